@@ -0,0 +1,207 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       buffer_pool.hpp
+ *
+ * Purpose:    Hand out device buffers from a few large allocations and
+ *             reuse them, instead of creating a new cl::Buffer every run
+ *
+ * Usage:      util::BufferPool pool(context, device);
+ *
+ *             cl::Buffer d_a = pool.acquire(sizeof(float) * n, CL_MEM_READ_ONLY);
+ *             ...
+ *             pool.release(d_a);       // d_a goes back in its bin
+ *             pool.print();            // live, peak and reserved bytes
+ *
+ *             Requests are rounded up to a size class: a power of two no
+ *             smaller than the device's CL_DEVICE_MEM_BASE_ADDR_ALIGN, up
+ *             to the slab size.  A buffer of a class is a sub-buffer
+ *             (clCreateSubBuffer) cut from the current slab, a
+ *             CL_MEM_READ_WRITE buffer of slab_bytes, and a released
+ *             buffer waits in the bin of its class and access flags for
+ *             the next request of the same class.  So a loop that
+ *             acquires and releases the same sizes each iteration only
+ *             creates buffers on its first pass.
+ *
+ *             Requests larger than a slab are rounded up to whole slabs
+ *             and get a buffer of their own, kept in a bin the same way.
+ *
+ *             Only the access flags (CL_MEM_READ_WRITE, CL_MEM_READ_ONLY,
+ *             CL_MEM_WRITE_ONLY) may be given; sub-buffers cannot copy or
+ *             use host memory.  Write the data after acquiring.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             Memory only goes back to OpenCL when the pool is destroyed
+ *             (or trim() frees the unused large buffers), so the buffers
+ *             handed out must not outlive the pool, and must be released
+ *             to the pool they came from.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace util {
+
+class BufferPool
+{
+public:
+    // Byte counts of the pool so far
+    struct Stats
+    {
+        cl_ulong live;        // bytes in buffers handed out (whole size classes)
+        cl_ulong requested;   // bytes asked for by the buffers handed out
+        cl_ulong peak;        // most live bytes at any one time
+        cl_ulong reserved;    // bytes allocated from OpenCL (slabs and large buffers)
+        unsigned int slabs;   // slabs allocated
+        unsigned int acquires;
+        unsigned int reuses;  // acquires served from a bin
+    };
+
+    BufferPool(const cl::Context& context, const cl::Device& device,
+               ::size_t slab_bytes = 64 << 20)
+        : context_(context), slab_bytes_(slab_bytes), used_(0)
+    {
+        // The alignment is given in bits
+        align_ = device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8;
+        if (align_ < 256)
+            align_ = 256;
+
+        cl_ulong max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+        if (slab_bytes_ > max_alloc)
+            slab_bytes_ = (::size_t)max_alloc;
+        slab_bytes_ = classBytes(slab_bytes_ / 2 + 1);
+
+        Stats zero = { 0, 0, 0, 0, 0, 0, 0 };
+        stats_ = zero;
+    }
+
+    //! A buffer of at least bytes bytes, with the given access flags
+    cl::Buffer acquire(::size_t bytes, cl_mem_flags flags = CL_MEM_READ_WRITE)
+    {
+        const cl_mem_flags access = CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY;
+        if (flags & ~access)
+            throw cl::Error(CL_INVALID_VALUE, "util::BufferPool::acquire (only access flags)");
+        if (bytes == 0)
+            bytes = 1;
+
+        ::size_t size = bytes > slab_bytes_
+            ? (bytes + slab_bytes_ - 1) / slab_bytes_ * slab_bytes_
+            : classBytes(bytes);
+        Bin& bin = bins_[std::make_pair(size, flags)];
+
+        cl::Buffer buffer;
+        stats_.acquires++;
+        if (!bin.empty())
+        {
+            buffer = bin.back();
+            bin.pop_back();
+            stats_.reuses++;
+        }
+        else if (size >= slab_bytes_)
+        {
+            TraceSpan span("create buffer", "pool");
+            buffer = cl::Buffer(context_, flags, size);
+            stats_.reserved += size;
+        }
+        else
+        {
+            if (slabs_.empty() || used_ + size > slab_bytes_)
+            {
+                TraceSpan span("create buffer", "pool slab");
+                slabs_.push_back(cl::Buffer(context_, CL_MEM_READ_WRITE, slab_bytes_));
+                used_ = 0;
+                stats_.reserved += slab_bytes_;
+                stats_.slabs++;
+            }
+            cl_buffer_region region = { used_, size };
+            buffer = slabs_.back().createSubBuffer(flags, CL_BUFFER_CREATE_TYPE_REGION, &region);
+            used_ += size;
+        }
+
+        Block block = { size, flags, bytes };
+        live_[buffer()] = block;
+        stats_.live += size;
+        stats_.requested += bytes;
+        if (stats_.live > stats_.peak)
+            stats_.peak = stats_.live;
+        return buffer;
+    }
+
+    //! Give a buffer from acquire() back to the pool
+    void release(const cl::Buffer& buffer)
+    {
+        std::map<cl_mem, Block>::iterator b = live_.find(buffer());
+        if (b == live_.end())
+            throw cl::Error(CL_INVALID_MEM_OBJECT, "util::BufferPool::release (not from this pool)");
+
+        const Block& block = b->second;
+        bins_[std::make_pair(block.size, block.flags)].push_back(buffer);
+        stats_.live -= block.size;
+        stats_.requested -= block.bytes;
+        live_.erase(b);
+    }
+
+    //! Free the large buffers waiting in bins (slabs are kept: their
+    //! sub-buffers may be in use)
+    void trim()
+    {
+        for (std::map<Key, Bin>::iterator b = bins_.begin(); b != bins_.end(); ++b)
+        {
+            if (b->first.first < slab_bytes_)
+                continue;
+            stats_.reserved -= (cl_ulong)b->first.first * b->second.size();
+            b->second.clear();
+        }
+    }
+
+    const Stats& stats() const { return stats_; }
+
+    void print() const
+    {
+        printf("\n Buffer pool: %.1f MB live (%.1f MB asked for), %.1f MB peak,"
+               " %.1f MB reserved in %u slabs;\n %u buffers handed out, %u of them reused\n",
+               stats_.live / 1.0e6, stats_.requested / 1.0e6, stats_.peak / 1.0e6,
+               stats_.reserved / 1.0e6, stats_.slabs, stats_.acquires, stats_.reuses);
+    }
+
+private:
+    typedef std::pair< ::size_t, cl_mem_flags> Key;
+    typedef std::vector<cl::Buffer> Bin;
+
+    struct Block
+    {
+        ::size_t     size;    // size class
+        cl_mem_flags flags;
+        ::size_t     bytes;   // as asked for
+    };
+
+    cl::Context               context_;
+    ::size_t                  slab_bytes_;
+    ::size_t                  align_;
+    ::size_t                  used_;      // bytes cut from the current slab
+    std::vector<cl::Buffer>   slabs_;
+    std::map<Key, Bin>        bins_;
+    std::map<cl_mem, Block>   live_;
+    Stats                     stats_;
+
+    // The power of two at least bytes and the alignment
+    ::size_t classBytes(::size_t bytes) const
+    {
+        ::size_t size = align_;
+        while (size < bytes)
+            size *= 2;
+        return size;
+    }
+
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+};
+
+} // namespace util
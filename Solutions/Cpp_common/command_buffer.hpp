@@ -0,0 +1,202 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       command_buffer.hpp
+ *
+ * Purpose:    Record a sequence of kernel launches once and replay it many
+ *             times, with cl_khr_command_buffer where the device has it
+ *
+ * Usage:      util::CommandRecording rec(queue);
+ *             rec.record(kernel_a, global, local);   // arguments as set now
+ *             rec.record(kernel_b, global, local);
+ *             rec.finalize();
+ *             for (int i = 0; i < repeats; i++)
+ *                 rec.enqueue(queue);                 // a then b, in order
+ *
+ *             With cl_khr_command_buffer the launches become one
+ *             command-buffer, built and checked by the driver when it is
+ *             finalized, so a replay is a single clEnqueueCommandBufferKHR
+ *             however many launches it holds.  Each launch waits on the
+ *             one before through a sync point, as on an in-order queue.
+ *
+ *             Without it (native() is false) a replay enqueues the
+ *             launches straight through clEnqueueNDRangeKernel, from
+ *             sizes worked out when they were recorded and with no
+ *             events, then flushes once, so they reach the device as one
+ *             batch.
+ *
+ *             Either way, the kernels' arguments must not change after
+ *             they are recorded: a command-buffer holds the values they
+ *             had, and the fallback uses the values they have.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             The extension's types and entry points are declared here so
+ *             that OpenCL 1.2 headers will do.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace util {
+
+class CommandRecording
+{
+public:
+    explicit CommandRecording(const cl::CommandQueue& queue)
+        : queue_(queue), buffer_(NULL), create_(NULL), command_(NULL), finish_(NULL),
+          enqueue_(NULL), release_(NULL), finalized_(false)
+    {
+        cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+        std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+        if (extensions.find("cl_khr_command_buffer") == std::string::npos)
+            return;
+
+        cl_platform_id platform = device.getInfo<CL_DEVICE_PLATFORM>();
+        create_   = (Create)lookup(platform, "clCreateCommandBufferKHR");
+        command_  = (Command)lookup(platform, "clCommandNDRangeKernelKHR");
+        finish_   = (Finalize)lookup(platform, "clFinalizeCommandBufferKHR");
+        enqueue_  = (Enqueue)lookup(platform, "clEnqueueCommandBufferKHR");
+        release_  = (Release)lookup(platform, "clReleaseCommandBufferKHR");
+        if (!create_ || !command_ || !finish_ || !enqueue_ || !release_)
+            return;
+
+        cl_command_queue q = queue_();
+        cl_int err;
+        buffer_ = create_(1, &q, NULL, &err);
+        if (err != CL_SUCCESS)
+            buffer_ = NULL;
+    }
+
+    ~CommandRecording()
+    {
+        if (buffer_)
+            release_(buffer_);
+    }
+
+    //! Add a launch of kernel, with its arguments as they are now
+    void record(const cl::Kernel& kernel, const cl::NDRange& global,
+                const cl::NDRange& local = cl::NullRange)
+    {
+        if (finalized_)
+            throw cl::Error(CL_INVALID_OPERATION, "util::CommandRecording (record after finalize)");
+
+        Launch launch;
+        launch.kernel = kernel;
+        launch.dims = (cl_uint)global.dimensions();
+        for (cl_uint d = 0; d < launch.dims; d++)
+        {
+            launch.global[d] = ((const ::size_t *)global)[d];
+            launch.local[d] = local.dimensions() ? ((const ::size_t *)local)[d] : 0;
+        }
+        launch.has_local = local.dimensions() != 0;
+        launches_.push_back(launch);
+
+        // A native recording that cannot take the launch becomes a batch
+        if (buffer_)
+        {
+            const cl_uint waits = sync_points_.empty() ? 0 : 1;
+            cl_uint point = 0;
+            cl_int err = command_(buffer_, NULL, NULL, kernel(), launch.dims, NULL,
+                                  launch.global, launch.has_local ? launch.local : NULL,
+                                  waits, waits ? &sync_points_.back() : NULL, &point, NULL);
+            if (err == CL_SUCCESS)
+                sync_points_.push_back(point);
+            else
+                drop();
+        }
+    }
+
+    //! Finish recording; replays may follow
+    void finalize()
+    {
+        if (buffer_ && finish_(buffer_) != CL_SUCCESS)
+            drop();
+        finalized_ = true;
+    }
+
+    //! Run the recorded launches once more, in order, after whatever is
+    //! already on the queue (which must be the one recorded with)
+    void enqueue(cl::CommandQueue& queue)
+    {
+        if (!finalized_)
+            throw cl::Error(CL_INVALID_OPERATION, "util::CommandRecording (enqueue before finalize)");
+
+        cl_command_queue q = queue();
+        if (buffer_)
+        {
+            cl_int err = enqueue_(1, &q, buffer_, 0, NULL, NULL);
+            if (err != CL_SUCCESS)
+                throw cl::Error(err, "util::CommandRecording (clEnqueueCommandBufferKHR)");
+            return;
+        }
+
+        for (std::vector<Launch>::size_type i = 0; i < launches_.size(); i++)
+        {
+            const Launch& l = launches_[i];
+            cl_int err = ::clEnqueueNDRangeKernel(q, l.kernel(), l.dims, NULL, l.global,
+                                                  l.has_local ? l.local : NULL, 0, NULL, NULL);
+            if (err != CL_SUCCESS)
+                throw cl::Error(err, "util::CommandRecording (clEnqueueNDRangeKernel)");
+        }
+        ::clFlush(q);
+    }
+
+    //! True if replays go through cl_khr_command_buffer
+    bool native() const { return buffer_ != NULL; }
+
+    //! The launches in one replay
+    unsigned int size() const { return (unsigned int)launches_.size(); }
+
+private:
+    // cl_khr_command_buffer, as in cl_ext.h; properties are passed as NULL
+    typedef struct CommandBuffer_* CommandBuffer;
+    typedef CommandBuffer (CL_API_CALL *Create)(cl_uint, const cl_command_queue *,
+                                                const cl_bitfield *, cl_int *);
+    typedef cl_int (CL_API_CALL *Command)(CommandBuffer, cl_command_queue, const cl_bitfield *,
+                                          cl_kernel, cl_uint, const ::size_t *, const ::size_t *,
+                                          const ::size_t *, cl_uint, const cl_uint *, cl_uint *,
+                                          void **);
+    typedef cl_int (CL_API_CALL *Finalize)(CommandBuffer);
+    typedef cl_int (CL_API_CALL *Enqueue)(cl_uint, cl_command_queue *, CommandBuffer,
+                                          cl_uint, const cl_event *, cl_event *);
+    typedef cl_int (CL_API_CALL *Release)(CommandBuffer);
+
+    struct Launch
+    {
+        cl::Kernel  kernel;
+        cl_uint     dims;
+        ::size_t    global[3], local[3];
+        bool        has_local;
+    };
+
+    static void *lookup(cl_platform_id platform, const char *name)
+    {
+        return ::clGetExtensionFunctionAddressForPlatform(platform, name);
+    }
+
+    // Give up on the command-buffer and replay as a batch
+    void drop()
+    {
+        release_(buffer_);
+        buffer_ = NULL;
+    }
+
+    CommandRecording(const CommandRecording&);
+    CommandRecording& operator=(const CommandRecording&);
+
+    cl::CommandQueue        queue_;
+    CommandBuffer           buffer_;
+    Create                  create_;
+    Command                 command_;
+    Finalize                finish_;
+    Enqueue                 enqueue_;
+    Release                 release_;
+    bool                    finalized_;
+    std::vector<Launch>     launches_;
+    std::vector<cl_uint>    sync_points_;
+};
+
+} // namespace util
@@ -7,6 +7,14 @@
  * Note:       Must be included AFTER the relevant OpenCL header
  *             See one of the Matrix Multiply exercises for usage
  *
+ *             The platforms are enumerated and each device's name and
+ *             capabilities queried once per run (getDeviceInventory), so
+ *             --list, --device-type, --best and getDeviceList share the
+ *             one query.  --device-type and --best set the device index
+ *             to the first device of a type, or to the best device of a
+ *             type (or of all): GPUs before accelerators before CPUs,
+ *             then the most compute units times clock.
+ *
  * HISTORY:    Method written by James Price, October 2014
  *             Extracted to a common header by Tom Deakin, November 2014
  */
@@ -19,10 +27,45 @@
 
 #define MAX_INFO_STRING 256
 
+// What a device can do, as queried once per run
+struct DeviceCaps
+{
+  cl::Device     device;
+  std::string    name;
+  std::string    platform;
+  cl_device_type type;
+  cl_uint        compute_units;
+  cl_uint        clock_mhz;
+  cl_ulong       global_mem;       // bytes
+  cl_ulong       local_mem;        // bytes
+  cl_ulong       max_alloc;        // bytes
+  ::size_t       max_work_group;
+  cl_uint        vector_float;     // preferred vector widths
+  cl_uint        vector_double;
+  bool           fp64;
+};
 
-unsigned getDeviceList(std::vector<cl::Device>& devices)
+void queryDeviceName(cl::Device& device, std::string& name)
 {
-  cl_int err;
+  cl_device_info info = CL_DEVICE_NAME;
+
+  // Special case for AMD
+#ifdef CL_DEVICE_BOARD_NAME_AMD
+  device.getInfo(CL_DEVICE_VENDOR, &name);
+  if (strstr(name.c_str(), "Advanced Micro Devices"))
+    info = CL_DEVICE_BOARD_NAME_AMD;
+#endif
+
+  device.getInfo(info, &name);
+}
+
+const std::vector<DeviceCaps>& getDeviceInventory()
+{
+  static std::vector<DeviceCaps> inventory;
+  static bool listed = false;
+  if (listed)
+    return inventory;
+  listed = true;
 
   // Get list of platforms
   std::vector<cl::Platform> platforms;
@@ -31,27 +74,88 @@ unsigned getDeviceList(std::vector<cl::Device>& devices)
   // Enumerate devices
   for (int i = 0; i < platforms.size(); i++)
   {
-    cl_uint num = 0;
     std::vector<cl::Device> plat_devices;
     platforms[i].getDevices(CL_DEVICE_TYPE_ALL, &plat_devices);
-    devices.insert(devices.end(), plat_devices.begin(), plat_devices.end());
+    std::string platform = platforms[i].getInfo<CL_PLATFORM_NAME>();
+
+    for (int d = 0; d < plat_devices.size(); d++)
+    {
+      DeviceCaps caps;
+      cl::Device& device = plat_devices[d];
+      caps.device         = device;
+      queryDeviceName(device, caps.name);
+      caps.platform       = platform;
+      caps.type           = device.getInfo<CL_DEVICE_TYPE>();
+      caps.compute_units  = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+      caps.clock_mhz      = device.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>();
+      caps.global_mem     = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+      caps.local_mem      = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+      caps.max_alloc      = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+      caps.max_work_group = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+      caps.vector_float   = device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>();
+      caps.vector_double  = device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE>();
+      caps.fp64 = device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") != std::string::npos;
+      inventory.push_back(caps);
+    }
   }
 
+  return inventory;
+}
+
+// The capabilities of a device from the inventory, or NULL if it is
+// not in it (such as a sub-device)
+const DeviceCaps* getDeviceCaps(const cl::Device& device)
+{
+  const std::vector<DeviceCaps>& inventory = getDeviceInventory();
+  for (int i = 0; i < inventory.size(); i++)
+    if (inventory[i].device() == device())
+      return &inventory[i];
+  return NULL;
+}
+
+unsigned getDeviceList(std::vector<cl::Device>& devices)
+{
+  const std::vector<DeviceCaps>& inventory = getDeviceInventory();
+  for (int i = 0; i < inventory.size(); i++)
+    devices.push_back(inventory[i].device);
+
   return devices.size();
 }
 
 void getDeviceName(cl::Device& device, std::string& name)
 {
-  cl_device_info info = CL_DEVICE_NAME;
+  const DeviceCaps* caps = getDeviceCaps(device);
+  if (caps)
+    name = caps->name;
+  else
+    queryDeviceName(device, name);
+}
 
-  // Special case for AMD
-#ifdef CL_DEVICE_BOARD_NAME_AMD
-  device.getInfo(CL_DEVICE_VENDOR, &name);
-  if (strstr(name.c_str(), "Advanced Micro Devices"))
-    info = CL_DEVICE_BOARD_NAME_AMD;
-#endif
+// The device type for a --device-type name, or 0 if it is not one
+cl_device_type parseDeviceType(const char *str)
+{
+  if (!strcmp(str, "cpu"))
+    return CL_DEVICE_TYPE_CPU;
+  if (!strcmp(str, "gpu"))
+    return CL_DEVICE_TYPE_GPU;
+  if (!strcmp(str, "accelerator"))
+    return CL_DEVICE_TYPE_ACCELERATOR;
+  if (!strcmp(str, "all"))
+    return CL_DEVICE_TYPE_ALL;
+  return 0;
+}
 
-  device.getInfo(info, &name);
+// How --best ranks a device: its type, then compute units times clock
+cl_ulong deviceScore(const DeviceCaps& caps)
+{
+  cl_ulong rank = 0;
+  if (caps.type & CL_DEVICE_TYPE_GPU)
+    rank = 3;
+  else if (caps.type & CL_DEVICE_TYPE_ACCELERATOR)
+    rank = 2;
+  else if (caps.type & CL_DEVICE_TYPE_CPU)
+    rank = 1;
+  return (rank << 48) + (cl_ulong)caps.compute_units * caps.clock_mhz;
 }
 
 
@@ -62,34 +166,55 @@ int parseUInt(const char *str, cl_uint *output)
   return !strlen(next);
 }
 
-void parseArguments(int argc, char *argv[], cl_uint *deviceIndex)
+// Any program specific options can be described in usage, which is
+// printed after the common options by --help
+void parseArguments(int argc, char *argv[], cl_uint *deviceIndex, const char *usage = NULL)
 {
+  cl_device_type type = 0;
+  bool best = false;
+
   for (int i = 1; i < argc; i++)
   {
     if (!strcmp(argv[i], "--list"))
     {
-      // Get list of devices
-      std::vector<cl::Device> devices;
-      unsigned numDevices = getDeviceList(devices);
+      const std::vector<DeviceCaps>& inventory = getDeviceInventory();
 
-      // Print device names
-      if (numDevices == 0)
+      // Print device names and capabilities
+      if (inventory.size() == 0)
       {
         std::cout << "No devices found.\n";
       }
       else
       {
         std::cout << "\nDevices:\n";
-        for (int i = 0; i < numDevices; i++)
+        for (int i = 0; i < inventory.size(); i++)
         {
-          std::string name;
-          getDeviceName(devices[i], name);
-          std::cout << i << ": " << name << "\n";
+          const DeviceCaps& caps = inventory[i];
+          std::cout << i << ": " << caps.name << "\n"
+                    << "     " << caps.platform << ", "
+                    << caps.compute_units << " compute units at " << caps.clock_mhz << " MHz, "
+                    << caps.global_mem / (1024 * 1024) << " MB global, "
+                    << caps.local_mem / 1024 << " KB local, "
+                    << "work-groups of " << caps.max_work_group << ", "
+                    << "float" << caps.vector_float
+                    << (caps.fp64 ? ", fp64" : "") << "\n";
         }
         std::cout << "\n";
       }
       exit(0);
     }
+    else if (!strcmp(argv[i], "--device-type"))
+    {
+      if (++i >= argc || !(type = parseDeviceType(argv[i])))
+      {
+        std::cout << "Invalid device type (try cpu, gpu, accelerator or all)\n";
+        exit(1);
+      }
+    }
+    else if (!strcmp(argv[i], "--best"))
+    {
+      best = true;
+    }
     else if (!strcmp(argv[i], "--device"))
     {
       if (++i >= argc || !parseUInt(argv[i], deviceIndex))
@@ -106,9 +231,36 @@ void parseArguments(int argc, char *argv[], cl_uint *deviceIndex)
       std::cout << "  -h  --help               Print the message\n";
       std::cout << "      --list               List available devices\n";
       std::cout << "      --device     INDEX   Select device at INDEX\n";
+      std::cout << "      --device-type TYPE   Select the first cpu, gpu or accelerator device\n";
+      std::cout << "      --best               Select the fastest looking device (of TYPE)\n";
+      if (usage)
+        std::cout << usage;
       std::cout << "\n";
       exit(0);
     }
   }
+
+  if (type == 0 && !best)
+    return;
+
+  // Pick from the devices of the type
+  const std::vector<DeviceCaps>& inventory = getDeviceInventory();
+  int chosen = -1;
+  for (int i = 0; i < inventory.size(); i++)
+  {
+    if (type && !(inventory[i].type & type))
+      continue;
+    if (chosen < 0 || (best && deviceScore(inventory[i]) > deviceScore(inventory[chosen])))
+      chosen = i;
+    if (!best)
+      break;
+  }
+
+  if (chosen < 0)
+  {
+    std::cout << "No device of that type (try '--list')\n";
+    exit(1);
+  }
+  *deviceIndex = chosen;
 }
 
@@ -0,0 +1,141 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       device_profile.hpp
+ *
+ * Purpose:    Store and load the measured characteristics of a device:
+ *             bandwidths, barrier cost, launch latency and peak FLOP rate
+ *
+ * Usage:      util::DeviceProfile profile(device);
+ *             if (profile.has("global_copy_gbps"))
+ *                 gbps = profile.get("global_copy_gbps");
+ *
+ *             The profile is written by the microbenchmarks
+ *             (Exercise01/Cpp/microbench), one plain text file a device
+ *             named as its tuning file but ending .profile, in the same
+ *             OCL_TUNING_DIR.  Each line holds one figure:
+ *
+ *                 local_gbps 1843.2 # 256 work-items, 4096 floats
+ *
+ *             The roofline report takes its peaks from here when there
+ *             is a profile, and the auto-tuner the smallest difference
+ *             in time it believes.  The keys written are:
+ *
+ *                 launch_us           enqueue to finish of an empty kernel
+ *                 enqueue_us          host time for one non-blocking enqueue
+ *                 kernel_min_us       device time of an empty kernel
+ *                 global_copy_gbps    copying, neighbours reading neighbours
+ *                 global_strided_gbps copying, reads STRIDE floats apart
+ *                 local_gbps          reads and writes of local memory
+ *                 barrier_ns          one work-group barrier
+ *                 peak_gflops         float FMAs with no memory traffic
+ *
+ * Note:       Must be included AFTER cl.hpp
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+
+#include "tuning.hpp"
+
+namespace util {
+
+class DeviceProfile
+{
+public:
+    //! Open (but do not require) the profile of a device
+    explicit DeviceProfile(const cl::Device& device)
+    {
+        device_ = device.getInfo<CL_DEVICE_NAME>();
+        path_ = deviceFilePath(device_, "profile");
+        load();
+    }
+
+    //! The file backing this device's profile
+    const std::string& path() const { return path_; }
+
+    //! (Re)read the profile; returns false if there is none
+    bool load()
+    {
+        std::ifstream stream(path_.c_str());
+        if (!stream.is_open())
+            return false;
+
+        values_.clear();
+        notes_.clear();
+
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            std::string note;
+            std::string::size_type hash = line.find('#');
+            if (hash != std::string::npos)
+            {
+                note = line.substr(hash + 1);
+                line = line.substr(0, hash);
+            }
+
+            std::istringstream words(line);
+            std::string key;
+            double value;
+            if (words >> key >> value)
+            {
+                values_[key] = value;
+                notes_[key] = note;
+            }
+        }
+        return true;
+    }
+
+    //! Write the profile back
+    bool save() const
+    {
+        std::ofstream stream(path_.c_str());
+        if (!stream.is_open())
+            return false;
+
+        stream << "# Measured profile of " << device_ << "\n";
+        for (std::map<std::string, double>::const_iterator v = values_.begin();
+             v != values_.end(); ++v)
+        {
+            stream << v->first << " " << v->second;
+            std::map<std::string, std::string>::const_iterator n = notes_.find(v->first);
+            if (n != notes_.end() && !n->second.empty())
+                stream << " #" << n->second;
+            stream << "\n";
+        }
+        return true;
+    }
+
+    bool has(const std::string& key) const
+    {
+        return values_.find(key) != values_.end();
+    }
+
+    //! A figure, or fallback if it has not been measured
+    double get(const std::string& key, double fallback = 0.0) const
+    {
+        std::map<std::string, double>::const_iterator v = values_.find(key);
+        return v != values_.end() ? v->second : fallback;
+    }
+
+    void set(const std::string& key, double value, const std::string& note = "")
+    {
+        values_[key] = value;
+        notes_[key] = note.empty() ? "" : " " + note;
+    }
+
+private:
+    std::string                         path_;
+    std::string                         device_;
+    std::map<std::string, double>       values_;
+    std::map<std::string, std::string>  notes_;
+};
+
+} // namespace util
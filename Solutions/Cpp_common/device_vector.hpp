@@ -0,0 +1,319 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       device_vector.hpp
+ *
+ * Purpose:    Vectors that stay on the device, with elementwise arithmetic
+ *             compiled to one OpenCL kernel per expression
+ *
+ * Usage:      util::VectorContext vc(context, device, queue);
+ *             util::DeviceVector<float> a(vc, h_a), b(vc, h_b), d(vc, n);
+ *
+ *             d = a * 2.0f + b;        // one kernel, no temporaries
+ *             d = d + a + b;
+ *             d.read(h_d);
+ *
+ *             The right hand side of an assignment is an expression
+ *             template: + - * / of vectors and scalars build a tree of
+ *             types, not vectors.  On assignment the tree is turned into
+ *             the source of a kernel that computes every element of the
+ *             result in one pass, reading each vector once.
+ *
+ *             The kernel is built the first time each expression shape is
+ *             assigned and kept in the VectorContext, keyed by its
+ *             source, so repeating an assignment in a loop only sets the
+ *             arguments and launches.  Scalars are kernel arguments, so a
+ *             new value does not mean a new kernel.
+ *
+ *             Data moves between host and device only through the
+ *             std::vector constructor, write() and read().  Scalars have
+ *             the element type (write 2.0f, not 2, for floats).
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "program_cache.hpp"
+#include "reduce.hpp"
+
+namespace util {
+
+// The context, device and queue device vectors live on, and the kernels
+// compiled for their expressions
+class VectorContext
+{
+public:
+    VectorContext(const cl::Context& context, const cl::Device& device,
+                  const cl::CommandQueue& queue)
+        : context_(context), device_(device), queue_(queue)
+    {
+    }
+
+    const cl::Context& context() const { return context_; }
+    cl::CommandQueue& queue() { return queue_; }
+
+    //! The kernel "expr" in source, built on first use
+    cl::Kernel& kernel(const std::string& source)
+    {
+        std::map<std::string, cl::Kernel>::iterator k = kernels_.find(source);
+        if (k != kernels_.end())
+            return k->second;
+
+        cl::Program program = buildProgram(context_, device_, source);
+        return kernels_[source] = cl::Kernel(program, "expr");
+    }
+
+    //! Number of distinct expressions compiled so far
+    ::size_t kernels() const { return kernels_.size(); }
+
+private:
+    cl::Context      context_;
+    cl::Device       device_;
+    cl::CommandQueue queue_;
+    std::map<std::string, cl::Kernel> kernels_;
+};
+
+// Arguments and code gathered while walking an expression tree
+template <typename T>
+struct ExprBuilder
+{
+    ::size_t                size;       // elements in every vector
+    std::vector<cl::Buffer> buffers;    // v0, v1, ...
+    std::vector<T>          scalars;    // s0, s1, ...
+
+    // Name of a vector argument, passing each buffer once
+    std::string vector(const cl::Buffer& buffer, ::size_t n)
+    {
+        if (n != size)
+            throw cl::Error(CL_INVALID_VALUE, "util::DeviceVector (sizes differ)");
+
+        unsigned v = 0;
+        while (v < buffers.size() && buffers[v]() != buffer())
+            v++;
+        if (v == buffers.size())
+            buffers.push_back(buffer);
+
+        std::ostringstream name;
+        name << "v" << v << "[i]";
+        return name.str();
+    }
+
+    std::string scalar(const T& value)
+    {
+        std::ostringstream name;
+        name << "s" << scalars.size();
+        scalars.push_back(value);
+        return name.str();
+    }
+};
+
+template <typename T> class DeviceVector;
+
+// Leaf: a device vector
+template <typename T>
+struct VecTerm
+{
+    const DeviceVector<T> *vec;
+    explicit VecTerm(const DeviceVector<T>& v) : vec(&v) {}
+    std::string emit(ExprBuilder<T>& b) const { return b.vector(vec->buffer(), vec->size()); }
+};
+
+// Leaf: a scalar, the same for every element
+template <typename T>
+struct ScalarTerm
+{
+    T value;
+    explicit ScalarTerm(const T& v) : value(v) {}
+    std::string emit(ExprBuilder<T>& b) const { return b.scalar(value); }
+};
+
+struct OpAdd { static const char *symbol() { return " + "; } };
+struct OpSub { static const char *symbol() { return " - "; } };
+struct OpMul { static const char *symbol() { return " * "; } };
+struct OpDiv { static const char *symbol() { return " / "; } };
+
+// Node: L op R
+template <typename T, typename L, typename R, typename Op>
+struct BinaryTerm
+{
+    L left;
+    R right;
+    BinaryTerm(const L& l, const R& r) : left(l), right(r) {}
+    std::string emit(ExprBuilder<T>& b) const
+    {
+        std::string l = left.emit(b);
+        return "(" + l + Op::symbol() + right.emit(b) + ")";
+    }
+};
+
+// An expression of element type T, held by value (the leaves hold
+// pointers to the vectors, so it must be used within the statement)
+template <typename T, typename E>
+struct Expr
+{
+    E term;
+    explicit Expr(const E& e) : term(e) {}
+};
+
+template <typename T>
+class DeviceVector
+{
+public:
+    //! Uninitialised vector of n elements
+    DeviceVector(VectorContext& vc, ::size_t n)
+        : vc_(&vc), size_(n),
+          buffer_(vc.context(), CL_MEM_READ_WRITE, sizeof(T) * n)
+    {
+    }
+
+    //! Vector holding a copy of host
+    DeviceVector(VectorContext& vc, const std::vector<T>& host)
+        : vc_(&vc), size_(host.size()),
+          buffer_(vc.context(), CL_MEM_READ_WRITE, sizeof(T) * host.size())
+    {
+        write(host);
+    }
+
+    //! Element copy of another vector of the same size
+    DeviceVector& operator=(const DeviceVector& other)
+    {
+        if (this != &other)
+            *this = Expr<T, VecTerm<T> >(VecTerm<T>(other));
+        return *this;
+    }
+
+    //! Evaluate an expression into this vector, with one kernel
+    template <typename E>
+    DeviceVector& operator=(const Expr<T, E>& expr)
+    {
+        ExprBuilder<T> b;
+        b.size = size_;
+        std::string code = expr.term.emit(b);
+
+        std::ostringstream src;
+        if (std::string(ClType<T>::name()) == "double")
+            src << "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+        src << "__kernel void expr(const unsigned int n, __global " << ClType<T>::name() << "* out";
+        for (unsigned v = 0; v < b.buffers.size(); v++)
+            src << ", __global const " << ClType<T>::name() << "* v" << v;
+        for (unsigned s = 0; s < b.scalars.size(); s++)
+            src << ", const " << ClType<T>::name() << " s" << s;
+        src << ")\n{\n   unsigned int i = get_global_id(0);\n"
+            << "   if (i < n)\n      out[i] = " << code << ";\n}\n";
+
+        cl::Kernel& kernel = vc_->kernel(src.str());
+        unsigned arg = 0;
+        kernel.setArg(arg++, (cl_uint)size_);
+        kernel.setArg(arg++, buffer_);
+        for (unsigned v = 0; v < b.buffers.size(); v++)
+            kernel.setArg(arg++, b.buffers[v]);
+        for (unsigned s = 0; s < b.scalars.size(); s++)
+            kernel.setArg(arg++, b.scalars[s]);
+
+        if (size_ > 0)
+            vc_->queue().enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(size_));
+        return *this;
+    }
+
+    //! Copy host (of size() elements) to the device
+    void write(const std::vector<T>& host)
+    {
+        if (host.size() != size_)
+            throw cl::Error(CL_INVALID_VALUE, "util::DeviceVector::write (sizes differ)");
+        if (size_ > 0)
+            vc_->queue().enqueueWriteBuffer(buffer_, CL_TRUE, 0, sizeof(T) * size_, &host[0]);
+    }
+
+    //! Copy the vector back to host, once the kernels writing it are done
+    void read(std::vector<T>& host) const
+    {
+        host.resize(size_);
+        if (size_ > 0)
+            vc_->queue().enqueueReadBuffer(buffer_, CL_TRUE, 0, sizeof(T) * size_, &host[0]);
+    }
+
+    ::size_t size() const { return size_; }
+    const cl::Buffer& buffer() const { return buffer_; }
+
+private:
+    VectorContext *vc_;
+    ::size_t       size_;
+    cl::Buffer     buffer_;
+
+    // Copies would share the buffer; use assignment to copy the elements
+    DeviceVector(const DeviceVector&);
+};
+
+// The operators, for every mix of expression, vector and scalar operands
+#define UTIL_DEVICE_VECTOR_OPERATOR(op, Op)                                         \
+template <typename T, typename L, typename R>                                       \
+inline Expr<T, BinaryTerm<T, L, R, Op> >                                            \
+operator op(const Expr<T, L>& l, const Expr<T, R>& r)                               \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, L, R, Op> >(BinaryTerm<T, L, R, Op>(l.term, r.term)); \
+}                                                                                   \
+template <typename T, typename L>                                                   \
+inline Expr<T, BinaryTerm<T, L, VecTerm<T>, Op> >                                   \
+operator op(const Expr<T, L>& l, const DeviceVector<T>& r)                          \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, L, VecTerm<T>, Op> >(                              \
+        BinaryTerm<T, L, VecTerm<T>, Op>(l.term, VecTerm<T>(r)));                   \
+}                                                                                   \
+template <typename T, typename R>                                                   \
+inline Expr<T, BinaryTerm<T, VecTerm<T>, R, Op> >                                   \
+operator op(const DeviceVector<T>& l, const Expr<T, R>& r)                          \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, VecTerm<T>, R, Op> >(                              \
+        BinaryTerm<T, VecTerm<T>, R, Op>(VecTerm<T>(l), r.term));                   \
+}                                                                                   \
+template <typename T>                                                               \
+inline Expr<T, BinaryTerm<T, VecTerm<T>, VecTerm<T>, Op> >                          \
+operator op(const DeviceVector<T>& l, const DeviceVector<T>& r)                     \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, VecTerm<T>, VecTerm<T>, Op> >(                     \
+        BinaryTerm<T, VecTerm<T>, VecTerm<T>, Op>(VecTerm<T>(l), VecTerm<T>(r)));   \
+}                                                                                   \
+template <typename T, typename L>                                                   \
+inline Expr<T, BinaryTerm<T, L, ScalarTerm<T>, Op> >                                \
+operator op(const Expr<T, L>& l, const T& r)                                        \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, L, ScalarTerm<T>, Op> >(                           \
+        BinaryTerm<T, L, ScalarTerm<T>, Op>(l.term, ScalarTerm<T>(r)));             \
+}                                                                                   \
+template <typename T, typename R>                                                   \
+inline Expr<T, BinaryTerm<T, ScalarTerm<T>, R, Op> >                                \
+operator op(const T& l, const Expr<T, R>& r)                                        \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, ScalarTerm<T>, R, Op> >(                           \
+        BinaryTerm<T, ScalarTerm<T>, R, Op>(ScalarTerm<T>(l), r.term));             \
+}                                                                                   \
+template <typename T>                                                               \
+inline Expr<T, BinaryTerm<T, VecTerm<T>, ScalarTerm<T>, Op> >                       \
+operator op(const DeviceVector<T>& l, const T& r)                                   \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, VecTerm<T>, ScalarTerm<T>, Op> >(                  \
+        BinaryTerm<T, VecTerm<T>, ScalarTerm<T>, Op>(VecTerm<T>(l), ScalarTerm<T>(r))); \
+}                                                                                   \
+template <typename T>                                                               \
+inline Expr<T, BinaryTerm<T, ScalarTerm<T>, VecTerm<T>, Op> >                       \
+operator op(const T& l, const DeviceVector<T>& r)                                   \
+{                                                                                   \
+    return Expr<T, BinaryTerm<T, ScalarTerm<T>, VecTerm<T>, Op> >(                  \
+        BinaryTerm<T, ScalarTerm<T>, VecTerm<T>, Op>(ScalarTerm<T>(l), VecTerm<T>(r))); \
+}
+
+UTIL_DEVICE_VECTOR_OPERATOR(+, OpAdd)
+UTIL_DEVICE_VECTOR_OPERATOR(-, OpSub)
+UTIL_DEVICE_VECTOR_OPERATOR(*, OpMul)
+UTIL_DEVICE_VECTOR_OPERATOR(/, OpDiv)
+
+#undef UTIL_DEVICE_VECTOR_OPERATOR
+
+} // namespace util
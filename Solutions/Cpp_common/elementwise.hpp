@@ -0,0 +1,275 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       elementwise.hpp
+ *
+ * Purpose:    Generate elementwise kernels, out[i] = f(x0[i], x1[i], ...),
+ *             for any number of inputs, element type and expression f, in
+ *             place of a hand-written kernel for each (vadd, vadd_abc)
+ *
+ * Usage:      util::Elementwise ew(context, device);
+ *
+ *             // d = a + b + c, four floats a work-item, grid-stride
+ *             util::ElementwiseKernel& sum3 = ew.get(
+ *                 util::ElementwiseSpec("float", 3, "x0 + x1 + x2").width(4).gridStride());
+ *             sum3.input(0, d_a).input(1, d_b).input(2, d_c).output(d_d);
+ *             sum3.enqueue(queue, count);
+ *
+ *             // y = p0 * x + y, with p0 a kernel argument
+ *             util::ElementwiseKernel& axpy = ew.get(
+ *                 util::ElementwiseSpec("float", 2, "p0 * x0 + x1").scalars(1));
+ *             axpy.input(0, d_x).input(1, d_y).output(d_y).scalar(0, 2.0f);
+ *
+ *             The expression is OpenCL C in the inputs x0, x1, ... and the
+ *             scalars p0, p1, ...; with a width of 2, 4, 8 or 16 each
+ *             input is loaded as a vector of that many elements (vloadN),
+ *             so the expression must mean the same for a vector as for
+ *             one element, as arithmetic and the built-in functions do.
+ *             The elements past the last whole vector are done one at a
+ *             time.  The type is float, double (cl_khr_fp64), int or half:
+ *             halves are only stored as half, and loaded into and worked
+ *             on as float (vload_half), so need no cl_khr_fp16, and their
+ *             scalars are floats.
+ *
+ *             Without gridStride() there is a work-item for each vector;
+ *             with it, as many as fill the device (util::planGrid), each
+ *             looping over the vectors a grid apart.
+ *
+ *             Each kernel is generated and built the first time its spec
+ *             is asked for, then kept, keyed by the spec's signature, so
+ *             a new operation is a new string, not a new kernel file, and
+ *             asking again costs a map lookup.  The build goes through
+ *             buildProgram, so its binary is also in the program cache
+ *             between runs.  The arguments bound on a kernel stay bound,
+ *             as for any cl::Kernel, until set again.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "program_cache.hpp"
+#include "launch_plan.hpp"
+
+namespace util {
+
+// What kernel to generate: the element type, the inputs, the expression
+// and how the elements are shared out
+struct ElementwiseSpec
+{
+    std::string  type;          // float, double, int or half
+    unsigned int arity;         // inputs x0 .. x(arity - 1)
+    std::string  expr;
+    unsigned int nscalars;      // scalar arguments p0 .. p(nscalars - 1)
+    unsigned int vector;        // elements a load: 1, 2, 4, 8 or 16
+    bool         grid;          // loop over the vectors a grid apart
+
+    ElementwiseSpec(const std::string& type_, unsigned int arity_, const std::string& expr_)
+        : type(type_), arity(arity_), expr(expr_), nscalars(0), vector(1), grid(false)
+    {
+    }
+
+    ElementwiseSpec& scalars(unsigned int n) { nscalars = n; return *this; }
+    ElementwiseSpec& width(unsigned int n) { vector = n; return *this; }
+    ElementwiseSpec& gridStride(bool on = true) { grid = on; return *this; }
+
+    //! Everything the kernel is generated from, as one string
+    std::string signature() const
+    {
+        std::ostringstream sig;
+        sig << type << "/" << arity << "/" << nscalars << "/" << vector
+            << (grid ? "/grid" : "/item") << ": " << expr;
+        return sig.str();
+    }
+
+    //! The source of the kernel "elementwise"
+    std::string source() const
+    {
+        if (type != "float" && type != "double" && type != "int" && type != "half")
+            throw cl::Error(CL_INVALID_VALUE, "util::ElementwiseSpec (type not float, double, int or half)");
+        if (vector != 1 && vector != 2 && vector != 4 && vector != 8 && vector != 16)
+            throw cl::Error(CL_INVALID_VALUE, "util::ElementwiseSpec (width not 1, 2, 4, 8 or 16)");
+
+        const bool half = (type == "half");
+        const std::string work = half ? "float" : type;       // the type worked in
+        std::ostringstream n;
+        n << vector;
+        const std::string w = vector > 1 ? n.str() : "";
+        const std::string vtype = work + w;
+
+        std::ostringstream src;
+        if (type == "double")
+            src << "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+
+        src << "__kernel void elementwise(const unsigned int n, __global " << type << "* out";
+        for (unsigned int a = 0; a < arity; a++)
+            src << ", __global const " << type << "* in" << a;
+        for (unsigned int s = 0; s < nscalars; s++)
+            src << ", const " << work << " p" << s;
+        src << ")\n{\n";
+
+        // Whole vectors: v is a vector's index
+        src << "   const unsigned int nvec = n / " << vector << ";\n";
+        if (grid)
+            src << "   for (unsigned int v = get_global_id(0); v < nvec; v += get_global_size(0))\n";
+        else
+            src << "   const unsigned int v = get_global_id(0);\n"
+                << "   if (v < nvec)\n";
+        src << "   {\n";
+        for (unsigned int a = 0; a < arity; a++)
+        {
+            src << "      const " << vtype << " x" << a << " = ";
+            if (half)
+                src << "vload_half" << w << "(v, in" << a << ");\n";
+            else if (vector > 1)
+                src << "vload" << w << "(v, in" << a << ");\n";
+            else
+                src << "in" << a << "[v];\n";
+        }
+        if (half)
+            src << "      vstore_half" << w << "((" << vtype << ")(" << expr << "), v, out);\n";
+        else if (vector > 1)
+            src << "      vstore" << w << "((" << vtype << ")(" << expr << "), v, out);\n";
+        else
+            src << "      out[v] = " << expr << ";\n";
+        src << "   }\n";
+
+        // The rest, an element each for the first work-items
+        if (vector > 1)
+        {
+            if (grid)
+                src << "   for (unsigned int t = nvec * " << vector << " + get_global_id(0);"
+                    << " t < n; t += get_global_size(0))\n   {\n";
+            else
+                src << "   const unsigned int t = nvec * " << vector << " + get_global_id(0);\n"
+                    << "   if (t < n)\n   {\n";
+            for (unsigned int a = 0; a < arity; a++)
+            {
+                src << "      const " << work << " x" << a << " = ";
+                if (half)
+                    src << "vload_half(t, in" << a << ");\n";
+                else
+                    src << "in" << a << "[t];\n";
+            }
+            if (half)
+                src << "      vstore_half(" << expr << ", t, out);\n";
+            else
+                src << "      out[t] = " << expr << ";\n";
+            src << "   }\n";
+        }
+        src << "}\n";
+        return src.str();
+    }
+};
+
+// One generated kernel, with its arguments bound by name
+class ElementwiseKernel
+{
+public:
+    ElementwiseKernel(const ElementwiseSpec& spec, const cl::Kernel& kernel,
+                      const cl::Device& device)
+        : spec_(spec), kernel_(kernel), device_(device)
+    {
+    }
+
+    ElementwiseKernel& input(unsigned int a, const cl::Buffer& buffer)
+    {
+        if (a >= spec_.arity)
+            throw cl::Error(CL_INVALID_ARG_INDEX, "util::ElementwiseKernel::input");
+        kernel_.setArg(2 + a, buffer);
+        return *this;
+    }
+
+    ElementwiseKernel& output(const cl::Buffer& buffer)
+    {
+        kernel_.setArg(1, buffer);
+        return *this;
+    }
+
+    //! Scalar s: of the element type, or float for half
+    template <typename T>
+    ElementwiseKernel& scalar(unsigned int s, const T& value)
+    {
+        if (s >= spec_.nscalars)
+            throw cl::Error(CL_INVALID_ARG_INDEX, "util::ElementwiseKernel::scalar");
+        kernel_.setArg(2 + spec_.arity + s, value);
+        return *this;
+    }
+
+    //! out[i] = f(x0[i], ...) for i < n, once the inputs and output are bound
+    cl::Event enqueue(cl::CommandQueue& queue, ::size_t n, const std::vector<cl::Event>* wait = NULL)
+    {
+        kernel_.setArg(0, (cl_uint)n);
+
+        // A work-item a vector, or enough to fill the device (planGrid);
+        // without the grid, one too for each element after the last vector
+        const ::size_t nvec = n / spec_.vector;
+        const cl_long items = std::max((cl_long)nvec, (cl_long)(n % spec_.vector));
+        ::size_t global, local;
+        if (spec_.grid)
+        {
+            LaunchPlan plan = planGrid(kernel_, device_, items);
+            local = plan.work_group_size;
+            global = plan.work_groups * plan.work_group_size;
+        }
+        else
+        {
+            local = std::min((::size_t)256,
+                             kernel_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device_));
+            global = ((::size_t)std::max(items, (cl_long)1) + local - 1) / local * local;
+        }
+
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(global),
+                                   cl::NDRange(local), wait, &event);
+        return event;
+    }
+
+    const ElementwiseSpec& spec() const { return spec_; }
+    cl::Kernel& kernel() { return kernel_; }
+
+private:
+    ElementwiseSpec spec_;
+    cl::Kernel      kernel_;
+    cl::Device      device_;
+};
+
+// The kernels generated so far, by signature
+class Elementwise
+{
+public:
+    Elementwise(const cl::Context& context, const cl::Device& device)
+        : context_(context), device_(device)
+    {
+    }
+
+    //! The kernel for spec, generated and built the first time
+    ElementwiseKernel& get(const ElementwiseSpec& spec)
+    {
+        const std::string sig = spec.signature();
+        std::map<std::string, ElementwiseKernel>::iterator k = kernels_.find(sig);
+        if (k != kernels_.end())
+            return k->second;
+
+        cl::Program program = buildProgram(context_, device_, spec.source());
+        ElementwiseKernel made(spec, cl::Kernel(program, "elementwise"), device_);
+        return kernels_.insert(std::make_pair(sig, made)).first->second;
+    }
+
+    //! Number of kernels generated so far
+    ::size_t size() const { return kernels_.size(); }
+
+private:
+    cl::Context context_;
+    cl::Device  device_;
+    std::map<std::string, ElementwiseKernel> kernels_;
+};
+
+} // namespace util
@@ -0,0 +1,195 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       executor.hpp
+ *
+ * Purpose:    A pool of host threads running OpenCL jobs on shared
+ *             devices, each thread with its own queue and its own copies
+ *             of the kernels, so that jobs submitted from many threads
+ *             run side by side without a lock around the OpenCL calls
+ *
+ * Usage:      util::Executor executor(runtime.context(), devices, 4);
+ *             cl::Program& program = runtime.program("../vadd.cl");
+ *
+ *             std::future<float> done = executor.submit(
+ *                 [&](util::ExecutorThread& thread) {
+ *                     cl::Kernel& vadd = thread.kernel(program, "vadd");
+ *                     vadd.setArg(0, ...);              // this thread's copy
+ *                     thread.queue().enqueueNDRangeKernel(vadd, ...);
+ *                     ...
+ *                     return result;
+ *                 });
+ *             float result = done.get();    // rethrows what the job threw
+ *
+ *             OpenCL calls are thread-safe, except that two threads must
+ *             not set the arguments of one cl_kernel at once (and then
+ *             launch it expecting their own).  A Runtime's kernels are one
+ *             per program and name, and shared; here each thread makes
+ *             its own from the program the first time it asks for one,
+ *             and keeps it.  Programs, contexts and buffers may be shared.
+ *
+ *             Thread t has a queue on device t % devices.size(), so the
+ *             threads are dealt round the devices, and with more threads
+ *             than devices a device has several queues, which lets it
+ *             overlap the transfers of one job with the kernel of
+ *             another.  Jobs are taken in the order they were submitted,
+ *             by whichever thread is free; the only lock is the one on
+ *             that list of jobs.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             Needs C++11 and -pthread.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// What a job is given: the thread's own queue and kernels
+class ExecutorThread
+{
+public:
+    ExecutorThread(const cl::Context& context, const cl::Device& device, unsigned int index,
+                   cl_command_queue_properties properties)
+        : device_(device), queue_(context, device, properties), index_(index), jobs_(0)
+    {
+    }
+
+    cl::Device& device() { return device_; }
+    cl::CommandQueue& queue() { return queue_; }
+
+    //! This thread's kernel name from program, made the first time
+    cl::Kernel& kernel(const cl::Program& program, const std::string& name)
+    {
+        Key key(program(), name);
+        std::map<Key, cl::Kernel>::iterator k = kernels_.find(key);
+        if (k != kernels_.end())
+            return k->second;
+        return kernels_[key] = cl::Kernel(program, name.c_str());
+    }
+
+    //! Which thread of the pool this is, and the jobs it has taken
+    unsigned int index() const { return index_; }
+    unsigned int jobs() const { return jobs_; }
+
+private:
+    friend class Executor;
+    typedef std::pair<cl_program, std::string> Key;
+
+    cl::Device                  device_;
+    cl::CommandQueue            queue_;
+    std::map<Key, cl::Kernel>   kernels_;
+    unsigned int                index_;
+    std::atomic<unsigned int>   jobs_;
+
+    ExecutorThread(const ExecutorThread&);
+    ExecutorThread& operator=(const ExecutorThread&);
+};
+
+class Executor
+{
+public:
+    //! threads threads, dealt round devices (all in context)
+    Executor(const cl::Context& context, const std::vector<cl::Device>& devices,
+             unsigned int threads, cl_command_queue_properties properties = 0)
+        : stopping_(false)
+    {
+        if (devices.empty() || threads == 0)
+            throw cl::Error(CL_INVALID_VALUE, "util::Executor::Executor (no devices or threads)");
+
+        for (unsigned int t = 0; t < threads; t++)
+            threads_.push_back(new ExecutorThread(context, devices[t % devices.size()], t,
+                                                  properties));
+        for (unsigned int t = 0; t < threads; t++)
+            workers_.push_back(std::thread(&Executor::work, this, threads_[t]));
+    }
+
+    //! Runs the jobs already submitted, then stops the threads
+    ~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (unsigned int t = 0; t < workers_.size(); t++)
+            workers_[t].join();
+        for (unsigned int t = 0; t < threads_.size(); t++)
+            delete threads_[t];
+    }
+
+    //! Queue job(thread) to run on the next free thread.  May be called
+    //! from any thread; the future has what the job returns, or throws
+    //! what it threw.
+    template <typename Job>
+    std::future<typename std::result_of<Job(ExecutorThread&)>::type> submit(Job job)
+    {
+        typedef typename std::result_of<Job(ExecutorThread&)>::type Result;
+        std::shared_ptr<std::packaged_task<Result(ExecutorThread&)> > task =
+            std::make_shared<std::packaged_task<Result(ExecutorThread&)> >(job);
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_)
+                throw cl::Error(CL_INVALID_OPERATION, "util::Executor::submit (stopping)");
+            jobs_.push_back([task](ExecutorThread& thread) { (*task)(thread); });
+        }
+        ready_.notify_one();
+        return result;
+    }
+
+    unsigned int threads() const { return threads_.size(); }
+
+    //! The jobs thread t has taken so far
+    unsigned int jobs(unsigned int t) const { return threads_.at(t)->jobs_; }
+
+    //! The device thread t runs on
+    const cl::Device& device(unsigned int t) const { return threads_.at(t)->device_; }
+
+private:
+    typedef std::function<void(ExecutorThread&)> Task;
+
+    std::vector<ExecutorThread*>    threads_;
+    std::vector<std::thread>        workers_;
+    std::deque<Task>                jobs_;
+    std::mutex                      mutex_;
+    std::condition_variable         ready_;
+    bool                            stopping_;
+
+    // A thread's loop: take the oldest job, run it, until stopped with none left
+    void work(ExecutorThread* thread)
+    {
+        for (;;)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return;
+                task = jobs_.front();
+                jobs_.pop_front();
+            }
+            thread->jobs_++;
+            task(*thread);
+        }
+    }
+
+    Executor(const Executor&);
+    Executor& operator=(const Executor&);
+};
+
+} // namespace util
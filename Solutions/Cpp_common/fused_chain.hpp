@@ -0,0 +1,206 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       fused_chain.hpp
+ *
+ * Purpose:    Fuse a chain of elementwise vector sums into one kernel
+ *
+ * Usage:      util::AddChain chain;
+ *             chain.sum("c", "a", "b");          // c = a + b
+ *             chain.sum("d", "e", "c");          // d = e + c
+ *             chain.sum("f", "g", "d");          // f = g + d
+ *             chain.output("f");
+ *
+ *             cl::Kernel kernel = chain.build(context, device);
+ *
+ *             std::map<std::string, cl::Buffer> buffers;
+ *             buffers["a"] = d_a;  ...  buffers["f"] = d_f;
+ *             chain.enqueue(queue, kernel, buffers, count);
+ *
+ *             Each step adds two or three vectors (the vadd and vadd_abc
+ *             kernels).  A name that no earlier step produced is an input
+ *             buffer; the other intermediates live in registers, so the
+ *             fused kernel reads every input once and writes only the
+ *             vectors marked with output() (the last step's, if none is).
+ *             One pass over memory replaces one pass per step.
+ *
+ *             The kernel arguments are the inputs, in the order they are
+ *             first used, then the outputs, then the count.  A vector that
+ *             is both (such as "a" in a = a + b) is passed once.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include "program_cache.hpp"
+
+namespace util {
+
+class AddChain
+{
+public:
+    //! out = a + b
+    void sum(const std::string& out, const std::string& a, const std::string& b)
+    {
+        std::vector<std::string> terms;
+        terms.push_back(a);
+        terms.push_back(b);
+        step(out, terms);
+    }
+
+    //! out = a + b + c
+    void sum(const std::string& out, const std::string& a, const std::string& b,
+             const std::string& c)
+    {
+        std::vector<std::string> terms;
+        terms.push_back(a);
+        terms.push_back(b);
+        terms.push_back(c);
+        step(out, terms);
+    }
+
+    //! Write the final value of name back to its buffer
+    void output(const std::string& name)
+    {
+        if (std::find(outputs_.begin(), outputs_.end(), name) == outputs_.end())
+            outputs_.push_back(name);
+    }
+
+    //! Buffers read by the kernel, in the order they were first used
+    const std::vector<std::string>& inputs() const { return inputs_; }
+
+    //! Buffers written by the kernel
+    std::vector<std::string> outputs() const
+    {
+        if (outputs_.empty() && !steps_.empty())
+            return std::vector<std::string>(1, steps_.back().out);
+        return outputs_;
+    }
+
+    //! Kernel arguments, in order (followed by the count)
+    std::vector<std::string> arguments() const
+    {
+        std::vector<std::string> args = inputs_;
+        std::vector<std::string> outs = outputs();
+        for (unsigned o = 0; o < outs.size(); o++)
+            if (std::find(args.begin(), args.end(), outs[o]) == args.end())
+                args.push_back(outs[o]);
+        return args;
+    }
+
+    //! OpenCL C source of the fused kernel
+    std::string source(const std::string& kernel_name = "vadd_fused") const
+    {
+        std::vector<std::string> args = arguments();
+        std::vector<std::string> outs = outputs();
+        std::ostringstream src;
+
+        src << "__kernel void " << kernel_name << "(\n";
+        for (unsigned a = 0; a < args.size(); a++)
+        {
+            bool written = std::find(outs.begin(), outs.end(), args[a]) != outs.end();
+            src << "   __global " << (written ? "" : "const ") << "float* " << args[a] << ",\n";
+        }
+        src << "   const unsigned int count)\n"
+            << "{\n"
+            << "   int i = get_global_id(0);\n"
+            << "   if (i < count) {\n";
+
+        // Load each input once, then one private value per step
+        std::map<std::string, std::string> current;
+        for (unsigned a = 0; a < inputs_.size(); a++)
+        {
+            std::string v = "in_" + inputs_[a];
+            src << "      float " << v << " = " << inputs_[a] << "[i];\n";
+            current[inputs_[a]] = v;
+        }
+        for (unsigned s = 0; s < steps_.size(); s++)
+        {
+            std::ostringstream v;
+            v << "t" << s;
+            src << "      float " << v.str() << " = ";
+            for (unsigned t = 0; t < steps_[s].terms.size(); t++)
+                src << (t ? " + " : "") << current[steps_[s].terms[t]];
+            src << ";\n";
+            current[steps_[s].out] = v.str();
+        }
+        for (unsigned o = 0; o < outs.size(); o++)
+            src << "      " << outs[o] << "[i] = " << current[outs[o]] << ";\n";
+
+        src << "   }\n"
+            << "}\n";
+        return src.str();
+    }
+
+    //! Build the fused kernel for device
+    cl::Kernel build(const cl::Context& context, const cl::Device& device,
+                     const std::string& kernel_name = "vadd_fused") const
+    {
+        cl::Program program = buildProgram(context, device, source(kernel_name));
+        return cl::Kernel(program, kernel_name.c_str());
+    }
+
+    //! Run the fused kernel over count elements, with the buffers by name
+    cl::Event enqueue(cl::CommandQueue& queue, cl::Kernel& kernel,
+                      const std::map<std::string, cl::Buffer>& buffers,
+                      unsigned int count) const
+    {
+        std::vector<std::string> args = arguments();
+        for (unsigned a = 0; a < args.size(); a++)
+        {
+            std::map<std::string, cl::Buffer>::const_iterator b = buffers.find(args[a]);
+            if (b == buffers.end())
+                throw cl::Error(CL_INVALID_MEM_OBJECT, "util::AddChain::enqueue (missing buffer)");
+            kernel.setArg(a, b->second);
+        }
+        kernel.setArg(args.size(), count);
+
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(count),
+                                   cl::NullRange, NULL, &event);
+        return event;
+    }
+
+private:
+    struct Step
+    {
+        std::string              out;
+        std::vector<std::string> terms;
+    };
+
+    std::vector<Step>        steps_;
+    std::vector<std::string> inputs_;
+    std::vector<std::string> outputs_;
+
+    void step(const std::string& out, const std::vector<std::string>& terms)
+    {
+        // A term no earlier step produced must come from a buffer
+        for (unsigned t = 0; t < terms.size(); t++)
+            if (!produced(terms[t]) &&
+                std::find(inputs_.begin(), inputs_.end(), terms[t]) == inputs_.end())
+                inputs_.push_back(terms[t]);
+
+        Step s;
+        s.out   = out;
+        s.terms = terms;
+        steps_.push_back(s);
+    }
+
+    bool produced(const std::string& name) const
+    {
+        for (unsigned s = 0; s < steps_.size(); s++)
+            if (steps_[s].out == name)
+                return true;
+        return false;
+    }
+};
+
+} // namespace util
@@ -0,0 +1,194 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       kernel_report.hpp
+ *
+ * Purpose:    Report what a built kernel uses of a device (work-group size,
+ *             local and private memory) and estimate the occupancy that
+ *             leaves, to explain a slow kernel rather than guess
+ *
+ * Usage:      util::KernelReport report(device);
+ *
+ *             event = ...enqueue the kernel, with work-groups of wg...;
+ *             const util::KernelUsage& usage = report.record("mmul", kernel, wg);
+ *             printf(" %s\n", util::formatUsage(usage).c_str());
+ *             ...
+ *             report.print();
+ *
+ *             The figures are the kernel's work-group queries:
+ *             CL_KERNEL_WORK_GROUP_SIZE, the preferred work-group size
+ *             multiple, CL_KERNEL_LOCAL_MEM_SIZE (which counts the
+ *             __local arguments as last set, so record after the
+ *             launch) and CL_KERNEL_PRIVATE_MEM_SIZE.  A work-group
+ *             size of 0 is the runtime's choice, taken to be the
+ *             largest the kernel allows.
+ *
+ *             OpenCL does not say how many work-items a compute unit
+ *             keeps in flight, so the estimate takes it to be the
+ *             largest work-group the device allows.  The work-groups
+ *             resident on a compute unit are as many as fit in that
+ *             many work-items, in the kernel's own work-group limit
+ *             (which the runtime lowers below the device's when each
+ *             work-item needs many registers) and in the device's
+ *             local memory; the occupancy is the work-items they hold
+ *             as a fraction of the work-items in flight.  It is a
+ *             comparison between kernels on one device, not a count
+ *             of a GPU's warps.
+ *
+ *             Private memory the runtime reports is memory, not
+ *             registers: a private array, or registers spilled to it.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace util {
+
+// What one kernel uses, and what that leaves of the device
+struct KernelUsage
+{
+    ::size_t    work_group;          // work-items a group, as launched
+    ::size_t    max_work_group;      // CL_KERNEL_WORK_GROUP_SIZE
+    ::size_t    multiple;            // the preferred work-group size multiple
+    cl_ulong    local_mem;           // bytes a work-group
+    cl_ulong    private_mem;         // bytes a work-item
+    ::size_t    groups;              // work-groups resident on a compute unit
+    double      occupancy;           // estimated, 0 to 1
+    std::string limit;               // what limits the groups resident
+    std::vector<std::string> warnings;
+};
+
+//! Query the usage of kernel on device, launched with work-groups of work_group
+inline KernelUsage kernelUsage(const cl::Kernel& kernel, const cl::Device& device,
+                               ::size_t work_group = 0)
+{
+    KernelUsage u;
+    u.max_work_group = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+    u.multiple = kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+    u.local_mem = kernel.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device);
+    u.private_mem = kernel.getWorkGroupInfo<CL_KERNEL_PRIVATE_MEM_SIZE>(device);
+    u.work_group = work_group ? work_group : u.max_work_group;
+
+    const ::size_t in_flight = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    const cl_ulong device_local = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+    // Groups resident on a compute unit, by each limit
+    u.groups = in_flight / u.work_group;
+    u.limit = "work-items";
+    const ::size_t by_registers = u.max_work_group / u.work_group;
+    if (u.max_work_group < in_flight && by_registers < u.groups)
+    {
+        u.groups = by_registers;
+        u.limit = "registers";
+    }
+    if (u.local_mem > 0 && device_local / u.local_mem < u.groups)
+    {
+        u.groups = (::size_t)(device_local / u.local_mem);
+        u.limit = "local memory";
+    }
+    u.occupancy = std::min(1.0, (double)(u.groups * u.work_group) / in_flight);
+
+    std::ostringstream w;
+    if (u.groups == 0)
+    {
+        w << "a work-group of " << u.work_group << " cannot run: the kernel allows "
+          << u.max_work_group << " and " << device_local << " bytes of local memory";
+        u.warnings.push_back(w.str());
+        w.str("");
+    }
+    if (u.max_work_group < in_flight)
+    {
+        w << "register pressure: work-groups of at most " << u.max_work_group
+          << " (the device allows " << in_flight << ")";
+        u.warnings.push_back(w.str());
+        w.str("");
+    }
+    if (u.private_mem > 0)
+    {
+        w << u.private_mem << " bytes of private memory a work-item: a private array or "
+          << "spilled registers, in memory";
+        u.warnings.push_back(w.str());
+        w.str("");
+    }
+    if (u.multiple > 1 && u.work_group % u.multiple != 0)
+    {
+        w << "work-groups of " << u.work_group << " are not a multiple of " << u.multiple
+          << ", so some lanes idle";
+        u.warnings.push_back(w.str());
+    }
+    return u;
+}
+
+//! One line of the usage: sizes, memory and estimated occupancy
+inline std::string formatUsage(const KernelUsage& u)
+{
+    std::ostringstream line;
+    line << "Work-group " << u.work_group << " (max " << u.max_work_group
+         << ", multiple " << u.multiple << "), local " << u.local_mem
+         << " B, private " << u.private_mem << " B, occupancy ~"
+         << (int)(100.0 * u.occupancy + 0.5) << "% (" << u.limit << ")";
+    return line.str();
+}
+
+class KernelReport
+{
+public:
+    explicit KernelReport(const cl::Device& device) : device_(device) {}
+
+    //! Query kernel, launched as name with work-groups of work_group, once
+    const KernelUsage& record(const std::string& name, const cl::Kernel& kernel,
+                              ::size_t work_group = 0)
+    {
+        std::map<std::string, KernelUsage>::iterator entry = usage_.find(name);
+        if (entry == usage_.end())
+        {
+            entry = usage_.insert(std::make_pair(name, kernelUsage(kernel, device_, work_group))).first;
+            order_.push_back(name);
+        }
+        return entry->second;
+    }
+
+    //! Print every kernel's usage, then the warnings
+    void print() const
+    {
+        printf("\n Kernel resources: occupancy estimated against %lu work-items in flight, "
+               "%lu bytes of local memory a compute unit\n",
+               (unsigned long)device_.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(),
+               (unsigned long)device_.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>());
+        printf(" %-24s %8s %8s %8s %10s %10s %7s %6s  %s\n", "kernel", "group", "max",
+               "multiple", "local(B)", "private(B)", "groups", "occ", "limit");
+
+        for (std::vector<std::string>::const_iterator n = order_.begin(); n != order_.end(); ++n)
+        {
+            const KernelUsage& u = usage_.find(*n)->second;
+            printf(" %-24s %8lu %8lu %8lu %10lu %10lu %7lu %5.0f%%  %s\n", n->c_str(),
+                   (unsigned long)u.work_group, (unsigned long)u.max_work_group,
+                   (unsigned long)u.multiple, (unsigned long)u.local_mem,
+                   (unsigned long)u.private_mem, (unsigned long)u.groups,
+                   100.0 * u.occupancy, u.limit.c_str());
+        }
+
+        for (std::vector<std::string>::const_iterator n = order_.begin(); n != order_.end(); ++n)
+        {
+            const KernelUsage& u = usage_.find(*n)->second;
+            for (unsigned w = 0; w < u.warnings.size(); w++)
+                printf(" %s: %s\n", n->c_str(), u.warnings[w].c_str());
+        }
+    }
+
+private:
+    cl::Device                         device_;
+    std::map<std::string, KernelUsage> usage_;
+    std::vector<std::string>           order_;
+};
+
+} // namespace util
@@ -0,0 +1,96 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       launch_plan.hpp
+ *
+ * Purpose:    Size a one dimensional launch that splits a fixed amount of
+ *             work (such as the steps of the pi integration) over enough
+ *             work-items to fill the device
+ *
+ * Usage:      util::LaunchPlan plan = util::planLaunch(kernel, device, nsteps);
+ *
+ *             kernel(global = plan.work_groups * plan.work_group_size,
+ *                    local  = plan.work_group_size), each work-item doing
+ *                    plan.iters steps, plan.steps in all (>= nsteps)
+ *
+ *             The work-group size is the largest multiple of
+ *             CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE the kernel can
+ *             run with, up to 256.  There are groups_per_unit work-groups
+ *             per compute unit, so every unit has several to switch
+ *             between, unless there are too few steps for that.  The
+ *             steps per work-item are rounded up to a multiple of
+ *             granularity (the vector width of a vectorised kernel).
+ *
+ *             util::planGrid(kernel, device, items) does the same for a
+ *             grid-stride kernel over items independent pieces of work:
+ *             the NDRange fills the device, but has no more work-groups
+ *             than items can fill, and each work-item loops over about
+ *             plan.iters of them.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+
+namespace util {
+
+struct LaunchPlan
+{
+    ::size_t work_group_size;
+    ::size_t work_groups;
+    cl_long  iters;         // per work-item, a multiple of the granularity
+    cl_long  steps;         // work_groups * work_group_size * iters
+};
+
+inline LaunchPlan planLaunch(const cl::Kernel& kernel, const cl::Device& device,
+                             cl_long target_steps, int granularity = 1,
+                             int groups_per_unit = 8)
+{
+    LaunchPlan plan;
+
+    ::size_t max_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+    ::size_t multiple =
+        kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+    if (multiple < 1 || multiple > max_size)
+        multiple = 1;
+
+    plan.work_group_size = std::min(max_size, (::size_t)256) / multiple * multiple;
+    if (plan.work_group_size < 1)
+        plan.work_group_size = 1;
+
+    // Enough work-groups to keep every compute unit busy, but no work-item
+    // with less than one granule of steps
+    cl_long units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    cl_long groups = units * groups_per_unit;
+    cl_long fit = target_steps / ((cl_long)plan.work_group_size * granularity);
+    groups = std::max((cl_long)1, std::min(groups, fit));
+
+    // Kernels take the steps per work-item as an int, so very long runs
+    // need more work-groups rather than longer work-items
+    const cl_long max_iters = INT_MAX / granularity * granularity;
+    cl_long items = groups * plan.work_group_size;
+    if ((target_steps + items - 1) / items > max_iters)
+    {
+        cl_long per_group = max_iters * plan.work_group_size;
+        groups = (target_steps + per_group - 1) / per_group;
+        items = groups * plan.work_group_size;
+    }
+
+    plan.work_groups = (::size_t)groups;
+    plan.iters = (target_steps + items - 1) / items;
+    plan.iters = (plan.iters + granularity - 1) / granularity * granularity;
+    plan.steps = plan.iters * items;
+    return plan;
+}
+
+// A grid-stride launch is a launch whose steps are the items; planLaunch
+// never makes more work-groups than there are items to fill them
+inline LaunchPlan planGrid(const cl::Kernel& kernel, const cl::Device& device,
+                           cl_long items, int groups_per_unit = 8)
+{
+    return planLaunch(kernel, device, std::max(items, (cl_long)1), 1, groups_per_unit);
+}
+
+} // namespace util
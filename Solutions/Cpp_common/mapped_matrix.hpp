@@ -0,0 +1,185 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       mapped_matrix.hpp
+ *
+ * Purpose:    Read a matrix of floats from a raw binary or .npy file by
+ *             mapping it into memory, so it can go to the device straight
+ *             from the page cache
+ *
+ * Usage:      util::MappedMatrix a("A.npy");              // shape from the header
+ *             util::MappedMatrix b("B.bin", 1024, 512);   // raw: give the shape
+ *
+ *             cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+ *                            a.bytes(), a.data());
+ *
+ *             A .npy file must hold a 2D array of little-endian float32
+ *             ('<f4') in C (row major) order, as numpy.save writes
+ *             numpy.float32 arrays.  A raw file is rows * cols floats by
+ *             rows, in the byte order of the host, and its size must match.
+ *
+ *             The mapping is private and writable, so a runtime that
+ *             writes to host memory it was given (CL_MEM_USE_HOST_PTR)
+ *             only changes its own copy of a page, never the file.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS;
+ *             errors are thrown as cl::Error(CL_INVALID_VALUE).  On
+ *             Windows the file is read into memory instead of mapped.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace util {
+
+class MappedMatrix
+{
+public:
+    //! Map path; rows and cols are needed for a raw file, and checked
+    //! against the header for a .npy one if given
+    explicit MappedMatrix(const std::string& path, int rows = 0, int cols = 0)
+        : path_(path), rows_(0), cols_(0), base_(NULL), length_(0), data_(NULL)
+    {
+        map();
+
+        const unsigned char *head = static_cast<const unsigned char *>(base_);
+        ::size_t offset = 0;
+        if (length_ >= 10 && !memcmp(head, "\x93NUMPY", 6))
+            offset = parseNpy(head, rows_, cols_);
+        else
+        {
+            rows_ = rows;
+            cols_ = cols;
+        }
+
+        if (rows_ <= 0 || cols_ <= 0)
+            fail("shape unknown: give the sizes for a raw file");
+        if ((rows && rows != rows_) || (cols && cols != cols_))
+            fail("shape differs from the sizes given");
+        if (length_ - offset != bytes())
+            fail("file size does not match the shape");
+
+        data_ = reinterpret_cast<float *>(static_cast<char *>(base_) + offset);
+    }
+
+    ~MappedMatrix()
+    {
+#ifndef _WIN32
+        if (base_)
+            munmap(base_, length_);
+#endif
+    }
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    ::size_t bytes() const { return sizeof(float) * (::size_t)rows_ * cols_; }
+
+    //! The elements, by rows; writing changes only this process's copy
+    float *data() { return data_; }
+    const float *data() const { return data_; }
+
+private:
+    std::string         path_;
+    int                 rows_, cols_;
+    void               *base_;      // the whole file, header and all
+    ::size_t            length_;
+    float              *data_;
+    std::vector<char>   copy_;      // where the file is read, not mapped
+
+    void fail(const char *why) const
+    {
+        fprintf(stderr, "%s: %s\n", path_.c_str(), why);
+        throw cl::Error(CL_INVALID_VALUE, "util::MappedMatrix (cannot use the file)");
+    }
+
+    void map()
+    {
+#ifndef _WIN32
+        int fd = open(path_.c_str(), O_RDONLY);
+        if (fd < 0)
+            fail("cannot open");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            fail("cannot read the size, or empty");
+        }
+        length_ = (::size_t)st.st_size;
+        base_ = mmap(NULL, length_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base_ == MAP_FAILED)
+        {
+            base_ = NULL;
+            fail("cannot map");
+        }
+#else
+        FILE *file = fopen(path_.c_str(), "rb");
+        if (!file)
+            fail("cannot open");
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (size <= 0)
+        {
+            fclose(file);
+            fail("cannot read the size, or empty");
+        }
+        copy_.resize(size);
+        length_ = fread(&copy_[0], 1, size, file);
+        fclose(file);
+        base_ = &copy_[0];
+#endif
+    }
+
+    //! Check the header of a .npy file and read its shape; returns the
+    //! offset of the data
+    ::size_t parseNpy(const unsigned char *bytes, int& rows, int& cols) const
+    {
+        const int major = bytes[6];
+        ::size_t header, start;
+        if (major == 1)
+        {
+            header = bytes[8] | (bytes[9] << 8);
+            start = 10;
+        }
+        else
+        {
+            if (length_ < 12)
+                fail("truncated header");
+            header = bytes[8] | (bytes[9] << 8) | (bytes[10] << 16) | ((::size_t)bytes[11] << 24);
+            start = 12;
+        }
+        if (start + header > length_)
+            fail("truncated header");
+
+        std::string dict(reinterpret_cast<const char *>(bytes) + start, header);
+        if (dict.find("'descr': '<f4'") == std::string::npos)
+            fail("not float32 ('<f4')");
+        if (dict.find("'fortran_order': False") == std::string::npos)
+            fail("not in C order");
+
+        std::string::size_type shape = dict.find("'shape': (");
+        if (shape == std::string::npos ||
+            sscanf(dict.c_str() + shape + 10, "%d, %d", &rows, &cols) != 2)
+            fail("not a 2D array");
+        return start + header;
+    }
+
+    MappedMatrix(const MappedMatrix&);
+    MappedMatrix& operator=(const MappedMatrix&);
+};
+
+} // namespace util
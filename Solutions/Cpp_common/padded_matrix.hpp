@@ -0,0 +1,149 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       padded_matrix.hpp
+ *
+ * Purpose:    A matrix on the host stored by rows, each row starting on a
+ *             HOST_ALIGNMENT byte boundary and padded so no two rows fall
+ *             on the same cache sets, for host loops that vectorise over a
+ *             row and for copies to and from dense device buffers
+ *
+ * Usage:      util::PinnedAllocator<float> pinned(context, queue);
+ *             util::PaddedMatrix<float> a(M, K, pinned);
+ *
+ *             a(i, k) = ...;                  // or a.row(i)[k]
+ *             a.write(queue, d_a);            // M x K, dense on the device
+ *             a.read(queue, d_a);
+ *
+ *             The leading dimension ld() (the elements from one row to
+ *             the next) is cols rounded up to a whole HOST_ALIGNMENT,
+ *             then one HOST_ALIGNMENT more if that makes a row a multiple
+ *             of PADDED_CRITICAL bytes.  Rows at such a stride land on the
+ *             same sets of an L1 or L2 cache, so a loop down a column of
+ *             them (a panel of B in a GEMM) evicts its own lines; the
+ *             extra padding staggers them.
+ *
+ *             write() and read() copy the rows with
+ *             enqueueWriteBufferRect and enqueueReadBufferRect, so the
+ *             buffer holds the matrix densely (rows cols apart) as the
+ *             kernels expect and the padding never goes to the device.
+ *             A kernel given ld() can take data() and bytes() whole.
+ *
+ * Note:       Must be included AFTER cl.hpp, with pinned_allocator.hpp
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "pinned_allocator.hpp"
+
+#define PADDED_CRITICAL 4096    // bytes: rows a multiple of this apart share cache sets
+
+namespace util {
+
+//! The leading dimension of a padded matrix with cols elements of bytes each
+inline ::size_t paddedLd(::size_t cols, ::size_t bytes)
+{
+    const ::size_t unit = HOST_ALIGNMENT / bytes;
+    ::size_t ld = (cols + unit - 1) / unit * unit;
+    if (ld > 0 && (ld * bytes) % PADDED_CRITICAL == 0)
+        ld += unit;
+    return ld;
+}
+
+template <typename T>
+class PaddedMatrix
+{
+public:
+    typedef std::vector<T, PinnedAllocator<T> > Storage;
+
+    PaddedMatrix() : rows_(0), cols_(0), ld_(0) {}
+
+    PaddedMatrix(::size_t rows, ::size_t cols,
+                 const PinnedAllocator<T>& allocator = PinnedAllocator<T>())
+        : rows_(rows), cols_(cols), ld_(paddedLd(cols, sizeof(T))),
+          data_(rows * paddedLd(cols, sizeof(T)), T(), allocator)
+    {
+    }
+
+    ::size_t rows() const { return rows_; }
+    ::size_t cols() const { return cols_; }
+    ::size_t ld() const { return ld_; }
+
+    //! Bytes of the padded storage, and of the matrix held densely
+    ::size_t bytes() const { return sizeof(T) * data_.size(); }
+    ::size_t denseBytes() const { return sizeof(T) * rows_ * cols_; }
+
+    T *data() { return data_.empty() ? NULL : &data_[0]; }
+    const T *data() const { return data_.empty() ? NULL : &data_[0]; }
+
+    T *row(::size_t i) { return &data_[i * ld_]; }
+    const T *row(::size_t i) const { return &data_[i * ld_]; }
+
+    T& operator()(::size_t i, ::size_t j) { return data_[i * ld_ + j]; }
+    const T& operator()(::size_t i, ::size_t j) const { return data_[i * ld_ + j]; }
+
+    //! Every element (the padding too) set to value
+    void fill(const T& value) { std::fill(data_.begin(), data_.end(), value); }
+
+    //! Copy in from, or out to, elements stored densely by rows
+    void fromDense(const T *dense)
+    {
+        for (::size_t i = 0; i < rows_; i++)
+            std::copy(dense + i * cols_, dense + (i + 1) * cols_, row(i));
+    }
+
+    void toDense(T *dense) const
+    {
+        for (::size_t i = 0; i < rows_; i++)
+            std::copy(row(i), row(i) + cols_, dense + i * cols_);
+    }
+
+    //! Copy the rows to a dense buffer of rows * cols elements
+    void write(cl::CommandQueue& queue, const cl::Buffer& buffer, bool blocking = true,
+               cl::Event *event = NULL) const
+    {
+        if (rows_ == 0 || cols_ == 0)
+            return;
+        queue.enqueueWriteBufferRect(buffer, blocking ? CL_TRUE : CL_FALSE, origin(), origin(),
+                                     region(), sizeof(T) * cols_, 0, sizeof(T) * ld_, 0,
+                                     const_cast<T *>(data()), NULL, event);
+    }
+
+    //! Copy the rows back from a dense buffer of rows * cols elements
+    void read(cl::CommandQueue& queue, const cl::Buffer& buffer, bool blocking = true,
+              cl::Event *event = NULL)
+    {
+        if (rows_ == 0 || cols_ == 0)
+            return;
+        queue.enqueueReadBufferRect(buffer, blocking ? CL_TRUE : CL_FALSE, origin(), origin(),
+                                    region(), sizeof(T) * cols_, 0, sizeof(T) * ld_, 0,
+                                    data(), NULL, event);
+    }
+
+private:
+    ::size_t rows_, cols_, ld_;
+    Storage  data_;
+
+    static cl::size_t<3> origin()
+    {
+        cl::size_t<3> o;
+        o[0] = o[1] = o[2] = 0;
+        return o;
+    }
+
+    cl::size_t<3> region() const
+    {
+        cl::size_t<3> r;
+        r[0] = sizeof(T) * cols_;
+        r[1] = rows_;
+        r[2] = 1;
+        return r;
+    }
+};
+
+} // namespace util
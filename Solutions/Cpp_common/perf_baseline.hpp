@@ -0,0 +1,286 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       perf_baseline.hpp
+ *
+ * Purpose:    Keep the timings of a good run of the kernels on a device and
+ *             check later runs against them, to catch a kernel or driver
+ *             change that made one slower
+ *
+ * Usage:      util::PerfBaseline baseline(device);
+ *
+ *             baseline.set("matmul/block/1024x1024x1024", times);
+ *             baseline.save();
+ *
+ *             util::BaselineCheck check =
+ *                 baseline.compare("matmul/block/1024x1024x1024", times, 0.05);
+ *             if (check.verdict == util::BASELINE_SLOWER) ...
+ *
+ *             The baseline is a plain text file a device, named as its
+ *             tuning file but ending .baseline, in the same
+ *             OCL_TUNING_DIR.  Each line holds every timed run (in
+ *             seconds) of one kernel at one size:
+ *
+ *                 matmul/block/1024x1024x1024 0.00412 0.00409 ...
+ *
+ *             so a check compares two samples rather than two numbers.
+ *             A run is slower only if both hold: its median is more
+ *             than threshold (a fraction) above the baseline's, and a
+ *             one-sided Mann-Whitney U test says its times are larger
+ *             with p below BASELINE_ALPHA.  The test goes on ranks, so
+ *             a few outliers in either run (a clock change, another
+ *             process) do not decide it, and a small shift in noisy
+ *             times is not called a regression.  Faster runs are
+ *             reported the same way, as a prompt to save a new
+ *             baseline.
+ *
+ *             With few runs even a complete separation of the two
+ *             samples is not significant (with BASELINE_ALPHA 0.01 and
+ *             equal samples the least p is 0.040 at 3 runs, 0.015 at 4),
+ *             so such a check is BASELINE_TOO_FEW rather than same.
+ *             Drivers should time at least BASELINE_MIN_RUNS runs for a
+ *             baseline and for a check against it.
+ *
+ * Note:       Must be included AFTER cl.hpp
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+
+#include "tuning.hpp"
+
+// Significance of the rank test for a change in speed
+#define BASELINE_ALPHA 0.01
+
+// Fewest runs in each sample for the test to reach BASELINE_ALPHA
+#define BASELINE_MIN_RUNS 5
+
+namespace util {
+
+enum BaselineVerdict
+{
+    BASELINE_MISSING,   // no baseline for the key
+    BASELINE_TOO_FEW,   // too few runs for the test to find a change
+    BASELINE_SAME,
+    BASELINE_SLOWER,
+    BASELINE_FASTER
+};
+
+// The result of checking one kernel's times against its baseline
+struct BaselineCheck
+{
+    BaselineVerdict verdict;
+    double          baseline_median;    // seconds
+    double          median;             // seconds
+    double          ratio;              // median / baseline_median
+    double          p_slower;           // p-value of "this run is slower"
+    double          p_faster;
+};
+
+//! The median of some times
+inline double sampleMedian(std::vector<double> times)
+{
+    if (times.empty())
+        return 0.0;
+    std::sort(times.begin(), times.end());
+    const std::vector<double>::size_type n = times.size();
+    return n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+}
+
+//! One-sided p-value that the values of a tend to be larger than those
+//! of b (Mann-Whitney U, normal approximation with ties corrected)
+inline double mannWhitneyLarger(const std::vector<double>& a, const std::vector<double>& b)
+{
+    const double n1 = a.size(), n2 = b.size(), n = n1 + n2;
+    if (n1 < 1 || n2 < 1)
+        return 1.0;
+
+    // Rank the two together, ties sharing the mean of their ranks
+    std::vector<std::pair<double, int> > all;
+    for (unsigned i = 0; i < a.size(); i++)
+        all.push_back(std::make_pair(a[i], 0));
+    for (unsigned i = 0; i < b.size(); i++)
+        all.push_back(std::make_pair(b[i], 1));
+    std::sort(all.begin(), all.end());
+
+    double rank_a = 0.0, ties = 0.0;
+    for (unsigned i = 0; i < all.size(); )
+    {
+        unsigned j = i;
+        while (j < all.size() && all[j].first == all[i].first)
+            j++;
+        const double rank = 0.5 * (i + 1 + j), t = j - i;
+        for (unsigned k = i; k < j; k++)
+            if (all[k].second == 0)
+                rank_a += rank;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    const double u = rank_a - n1 * (n1 + 1.0) / 2.0;
+    const double var = n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+    if (var <= 0.0)
+        return 1.0;
+    const double z = (u - n1 * n2 / 2.0 - 0.5) / std::sqrt(var);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+//! The least p-value mannWhitneyLarger can give for samples of n1 and n2,
+//! when every value of one is larger than every value of the other
+inline double mannWhitneyLeast(double n1, double n2)
+{
+    if (n1 < 1 || n2 < 1)
+        return 1.0;
+    const double z = (n1 * n2 / 2.0 - 0.5) / std::sqrt(n1 * n2 * (n1 + n2 + 1.0) / 12.0);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+class PerfBaseline
+{
+public:
+    //! Open (but do not require) the baseline of a device
+    explicit PerfBaseline(const cl::Device& device)
+    {
+        device_ = device.getInfo<CL_DEVICE_NAME>();
+        driver_ = device.getInfo<CL_DRIVER_VERSION>();
+        path_ = deviceFilePath(device_, "baseline");
+        load();
+    }
+
+    //! The file backing this device's baseline
+    const std::string& path() const { return path_; }
+
+    //! The driver the baseline was saved with
+    const std::string& savedDriver() const { return saved_driver_; }
+
+    //! (Re)read the baseline; returns false if there is none
+    bool load()
+    {
+        std::ifstream stream(path_.c_str());
+        if (!stream.is_open())
+            return false;
+
+        times_.clear();
+        saved_driver_.clear();
+
+        std::string line;
+        const std::string driver_note = "# driver ";
+        while (std::getline(stream, line))
+        {
+            if (line.compare(0, driver_note.size(), driver_note) == 0)
+                saved_driver_ = line.substr(driver_note.size());
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream words(line);
+            std::string key;
+            double t;
+            if (!(words >> key))
+                continue;
+            std::vector<double>& times = times_[key];
+            times.clear();
+            while (words >> t)
+                times.push_back(t);
+        }
+        return true;
+    }
+
+    //! Write the baseline back, as from this driver
+    bool save() const
+    {
+        std::ofstream stream(path_.c_str());
+        if (!stream.is_open())
+            return false;
+
+        stream << "# Timings of " << device_ << ", in seconds\n";
+        stream << "# driver " << driver_ << "\n";
+        stream.precision(6);
+        for (std::map<std::string, std::vector<double> >::const_iterator k = times_.begin();
+             k != times_.end(); ++k)
+        {
+            stream << k->first;
+            for (unsigned i = 0; i < k->second.size(); i++)
+                stream << " " << k->second[i];
+            stream << "\n";
+        }
+        return true;
+    }
+
+    bool has(const std::string& key) const
+    {
+        return times_.find(key) != times_.end();
+    }
+
+    void set(const std::string& key, const std::vector<double>& times)
+    {
+        times_[key] = times;
+    }
+
+    //! Check times against the baseline of key
+    BaselineCheck compare(const std::string& key, const std::vector<double>& times,
+                          double threshold) const
+    {
+        BaselineCheck check;
+        check.verdict = BASELINE_MISSING;
+        check.median = sampleMedian(times);
+        check.baseline_median = check.ratio = 0.0;
+        check.p_slower = check.p_faster = 1.0;
+
+        std::map<std::string, std::vector<double> >::const_iterator b = times_.find(key);
+        if (b == times_.end() || b->second.empty() || times.empty())
+            return check;
+
+        check.baseline_median = sampleMedian(b->second);
+        check.ratio = check.baseline_median > 0.0 ? check.median / check.baseline_median : 1.0;
+        check.p_slower = mannWhitneyLarger(times, b->second);
+        check.p_faster = mannWhitneyLarger(b->second, times);
+
+        if (mannWhitneyLeast(times.size(), b->second.size()) >= BASELINE_ALPHA)
+            check.verdict = BASELINE_TOO_FEW;
+        else if (check.ratio > 1.0 + threshold && check.p_slower < BASELINE_ALPHA)
+            check.verdict = BASELINE_SLOWER;
+        else if (check.ratio < 1.0 - threshold && check.p_faster < BASELINE_ALPHA)
+            check.verdict = BASELINE_FASTER;
+        else
+            check.verdict = BASELINE_SAME;
+        return check;
+    }
+
+private:
+    std::string                                  path_;
+    std::string                                  device_;
+    std::string                                  driver_;
+    std::string                                  saved_driver_;
+    std::map<std::string, std::vector<double> >  times_;
+};
+
+//! One line of a check, as "1.23x (p 0.001) SLOWER"
+inline std::string formatCheck(const BaselineCheck& check)
+{
+    char line[96];
+    if (check.verdict == BASELINE_MISSING)
+        return "no baseline";
+    if (check.verdict == BASELINE_TOO_FEW)
+    {
+        snprintf(line, sizeof(line), "%.3fx the baseline median, too few runs to test",
+                 check.ratio);
+        return line;
+    }
+
+    const char *verdict = check.verdict == BASELINE_SLOWER ? "SLOWER" :
+                          check.verdict == BASELINE_FASTER ? "faster" : "same";
+    snprintf(line, sizeof(line), "%.3fx the baseline median (p %.3g) %s", check.ratio,
+             check.verdict == BASELINE_FASTER ? check.p_faster : check.p_slower, verdict);
+    return line;
+}
+
+} // namespace util
@@ -0,0 +1,135 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       ping_pong.hpp
+ *
+ * Purpose:    Launch a kernel over and over with its input and output
+ *             buffers trading places, without setting its arguments again
+ *
+ * Usage:      util::PingPongLaunch life(program, "accelerate_life");
+ *             life.swap(0, 1, d_tick, d_tock);   // args 0 and 1 trade places
+ *             life.setArg(2, nx);                // the rest are set once
+ *             ...
+ *             for (int i = 0; i < iterations; i++)
+ *                 life.enqueue(queue, global, local);
+ *
+ *             queue.enqueueReadBuffer(life.input(), ...);   // the latest state
+ *
+ *             util::CommandRecording rec(queue);   // command_buffer.hpp
+ *             life.record(rec, global, local, 32); // 32 pairs of launches
+ *             rec.finalize();
+ *             life.replay(queue, rec);             // 64 more generations
+ *
+ *             There are two kernel objects, one with each buffer in each
+ *             place, and every argument is set on both when it is bound.
+ *             A launch is then only clEnqueueNDRangeKernel on one or the
+ *             other in turn, where cl::make_kernel sets every argument
+ *             and builds the EnqueueArgs again each time.  swap() may be
+ *             called for more than one pair of arguments (all trade
+ *             places together), and setArg() again for an argument that
+ *             changes, such as the generations in the last launch.
+ *             record() adds pairs of launches, one of each kernel, to a
+ *             recording, so a replay leaves the buffers where they were;
+ *             the arguments must be bound by then.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "command_buffer.hpp"
+
+namespace util {
+
+class PingPongLaunch
+{
+public:
+    PingPongLaunch(const cl::Program& program, const char *name)
+        : parity_(0), launches_(0)
+    {
+        kernels_[0] = cl::Kernel(program, name);
+        kernels_[1] = cl::Kernel(program, name);
+    }
+
+    //! Arguments in_arg and out_arg start as a and b, then trade places
+    //! after every launch
+    void swap(cl_uint in_arg, cl_uint out_arg, const cl::Buffer& a, const cl::Buffer& b)
+    {
+        kernels_[0].setArg(in_arg, a);
+        kernels_[0].setArg(out_arg, b);
+        kernels_[1].setArg(in_arg, b);
+        kernels_[1].setArg(out_arg, a);
+
+        Pair pair = { a, b };
+        pairs_.push_back(pair);
+    }
+
+    //! An argument that is the same for every launch
+    template <typename T>
+    void setArg(cl_uint index, const T& value)
+    {
+        kernels_[0].setArg(index, value);
+        kernels_[1].setArg(index, value);
+    }
+
+    //! Launch with the buffers as they are now, then swap them over
+    void enqueue(cl::CommandQueue& queue, const cl::NDRange& global,
+                 const cl::NDRange& local = cl::NullRange, cl::Event *event = NULL)
+    {
+        queue.enqueueNDRangeKernel(kernels_[parity_], cl::NullRange, global, local, NULL, event);
+        parity_ ^= 1;
+        launches_++;
+    }
+
+    //! The buffer the next launch reads through the pair's in_arg, which
+    //! holds what the last launch wrote
+    const cl::Buffer& input(unsigned int pair = 0) const
+    {
+        return parity_ ? pairs_.at(pair).b : pairs_.at(pair).a;
+    }
+
+    //! And the one it writes
+    const cl::Buffer& output(unsigned int pair = 0) const
+    {
+        return parity_ ? pairs_.at(pair).a : pairs_.at(pair).b;
+    }
+
+    //! Record pairs of launches, each kernel in turn, starting with the next
+    void record(CommandRecording& recording, const cl::NDRange& global,
+                const cl::NDRange& local = cl::NullRange, unsigned int pairs = 1)
+    {
+        for (unsigned int i = 0; i < pairs; i++)
+        {
+            recording.record(kernels_[parity_], global, local);
+            recording.record(kernels_[parity_ ^ 1], global, local);
+        }
+    }
+
+    //! Run a recording made by record(); the same kernel is next after it
+    void replay(cl::CommandQueue& queue, CommandRecording& recording)
+    {
+        recording.enqueue(queue);
+        launches_ += recording.size();
+    }
+
+    unsigned int launches() const { return launches_; }
+
+    //! The kernel the next launch runs, for work-group queries
+    const cl::Kernel& kernel() const { return kernels_[parity_]; }
+
+private:
+    struct Pair
+    {
+        cl::Buffer a, b;
+    };
+
+    cl::Kernel          kernels_[2];
+    std::vector<Pair>   pairs_;
+    int                 parity_;
+    unsigned int        launches_;
+};
+
+} // namespace util
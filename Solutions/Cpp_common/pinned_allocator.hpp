@@ -0,0 +1,229 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       pinned_allocator.hpp
+ *
+ * Purpose:    STL allocator for host memory the OpenCL runtime can transfer
+ *             without a staging copy
+ *
+ * Usage:      util::PinnedAllocator<float> pinned(context, queue);
+ *             std::vector<float, util::PinnedAllocator<float> > h_a(n, 0.0f, pinned);
+ *
+ *             queue.enqueueWriteBuffer(d_a, CL_TRUE, 0, n * sizeof(float), &h_a[0]);
+ *
+ *             Each allocation is a buffer created with CL_MEM_ALLOC_HOST_PTR
+ *             and kept mapped for the life of the allocation.  On discrete
+ *             GPUs such memory is usually page-locked, so reads and writes
+ *             from it go straight to DMA.  On devices that share memory
+ *             with the host (CL_DEVICE_HOST_UNIFIED_MEMORY) a buffer made
+ *             with CL_MEM_USE_HOST_PTR over &h_a[0] lets kernels use the
+ *             memory in place (zero-copy).
+ *
+ *             A default constructed allocator is not bound to a context and
+ *             uses ordinary heap memory, so code can declare its vectors
+ *             before the context exists and switch to pinned memory later.
+ *
+ *             Either way an allocation starts on a HOST_ALIGNMENT (64)
+ *             byte boundary, a cache line and an AVX-512 vector, so host
+ *             loops over it can use aligned vector loads.  A pinned
+ *             buffer is made HOST_ALIGNMENT bytes larger in case the
+ *             runtime maps it at a lesser boundary.
+ *
+ * Note:       Must be included AFTER cl.hpp
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+#define HOST_ALIGNMENT 64   // bytes, the boundary every allocation starts on
+
+namespace util {
+
+// A live pinned allocation: its buffer and where the buffer is mapped
+struct PinnedBlock
+{
+    cl::Buffer  buffer;
+    void       *mapped;
+};
+
+// Context, queue and live allocations, shared by copies of an allocator
+struct PinnedPool
+{
+    cl::Context                   context;
+    cl::CommandQueue              queue;
+    std::map<void *, PinnedBlock> buffers;  // aligned pointer -> backing buffer
+    int                           refs;
+};
+
+//! Heap memory starting on a HOST_ALIGNMENT byte boundary
+inline void *alignedAlloc(std::size_t bytes)
+{
+#ifdef _WIN32
+    void *p = _aligned_malloc(bytes, HOST_ALIGNMENT);
+#else
+    void *p = NULL;
+    if (posix_memalign(&p, HOST_ALIGNMENT, bytes) != 0)
+        p = NULL;
+#endif
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+inline void alignedFree(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+template <typename T>
+class PinnedAllocator
+{
+public:
+    typedef T              value_type;
+    typedef T*             pointer;
+    typedef const T*       const_pointer;
+    typedef T&             reference;
+    typedef const T&       const_reference;
+    typedef std::size_t    size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef PinnedAllocator<U> other;
+    };
+
+#if __cplusplus >= 201103L
+    // Containers take the allocator with them when they are assigned or
+    // swapped, so "h_a = std::vector<...>(n, 0.0f, pinned)" keeps the
+    // memory pinned
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+#endif
+
+    //! Unbound allocator: plain heap memory
+    PinnedAllocator() : pool_(NULL) {}
+
+    //! Allocate pinned memory in context, mapping it with queue
+    PinnedAllocator(const cl::Context& context, const cl::CommandQueue& queue)
+        : pool_(new PinnedPool)
+    {
+        pool_->context = context;
+        pool_->queue   = queue;
+        pool_->refs    = 1;
+    }
+
+    PinnedAllocator(const PinnedAllocator& other) : pool_(other.pool()) { retain(); }
+
+    template <typename U>
+    PinnedAllocator(const PinnedAllocator<U>& other) : pool_(other.pool()) { retain(); }
+
+    PinnedAllocator& operator=(const PinnedAllocator& other)
+    {
+        if (pool_ != other.pool())
+        {
+            drop();
+            pool_ = other.pool();
+            retain();
+        }
+        return *this;
+    }
+
+    ~PinnedAllocator() { drop(); }
+
+    pointer allocate(size_type n, const void * = 0)
+    {
+        if (n == 0)
+            return NULL;
+        if (pool_ == NULL)
+            return static_cast<pointer>(alignedAlloc(n * sizeof(T)));
+
+        const ::size_t bytes = n * sizeof(T) + HOST_ALIGNMENT;
+        PinnedBlock block;
+        block.buffer = cl::Buffer(pool_->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes);
+        block.mapped = pool_->queue.enqueueMapBuffer(block.buffer, CL_TRUE,
+                                                     CL_MAP_READ | CL_MAP_WRITE, 0, bytes);
+        char *host = static_cast<char *>(block.mapped);
+        host += (HOST_ALIGNMENT - reinterpret_cast<std::size_t>(host) % HOST_ALIGNMENT) % HOST_ALIGNMENT;
+        pool_->buffers[host] = block;
+        return reinterpret_cast<pointer>(host);
+    }
+
+    void deallocate(pointer p, size_type)
+    {
+        if (p == NULL)
+            return;
+        if (pool_ == NULL)
+        {
+            alignedFree(p);
+            return;
+        }
+
+        std::map<void *, PinnedBlock>::iterator b = pool_->buffers.find(p);
+        if (b == pool_->buffers.end())
+            return;
+        cl::Event event;
+        pool_->queue.enqueueUnmapMemObject(b->second.buffer, b->second.mapped, NULL, &event);
+        event.wait();
+        pool_->buffers.erase(b);
+    }
+
+    //! Is this allocator handing out pinned memory?
+    bool pinned() const { return pool_ != NULL; }
+
+    size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+
+    void construct(pointer p, const T& value) { new (static_cast<void *>(p)) T(value); }
+    void destroy(pointer p) { p->~T(); }
+
+    PinnedPool *pool() const { return pool_; }
+
+private:
+    PinnedPool *pool_;
+
+    void retain()
+    {
+        if (pool_ != NULL)
+            pool_->refs++;
+    }
+
+    void drop()
+    {
+        if (pool_ != NULL && --pool_->refs == 0)
+            delete pool_;
+        pool_ = NULL;
+    }
+};
+
+template <typename T, typename U>
+inline bool operator==(const PinnedAllocator<T>& a, const PinnedAllocator<U>& b)
+{
+    return a.pool() == b.pool();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const PinnedAllocator<T>& a, const PinnedAllocator<U>& b)
+{
+    return a.pool() != b.pool();
+}
+
+} // namespace util
@@ -0,0 +1,268 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       profiler.hpp
+ *
+ * Purpose:    Time commands on the device with OpenCL event profiling
+ *
+ * Usage:      cl::CommandQueue queue = util::createProfilingQueue(context, device);
+ *             util::Profiler profiler;
+ *
+ *             cl::Event event;
+ *             queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local,
+ *                                        NULL, &event);
+ *             profiler.record("mmul", event);
+ *             ...
+ *             profiler.print();
+ *             profiler.writeFile("profile.csv");    // or profile.json
+ *
+ *             Each record() waits for its event and stores the queued,
+ *             submit, start and end timestamps.  Commands with the same
+ *             name are summarised together (min / median / max), split
+ *             into the time spent waiting in the host queue (queued ->
+ *             submit), waiting on the device (submit -> start) and
+ *             running (start -> end).  Kernels and transfers are told
+ *             apart by the command type of the event.  With OCL_TRACE
+ *             set, each command also goes into the trace (trace.hpp).
+ *
+ * Note:       Must be included AFTER cl.hpp.  The queue must have been
+ *             created with CL_QUEUE_PROFILING_ENABLE.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace util {
+
+// Create an in-order queue that records profiling information
+inline cl::CommandQueue createProfilingQueue(const cl::Context& context, const cl::Device& device)
+{
+    return cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+}
+
+// Run time (start -> end) of a completed command, in seconds
+inline double eventSeconds(const cl::Event& event)
+{
+    cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    cl_ulong end   = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+    return (end - start) * 1.0e-9;
+}
+
+class Profiler
+{
+public:
+    // Summary of one stage of a command over all its samples, in milliseconds
+    struct Stats
+    {
+        double min, median, max;
+    };
+
+private:
+    struct Sample
+    {
+        cl_ulong queued, submit, start, end;
+    };
+
+    struct Entry
+    {
+        std::string         type;     // "kernel", "transfer" or "other"
+        std::vector<Sample> samples;
+    };
+
+    std::vector<std::string>     order_;    // names in the order first seen
+    std::map<std::string, Entry> entries_;
+
+    static std::string commandType(cl_command_type type)
+    {
+        switch (type)
+        {
+        case CL_COMMAND_NDRANGE_KERNEL:
+        case CL_COMMAND_TASK:
+        case CL_COMMAND_NATIVE_KERNEL:
+            return "kernel";
+        case CL_COMMAND_READ_BUFFER:
+        case CL_COMMAND_WRITE_BUFFER:
+        case CL_COMMAND_COPY_BUFFER:
+        case CL_COMMAND_READ_BUFFER_RECT:
+        case CL_COMMAND_WRITE_BUFFER_RECT:
+        case CL_COMMAND_COPY_BUFFER_RECT:
+        case CL_COMMAND_FILL_BUFFER:
+        case CL_COMMAND_READ_IMAGE:
+        case CL_COMMAND_WRITE_IMAGE:
+        case CL_COMMAND_COPY_IMAGE:
+        case CL_COMMAND_COPY_IMAGE_TO_BUFFER:
+        case CL_COMMAND_COPY_BUFFER_TO_IMAGE:
+        case CL_COMMAND_FILL_IMAGE:
+        case CL_COMMAND_MAP_BUFFER:
+        case CL_COMMAND_MAP_IMAGE:
+        case CL_COMMAND_UNMAP_MEM_OBJECT:
+        case CL_COMMAND_MIGRATE_MEM_OBJECTS:
+            return "transfer";
+        default:
+            return "other";
+        }
+    }
+
+    static Stats summarise(std::vector<double> times)
+    {
+        Stats stats = { 0.0, 0.0, 0.0 };
+        if (times.empty())
+            return stats;
+
+        std::sort(times.begin(), times.end());
+        std::vector<double>::size_type n = times.size();
+        stats.min    = times[0];
+        stats.max    = times[n - 1];
+        stats.median = (n % 2) ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+        return stats;
+    }
+
+    // Stage 0: queued -> submit, 1: submit -> start, 2: start -> end
+    Stats stage(const Entry& entry, int which) const
+    {
+        std::vector<double> times;
+        for (std::vector<Sample>::const_iterator s = entry.samples.begin();
+             s != entry.samples.end(); ++s)
+        {
+            cl_ulong from = which == 0 ? s->queued : which == 1 ? s->submit : s->start;
+            cl_ulong to   = which == 0 ? s->submit : which == 1 ? s->start  : s->end;
+            times.push_back((to - from) * 1.0e-6);
+        }
+        return summarise(times);
+    }
+
+public:
+    //! Wait for a command and store its timestamps under the given name
+    void record(const std::string& name, const cl::Event& event)
+    {
+        event.wait();
+
+        Sample sample;
+        sample.queued = event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+        sample.submit = event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+        sample.start  = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        sample.end    = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+        if (entries_.find(name) == entries_.end())
+        {
+            order_.push_back(name);
+            entries_[name].type = commandType(event.getInfo<CL_EVENT_COMMAND_TYPE>());
+        }
+        entries_[name].samples.push_back(sample);
+
+        if (traceEnabled())
+            traceCommand(name, event.getInfo<CL_EVENT_COMMAND_QUEUE>()(), sample.start, sample.end);
+    }
+
+    //! Forget all recorded commands
+    void clear()
+    {
+        order_.clear();
+        entries_.clear();
+    }
+
+    //! Run time statistics (start -> end, milliseconds) for a named command
+    Stats runTime(const std::string& name) const
+    {
+        std::map<std::string, Entry>::const_iterator e = entries_.find(name);
+        if (e == entries_.end())
+        {
+            Stats none = { 0.0, 0.0, 0.0 };
+            return none;
+        }
+        return stage(e->second, 2);
+    }
+
+    //! Print a table of the recorded commands
+    void print(std::ostream& out = std::cout) const
+    {
+        out << "\n" << std::left << std::setw(24) << "Command" << std::right
+            << std::setw(9) << "Type" << std::setw(7) << "Count"
+            << std::setw(12) << "Queue(ms)" << std::setw(12) << "Submit(ms)"
+            << std::setw(12) << "Min(ms)" << std::setw(12) << "Median(ms)"
+            << std::setw(12) << "Max(ms)" << "\n";
+
+        out << std::fixed << std::setprecision(4);
+        for (std::vector<std::string>::const_iterator n = order_.begin(); n != order_.end(); ++n)
+        {
+            const Entry& entry = entries_.find(*n)->second;
+            Stats queued = stage(entry, 0), submit = stage(entry, 1), run = stage(entry, 2);
+            out << std::left << std::setw(24) << *n << std::right
+                << std::setw(9) << entry.type << std::setw(7) << entry.samples.size()
+                << std::setw(12) << queued.median << std::setw(12) << submit.median
+                << std::setw(12) << run.min << std::setw(12) << run.median
+                << std::setw(12) << run.max << "\n";
+        }
+        out.unsetf(std::ios::floatfield);
+    }
+
+    //! One line per command; all times in milliseconds
+    void writeCSV(std::ostream& out) const
+    {
+        out << "name,type,count,"
+               "queued_min,queued_median,queued_max,"
+               "submit_min,submit_median,submit_max,"
+               "run_min,run_median,run_max\n";
+
+        out << std::setprecision(6);
+        for (std::vector<std::string>::const_iterator n = order_.begin(); n != order_.end(); ++n)
+        {
+            const Entry& entry = entries_.find(*n)->second;
+            out << *n << "," << entry.type << "," << entry.samples.size();
+            for (int s = 0; s < 3; s++)
+            {
+                Stats stats = stage(entry, s);
+                out << "," << stats.min << "," << stats.median << "," << stats.max;
+            }
+            out << "\n";
+        }
+    }
+
+    //! The same information as a JSON array of objects
+    void writeJSON(std::ostream& out) const
+    {
+        static const char *stages[] = { "queued", "submit", "run" };
+
+        out << "[\n" << std::setprecision(6);
+        for (std::vector<std::string>::const_iterator n = order_.begin(); n != order_.end(); ++n)
+        {
+            const Entry& entry = entries_.find(*n)->second;
+            out << "  { \"name\": \"" << *n << "\", \"type\": \"" << entry.type
+                << "\", \"count\": " << entry.samples.size();
+            for (int s = 0; s < 3; s++)
+            {
+                Stats stats = stage(entry, s);
+                out << ", \"" << stages[s] << "_ms\": { \"min\": " << stats.min
+                    << ", \"median\": " << stats.median << ", \"max\": " << stats.max << " }";
+            }
+            out << " }" << (n + 1 != order_.end() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+
+    //! Write CSV, or JSON if the file name ends in ".json"; false on failure
+    bool writeFile(const std::string& path) const
+    {
+        std::ofstream out(path.c_str());
+        if (!out.is_open())
+            return false;
+
+        if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0)
+            writeJSON(out);
+        else
+            writeCSV(out);
+        return true;
+    }
+};
+
+} // namespace util
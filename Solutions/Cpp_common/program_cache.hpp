@@ -0,0 +1,330 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       program_cache.hpp
+ *
+ * Purpose:    Build OpenCL programs through an on-disk cache of program
+ *             binaries, so that a warm start skips the OpenCL C compiler
+ *
+ * Usage:      cl::Program program = util::buildProgram(context, device,
+ *                 util::loadProgram("../C_block_form.cl"), "-D blksz=16");
+ *
+ *             Binaries are stored in the directory named by the
+ *             OCL_PROGRAM_CACHE environment variable (default ".clcache"
+ *             in the working directory).  Set OCL_PROGRAM_CACHE to an
+ *             empty string to disable the cache.
+ *
+ *             Cache entries are keyed by a hash of the kernel source, the
+ *             device name, the device and driver versions and the build
+ *             options, so editing a kernel or upgrading the driver simply
+ *             misses the cache rather than loading a stale binary.
+ *
+ *             cl::Program program = util::buildProgramFile(context, device,
+ *                 "../pi_ocl.cl");
+ *
+ *             builds from precompiled SPIR-V, ../pi_ocl.spv (made by "make
+ *             spirv" in Solutions), when there is one, the device takes IL
+ *             (OpenCL 2.1, or cl_khr_il_program) and the options define
+ *             nothing (-D), since the IL was compiled without them.  In
+ *             any other case, or if the IL is rejected, it builds from the
+ *             source, as loadProgram finds it.  IL builds are cached like
+ *             source builds, keyed by the IL.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "util.hpp"
+#include "trace.hpp"
+
+#ifndef CL_DEVICE_IL_VERSION
+#define CL_DEVICE_IL_VERSION 0x105B
+#endif
+
+namespace util {
+
+// 64-bit FNV-1a hash, used to name cache entries
+inline unsigned long long hashString(const std::string& str)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (std::string::size_type i = 0; i < str.size(); i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Directory holding cached binaries, or "" if the cache is disabled
+inline std::string programCacheDir()
+{
+    const char *dir = getenv("OCL_PROGRAM_CACHE");
+    if (dir == NULL)
+        return ".clcache";
+    return std::string(dir);
+}
+
+// Path of the cache entry for this source/device/options triple
+inline std::string programCachePath(const cl::Device& device,
+                                    const std::string& source,
+                                    const std::string& options)
+{
+    std::string key = source;
+    key += '\0';
+    key += device.getInfo<CL_DEVICE_NAME>();
+    key += '\0';
+    key += device.getInfo<CL_DEVICE_VERSION>();
+    key += '\0';
+    key += device.getInfo<CL_DRIVER_VERSION>();
+    key += '\0';
+    key += options;
+
+    char name[32];
+    sprintf(name, "%016llx.bin", hashString(key));
+    return programCacheDir() + "/" + name;
+}
+
+// Print the build log for a device if a build failed, then rethrow
+inline void reportBuildFailure(const cl::Program& program,
+                               const cl::Device& device,
+                               const cl::Error& error)
+{
+    if (error.err() == CL_BUILD_PROGRAM_FAILURE)
+    {
+        std::string log = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+        std::cerr << log << "\n";
+    }
+    throw error;
+}
+
+// Try to create and build the program from a cached binary.
+// Returns false (leaving program untouched) on a miss or a rejected binary.
+inline bool loadCachedProgram(const cl::Context& context,
+                              const cl::Device& device,
+                              const std::string& path,
+                              const std::string& options,
+                              cl::Program& program)
+{
+    std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+    if (!stream.is_open())
+        return false;
+
+    std::string binary(
+        (std::istreambuf_iterator<char>(stream)),
+        std::istreambuf_iterator<char>());
+    if (binary.empty())
+        return false;
+
+    std::vector<cl::Device> devices(1, device);
+    cl::Program::Binaries binaries(1,
+        std::make_pair((const void*)binary.data(), binary.size()));
+
+    // A binary from a different driver build may be rejected at creation
+    // or build time; either way we fall back to compiling the source
+    try
+    {
+        cl::Program cached(context, devices, binaries);
+        cached.build(devices, options.c_str());
+        program = cached;
+        return true;
+    }
+    catch (cl::Error)
+    {
+        return false;
+    }
+}
+
+// Write the device binary of a freshly built program into the cache
+inline void storeCachedProgram(const cl::Program& program,
+                               const std::string& path)
+{
+    std::string dir = programCacheDir();
+#if defined(_WIN32)
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+
+    // CL_PROGRAM_BINARIES fills buffers the caller allocates, one a device
+    // of the program, so the C++ wrapper's getInfo cannot be used for it
+    std::vector< ::size_t> sizes = program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+    if (sizes.empty() || sizes[0] == 0)
+        return;
+
+    std::vector<char *> binaries(sizes.size());
+    for (std::vector< ::size_t>::size_type i = 0; i < sizes.size(); i++)
+        binaries[i] = sizes[i] > 0 ? new char[sizes[i]] : NULL;
+
+    if (::clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(char *) * binaries.size(),
+                           &binaries[0], NULL) == CL_SUCCESS)
+    {
+        // Write to a temporary and rename so that concurrent runs never
+        // see a partially written binary
+        std::ostringstream tmp;
+        tmp << path << "." << getpid() << ".tmp";
+        std::ofstream stream(tmp.str().c_str(), std::ios::out | std::ios::binary);
+        if (stream.is_open())
+        {
+            stream.write(binaries[0], sizes[0]);
+            stream.close();
+            if (!stream.fail())
+                rename(tmp.str().c_str(), path.c_str());
+            else
+                remove(tmp.str().c_str());
+        }
+    }
+
+    for (std::vector<char *>::size_type i = 0; i < binaries.size(); i++)
+        delete[] binaries[i];
+}
+
+// Build a program for a single device, going through the binary cache
+inline cl::Program buildProgram(const cl::Context& context,
+                                const cl::Device& device,
+                                const std::string& source,
+                                const std::string& options = "")
+{
+    TraceSpan span("build program", options);
+    cl::Program program;
+    std::vector<cl::Device> devices(1, device);
+
+    bool cache = !programCacheDir().empty();
+    std::string path;
+    if (cache)
+    {
+        path = programCachePath(device, source, options);
+        if (loadCachedProgram(context, device, path, options, program))
+            return program;
+    }
+
+    program = cl::Program(context, source);
+    try
+    {
+        program.build(devices, options.c_str());
+    }
+    catch (cl::Error error)
+    {
+        reportBuildFailure(program, device, error);
+    }
+
+    if (cache)
+        storeCachedProgram(program, path);
+
+    return program;
+}
+
+// Whether a device can build programs from SPIR-V: OpenCL 2.1 made it
+// core, and before that it is the cl_khr_il_program extension
+inline bool deviceTakesIL(const cl::Device& device)
+{
+    std::string il;
+    if (device.getInfo(CL_DEVICE_IL_VERSION, &il) != CL_SUCCESS)
+        return false;
+    return il.find("SPIR-V") != std::string::npos;
+}
+
+// Create (not build) a program from SPIR-V, or return false if the
+// device or its driver cannot
+inline bool createProgramWithIL(const cl::Context& context, const cl::Device& device,
+                                const std::string& il, cl::Program& program)
+{
+    typedef cl_program (CL_API_CALL *CreateWithIL)(cl_context, const void *, ::size_t, cl_int *);
+    CreateWithIL create = NULL;
+
+    // "OpenCL 2.1 ..." and later have it in the core API
+#if defined(CL_VERSION_2_1)
+    std::string version = device.getInfo<CL_DEVICE_VERSION>();
+    if (version.size() > 9 && (version[7] > '2' || (version[7] == '2' && version[9] >= '1')))
+        create = ::clCreateProgramWithIL;
+#endif
+    if (create == NULL)
+    {
+        cl_platform_id platform = device.getInfo<CL_DEVICE_PLATFORM>();
+        create = (CreateWithIL)::clGetExtensionFunctionAddressForPlatform(
+            platform, "clCreateProgramWithILKHR");
+    }
+    if (create == NULL)
+        return false;
+
+    cl_int err;
+    cl_program created = create(context(), il.data(), il.size(), &err);
+    if (err != CL_SUCCESS)
+        return false;
+    program = cl::Program(created);
+    return true;
+}
+
+// Build a program from a kernel file, through its SPIR-V if it can be used
+inline cl::Program buildProgramFile(const cl::Context& context,
+                                    const cl::Device& device,
+                                    const std::string& file,
+                                    const std::string& options = "")
+{
+    TraceSpan span("build program file", file);
+    std::string spv = file;
+    if (spv.size() > 3 && spv.compare(spv.size() - 3, 3, ".cl") == 0)
+        spv.replace(spv.size() - 3, 3, ".spv");
+    else
+        spv.clear();
+
+    std::ifstream stream;
+    if (!spv.empty() && options.find("-D") == std::string::npos && deviceTakesIL(device))
+        stream.open(spv.c_str(), std::ios::in | std::ios::binary);
+
+    if (stream.is_open())
+    {
+        std::string il(
+            (std::istreambuf_iterator<char>(stream)),
+            std::istreambuf_iterator<char>());
+
+        cl::Program program;
+        bool cache = !programCacheDir().empty();
+        std::string path;
+        if (cache)
+        {
+            path = programCachePath(device, il, options);
+            if (loadCachedProgram(context, device, path, options, program))
+                return program;
+        }
+
+        if (!il.empty() && createProgramWithIL(context, device, il, program))
+        {
+            std::vector<cl::Device> devices(1, device);
+            try
+            {
+                program.build(devices, options.c_str());
+                if (cache)
+                    storeCachedProgram(program, path);
+                return program;
+            }
+            catch (cl::Error)
+            {
+                // Fall back to the source
+            }
+        }
+    }
+
+    return buildProgram(context, device, loadProgram(file), options);
+}
+
+} // namespace util
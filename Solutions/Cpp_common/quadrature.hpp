@@ -0,0 +1,391 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       quadrature.hpp
+ *
+ * Purpose:    Integrate any function over any box, in one or more
+ *             dimensions, with the work-group pattern of the pi kernels
+ *             (Exercise09), in place of a kernel for each integrand
+ *
+ * Usage:      util::Quadrature quad(context, device);
+ *
+ *             // pi, as Exercise09 does it, with 3 point Gauss-Legendre
+ *             double lo = 0.0, hi = 1.0;
+ *             util::QuadratureResult r = quad.integrate(queue,
+ *                 util::QuadratureSpec("4.0f / (1.0f + x0 * x0)").gauss(3), &lo, &hi, 1024);
+ *
+ *             // a 2D integral in double, with a helper function and a -D
+ *             util::QuadratureSpec spec("g(x0, x1)", 2);
+ *             spec.precision("double").simpson()
+ *                 .code("double g(double x, double y) { return exp(-K * (x * x + y * y)); }")
+ *                 .options("-D K=2.0");
+ *             double los[2] = { -1, -1 }, his[2] = { 1, 1 };
+ *             r = quad.integrate(queue, spec, los, his, 4096);   // 4096^2 cells
+ *
+ *             The integrand is an OpenCL C expression in x0, x1, ... (one
+ *             for each dimension), compiled into the kernel, with any
+ *             functions it calls given as code() and any macros as
+ *             options(), so a new integrand is a new string.  The box is
+ *             cut into cells, cells along each dimension, and each cell is
+ *             integrated with the rule: the midpoint, Simpson's rule, or
+ *             Gauss-Legendre of 1 to 5 points, as a tensor product in more
+ *             than one dimension (points^dims evaluations a cell).
+ *
+ *             Each work-item adds up a run of cells with compensated
+ *             (Kahan) sums, the work-groups reduce their work-items' sums
+ *             in a tree, and a second kernel adds the work-groups' sums
+ *             and scales them by a cell's volume, as pi and pi_final do;
+ *             the work is sized with planLaunch.  Kernels are generated
+ *             and built the first time a spec is asked for, then kept by
+ *             the spec's signature (and the binaries are in the program
+ *             cache), so integrating again costs two launches and a read.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             The precision is float or double (cl_khr_fp64).
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include "program_cache.hpp"
+#include "launch_plan.hpp"
+
+namespace util {
+
+enum QuadratureRule { QUAD_MIDPOINT, QUAD_SIMPSON, QUAD_GAUSS };
+
+// What to integrate and how: the integrand, its dimensions, the rule
+// and the precision
+struct QuadratureSpec
+{
+    std::string    expr;         // OpenCL C, in x0 .. x(dims - 1)
+    unsigned int   dims;
+    std::string    type;         // float or double
+    QuadratureRule rule;
+    unsigned int   points;       // Gauss-Legendre points, 1 to 5
+    std::string    helpers;      // source put before the kernels
+    std::string    build;        // build options, such as -D
+
+    QuadratureSpec(const std::string& expr_, unsigned int dims_ = 1)
+        : expr(expr_), dims(dims_), type("float"), rule(QUAD_MIDPOINT), points(1)
+    {
+    }
+
+    QuadratureSpec& precision(const std::string& t) { type = t; return *this; }
+    QuadratureSpec& midpoint() { rule = QUAD_MIDPOINT; points = 1; return *this; }
+    QuadratureSpec& simpson() { rule = QUAD_SIMPSON; points = 3; return *this; }
+    QuadratureSpec& gauss(unsigned int n) { rule = QUAD_GAUSS; points = n; return *this; }
+    QuadratureSpec& code(const std::string& src) { helpers = src; return *this; }
+    QuadratureSpec& options(const std::string& opts) { build = opts; return *this; }
+
+    //! The rule's nodes and weights on a cell [0, 1]
+    void nodes(std::vector<double>& node, std::vector<double>& weight) const
+    {
+        // Gauss-Legendre on [-1, 1], the points of each n from 0 up
+        static const double gl_nodes[5][3] = {
+            { 0.0 },
+            { 0.57735026918962576 },
+            { 0.0, 0.77459666924148338 },
+            { 0.33998104358485626, 0.86113631159405258 },
+            { 0.0, 0.53846931010568309, 0.90617984593866399 } };
+        static const double gl_weights[5][3] = {
+            { 2.0 },
+            { 1.0 },
+            { 0.88888888888888889, 0.55555555555555556 },
+            { 0.65214515486254614, 0.34785484513745386 },
+            { 0.56888888888888889, 0.47862867049936647, 0.23692688505618909 } };
+
+        node.clear();
+        weight.clear();
+        if (rule == QUAD_MIDPOINT)
+        {
+            node.push_back(0.5);
+            weight.push_back(1.0);
+        }
+        else if (rule == QUAD_SIMPSON)
+        {
+            node.push_back(0.0);  weight.push_back(1.0 / 6.0);
+            node.push_back(0.5);  weight.push_back(4.0 / 6.0);
+            node.push_back(1.0);  weight.push_back(1.0 / 6.0);
+        }
+        else
+        {
+            if (points < 1 || points > 5)
+                throw cl::Error(CL_INVALID_VALUE, "util::QuadratureSpec (Gauss-Legendre of 1 to 5 points)");
+            // The nodes below the middle, then the middle and above
+            const double *t = gl_nodes[points - 1], *w = gl_weights[points - 1];
+            for (int k = (int)(points - 1) / 2; k >= 0; k--)
+            {
+                if (t[k] == 0.0)
+                    continue;
+                node.push_back(0.5 * (1.0 - t[k]));
+                weight.push_back(0.5 * w[k]);
+            }
+            for (unsigned int k = 0; k <= (points - 1) / 2; k++)
+            {
+                node.push_back(0.5 * (1.0 + t[k]));
+                weight.push_back(0.5 * w[k]);
+            }
+        }
+    }
+
+    //! Everything the kernels are generated from, as one string
+    std::string signature() const
+    {
+        std::ostringstream sig;
+        sig << type << "/" << dims << "/" << rule << "/" << points << "/" << build
+            << ": " << expr << "\n" << helpers;
+        return sig.str();
+    }
+
+    //! The source of the kernels "quadrature" and "quadrature_final"
+    std::string source() const
+    {
+        if (type != "float" && type != "double")
+            throw cl::Error(CL_INVALID_VALUE, "util::QuadratureSpec (precision not float or double)");
+        if (dims < 1)
+            throw cl::Error(CL_INVALID_VALUE, "util::QuadratureSpec (no dimensions)");
+
+        std::vector<double> node, weight;
+        nodes(node, weight);
+        const char *suffix = type == "float" ? "f" : "";
+
+        std::ostringstream src;
+        src.precision(17);
+        if (type == "double")
+            src << "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+        src << "typedef " << type << " real;\n\n"
+            << helpers << "\n\n";
+
+        src << "#define INTEGRAND(";
+        for (unsigned int d = 0; d < dims; d++)
+            src << (d ? ", " : "") << "x" << d;
+        src << ") (" << expr << ")\n\n";
+
+        src << "#define QUAD_POINTS " << node.size() << "\n"
+            << "__constant real quad_node[QUAD_POINTS] = {";
+        for (::size_t q = 0; q < node.size(); q++)
+            src << (q ? ", " : " ") << std::scientific << node[q] << suffix;
+        src << " };\n__constant real quad_weight[QUAD_POINTS] = {";
+        for (::size_t q = 0; q < weight.size(); q++)
+            src << (q ? ", " : " ") << std::scientific << weight[q] << suffix;
+        src << " };\n\n";
+
+        // The pairwise tree of pi_ocl.cl's reduce_local
+        src << "real reduce_quad(__local real* local_sums)\n"
+               "{\n"
+               "   int local_id = get_local_id(0);\n"
+               "   int count    = get_local_size(0);\n"
+               "   while (count > 1) {\n"
+               "      int half = (count + 1) / 2;\n"
+               "      if (local_id < count - half)\n"
+               "         local_sums[local_id] += local_sums[local_id + half];\n"
+               "      barrier(CLK_LOCAL_MEM_FENCE);\n"
+               "      count = half;\n"
+               "   }\n"
+               "   return local_sums[0];\n"
+               "}\n\n";
+
+        // Cells istart .. iend - 1 of ncells, n along each dimension, for
+        // each work-item; cell c is the digits of c in base n
+        src << "__kernel void quadrature(const int niters, const long ncells, const long n,\n"
+               "                         __global const real* lo, __global const real* h,\n"
+               "                         __local real* local_sums, __global real* partial_sums)\n"
+               "{\n"
+               "   const long istart = ((long)get_group_id(0) * get_local_size(0) + get_local_id(0)) * niters;\n"
+               "   const long iend   = min(istart + niters, ncells);\n"
+               "   real accum = 0, comp = 0;\n"
+               "   for (long c = istart; c < iend; c++) {\n"
+               "      long rest = c;\n";
+        for (unsigned int d = 0; d < dims; d++)
+            src << "      const real a" << d << " = lo[" << d << "] + h[" << d
+                << "] * (real)(rest % n); rest /= n;\n";
+        src << "      real cell = 0;\n";
+        std::string indent = "      ";
+        for (unsigned int d = 0; d < dims; d++)
+        {
+            src << indent << "for (int q" << d << " = 0; q" << d << " < QUAD_POINTS; q"
+                << d << "++) {\n";
+            indent += "   ";
+            src << indent << "const real x" << d << " = a" << d << " + h[" << d
+                << "] * quad_node[q" << d << "];\n";
+        }
+        src << indent << "cell += ";
+        for (unsigned int d = 0; d < dims; d++)
+            src << "quad_weight[q" << d << "] * ";
+        src << "INTEGRAND(";
+        for (unsigned int d = 0; d < dims; d++)
+            src << (d ? ", " : "") << "x" << d;
+        src << ");\n";
+        for (unsigned int d = 0; d < dims; d++)
+        {
+            indent.resize(indent.size() - 3);
+            src << indent << "}\n";
+        }
+        src << "      const real y = cell - comp;\n"
+               "      const real t = accum + y;\n"
+               "      comp = (t - accum) - y;\n"
+               "      accum = t;\n"
+               "   }\n"
+               "   local_sums[get_local_id(0)] = accum;\n"
+               "   barrier(CLK_LOCAL_MEM_FENCE);\n"
+               "   const real sum = reduce_quad(local_sums);\n"
+               "   if (get_local_id(0) == 0)\n"
+               "      partial_sums[get_group_id(0)] = sum;\n"
+               "}\n\n";
+
+        // One work-group: the group sums, times a cell's volume
+        src << "__kernel void quadrature_final(const int nsums, const real volume,\n"
+               "                               __global const real* partial_sums,\n"
+               "                               __local real* local_sums, __global real* result)\n"
+               "{\n"
+               "   real y, t, accum = 0, comp = 0;\n"
+               "   for (int i = get_local_id(0); i < nsums; i += get_local_size(0)) {\n"
+               "      y = partial_sums[i] - comp;\n"
+               "      t = accum + y;\n"
+               "      comp = (t - accum) - y;\n"
+               "      accum = t;\n"
+               "   }\n"
+               "   local_sums[get_local_id(0)] = accum;\n"
+               "   barrier(CLK_LOCAL_MEM_FENCE);\n"
+               "   accum = reduce_quad(local_sums);\n"
+               "   if (get_local_id(0) == 0)\n"
+               "      result[0] = accum * volume;\n"
+               "}\n";
+        return src.str();
+    }
+};
+
+// The integral, and what it took
+struct QuadratureResult
+{
+    double    value;
+    cl_long   cells;           // in all, cells^dims
+    cl_long   evaluations;     // of the integrand
+    cl::Event event;           // of the quadrature kernel, for profiling
+};
+
+class Quadrature
+{
+public:
+    Quadrature(const cl::Context& context, const cl::Device& device)
+        : context_(context), device_(device)
+    {
+    }
+
+    //! The integral of spec's integrand over the box lo[d] .. hi[d], with
+    //! cells along each of its dimensions
+    QuadratureResult integrate(cl::CommandQueue& queue, const QuadratureSpec& spec,
+                               const double *lo, const double *hi, cl_long cells)
+    {
+        if (cells < 1)
+            throw cl::Error(CL_INVALID_VALUE, "util::Quadrature::integrate (no cells)");
+        cl_long ncells = 1;
+        for (unsigned int d = 0; d < spec.dims; d++)
+        {
+            if (ncells > ((cl_long)1 << 62) / cells)
+                throw cl::Error(CL_INVALID_VALUE, "util::Quadrature::integrate (too many cells)");
+            ncells *= cells;
+        }
+
+        if (spec.type == "double")
+            return run<cl_double>(queue, spec, lo, hi, cells, ncells);
+        return run<cl_float>(queue, spec, lo, hi, cells, ncells);
+    }
+
+    //! Number of integrands built so far
+    ::size_t size() const { return kernels_.size(); }
+
+private:
+    struct Kernels
+    {
+        cl::Kernel quad;
+        cl::Kernel final;
+        ::size_t   final_size;      // the final kernel's one work-group
+    };
+
+    cl::Context context_;
+    cl::Device  device_;
+    std::map<std::string, Kernels> kernels_;
+
+    Kernels& get(const QuadratureSpec& spec)
+    {
+        const std::string sig = spec.signature();
+        std::map<std::string, Kernels>::iterator k = kernels_.find(sig);
+        if (k != kernels_.end())
+            return k->second;
+
+        cl::Program program = buildProgram(context_, device_, spec.source(), spec.build);
+        Kernels made;
+        made.quad = cl::Kernel(program, "quadrature");
+        made.final = cl::Kernel(program, "quadrature_final");
+        made.final_size = made.final.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device_);
+        return kernels_.insert(std::make_pair(sig, made)).first->second;
+    }
+
+    template <typename real>
+    QuadratureResult run(cl::CommandQueue& queue, const QuadratureSpec& spec,
+                         const double *lo, const double *hi, cl_long cells, cl_long ncells)
+    {
+        Kernels& k = get(spec);
+
+        std::vector<real> h_lo(spec.dims), h_h(spec.dims);
+        double volume = 1.0;
+        for (unsigned int d = 0; d < spec.dims; d++)
+        {
+            h_lo[d] = (real)lo[d];
+            h_h[d] = (real)((hi[d] - lo[d]) / cells);
+            volume *= (hi[d] - lo[d]) / cells;
+        }
+        cl::Buffer d_lo(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                        sizeof(real) * spec.dims, &h_lo[0]);
+        cl::Buffer d_h(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       sizeof(real) * spec.dims, &h_h[0]);
+
+        LaunchPlan plan = planLaunch(k.quad, device_, ncells);
+        cl::Buffer d_partial(context_, CL_MEM_READ_WRITE, sizeof(real) * plan.work_groups);
+        cl::Buffer d_result(context_, CL_MEM_WRITE_ONLY, sizeof(real));
+
+        k.quad.setArg(0, (int)plan.iters);
+        k.quad.setArg(1, ncells);
+        k.quad.setArg(2, cells);
+        k.quad.setArg(3, d_lo);
+        k.quad.setArg(4, d_h);
+        k.quad.setArg(5, cl::Local(sizeof(real) * plan.work_group_size));
+        k.quad.setArg(6, d_partial);
+
+        QuadratureResult result;
+        queue.enqueueNDRangeKernel(k.quad, cl::NullRange,
+                                   cl::NDRange(plan.work_groups * plan.work_group_size),
+                                   cl::NDRange(plan.work_group_size), NULL, &result.event);
+
+        ::size_t final_size = std::min(k.final_size, plan.work_groups);
+        k.final.setArg(0, (int)plan.work_groups);
+        k.final.setArg(1, (real)volume);
+        k.final.setArg(2, d_partial);
+        k.final.setArg(3, cl::Local(sizeof(real) * final_size));
+        k.final.setArg(4, d_result);
+        queue.enqueueNDRangeKernel(k.final, cl::NullRange, cl::NDRange(final_size),
+                                   cl::NDRange(final_size));
+
+        real value;
+        queue.enqueueReadBuffer(d_result, CL_TRUE, 0, sizeof(real), &value);
+
+        cl_long per_cell = 1;
+        for (unsigned int d = 0; d < spec.dims; d++)
+            per_cell *= spec.points;
+        result.value = value;
+        result.cells = ncells;
+        result.evaluations = ncells * per_cell;
+        return result;
+    }
+};
+
+} // namespace util
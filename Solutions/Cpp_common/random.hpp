@@ -0,0 +1,230 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       random.hpp
+ *
+ * Purpose:    Random numbers made on the device, straight into buffers,
+ *             with the counter-based Philox4x32-10 generator, in place of
+ *             rand() on the host and an upload
+ *
+ * Usage:      util::Random rng(context, device, seed);
+ *             rng.uniform(queue, d_a, n);              // [0, 1)
+ *             rng.uniform(queue, d_b, n, -1.0f, 1.0f); // [-1, 1)
+ *             rng.normal(queue, d_c, n, 0.0f, 1.0f);   // mean, sigma
+ *
+ *             float a0 = util::philoxUniform(seed, 0, 0);   // the same on the host
+ *
+ *             Philox (Salmon et al., "Parallel random numbers: as easy as
+ *             1, 2, 3", SC11) turns a 128 bit counter and a 64 bit key
+ *             into four 32 bit random words with ten rounds of multiplies,
+ *             so any element can be made on its own, by any work-item, in
+ *             any order: there is no state to carry from one to the next.
+ *             The key is the seed and the counter is a position in the
+ *             stream, so each fill takes the next n / 4 counters and a
+ *             second fill gives different numbers from the first, but the
+ *             same seed gives the same numbers whatever the device, the
+ *             work-group size or the number of work-items.
+ *
+ *             A uniform float is the top 24 bits of a word times 2^-24,
+ *             which is exact, and lo + (hi - lo) * u is worked out with
+ *             FP_CONTRACT off, so philoxUniform on the host gives the same
+ *             bits as the device.  Normals are Box-Muller on pairs of
+ *             uniforms, and so only agree with the host to rounding.
+ *
+ *             The fill kernels are grid-stride, four numbers a counter,
+ *             over as many work-items as fill the device (util::planGrid).
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cmath>
+#include <string>
+
+#include "program_cache.hpp"
+#include "launch_plan.hpp"
+
+namespace util {
+
+// The generator as OpenCL C: philox4x32_10(counter, key), and the fills
+inline const char *philoxSource()
+{
+    return
+    "#pragma OPENCL FP_CONTRACT OFF\n"
+    "\n"
+    "#define PHILOX_M0 0xD2511F53u\n"
+    "#define PHILOX_M1 0xCD9E8D57u\n"
+    "#define PHILOX_W0 0x9E3779B9u\n"
+    "#define PHILOX_W1 0xBB67AE85u\n"
+    "\n"
+    "uint4 philox_round(uint4 c, uint2 k)\n"
+    "{\n"
+    "   const uint hi0 = mul_hi(PHILOX_M0, c.x), lo0 = PHILOX_M0 * c.x;\n"
+    "   const uint hi1 = mul_hi(PHILOX_M1, c.z), lo1 = PHILOX_M1 * c.z;\n"
+    "   return (uint4)(hi1 ^ c.y ^ k.x, lo1, hi0 ^ c.w ^ k.y, lo0);\n"
+    "}\n"
+    "\n"
+    "uint4 philox4x32_10(uint4 c, uint2 k)\n"
+    "{\n"
+    "   for (int r = 0; r < 10; r++) {\n"
+    "      if (r > 0)\n"
+    "         k += (uint2)(PHILOX_W0, PHILOX_W1);\n"
+    "      c = philox_round(c, k);\n"
+    "   }\n"
+    "   return c;\n"
+    "}\n"
+    "\n"
+    "// The four words of counter base + g under key\n"
+    "uint4 philox_at(ulong base, ulong g, uint2 key)\n"
+    "{\n"
+    "   const ulong c = base + g;\n"
+    "   return philox4x32_10((uint4)((uint)c, (uint)(c >> 32), 0u, 0u), key);\n"
+    "}\n"
+    "\n"
+    "// Store the four numbers of counter g, or those of them below n\n"
+    "void store4(__global float* out, ulong g, ulong n, float4 v)\n"
+    "{\n"
+    "   const ulong i = g * 4;\n"
+    "   if (i + 4 <= n)\n"
+    "      vstore4(v, g, out);\n"
+    "   else {\n"
+    "      if (i < n)     out[i]     = v.x;\n"
+    "      if (i + 1 < n) out[i + 1] = v.y;\n"
+    "      if (i + 2 < n) out[i + 2] = v.z;\n"
+    "   }\n"
+    "}\n"
+    "\n"
+    "// out[i] = lo + scale * u, u uniform in [0, 1)\n"
+    "__kernel void philox_uniform(__global float* out, const ulong n,\n"
+    "                             const uint key0, const uint key1, const ulong base,\n"
+    "                             const float lo, const float scale)\n"
+    "{\n"
+    "   for (ulong g = get_global_id(0); g * 4 < n; g += get_global_size(0)) {\n"
+    "      const uint4 r = philox_at(base, g, (uint2)(key0, key1));\n"
+    "      const float4 u = convert_float4(r >> 8u) * (1.0f / 16777216.0f);\n"
+    "      store4(out, g, n, lo + scale * u);\n"
+    "   }\n"
+    "}\n"
+    "\n"
+    "// out[i] = mean + sigma * z, z standard normal (Box-Muller)\n"
+    "__kernel void philox_normal(__global float* out, const ulong n,\n"
+    "                            const uint key0, const uint key1, const ulong base,\n"
+    "                            const float mean, const float sigma)\n"
+    "{\n"
+    "   for (ulong g = get_global_id(0); g * 4 < n; g += get_global_size(0)) {\n"
+    "      const uint4 r = philox_at(base, g, (uint2)(key0, key1));\n"
+    "      // u1 in (0, 1], so its log is finite\n"
+    "      const float2 u1 = convert_float2(r.xz >> 8u) * (1.0f / 16777216.0f) + (1.0f / 16777216.0f);\n"
+    "      const float2 u2 = convert_float2(r.yw >> 8u) * (1.0f / 16777216.0f);\n"
+    "      const float2 radius = sqrt(-2.0f * log(u1));\n"
+    "      const float2 angle = 6.28318530717958648f * u2;\n"
+    "      const float4 z = (float4)(radius.x * cos(angle.x), radius.x * sin(angle.x),\n"
+    "                                radius.y * cos(angle.y), radius.y * sin(angle.y));\n"
+    "      store4(out, g, n, mean + sigma * z);\n"
+    "   }\n"
+    "}\n";
+}
+
+// philox4x32_10 on the host, counter ctr and key key, in place of ctr
+inline void philox4x32_10(cl_uint ctr[4], const cl_uint key[2])
+{
+    cl_uint k0 = key[0], k1 = key[1];
+    for (int r = 0; r < 10; r++)
+    {
+        if (r > 0)
+        {
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        const cl_ulong p0 = (cl_ulong)0xD2511F53u * ctr[0];
+        const cl_ulong p1 = (cl_ulong)0xCD9E8D57u * ctr[2];
+        const cl_uint c1 = ctr[1], c3 = ctr[3];
+        ctr[0] = (cl_uint)(p1 >> 32) ^ c1 ^ k0;
+        ctr[1] = (cl_uint)p1;
+        ctr[2] = (cl_uint)(p0 >> 32) ^ c3 ^ k1;
+        ctr[3] = (cl_uint)p0;
+    }
+}
+
+// Element i of util::Random(seed).uniform(lo, hi) made from counter base,
+// bit for bit as the device makes it
+inline float philoxUniform(cl_ulong seed, cl_ulong base, cl_ulong i,
+                           float lo = 0.0f, float hi = 1.0f)
+{
+    const cl_ulong c = base + i / 4;
+    cl_uint ctr[4] = { (cl_uint)c, (cl_uint)(c >> 32), 0, 0 };
+    const cl_uint key[2] = { (cl_uint)seed, (cl_uint)(seed >> 32) };
+    philox4x32_10(ctr, key);
+    const float u = (float)(ctr[i % 4] >> 8) * (1.0f / 16777216.0f);
+    const volatile float step = (hi - lo) * u;      // not contracted to an fma
+    return lo + step;
+}
+
+class Random
+{
+public:
+    Random(const cl::Context& context, const cl::Device& device, cl_ulong seed)
+        : device_(device), counter_(0)
+    {
+        key_[0] = (cl_uint)seed;
+        key_[1] = (cl_uint)(seed >> 32);
+        cl::Program program = buildProgram(context, device, philoxSource());
+        uniform_ = cl::Kernel(program, "philox_uniform");
+        normal_ = cl::Kernel(program, "philox_normal");
+    }
+
+    //! Fill n floats of out with uniform numbers in [lo, hi)
+    cl::Event uniform(cl::CommandQueue& queue, const cl::Buffer& out, ::size_t n,
+                      float lo = 0.0f, float hi = 1.0f)
+    {
+        return fill(queue, uniform_, out, n, lo, hi - lo);
+    }
+
+    //! Fill n floats of out with normal numbers of mean and sigma
+    cl::Event normal(cl::CommandQueue& queue, const cl::Buffer& out, ::size_t n,
+                     float mean = 0.0f, float sigma = 1.0f)
+    {
+        return fill(queue, normal_, out, n, mean, sigma);
+    }
+
+    //! The counter the next fill starts from (for philoxUniform)
+    cl_ulong counter() const { return counter_; }
+
+    //! Start the next fill from counter, to repeat or skip part of the stream
+    void seek(cl_ulong counter) { counter_ = counter; }
+
+private:
+    cl::Device  device_;
+    cl_uint     key_[2];          // the seed, as Philox's key
+    cl_ulong    counter_;           // the first counter the next fill uses
+    cl::Kernel  uniform_;
+    cl::Kernel  normal_;
+
+    cl::Event fill(cl::CommandQueue& queue, cl::Kernel& kernel, const cl::Buffer& out,
+                   ::size_t n, float a, float b)
+    {
+        const cl_ulong counters = ((cl_ulong)n + 3) / 4;
+        kernel.setArg(0, out);
+        kernel.setArg(1, (cl_ulong)n);
+        kernel.setArg(2, key_[0]);
+        kernel.setArg(3, key_[1]);
+        kernel.setArg(4, counter_);
+        kernel.setArg(5, a);
+        kernel.setArg(6, b);
+        counter_ += counters;
+
+        LaunchPlan plan = planGrid(kernel, device_, (cl_long)counters);
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                   cl::NDRange(plan.work_groups * plan.work_group_size),
+                                   cl::NDRange(plan.work_group_size), NULL, &event);
+        return event;
+    }
+
+    Random(const Random&);
+    Random& operator=(const Random&);
+};
+
+} // namespace util
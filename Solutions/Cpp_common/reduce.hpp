@@ -0,0 +1,408 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       reduce.hpp
+ *
+ * Purpose:    Reductions (sum, min, max, argmax) and prefix sums (inclusive
+ *             and exclusive scans) over large device buffers
+ *
+ * Usage:      util::Reduction<float> reduction(context, device);
+ *
+ *             float total = reduction.reduce(queue, d_a, n, util::REDUCE_SUM);
+ *             float top;
+ *             cl_uint where = reduction.argmax(queue, d_a, n, &top);
+ *             reduction.scan(queue, d_a, d_b, n, util::SCAN_EXCLUSIVE);
+ *
+ *             The element type is the template argument: float, double,
+ *             int or cl_uint.  The kernels are built from one source, with
+ *             the type and operator chosen by -D options, the first time
+ *             each operator is used; the programs go through the binary
+ *             cache of program_cache.hpp.
+ *
+ *             A reduction is the pattern of the pi kernels: each
+ *             work-group combines a slice of the input into one partial
+ *             result, and the partial results are reduced again until one
+ *             is left.  Each pass divides the length by the work-group
+ *             size, so a few passes cover any buffer.
+ *
+ *             A scan is work-efficient (Blelloch): each work-group scans
+ *             a block of twice its size in local memory and writes the
+ *             block total; the block totals are scanned the same way, and
+ *             added back onto the blocks.  The input and output may be the
+ *             same buffer.  Scans take sum, min or max.
+ *
+ *             Lengths and indices are 32 bit.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <algorithm>
+
+#include "program_cache.hpp"
+
+namespace util {
+
+enum ReduceOp { REDUCE_SUM, REDUCE_MIN, REDUCE_MAX, REDUCE_ARGMAX };
+enum ScanType { SCAN_INCLUSIVE, SCAN_EXCLUSIVE };
+
+// OpenCL C spelling of an element type, and its largest and smallest values
+template <typename T> struct ClType;
+
+template <> struct ClType<float>
+{
+    static const char *name()    { return "float"; }
+    static const char *highest() { return "INFINITY"; }
+    static const char *lowest()  { return "(-INFINITY)"; }
+};
+
+template <> struct ClType<double>
+{
+    static const char *name()    { return "double"; }
+    static const char *highest() { return "INFINITY"; }
+    static const char *lowest()  { return "(-INFINITY)"; }
+};
+
+template <> struct ClType<cl_int>
+{
+    static const char *name()    { return "int"; }
+    static const char *highest() { return "INT_MAX"; }
+    static const char *lowest()  { return "INT_MIN"; }
+};
+
+template <> struct ClType<cl_uint>
+{
+    static const char *name()    { return "uint"; }
+    static const char *highest() { return "UINT_MAX"; }
+    static const char *lowest()  { return "0"; }
+};
+
+// Kernels shared by every type and operator.  T, OP_* and the limits
+// T_HIGHEST and T_LOWEST are set with -D options.
+inline const char *reductionSource()
+{
+    return
+    "#if defined(USE_FP64)\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "#endif\n"
+    "\n"
+    "#if defined(OP_SUM)\n"
+    "#define IDENTITY ((T)0)\n"
+    "#define COMBINE(a, b) ((a) + (b))\n"
+    "#elif defined(OP_MIN)\n"
+    "#define IDENTITY T_HIGHEST\n"
+    "#define COMBINE(a, b) min(a, b)\n"
+    "#else\n"
+    "#define IDENTITY T_LOWEST\n"
+    "#define COMBINE(a, b) max(a, b)\n"
+    "#endif\n"
+    "\n"
+    "// Combine a grid-strided slice of in[] per work-group into out[group]\n"
+    "__kernel void reduce_pass(const uint n, __global const T* in,\n"
+    "                          __global T* out, __local T* scratch)\n"
+    "{\n"
+    "   uint lid = get_local_id(0);\n"
+    "   uint count = get_local_size(0);\n"
+    "   T acc = IDENTITY;\n"
+    "   for (uint i = get_global_id(0); i < n; i += get_global_size(0))\n"
+    "      acc = COMBINE(acc, in[i]);\n"
+    "   scratch[lid] = acc;\n"
+    "   barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "   for (count >>= 1; count > 0; count >>= 1) {\n"
+    "      if (lid < count)\n"
+    "         scratch[lid] = COMBINE(scratch[lid], scratch[lid + count]);\n"
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "   }\n"
+    "   if (lid == 0)\n"
+    "      out[get_group_id(0)] = scratch[0];\n"
+    "}\n"
+    "\n"
+    "// As reduce_pass, keeping the index of the largest value (the first\n"
+    "// one on ties).  On the first pass the indices are the positions.\n"
+    "__kernel void argmax_pass(const uint n, const int first,\n"
+    "                          __global const T* in, __global const uint* in_index,\n"
+    "                          __global T* out, __global uint* out_index,\n"
+    "                          __local T* scratch, __local uint* scratch_index)\n"
+    "{\n"
+    "   uint lid = get_local_id(0);\n"
+    "   uint count = get_local_size(0);\n"
+    "   T best = T_LOWEST;\n"
+    "   uint where = UINT_MAX;\n"
+    "   for (uint i = get_global_id(0); i < n; i += get_global_size(0)) {\n"
+    "      uint at = first ? i : in_index[i];\n"
+    "      if (in[i] > best || (in[i] == best && at < where)) {\n"
+    "         best = in[i];\n"
+    "         where = at;\n"
+    "      }\n"
+    "   }\n"
+    "   scratch[lid] = best;\n"
+    "   scratch_index[lid] = where;\n"
+    "   barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "   for (count >>= 1; count > 0; count >>= 1) {\n"
+    "      if (lid < count) {\n"
+    "         T other = scratch[lid + count];\n"
+    "         uint other_at = scratch_index[lid + count];\n"
+    "         if (other > scratch[lid] ||\n"
+    "             (other == scratch[lid] && other_at < scratch_index[lid])) {\n"
+    "            scratch[lid] = other;\n"
+    "            scratch_index[lid] = other_at;\n"
+    "         }\n"
+    "      }\n"
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "   }\n"
+    "   if (lid == 0) {\n"
+    "      out[get_group_id(0)] = scratch[0];\n"
+    "      out_index[get_group_id(0)] = scratch_index[0];\n"
+    "   }\n"
+    "}\n"
+    "\n"
+    "// Scan a block of 2 * local size elements in local memory, writing\n"
+    "// the block total to block_sums[group]\n"
+    "__kernel void scan_block(const uint n, const int inclusive,\n"
+    "                         __global const T* in, __global T* out,\n"
+    "                         __global T* block_sums, __local T* temp)\n"
+    "{\n"
+    "   uint lid = get_local_id(0);\n"
+    "   uint wg = get_local_size(0);\n"
+    "   uint base = get_group_id(0) * 2 * wg;\n"
+    "   uint ia = base + 2 * lid, ib = ia + 1;\n"
+    "   uint offset = 1, d, ai, bi;\n"
+    "   T a = ia < n ? in[ia] : IDENTITY;\n"
+    "   T b = ib < n ? in[ib] : IDENTITY;\n"
+    "   temp[2 * lid] = a;\n"
+    "   temp[2 * lid + 1] = b;\n"
+    "\n"
+    "   // Up-sweep: build the partial sums of a balanced tree\n"
+    "   for (d = wg; d > 0; d >>= 1) {\n"
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "      if (lid < d) {\n"
+    "         ai = offset * (2 * lid + 1) - 1;\n"
+    "         bi = offset * (2 * lid + 2) - 1;\n"
+    "         temp[bi] = COMBINE(temp[ai], temp[bi]);\n"
+    "      }\n"
+    "      offset <<= 1;\n"
+    "   }\n"
+    "\n"
+    "   if (lid == 0) {\n"
+    "      block_sums[get_group_id(0)] = temp[2 * wg - 1];\n"
+    "      temp[2 * wg - 1] = IDENTITY;\n"
+    "   }\n"
+    "\n"
+    "   // Down-sweep: turn the tree into an exclusive scan\n"
+    "   for (d = 1; d < 2 * wg; d <<= 1) {\n"
+    "      offset >>= 1;\n"
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "      if (lid < d) {\n"
+    "         ai = offset * (2 * lid + 1) - 1;\n"
+    "         bi = offset * (2 * lid + 2) - 1;\n"
+    "         T t = temp[ai];\n"
+    "         temp[ai] = temp[bi];\n"
+    "         temp[bi] = COMBINE(temp[bi], t);\n"
+    "      }\n"
+    "   }\n"
+    "   barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "   if (ia < n)\n"
+    "      out[ia] = inclusive ? COMBINE(temp[2 * lid], a) : temp[2 * lid];\n"
+    "   if (ib < n)\n"
+    "      out[ib] = inclusive ? COMBINE(temp[2 * lid + 1], b) : temp[2 * lid + 1];\n"
+    "}\n"
+    "\n"
+    "// Add the scanned block totals onto each block\n"
+    "__kernel void scan_add(const uint n, const uint block,\n"
+    "                       __global T* out, __global const T* block_offsets)\n"
+    "{\n"
+    "   uint i = get_global_id(0);\n"
+    "   if (i < n)\n"
+    "      out[i] = COMBINE(out[i], block_offsets[i / block]);\n"
+    "}\n";
+}
+
+template <typename T>
+class Reduction
+{
+public:
+    //! Reductions and scans of T on device, in context
+    Reduction(const cl::Context& context, const cl::Device& device)
+        : context_(context), device_(device), local_(0)
+    {
+    }
+
+    //! Combine the first n elements of in with op (sum, min or max)
+    T reduce(cl::CommandQueue& queue, const cl::Buffer& in, cl_uint n, ReduceOp op)
+    {
+        if (op == REDUCE_ARGMAX)
+        {
+            T value;
+            argmax(queue, in, n, &value);
+            return value;
+        }
+
+        cl::Kernel kernel(program(op), "reduce_pass");
+        const cl_uint wg = workGroupSize(kernel, sizeof(T));
+
+        cl::Buffer partial[2];
+        partial[0] = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(T) * wg);
+        partial[1] = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(T) * wg);
+
+        // Each pass leaves one value per work-group, and never more work-groups
+        // than fit into a single one on the next pass
+        cl::Buffer src = in;
+        int dst = 0;
+        do
+        {
+            cl_uint groups = std::max(std::min((n + wg - 1) / wg, wg), (cl_uint)1);
+            kernel.setArg(0, n);
+            kernel.setArg(1, src);
+            kernel.setArg(2, partial[dst]);
+            kernel.setArg(3, cl::Local(sizeof(T) * wg));
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groups * wg),
+                                       cl::NDRange(wg));
+            src = partial[dst];
+            dst = 1 - dst;
+            n = groups;
+        } while (n > 1);
+
+        T result;
+        queue.enqueueReadBuffer(src, CL_TRUE, 0, sizeof(T), &result);
+        return result;
+    }
+
+    //! Index of the largest of the first n elements of in (the first, on ties);
+    //! the value itself goes in *value if that is not NULL
+    cl_uint argmax(cl::CommandQueue& queue, const cl::Buffer& in, cl_uint n, T *value = NULL)
+    {
+        cl::Kernel kernel(program(REDUCE_ARGMAX), "argmax_pass");
+        const cl_uint wg = workGroupSize(kernel, sizeof(T) + sizeof(cl_uint));
+
+        cl::Buffer partial[2], index[2];
+        for (int b = 0; b < 2; b++)
+        {
+            partial[b] = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(T) * wg);
+            index[b]   = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(cl_uint) * wg);
+        }
+
+        cl::Buffer src = in, src_index = index[1];
+        int first = 1, dst = 0;
+        do
+        {
+            cl_uint groups = std::max(std::min((n + wg - 1) / wg, wg), (cl_uint)1);
+            kernel.setArg(0, n);
+            kernel.setArg(1, first);
+            kernel.setArg(2, src);
+            kernel.setArg(3, src_index);
+            kernel.setArg(4, partial[dst]);
+            kernel.setArg(5, index[dst]);
+            kernel.setArg(6, cl::Local(sizeof(T) * wg));
+            kernel.setArg(7, cl::Local(sizeof(cl_uint) * wg));
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groups * wg),
+                                       cl::NDRange(wg));
+            src = partial[dst];
+            src_index = index[dst];
+            dst = 1 - dst;
+            first = 0;
+            n = groups;
+        } while (n > 1);
+
+        cl_uint where;
+        queue.enqueueReadBuffer(src_index, CL_TRUE, 0, sizeof(cl_uint), &where);
+        if (value != NULL)
+            queue.enqueueReadBuffer(src, CL_TRUE, 0, sizeof(T), value);
+        return where;
+    }
+
+    //! Prefix scan of the first n elements of in into out, with op (sum, min
+    //! or max).  in and out may be the same buffer.
+    void scan(cl::CommandQueue& queue, const cl::Buffer& in, const cl::Buffer& out,
+              cl_uint n, ScanType type, ReduceOp op = REDUCE_SUM)
+    {
+        if (op == REDUCE_ARGMAX)
+            throw cl::Error(CL_INVALID_VALUE, "util::Reduction::scan (argmax has no scan)");
+        if (n == 0)
+            return;
+
+        cl::Program& prog = program(op);
+        cl::Kernel block(prog, "scan_block");
+        cl::Kernel add(prog, "scan_add");
+        scanLevel(queue, block, add, in, out, n, type == SCAN_INCLUSIVE);
+    }
+
+private:
+    cl::Context context_;
+    cl::Device  device_;
+    cl_uint     local_;                     // local memory of the device, in bytes
+    std::map<int, cl::Program> programs_;   // by ReduceOp
+
+    // The program for op, built the first time it is asked for
+    cl::Program& program(ReduceOp op)
+    {
+        std::map<int, cl::Program>::iterator p = programs_.find(op);
+        if (p != programs_.end())
+            return p->second;
+
+        static const char *ops[] = { "OP_SUM", "OP_MIN", "OP_MAX", "OP_ARGMAX" };
+        std::string options = std::string("-D T=") + ClType<T>::name()
+            + " -D T_HIGHEST=" + ClType<T>::highest()
+            + " -D T_LOWEST=" + ClType<T>::lowest()
+            + " -D " + ops[op];
+        if (std::string(ClType<T>::name()) == "double")
+            options += " -D USE_FP64";
+
+        return programs_[op] = buildProgram(context_, device_, reductionSource(), options);
+    }
+
+    // The largest power of two work-group size that kernel can run with,
+    // using bytes of local memory per work-item (at most 256)
+    cl_uint workGroupSize(cl::Kernel& kernel, ::size_t bytes)
+    {
+        if (local_ == 0)
+            local_ = (cl_uint)device_.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+        ::size_t limit = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device_);
+        limit = std::min(limit, (::size_t)256);
+        limit = std::min(limit, (::size_t)(local_ / bytes));
+
+        cl_uint wg = 1;
+        while (2 * wg <= limit)
+            wg *= 2;
+        return wg;
+    }
+
+    // Scan one level, then the block totals of this level, recursively
+    void scanLevel(cl::CommandQueue& queue, cl::Kernel& block, cl::Kernel& add,
+                   const cl::Buffer& in, const cl::Buffer& out, cl_uint n, bool inclusive)
+    {
+        const cl_uint wg = workGroupSize(block, 2 * sizeof(T));
+        const cl_uint width = 2 * wg;
+        const cl_uint nblocks = (n + width - 1) / width;
+
+        cl::Buffer sums(context_, CL_MEM_READ_WRITE, sizeof(T) * nblocks);
+
+        block.setArg(0, n);
+        block.setArg(1, inclusive ? 1 : 0);
+        block.setArg(2, in);
+        block.setArg(3, out);
+        block.setArg(4, sums);
+        block.setArg(5, cl::Local(sizeof(T) * width));
+        queue.enqueueNDRangeKernel(block, cl::NullRange, cl::NDRange(nblocks * wg),
+                                   cl::NDRange(wg));
+
+        if (nblocks == 1)
+            return;
+
+        // Exclusive scan of the block totals gives each block its offset
+        scanLevel(queue, block, add, sums, sums, nblocks, false);
+
+        add.setArg(0, n);
+        add.setArg(1, width);
+        add.setArg(2, out);
+        add.setArg(3, sums);
+        queue.enqueueNDRangeKernel(add, cl::NullRange, cl::NDRange(nblocks * width));
+    }
+};
+
+} // namespace util
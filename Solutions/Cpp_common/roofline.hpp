@@ -0,0 +1,269 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       roofline.hpp
+ *
+ * Purpose:    Report the GFLOP/s and GB/s a kernel achieved against the
+ *             peaks of the device, and which of the two bounds it
+ *             (the roofline model)
+ *
+ * Usage:      util::Roofline roofline(context, device);
+ *
+ *             event = ...enqueue the kernel...;
+ *             event.wait();
+ *             roofline.record("mmul", util::matmulCost(M, N, K), util::eventSeconds(event));
+ *             ...
+ *             roofline.print();
+ *
+ *             The cost of a kernel is the floating point operations it
+ *             does and the bytes it must move to and from global memory
+ *             at least: for vadd 1 FLOP and 3 floats an element, for
+ *             matmul 2MNK FLOPs and each matrix once, for a generation of
+ *             Life no FLOPs and a read and a write of every cell.  A
+ *             kernel that caches badly moves more than this, so its GB/s
+ *             is a lower bound on the traffic it made.
+ *
+ *             The peak GFLOP/s is estimated from the device queries:
+ *             compute units x clock x lanes a compute unit x 2 (a fused
+ *             multiply-add each cycle).  OpenCL does not say the lanes in
+ *             a compute unit, so they are the SIMD width for a CPU (the
+ *             native float vector width, on two FMA ports) and a usual
+ *             figure for a GPU of the vendor.  Nor does it say the memory
+ *             bandwidth, so that is measured with a copy between two
+ *             buffers.  A device profile written by the microbenchmarks
+ *             (device_profile.hpp) gives measured figures for both in
+ *             place of these, and OCL_PEAK_GFLOPS and OCL_PEAK_GBS in the
+ *             environment set the peaks in place of any of them.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             The times given must be of the kernel alone, from a
+ *             profiling queue (profiler.hpp) where there is one.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "device_profile.hpp"
+
+namespace util {
+
+// The work a kernel launch does
+struct KernelCost
+{
+    double flops;
+    double bytes;
+};
+
+//! c = a + b over n floats
+inline KernelCost vaddCost(double n)
+{
+    KernelCost cost = { n, 3.0 * sizeof(float) * n };
+    return cost;
+}
+
+//! C += A B, with A M x K, B K x N and C M x N of floats
+inline KernelCost matmulCost(double M, double N, double K)
+{
+    KernelCost cost = { 2.0 * M * N * K, sizeof(float) * (M * K + K * N + M * N) };
+    return cost;
+}
+
+//! passes of Life over cells stored in bytes_per_cell bytes each (1 on a
+//! char board, 1/8 packed), each pass reading and writing every cell
+//! once (a pass is several generations with accelerate_life_multi)
+inline KernelCost lifeCost(double cells, double bytes_per_cell, double passes = 1.0)
+{
+    KernelCost cost = { 0.0, 2.0 * cells * bytes_per_cell * passes };
+    return cost;
+}
+
+//! The integration of pi: x = (i + 0.5) step and 4 / (1 + x x) is summed,
+//! 6 FLOPs a step, and only the partial sums are written
+inline KernelCost piCost(double steps, double partial_bytes)
+{
+    KernelCost cost = { 6.0 * steps, partial_bytes };
+    return cost;
+}
+
+class Roofline
+{
+public:
+    Roofline(const cl::Context& context, const cl::Device& device)
+        : peak_gflops_(0.0), peak_gbps_(0.0)
+    {
+        const char *gflops = getenv("OCL_PEAK_GFLOPS");
+        const char *gbps = getenv("OCL_PEAK_GBS");
+        DeviceProfile profile(device);
+
+        if (gflops && atof(gflops) > 0.0)
+        {
+            peak_gflops_ = atof(gflops);
+            gflops_from_ = "given";
+        }
+        else if (profile.get("peak_gflops") > 0.0)
+        {
+            peak_gflops_ = profile.get("peak_gflops");
+            gflops_from_ = "profiled";
+        }
+        else
+        {
+            peak_gflops_ = estimateGflops(device);
+            gflops_from_ = "estimated";
+        }
+
+        if (gbps && atof(gbps) > 0.0)
+        {
+            peak_gbps_ = atof(gbps);
+            gbps_from_ = "given";
+        }
+        else if (profile.get("global_copy_gbps") > 0.0)
+        {
+            peak_gbps_ = profile.get("global_copy_gbps");
+            gbps_from_ = "profiled";
+        }
+        else
+        {
+            peak_gbps_ = measureBandwidth(context, device);
+            gbps_from_ = "measured copy";
+        }
+    }
+
+    double peakGflops() const { return peak_gflops_; }
+    double peakGbps() const { return peak_gbps_; }
+
+    //! The arithmetic intensity (FLOP/byte) above which a kernel is compute bound
+    double ridge() const { return peak_gbps_ > 0.0 ? peak_gflops_ / peak_gbps_ : 0.0; }
+
+    //! A launch of the kernel name (or launches of it, timed together)
+    //! that did cost in seconds
+    void record(const std::string& name, const KernelCost& cost, double seconds,
+                unsigned int launches = 1)
+    {
+        if (entries_.find(name) == entries_.end())
+            order_.push_back(name);
+        Entry& entry = entries_[name];
+        entry.flops += cost.flops;
+        entry.bytes += cost.bytes;
+        entry.seconds += seconds;
+        entry.launches += launches;
+    }
+
+    void print() const
+    {
+        printf("\n Roofline: peak %.1f GFLOP/s (%s), %.1f GB/s (%s), ridge at %.2f FLOP/byte\n",
+               peak_gflops_, gflops_from_.c_str(), peak_gbps_, gbps_from_.c_str(), ridge());
+        printf(" %-24s %8s %10s %6s %10s %6s %10s  %s\n",
+               "kernel", "launches", "GFLOP/s", "%peak", "GB/s", "%peak", "FLOP/byte", "bound");
+
+        for (std::vector<std::string>::const_iterator n = order_.begin(); n != order_.end(); ++n)
+        {
+            const Entry& entry = entries_.find(*n)->second;
+            if (entry.seconds <= 0.0)
+                continue;
+
+            double gflops = entry.flops / entry.seconds * 1.0e-9;
+            double gbps = entry.bytes / entry.seconds * 1.0e-9;
+            double intensity = entry.bytes > 0.0 ? entry.flops / entry.bytes : 0.0;
+            bool memory = entry.bytes > 0.0 && intensity < ridge();
+
+            printf(" %-24s %8u ", n->c_str(), entry.launches);
+            if (entry.flops > 0.0)
+                printf("%10.2f %5.1f%% ", gflops, percent(gflops, peak_gflops_));
+            else
+                printf("%10s %6s ", "-", "-");
+            printf("%10.2f %5.1f%% %10.2f  %s\n", gbps, percent(gbps, peak_gbps_),
+                   intensity, memory ? "memory" : "compute");
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Entry() : flops(0.0), bytes(0.0), seconds(0.0), launches(0) {}
+
+        double       flops;
+        double       bytes;
+        double       seconds;
+        unsigned int launches;
+    };
+
+    double                          peak_gflops_;
+    double                          peak_gbps_;
+    std::string                     gflops_from_;       // given, profiled or estimated
+    std::string                     gbps_from_;         // given, profiled or measured copy
+    std::vector<std::string>        order_;             // names in the order first seen
+    std::map<std::string, Entry>    entries_;
+
+    static double percent(double achieved, double peak)
+    {
+        return peak > 0.0 ? 100.0 * achieved / peak : 0.0;
+    }
+
+    //! Single precision lanes in one compute unit
+    static double lanes(const cl::Device& device)
+    {
+        cl_device_type type = device.getInfo<CL_DEVICE_TYPE>();
+        if (type & CL_DEVICE_TYPE_CPU)
+            return 2.0 * std::max<cl_uint>(device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT>(), 1);
+        if (!(type & CL_DEVICE_TYPE_GPU))
+            return 16.0;
+
+        std::string vendor = device.getInfo<CL_DEVICE_VENDOR>();
+        std::transform(vendor.begin(), vendor.end(), vendor.begin(), ::tolower);
+        if (vendor.find("nvidia") != std::string::npos)
+            return 128.0;   // an SM since Maxwell
+        if (vendor.find("intel") != std::string::npos)
+            return 8.0;     // an EU: two SIMD-4 units
+        if (vendor.find("apple") != std::string::npos)
+            return 128.0;
+        return 64.0;        // an AMD CU, and a guess for the rest
+    }
+
+    static double estimateGflops(const cl::Device& device)
+    {
+        double units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+        double mhz = device.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>();
+        return units * mhz * 1.0e-3 * lanes(device) * 2.0;
+    }
+
+    //! The best of a few copies between two buffers, counting the read
+    //! and the write
+    static double measureBandwidth(const cl::Context& context, const cl::Device& device)
+    {
+        ::size_t bytes = 64 << 20;
+        cl_ulong max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+        if (bytes > max_alloc / 2)
+            bytes = (::size_t)(max_alloc / 2);
+
+        cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+        cl::Buffer src(context, CL_MEM_READ_WRITE, bytes);
+        cl::Buffer dst(context, CL_MEM_READ_WRITE, bytes);
+
+        // The first copy also makes the buffers resident on the device
+        double best = 0.0;
+        for (int i = 0; i < 4; i++)
+        {
+            cl::Event event;
+            queue.enqueueCopyBuffer(src, dst, 0, 0, bytes, NULL, &event);
+            event.wait();
+            cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+            cl_ulong end   = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+            if (i > 0 && end > start)
+                best = std::max(best, 2.0 * bytes / (end - start));
+        }
+        return best;    // bytes per ns is GB/s
+    }
+
+    Roofline(const Roofline&);
+    Roofline& operator=(const Roofline&);
+};
+
+} // namespace util
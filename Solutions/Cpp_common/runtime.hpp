@@ -0,0 +1,291 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       runtime.hpp
+ *
+ * Purpose:    Own the OpenCL state a driver sets up once: the context, a
+ *             queue per device, the programs and kernels built so far and
+ *             scratch buffers
+ *
+ * Usage:      util::Runtime runtime(device, CL_QUEUE_PROFILING_ENABLE);
+ *
+ *             cl::Kernel& vadd = runtime.kernel("vadd.cl", "vadd");
+ *             cl::Buffer& d_a = runtime.buffer("a", CL_MEM_READ_ONLY, bytes);
+ *             runtime.queue().enqueueNDRangeKernel(vadd, ...);
+ *
+ *             A Runtime is made from one device, several devices of one
+ *             platform (a queue each, runtime.queue(i)) or a device type,
+ *             as cl::Context(DEVICE) is.  Programs are built once for each
+ *             source file and set of build options, through
+ *             buildProgramFile and so the binary cache (and SPIR-V), and
+ *             kernels once for each program and name, so drivers that go
+ *             back to a kernel (the matmul variants, autotuning,
+ *             benchmarks) get the one already built.
+ *             program() and kernel() take the source itself in place of a
+ *             file name when it holds a newline.
+ *
+ *             prebuild(builds) starts building a list of programs (file
+ *             and options) on a worker thread and returns at once, so the
+ *             compiler runs while the host gets on with setting up data.
+ *             program() then takes a program the worker has built, waits
+ *             for the one it is building, or builds one it has not got
+ *             to yet itself; a build that failed on the worker throws
+ *             its cl::Error there.
+ *
+ *             buffer(name, ...) hands back the same buffer for a name for
+ *             as long as it is large enough and has the same flags.
+ *             pool() is a BufferPool (buffer_pool.hpp) on the first
+ *             device, made when first asked for.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             The kernels are shared, so two threads must not set the
+ *             arguments of one at the same time; util::Executor
+ *             (executor.hpp) gives each thread kernels of its own.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util.hpp"
+#include "program_cache.hpp"
+#include "buffer_pool.hpp"
+#include "trace.hpp"
+
+namespace util {
+
+class Runtime
+{
+public:
+    //! A program to build: source file (or source) and build options
+    typedef std::pair<std::string, std::string> Build;
+
+    //! One device, with one queue
+    explicit Runtime(const cl::Device& device, cl_command_queue_properties properties = 0)
+        : pool_(NULL)
+    {
+        init(std::vector<cl::Device>(1, device), properties);
+    }
+
+    //! Devices of one platform, with a queue each
+    explicit Runtime(const std::vector<cl::Device>& devices,
+                     cl_command_queue_properties properties = 0)
+        : pool_(NULL)
+    {
+        init(devices, properties);
+    }
+
+    //! The devices of a type (such as the DEVICE of the Makefiles)
+    explicit Runtime(cl_device_type type, cl_command_queue_properties properties = 0)
+        : pool_(NULL)
+    {
+        cl::Context context(type);
+        init(context.getInfo<CL_CONTEXT_DEVICES>(), properties);
+    }
+
+    ~Runtime()
+    {
+        // Builds not yet started are dropped
+        for (std::map<Key, PendingPtr>::iterator p = pending_.begin(); p != pending_.end(); ++p)
+            p->second->claimed.exchange(true);
+        if (builder_.joinable())
+            builder_.join();
+        delete pool_;
+    }
+
+    cl::Context& context() { return context_; }
+
+    unsigned int devices() const { return devices_.size(); }
+    cl::Device& device(unsigned int i = 0) { return devices_.at(i); }
+    cl::CommandQueue& queue(unsigned int i = 0) { return queues_.at(i); }
+
+    //! The program built from a source file (or source) with options,
+    //! for every device of the runtime
+    cl::Program& program(const std::string& file, const std::string& options = "")
+    {
+        Key key(file, options);
+        std::map<Key, cl::Program>::iterator p = programs_.find(key);
+        if (p != programs_.end())
+            return p->second;
+
+        std::map<Key, PendingPtr>::iterator b = pending_.find(key);
+        if (b != pending_.end())
+        {
+            PendingPtr pending = b->second;
+            pending_.erase(b);
+            if (pending->claimed.exchange(true))
+            {
+                TraceSpan span("wait for build", file);
+                return programs_[key] = pending->program.get();
+            }
+        }
+        return programs_[key] = build(file, options);
+    }
+
+    //! Start building programs on a worker thread (see above); builds
+    //! the runtime already has, or has been asked for, are left out
+    void prebuild(const std::vector<Build>& builds)
+    {
+        std::vector<PendingPtr> jobs;
+        for (unsigned int i = 0; i < builds.size(); i++)
+        {
+            if (programs_.count(builds[i]) || pending_.count(builds[i]))
+                continue;
+            PendingPtr pending(new Pending);
+            pending->build = builds[i];
+            pending->program = pending->done.get_future();
+            pending_[builds[i]] = pending;
+            jobs.push_back(pending);
+        }
+        if (jobs.empty())
+            return;
+
+        // One worker at a time, so a second list waits for the first
+        if (builder_.joinable())
+            builder_.join();
+        builder_ = std::thread(&Runtime::buildAll, this, jobs);
+    }
+
+    //! The kernel name from program(file, options)
+    cl::Kernel& kernel(const std::string& file, const std::string& name,
+                       const std::string& options = "")
+    {
+        Key key(file + '\0' + options, name);
+        std::map<Key, cl::Kernel>::iterator k = kernels_.find(key);
+        if (k != kernels_.end())
+            return k->second;
+        return kernels_[key] = cl::Kernel(program(file, options), name.c_str());
+    }
+
+    //! A buffer kept under name, made again if it is too small or the
+    //! flags change
+    cl::Buffer& buffer(const std::string& name, cl_mem_flags flags, ::size_t bytes)
+    {
+        std::map<std::string, Scratch>::iterator b = buffers_.find(name);
+        if (b != buffers_.end() && b->second.flags == flags && b->second.bytes >= bytes)
+            return b->second.buffer;
+
+        TraceSpan span("create buffer", name);
+        Scratch& scratch = buffers_[name];
+        scratch.buffer = cl::Buffer(context_, flags, bytes);
+        scratch.flags = flags;
+        scratch.bytes = bytes;
+        return scratch.buffer;
+    }
+
+    //! The pool to acquire and release device buffers from
+    BufferPool& pool()
+    {
+        if (!pool_)
+            pool_ = new BufferPool(context_, devices_[0]);
+        return *pool_;
+    }
+
+    //! Let go of the programs, kernels and named buffers
+    void clear()
+    {
+        kernels_.clear();
+        programs_.clear();
+        buffers_.clear();
+    }
+
+private:
+    typedef Build Key;
+
+    // A program handed to the worker: whichever thread claims it first
+    // builds it
+    struct Pending
+    {
+        Build                      build;
+        std::atomic<bool>          claimed;
+        std::promise<cl::Program>  done;
+        std::future<cl::Program>   program;
+
+        Pending() : claimed(false) {}
+    };
+    typedef std::shared_ptr<Pending> PendingPtr;
+
+    struct Scratch
+    {
+        cl::Buffer   buffer;
+        cl_mem_flags flags;
+        ::size_t     bytes;
+    };
+
+    cl::Context                       context_;
+    std::vector<cl::Device>           devices_;
+    std::vector<cl::CommandQueue>     queues_;
+    std::map<Key, cl::Program>        programs_;
+    std::map<Key, cl::Kernel>         kernels_;
+    std::map<std::string, Scratch>    buffers_;
+    BufferPool*                       pool_;
+    std::map<Key, PendingPtr>         pending_;
+    std::thread                       builder_;
+
+    // Build a program for every device, without the cache of programs_
+    cl::Program build(const std::string& file, const std::string& options)
+    {
+        const bool is_source = file.find('\n') != std::string::npos;
+        cl::Program program;
+        if (devices_.size() == 1 && !is_source)
+            program = buildProgramFile(context_, devices_[0], file, options);
+        else if (devices_.size() == 1)
+            program = buildProgram(context_, devices_[0], file, options);
+        else
+        {
+            program = cl::Program(context_, is_source ? file : loadProgram(file));
+            try
+            {
+                program.build(devices_, options.c_str());
+            } catch (cl::Error)
+            {
+                for (unsigned int i = 0; i < devices_.size(); i++)
+                    std::cerr << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices_[i]);
+                throw;
+            }
+        }
+        return program;
+    }
+
+    // The worker: build each job no other thread has claimed
+    void buildAll(std::vector<PendingPtr> jobs)
+    {
+        for (unsigned int i = 0; i < jobs.size(); i++)
+        {
+            if (jobs[i]->claimed.exchange(true))
+                continue;
+            TraceSpan span("prebuild", jobs[i]->build.first);
+            try
+            {
+                jobs[i]->done.set_value(build(jobs[i]->build.first, jobs[i]->build.second));
+            } catch (...)
+            {
+                jobs[i]->done.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    void init(const std::vector<cl::Device>& devices, cl_command_queue_properties properties)
+    {
+        if (devices.empty())
+            throw cl::Error(CL_INVALID_VALUE, "util::Runtime::Runtime (no devices)");
+
+        devices_ = devices;
+        context_ = cl::Context(devices_);
+        for (unsigned int i = 0; i < devices_.size(); i++)
+            queues_.push_back(cl::CommandQueue(context_, devices_[i], properties));
+    }
+
+    Runtime(const Runtime&);
+    Runtime& operator=(const Runtime&);
+};
+
+} // namespace util
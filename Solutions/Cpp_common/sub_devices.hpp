@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       sub_devices.hpp
+ *
+ * Purpose:    Partition a device (in practice a CPU) into one sub-device
+ *             per NUMA node, so each node's cores work on memory of their
+ *             own rather than across the links between sockets
+ *
+ * Usage:      std::vector<cl::Device> nodes = util::numaSubDevices(device);
+ *
+ *             The sub-devices come from clCreateSubDevices by affinity
+ *             domain (CL_DEVICE_AFFINITY_DOMAIN_NUMA).  They are devices
+ *             like any other: give each its own queue and its own
+ *             buffers, made and first written through that queue, and
+ *             the runtime can place them on its node.  A device that
+ *             cannot be partitioned that way (a GPU, a one socket CPU,
+ *             an OpenCL 1.1 runtime) comes back on its own, so callers
+ *             need no second path.
+ *
+ * Note:       Must be included AFTER cl.hpp
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+
+namespace util {
+
+//! Whether device can be partitioned by NUMA node
+inline bool partitionsByNuma(const cl::Device& device)
+{
+#if defined(CL_VERSION_1_2)
+    try
+    {
+        std::vector<cl_device_partition_property> props =
+            device.getInfo<CL_DEVICE_PARTITION_PROPERTIES>();
+        bool by_domain = false;
+        for (unsigned i = 0; i < props.size(); i++)
+            by_domain |= (props[i] == CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN);
+        return by_domain &&
+            (device.getInfo<CL_DEVICE_PARTITION_AFFINITY_DOMAIN>() & CL_DEVICE_AFFINITY_DOMAIN_NUMA);
+    }
+    catch (cl::Error)
+    {
+        // An OpenCL 1.1 device on a 1.2 platform does not know the query
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+//! One sub-device per NUMA node of device, or device itself
+inline std::vector<cl::Device> numaSubDevices(const cl::Device& device)
+{
+    std::vector<cl::Device> nodes;
+#if defined(CL_VERSION_1_2)
+    if (partitionsByNuma(device))
+    {
+        const cl_device_partition_property props[] = {
+            CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0 };
+        try
+        {
+            cl::Device(device).createSubDevices(props, &nodes);
+        }
+        catch (cl::Error)
+        {
+            // CL_DEVICE_PARTITION_FAILED: only the one node
+            nodes.clear();
+        }
+    }
+#endif
+    if (nodes.empty())
+        nodes.push_back(device);
+    return nodes;
+}
+
+} // namespace util
@@ -0,0 +1,162 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       svm.hpp
+ *
+ * Purpose:    Host arrays in OpenCL 2.0 shared virtual memory, which the
+ *             kernels use where they are, with no copies to and from
+ *             buffers
+ *
+ * Usage:      util::SVMKind kind = util::svmKind(device);
+ *             if (kind == util::SVM_NONE)
+ *                 ...                                 // buffers and copies
+ *
+ *             util::SVMVector<float> a(context, kind, n);
+ *             a.hostAccess(queue);                    // before the host
+ *             for (int i = 0; i < n; i++)             // touches it
+ *                 a[i] = ...;
+ *             a.deviceAccess(queue);                  // before a kernel
+ *             a.setArg(kernel, 0);                    // does
+ *             queue.enqueueNDRangeKernel(kernel, ...);
+ *             queue.finish();                         // then read a[i]
+ *                                                     // (after hostAccess)
+ *
+ *             With fine-grained buffer SVM (SVM_FINE, as on most
+ *             integrated GPUs and CPUs) host and device share the pages,
+ *             and hostAccess / deviceAccess do nothing: the host must only
+ *             wait for the kernels that use an array before reading it.
+ *             Coarse-grained SVM (SVM_COARSE, every OpenCL 2.0 device) is
+ *             mapped for the host and unmapped for the device, which the
+ *             driver may do without a copy where memory is shared.
+ *
+ *             Kernels take the arrays as ordinary __global pointers, but
+ *             their arguments are set with setArg here, not through
+ *             cl::Kernel::setArg (which would pass the pointer's value).
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS.
+ *             With OpenCL headers older than 2.0 svmKind is always
+ *             SVM_NONE, and an SVMVector cannot be made.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <string>
+
+namespace util {
+
+enum SVMKind { SVM_NONE, SVM_COARSE, SVM_FINE };
+
+inline const char *svmName(SVMKind kind)
+{
+    return kind == SVM_FINE ? "fine-grained SVM" :
+           kind == SVM_COARSE ? "coarse-grained SVM" : "no SVM";
+}
+
+// The buffer SVM a device has, from its version ("OpenCL 2.0 ...") and
+// CL_DEVICE_SVM_CAPABILITIES
+inline SVMKind svmKind(const cl::Device& device)
+{
+#if defined(CL_VERSION_2_0)
+    std::string version = device.getInfo<CL_DEVICE_VERSION>();
+    if (version.size() > 7 && version[7] >= '2')
+    {
+        cl_device_svm_capabilities caps = 0;
+        if (::clGetDeviceInfo(device(), CL_DEVICE_SVM_CAPABILITIES, sizeof(caps), &caps,
+                              NULL) == CL_SUCCESS)
+        {
+            if (caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER)
+                return SVM_FINE;
+            if (caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER)
+                return SVM_COARSE;
+        }
+    }
+#endif
+    return SVM_NONE;
+}
+
+template <typename T>
+class SVMVector
+{
+public:
+    //! n elements of SVM of the kind given, for all devices of context
+    SVMVector(const cl::Context& context, SVMKind kind, ::size_t n)
+        : context_(context), kind_(kind), size_(n), data_(NULL), mapped_(false)
+    {
+#if defined(CL_VERSION_2_0)
+        cl_svm_mem_flags flags = CL_MEM_READ_WRITE;
+        if (kind == SVM_FINE)
+            flags |= CL_MEM_SVM_FINE_GRAIN_BUFFER;
+        if (kind != SVM_NONE && n > 0)
+            data_ = static_cast<T *>(::clSVMAlloc(context_(), flags, sizeof(T) * n, 0));
+#endif
+        if (data_ == NULL)
+            throw cl::Error(CL_MEM_OBJECT_ALLOCATION_FAILURE, "util::SVMVector (clSVMAlloc)");
+    }
+
+    ~SVMVector()
+    {
+#if defined(CL_VERSION_2_0)
+        ::clSVMFree(context_(), data_);
+#endif
+    }
+
+    ::size_t size() const { return size_; }
+    T *data() { return data_; }
+    const T *data() const { return data_; }
+    T& operator[](::size_t i) { return data_[i]; }
+    const T& operator[](::size_t i) const { return data_[i]; }
+
+    //! Make the array the host's to read and write (waits for queue's
+    //! commands before it, for coarse-grained SVM)
+    void hostAccess(cl::CommandQueue& queue)
+    {
+#if defined(CL_VERSION_2_0)
+        if (kind_ == SVM_COARSE && !mapped_)
+        {
+            cl_int err = ::clEnqueueSVMMap(queue(), CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                           data_, sizeof(T) * size_, 0, NULL, NULL);
+            if (err != CL_SUCCESS)
+                throw cl::Error(err, "util::SVMVector::hostAccess (clEnqueueSVMMap)");
+            mapped_ = true;
+        }
+#endif
+    }
+
+    //! Give the array back to the device's kernels
+    void deviceAccess(cl::CommandQueue& queue)
+    {
+#if defined(CL_VERSION_2_0)
+        if (mapped_)
+        {
+            cl_int err = ::clEnqueueSVMUnmap(queue(), data_, 0, NULL, NULL);
+            if (err != CL_SUCCESS)
+                throw cl::Error(err, "util::SVMVector::deviceAccess (clEnqueueSVMUnmap)");
+            mapped_ = false;
+        }
+#endif
+    }
+
+    //! Pass the array as argument index of kernel
+    void setArg(cl::Kernel& kernel, cl_uint index) const
+    {
+        cl_int err = CL_INVALID_OPERATION;
+#if defined(CL_VERSION_2_0)
+        err = ::clSetKernelArgSVMPointer(kernel(), index, data_);
+#endif
+        if (err != CL_SUCCESS)
+            throw cl::Error(err, "util::SVMVector::setArg (clSetKernelArgSVMPointer)");
+    }
+
+private:
+    cl::Context context_;
+    SVMKind     kind_;
+    ::size_t    size_;
+    T          *data_;
+    bool        mapped_;
+
+    SVMVector(const SVMVector&);
+    SVMVector& operator=(const SVMVector&);
+};
+
+} // namespace util
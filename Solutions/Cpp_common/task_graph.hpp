@@ -0,0 +1,248 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       task_graph.hpp
+ *
+ * Purpose:    Run transfers and kernels in the order their buffers need,
+ *             not the order they were written, spreading independent work
+ *             over queues and joining it with event wait lists
+ *
+ * Usage:      util::TaskGraph graph(context, device);
+ *
+ *             graph.write(d_a, &h_a[0], bytes);
+ *             ...
+ *             vadd.setArg(0, d_a); vadd.setArg(1, d_b); vadd.setArg(2, d_c); ...
+ *             graph.kernel(vadd, global, local, util::Uses().reads(d_a).reads(d_b).writes(d_c));
+ *             vadd.setArg(0, d_e); vadd.setArg(1, d_g); vadd.setArg(2, d_h); ...
+ *             graph.kernel(vadd, global, local, util::Uses().reads(d_e).reads(d_g).writes(d_h));
+ *             vadd.setArg(0, d_c); vadd.setArg(1, d_h); vadd.setArg(2, d_f); ...
+ *             graph.kernel(vadd, global, local, util::Uses().reads(d_c).reads(d_h).writes(d_f));
+ *             graph.read(d_f, &h_f[0], bytes);
+ *             graph.finish();
+ *
+ *             Each task says which buffers it reads and writes.  A task
+ *             waits for the last task to write a buffer it uses (read
+ *             after write), and a writer also for every task that read the
+ *             buffer since (write after read), so the results are those
+ *             of running the tasks one at a time in the order given.
+ *             Tasks with nothing in common do not wait for each other: in
+ *             the example c = a + b and h = e + g may run at the same
+ *             time, and f = c + h waits for both.
+ *
+ *             Tasks are enqueued as they are declared, so a kernel's
+ *             arguments are the ones set when kernel() is called and the
+ *             kernel object may be set up again for the next task.
+ *             Transfers do not block: the host memory of a write must stay
+ *             as it is, and that of a read must not be used, until wait()
+ *             on the task or finish().
+ *
+ *             With queues = 0 the tasks go on one out-of-order queue if
+ *             the device has them, and on two in-order queues if not.
+ *             Otherwise they are spread over that many in-order queues.
+ *             On in-order queues a task follows a task it waits for on
+ *             the same queue if that task is still the last on its queue,
+ *             so it waits for nothing else there, and goes on the next
+ *             queue in turn if not.  It waits through events only for
+ *             tasks on other queues.
+ *
+ * Note:       Must be included AFTER cl.hpp, with __CL_ENABLE_EXCEPTIONS
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace util {
+
+// The buffers a task reads and writes
+class Uses
+{
+public:
+    Uses& reads(const cl::Buffer& buffer)  { reads_.push_back(buffer()); return *this; }
+    Uses& writes(const cl::Buffer& buffer) { writes_.push_back(buffer()); return *this; }
+
+    const std::vector<cl_mem>& reads() const  { return reads_; }
+    const std::vector<cl_mem>& writes() const { return writes_; }
+
+private:
+    std::vector<cl_mem> reads_, writes_;
+};
+
+class TaskGraph
+{
+public:
+    typedef int Task;
+
+    TaskGraph(const cl::Context& context, const cl::Device& device, unsigned int queues = 0,
+              cl_command_queue_properties properties = 0)
+        : next_(0)
+    {
+        if (queues == 0)
+        {
+            cl_command_queue_properties supported = device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>();
+            if (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+                queues_.push_back(cl::CommandQueue(context, device,
+                    properties | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE));
+            else
+                queues = 2;
+        }
+        for (unsigned int q = 0; q < queues; q++)
+            queues_.push_back(cl::CommandQueue(context, device, properties));
+        tail_.assign(queues_.size(), -1);
+        out_of_order_ = queues == 0;
+    }
+
+    //! Copy bytes from host memory into a buffer
+    Task write(const cl::Buffer& buffer, const void *ptr, ::size_t bytes, ::size_t offset = 0)
+    {
+        TraceSpan span("enqueue write", "task graph");
+        std::vector<cl::Event> wait;
+        int q = place(Uses().writes(buffer), wait);
+        cl::Event event;
+        queues_[q].enqueueWriteBuffer(buffer, CL_FALSE, offset, bytes, ptr, list(wait), &event);
+        return add(q, event, Uses().writes(buffer));
+    }
+
+    //! Copy bytes from a buffer into host memory
+    Task read(const cl::Buffer& buffer, void *ptr, ::size_t bytes, ::size_t offset = 0)
+    {
+        TraceSpan span("enqueue read", "task graph");
+        std::vector<cl::Event> wait;
+        int q = place(Uses().reads(buffer), wait);
+        cl::Event event;
+        queues_[q].enqueueReadBuffer(buffer, CL_FALSE, offset, bytes, ptr, list(wait), &event);
+        return add(q, event, Uses().reads(buffer));
+    }
+
+    //! Run a kernel, with the arguments it has now, using the given buffers
+    Task kernel(const cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local,
+                const Uses& uses)
+    {
+        TraceSpan span("enqueue kernel",
+                       traceEnabled() ? kernel.getInfo<CL_KERNEL_FUNCTION_NAME>() : "");
+        std::vector<cl::Event> wait;
+        int q = place(uses, wait);
+        cl::Event event;
+        queues_[q].enqueueNDRangeKernel(kernel, cl::NullRange, global, local, list(wait), &event);
+        return add(q, event, uses);
+    }
+
+    //! The event of a task, to profile it or wait on it elsewhere
+    const cl::Event& event(Task task) const { return tasks_.at(task).event; }
+
+    void wait(Task task) { tasks_.at(task).event.wait(); }
+
+    //! Wait for every task, and start a new graph
+    void finish()
+    {
+        TraceSpan span("finish", "task graph");
+        for (unsigned int q = 0; q < queues_.size(); q++)
+            queues_[q].finish();
+        tasks_.clear();
+        tail_.assign(queues_.size(), -1);
+        writer_.clear();
+        readers_.clear();
+    }
+
+    unsigned int queues() const { return queues_.size(); }
+    bool outOfOrder() const { return out_of_order_; }
+
+private:
+    struct Node
+    {
+        int       queue;
+        cl::Event event;
+    };
+
+    std::vector<cl::CommandQueue>           queues_;
+    bool                                    out_of_order_;
+    unsigned int                            next_;      // queue for the next task that waits for nothing
+    std::vector<Node>                       tasks_;
+    std::vector<Task>                       tail_;      // last task on each queue
+    std::map<cl_mem, Task>                  writer_;    // last task to write each buffer
+    std::map<cl_mem, std::vector<Task> >    readers_;   // tasks that read it since
+
+    //! The tasks a new task must wait for
+    std::vector<Task> dependencies(const Uses& uses) const
+    {
+        std::vector<Task> deps;
+        for (unsigned int i = 0; i < uses.reads().size(); i++)
+        {
+            std::map<cl_mem, Task>::const_iterator w = writer_.find(uses.reads()[i]);
+            if (w != writer_.end())
+                deps.push_back(w->second);
+        }
+        for (unsigned int i = 0; i < uses.writes().size(); i++)
+        {
+            cl_mem buffer = uses.writes()[i];
+            std::map<cl_mem, Task>::const_iterator w = writer_.find(buffer);
+            if (w != writer_.end())
+                deps.push_back(w->second);
+            std::map<cl_mem, std::vector<Task> >::const_iterator r = readers_.find(buffer);
+            if (r != readers_.end())
+                deps.insert(deps.end(), r->second.begin(), r->second.end());
+        }
+        std::sort(deps.begin(), deps.end());
+        deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+        return deps;
+    }
+
+    //! Choose the queue of a new task and fill in the events it waits on
+    int place(const Uses& uses, std::vector<cl::Event>& wait)
+    {
+        std::vector<Task> deps = dependencies(uses);
+
+        int q = -1;
+        if (out_of_order_)
+            q = 0;
+        for (unsigned int i = deps.size(); i-- > 0 && q < 0; )
+        {
+            if (tail_[tasks_[deps[i]].queue] == deps[i])
+                q = tasks_[deps[i]].queue;
+        }
+        if (q < 0)
+            q = next_++ % queues_.size();
+
+        for (unsigned int i = 0; i < deps.size(); i++)
+        {
+            const Node& dep = tasks_[deps[i]];
+            if (out_of_order_ || dep.queue != q)
+                wait.push_back(dep.event);
+            // A queue whose command is waited on from
+            // another queue must be submitted
+            if (dep.queue != q)
+                queues_[dep.queue].flush();
+        }
+        return q;
+    }
+
+    static const std::vector<cl::Event>* list(const std::vector<cl::Event>& wait)
+    {
+        return wait.empty() ? NULL : &wait;
+    }
+
+    //! Record a task that has been enqueued, as the writer or a reader of its buffers
+    Task add(int q, const cl::Event& event, const Uses& uses)
+    {
+        Task task = tasks_.size();
+        Node node = { q, event };
+        tasks_.push_back(node);
+        tail_[q] = task;
+
+        for (unsigned int i = 0; i < uses.reads().size(); i++)
+            readers_[uses.reads()[i]].push_back(task);
+        for (unsigned int i = 0; i < uses.writes().size(); i++)
+        {
+            writer_[uses.writes()[i]] = task;
+            readers_[uses.writes()[i]].clear();
+        }
+        return task;
+    }
+};
+
+} // namespace util
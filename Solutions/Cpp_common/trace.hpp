@@ -0,0 +1,325 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       trace.hpp
+ *
+ * Purpose:    Record what the host and the device did and when, and write
+ *             it as a Chrome trace (chrome://tracing, ui.perfetto.dev) to
+ *             see overlap and gaps that run time totals hide
+ *
+ * Usage:      OCL_TRACE=trace.json ./mult
+ *
+ *             {
+ *                 util::TraceSpan span("build", "vadd.cl");   // until the end of the block
+ *                 ...
+ *             }
+ *             util::TraceSpan wait("finish");
+ *             queue.finish();
+ *             wait.end();                              // or until end()
+ *             util::traceEvent("vadd", event);         // a completed command
+ *
+ *             Nothing is recorded unless OCL_TRACE names a file; the trace
+ *             is written there when the program exits (or by
+ *             util::traceWrite).  The helpers of Cpp_common trace
+ *             themselves: program builds (program_cache.hpp), buffers made
+ *             by Runtime and BufferPool, the tasks of a TaskGraph, and
+ *             every command given to Profiler::record, which also traces
+ *             its device timestamps.
+ *
+ *             Each thread records into a ring of its own, so recording
+ *             takes no lock: a span is a clock read at each end and a copy
+ *             into the next slot, and when a ring is full the oldest
+ *             records are overwritten.  A thread's ring is linked into a
+ *             list with compare-and-swap the first time it records.
+ *
+ *             Host spans are on process "host", a row per thread.
+ *             Commands are on process "device", a row per queue.  The
+ *             device clock is not the host's: each queue's timestamps are
+ *             moved so that its commands end no later than the host saw
+ *             them end, which lines them up to within the latency of
+ *             the first wait.
+ *
+ * Note:       Must be included AFTER cl.hpp.  Needs C++11 (threads and
+ *             atomics); with an older standard every call does nothing.
+ *             The ring is written out while other threads may record, so
+ *             stop them (join) before the program exits.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+#if __cplusplus >= 201103L
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+#endif
+
+namespace util {
+
+#if __cplusplus >= 201103L
+
+namespace trace {
+
+const unsigned int RING_SIZE = 1 << 14;     // records a thread keeps
+const unsigned int NAME_SIZE = 48;
+
+struct Record
+{
+    char             name[NAME_SIZE];
+    char             detail[NAME_SIZE];
+    cl_command_queue queue;     // NULL for a host span
+    cl_ulong         begin;     // host: microseconds; device: start in ns
+    cl_ulong         end;       // host: microseconds; device: end in ns
+    cl_ulong         seen;      // device: host microseconds after the end
+};
+
+struct Ring
+{
+    Record                  records[RING_SIZE];
+    std::atomic<cl_ulong>   head;   // records written so far
+    unsigned int            thread;
+    Ring                   *next;
+};
+
+inline const char *file()
+{
+    static const char *name = getenv("OCL_TRACE");
+    return name && *name ? name : NULL;
+}
+
+inline bool enabled()
+{
+    static const bool on = file() != NULL;
+    return on;
+}
+
+//! Host microseconds since the first call
+inline cl_ulong now()
+{
+    typedef std::chrono::steady_clock clock;
+    static const clock::time_point epoch = clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - epoch).count();
+}
+
+inline std::atomic<Ring*>& rings()
+{
+    static std::atomic<Ring*> head(NULL);
+    return head;
+}
+
+inline void write(const char *path);
+
+// Writes the trace at exit; made with the first ring
+struct Flush
+{
+    ~Flush() { if (enabled()) write(file()); }
+};
+
+//! This thread's ring, made and linked in on first use
+inline Ring *ring()
+{
+    static thread_local Ring *mine = NULL;
+    if (!mine)
+    {
+        static Flush flush;
+        static std::atomic<unsigned int> threads(0);
+        mine = new Ring();
+        mine->head = 0;
+        mine->thread = threads++;
+        mine->next = rings().load();
+        while (!rings().compare_exchange_weak(mine->next, mine))
+            ;
+    }
+    return mine;
+}
+
+inline void copyName(char *to, const char *from)
+{
+    strncpy(to, from ? from : "", NAME_SIZE - 1);
+    to[NAME_SIZE - 1] = '\0';
+}
+
+inline void add(const char *name, const char *detail, cl_command_queue queue,
+                cl_ulong begin, cl_ulong end, cl_ulong seen)
+{
+    Ring *r = ring();
+    cl_ulong slot = r->head.load(std::memory_order_relaxed);
+    Record& record = r->records[slot % RING_SIZE];
+    copyName(record.name, name);
+    copyName(record.detail, detail);
+    record.queue = queue;
+    record.begin = begin;
+    record.end = end;
+    record.seen = seen;
+    r->head.store(slot + 1, std::memory_order_release);
+}
+
+inline void escaped(FILE *out, const char *str)
+{
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*str >= ' ')
+            fputc(*str, out);
+    }
+}
+
+inline void write(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Could not write trace to %s\n", path);
+        return;
+    }
+
+    // Gather the records kept in every ring
+    std::vector<std::pair<unsigned int, Record> > records;
+    for (Ring *r = rings().load(); r; r = r->next)
+    {
+        cl_ulong head = r->head.load(std::memory_order_acquire);
+        cl_ulong first = head > RING_SIZE ? head - RING_SIZE : 0;
+        for (cl_ulong i = first; i < head; i++)
+            records.push_back(std::make_pair(r->thread, r->records[i % RING_SIZE]));
+    }
+
+    // A row for each queue, and the shift from its clock to the host's
+    std::map<cl_command_queue, unsigned int> rows;
+    std::map<cl_command_queue, double> shift;
+    for (unsigned int i = 0; i < records.size(); i++)
+    {
+        const Record& record = records[i].second;
+        if (!record.queue)
+            continue;
+        double s = record.seen - record.end * 1.0e-3;
+        if (!shift.count(record.queue) || s < shift[record.queue])
+            shift[record.queue] = s;
+        if (!rows.count(record.queue))
+        {
+            unsigned int row = rows.size();
+            rows[record.queue] = row;
+        }
+    }
+
+    fprintf(out, "{\"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"host\"}},\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"device\"}}");
+    for (unsigned int i = 0; i < records.size(); i++)
+    {
+        const Record& record = records[i].second;
+        double ts, dur;
+        int pid;
+        unsigned int tid;
+        if (record.queue)
+        {
+            ts = record.begin * 1.0e-3 + shift[record.queue];
+            dur = (record.end - record.begin) * 1.0e-3;
+            pid = 1;
+            tid = rows[record.queue];
+        }
+        else
+        {
+            ts = (double)record.begin;
+            dur = (double)(record.end - record.begin);
+            pid = 0;
+            tid = records[i].first;
+        }
+
+        fprintf(out, ",\n{\"name\": \"");
+        escaped(out, record.name);
+        fprintf(out, "\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %u",
+                ts, dur, pid, tid);
+        if (record.detail[0])
+        {
+            fprintf(out, ", \"args\": {\"detail\": \"");
+            escaped(out, record.detail);
+            fprintf(out, "\"}");
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+}
+
+} // namespace trace
+
+//! Whether OCL_TRACE is set, to skip work done only for the trace
+inline bool traceEnabled() { return trace::enabled(); }
+
+//! A host span from construction to destruction
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const std::string& detail = "")
+        : name_(name), detail_(detail), begin_(trace::enabled() ? trace::now() : 0) {}
+
+    ~TraceSpan() { end(); }
+
+    //! End the span before it goes out of scope
+    void end()
+    {
+        if (trace::enabled() && name_)
+            trace::add(name_, detail_.c_str(), NULL, begin_, trace::now(), 0);
+        name_ = NULL;
+    }
+
+private:
+    const char  *name_;
+    std::string  detail_;
+    cl_ulong     begin_;
+
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+};
+
+//! A command that has finished (or is waited for here), from its
+//! profiling timestamps; the queue must have CL_QUEUE_PROFILING_ENABLE
+inline void traceCommand(const std::string& name, cl_command_queue queue,
+                         cl_ulong start, cl_ulong end)
+{
+    if (trace::enabled())
+        trace::add(name.c_str(), "", queue, start, end, trace::now());
+}
+
+inline void traceEvent(const std::string& name, const cl::Event& event)
+{
+    if (!trace::enabled())
+        return;
+    event.wait();
+    traceCommand(name, event.getInfo<CL_EVENT_COMMAND_QUEUE>()(),
+                 event.getProfilingInfo<CL_PROFILING_COMMAND_START>(),
+                 event.getProfilingInfo<CL_PROFILING_COMMAND_END>());
+}
+
+//! Write what has been recorded so far
+inline void traceWrite(const char *path)
+{
+    trace::write(path);
+}
+
+#else
+
+inline bool traceEnabled() { return false; }
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *, const std::string& = "") {}
+    void end() {}
+};
+
+inline void traceCommand(const std::string&, cl_command_queue, cl_ulong, cl_ulong) {}
+inline void traceEvent(const std::string&, const cl::Event&) {}
+inline void traceWrite(const char *) {}
+
+#endif
+
+} // namespace util
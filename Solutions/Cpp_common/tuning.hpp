@@ -0,0 +1,174 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       tuning.hpp
+ *
+ * Purpose:    Store and load per-device kernel tuning parameters
+ *
+ * Usage:      util::TuningFile tuning(device);
+ *             util::TuningParams params = tuning.get("block", defaults);
+ *
+ *             Each device has its own plain text file, named after the
+ *             device, in the directory given by the OCL_TUNING_DIR
+ *             environment variable (default: the working directory).
+ *             Each line holds the parameters for one kernel:
+ *
+ *                 block blksz=16 # 0.002143 s
+ *
+ *             Anything after a '#' is a comment.
+ *
+ * Note:       Must be included AFTER cl.hpp
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+
+namespace util {
+
+typedef std::map<std::string, int> TuningParams;
+
+// The file for a device with extension ext ("tune", "profile"): the
+// device name, with anything awkward in a file name replaced, in the
+// directory OCL_TUNING_DIR (default: the working directory)
+inline std::string deviceFilePath(const std::string& device, const std::string& ext)
+{
+    std::string name;
+    for (std::string::size_type i = 0; i < device.size(); i++)
+    {
+        char c = device[i];
+        if (isalnum((unsigned char)c) || c == '-' || c == '.')
+            name += c;
+        else if (!name.empty() && name[name.size() - 1] != '_')
+            name += '_';
+    }
+
+    const char *dir = getenv("OCL_TUNING_DIR");
+    std::string path = (dir != NULL && *dir) ? std::string(dir) + "/" : "";
+    return path + name + "." + ext;
+}
+
+// Format parameters as "key=value key=value"
+inline std::string formatParams(const TuningParams& params)
+{
+    std::ostringstream out;
+    for (TuningParams::const_iterator p = params.begin(); p != params.end(); ++p)
+    {
+        if (p != params.begin())
+            out << " ";
+        out << p->first << "=" << p->second;
+    }
+    return out.str();
+}
+
+class TuningFile
+{
+private:
+    std::string path_;
+    std::string device_;
+    std::map<std::string, TuningParams> kernels_;
+    std::map<std::string, std::string> notes_;
+
+public:
+    //! Open (but do not require) the tuning file for a device
+    TuningFile(const cl::Device& device)
+    {
+        device_ = device.getInfo<CL_DEVICE_NAME>();
+        path_ = deviceFilePath(device_, "tune");
+        load();
+    }
+
+    //! The file backing this device's parameters
+    const std::string& path() const { return path_; }
+
+    //! (Re)read the tuning file; returns false if there is none
+    bool load()
+    {
+        std::ifstream stream(path_.c_str());
+        if (!stream.is_open())
+            return false;
+
+        kernels_.clear();
+        notes_.clear();
+
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            std::string note;
+            std::string::size_type hash = line.find('#');
+            if (hash != std::string::npos)
+            {
+                note = line.substr(hash + 1);
+                line = line.substr(0, hash);
+            }
+
+            std::istringstream words(line);
+            std::string kernel, word;
+            if (!(words >> kernel))
+                continue;
+
+            TuningParams& params = kernels_[kernel];
+            while (words >> word)
+            {
+                std::string::size_type eq = word.find('=');
+                if (eq != std::string::npos)
+                    params[word.substr(0, eq)] = atoi(word.substr(eq + 1).c_str());
+            }
+            notes_[kernel] = note;
+        }
+        return true;
+    }
+
+    //! Write all parameters back to the tuning file
+    bool save() const
+    {
+        std::ofstream stream(path_.c_str());
+        if (!stream.is_open())
+            return false;
+
+        stream << "# Tuning parameters for " << device_ << "\n";
+        for (std::map<std::string, TuningParams>::const_iterator k = kernels_.begin();
+             k != kernels_.end(); ++k)
+        {
+            stream << k->first << " " << formatParams(k->second);
+            std::map<std::string, std::string>::const_iterator n = notes_.find(k->first);
+            if (n != notes_.end() && !n->second.empty())
+                stream << " #" << n->second;
+            stream << "\n";
+        }
+        return true;
+    }
+
+    //! Is there a stored entry for this kernel?
+    bool has(const std::string& kernel) const
+    {
+        return kernels_.find(kernel) != kernels_.end();
+    }
+
+    //! Stored parameters for a kernel, with missing ones taken from defaults
+    TuningParams get(const std::string& kernel, const TuningParams& defaults) const
+    {
+        TuningParams params = defaults;
+        std::map<std::string, TuningParams>::const_iterator k = kernels_.find(kernel);
+        if (k != kernels_.end())
+            for (TuningParams::const_iterator p = k->second.begin(); p != k->second.end(); ++p)
+                params[p->first] = p->second;
+        return params;
+    }
+
+    //! Record the parameters for a kernel, with an optional comment
+    void set(const std::string& kernel, const TuningParams& params, const std::string& note = "")
+    {
+        kernels_[kernel] = params;
+        notes_[kernel] = note.empty() ? "" : " " + note;
+    }
+};
+
+} // namespace util
@@ -16,11 +16,41 @@ typedef unsigned __int64 uint64_t;
 #include <string>
 
 #include <cstdlib>
+#include <map>
 
 namespace util {
 
+// Kernel sources compiled into the program, by file name without the
+// directory.  The Makefiles generate embedded_kernels.cpp with
+// Tools/embed_opencl, which adds each with an EmbeddedSource.
+inline std::map<std::string, const char*>& embeddedSources()
+{
+    static std::map<std::string, const char*> sources;
+    return sources;
+}
+
+struct EmbeddedSource
+{
+    EmbeddedSource(const char *file, const char *source)
+    {
+        embeddedSources()[file] = source;
+    }
+};
+
+// The source of a kernel file: the copy compiled into the program if
+// there is one, so it runs from any directory, or else the file.
+// Set OCL_KERNEL_FILES to read the files even so (while editing them).
 inline std::string loadProgram(std::string input)
 {
+    if (!getenv("OCL_KERNEL_FILES"))
+    {
+        std::string::size_type slash = input.find_last_of("/\\");
+        std::map<std::string, const char*>::const_iterator embedded =
+            embeddedSources().find(slash == std::string::npos ? input : input.substr(slash + 1));
+        if (embedded != embeddedSources().end())
+            return embedded->second;
+    }
+
     std::ifstream stream(input.c_str());
     if (!stream.is_open()) {
         std::cout << "Cannot open file: " << input << std::endl;
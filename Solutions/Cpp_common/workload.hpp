@@ -0,0 +1,118 @@
+/*------------------------------------------------------------------------------
+ *
+ * Name:       workload.hpp
+ *
+ * Purpose:    Log each kernel a driver was asked to run, with its sizes and
+ *             device, so a mix of real runs can be replayed later (see
+ *             Exercise08/Cpp/replay.cpp)
+ *
+ * Usage:      OCL_WORKLOAD=work.log ./mult --size 1000 500 700
+ *
+ *             const long sizes[] = { M, N, K };
+ *             util::recordWorkload(device, "matmul", sizes, 3);
+ *
+ *             std::vector<util::WorkloadEntry> entries;
+ *             util::readWorkload("work.log", entries);
+ *
+ *             Nothing is logged unless OCL_WORKLOAD names a file.  Each
+ *             record is appended to it as one line,
+ *
+ *                 <seconds> <kernel> <count> <size> ... <device name>
+ *
+ *             with the wall clock in seconds since 1970, so lines from
+ *             successive runs (or from several programs writing the one
+ *             log) sort into the order they came in.  The kernels logged
+ *             are matmul (M N K), vadd (length) and life (nx ny
+ *             generations).  Lines starting # are comments.
+ *
+ * Note:       Must be included AFTER cl.hpp.  Needs C++11 (std::chrono)
+ *
+ *------------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace util {
+
+// One logged run of a kernel
+struct WorkloadEntry
+{
+    double              time;       // seconds since 1970
+    std::string         kernel;
+    std::vector<long>   sizes;
+    std::string         device;
+};
+
+inline bool earlier(const WorkloadEntry& a, const WorkloadEntry& b)
+{
+    return a.time < b.time;
+}
+
+//! Append a run of kernel at count sizes on device to OCL_WORKLOAD, if set
+inline void recordWorkload(const cl::Device& device, const char *kernel,
+                           const long *sizes, int count)
+{
+    const char *path = getenv("OCL_WORKLOAD");
+    if (path == NULL || *path == '\0')
+        return;
+
+    const double now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() * 1.0e-6;
+
+    std::ostringstream line;
+    line.precision(16);
+    line << now << " " << kernel << " " << count;
+    for (int i = 0; i < count; i++)
+        line << " " << sizes[i];
+    line << " " << device.getInfo<CL_DEVICE_NAME>() << "\n";
+
+    // One write a line, so programs appending at once do not mix lines
+    FILE *out = fopen(path, "a");
+    if (out == NULL)
+        return;
+    fputs(line.str().c_str(), out);
+    fclose(out);
+}
+
+//! Read a workload log, in time order; false if it cannot be read
+inline bool readWorkload(const std::string& path, std::vector<WorkloadEntry>& entries)
+{
+    std::ifstream stream(path.c_str());
+    if (!stream.is_open())
+        return false;
+
+    entries.clear();
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream words(line);
+        WorkloadEntry entry;
+        int count;
+        if (!(words >> entry.time >> entry.kernel >> count) || count < 0)
+            continue;
+        long size;
+        for (int i = 0; i < count && words >> size; i++)
+            entry.sizes.push_back(size);
+        if ((int)entry.sizes.size() != count)
+            continue;
+        std::getline(words >> std::ws, entry.device);
+        entries.push_back(entry);
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), earlier);
+    return true;
+}
+
+} // namespace util
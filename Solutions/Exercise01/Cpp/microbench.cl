@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+//
+// kernels: the microbenchmarks of microbench.cpp
+//
+// Purpose: Each kernel does one thing, many times over, so its run time
+//          (from profiled events) measures that one thing: a launch,
+//          a copy through global memory, local memory traffic, a
+//          barrier, or floating point work.  Results are written to
+//          out, so the compiler cannot throw the work away.
+//
+
+// Nothing at all: what is left is the cost of a launch
+__kernel void empty(__global float* out)
+{
+}
+
+//------------------------------------------------------------------------------
+//
+// kernels: copy, copy_strided
+//
+// Purpose: out = in, n floats, with neighbouring work-items reading
+//          neighbouring floats (copy), or floats stride apart (copy_
+//          strided): work-item i reads float (i % rows) * stride + i /
+//          rows, rows = n / stride, which is every float once when
+//          stride divides n.  Both write neighbouring floats.
+//
+
+__kernel void copy(__global const float* in, __global float* out)
+{
+   const int i = get_global_id(0);
+   out[i] = in[i];
+}
+
+__kernel void copy_strided(__global const float* in, __global float* out,
+                           const int stride)
+{
+   const int i = get_global_id(0);
+   const int rows = get_global_size(0) / stride;
+   out[i] = in[(i % rows) * stride + i / rows];
+}
+
+//------------------------------------------------------------------------------
+//
+// kernel:  local_traffic
+//
+// Purpose: reps rounds of reading a float of local memory and writing
+//          another, each work-item moving round the work-group's tile
+//          so no round is the same as the last; two accesses of four
+//          bytes a round.  There is no barrier between rounds, so a
+//          value read may be old or new: only the traffic matters.  The
+//          work-group size must be a power of two.
+//
+
+__kernel void local_traffic(__global float* out, const int reps, __local float* tile)
+{
+   const int lid = get_local_id(0);
+   const int mask = get_local_size(0) - 1;
+
+   tile[lid] = (float)lid;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   float acc = 0.0f;
+   for (int r = 0; r < reps; r++) {
+      const float v = tile[(lid + r) & mask];
+      tile[(lid + r + 1) & mask] = v + 1.0f;
+      acc += v;
+   }
+   out[get_global_id(0)] = acc;
+}
+
+//------------------------------------------------------------------------------
+//
+// kernels: barriers, barriers_none
+//
+// Purpose: reps work-group barriers with a little local work between
+//          them, and the same work without them; the difference over
+//          reps is one barrier.
+//
+
+__kernel void barriers(__global float* out, const int reps, __local float* tile)
+{
+   const int lid = get_local_id(0);
+   float acc = (float)lid;
+   for (int r = 0; r < reps; r++) {
+      acc = acc * 0.5f + 1.0f;
+      barrier(CLK_LOCAL_MEM_FENCE);
+   }
+   tile[lid] = acc;
+   out[get_global_id(0)] = tile[lid];
+}
+
+__kernel void barriers_none(__global float* out, const int reps, __local float* tile)
+{
+   const int lid = get_local_id(0);
+   float acc = (float)lid;
+   for (int r = 0; r < reps; r++)
+      acc = acc * 0.5f + 1.0f;
+   tile[lid] = acc;
+   out[get_global_id(0)] = tile[lid];
+}
+
+//------------------------------------------------------------------------------
+//
+// kernel:  fma_peak
+//
+// Purpose: reps rounds of 8 independent float4 multiply-adds, 64 FLOPs a
+//          round, with nothing read from memory: as close to the peak
+//          FLOP rate as a kernel gets.
+//
+
+__kernel void fma_peak(__global float* out, const int reps)
+{
+   const float x = (float)get_global_id(0) * 1.0e-7f;
+   float4 a = (float4)(x, x + 1.0f, x + 2.0f, x + 3.0f);
+   float4 b = a + 0.5f, c = a + 1.5f, d = a + 2.5f;
+   float4 e = a + 3.5f, f = a + 4.5f, g = a + 5.5f, h = a + 6.5f;
+   const float4 m = (float4)(0.999f);
+   const float4 k = (float4)(0.001f);
+
+   for (int r = 0; r < reps; r++) {
+      a = mad(a, m, k); b = mad(b, m, k); c = mad(c, m, k); d = mad(d, m, k);
+      e = mad(e, m, k); f = mad(f, m, k); g = mad(g, m, k); h = mad(h, m, k);
+   }
+   const float4 s = a + b + c + d + e + f + g + h;
+   out[get_global_id(0)] = s.x + s.y + s.z + s.w;
+}
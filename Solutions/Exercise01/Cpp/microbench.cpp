@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+//
+// Name:       microbench.cpp
+//
+// Purpose:    Measure what a device can do, rather than what it says it
+//             can (Exercise01/Cpp/DeviceInfo.cpp): launch latency, global
+//             memory bandwidth for neighbouring and strided reads, local
+//             memory bandwidth, the cost of a barrier and the peak FLOP
+//             rate, each from the kernels of microbench.cl timed with
+//             profiled events (the best of BENCH_RUNS), except the launch
+//             and enqueue costs, which are host times.
+//
+// Usage:      ./microbench [--device N]
+//
+//             Every device is measured, or only the one picked with
+//             --device, --device-type or --best.  The figures are printed
+//             and written to the device's profile (device_profile.hpp), in
+//             OCL_TUNING_DIR, where the roofline report takes its peaks
+//             from and the auto-tuner (Exercise08/Cpp) the smallest time
+//             it can tell apart.
+//
+//             The barrier cost is the difference between a kernel with a
+//             barrier in its loop and one without, over the rounds, run
+//             as one work-group per compute unit; so it is one round of
+//             barriers across the device, as a kernel would see it.
+//
+//------------------------------------------------------------------------------
+
+#define __CL_ENABLE_EXCEPTIONS
+
+#include "cl.hpp"
+#include "util.hpp"
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
+
+#include "err_code.h"
+#include "device_picker.hpp"
+#include "program_cache.hpp"
+#include "profiler.hpp"
+#include "device_profile.hpp"
+
+#define BENCH_RUNS      10          // timed runs of each kernel, best kept
+#define LAUNCH_RUNS     1000        // launches averaged for the host times
+#define COPY_BYTES      (64 << 20)  // size of the copy buffers, at most
+#define STRIDE          32          // floats between reads of copy_strided
+#define LOCAL_REPS      4096        // rounds of local_traffic
+#define BARRIER_REPS    4096        // rounds of barriers
+#define FMA_REPS        4096        // rounds of fma_peak
+#define BENCH_WG        256         // largest work-group size used
+
+//------------------------------------------------------------------------------
+//
+//  Function to time kernel over global / local, best of BENCH_RUNS, seconds
+//
+//------------------------------------------------------------------------------
+static double bestSeconds(cl::CommandQueue& queue, cl::Kernel& kernel,
+                          ::size_t global, ::size_t local)
+{
+    // One untimed run, to leave out the first launch's setup
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(global), cl::NDRange(local));
+    queue.finish();
+
+    double best = 0.0;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(global),
+                                   cl::NDRange(local), NULL, &event);
+        event.wait();
+        double seconds = util::eventSeconds(event);
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+// The largest power of two work-group, up to BENCH_WG, kernel can run as
+static ::size_t groupSize(const cl::Kernel& kernel, const cl::Device& device)
+{
+    ::size_t limit = std::min((::size_t)BENCH_WG,
+                              kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+    ::size_t wg = 1;
+    while (wg * 2 <= limit)
+        wg *= 2;
+    return wg;
+}
+
+static std::string describe(const char *format, double a, double b = 0.0)
+{
+    char text[128];
+    snprintf(text, sizeof(text), format, a, b);
+    return text;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to measure one device and write its profile
+//
+//------------------------------------------------------------------------------
+static void measure(cl::Device& device)
+{
+    std::string name;
+    getDeviceName(device, name);
+    std::cout << "\nDevice: " << name << "\n";
+
+    cl::Context context(std::vector<cl::Device>(1, device));
+    cl::CommandQueue queue = util::createProfilingQueue(context, device);
+    cl::Program program = util::buildProgramFile(context, device, "microbench.cl");
+    util::DeviceProfile profile(device);
+
+    const cl_uint units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    util::Timer timer;
+
+    // Launches: host time for enqueue to finish, and for an enqueue alone,
+    // then the device time of the empty kernel
+    cl::Buffer d_out(context, CL_MEM_WRITE_ONLY, sizeof(float) * units * BENCH_WG * 8);
+    cl::Kernel empty(program, "empty");
+    empty.setArg(0, d_out);
+    queue.enqueueNDRangeKernel(empty, cl::NullRange, cl::NDRange(1), cl::NDRange(1));
+    queue.finish();
+
+    timer.reset();
+    for (int r = 0; r < LAUNCH_RUNS; r++)
+    {
+        queue.enqueueNDRangeKernel(empty, cl::NullRange, cl::NDRange(1), cl::NDRange(1));
+        queue.finish();
+    }
+    double launch_us = (double)timer.getTimeMicroseconds() / LAUNCH_RUNS;
+
+    timer.reset();
+    for (int r = 0; r < LAUNCH_RUNS; r++)
+        queue.enqueueNDRangeKernel(empty, cl::NullRange, cl::NDRange(1), cl::NDRange(1));
+    double enqueue_us = (double)timer.getTimeMicroseconds() / LAUNCH_RUNS;
+    queue.finish();
+
+    double kernel_min_us = bestSeconds(queue, empty, 1, 1) * 1.0e6;
+
+    profile.set("launch_us", launch_us, "enqueue and finish, empty kernel");
+    profile.set("enqueue_us", enqueue_us, "non-blocking enqueue");
+    profile.set("kernel_min_us", kernel_min_us, "device time, empty kernel");
+
+    // Global memory: copies of n floats, n a whole number of groups of
+    // copy_strided's rows, read once and written once
+    cl::Kernel copy(program, "copy");
+    cl::Kernel strided(program, "copy_strided");
+    ::size_t copy_wg = std::min(groupSize(copy, device), groupSize(strided, device));
+    ::size_t bytes = std::min((::size_t)COPY_BYTES,
+                              (::size_t)device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>() / 2);
+    ::size_t block = STRIDE * copy_wg;
+    ::size_t n = bytes / sizeof(float) / block * block;
+
+    cl::Buffer d_in(context, CL_MEM_READ_ONLY, sizeof(float) * n);
+    cl::Buffer d_copy(context, CL_MEM_WRITE_ONLY, sizeof(float) * n);
+    queue.enqueueFillBuffer(d_in, 1.0f, 0, sizeof(float) * n);
+
+    copy.setArg(0, d_in);
+    copy.setArg(1, d_copy);
+    double copy_gbps = 2.0 * sizeof(float) * n / bestSeconds(queue, copy, n, copy_wg) * 1.0e-9;
+
+    strided.setArg(0, d_in);
+    strided.setArg(1, d_copy);
+    strided.setArg(2, (int)STRIDE);
+    double strided_gbps = 2.0 * sizeof(float) * n / bestSeconds(queue, strided, n, copy_wg) * 1.0e-9;
+
+    std::string copied = describe("%.0f MB each way", sizeof(float) * n / 1048576.0);
+    profile.set("global_copy_gbps", copy_gbps, copied);
+    profile.set("global_strided_gbps", strided_gbps,
+                copied + ", stride " + describe("%.0f", STRIDE));
+
+    // Local memory: eight work-groups a compute unit, two accesses a round
+    cl::Kernel local(program, "local_traffic");
+    ::size_t local_wg = groupSize(local, device);
+    ::size_t local_global = units * 8 * local_wg;
+    local.setArg(0, d_out);
+    local.setArg(1, (int)LOCAL_REPS);
+    local.setArg(2, cl::Local(sizeof(float) * local_wg));
+    double local_gbps = 2.0 * sizeof(float) * local_global * LOCAL_REPS /
+                        bestSeconds(queue, local, local_global, local_wg) * 1.0e-9;
+    profile.set("local_gbps", local_gbps,
+                describe("%.0f work-items a group, %.0f groups", local_wg, units * 8));
+
+    // Barriers: the same loop with and without, one group a compute unit
+    cl::Kernel barriers(program, "barriers");
+    cl::Kernel barriers_none(program, "barriers_none");
+    ::size_t barrier_wg = std::min(groupSize(barriers, device), groupSize(barriers_none, device));
+    ::size_t barrier_global = units * barrier_wg;
+    barriers.setArg(0, d_out);
+    barriers.setArg(1, (int)BARRIER_REPS);
+    barriers.setArg(2, cl::Local(sizeof(float) * barrier_wg));
+    barriers_none.setArg(0, d_out);
+    barriers_none.setArg(1, (int)BARRIER_REPS);
+    barriers_none.setArg(2, cl::Local(sizeof(float) * barrier_wg));
+    double with = bestSeconds(queue, barriers, barrier_global, barrier_wg);
+    double without = bestSeconds(queue, barriers_none, barrier_global, barrier_wg);
+    double barrier_ns = std::max(0.0, with - without) / BARRIER_REPS * 1.0e9;
+    profile.set("barrier_ns", barrier_ns,
+                describe("%.0f work-items a group, %.0f groups", barrier_wg, units));
+
+    // Floating point: eight groups a compute unit, 64 FLOPs a round
+    cl::Kernel fma(program, "fma_peak");
+    ::size_t fma_wg = groupSize(fma, device);
+    ::size_t fma_global = units * 8 * fma_wg;
+    fma.setArg(0, d_out);
+    fma.setArg(1, (int)FMA_REPS);
+    double peak_gflops = 64.0 * fma_global * FMA_REPS /
+                         bestSeconds(queue, fma, fma_global, fma_wg) * 1.0e-9;
+    profile.set("peak_gflops", peak_gflops, "float4 mad, no memory traffic");
+
+    printf(" Launch, enqueue to finish      %10.2f us\n", launch_us);
+    printf(" Enqueue alone                  %10.2f us\n", enqueue_us);
+    printf(" Empty kernel on the device     %10.2f us\n", kernel_min_us);
+    printf(" Global copy                    %10.2f GB/s\n", copy_gbps);
+    printf(" Global copy, stride %-4d       %10.2f GB/s\n", STRIDE, strided_gbps);
+    printf(" Local memory                   %10.2f GB/s\n", local_gbps);
+    printf(" Barrier                        %10.2f ns\n", barrier_ns);
+    printf(" Peak float                     %10.2f GFLOP/s\n", peak_gflops);
+
+    if (profile.save())
+        std::cout << " Profile written to " << profile.path() << "\n";
+    else
+        std::cout << " Could not write the profile to " << profile.path() << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        cl_uint deviceIndex = 0;
+        parseArguments(argc, argv, &deviceIndex);
+
+        // Only one device if one was picked
+        bool one = false;
+        for (int i = 1; i < argc; i++)
+            if (!strcmp(argv[i], "--device") || !strcmp(argv[i], "--device-type") ||
+                !strcmp(argv[i], "--best"))
+                one = true;
+
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+
+        if (one)
+        {
+            if (deviceIndex >= numDevices)
+            {
+                std::cout << "Invalid device index (try '--list')\n";
+                return EXIT_FAILURE;
+            }
+            measure(devices[deviceIndex]);
+        }
+        else
+        {
+            for (unsigned d = 0; d < numDevices; d++)
+                measure(devices[d]);
+        }
+    }
+    catch (cl::Error err)
+    {
+        std::cout << "OpenCL Error: " << err.what() << " returned " << err_code(err.err()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
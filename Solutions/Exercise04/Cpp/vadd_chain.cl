@@ -19,4 +19,44 @@ __kernel void vadd(
    if(i < count)  {
        c[i] = a[i] + b[i];                 
    }
-}                                          
\ No newline at end of file
+}                                          
+
+//------------------------------------------------------------------------------
+//
+// kernels:  vadd_vec4, vadd_vec8
+//
+// Purpose: As vadd, four or eight floats at a time, with a grid-stride
+//          loop so the NDRange can be sized to the device rather than to
+//          count.  The last count % 4 (or 8) elements are done one at a
+//          time.
+//
+
+__kernel void vadd_vec4(
+   __global float* a,
+   __global float* b,
+   __global float* c,
+   const unsigned int count)
+{
+   unsigned int nvec = count / 4;
+   unsigned int v, i;
+   for (v = get_global_id(0); v < nvec; v += get_global_size(0))
+       vstore4(vload4(v, a) + vload4(v, b), v, c);
+
+   for (i = nvec * 4 + get_global_id(0); i < count; i += get_global_size(0))
+       c[i] = a[i] + b[i];
+}
+
+__kernel void vadd_vec8(
+   __global float* a,
+   __global float* b,
+   __global float* c,
+   const unsigned int count)
+{
+   unsigned int nvec = count / 8;
+   unsigned int v, i;
+   for (v = get_global_id(0); v < nvec; v += get_global_size(0))
+       vstore8(vload8(v, a) + vload8(v, b), v, c);
+
+   for (i = nvec * 8 + get_global_id(0); i < count; i += get_global_size(0))
+       c[i] = a[i] + b[i];
+}
@@ -6,6 +6,27 @@
 //
 //                   c = a + b
 //
+//             The chain f = g + (e + (a + b)) is run as three vadd
+//             launches, then as one kernel fused by util::AddChain,
+//             which reads a, b, e and g once and writes only f.
+//             The three launches are also run with the float4 and
+//             float8 grid-stride kernels, sized to the device.
+//
+//             The launches are timed on the device, and their GFLOP/s
+//             and GB/s printed against the device peaks (roofline.hpp).
+//             With OCL_TRACE=FILE they, the builds and the task graph go
+//             into a Chrome trace (trace.hpp).  With OCL_WORKLOAD=FILE
+//             the length is appended to FILE, for replay (workload.hpp).
+//
+//             The inputs are random numbers made on the device by a
+//             counter-based generator (random.hpp), so there is no host
+//             loop of rand() and no upload; they are read back only to
+//             check the answers.
+//
+//             Last, the sum is (a + b) + (e + g) as a util::TaskGraph,
+//             which runs c = a + b and h = e + g at the same time, each
+//             after its own uploads, and f = c + h once both are done.
+//
 // HISTORY:    Written by Tim Mattson, June 2011
 //             Ported to C++ Wrapper API by Benedict Gaster, September 2011
 //             Updated to C++ Wrapper API v1.2 by Tom Deakin and Simon McIntosh-Smith, October 2012
@@ -23,6 +44,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <map>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
@@ -33,11 +56,45 @@
 #endif
 
 #include "err_code.h"
+#include "program_cache.hpp"
+#include "fused_chain.hpp"
+#include "task_graph.hpp"
+#include "launch_plan.hpp"
+#include "profiler.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
+#include "workload.hpp"
+#include "random.hpp"
 
 //------------------------------------------------------------------------------
 
 #define TOL    (0.001)   // tolerance used in floating point comparisons
 #define LENGTH (1024)    // length of vectors a, b, and c
+#define SEED   (2011)    // seed of the random inputs
+
+//------------------------------------------------------------------------------
+//
+//  Function to count the correct elements of f = a + b + e + g
+//
+//------------------------------------------------------------------------------
+int check(const std::vector<float>& h_a, const std::vector<float>& h_b,
+          const std::vector<float>& h_e, const std::vector<float>& h_g,
+          const std::vector<float>& h_f)
+{
+    int correct = 0;
+    float tmp;
+    for(unsigned i = 0; i < h_f.size(); i++)
+    {
+        tmp = h_a[i] + h_b[i] + h_e[i] + h_g[i];     // assign element i of a+b+e+g to tmp
+        tmp -= h_f[i];                               // compute deviation of expected and output result
+        if(tmp*tmp < TOL*TOL)                        // correct if square deviation is less than tolerance squared
+            correct++;
+        else {
+            printf(" tmp %f h_a %f h_b %f h_e %f h_g %f h_f %f\n",tmp, h_a[i], h_b[i], h_e[i], h_g[i], h_f[i]);
+        }
+    }
+    return correct;
+}
 
 int main(void)
 {
@@ -48,6 +105,7 @@ int main(void)
     std::vector<float> h_e (LENGTH);               // e vector
     std::vector<float> h_f (LENGTH, 0xdeadbeef);   // f vector (result)
     std::vector<float> h_g (LENGTH);               // g vector
+    std::vector<float> h_h (LENGTH, 0xdeadbeef);   // h vector (result)
 
     cl::Buffer d_a;                       // device memory used for the input  a vector
     cl::Buffer d_b;                       // device memory used for the input  b vector
@@ -56,43 +114,56 @@ int main(void)
     cl::Buffer d_e;                       // device memory used for the input e vector
     cl::Buffer d_f;                       // device memory used for the output f vector
     cl::Buffer d_g;                       // device memory used for the input g vector
+    cl::Buffer d_h;                       // device memory used for the output h vector
 
-    // Fill vectors a and b with random float values
     int count = LENGTH;
-    for(int i = 0; i < count; i++)
-    {
-        h_a[i]  = rand() / (float)RAND_MAX;
-        h_b[i]  = rand() / (float)RAND_MAX;
-        h_e[i]  = rand() / (float)RAND_MAX;
-        h_g[i]  = rand() / (float)RAND_MAX;
-    }
 
     try 
     {
     	// Create a context
         cl::Context context(DEVICE);
 
-        // Load in kernel source, creating a program object for the context
+        std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
+
+        // The run goes into the OCL_WORKLOAD log, for replay
+        const long workload[] = { count };
+        util::recordWorkload(devices[0], "vadd", workload, 1);
+
+        // Load in kernel source (or its SPIR-V), creating a program object for the context
 
-        cl::Program program(context, util::loadProgram("vadd_chain.cl"), true);
+        cl::Program program = util::buildProgramFile(context, devices[0], "vadd_chain.cl");
 
-        // Get the command queue
-        cl::CommandQueue queue(context);
+        // Get the command queue, timing each launch
+        cl::CommandQueue queue = util::createProfilingQueue(context, devices[0]);
+        util::Roofline roofline(context, devices[0]);
+        cl::Event event, chain_events[3];
 
         // Create the kernel functor
  
         cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, int> vadd(program, "vadd");
 
-        d_a   = cl::Buffer(context, h_a.begin(), h_a.end(), true);
-        d_b   = cl::Buffer(context, h_b.begin(), h_b.end(), true);
-        d_e   = cl::Buffer(context, h_e.begin(), h_e.end(), true);
-        d_g   = cl::Buffer(context, h_g.begin(), h_g.end(), true);
+        d_a   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+        d_b   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+        d_e   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+        d_g   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+
+        // Fill vectors a, b, e and g with random float values on the
+        // device, and bring them back to check the sums against
+        util::Random rng(context, devices[0], SEED);
+        rng.uniform(queue, d_a, count);
+        rng.uniform(queue, d_b, count);
+        rng.uniform(queue, d_e, count);
+        rng.uniform(queue, d_g, count);
+        cl::copy(queue, d_a, h_a.begin(), h_a.end());
+        cl::copy(queue, d_b, h_b.begin(), h_b.end());
+        cl::copy(queue, d_e, h_e.begin(), h_e.end());
+        cl::copy(queue, d_g, h_g.begin(), h_g.end());
 
         d_c  = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * LENGTH);
         d_d  = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * LENGTH);
         d_f  = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * LENGTH);
 
-        vadd(
+        chain_events[0] = vadd(
             cl::EnqueueArgs(
                 queue,
                 cl::NDRange(count)), 
@@ -101,7 +172,7 @@ int main(void)
             d_c,
             count);
 
-        vadd(
+        chain_events[1] = vadd(
             cl::EnqueueArgs(
                 queue,
                 cl::NDRange(count)), 
@@ -110,7 +181,7 @@ int main(void)
             d_d,
             count);
 
-        vadd(
+        chain_events[2] = vadd(
             cl::EnqueueArgs(
                 queue,
                 cl::NDRange(count)), 
@@ -120,24 +191,115 @@ int main(void)
             count);
 
         cl::copy(queue, d_f, h_f.begin(), h_f.end());
+        for (int e = 0; e < 3; e++)
+        {
+            roofline.record("vadd", util::vaddCost(count), util::eventSeconds(chain_events[e]));
+            util::traceEvent("vadd", chain_events[e]);
+        }
 
         // Test the results
-        int correct = 0;
-        float tmp;
-        for(int i = 0; i < count; i++)
+        printf("C = A+B+E+G:  %d out of %d results were correct.\n",
+            check(h_a, h_b, h_e, h_g, h_f), count);
+
+        // The chain again with the vector kernels, over as many work-items
+        // as fill the device
+        const char *vec_names[] = { "vadd_vec4", "vadd_vec8" };
+        const int widths[] = { 4, 8 };
+        for (int k = 0; k < 2; k++)
         {
-            tmp = h_a[i] + h_b[i] + h_e[i] + h_g[i];     // assign element i of a+b+e+g to tmp
-            tmp -= h_f[i];                               // compute deviation of expected and output result
-            if(tmp*tmp < TOL*TOL)                        // correct if square deviation is less than tolerance squared
-                correct++;
-            else {
-                printf(" tmp %f h_a %f h_b %f h_e %f h_g %f h_f %f\n",tmp, h_a[i], h_b[i], h_e[i], h_g[i], h_f[i]);
+            cl::Kernel kernel(program, vec_names[k]);
+            util::LaunchPlan plan = util::planGrid(kernel, devices[0],
+                                                   (count + widths[k] - 1) / widths[k]);
+            cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, int> vadd_vec(kernel);
+            cl::EnqueueArgs args(queue, cl::NDRange(plan.work_groups * plan.work_group_size),
+                                 cl::NDRange(plan.work_group_size));
+
+            std::fill(h_f.begin(), h_f.end(), 0xdeadbeef);
+            cl::copy(queue, h_f.begin(), h_f.end(), d_f);
+            cl::Event events[3];
+            events[0] = vadd_vec(args, d_a, d_b, d_c, count);
+            events[1] = vadd_vec(args, d_e, d_c, d_d, count);
+            events[2] = vadd_vec(args, d_g, d_d, d_f, count);
+            cl::copy(queue, d_f, h_f.begin(), h_f.end());
+            for (int e = 0; e < 3; e++)
+            {
+                roofline.record(vec_names[k], util::vaddCost(count), util::eventSeconds(events[e]));
+                util::traceEvent(vec_names[k], events[e]);
             }
+
+            printf("%-13s %d out of %d results were correct.\n", (std::string(vec_names[k]) + ":").c_str(),
+                check(h_a, h_b, h_e, h_g, h_f), count);
         }
-        
-        // summarize results
-        printf("C = A+B+E+G:  %d out of %d results were correct.\n", correct, count);
-        
+
+        // The same chain as one fused kernel, with no intermediate buffers
+        util::AddChain chain;
+        chain.sum("c", "a", "b");
+        chain.sum("d", "e", "c");
+        chain.sum("f", "g", "d");
+        chain.output("f");
+
+        cl::Kernel fused = chain.build(context, devices[0]);
+
+        std::map<std::string, cl::Buffer> buffers;
+        buffers["a"] = d_a;
+        buffers["b"] = d_b;
+        buffers["e"] = d_e;
+        buffers["g"] = d_g;
+        buffers["f"] = d_f;
+
+        std::fill(h_f.begin(), h_f.end(), 0xdeadbeef);
+        cl::copy(queue, h_f.begin(), h_f.end(), d_f);
+        event = chain.enqueue(queue, fused, buffers, count);
+        cl::copy(queue, d_f, h_f.begin(), h_f.end());
+
+        // Three additions an element, reading four vectors and writing one
+        util::KernelCost fused_cost = { 3.0 * count, 5.0 * sizeof(float) * count };
+        roofline.record("fused chain", fused_cost, util::eventSeconds(event));
+        util::traceEvent("fused chain", event);
+
+        printf("Fused:        %d out of %d results were correct.\n",
+            check(h_a, h_b, h_e, h_g, h_f), count);
+
+        // The sum as a task graph: the two halves only share f, so
+        // they are free to run side by side
+        util::TaskGraph graph(context, devices[0]);
+        d_h = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * LENGTH);
+        std::fill(h_f.begin(), h_f.end(), 0xdeadbeef);
+
+        const ::size_t bytes = sizeof(float) * count;
+        graph.write(d_a, &h_a[0], bytes);
+        graph.write(d_b, &h_b[0], bytes);
+        graph.write(d_e, &h_e[0], bytes);
+        graph.write(d_g, &h_g[0], bytes);
+
+        cl::Kernel ko_vadd(program, "vadd");
+        ko_vadd.setArg(0, d_a);
+        ko_vadd.setArg(1, d_b);
+        ko_vadd.setArg(2, d_c);
+        ko_vadd.setArg(3, count);
+        graph.kernel(ko_vadd, cl::NDRange(count), cl::NullRange,
+                     util::Uses().reads(d_a).reads(d_b).writes(d_c));
+
+        ko_vadd.setArg(0, d_e);
+        ko_vadd.setArg(1, d_g);
+        ko_vadd.setArg(2, d_h);
+        graph.kernel(ko_vadd, cl::NDRange(count), cl::NullRange,
+                     util::Uses().reads(d_e).reads(d_g).writes(d_h));
+
+        ko_vadd.setArg(0, d_c);
+        ko_vadd.setArg(1, d_h);
+        ko_vadd.setArg(2, d_f);
+        graph.kernel(ko_vadd, cl::NDRange(count), cl::NullRange,
+                     util::Uses().reads(d_c).reads(d_h).writes(d_f));
+
+        graph.read(d_f, &h_f[0], bytes);
+        graph.finish();
+
+        printf("Task graph:   %d out of %d results were correct (%u %s queue%s).\n",
+            check(h_a, h_b, h_e, h_g, h_f), count, graph.queues(),
+            graph.outOfOrder() ? "out-of-order" : "in-order", graph.queues() > 1 ? "s" : "");
+
+        roofline.print();
     }
     catch (cl::Error err) {
         std::cout << "Exception\n";
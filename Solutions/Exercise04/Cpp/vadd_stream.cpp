@@ -0,0 +1,228 @@
+//------------------------------------------------------------------------------
+//
+// Name:       vadd_stream.cpp
+//
+// Purpose:    Elementwise addition of two vectors (c = a + b) too long to
+//             fit on the device
+//
+//                   c = a + b
+//
+//             The vectors are cut into chunks that each fit in one device
+//             allocation.  Each of several queues has its own buffers for a
+//             chunk of a, b and c, and takes every Q'th chunk: it uploads
+//             a and b, runs the kernel (vadd_vec4 from vadd_chain.cl) and
+//             downloads c, without blocking.  The commands of one queue
+//             run in order, so a queue's buffers are never overwritten
+//             too early; with Q queues, uploads, kernels and downloads of
+//             different chunks run at the same time.
+//
+// Usage:      ./vadd_stream [--length N] [--chunk N] [--queues Q] [--device INDEX]
+//
+//             The default length is up to 4 times CL_DEVICE_MAX_MEM_ALLOC_SIZE
+//             (as host memory allows).  The chunk defaults to whatever lets
+//             the Q sets of buffers fit in a quarter of the device memory.
+//
+//             With OCL_TRACE=FILE the queues are profiled and every
+//             transfer and kernel goes into a Chrome trace (trace.hpp),
+//             which shows how far the streams overlap.
+//
+//------------------------------------------------------------------------------
+
+#define __CL_ENABLE_EXCEPTIONS
+
+#include "cl.hpp"
+
+#include "util.hpp" // utility library
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+#include <iostream>
+#include <fstream>
+
+#include "err_code.h"
+#include "device_picker.hpp"
+#include "launch_plan.hpp"
+#include "trace.hpp"
+
+//------------------------------------------------------------------------------
+
+#define TOL        (0.001)        // tolerance used in floating point comparisons
+#define MAX_LENGTH (1ULL << 28)   // default length at most 2^28 floats (1 GB a vector)
+#define QUEUES     (3)            // default number of queues
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        cl_uint deviceIndex = 0;
+        parseArguments(argc, argv, &deviceIndex,
+            "      --length     N       Number of elements in each vector\n"
+            "      --chunk      N       Number of elements in each chunk\n"
+            "      --queues     Q       Number of queues to stream through\n");
+
+        cl_ulong length = 0, chunk = 0;
+        int nqueues = QUEUES;
+        for (int i = 1; i < argc - 1; i++)
+        {
+            if (!strcmp(argv[i], "--length"))
+                length = strtoull(argv[i + 1], NULL, 10);
+            else if (!strcmp(argv[i], "--chunk"))
+                chunk = strtoull(argv[i + 1], NULL, 10);
+            else if (!strcmp(argv[i], "--queues"))
+                nqueues = std::max(1, atoi(argv[i + 1]));
+        }
+
+        // Get list of devices
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+
+        // Check device index in range
+        if (deviceIndex >= numDevices)
+        {
+          std::cout << "Invalid device index (try '--list')\n";
+          return EXIT_FAILURE;
+        }
+
+        cl::Device device = devices[deviceIndex];
+
+        std::string name;
+        getDeviceName(device, name);
+        std::cout << "\nUsing OpenCL device: " << name << "\n";
+
+        cl_ulong max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+        cl_ulong global_mem = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+        if (length == 0)
+            length = std::min((cl_ulong)MAX_LENGTH, 4 * max_alloc / sizeof(float));
+        if (chunk == 0)
+            chunk = std::min(max_alloc, global_mem / (4 * 3 * nqueues)) / sizeof(float);
+        chunk = std::min(chunk, std::min(length, max_alloc / sizeof(float)));
+        chunk = std::max(chunk, (cl_ulong)1);
+        // The kernel takes the count as an unsigned int
+        chunk = std::min(chunk, (cl_ulong)0xFFFFFFFFu / 4 * 4);
+
+        const cl_ulong nchunks = (length + chunk - 1) / chunk;
+        printf(" %llu elements (%.1f MB a vector) in %llu chunks of %llu, %d queues\n",
+            (unsigned long long)length, length * sizeof(float) / 1.0e6,
+            (unsigned long long)nchunks, (unsigned long long)chunk, nqueues);
+
+        std::vector<float> h_a(length);     // a vector
+        std::vector<float> h_b(length);     // b vector
+        std::vector<float> h_c(length);     // c vector (result)
+
+        // Fill vectors a and b with random float values
+        for (cl_ulong i = 0; i < length; i++)
+        {
+            h_a[i] = rand() / (float)RAND_MAX;
+            h_b[i] = rand() / (float)RAND_MAX;
+        }
+
+        std::vector<cl::Device> chosen_device;
+        chosen_device.push_back(device);
+        cl::Context context(chosen_device);
+
+        cl::Program program(context, util::loadProgram("vadd_chain.cl"));
+        program.build(chosen_device);
+        cl::Kernel vadd(program, "vadd_vec4");
+
+        util::LaunchPlan plan = util::planGrid(vadd, device, (chunk + 3) / 4);
+        cl::NDRange global(plan.work_groups * plan.work_group_size);
+        cl::NDRange local(plan.work_group_size);
+
+        // A queue, a kernel and a set of chunk buffers per stream
+        const bool tracing = util::traceEnabled();
+        std::vector<cl::CommandQueue> queues;
+        std::vector<cl::Kernel> kernels;
+        std::vector<cl::Buffer> d_a, d_b, d_c;
+        for (int q = 0; q < nqueues; q++)
+        {
+            queues.push_back(cl::CommandQueue(context, device,
+                tracing ? CL_QUEUE_PROFILING_ENABLE : 0));
+            kernels.push_back(cl::Kernel(program, "vadd_vec4"));
+            d_a.push_back(cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * chunk));
+            d_b.push_back(cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * chunk));
+            d_c.push_back(cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * chunk));
+        }
+
+        // The commands of every chunk, kept for the trace
+        const char *stages[] = { "write a", "write b", "vadd_vec4", "read c" };
+        std::vector<cl::Event> traced;
+        cl::Event events[4];
+
+        util::Timer timer;
+
+        for (cl_ulong k = 0; k < nchunks; k++)
+        {
+            util::TraceSpan span("enqueue chunk");
+            int q = k % nqueues;
+            cl_ulong first = k * chunk;
+            cl_uint count = (cl_uint)std::min(chunk, length - first);
+            ::size_t bytes = sizeof(float) * count;
+
+            queues[q].enqueueWriteBuffer(d_a[q], CL_FALSE, 0, bytes, &h_a[first],
+                                         NULL, tracing ? &events[0] : NULL);
+            queues[q].enqueueWriteBuffer(d_b[q], CL_FALSE, 0, bytes, &h_b[first],
+                                         NULL, tracing ? &events[1] : NULL);
+
+            kernels[q].setArg(0, d_a[q]);
+            kernels[q].setArg(1, d_b[q]);
+            kernels[q].setArg(2, d_c[q]);
+            kernels[q].setArg(3, count);
+            queues[q].enqueueNDRangeKernel(kernels[q], cl::NullRange, global, local,
+                                           NULL, tracing ? &events[2] : NULL);
+
+            queues[q].enqueueReadBuffer(d_c[q], CL_FALSE, 0, bytes, &h_c[first],
+                                        NULL, tracing ? &events[3] : NULL);
+            queues[q].flush();
+            if (tracing)
+                traced.insert(traced.end(), events, events + 4);
+        }
+
+        {
+            util::TraceSpan span("finish");
+            for (int q = 0; q < nqueues; q++)
+                queues[q].finish();
+        }
+
+        double rtime = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        for (unsigned int e = 0; e < traced.size(); e++)
+            util::traceEvent(stages[e % 4], traced[e]);
+
+        // Test the results
+        cl_ulong correct = 0;
+        float tmp;
+        for (cl_ulong i = 0; i < length; i++)
+        {
+            tmp = h_a[i] + h_b[i] - h_c[i];
+            if (tmp*tmp < TOL*TOL)
+                correct++;
+        }
+
+        printf("C = A+B:  %llu out of %llu results were correct.\n",
+            (unsigned long long)correct, (unsigned long long)length);
+        printf(" %.3f seconds, %.2f GB/s moved between host and device\n",
+            rtime, 3.0 * length * sizeof(float) / (1.0e9 * rtime));
+    }
+    catch (cl::Error err) {
+        std::cout << "Exception\n";
+        std::cerr
+            << "ERROR: "
+            << err.what()
+            << "("
+            << err_code(err.err())
+           << ")"
+           << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (std::bad_alloc) {
+        std::cout << "Not enough host memory; try a smaller --length\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -22,3 +22,45 @@ __kernel void vadd(
    }
 }
 
+
+//------------------------------------------------------------------------------
+//
+// kernels:  vadd_vec4, vadd_vec8
+//
+// Purpose: As vadd, four or eight floats at a time, with a grid-stride
+//          loop so the NDRange can be sized to the device rather than to
+//          count.  The last count % 4 (or 8) elements are done one at a
+//          time.
+//
+
+__kernel void vadd_vec4(
+   __global float* a,
+   __global float* b,
+   __global float* c,
+   __global float* d,
+   const unsigned int count)
+{
+   unsigned int nvec = count / 4;
+   unsigned int v, i;
+   for (v = get_global_id(0); v < nvec; v += get_global_size(0))
+       vstore4(vload4(v, a) + vload4(v, b) + vload4(v, c), v, d);
+
+   for (i = nvec * 4 + get_global_id(0); i < count; i += get_global_size(0))
+       d[i] = a[i] + b[i] + c[i];
+}
+
+__kernel void vadd_vec8(
+   __global float* a,
+   __global float* b,
+   __global float* c,
+   __global float* d,
+   const unsigned int count)
+{
+   unsigned int nvec = count / 8;
+   unsigned int v, i;
+   for (v = get_global_id(0); v < nvec; v += get_global_size(0))
+       vstore8(vload8(v, a) + vload8(v, b) + vload8(v, c), v, d);
+
+   for (i = nvec * 8 + get_global_id(0); i < count; i += get_global_size(0))
+       d[i] = a[i] + b[i] + c[i];
+}
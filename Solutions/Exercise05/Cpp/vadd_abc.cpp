@@ -6,6 +6,22 @@
 //
 //                   d = a + b + c
 //
+//             a, b and c are random numbers made on the device
+//             (random.hpp) and read back only for the checks.  The sum
+//             is computed by the vadd kernel, then again by writing
+//             d = a + b + c with util::DeviceVector, which compiles the
+//             expression to a kernel of its own, and with the float4 and
+//             float8 grid-stride kernels, sized to the device.  The same
+//             sum comes once more from a kernel generated for it
+//             (util::Elementwise), four floats a load and grid-stride,
+//             as any other elementwise op would.
+//
+//             On an OpenCL 2.0 device the vadd kernel runs once more on
+//             vectors in shared virtual memory (svm.hpp), which it reads
+//             and writes where the host has them, with no buffers or
+//             copies; fine-grained SVM where the device has it, else
+//             coarse-grained.  Devices without SVM skip it.
+//
 // HISTORY:    Written by Tim Mattson, June 2011
 //             Ported to C++ Wrapper API by Benedict Gaster, September 2011
 //             Updated to C++ Wrapper API v1.2 by Tom Deakin and Simon McIntosh-Smith, October 2012
@@ -24,6 +40,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
@@ -34,11 +51,40 @@
 #endif
 
 #include "err_code.h"
+#include "device_vector.hpp"
+#include "launch_plan.hpp"
+#include "svm.hpp"
+#include "elementwise.hpp"
+#include "random.hpp"
 
 //------------------------------------------------------------------------------
 
 #define TOL    (0.001)   // tolerance used in floating point comparisons
 #define LENGTH (1024)    // length of vectors a, b, and c
+#define SEED   (2011)    // seed of the random inputs
+
+//------------------------------------------------------------------------------
+//
+//  Function to count the correct elements of d = a + b + c
+//
+//------------------------------------------------------------------------------
+int check(const std::vector<float>& h_a, const std::vector<float>& h_b,
+          const std::vector<float>& h_c, const std::vector<float>& h_d)
+{
+    int correct = 0;
+    float tmp;
+    for(unsigned i = 0; i < h_d.size(); i++)
+    {
+        tmp = h_a[i] + h_b[i] + h_c[i];              // assign element i of a+b+c to tmp
+        tmp -= h_d[i];                               // compute deviation of expected and output result
+        if(tmp*tmp < TOL*TOL)                        // correct if square deviation is less than tolerance squared
+            correct++;
+        else {
+            printf(" tmp %f h_a %f h_b %f h_c %f h_d %f\n",tmp, h_a[i], h_b[i], h_c[i], h_d[i]);
+        }
+    }
+    return correct;
+}
 
 int main(void)
 {
@@ -52,14 +98,7 @@ int main(void)
     cl::Buffer d_c;                       // device memory used for the input c vector
     cl::Buffer d_d;                       // device memory used for the output d vector
 
-    // Fill vectors a and b with random float values
     int count = LENGTH;
-    for(int i = 0; i < count; i++)
-    {
-        h_a[i]  = rand() / (float)RAND_MAX;
-        h_b[i]  = rand() / (float)RAND_MAX;
-        h_c[i]  = rand() / (float)RAND_MAX;
-    }
 
     try
     {
@@ -77,9 +116,20 @@ int main(void)
 
         cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, int> vadd(program, "vadd");
 
-        d_a   = cl::Buffer(context, h_a.begin(), h_a.end(), true);
-        d_b   = cl::Buffer(context, h_b.begin(), h_b.end(), true);
-        d_c   = cl::Buffer(context, h_c.begin(), h_c.end(), true);
+        d_a   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+        d_b   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+        d_c   = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * LENGTH);
+
+        // Fill vectors a, b and c with random float values on the device,
+        // and bring them back to check the sums against
+        std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
+        util::Random rng(context, devices[0], SEED);
+        rng.uniform(queue, d_a, count);
+        rng.uniform(queue, d_b, count);
+        rng.uniform(queue, d_c, count);
+        cl::copy(queue, d_a, h_a.begin(), h_a.end());
+        cl::copy(queue, d_b, h_b.begin(), h_b.end());
+        cl::copy(queue, d_c, h_c.begin(), h_c.end());
 
         d_d  = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * LENGTH);
 
@@ -96,22 +146,101 @@ int main(void)
         cl::copy(queue, d_d, h_d.begin(), h_d.end());
 
         // Test the results
-        int correct = 0;
-        float tmp;
-        for(int i = 0; i < count; i++)
+        printf("D = A+B+C:  %d out of %d results were correct.\n",
+            check(h_a, h_b, h_c, h_d), count);
+
+        // The same sum as an expression on device vectors
+        util::VectorContext vc(context, devices[0], queue);
+        util::DeviceVector<float> v_a(vc, h_a), v_b(vc, h_b), v_c(vc, h_c), v_d(vc, count);
+
+        v_d = v_a + v_b + v_c;
+        v_d.read(h_d);
+
+        printf("Expression: %d out of %d results were correct.\n",
+            check(h_a, h_b, h_c, h_d), count);
+
+        // The vector kernels, over as many work-items as fill the device
+        const char *vec_names[] = { "vadd_vec4", "vadd_vec8" };
+        const int widths[] = { 4, 8 };
+        for (int k = 0; k < 2; k++)
         {
-            tmp = h_a[i] + h_b[i] + h_c[i];              // assign element i of a+b+c to tmp
-            tmp -= h_d[i];                               // compute deviation of expected and output result
-            if(tmp*tmp < TOL*TOL)                        // correct if square deviation is less than tolerance squared
-                correct++;
-            else {
-                printf(" tmp %f h_a %f h_b %f h_c %f h_d %f\n",tmp, h_a[i], h_b[i], h_c[i], h_d[i]);
-            }
+            cl::Kernel kernel(program, vec_names[k]);
+            util::LaunchPlan plan = util::planGrid(kernel, devices[0],
+                                                   (count + widths[k] - 1) / widths[k]);
+            cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, int> vadd_vec(kernel);
+
+            std::fill(h_d.begin(), h_d.end(), 0xdeadbeef);
+            cl::copy(queue, h_d.begin(), h_d.end(), d_d);
+            vadd_vec(
+                cl::EnqueueArgs(
+                    queue,
+                    cl::NDRange(plan.work_groups * plan.work_group_size),
+                    cl::NDRange(plan.work_group_size)),
+                d_a,
+                d_b,
+                d_c,
+                d_d,
+                count);
+            cl::copy(queue, d_d, h_d.begin(), h_d.end());
+
+            printf("%-11s %d out of %d results were correct.\n", (std::string(vec_names[k]) + ":").c_str(),
+                check(h_a, h_b, h_c, h_d), count);
         }
 
-        // summarize results
-        printf("D = A+B+C:  %d out of %d results were correct.\n", correct, count);
+        // The sum from a generated kernel, made once for its signature
+        util::Elementwise ew(context, devices[0]);
+        util::ElementwiseKernel& sum3 = ew.get(
+            util::ElementwiseSpec("float", 3, "x0 + x1 + x2").width(4).gridStride());
+        std::fill(h_d.begin(), h_d.end(), 0xdeadbeef);
+        cl::copy(queue, h_d.begin(), h_d.end(), d_d);
+        sum3.input(0, d_a).input(1, d_b).input(2, d_c).output(d_d);
+        sum3.enqueue(queue, count);
+        cl::copy(queue, d_d, h_d.begin(), h_d.end());
 
+        printf("Generated:  %d out of %d results were correct.\n",
+            check(h_a, h_b, h_c, h_d), count);
+
+        // The vadd kernel on vectors in shared virtual memory
+        util::SVMKind kind = util::svmKind(devices[0]);
+        if (kind == util::SVM_NONE)
+        {
+            printf("SVM:        not on this device, skipped\n");
+        }
+        else
+        {
+            util::SVMVector<float> s_a(context, kind, count), s_b(context, kind, count);
+            util::SVMVector<float> s_c(context, kind, count), s_d(context, kind, count);
+            s_a.hostAccess(queue);
+            s_b.hostAccess(queue);
+            s_c.hostAccess(queue);
+            s_d.hostAccess(queue);
+            for (int i = 0; i < count; i++)
+            {
+                s_a[i] = h_a[i];
+                s_b[i] = h_b[i];
+                s_c[i] = h_c[i];
+                s_d[i] = 0xdeadbeef;
+            }
+            s_a.deviceAccess(queue);
+            s_b.deviceAccess(queue);
+            s_c.deviceAccess(queue);
+            s_d.deviceAccess(queue);
+
+            cl::Kernel kernel(program, "vadd");
+            s_a.setArg(kernel, 0);
+            s_b.setArg(kernel, 1);
+            s_c.setArg(kernel, 2);
+            s_d.setArg(kernel, 3);
+            kernel.setArg(4, count);
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(count));
+            queue.finish();
+
+            // The host reads d where the kernel wrote it
+            s_d.hostAccess(queue);
+            std::copy(s_d.data(), s_d.data() + count, h_d.begin());
+            printf("SVM:        %d out of %d results were correct (%s).\n",
+                check(h_a, h_b, h_c, h_d), count, util::svmName(kind));
+        }
     }
     catch (cl::Error err) {
         std::cout << "Exception\n";
@@ -0,0 +1,213 @@
+//------------------------------------------------------------------------------
+//
+// Name:       matmul.cu
+//
+// Purpose:    CUDA version of the blocked matrix multiplication (the
+//             "block" variant of Exercise08, C_block_form.cl), for
+//             comparing the two on NVIDIA devices
+//
+//                C  = A * B
+//
+//             A and B are the same constant matrices as the OpenCL
+//             programs use, and the results are checked and printed the
+//             same way, so Tools/bench_suite.py reads either.
+//
+// Usage:      ./mult [--size M N K] [--device INDEX] [--list]
+//
+//             --size multiplies an M x K matrix A by a K x N matrix B
+//             (square of order ORDER by default).  The kernel time is
+//             from CUDA events, as the OpenCL programs use event
+//             profiling.  --device picks a CUDA device by its index in
+//             --list; this numbering is CUDA's, not the OpenCL one.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <cuda.h>
+
+#define ORDER    1024    // Order of the square matrices A, B, and C
+#define AVAL     3.0     // A elements are constant and equal to AVAL
+#define BVAL     5.0     // B elements are constant and equal to BVAL
+#define TOL      (0.001) // tolerance used in floating point comparisons
+#define COUNT    1       // number of times to do the multiplication
+#define BLKSZ    16      // block size, as blksz in C_block_form.cl
+
+// Stop with CUDA's message if a call fails
+#define CHECK(call)                                                         \
+    do {                                                                    \
+        cudaError_t err = (call);                                           \
+        if (err != cudaSuccess) {                                           \
+            fprintf(stderr, "ERROR: %s (%s, line %d)\n",                    \
+                    cudaGetErrorString(err), __FILE__, __LINE__);           \
+            exit(EXIT_FAILURE);                                             \
+        }                                                                   \
+    } while (0)
+
+/*************************************************************************************
+ * CUDA kernel: a BLKSZ x BLKSZ block of C per thread block, built from blocks of
+ * A and B staged in shared memory, as mmul_mnk in C_block_form.cl.  threadIdx.x
+ * runs along a row of C, so neighbouring threads read neighbouring elements of B.
+ ************************************************************************************/
+
+__global__ void mmul_block(const int M, const int N, const int K,
+                           const float* A,
+                           const float* B,
+                                 float* C)
+{
+    __shared__ float Awrk[BLKSZ][BLKSZ];
+    __shared__ float Bwrk[BLKSZ][BLKSZ];
+
+    const int jloc = threadIdx.x;
+    const int iloc = threadIdx.y;
+    const int j = blockIdx.x * BLKSZ + jloc;
+    const int i = blockIdx.y * BLKSZ + iloc;
+
+    float sum = 0.0f;
+    for (int kk = 0; kk < K; kk += BLKSZ) {
+        // Elements past the edges of A and B load as zero
+        Awrk[iloc][jloc] = (i < M && kk + jloc < K) ? A[i*K + kk + jloc] : 0.0f;
+        Bwrk[iloc][jloc] = (kk + iloc < K && j < N) ? B[(kk + iloc)*N + j] : 0.0f;
+        __syncthreads();
+
+        #pragma unroll
+        for (int kloc = 0; kloc < BLKSZ; kloc++)
+            sum += Awrk[iloc][kloc] * Bwrk[kloc][jloc];
+        __syncthreads();
+    }
+
+    if (i < M && j < N)
+        C[i*N + j] = sum;
+}
+
+/*************************************************************************************
+ * Host functions
+ ************************************************************************************/
+
+// Sum of the squared errors of C against the constant product
+static float error(int M, int N, int K, const std::vector<float>& C)
+{
+    const double cval = (double)K * AVAL * BVAL;
+    double errsq = 0.0;
+    for (size_t i = 0; i < C.size(); i++)
+        errsq += (C[i] - cval) * (C[i] - cval);
+    return (float)errsq;
+}
+
+static void results(int M, int N, int K, const std::vector<float>& C, double run_time)
+{
+    float mflops = 2.0 * M * N * K / (1000000.0f * run_time);
+    printf(" %.2f seconds at %.1f MFLOPS \n", run_time, mflops);
+    float errsq = error(M, N, K, C);
+    if (isnan(errsq) || errsq > TOL)
+        printf("\n Errors in multiplication: %f\n", errsq);
+}
+
+static void listDevices(void)
+{
+    int count = 0;
+    CHECK(cudaGetDeviceCount(&count));
+    printf("\nDevices:\n");
+    for (int d = 0; d < count; d++) {
+        cudaDeviceProp prop;
+        CHECK(cudaGetDeviceProperties(&prop, d));
+        printf("%d: %s\n     %d multiprocessors at %d MHz, %lu MB global, %lu KB shared\n",
+               d, prop.name, prop.multiProcessorCount, prop.clockRate / 1000,
+               (unsigned long)(prop.totalGlobalMem / (1024 * 1024)),
+               (unsigned long)(prop.sharedMemPerBlock / 1024));
+    }
+    printf("\n");
+}
+
+/*************************************************************************************
+ * Main function
+ ************************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    int M = ORDER, N = ORDER, K = ORDER;
+    int device = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--list")) {
+            listDevices();
+            return EXIT_SUCCESS;
+        }
+        else if (!strcmp(argv[i], "--device") && i + 1 < argc)
+            device = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && i + 3 < argc) {
+            M = atoi(argv[i+1]);
+            N = atoi(argv[i+2]);
+            K = atoi(argv[i+3]);
+            i += 3;
+        }
+        else {
+            printf("Usage: %s [--size M N K] [--device INDEX] [--list]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (M <= 0 || N <= 0 || K <= 0) {
+        printf("Invalid matrix sizes (--size M N K)\n");
+        return EXIT_FAILURE;
+    }
+
+    int count = 0;
+    CHECK(cudaGetDeviceCount(&count));
+    if (device < 0 || device >= count) {
+        printf("Invalid device index (try '--list')\n");
+        return EXIT_FAILURE;
+    }
+    CHECK(cudaSetDevice(device));
+    cudaDeviceProp prop;
+    CHECK(cudaGetDeviceProperties(&prop, device));
+    printf("\nUsing CUDA device: %s\n", prop.name);
+
+    std::vector<float> h_A(M * K, AVAL), h_B(K * N, BVAL), h_C(M * N);
+    float *d_a, *d_b, *d_c;
+    CHECK(cudaMalloc(&d_a, sizeof(float) * M * K));
+    CHECK(cudaMalloc(&d_b, sizeof(float) * K * N));
+    CHECK(cudaMalloc(&d_c, sizeof(float) * M * N));
+    CHECK(cudaMemcpy(d_a, &h_A[0], sizeof(float) * M * K, cudaMemcpyHostToDevice));
+    CHECK(cudaMemcpy(d_b, &h_B[0], sizeof(float) * K * N, cudaMemcpyHostToDevice));
+
+    if (M == N && N == K)
+        printf("\n===== CUDA, matrix mult (blocked), order %d ======\n", N);
+    else
+        printf("\n===== CUDA, matrix mult (blocked), M=%d, N=%d, K=%d ======\n", M, N, K);
+
+    dim3 numThreads(BLKSZ, BLKSZ);
+    dim3 numBlocks((N + BLKSZ - 1) / BLKSZ, (M + BLKSZ - 1) / BLKSZ);
+    cudaEvent_t start, stop;
+    CHECK(cudaEventCreate(&start));
+    CHECK(cudaEventCreate(&stop));
+
+    // An untimed run first, as the OpenCL programs build before timing
+    mmul_block<<<numBlocks, numThreads>>>(M, N, K, d_a, d_b, d_c);
+    CHECK(cudaGetLastError());
+
+    for (int i = 0; i < COUNT; i++) {
+        CHECK(cudaMemset(d_c, 0, sizeof(float) * M * N));
+
+        CHECK(cudaEventRecord(start));
+        mmul_block<<<numBlocks, numThreads>>>(M, N, K, d_a, d_b, d_c);
+        CHECK(cudaEventRecord(stop));
+        CHECK(cudaEventSynchronize(stop));
+        CHECK(cudaGetLastError());
+
+        float ms = 0.0f;
+        CHECK(cudaEventElapsedTime(&ms, start, stop));
+
+        CHECK(cudaMemcpy(&h_C[0], d_c, sizeof(float) * M * N, cudaMemcpyDeviceToHost));
+        results(M, N, K, h_C, ms / 1000.0);
+    }
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(d_a);
+    cudaFree(d_b);
+    cudaFree(d_c);
+    return EXIT_SUCCESS;
+}
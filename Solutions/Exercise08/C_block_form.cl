@@ -44,69 +44,217 @@
 
 // It turns out that the compiler generates much better code if
 // we "hardwire" this block size.  16 works well for an NVIDIA 
-// GPU, 32 works well for a CPU
+// GPU, 32 works well for a CPU.  It can be overridden at build
+// time (-D blksz=32), which is how the auto-tuner sweeps it.
+#ifndef blksz
 #define blksz 16
+#endif
 
-__kernel void mmul(
-                const unsigned int             N,
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+// An epilogue applied to each element of C in registers before
+// it is stored, so that C = relu(alpha*A*B + beta*C + bias) takes
+// one pass over C.  Each part is compiled in by a build option:
+//
+//   -D EPI_ALPHA   scale the product by alpha
+//   -D EPI_BETA    add beta times the old C (reads C)
+//   -D EPI_BIAS    add bias[i] to column i
+//   -D EPI_RELU    clamp negative results to zero
+//
+// With any of them, mmul_mnk takes alpha, beta and bias after
+// Bwrk (unused ones are ignored).  The other kernels never apply
+// it.
+#if defined(EPI_ALPHA) || defined(EPI_BETA) || defined(EPI_BIAS) || defined(EPI_RELU)
+#define EPILOGUE
+#endif
+
+inline float epilogue(float acc, __global const float* C, const int idx, const int i,
+                      const float alpha, const float beta, __global const float* bias)
+{
+#ifdef EPI_ALPHA
+    acc *= alpha;
+#endif
+#ifdef EPI_BETA
+    acc += beta * C[idx];
+#endif
+#ifdef EPI_BIAS
+    acc += bias[i];
+#endif
+#ifdef EPI_RELU
+    acc = fmax(acc, 0.0f);
+#endif
+    return acc;
+}
+
+// C(M,N) = A(M,K) * B(K,N), all stored by rows.
+//
+// The NDRange is rounded up to whole blocks.  Elements of the
+// A and B blocks that fall outside the matrices are loaded as
+// zero, and only work-items inside C store a result, so the
+// block size need not divide M, N or K.  With epi the epilogue
+// is applied to each element as it is stored.
+void mmul_block(
+                const int                      M,
+                const int                      N,
+                const int                      K,
                 __global const float* restrict A,
                 __global const float* restrict B,
                 __global       float* restrict C,
                 __local        float* restrict Awrk,
-                __local        float* restrict Bwrk)
+                __local        float* restrict Bwrk,
+                const bool                     epi,
+                const float                    alpha,
+                const float                    beta,
+                __global const float* restrict bias)
 {
     int kloc, Kblk;
     float Ctmp=0.0f;
 
-    //  This work-item will compute element C(i,j)
+    //  This work-item will compute element C(j,i): column i, row j
     const int i = get_global_id(0);
     const int j = get_global_id(1);
 
-    // Element C(i,j) is in block C(Iblk,Jblk)
-    const int Iblk = get_group_id(0);
-    const int Jblk = get_group_id(1);
-
-    // C(i,j) is element C(iloc, jloc) of block C(Iblk, Jblk)
+    // C(j,i) is element C(jloc, iloc) of block C(Jblk, Iblk)
     const int iloc = get_local_id(0);
     const int jloc = get_local_id(1);
 
-    // The number of blocks are the same in each dimension
-    const int Num_BLK = N/blksz;
-
-    // Setup the upper-left-corner (base address) for the A and
-    // B blocks plus the increments to advance base addresses as
-    // we loop over blocks
-          int Abase = Jblk*N*blksz;    
-    const int Ainc  = blksz;
-
-          int Bbase = Iblk*blksz;
-    const int Binc  = blksz*N;
-
+    // The number of blocks along the shared dimension
+    const int Num_BLK = (K + blksz - 1)/blksz;
 
-    // C(Iblk,Jblk) = (sum over Kblk) A(Iblk,Kblk)*B(Kblk,Jblk)
+    // C(Jblk,Iblk) = (sum over Kblk) A(Jblk,Kblk)*B(Kblk,Iblk)
     for (Kblk = 0;  Kblk<Num_BLK;  Kblk++)
     {
-       // Load A(Iblk,Kblk) and B(Kblk,Jblk) into local memory.
+       // Load A(Jblk,Kblk) and B(Kblk,Iblk) into local memory.
        // Each work-item loads a single element of the two blocks
        // which are shared with the entire work-group.
+       const int ka = Kblk*blksz + iloc;    // column of A loaded
+       const int kb = Kblk*blksz + jloc;    // row of B loaded
 
-       Awrk[jloc*blksz+iloc] = A[Abase+jloc*N+iloc];
-       Bwrk[jloc*blksz+iloc] = B[Bbase+jloc*N+iloc];
+       Awrk[jloc*blksz+iloc] = (j < M && ka < K) ? A[j*K+ka] : 0.0f;
+       Bwrk[jloc*blksz+iloc] = (kb < K && i < N) ? B[kb*N+i] : 0.0f;
 
        barrier(CLK_LOCAL_MEM_FENCE);
 
        // Compute dot products over local blocks to find
-       // the contribution to C(i,j) from this block
+       // the contribution to C(j,i) from this block
        #pragma unroll
        for (kloc=0; kloc<blksz; kloc++)
           Ctmp += Awrk[jloc*blksz+kloc] * Bwrk[kloc*blksz+iloc];
 
        barrier(CLK_LOCAL_MEM_FENCE);
-       Abase += Ainc;
-       Bbase += Binc;
     }
  
     // update global C matrix 
-    C[j*N+i] = Ctmp;
+    if (j < M && i < N)
+       C[j*N+i] = epi ? epilogue(Ctmp, C, j*N+i, i, alpha, beta, bias) : Ctmp;
 
 }
+
+__kernel void mmul(
+                const unsigned int             N,
+                __global const float* restrict A,
+                __global const float* restrict B,
+                __global       float* restrict C,
+                __local        float* restrict Awrk,
+                __local        float* restrict Bwrk)
+{
+    mmul_block(N, N, N, A, B, C, Awrk, Bwrk, false, 1.0f, 0.0f, 0);
+}
+
+__kernel void mmul_mnk(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const float* restrict A,
+                __global const float* restrict B,
+                __global       float* restrict C,
+                __local        float* restrict Awrk,
+#ifdef EPILOGUE
+                __local        float* restrict Bwrk,
+                const float                    alpha,
+                const float                    beta,
+                __global const float* restrict bias)
+{
+    mmul_block(SIZE_M, SIZE_N, SIZE_K, A, B, C, Awrk, Bwrk, true, alpha, beta, bias);
+}
+#else
+                __local        float* restrict Bwrk)
+{
+    mmul_block(SIZE_M, SIZE_N, SIZE_K, A, B, C, Awrk, Bwrk, false, 1.0f, 0.0f, 0);
+}
+#endif
+
+// The epilogue as a pass of its own over C(M,N), for comparison
+// with applying it in mmul_mnk: D = epilogue(P, C), where P is
+// the product.  Only built with the epilogue on.
+#ifdef EPILOGUE
+__kernel void epilogue_pass(
+                const int                      M,
+                const int                      N,
+                __global const float* restrict P,
+                __global       float* restrict C,
+                const float                    alpha,
+                const float                    beta,
+                __global const float* restrict bias)
+{
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+    if (j < M && i < N)
+       C[j*N+i] = epilogue(P[j*N+i], C, j*N+i, i, alpha, beta, bias);
+}
+#endif
+
+// A batch of independent products C[b] = A[b] * B[b], all of
+// the same size, in one NDRange: dimension 2 is the batch index.
+// Matrix b of each operand starts stride elements after matrix
+// b-1 (a stride of 0 shares one matrix across the batch).
+__kernel void mmul_batched(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const float* restrict A,
+                const int                      strideA,
+                __global const float* restrict B,
+                const int                      strideB,
+                __global       float* restrict C,
+                const int                      strideC,
+                __local        float* restrict Awrk,
+                __local        float* restrict Bwrk)
+{
+    const int b = get_global_id(2);
+    mmul_block(M, N, K, A + b*strideA, B + b*strideB, C + b*strideC, Awrk, Bwrk,
+               false, 1.0f, 0.0f, 0);
+}
+
+// As mmul_batched, but matrix b of each operand starts at the
+// element offset given by offA[b], offB[b] and offC[b], so the
+// matrices can be anywhere in their buffers.
+__kernel void mmul_batched_offsets(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const float* restrict A,
+                __global const int*   restrict offA,
+                __global const float* restrict B,
+                __global const int*   restrict offB,
+                __global       float* restrict C,
+                __global const int*   restrict offC,
+                __local        float* restrict Awrk,
+                __local        float* restrict Bwrk)
+{
+    const int b = get_global_id(2);
+    mmul_block(M, N, K, A + offA[b], B + offB[b], C + offC[b], Awrk, Bwrk,
+               false, 1.0f, 0.0f, 0);
+}
@@ -0,0 +1,70 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Blocked Matrix Multipliplication kernel, fp16 storage
+//
+//  PURPOSE: Computes an element of the product matrix
+//
+//              C = A * B
+//
+//           with the blocked algorithm of C_block_form.cl, where
+//           A and B are stored as 16 bit halfs and C as floats.
+//           The blocks are widened to float as they are loaded
+//           into local memory and the sums are kept in float, so
+//           only the storage is half: A and B move half the
+//           bytes of the float kernel.
+//
+//           vload_half is core OpenCL, so a device without
+//           cl_khr_fp16 (no arithmetic on halfs) runs this too.
+//
+//  USAGE:   C(M,N) = A(M,K) * B(K,N), all stored by rows.  The
+//           NDRange and work-group are those of C_block_form.cl:
+//           C rounded up to whole blksz x blksz blocks.
+//
+//-------------------------------------------------------------
+
+#ifndef blksz
+#define blksz 16
+#endif
+
+__kernel void mmul_mnk(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const half*  restrict A,
+                __global const half*  restrict B,
+                __global       float* restrict C,
+                __local        float* restrict Awrk,
+                __local        float* restrict Bwrk)
+{
+    int kloc, Kblk;
+    float Ctmp = 0.0f;
+
+    //  This work-item will compute element C(j,i): column i, row j
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    const int iloc = get_local_id(0);
+    const int jloc = get_local_id(1);
+
+    const int Num_BLK = (K + blksz - 1)/blksz;
+
+    for (Kblk = 0;  Kblk<Num_BLK;  Kblk++)
+    {
+       const int ka = Kblk*blksz + iloc;    // column of A loaded
+       const int kb = Kblk*blksz + jloc;    // row of B loaded
+
+       Awrk[jloc*blksz+iloc] = (j < M && ka < K) ? vload_half(j*K+ka, A) : 0.0f;
+       Bwrk[jloc*blksz+iloc] = (kb < K && i < N) ? vload_half(kb*N+i, B) : 0.0f;
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+
+       #pragma unroll
+       for (kloc=0; kloc<blksz; kloc++)
+          Ctmp += Awrk[jloc*blksz+kloc] * Bwrk[kloc*blksz+iloc];
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (j < M && i < N)
+       C[j*N+i] = Ctmp;
+}
@@ -0,0 +1,98 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Blocked Matrix Multipliplication kernel, int8
+//
+//  PURPOSE: Computes an element of the product matrix
+//
+//              C = scale * (A * B)
+//
+//           where A and B hold 8 bit integers (quantized on the
+//           host, see quantizeInt8 in matrix_lib.cpp) and C is
+//           float.  The sums are 32 bit integers, scaled back to
+//           float as C is stored.  A and B move a quarter of the
+//           bytes of the float kernel.
+//
+//           The k dimension is packed four to an int: A is M rows
+//           of Kp ints, and B is stored transposed, as N rows of
+//           Kp ints, so a packed int holds 4 consecutive k of a
+//           row of A or a column of B and one int of each gives a
+//           4 term dot product.  With cl_khr_integer_dot_product
+//           (OpenCL 3.0) that is dot_4x8packed_ss_int, one
+//           instruction on the devices that have it.
+//
+//  USAGE:   Kp = ceil(K / 4); the host pads the rows with zeros.
+//           The NDRange and work-group are those of
+//           C_block_form.cl: C rounded up to whole blksz x blksz
+//           blocks.  The blocks are blksz x blksz ints, so
+//           4*blksz values of k are reduced per barrier.
+//
+//-------------------------------------------------------------
+
+#ifndef blksz
+#define blksz 16
+#endif
+
+#ifdef __opencl_c_integer_dot_product_input_4x8bit_packed
+#pragma OPENCL EXTENSION cl_khr_integer_dot_product : enable
+#endif
+
+// The dot product of two packed vectors of 4 signed chars
+inline int dot4(int a, int b)
+{
+#ifdef __opencl_c_integer_dot_product_input_4x8bit_packed
+    return dot_4x8packed_ss_int(as_uint(a), as_uint(b));
+#else
+    const char4 x = as_char4(a);
+    const char4 y = as_char4(b);
+    return x.s0*y.s0 + x.s1*y.s1 + x.s2*y.s2 + x.s3*y.s3;
+#endif
+}
+
+__kernel void mmul_mnk(
+                const int                      M,
+                const int                      N,
+                const int                      Kp,
+                __global const int*   restrict A,
+                __global const int*   restrict Bt,
+                __global       float* restrict C,
+                const float                    scale,
+                __local        int*   restrict Awrk,
+                __local        int*   restrict Bwrk)
+{
+    int kloc, Kblk;
+    int Ctmp = 0;
+
+    //  This work-item will compute element C(j,i): column i, row j
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    const int iloc = get_local_id(0);
+    const int jloc = get_local_id(1);
+
+    // The column of B (row of Bt) that work-item (jloc, *) loads
+    const int ib = get_group_id(0)*blksz + jloc;
+
+    const int Num_BLK = (Kp + blksz - 1)/blksz;
+
+    for (Kblk = 0;  Kblk<Num_BLK;  Kblk++)
+    {
+       // Neighbouring work-items load neighbouring ints of a row
+       // of A and of Bt
+       const int k = Kblk*blksz + iloc;
+
+       Awrk[jloc*blksz+iloc] = (j < M && k < Kp)  ? A[j*Kp+k]   : 0;
+       Bwrk[jloc*blksz+iloc] = (ib < N && k < Kp) ? Bt[ib*Kp+k] : 0;
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+
+       // Bwrk row iloc is column i of B
+       #pragma unroll
+       for (kloc=0; kloc<blksz; kloc++)
+          Ctmp += dot4(Awrk[jloc*blksz+kloc], Bwrk[iloc*blksz+kloc]);
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (j < M && i < N)
+       C[j*N+i] = scale * (float)Ctmp;
+}
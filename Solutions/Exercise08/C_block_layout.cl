@@ -0,0 +1,144 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Blocked Matrix Multipliplication kernel, any layout
+//
+//  PURPOSE: Computes an element of the product matrix
+//
+//              C = op(A) * op(B)
+//
+//           with the blocked algorithm of C_block_form.cl, where
+//           op(X) is X or its transpose as the operand is stored:
+//
+//              TRANS_A=0   A is M x K by rows    (N)
+//              TRANS_A=1   A is stored K x M     (T)
+//              TRANS_B=0   B is K x N by rows    (N)
+//              TRANS_B=1   B is stored N x K     (T)
+//
+//           so NN, NT, TN and TT are the four builds.  Whatever
+//           the layout, neighbouring work-items load neighbouring
+//           floats of a stored row (coalesced), and the block is
+//           written to local memory the way round the product
+//           reads it.  The local rows are padded by one float so
+//           the transposed writes do not fall in one bank.
+//
+//           transpose (Y = X transposed) uses the same padded
+//           tile, to change the layout of an operand on the
+//           device when a kernel wants the other one.
+//
+//  USAGE:   The NDRange and work-group are those of
+//           C_block_form.cl: C rounded up to whole blksz x blksz
+//           blocks.  Awrk and Bwrk are blksz x (blksz+1) floats.
+//           For transpose, the NDRange covers X(rows,cols) rounded
+//           up to whole blocks, dimension 0 along the columns.
+//
+//-------------------------------------------------------------
+
+#ifndef blksz
+#define blksz 16
+#endif
+
+#ifndef TRANS_A
+#define TRANS_A 0
+#endif
+
+#ifndef TRANS_B
+#define TRANS_B 0
+#endif
+
+// Row stride of the blocks in local memory
+#define LSTRIDE (blksz + 1)
+
+__kernel void mmul_mnk(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const float* restrict A,
+                __global const float* restrict B,
+                __global       float* restrict C,
+                __local        float* restrict Awrk,
+                __local        float* restrict Bwrk)
+{
+    int kloc, Kblk;
+    float Ctmp = 0.0f;
+
+    //  This work-item will compute element C(j,i): column i, row j
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    const int iloc = get_local_id(0);
+    const int jloc = get_local_id(1);
+
+    // The first row and column of this block of C
+    const int Jbase = get_group_id(1)*blksz;
+    const int Ibase = get_group_id(0)*blksz;
+
+    const int Num_BLK = (K + blksz - 1)/blksz;
+
+    for (Kblk = 0;  Kblk<Num_BLK;  Kblk++)
+    {
+       const int Kbase = Kblk*blksz;
+
+       // Awrk(r,k) = op(A)(Jbase+r, Kbase+k), with iloc running
+       // along the stored rows
+#if TRANS_A
+       {
+          const int r = iloc, k = jloc;
+          Awrk[r*LSTRIDE+k] = (Jbase+r < M && Kbase+k < K) ? A[(Kbase+k)*M + Jbase+r] : 0.0f;
+       }
+#else
+       {
+          const int r = jloc, k = iloc;
+          Awrk[r*LSTRIDE+k] = (Jbase+r < M && Kbase+k < K) ? A[(Jbase+r)*K + Kbase+k] : 0.0f;
+       }
+#endif
+
+       // Bwrk(k,c) = op(B)(Kbase+k, Ibase+c)
+#if TRANS_B
+       {
+          const int k = iloc, c = jloc;
+          Bwrk[k*LSTRIDE+c] = (Kbase+k < K && Ibase+c < N) ? B[(Ibase+c)*K + Kbase+k] : 0.0f;
+       }
+#else
+       {
+          const int k = jloc, c = iloc;
+          Bwrk[k*LSTRIDE+c] = (Kbase+k < K && Ibase+c < N) ? B[(Kbase+k)*N + Ibase+c] : 0.0f;
+       }
+#endif
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+
+       #pragma unroll
+       for (kloc=0; kloc<blksz; kloc++)
+          Ctmp += Awrk[jloc*LSTRIDE+kloc] * Bwrk[kloc*LSTRIDE+iloc];
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (j < M && i < N)
+       C[j*N+i] = Ctmp;
+}
+
+// Y(cols,rows) = X(rows,cols) transposed, a block at a time: the
+// block is read along the rows of X and written along the rows
+// of Y, so both are coalesced
+__kernel void transpose(
+                const int                      rows,
+                const int                      cols,
+                __global const float* restrict X,
+                __global       float* restrict Y,
+                __local        float* restrict tile)
+{
+    const int iloc = get_local_id(0);
+    const int jloc = get_local_id(1);
+    const int Ibase = get_group_id(0)*blksz;    // first column of X
+    const int Jbase = get_group_id(1)*blksz;    // first row of X
+
+    if (Jbase+jloc < rows && Ibase+iloc < cols)
+       tile[jloc*LSTRIDE+iloc] = X[(Jbase+jloc)*cols + Ibase+iloc];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Row Ibase+jloc of Y is column Ibase+jloc of X
+    if (Ibase+jloc < cols && Jbase+iloc < rows)
+       Y[(Ibase+jloc)*rows + Jbase+iloc] = tile[iloc*LSTRIDE+jloc];
+}
@@ -0,0 +1,176 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Register-tiled Matrix Multipliplication kernel
+//
+//  PURPOSE: Computes a TS x TS tile of the product matrix
+//
+//              C = A * B
+//
+//           per work-group, with each work-item computing a
+//           WPT x WPT sub-tile of C held in private memory
+//           (registers).
+//
+//           The blocked kernel (C_block_form.cl) computes one
+//           element of C per work-item, so every multiply-add
+//           needs two loads from local memory.  Here each
+//           work-item loads WPT values of A and WPT values of B
+//           from local memory per k and reuses them for
+//           WPT*WPT multiply-adds, so the ratio of arithmetic to
+//           local memory traffic grows by a factor of WPT.
+//
+//           The tiles of A and B are staged into local memory
+//           with float4 loads, TSK columns of A and TSK rows of
+//           B at a time.
+//
+//  USAGE:   The tile sizes are set at build time, for example
+//
+//              -D TS=64 -D TSK=16 -D WPT=4
+//
+//           The work-group must be (TS/WPT) x (TS/WPT) work-items
+//           and the NDRange covers C rounded up to whole tiles:
+//           (ceil(N/TS)*TS/WPT) x (ceil(M/TS)*TS/WPT).  TS must be
+//           a multiple of WPT, and TS and TSK multiples of 4.
+//
+//           C(M,N) = A(M,K) * B(K,N), all stored by rows.  Parts of
+//           the tiles outside the matrices are loaded as zero and
+//           not stored, so the tile sizes need not divide M, N or K.
+//
+//           Dimension 0 of the NDRange runs along the columns of
+//           C (as in C_block_form.cl), so neighbouring work-items
+//           touch neighbouring addresses.
+//
+//-------------------------------------------------------------
+
+#ifndef TS
+#define TS  64      // Tile of C computed by a work-group (TS x TS)
+#endif
+
+#ifndef TSK
+#define TSK 16      // Depth of the k-panel staged in local memory
+#endif
+
+#ifndef WPT
+#define WPT 4       // Tile of C computed by a work-item (WPT x WPT)
+#endif
+
+#define RTS (TS/WPT)    // The work-group is RTS x RTS work-items
+
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+// Load four consecutive floats of row r (of length len) of a
+// matrix with nrows rows, starting at column c, or zeros for
+// any that fall outside it
+inline float4 load4(__global const float* restrict X, const int nrows,
+                    const int len, const int r, const int c)
+{
+    if (r >= nrows)
+        return (float4)(0.0f);
+    if (c + 3 < len)
+        return vload4(0, X + r * len + c);
+
+    float4 v = (float4)(0.0f);
+    if (c     < len) v.s0 = X[r * len + c];
+    if (c + 1 < len) v.s1 = X[r * len + c + 1];
+    if (c + 2 < len) v.s2 = X[r * len + c + 2];
+    return v;
+}
+
+__kernel __attribute__((reqd_work_group_size(RTS, RTS, 1)))
+void mmul_mnk(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const float* restrict A,
+                __global const float* restrict B,
+                __global       float* restrict C)
+{
+    // Position of this work-item within the tile
+    const int tidn = get_local_id(0);       // column direction
+    const int tidm = get_local_id(1);       // row direction
+    const int tid  = tidm * RTS + tidn;
+
+    // Upper-left corner of the tile of C for this work-group
+    const int offN = get_group_id(0) * TS;
+    const int offM = get_group_id(1) * TS;
+
+    // Local memory panels: TS rows x TSK columns of A and
+    // TSK rows x TS columns of B
+    __local float Asub[TS][TSK];
+    __local float Bsub[TSK][TS];
+
+    // Private accumulators and operand registers
+    float Creg[WPT][WPT];
+    float Areg[WPT];
+    float Breg[WPT];
+
+    for (int wm = 0; wm < WPT; wm++)
+        for (int wn = 0; wn < WPT; wn++)
+            Creg[wm][wn] = 0.0f;
+
+    for (int t = 0; t < SIZE_K; t += TSK)
+    {
+        // Cooperatively load the panels of A and B, four floats
+        // at a time
+        for (int l = tid; l < TS * TSK / 4; l += RTS * RTS)
+        {
+            const int row = l / (TSK / 4);
+            const int col = (l % (TSK / 4)) * 4;
+            vstore4(load4(A, SIZE_M, SIZE_K, offM + row, t + col), 0, &Asub[row][col]);
+        }
+        for (int l = tid; l < TSK * TS / 4; l += RTS * RTS)
+        {
+            const int row = l / (TS / 4);
+            const int col = (l % (TS / 4)) * 4;
+            vstore4(load4(B, SIZE_K, SIZE_N, t + row, offN + col), 0, &Bsub[row][col]);
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Rank-1 updates of the register tile.  Work-items take
+        // rows and columns strided by RTS so that reads from local
+        // memory and the final stores to C are contiguous across
+        // the work-group.
+        #pragma unroll
+        for (int k = 0; k < TSK; k++)
+        {
+            #pragma unroll
+            for (int wm = 0; wm < WPT; wm++)
+                Areg[wm] = Asub[tidm + wm * RTS][k];
+            #pragma unroll
+            for (int wn = 0; wn < WPT; wn++)
+                Breg[wn] = Bsub[k][tidn + wn * RTS];
+
+            #pragma unroll
+            for (int wm = 0; wm < WPT; wm++)
+                #pragma unroll
+                for (int wn = 0; wn < WPT; wn++)
+                    Creg[wm][wn] += Areg[wm] * Breg[wn];
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Update global C matrix
+    for (int wm = 0; wm < WPT; wm++)
+    {
+        const int row = offM + tidm + wm * RTS;
+        for (int wn = 0; wn < WPT; wn++)
+        {
+            const int col = offN + tidn + wn * RTS;
+            if (row < SIZE_M && col < SIZE_N)
+                C[row * SIZE_N + col] = Creg[wm][wn];
+        }
+    }
+}
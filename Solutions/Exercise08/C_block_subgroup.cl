@@ -0,0 +1,153 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Blocked Matrix Multipliplication kernel with
+//           sub-group shuffles
+//
+//  PURPOSE: Computes an element of the product matrix
+//
+//              C = A * B
+//
+//           with the blocked algorithm of C_block_form.cl, but
+//           sharing the block of A through sub-group shuffles
+//           rather than local memory.
+//
+//           In the blocked kernel each row of the work-group
+//           reads the same row of the A block from local memory,
+//           blksz times a block.  When a row of the work-group is
+//           one sub-group (warp, wavefront), each work-item can
+//           instead keep its own element of that row in a
+//           register and broadcast it to the others with a
+//           shuffle, so only B goes through local memory.  B is
+//           double buffered, so each block needs one barrier
+//           rather than two: a work-item only writes a buffer
+//           again after every work-item has passed the barrier
+//           of the block that read it.
+//
+//  USAGE:   The block size is set at build time (-D blksz=16).
+//           The work-group is blksz x blksz, as for the blocked
+//           kernel, and mmul_mnk takes local memory for two B
+//           blocks (Bwrk) and one A block (Awrk).
+//
+//           The shuffles are compiled in on devices with
+//           cl_intel_subgroups or cl_khr_subgroup_shuffle, and
+//           used when the kernel's sub-groups are blksz wide, so
+//           that each row of the work-group is one (on Intel the
+//           width is asked for with intel_reqd_sub_group_size).
+//           Anywhere else the kernel is the blocked kernel, A and
+//           B both in local memory.  Sub-groups are taken to be
+//           made of consecutive work-items, as the drivers that
+//           have the extensions make them.
+//
+//-------------------------------------------------------------
+
+#ifndef blksz
+#define blksz 16
+#endif
+
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+#if defined(cl_intel_subgroups)
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+#define SUBGROUP_SHUFFLE(x, lane) intel_sub_group_shuffle(x, lane)
+#if defined(cl_intel_required_subgroup_size) && (blksz == 8 || blksz == 16 || blksz == 32)
+#pragma OPENCL EXTENSION cl_intel_required_subgroup_size : enable
+#define SUBGROUP_WIDTH __attribute__((intel_reqd_sub_group_size(blksz)))
+#endif
+#elif defined(cl_khr_subgroup_shuffle)
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle : enable
+#define SUBGROUP_SHUFFLE(x, lane) sub_group_shuffle(x, lane)
+#endif
+
+#ifndef SUBGROUP_WIDTH
+#define SUBGROUP_WIDTH
+#endif
+
+// C(M,N) = A(M,K) * B(K,N), all stored by rows.  As in
+// C_block_form.cl, the NDRange is rounded up to whole blocks,
+// parts of blocks outside the matrices are loaded as zero and
+// only work-items inside C store a result.
+__kernel SUBGROUP_WIDTH void mmul_mnk(
+                const int                      M,
+                const int                      N,
+                const int                      K,
+                __global const float* restrict A,
+                __global const float* restrict B,
+                __global       float* restrict C,
+                __local        float* restrict Bwrk,
+                __local        float* restrict Awrk)
+{
+    int kloc, Kblk;
+    float Ctmp = 0.0f;
+
+    //  This work-item will compute element C(j,i): column i, row j
+    const int i = get_global_id(0);
+    const int j = get_global_id(1);
+
+    // C(j,i) is element C(jloc, iloc) of block C(Jblk, Iblk)
+    const int iloc = get_local_id(0);
+    const int jloc = get_local_id(1);
+
+    // The number of blocks along the shared dimension
+    const int Num_BLK = (SIZE_K + blksz - 1)/blksz;
+
+#ifdef SUBGROUP_SHUFFLE
+    // The same for the whole work-group, so its barriers are too
+    if (get_max_sub_group_size() == blksz)
+    {
+       for (Kblk = 0;  Kblk<Num_BLK;  Kblk++)
+       {
+          const int ka = Kblk*blksz + iloc;    // column of A loaded
+          const int kb = Kblk*blksz + jloc;    // row of B loaded
+
+          // Lane iloc of the sub-group for row j holds A(j,ka)
+          const float a = (j < SIZE_M && ka < SIZE_K) ? A[j*SIZE_K+ka] : 0.0f;
+
+          __local float* Bblk = Bwrk + (Kblk & 1)*blksz*blksz;
+          Bblk[jloc*blksz+iloc] = (kb < SIZE_K && i < SIZE_N) ? B[kb*SIZE_N+i] : 0.0f;
+
+          barrier(CLK_LOCAL_MEM_FENCE);
+
+          #pragma unroll
+          for (kloc=0; kloc<blksz; kloc++)
+             Ctmp += SUBGROUP_SHUFFLE(a, kloc) * Bblk[kloc*blksz+iloc];
+       }
+
+       if (j < SIZE_M && i < SIZE_N)
+          C[j*SIZE_N+i] = Ctmp;
+       return;
+    }
+#endif
+
+    // Without shuffles: the loop of C_block_form.cl
+    for (Kblk = 0;  Kblk<Num_BLK;  Kblk++)
+    {
+       const int ka = Kblk*blksz + iloc;
+       const int kb = Kblk*blksz + jloc;
+
+       Awrk[jloc*blksz+iloc] = (j < SIZE_M && ka < SIZE_K) ? A[j*SIZE_K+ka] : 0.0f;
+       Bwrk[jloc*blksz+iloc] = (kb < SIZE_K && i < SIZE_N) ? B[kb*SIZE_N+i] : 0.0f;
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+
+       #pragma unroll
+       for (kloc=0; kloc<blksz; kloc++)
+          Ctmp += Awrk[jloc*blksz+kloc] * Bwrk[kloc*blksz+iloc];
+
+       barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (j < SIZE_M && i < SIZE_N)
+       C[j*SIZE_N+i] = Ctmp;
+}
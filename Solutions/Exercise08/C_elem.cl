@@ -1,19 +1,69 @@
 
-__kernel void mmul(
+// The k loop is unrolled by a factor of UNROLL, which can be
+// set at build time (-D UNROLL=4) by the auto-tuner
+#ifndef UNROLL
+#define UNROLL 1
+#endif
+
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+// C(M,N) = A(M,K) * B(K,N), all stored by rows.  Work-items
+// outside C (when the NDRange is rounded up to the work-group
+// size) do nothing.
+void mmul_elem(
+    const int M,
     const int N,
+    const int K,
     __global float* A,
     __global float* B,
     __global float* C)
 {
-    int k;
+    int k, u;
     int i = get_global_id(0);
     int j = get_global_id(1);
     float tmp;
-    if ((i < N) && (j < N))
+    if ((i < M) && (j < N))
     {
         tmp = 0.0;
-        for (k = 0; k < N; k++)
-            tmp += A[i*N+k] * B[k*N+j];
+        for (k = 0; k + UNROLL <= K; k += UNROLL) {
+            #pragma unroll
+            for (u = 0; u < UNROLL; u++)
+                tmp += A[i*K+k+u] * B[(k+u)*N+j];
+        }
+        for (; k < K; k++)
+            tmp += A[i*K+k] * B[k*N+j];
         C[i*N+j] = tmp;
     }
 }
+
+__kernel void mmul(
+    const int N,
+    __global float* A,
+    __global float* B,
+    __global float* C)
+{
+    mmul_elem(N, N, N, A, B, C);
+}
+
+__kernel void mmul_mnk(
+    const int M,
+    const int N,
+    const int K,
+    __global float* A,
+    __global float* B,
+    __global float* C)
+{
+    mmul_elem(SIZE_M, SIZE_N, SIZE_K, A, B, C);
+}
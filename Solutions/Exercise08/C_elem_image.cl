@@ -0,0 +1,72 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplication kernel, C(i,j) per work-item,
+//           reading A and B as images
+//
+//  PURPOSE: Computes an element of the product matrix
+//
+//              C = A * B
+//
+//           as C_elem.cl does, but with A and B in images
+//           (CL_R, CL_FLOAT) rather than buffers, so the reads go
+//           through the texture cache.  In C_elem.cl each
+//           work-item walks down a column of B, N floats apart,
+//           which an ordinary cache does not keep; the texture
+//           cache holds 2D neighbourhoods, so the work-items next
+//           to it in the other dimension find the same texels.
+//
+//           The sampler clamps to the border, so reads past the
+//           edge of a matrix give zero: the unrolled loop runs a
+//           whole number of UNROLLs past K with no tail.
+//
+//  USAGE:   -D UNROLL=n sets the unrolling, as for C_elem.cl.  A
+//           is an image K wide and M high and B one N wide and K
+//           high; enqueueVariant (variants.cpp) copies them in
+//           from the buffers before the kernel.
+//
+//-------------------------------------------------------------
+
+#ifndef UNROLL
+#define UNROLL 1
+#endif
+
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+__constant sampler_t matrix = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
+
+__kernel void mmul_mnk(
+    const int M,
+    const int N,
+    const int K,
+    __read_only image2d_t A,
+    __read_only image2d_t B,
+    __global float* C)
+{
+    int k, u;
+    int i = get_global_id(0);
+    int j = get_global_id(1);
+    float tmp;
+    if ((i < SIZE_M) && (j < SIZE_N))
+    {
+        tmp = 0.0f;
+        for (k = 0; k < SIZE_K; k += UNROLL) {
+            #pragma unroll
+            for (u = 0; u < UNROLL; u++)
+                tmp += read_imagef(A, matrix, (int2)(k+u, i)).x *
+                       read_imagef(B, matrix, (int2)(j, k+u)).x;
+        }
+        C[i*SIZE_N+j] = tmp;
+    }
+}
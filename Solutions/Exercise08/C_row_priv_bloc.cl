@@ -1,31 +1,95 @@
 
-__kernel void mmul(
+// The k loop is unrolled by a factor of UNROLL, which can be
+// set at build time (-D UNROLL=4) by the auto-tuner
+#ifndef UNROLL
+#define UNROLL 1
+#endif
+
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+// Length of the copy of a row of A held in private memory, and
+// of the column of B held in local memory.  Longer rows are
+// processed AWRK columns at a time, so Bwrk must hold
+// min(K, AWRK) floats.
+#ifndef AWRK
+#define AWRK 1024
+#endif
+
+// C(M,N) = A(M,K) * B(K,N), all stored by rows.  Every
+// work-item in the group must reach the barriers, so those past
+// the last row of C help load B but do not compute.
+void mmul_row_priv_bloc(
+    const int M,
     const int N,
+    const int K,
     __global float* A,
     __global float* B,
     __global float* C,
     __local float* Bwrk)
 {
-    int k, j;
+    int k, j, u, kb, kn;
     int i    = get_global_id(0);
     int iloc = get_local_id(0);
     int nloc = get_local_size(0);
-    float Awrk[1024];
+    float Awrk[AWRK];
     float tmp;
-    if (i < N) {
-        for (k = 0; k < N; k++)
-            Awrk[k] = A[i*N+k];
+    for (kb = 0; kb < K; kb += AWRK) {
+        kn = min(AWRK, K - kb);
+        if (i < M)
+            for (k = 0; k < kn; k++)
+                Awrk[k] = A[i*K+kb+k];
 
         for (j = 0; j < N; j++) {
             barrier(CLK_LOCAL_MEM_FENCE);
-            for (k = iloc; k < N; k += nloc)
-                Bwrk[k] = B[k*N+j];
+            for (k = iloc; k < kn; k += nloc)
+                Bwrk[k] = B[(kb+k)*N+j];
             barrier(CLK_LOCAL_MEM_FENCE);
-            tmp = 0.0f;
-            for (k = 0; k < N; k++)
-                tmp += Awrk[k] * Bwrk[k];
-            C[i*N+j] = tmp;
+            if (i < M) {
+                tmp = (kb == 0) ? 0.0f : C[i*N+j];
+                for (k = 0; k + UNROLL <= kn; k += UNROLL) {
+                    #pragma unroll
+                    for (u = 0; u < UNROLL; u++)
+                        tmp += Awrk[k+u] * Bwrk[k+u];
+                }
+                for (; k < kn; k++)
+                    tmp += Awrk[k] * Bwrk[k];
+                C[i*N+j] = tmp;
+            }
             barrier(CLK_LOCAL_MEM_FENCE);
         }
     }
 }
+
+__kernel void mmul(
+    const int N,
+    __global float* A,
+    __global float* B,
+    __global float* C,
+    __local float* Bwrk)
+{
+    mmul_row_priv_bloc(N, N, N, A, B, C, Bwrk);
+}
+
+__kernel void mmul_mnk(
+    const int M,
+    const int N,
+    const int K,
+    __global float* A,
+    __global float* B,
+    __global float* C,
+    __local float* Bwrk)
+{
+    mmul_row_priv_bloc(SIZE_M, SIZE_N, SIZE_K, A, B, C, Bwrk);
+}
@@ -0,0 +1,123 @@
+
+// The k loop is unrolled by a factor of UNROLL, which can be
+// set at build time (-D UNROLL=4) by the auto-tuner
+#ifndef UNROLL
+#define UNROLL 1
+#endif
+
+// The sizes of mmul_mnk are its arguments, unless they are built in
+// for one shape (-D SIZE_M=1024 -D SIZE_N=1024 -D SIZE_K=1024), when
+// the loop bounds and index arithmetic are constants the compiler
+// can unroll and strength-reduce
+#ifndef SIZE_M
+#define SIZE_M M
+#endif
+#ifndef SIZE_N
+#define SIZE_N N
+#endif
+#ifndef SIZE_K
+#define SIZE_K K
+#endif
+
+// Length of the copy of a row of A held in private memory, and
+// of each column of the panel of B held in local memory.
+// Longer rows are processed AWRK columns at a time.
+#ifndef AWRK
+#define AWRK 1024
+#endif
+
+// Columns of B in a panel.  Bwrk must hold NCOL * min(K, AWRK)
+// floats.
+#ifndef NCOL
+#define NCOL 4
+#endif
+
+// C(M,N) = A(M,K) * B(K,N), all stored by rows.
+//
+// As C_row_priv_bloc.cl, but B is staged NCOL columns at a time:
+// each work-item computes NCOL elements of its row of C per
+// panel, so a work-group has 2 barriers per NCOL columns of C
+// where C_row_priv_bloc.cl has 3 per column.  The panel is
+// loaded across its width first, so neighbouring work-items
+// read NCOL neighbouring floats of a row of B rather than one
+// float N apart, and is stored by columns in Bwrk for the dot
+// products.  Work-items past the last row of C help load B but
+// do not compute.
+void mmul_row_priv_panel(
+    const int M,
+    const int N,
+    const int K,
+    __global float* A,
+    __global float* B,
+    __global float* C,
+    __local float* Bwrk)
+{
+    int k, c, u, idx, kb, kn, j0, nc;
+    int i    = get_global_id(0);
+    int iloc = get_local_id(0);
+    int nloc = get_local_size(0);
+    float Awrk[AWRK];
+    float tmp[NCOL];
+    for (kb = 0; kb < K; kb += AWRK) {
+        kn = min(AWRK, K - kb);
+        if (i < M)
+            for (k = 0; k < kn; k++)
+                Awrk[k] = A[i*K+kb+k];
+
+        for (j0 = 0; j0 < N; j0 += NCOL) {
+            nc = min(NCOL, N - j0);
+
+            // Wait until the last panel is used, then load this one
+            barrier(CLK_LOCAL_MEM_FENCE);
+            for (idx = iloc; idx < kn*NCOL; idx += nloc) {
+                k = idx / NCOL;
+                c = idx % NCOL;
+                Bwrk[c*kn+k] = (c < nc) ? B[(kb+k)*N+j0+c] : 0.0f;
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            if (i < M) {
+                #pragma unroll
+                for (c = 0; c < NCOL; c++)
+                    tmp[c] = (kb == 0 || c >= nc) ? 0.0f : C[i*N+j0+c];
+                for (k = 0; k + UNROLL <= kn; k += UNROLL) {
+                    #pragma unroll
+                    for (u = 0; u < UNROLL; u++) {
+                        #pragma unroll
+                        for (c = 0; c < NCOL; c++)
+                            tmp[c] += Awrk[k+u] * Bwrk[c*kn+k+u];
+                    }
+                }
+                for (; k < kn; k++) {
+                    #pragma unroll
+                    for (c = 0; c < NCOL; c++)
+                        tmp[c] += Awrk[k] * Bwrk[c*kn+k];
+                }
+                for (c = 0; c < nc; c++)
+                    C[i*N+j0+c] = tmp[c];
+            }
+        }
+    }
+}
+
+__kernel void mmul(
+    const int N,
+    __global float* A,
+    __global float* B,
+    __global float* C,
+    __local float* Bwrk)
+{
+    mmul_row_priv_panel(N, N, N, A, B, C, Bwrk);
+}
+
+__kernel void mmul_mnk(
+    const int M,
+    const int N,
+    const int K,
+    __global float* A,
+    __global float* B,
+    __global float* C,
+    __local float* Bwrk)
+{
+    mmul_row_priv_panel(SIZE_M, SIZE_N, SIZE_K, A, B, C, Bwrk);
+}
@@ -0,0 +1,133 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Sparse matrix kernels (CSR and ELLPACK)
+//
+//  PURPOSE: y = A * x (SpMV) and C = A * B (SpMM) for a sparse
+//           A(rows,cols) and dense x, B(cols,N) and C(rows,N),
+//           so the work is proportional to the nonzeros of A
+//           rather than to rows * cols.  The formats are those of
+//           CsrMatrix and EllMatrix in matrix_lib.hpp.
+//
+//              spmv_csr          a work-item per row
+//              spmv_csr_vector   a work-group per row: its
+//                                work-items share the row's
+//                                nonzeros, so the loads of val
+//                                and col are coalesced, and the
+//                                partial sums are reduced in
+//                                local memory
+//              spmv_ell          a work-item per row; the ELLPACK
+//                                columns make the loads of
+//                                neighbouring rows coalesced
+//              spmm_csr          a work-item per element of C,
+//              spmm_ell          dimension 0 along a row of C, so
+//                                a work-group reads neighbouring
+//                                elements of each row of B it uses
+//
+//  USAGE:   spmv_csr_vector takes a work-group of a power of two
+//           work-items per row (ideally the SIMD width, so the
+//           group is one sub-group) and local memory of a float
+//           per work-item.  The others take any NDRange covering
+//           the rows (and columns of C).
+//
+//-------------------------------------------------------------
+
+__kernel void spmv_csr(
+    const int rows,
+    __global const int*   row_ptr,
+    __global const int*   col,
+    __global const float* val,
+    __global const float* x,
+    __global       float* y)
+{
+    int i = get_global_id(0);
+    if (i < rows) {
+        float tmp = 0.0f;
+        for (int p = row_ptr[i]; p < row_ptr[i+1]; p++)
+            tmp += val[p] * x[col[p]];
+        y[i] = tmp;
+    }
+}
+
+__kernel void spmv_csr_vector(
+    const int rows,
+    __global const int*   row_ptr,
+    __global const int*   col,
+    __global const float* val,
+    __global const float* x,
+    __global       float* y,
+    __local        float* partial)
+{
+    int i    = get_group_id(0);
+    int iloc = get_local_id(0);
+    int nloc = get_local_size(0);
+
+    float tmp = 0.0f;
+    if (i < rows)
+        for (int p = row_ptr[i] + iloc; p < row_ptr[i+1]; p += nloc)
+            tmp += val[p] * x[col[p]];
+    partial[iloc] = tmp;
+
+    for (int s = nloc / 2; s > 0; s /= 2) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (iloc < s)
+            partial[iloc] += partial[iloc + s];
+    }
+
+    if (iloc == 0 && i < rows)
+        y[i] = partial[0];
+}
+
+__kernel void spmv_ell(
+    const int rows,
+    const int width,
+    __global const int*   col,
+    __global const float* val,
+    __global const float* x,
+    __global       float* y)
+{
+    int i = get_global_id(0);
+    if (i < rows) {
+        float tmp = 0.0f;
+        for (int w = 0; w < width; w++)
+            tmp += val[w*rows+i] * x[col[w*rows+i]];
+        y[i] = tmp;
+    }
+}
+
+__kernel void spmm_csr(
+    const int rows,
+    const int N,
+    __global const int*   row_ptr,
+    __global const int*   col,
+    __global const float* val,
+    __global const float* B,
+    __global       float* C)
+{
+    int j = get_global_id(0);
+    int i = get_global_id(1);
+    if (i < rows && j < N) {
+        float tmp = 0.0f;
+        for (int p = row_ptr[i]; p < row_ptr[i+1]; p++)
+            tmp += val[p] * B[col[p]*N+j];
+        C[i*N+j] = tmp;
+    }
+}
+
+__kernel void spmm_ell(
+    const int rows,
+    const int N,
+    const int width,
+    __global const int*   col,
+    __global const float* val,
+    __global const float* B,
+    __global       float* C)
+{
+    int j = get_global_id(0);
+    int i = get_global_id(1);
+    if (i < rows && j < N) {
+        float tmp = 0.0f;
+        for (int w = 0; w < width; w++)
+            tmp += val[w*rows+i] * B[col[w*rows+i]*N+j];
+        C[i*N+j] = tmp;
+    }
+}
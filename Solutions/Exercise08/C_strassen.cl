@@ -0,0 +1,24 @@
+//-------------------------------------------------------------
+//
+//  PROGRAM: Matrix sums for the Strassen-Winograd recursion
+//
+//  PURPOSE: Z = X + beta * Y, element by element, over count
+//           floats: the additions (beta = 1) and subtractions
+//           (beta = -1) of quadrants in strassen.cpp.  Z may be
+//           X or Y, to update a temporary in place.
+//
+//  USAGE:   A 1D NDRange of at least count work-items
+//
+//-------------------------------------------------------------
+
+__kernel void mat_add(
+    const int count,
+    __global const float* X,
+    __global const float* Y,
+    __global       float* Z,
+    const float beta)
+{
+    int i = get_global_id(0);
+    if (i < count)
+        Z[i] = X[i] + beta * Y[i];
+}
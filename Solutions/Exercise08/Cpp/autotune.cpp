@@ -0,0 +1,162 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Auto-tuner for the matrix multiplication variants
+//
+//  PURPOSE: Sweep the tuning parameters (work-group sizes, tile sizes and
+//           unroll factors) of every kernel variant on the selected
+//           device, and keep the fastest correct configuration of each
+//           in the device's tuning file.  Later runs of the driver load
+//           the tuning file automatically.
+//
+//  USAGE:   ./mult --tune [--size M N K] [--device INDEX]
+//
+//           With a device profile (see Exercise01/Cpp/microbench), a
+//           configuration has to beat the best so far by more than the
+//           time of an empty kernel on the device, the smallest
+//           difference its timer can be trusted with; otherwise the
+//           first of two configurations that tie is kept.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+#include "device_profile.hpp"
+
+#define TUNE_REPS 3      // timed runs per configuration (best is kept)
+
+//------------------------------------------------------------------------------
+//
+//  Function to time one configuration on the device (the runtime's queue
+//  must have profiling enabled).  Returns the best run time in seconds, or
+//  a negative value if the configuration failed or gave the wrong answer.
+//
+//------------------------------------------------------------------------------
+static double timeConfig(util::Runtime& runtime, const Variant& variant,
+                         const util::TuningParams& params, int M, int N, int K,
+                         cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+                         HostMatrix& h_C)
+{
+    double best = -1.0;
+    cl::CommandQueue& queue = runtime.queue();
+
+    try
+    {
+        cl::Kernel& kernel = variantKernel(runtime, variant, params);
+
+        // Warm up, and check the answer
+        zero_mat(M, N, h_C);
+        cl::copy(queue, h_C.begin(), h_C.end(), d_c);
+        enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+        queue.finish();
+        cl::copy(queue, d_c, h_C.begin(), h_C.end());
+
+        float errsq = error(M, N, K, h_C);
+        if (std::isnan(errsq) || errsq > TOL)
+            return -1.0;
+
+        for (int r = 0; r < TUNE_REPS; r++)
+        {
+            cl::Event event = enqueueVariant(queue, kernel, variant, params,
+                                             M, N, K, d_a, d_b, d_c);
+            event.wait();
+            double run_time = util::eventSeconds(event);
+            if (best < 0.0 || run_time < best)
+                best = run_time;
+        }
+    }
+    catch (cl::Error)
+    {
+        // Invalid work-group sizes, out of resources, failed builds, ...
+        return -1.0;
+    }
+
+    return best;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to tune every variant and store the results
+//
+//------------------------------------------------------------------------------
+void autotune(util::Runtime& runtime, util::TuningFile& tuning,
+              int M, int N, int K, cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+              HostMatrix& h_C)
+{
+    util::DeviceProfile profile(runtime.device());
+    const double resolution = profile.get("kernel_min_us") * 1.0e-6;
+    if (resolution > 0.0)
+        printf("\n Differences under %.1f us are ties (from %s)\n",
+               resolution * 1.0e6, profile.path().c_str());
+
+    for (int v = 0; v < NUM_VARIANTS; v++)
+    {
+        const Variant& variant = variants[v];
+
+        printf("\n===== Tuning %s, %s ======\n", variant.name, sizeName(M, N, K).c_str());
+
+        // Walk the cartesian product of the candidate values like an odometer
+        int index[MAX_TUNE_PARAMS] = { 0 };
+        util::TuningParams best_params;
+        double best_time = -1.0;
+        int tried = 0;
+
+        while (true)
+        {
+            util::TuningParams params;
+            for (int p = 0; p < variant.nparams; p++)
+                params[variant.params[p].name] = variant.params[p].values[index[p]];
+
+            if (checkParams(variant, params, K, runtime.device()).empty())
+            {
+                double t = timeConfig(runtime, variant, params, M, N, K,
+                                      d_a, d_b, d_c, h_C);
+                tried++;
+                if (t >= 0.0)
+                {
+                    printf(" %-28s %9.6f seconds\n", util::formatParams(params).c_str(), t);
+                    if (best_time < 0.0 || t < best_time - resolution)
+                    {
+                        best_time = t;
+                        best_params = params;
+                    }
+                }
+                else
+                {
+                    printf(" %-28s failed\n", util::formatParams(params).c_str());
+                }
+            }
+
+            // Advance to the next configuration
+            int p = 0;
+            for (; p < variant.nparams; p++)
+            {
+                if (variant.params[p].values[++index[p]] != -1)
+                    break;
+                index[p] = 0;
+            }
+            if (p == variant.nparams)
+                break;
+        }
+
+        if (best_time < 0.0)
+        {
+            printf(" No working configuration out of %d tried\n", tried);
+            continue;
+        }
+
+        char note[96];
+        sprintf(note, "%f s at %s", best_time, sizeName(M, N, K).c_str());
+        tuning.set(variant.name, best_params, note);
+
+        printf(" Best: %s, %.6f seconds at %.1f MFLOPS\n",
+            util::formatParams(best_params).c_str(), best_time,
+            2.0 * M * N * K / (1000000.0f * best_time));
+    }
+
+    if (tuning.save())
+        printf("\nTuning parameters written to %s\n", tuning.path().c_str());
+    else
+        printf("\nCould not write tuning parameters to %s\n", tuning.path().c_str());
+}
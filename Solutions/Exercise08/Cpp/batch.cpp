@@ -0,0 +1,220 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Batched matrix multiplication
+//
+//  PURPOSE: Multiply many small matrices, C[b] = A[b] * B[b], with one
+//           kernel launch for the whole batch.  For matrices of order
+//           32 to 256 a launch per matrix costs about as much as the
+//           arithmetic, so the batch is folded into dimension 2 of the
+//           NDRange of the blocked kernel (C_block_form.cl).
+//
+//           The matrices of a batch all have the same size and live in
+//           one buffer per operand, either at a fixed stride
+//           (mmul_batched) or at arbitrary offsets given in a table
+//           (mmul_batched_offsets).
+//
+//  USAGE:   ./mult --batch COUNT [--size M N K]
+//
+//           Runs the batch as one launch per matrix, then as a single
+//           strided launch, then as a single launch through an offset
+//           table, and reports each.  The default size is order
+//           BATCH_ORDER.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to work out the NDRange for a batch with the blocked kernel
+//
+//------------------------------------------------------------------------------
+static void batchRange(const util::TuningParams& params, int M, int N, int batch,
+                       cl::NDRange& global, cl::NDRange& local)
+{
+    util::TuningParams::const_iterator p = params.find("blksz");
+    const int bs = p->second;
+
+    global = cl::NDRange(((N + bs - 1) / bs) * bs, ((M + bs - 1) / bs) * bs, batch);
+    local  = cl::NDRange(bs, bs, 1);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue a strided batch on the "mmul_batched" kernel
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueBatched(cl::CommandQueue& queue, cl::Kernel& kernel,
+                         const util::TuningParams& params, int M, int N, int K, int batch,
+                         cl::Buffer& d_a, int strideA, cl::Buffer& d_b, int strideB,
+                         cl::Buffer& d_c, int strideC)
+{
+    cl::NDRange global, local;
+    batchRange(params, M, N, batch, global, local);
+    const int bs = local[0];
+
+    kernel.setArg(0, M);
+    kernel.setArg(1, N);
+    kernel.setArg(2, K);
+    kernel.setArg(3, d_a);
+    kernel.setArg(4, strideA);
+    kernel.setArg(5, d_b);
+    kernel.setArg(6, strideB);
+    kernel.setArg(7, d_c);
+    kernel.setArg(8, strideC);
+    kernel.setArg(9, cl::Local(sizeof(float) * bs * bs));
+    kernel.setArg(10, cl::Local(sizeof(float) * bs * bs));
+
+    cl::Event event;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, NULL, &event);
+    return event;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue a batch on the "mmul_batched_offsets" kernel; the
+//  offset buffers hold one int (in floats) per matrix
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueBatchedOffsets(cl::CommandQueue& queue, cl::Kernel& kernel,
+                                const util::TuningParams& params, int M, int N, int K,
+                                int batch, cl::Buffer& d_a, cl::Buffer& d_offA,
+                                cl::Buffer& d_b, cl::Buffer& d_offB,
+                                cl::Buffer& d_c, cl::Buffer& d_offC)
+{
+    cl::NDRange global, local;
+    batchRange(params, M, N, batch, global, local);
+    const int bs = local[0];
+
+    kernel.setArg(0, M);
+    kernel.setArg(1, N);
+    kernel.setArg(2, K);
+    kernel.setArg(3, d_a);
+    kernel.setArg(4, d_offA);
+    kernel.setArg(5, d_b);
+    kernel.setArg(6, d_offB);
+    kernel.setArg(7, d_c);
+    kernel.setArg(8, d_offC);
+    kernel.setArg(9, cl::Local(sizeof(float) * bs * bs));
+    kernel.setArg(10, cl::Local(sizeof(float) * bs * bs));
+
+    cl::Event event;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, NULL, &event);
+    return event;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to compare a launch per matrix with the batched launches
+//
+//------------------------------------------------------------------------------
+void batched(const cl::Context& context, const cl::Device& device,
+             cl::CommandQueue& queue, const util::TuningFile& tuning,
+             int M, int N, int K, int batch)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    // The batch is stored as one tall matrix per operand, so the
+    // matrix_lib helpers can set up and check it as a whole: C is
+    // (batch*M) x N with every element equal to K*AVAL*BVAL
+    const int strideA = M * K, strideB = K * N, strideC = M * N;
+
+    util::PinnedAllocator<float> pinned(context, queue);
+    HostMatrix h_A(batch * strideA, 0.0f, pinned);
+    HostMatrix h_B(batch * strideB, 0.0f, pinned);
+    HostMatrix h_C(batch * strideC, 0.0f, pinned);
+    initmat(batch * M, N, K, h_A, h_B, h_C);
+
+    // initmat only fills the first B; the others are the same
+    std::fill(h_B.begin() + strideB, h_B.end(), (float)BVAL);
+
+    cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                   sizeof(float) * h_A.size(), &h_A[0]);
+    cl::Buffer d_b(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                   sizeof(float) * h_B.size(), &h_B[0]);
+    cl::Buffer d_c(context, CL_MEM_WRITE_ONLY, sizeof(float) * h_C.size());
+
+    cl::Program program = buildVariant(context, device, variant, params);
+    cl::Kernel strided(program, "mmul_batched");
+    cl::Kernel offsets(program, "mmul_batched_offsets");
+
+    util::Timer timer;
+    double run_time;
+
+    // One launch per matrix: the same kernel, with the global offset in
+    // dimension 2 picking the matrix
+    {
+        // Set the arguments (and warm up) with the first matrix
+        cl::NDRange global, local;
+        enqueueBatched(queue, strided, params, M, N, K, 1,
+                       d_a, strideA, d_b, strideB, d_c, strideC);
+        queue.finish();
+        batchRange(params, M, N, 1, global, local);
+
+        timer.reset();
+        for (int b = 0; b < batch; b++)
+            queue.enqueueNDRangeKernel(strided, cl::NDRange(0, 0, b), global, local);
+        queue.finish();
+        run_time = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * h_C.size(), &h_C[0]);
+        printf(" %-28s", "One launch per matrix");
+        results(batch * M, N, K, h_C, run_time);
+    }
+
+    // One launch, fixed strides
+    {
+        zero_mat(batch * M, N, h_C);
+        queue.enqueueWriteBuffer(d_c, CL_TRUE, 0, sizeof(float) * h_C.size(), &h_C[0]);
+
+        timer.reset();
+        enqueueBatched(queue, strided, params, M, N, K, batch,
+                       d_a, strideA, d_b, strideB, d_c, strideC);
+        queue.finish();
+        run_time = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * h_C.size(), &h_C[0]);
+        printf(" %-28s", "Batched, strided");
+        results(batch * M, N, K, h_C, run_time);
+    }
+
+    // One launch through an offset table.  The matrices are taken in
+    // reverse order, to show they need not be in sequence.
+    {
+        std::vector<int> h_offA(batch), h_offB(batch), h_offC(batch);
+        for (int b = 0; b < batch; b++)
+        {
+            h_offA[b] = (batch - 1 - b) * strideA;
+            h_offB[b] = (batch - 1 - b) * strideB;
+            h_offC[b] = b * strideC;
+        }
+        cl::Buffer d_offA(context, h_offA.begin(), h_offA.end(), true);
+        cl::Buffer d_offB(context, h_offB.begin(), h_offB.end(), true);
+        cl::Buffer d_offC(context, h_offC.begin(), h_offC.end(), true);
+
+        zero_mat(batch * M, N, h_C);
+        queue.enqueueWriteBuffer(d_c, CL_TRUE, 0, sizeof(float) * h_C.size(), &h_C[0]);
+
+        timer.reset();
+        enqueueBatchedOffsets(queue, offsets, params, M, N, K, batch,
+                              d_a, d_offA, d_b, d_offB, d_c, d_offC);
+        queue.finish();
+        run_time = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * h_C.size(), &h_C[0]);
+        printf(" %-28s", "Batched, offset table");
+        results(batch * M, N, K, h_C, run_time);
+    }
+}
@@ -0,0 +1,314 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Benchmark mode for the matrix multiplication variants
+//
+//  PURPOSE: Time every kernel variant over many repetitions, so the
+//           numbers are steady enough to compare between devices and
+//           driver versions.  Each variant gets some untimed warm-up
+//           runs, its answer is checked, and then it is timed on the
+//           device (event profiling) REPS times.  The minimum, 10th
+//           percentile, median, 90th percentile and maximum are
+//           reported, with GFLOP/s worked out from the median.
+//
+//  USAGE:   ./mult --bench [--sweep] [--size M N K] [--reps R]
+//                  [--warmup W] [--bench-out FILE] [--no-verify]
+//
+//           --sweep runs the square orders 256, 512, ... 8192 instead
+//           of the single size.  --bench-out writes one row per variant
+//           and size as CSV, or as JSON if FILE ends in .json.
+//           --no-verify skips reading C back and checking it, which at
+//           the largest orders takes longer than the timed runs.
+//
+//           --save-baseline stores every timed run of each variant and
+//           size as the device's baseline (perf_baseline.hpp), and
+//           --check-baseline compares this run with it: a variant whose
+//           median is more than --threshold PCT (default 5) slower, and
+//           whose times a rank test finds larger, fails the check, and
+//           the program exits non-zero.  Run with the same --reps and
+//           sizes as the baseline, on a quiet machine, after a driver
+//           update or a kernel change.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+#include "perf_baseline.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// One line of the benchmark results
+struct BenchResult
+{
+    std::string variant;
+    std::string params;
+    int         M, N, K;
+    int         reps;
+    double      min, p10, median, p90, max;   // seconds
+    double      gflops;                        // at the median
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the p'th percentile of sorted times (nearest rank)
+//
+//------------------------------------------------------------------------------
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    int rank = (int)ceil(p / 100.0 * sorted.size()) - 1;
+    rank = std::max(0, std::min(rank, (int)sorted.size() - 1));
+    return sorted[rank];
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to write the results as CSV, or JSON for a .json file
+//
+//------------------------------------------------------------------------------
+static bool writeResults(const std::string& path, const std::string& device,
+                         const std::string& driver,
+                         const std::vector<BenchResult>& results)
+{
+    std::ofstream out(path.c_str());
+    if (!out.is_open())
+        return false;
+
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    out.precision(6);
+
+    if (json)
+        out << "{\n  \"device\": \"" << device << "\",\n  \"driver\": \"" << driver
+            << "\",\n  \"results\": [\n";
+    else
+        out << "device,driver,variant,params,M,N,K,reps,"
+               "min_s,p10_s,median_s,p90_s,max_s,gflops\n";
+
+    for (std::vector<BenchResult>::size_type i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        if (json)
+            out << "    { \"variant\": \"" << r.variant << "\", \"params\": \"" << r.params
+                << "\", \"M\": " << r.M << ", \"N\": " << r.N << ", \"K\": " << r.K
+                << ", \"reps\": " << r.reps
+                << ", \"min_s\": " << r.min << ", \"p10_s\": " << r.p10
+                << ", \"median_s\": " << r.median << ", \"p90_s\": " << r.p90
+                << ", \"max_s\": " << r.max << ", \"gflops\": " << r.gflops << " }"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        else
+            out << "\"" << device << "\",\"" << driver << "\"," << r.variant << ",\""
+                << r.params << "\"," << r.M << "," << r.N << "," << r.K << "," << r.reps
+                << "," << r.min << "," << r.p10 << "," << r.median << "," << r.p90
+                << "," << r.max << "," << r.gflops << "\n";
+    }
+
+    if (json)
+        out << "  ]\n}\n";
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to name a variant at a size in the baseline
+//
+//------------------------------------------------------------------------------
+static std::string baselineKey(const char *variant, int M, int N, int K)
+{
+    std::ostringstream key;
+    key << "matmul/" << variant << "/" << M << "x" << N << "x" << K;
+    return key.str();
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to give the buffers of one size that were acquired back to
+//  the pool
+//
+//------------------------------------------------------------------------------
+static void releaseBuffers(util::BufferPool& pool, cl::Buffer& d_a, cl::Buffer& d_b,
+                           cl::Buffer& d_c)
+{
+    if (d_a())
+        pool.release(d_a);
+    if (d_b())
+        pool.release(d_b);
+    if (d_c())
+        pool.release(d_c);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to benchmark every variant at each size
+//
+//------------------------------------------------------------------------------
+int benchmark(util::Runtime& runtime, const util::TuningFile& tuning,
+              const std::vector<MatrixSize>& sizes, int reps, int warmup,
+              const std::string& out_file, bool verify,
+              BaselineMode baseline_mode, double threshold)
+{
+    std::vector<BenchResult> all;
+    cl::Device& device = runtime.device();
+    util::BufferPool& pool = runtime.pool();
+    cl::CommandQueue& queue = runtime.queue();
+
+    util::PerfBaseline baseline(device);
+    int slower = 0, missing = 0, too_few = 0;
+    if (baseline_mode == BASELINE_CHECK)
+    {
+        if (!baseline.load())
+        {
+            printf("\nNo baseline to check against (%s): run with --save-baseline first\n",
+                   baseline.path().c_str());
+            return 1;
+        }
+        printf("\nChecking against %s (driver %s), failing slowdowns over %.0f%%\n",
+               baseline.path().c_str(), baseline.savedDriver().c_str(), 100.0 * threshold);
+    }
+
+    for (std::vector<MatrixSize>::size_type s = 0; s < sizes.size(); s++)
+    {
+        int M = sizes[s].M, N = sizes[s].N, K = sizes[s].K;
+
+        printf("\n===== Benchmark, %s, %d warm-up and %d timed runs ======\n",
+            sizeName(M, N, K).c_str(), warmup, reps);
+        printf(" %-14s %10s %10s %10s %10s %10s %9s\n",
+            "variant", "min(s)", "p10(s)", "median(s)", "p90(s)", "max(s)", "GFLOP/s");
+
+        HostMatrix h_A(M * K), h_B(K * N), h_C(M * N);
+        cl::Buffer d_a, d_b, d_c;
+
+        try
+        {
+            // From the pool, and given back after each size
+            initmat(M, N, K, h_A, h_B, h_C);
+            d_a = pool.acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+            d_b = pool.acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+            d_c = pool.acquire(sizeof(float) * M * N, CL_MEM_WRITE_ONLY);
+            cl::copy(queue, h_A.begin(), h_A.end(), d_a);
+            cl::copy(queue, h_B.begin(), h_B.end(), d_b);
+        }
+        catch (cl::Error)
+        {
+            printf(" Skipped: matrices do not fit on the device\n");
+            releaseBuffers(pool, d_a, d_b, d_c);
+            continue;
+        }
+
+        for (int v = 0; v < NUM_VARIANTS; v++)
+        {
+            const Variant& variant = variants[v];
+            util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+            std::string invalid = checkParams(variant, params, K, device);
+            if (!invalid.empty())
+            {
+                printf(" %-14s skipped: %s\n", variant.name, invalid.c_str());
+                continue;
+            }
+
+            std::vector<double> times;
+            try
+            {
+                cl::Kernel& kernel = variantKernel(runtime, variant, params);
+
+                // Warm up, and check the answer of the last warm-up run.
+                // C is cleared on the device, not copied from the host.
+                queue.enqueueFillBuffer(d_c, 0.0f, 0, sizeof(float) * M * N);
+                for (int w = 0; w < std::max(warmup, 1); w++)
+                    enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+
+                if (verify)
+                {
+                    cl::copy(queue, d_c, h_C.begin(), h_C.end());
+
+                    float errsq = error(M, N, K, h_C);
+                    if (std::isnan(errsq) || errsq > TOL)
+                    {
+                        printf(" %-14s wrong answer (error %f)\n", variant.name, errsq);
+                        continue;
+                    }
+                }
+
+                for (int r = 0; r < reps; r++)
+                {
+                    cl::Event event = enqueueVariant(queue, kernel, variant, params,
+                                                     M, N, K, d_a, d_b, d_c);
+                    event.wait();
+                    times.push_back(util::eventSeconds(event));
+                }
+            }
+            catch (cl::Error err)
+            {
+                printf(" %-14s failed: %s (%d)\n", variant.name, err.what(), err.err());
+                continue;
+            }
+
+            // The times in the order they ran, for the baseline
+            const std::string key = baselineKey(variant.name, M, N, K);
+            util::BaselineCheck check;
+            if (baseline_mode == BASELINE_CHECK)
+                check = baseline.compare(key, times, threshold);
+            else if (baseline_mode == BASELINE_SAVE)
+                baseline.set(key, times);
+
+            std::sort(times.begin(), times.end());
+
+            BenchResult r;
+            r.variant = variant.name;
+            r.params  = util::formatParams(params);
+            r.M = M; r.N = N; r.K = K;
+            r.reps    = reps;
+            r.min     = times.front();
+            r.p10     = percentile(times, 10.0);
+            r.median  = percentile(times, 50.0);
+            r.p90     = percentile(times, 90.0);
+            r.max     = times.back();
+            r.gflops  = 2.0 * M * N * K / (1.0e9 * r.median);
+            all.push_back(r);
+
+            printf(" %-14s %10.6f %10.6f %10.6f %10.6f %10.6f %9.2f\n", r.variant.c_str(),
+                r.min, r.p10, r.median, r.p90, r.max, r.gflops);
+
+            if (baseline_mode == BASELINE_CHECK)
+            {
+                printf(" %-14s %s\n", "", util::formatCheck(check).c_str());
+                slower += check.verdict == util::BASELINE_SLOWER;
+                missing += check.verdict == util::BASELINE_MISSING;
+                too_few += check.verdict == util::BASELINE_TOO_FEW;
+            }
+        }
+
+        releaseBuffers(pool, d_a, d_b, d_c);
+    }
+
+    pool.print();
+
+    if (baseline_mode == BASELINE_SAVE)
+    {
+        if (baseline.save())
+            printf("\nBaseline written to %s\n", baseline.path().c_str());
+        else
+            printf("\nCould not write the baseline to %s\n", baseline.path().c_str());
+    }
+    else if (baseline_mode == BASELINE_CHECK)
+    {
+        printf("\nBaseline check: %d slower", slower);
+        if (missing)
+            printf(", %d not in the baseline", missing);
+        if (too_few)
+            printf(", %d with too few runs to test", too_few);
+        printf("\n");
+    }
+
+    if (out_file.empty())
+        return slower;
+
+    if (writeResults(out_file, device.getInfo<CL_DEVICE_NAME>(),
+                     device.getInfo<CL_DRIVER_VERSION>(), all))
+        printf("\nBenchmark results written to %s\n", out_file.c_str());
+    else
+        printf("\nCould not write benchmark results to %s\n", out_file.c_str());
+    return slower;
+}
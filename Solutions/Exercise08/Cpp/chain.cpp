@@ -0,0 +1,292 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix chain multiplication
+//
+//  PURPOSE: Multiply a chain of matrices of different shapes,
+//
+//              P = A1 * A2 * ... * An,   Ai of dims[i-1] x dims[i]
+//
+//           in the order that does the fewest flops.  The product is
+//           the same whichever way the chain is parenthesised, but the
+//           work is not: with A1 10x1000, A2 1000x10 and A3 10x1000,
+//           (A1 A2) A3 takes 0.4 MFLOP and A1 (A2 A3) 40.  planChain
+//           finds the best order by dynamic programming over the
+//           sub-chains (the textbook O(n^3) algorithm).
+//
+//           Each product is one launch of the blocked kernel at its
+//           tuned block size.  The intermediates come from the
+//           runtime's buffer pool and go back as soon as the product
+//           that reads them is queued, so they never leave the device;
+//           everything is on one in-order queue, which keeps the stages
+//           in order with no waits on the host, as the chain of vadd
+//           kernels in Exercise04 does.  Only the final product is
+//           read back.
+//
+//  USAGE:   ./mult --chain D0,D1,...,Dn
+//
+//           multiplies n matrices, the i-th Di-1 x Di, in the planned
+//           order and left to right, and checks the result against the
+//           same order on the host.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+//------------------------------------------------------------------------------
+//
+//  Function to read the dimensions of a chain from "D0,D1,...,Dn"
+//
+//------------------------------------------------------------------------------
+bool parseChain(const char *spec, std::vector<int>& dims)
+{
+    dims.clear();
+    std::string part;
+    std::istringstream parts(spec);
+    while (std::getline(parts, part, ','))
+    {
+        int d = atoi(part.c_str());
+        if (d < 1)
+            return false;
+        dims.push_back(d);
+    }
+    return dims.size() >= 3;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Functions to plan the order of a chain: the cheapest, and left to right
+//
+//------------------------------------------------------------------------------
+static double productFlops(const std::vector<int>& dims, int i, int k, int j)
+{
+    // (Ai..Ak)(Ak+1..Aj) is dims[i] x dims[k+1] by dims[k+1] x dims[j+1]
+    return 2.0 * dims[i] * dims[k + 1] * dims[j + 1];
+}
+
+static std::string orderName(const ChainPlan& plan, int i, int j)
+{
+    if (i == j)
+    {
+        std::ostringstream name;
+        name << "A" << i + 1;
+        return name.str();
+    }
+    const int k = plan.split[i][j];
+    return "(" + orderName(plan, i, k) + " " + orderName(plan, k + 1, j) + ")";
+}
+
+ChainPlan planChain(const std::vector<int>& dims)
+{
+    const int n = dims.size() - 1;
+    ChainPlan plan;
+    plan.dims = dims;
+    plan.split.assign(n, std::vector<int>(n, 0));
+
+    // cost[i][j]: fewest flops for Ai..Aj, over sub-chains of length 2, 3, ...
+    std::vector<std::vector<double> > cost(n, std::vector<double>(n, 0.0));
+    for (int len = 2; len <= n; len++)
+    {
+        for (int i = 0; i + len - 1 < n; i++)
+        {
+            const int j = i + len - 1;
+            cost[i][j] = -1.0;
+            for (int k = i; k < j; k++)
+            {
+                double c = cost[i][k] + cost[k + 1][j] + productFlops(dims, i, k, j);
+                if (cost[i][j] < 0.0 || c < cost[i][j])
+                {
+                    cost[i][j] = c;
+                    plan.split[i][j] = k;
+                }
+            }
+        }
+    }
+
+    plan.flops = cost[0][n - 1];
+    plan.order = orderName(plan, 0, n - 1);
+    return plan;
+}
+
+ChainPlan leftToRight(const std::vector<int>& dims)
+{
+    const int n = dims.size() - 1;
+    ChainPlan plan;
+    plan.dims = dims;
+    plan.split.assign(n, std::vector<int>(n, 0));
+    plan.flops = 0.0;
+    for (int j = 1; j < n; j++)
+    {
+        plan.split[0][j] = j - 1;
+        plan.flops += productFlops(dims, 0, j - 1, j);
+    }
+    plan.order = orderName(plan, 0, n - 1);
+    return plan;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue the product of Ai..Aj, into out if it is given or
+//  else a buffer from the pool, which the caller releases
+//
+//------------------------------------------------------------------------------
+struct ChainRun
+{
+    util::Runtime           *runtime;
+    const Variant           *variant;
+    util::TuningParams       params;
+    cl::Kernel               mmul;
+    const ChainPlan         *plan;
+    std::vector<cl::Buffer> *mats;
+    cl::Event                last;
+};
+
+static cl::Buffer product(ChainRun& r, int i, int j, cl::Buffer* out)
+{
+    if (i == j)
+        return (*r.mats)[i];
+
+    const std::vector<int>& dims = r.plan->dims;
+    const int k = r.plan->split[i][j];
+    cl::Buffer left = product(r, i, k, NULL);
+    cl::Buffer right = product(r, k + 1, j, NULL);
+
+    util::BufferPool& pool = r.runtime->pool();
+    cl::Buffer result = out ? *out : pool.acquire(sizeof(float) * dims[i] * dims[j + 1]);
+    r.last = enqueueVariant(r.runtime->queue(), r.mmul, *r.variant, r.params,
+                            dims[i], dims[j + 1], dims[k + 1], left, right, result);
+
+    // The queue is in order, so the next user of a released buffer
+    // runs after this product
+    if (k > i)
+        pool.release(left);
+    if (j > k + 1)
+        pool.release(right);
+    return result;
+}
+
+cl::Event multiplyChain(util::Runtime& runtime, const util::TuningFile& tuning,
+                        const ChainPlan& plan, std::vector<cl::Buffer>& mats,
+                        cl::Buffer& result)
+{
+    ChainRun r;
+    r.runtime = &runtime;
+    r.variant = &findVariant(VARIANT_BLOCK);
+    r.params = tuning.get(r.variant->name, defaultParams(*r.variant));
+    r.mmul = variantKernel(runtime, *r.variant, r.params);
+    r.plan = &plan;
+    r.mats = &mats;
+
+    product(r, 0, (int)plan.dims.size() - 2, &result);
+    return r.last;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply the chain on the host in the planned order
+//
+//------------------------------------------------------------------------------
+static void hostProduct(const ChainPlan& plan, std::vector<HostMatrix>& mats,
+                        int i, int j, HostMatrix& out)
+{
+    if (i == j)
+    {
+        out = mats[i];
+        return;
+    }
+    const std::vector<int>& dims = plan.dims;
+    const int k = plan.split[i][j];
+    HostMatrix left, right;
+    hostProduct(plan, mats, i, k, left);
+    hostProduct(plan, mats, k + 1, j, right);
+    out.assign((long)dims[i] * dims[j + 1], 0.0f);
+    seq_mat_mul_tiled(dims[i], dims[j + 1], dims[k + 1], &left[0], &right[0], &out[0]);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to time a chain in the planned order and left to right
+//
+//------------------------------------------------------------------------------
+static double timeChain(util::Runtime& runtime, const util::TuningFile& tuning,
+                        const ChainPlan& plan, std::vector<cl::Buffer>& mats,
+                        cl::Buffer& result)
+{
+    // Once untimed, to build the kernel and fill the pool
+    multiplyChain(runtime, tuning, plan, mats, result);
+    runtime.queue().finish();
+
+    util::Timer timer;
+    multiplyChain(runtime, tuning, plan, mats, result);
+    runtime.queue().finish();
+    return static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+}
+
+void chain(util::Runtime& runtime, const util::TuningFile& tuning,
+           const std::vector<int>& dims)
+{
+    const cl::Device device = runtime.context().getInfo<CL_CONTEXT_DEVICES>()[0];
+    const int n = dims.size() - 1;
+
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    std::string invalid = checkParams(variant, tuning.get(variant.name, defaultParams(variant)),
+                                      dims[1], device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    // Entries of about 1/sqrt(rows), so every product stays near 1
+    util::BufferPool& pool = runtime.pool();
+    std::vector<HostMatrix> h_mats(n);
+    std::vector<cl::Buffer> d_mats(n);
+    for (int m = 0; m < n; m++)
+    {
+        const long count = (long)dims[m] * dims[m + 1];
+        const float scale = 1.0f / std::sqrt((float)dims[m]);
+        h_mats[m].resize(count);
+        for (long i = 0; i < count; i++)
+            h_mats[m][i] = scale * (float)((i * 7 + m) % 5 - 2);
+
+        d_mats[m] = pool.acquire(sizeof(float) * count, CL_MEM_READ_ONLY);
+        runtime.queue().enqueueWriteBuffer(d_mats[m], CL_TRUE, 0, sizeof(float) * count,
+                                           &h_mats[m][0]);
+    }
+
+    const long count = (long)dims[0] * dims[n];
+    cl::Buffer d_result = pool.acquire(sizeof(float) * count);
+    HostMatrix h_result(count), h_ref;
+
+    ChainPlan best = planChain(dims);
+    hostProduct(best, h_mats, 0, n - 1, h_ref);
+
+    const ChainPlan plans[] = { best, leftToRight(dims) };
+    const char *names[] = { "Planned", "Left to right" };
+    for (int p = 0; p < 2; p++)
+    {
+        double run_time = timeChain(runtime, tuning, plans[p], d_mats, d_result);
+        runtime.queue().enqueueReadBuffer(d_result, CL_TRUE, 0, sizeof(float) * count,
+                                          &h_result[0]);
+
+        float err = 0.0f, largest = 0.0f;
+        for (long i = 0; i < count; i++)
+        {
+            err = std::max(err, std::fabs(h_result[i] - h_ref[i]));
+            largest = std::max(largest, std::fabs(h_ref[i]));
+        }
+
+        printf(" %-14s %s\n", names[p], plans[p].order.c_str());
+        printf("   %.1f MFLOP in %.4f seconds at %.1f MFLOPS, error %g\n", plans[p].flops / 1.0e6,
+               run_time, plans[p].flops / (1.0e6 * run_time),
+               largest > 0.0f ? err / largest : err);
+    }
+
+    for (int m = 0; m < n; m++)
+        pool.release(d_mats[m]);
+    pool.release(d_result);
+}
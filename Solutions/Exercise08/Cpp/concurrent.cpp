@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Concurrent matrix multiplication variants
+//
+//  PURPOSE: Run the kernel variants at the same time, each on a queue of
+//           its own writing a C of its own, so a device with room for
+//           more than one kernel can overlap them.  Each variant is
+//           first run alone on its queue, then all are enqueued together
+//           and the queues flushed before any is waited on.
+//
+//  USAGE:   ./mult --concurrent [--size M N K]
+//
+//           Every time is from the device events of one variant's own
+//           queue, so it belongs to that kernel alone; run together a
+//           kernel's time includes the device it shared.  The span is
+//           from the first start to the last end of the concurrent run:
+//           less than the sum of the times alone means the kernels
+//           overlapped.  Each answer is checked as usual.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+// One variant's share of the concurrent run
+struct Concurrent
+{
+    const Variant*      variant;
+    util::TuningParams  params;
+    cl::Kernel*         kernel;
+    cl::CommandQueue    queue;
+    cl::Buffer          d_c;
+    cl::Event           event;
+    double              alone;
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the variants one at a time, then all together
+//
+//------------------------------------------------------------------------------
+void concurrent(util::Runtime& runtime, const util::TuningFile& tuning,
+                int M, int N, int K)
+{
+    cl::Context& context = runtime.context();
+    cl::Device& device = runtime.device();
+    util::BufferPool& pool = runtime.pool();
+
+    HostMatrix h_A(M * K), h_B(K * N), h_C(M * N);
+    initmat(M, N, K, h_A, h_B, h_C);
+    cl::Buffer d_a = pool.acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+    cl::Buffer d_b = pool.acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+    cl::copy(runtime.queue(), h_A.begin(), h_A.end(), d_a);
+    cl::copy(runtime.queue(), h_B.begin(), h_B.end(), d_b);
+
+    // A queue and a C for each variant that can run; the kernels are
+    // all built first, so none of the runs waits on a build
+    std::vector<Concurrent> runs;
+    for (int v = 0; v < NUM_VARIANTS; v++)
+    {
+        Concurrent run;
+        run.variant = &variants[v];
+        run.params = tuning.get(run.variant->name, defaultParams(*run.variant));
+
+        std::string invalid = checkParams(*run.variant, run.params, K, device);
+        if (!invalid.empty())
+        {
+            printf(" %-14s skipped: %s\n", run.variant->name, invalid.c_str());
+            continue;
+        }
+
+        run.kernel = &variantKernel(runtime, *run.variant, run.params);
+        run.queue = util::createProfilingQueue(context, device);
+        run.d_c = pool.acquire(sizeof(float) * M * N, CL_MEM_READ_WRITE);
+        runs.push_back(run);
+    }
+
+    printf(" %-14s %12s %12s\n", "variant", "alone(s)", "together(s)");
+
+    // One at a time: each waits for the one before
+    double sum = 0.0;
+    for (unsigned r = 0; r < runs.size(); r++)
+    {
+        Concurrent& run = runs[r];
+        for (int rep = 0; rep < 2; rep++)     // the first is a warm up
+            run.event = enqueueVariant(run.queue, *run.kernel, *run.variant, run.params,
+                                       M, N, K, d_a, d_b, run.d_c);
+        run.event.wait();
+        run.alone = util::eventSeconds(run.event);
+        sum += run.alone;
+    }
+
+    // All together: enqueue everything, flush, and only then wait
+    for (unsigned r = 0; r < runs.size(); r++)
+    {
+        Concurrent& run = runs[r];
+        run.event = enqueueVariant(run.queue, *run.kernel, *run.variant, run.params,
+                                   M, N, K, d_a, d_b, run.d_c);
+        run.queue.flush();
+    }
+
+    cl_ulong first = 0, last = 0;
+    for (unsigned r = 0; r < runs.size(); r++)
+    {
+        Concurrent& run = runs[r];
+        run.event.wait();
+
+        cl_ulong start = run.event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        cl_ulong end   = run.event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+        first = r ? std::min(first, start) : start;
+        last  = r ? std::max(last, end) : end;
+
+        printf(" %-14s %12.6f %12.6f", run.variant->name, run.alone, util::eventSeconds(run.event));
+
+        cl::copy(run.queue, run.d_c, h_C.begin(), h_C.end());
+        float errsq = error(M, N, K, h_C);
+        if (std::isnan(errsq) || errsq > TOL)
+            printf("   wrong answer (error %f)", errsq);
+        printf("\n");
+    }
+
+    if (!runs.empty())
+    {
+        const double span = (last - first) * 1.0e-9;
+        printf("\n Alone, one after another: %.6f seconds\n", sum);
+        printf(" Together, first start to last end: %.6f seconds (%.2fx)\n", span, sum / span);
+    }
+
+    for (unsigned r = 0; r < runs.size(); r++)
+        pool.release(runs[r].d_c);
+    pool.release(d_a);
+    pool.release(d_b);
+}
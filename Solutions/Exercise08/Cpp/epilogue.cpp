@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplication with a fused epilogue
+//
+//  PURPOSE: C = relu(alpha * A * B + beta * C + bias), with the scale,
+//           accumulation, bias and activation applied by the blocked
+//           kernel (C_block_form.cl) in registers before its one store
+//           of C, compared with the product followed by a pass of its
+//           own over C (epilogue_pass), which reads and writes C again.
+//
+//  USAGE:   ./mult --epilogue SPEC [--size M N K]
+//
+//           SPEC is a comma separated list of the parts to apply, from
+//           alpha=VALUE, beta=VALUE, bias and relu; for example
+//           "alpha=2,beta=0.5,bias,relu".  Each part is compiled in with
+//           its -D EPI_ option, so those not asked for cost nothing.  The
+//           old C, and the bias (one value per column), hold small
+//           values of both signs so that relu has something to clamp;
+//           the results are checked on the host.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "program_cache.hpp"
+#include "profiler.hpp"
+
+#include <cstring>
+#include <sstream>
+
+//------------------------------------------------------------------------------
+//
+//  Function to read an epilogue from its SPEC.  Returns false if a part
+//  is not known.
+//
+//------------------------------------------------------------------------------
+bool parseEpilogue(const char *spec, Epilogue& epi)
+{
+    epi.alpha = epi.beta = epi.bias = epi.relu = false;
+    epi.alpha_value = 1.0f;
+    epi.beta_value = 0.0f;
+
+    std::string part;
+    std::istringstream parts(spec);
+    while (std::getline(parts, part, ','))
+    {
+        if (!part.compare(0, 6, "alpha="))
+        {
+            epi.alpha = true;
+            epi.alpha_value = atof(part.c_str() + 6);
+        }
+        else if (!part.compare(0, 5, "beta="))
+        {
+            epi.beta = true;
+            epi.beta_value = atof(part.c_str() + 5);
+        }
+        else if (part == "bias")
+            epi.bias = true;
+        else if (part == "relu")
+            epi.relu = true;
+        else
+            return false;
+    }
+    return epi.alpha || epi.beta || epi.bias || epi.relu;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to give the build options that compile an epilogue in
+//
+//------------------------------------------------------------------------------
+std::string epilogueOptions(const Epilogue& epi)
+{
+    std::string options;
+    if (epi.alpha)
+        options += " -D EPI_ALPHA";
+    if (epi.beta)
+        options += " -D EPI_BETA";
+    if (epi.bias)
+        options += " -D EPI_BIAS";
+    if (epi.relu)
+        options += " -D EPI_RELU";
+    return options;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to set the epilogue arguments of a kernel, from first on
+//
+//------------------------------------------------------------------------------
+static void setEpilogueArgs(cl::Kernel& kernel, int first, const Epilogue& epi, cl::Buffer& d_bias)
+{
+    kernel.setArg(first, epi.alpha_value);
+    kernel.setArg(first + 1, epi.beta_value);
+    kernel.setArg(first + 2, d_bias);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the largest difference from the reference, relative
+//  to its largest element
+//
+//------------------------------------------------------------------------------
+static float relError(HostMatrix& C, HostMatrix& ref)
+{
+    float err = 0.0f, largest = 0.0f;
+    for (size_t i = 0; i < C.size(); i++)
+    {
+        err = std::max(err, std::fabs(C[i] - ref[i]));
+        largest = std::max(largest, std::fabs(ref[i]));
+    }
+    return largest > 0.0f ? err / largest : err;
+}
+
+static void report(const char *how, int M, int N, int K, double run_time, float err)
+{
+    printf(" %-28s %.6f seconds at %.1f MFLOPS", how, run_time,
+           2.0 * M * N * K / (1000000.0 * run_time));
+    if (std::isnan(err) || err > TOL)
+        printf(", errors: %g", err);
+    printf("\n");
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the fused and the separate epilogue
+//
+//------------------------------------------------------------------------------
+void fusedEpilogue(const cl::Context& context, const cl::Device& device,
+                   cl::CommandQueue& queue, const util::TuningFile& tuning,
+                   int M, int N, int K, const Epilogue& epi)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    util::PinnedAllocator<float> pinned(context, queue);
+    HostMatrix h_A(M * K, 0.0f, pinned);
+    HostMatrix h_B(K * N, 0.0f, pinned);
+    HostMatrix h_C(M * N, 0.0f, pinned);
+    HostMatrix h_C0(M * N, 0.0f, pinned), h_ref(M * N, 0.0f, pinned);
+    initmat(M, N, K, h_A, h_B, h_C);
+
+    // The old C and the bias, of either sign and about the size of the
+    // product, so relu clamps some of the results
+    const float product = K * AVAL * BVAL;
+    std::vector<float> h_bias(N);
+    for (int i = 0; i < M * N; i++)
+        h_C0[i] = product * (float)(i % 7 - 3);
+    for (int j = 0; j < N; j++)
+        h_bias[j] = product * (float)(j % 5 - 2);
+
+    for (int i = 0; i < M; i++)
+    {
+        for (int j = 0; j < N; j++)
+        {
+            float c = product;
+            if (epi.alpha)
+                c *= epi.alpha_value;
+            if (epi.beta)
+                c += epi.beta_value * h_C0[i*N+j];
+            if (epi.bias)
+                c += h_bias[j];
+            if (epi.relu)
+                c = std::max(c, 0.0f);
+            h_ref[i*N+j] = c;
+        }
+    }
+
+    cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * M * K, &h_A[0]);
+    cl::Buffer d_b(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * K * N, &h_B[0]);
+    cl::Buffer d_c(context, CL_MEM_READ_WRITE, sizeof(float) * M * N);
+    cl::Buffer d_p(context, CL_MEM_READ_WRITE, sizeof(float) * M * N);
+    cl::Buffer d_bias(context, h_bias.begin(), h_bias.end(), true);
+
+    cl::Program plain = buildVariant(context, device, variant, params);
+    cl::Program fused = util::buildProgramFile(context, device, variant.file,
+                                               variantOptions(variant, params) + epilogueOptions(epi));
+    cl::Kernel mmul(plain, "mmul_mnk");
+    cl::Kernel mmul_epi(fused, "mmul_mnk");
+    cl::Kernel pass(fused, "epilogue_pass");
+
+    const int bs = params["blksz"];
+    const cl::NDRange global(((N + bs - 1) / bs) * bs, ((M + bs - 1) / bs) * bs);
+    const cl::NDRange local(bs, bs);
+
+    // Fused: the product and the epilogue in one kernel.  The extra
+    // arguments come after those enqueueVariant sets.
+    double fused_time = 0.0;
+    for (int rep = 0; rep < 2; rep++)     // the first is a warm up
+    {
+        queue.enqueueWriteBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C0[0]);
+        setEpilogueArgs(mmul_epi, 8, epi, d_bias);
+        cl::Event event = enqueueVariant(queue, mmul_epi, variant, params, M, N, K, d_a, d_b, d_c);
+        event.wait();
+        fused_time = util::eventSeconds(event);
+    }
+    queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    report("Fused epilogue", M, N, K, fused_time, relError(h_C, h_ref));
+
+    // Separate: the plain product into a temporary, then a pass over C
+    double separate_time = 0.0;
+    for (int rep = 0; rep < 2; rep++)
+    {
+        queue.enqueueWriteBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C0[0]);
+        cl::Event product_event = enqueueVariant(queue, mmul, variant, params, M, N, K, d_a, d_b, d_p);
+
+        pass.setArg(0, M);
+        pass.setArg(1, N);
+        pass.setArg(2, d_p);
+        pass.setArg(3, d_c);
+        setEpilogueArgs(pass, 4, epi, d_bias);
+        cl::Event pass_event;
+        queue.enqueueNDRangeKernel(pass, cl::NullRange, global, local, NULL, &pass_event);
+        pass_event.wait();
+        separate_time = util::eventSeconds(product_event) + util::eventSeconds(pass_event);
+    }
+    queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    report("Product, then epilogue pass", M, N, K, separate_time, relError(h_C, h_ref));
+}
@@ -0,0 +1,153 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplication shared between the host and the device
+//
+//  PURPOSE: Compute C = A * B with the device and the host's cores working
+//           at once on different rows of C: the device runs the blocked
+//           kernel on the first rows, and a host thread runs the tiled
+//           product (matrix_lib.cpp, threaded with OpenMP) on the rest.
+//           Neither waits for the other, so the host adds its throughput
+//           to the device's rather than idling while the kernel runs.
+//
+//           The split starts from the rates of a run of the whole
+//           product on the device and a panel of HYBRID_ROWS rows on the
+//           host.  After each of HYBRID_PASSES passes the device's share
+//           of the rows becomes its share of the throughput the pass
+//           measured, so the two should finish together.  Each side's
+//           time is from the start of the pass to its rows of C being on
+//           the host, the device's read of them included.  Both always
+//           keep HYBRID_ROWS rows, so a side that was slow in one pass
+//           is still measured in the next.
+//
+//  USAGE:   ./mult --hybrid [--size M N K]
+//
+//           A and B are on the device before the passes; only the
+//           device's rows of C come back each pass.  On a CPU device the
+//           two sides share the same cores and the split mostly measures
+//           that contention.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#define HYBRID_PASSES 6     // balanced passes after the starting split
+#define HYBRID_ROWS   64    // rows of C are split in multiples of this
+
+//------------------------------------------------------------------------------
+//
+//  Function to round the device's rows to a multiple of HYBRID_ROWS,
+//  leaving each side at least HYBRID_ROWS rows when M allows
+//
+//------------------------------------------------------------------------------
+static int deviceRows(int M, double share)
+{
+    if (M < 2 * HYBRID_ROWS)
+        return M;
+    int rows = (int)(share * M / HYBRID_ROWS + 0.5) * HYBRID_ROWS;
+    return std::max(HYBRID_ROWS, std::min(rows, (M - HYBRID_ROWS) / HYBRID_ROWS * HYBRID_ROWS));
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply with the rows of C split between host and device
+//
+//------------------------------------------------------------------------------
+void hybrid(util::Runtime& runtime, const util::TuningFile& tuning, int M, int N, int K,
+            HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C)
+{
+    cl::Device& device = runtime.device();
+    cl::CommandQueue& queue = runtime.queue();
+    util::BufferPool& pool = runtime.pool();
+
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" The %s kernel cannot run: %s\n", variant.name, invalid.c_str());
+        return;
+    }
+    cl::Kernel& kernel = variantKernel(runtime, variant, params);
+
+    if (device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)
+        printf(" The device is a CPU: the host and the device share its cores\n");
+
+    cl::Buffer d_a = pool.acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+    cl::Buffer d_b = pool.acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+    cl::Buffer d_c = pool.acquire(sizeof(float) * M * N, CL_MEM_WRITE_ONLY);
+    cl::copy(queue, h_A.begin(), h_A.end(), d_a);
+    cl::copy(queue, h_B.begin(), h_B.end(), d_b);
+
+    // The starting rates: the whole product on the device (after one run
+    // to warm up), and a panel on the host
+    util::Timer timer;
+    enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+    queue.finish();
+    timer.reset();
+    enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+    queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    const double device_alone = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+    const int probe = std::min(M, HYBRID_ROWS);
+    timer.reset();
+    seq_mat_mul_tiled(probe, N, K, &h_A[0], &h_B[0], &h_C[0]);
+    const double host_probe = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+    double device_rate = M / device_alone, host_rate = probe / host_probe;
+    printf(" Device alone: %.4f seconds (%.1f GFLOP/s); host: %.1f GFLOP/s on %d rows\n",
+        device_alone, 2.0e-9 * M * N * K / device_alone,
+        2.0e-9 * probe * N * K / host_probe, probe);
+
+    printf("\n %4s %12s %10s %12s %10s %10s %9s\n", "pass", "device rows", "device(s)",
+        "host rows", "host(s)", "span(s)", "GFLOP/s");
+
+    double span = 0.0;
+    for (int pass = 0; pass < HYBRID_PASSES; pass++)
+    {
+        const int rows = deviceRows(M, device_rate / (device_rate + host_rate));
+        const int host_rows = M - rows;
+
+        // The device's rows first, then the host's on a thread of their
+        // own while this one waits for the device
+        timer.reset();
+        enqueueVariant(queue, kernel, variant, params, rows, N, K, d_a, d_b, d_c);
+        queue.enqueueReadBuffer(d_c, CL_FALSE, 0, sizeof(float) * rows * N, &h_C[0]);
+        queue.flush();
+
+        double host_time = 0.0;
+        std::thread host([&]() {
+            util::Timer host_timer;
+            if (host_rows > 0)
+                seq_mat_mul_tiled(host_rows, N, K, &h_A[(size_t)rows * K], &h_B[0],
+                                  &h_C[(size_t)rows * N]);
+            host_time = static_cast<double>(host_timer.getTimeMicroseconds()) / 1.0e6;
+        });
+
+        queue.finish();
+        const double device_time = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+        host.join();
+        span = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        printf(" %4d %12d %10.4f %12d %10.4f %10.4f %9.1f\n", pass, rows, device_time,
+            host_rows, host_time, span, 2.0e-9 * M * N * K / span);
+
+        // Each side's throughput this pass sets the next split
+        if (rows > 0 && device_time > 0.0)
+            device_rate = rows / device_time;
+        if (host_rows > 0 && host_time > 0.0)
+            host_rate = host_rows / host_time;
+    }
+
+    pool.release(d_a);
+    pool.release(d_b);
+    pool.release(d_c);
+
+    printf("\n Host and device, last pass (%.2fx the device alone):", device_alone / span);
+    results(M, N, K, h_C, span);
+}
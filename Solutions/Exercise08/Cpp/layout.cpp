@@ -0,0 +1,228 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplication with transposed operands
+//
+//  PURPOSE: Multiply C = op(A) * op(B) where each operand may be stored
+//           transposed (the NN, NT, TN and TT layouts), without ever
+//           transposing on the host.  For each layout there are two ways:
+//
+//              direct      the layout-aware blocked kernel
+//                          (C_block_layout.cl) reads the operands as they
+//                          are stored, every load coalesced
+//              transpose   the transposed operands are transposed on the
+//                          device into scratch buffers, then the usual
+//                          NN blocked kernel (C_block_form.cl) runs
+//
+//           Both are timed from the device events and the faster is
+//           selected for the layout.  The direct way saves the extra pass
+//           over memory; the transpose can still win when the NN kernel
+//           is much better tuned, or when the operand is reused.
+//
+//  USAGE:   ./mult --layout [--size M N K]
+//
+//           The operands of each layout are made on the host with trans()
+//           (matrix_lib.cpp), standing for data that arrives that way.
+//           They are not constant, so that a wrong layout shows up as an
+//           error against the host product.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "program_cache.hpp"
+#include "profiler.hpp"
+
+#include <sstream>
+
+// The storage of the operands: for each, N (as is) or T (transposed)
+static const char *layoutNames[] = { "NN", "NT", "TN", "TT" };
+
+//------------------------------------------------------------------------------
+//
+//  Function to round a size up to whole blocks
+//
+//------------------------------------------------------------------------------
+static int roundBlocks(int n, int blksz)
+{
+    return ((n + blksz - 1) / blksz) * blksz;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue Y(cols,rows) = X(rows,cols) transposed with the
+//  "transpose" kernel of C_block_layout.cl
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueTranspose(cl::CommandQueue& queue, cl::Kernel& kernel, int blksz,
+                           int rows, int cols, cl::Buffer& d_x, cl::Buffer& d_y)
+{
+    kernel.setArg(0, rows);
+    kernel.setArg(1, cols);
+    kernel.setArg(2, d_x);
+    kernel.setArg(3, d_y);
+    kernel.setArg(4, cl::Local(sizeof(float) * blksz * (blksz + 1)));
+
+    cl::Event event;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                               cl::NDRange(roundBlocks(cols, blksz), roundBlocks(rows, blksz)),
+                               cl::NDRange(blksz, blksz), NULL, &event);
+    return event;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue C = op(A) * op(B) with the "mmul_mnk" kernel of
+//  C_block_layout.cl, built for the layout of the operands
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueLayout(cl::CommandQueue& queue, cl::Kernel& kernel, int blksz,
+                        int M, int N, int K,
+                        cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+                        const std::vector<cl::Event>* wait)
+{
+    kernel.setArg(0, M);
+    kernel.setArg(1, N);
+    kernel.setArg(2, K);
+    kernel.setArg(3, d_a);
+    kernel.setArg(4, d_b);
+    kernel.setArg(5, d_c);
+    kernel.setArg(6, cl::Local(sizeof(float) * blksz * (blksz + 1)));
+    kernel.setArg(7, cl::Local(sizeof(float) * blksz * (blksz + 1)));
+
+    cl::Event event;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                               cl::NDRange(roundBlocks(N, blksz), roundBlocks(M, blksz)),
+                               cl::NDRange(blksz, blksz), wait, &event);
+    return event;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the largest difference between C and the reference
+//
+//------------------------------------------------------------------------------
+static float maxDifference(HostMatrix& C, HostMatrix& ref)
+{
+    float diff = 0.0f;
+    for (size_t i = 0; i < C.size(); i++)
+        diff = std::max(diff, std::fabs(C[i] - ref[i]));
+    return diff;
+}
+
+static void report(const char *how, int M, int N, int K, double run_time,
+                   HostMatrix& C, HostMatrix& ref)
+{
+    printf("   %-10s %.4f seconds at %.1f MFLOPS", how, run_time,
+           2.0 * M * N * K / (1000000.0 * run_time));
+    float diff = maxDifference(C, ref);
+    if (std::isnan(diff) || diff > TOL)
+        printf(", errors in multiplication: %f", diff);
+    printf("\n");
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run each layout directly and through device transposes,
+//  and select the faster
+//
+//------------------------------------------------------------------------------
+void layouts(const cl::Context& context, const cl::Device& device,
+             cl::CommandQueue& queue, const util::TuningFile& tuning,
+             int M, int N, int K)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    const int blksz = params["blksz"];
+
+    // Small integers, so every product and sum is exact in float
+    util::PinnedAllocator<float> pinned(context, queue);
+    HostMatrix h_A(M * K, 0.0f, pinned), h_At(K * M, 0.0f, pinned);
+    HostMatrix h_B(K * N, 0.0f, pinned), h_Bt(N * K, 0.0f, pinned);
+    HostMatrix h_C(M * N, 0.0f, pinned), h_ref(M * N, 0.0f, pinned);
+    for (int i = 0; i < M * K; i++)
+        h_A[i] = (float)(i % 7 - 3);
+    for (int i = 0; i < K * N; i++)
+        h_B[i] = (float)(i % 5 - 2);
+    seq_mat_mul_tiled(M, N, K, h_A, h_B, h_ref);
+
+    trans(M, K, h_A, h_At);
+    trans(K, N, h_B, h_Bt);
+
+    cl::Buffer d_c(context, CL_MEM_WRITE_ONLY, sizeof(float) * M * N);
+    cl::Buffer d_as(context, CL_MEM_READ_WRITE, sizeof(float) * M * K);   // scratch
+    cl::Buffer d_bs(context, CL_MEM_READ_WRITE, sizeof(float) * K * N);
+
+    // The NN kernel, and the transpose, for the transpose way
+    cl::Program block = buildVariant(context, device, variant, params);
+    cl::Kernel nn(block, "mmul_mnk");
+
+    std::ostringstream options;
+    options << "-D blksz=" << blksz;
+    cl::Program layout = util::buildProgramFile(context, device, "../C_block_layout.cl",
+                                                options.str());
+    cl::Kernel transpose(layout, "transpose");
+
+    for (int l = 0; l < 4; l++)
+    {
+        const bool ta = (l & 2) != 0, tb = (l & 1) != 0;
+        HostMatrix& a = ta ? h_At : h_A;
+        HostMatrix& b = tb ? h_Bt : h_B;
+
+        printf("\n %s: A %s, B %s\n", layoutNames[l],
+               ta ? "stored K x M" : "M x K", tb ? "stored N x K" : "K x N");
+
+        cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       sizeof(float) * a.size(), &a[0]);
+        cl::Buffer d_b(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       sizeof(float) * b.size(), &b[0]);
+
+        // Direct: the kernel built for this layout
+        std::ostringstream direct_options;
+        direct_options << options.str() << " -D TRANS_A=" << ta << " -D TRANS_B=" << tb;
+        cl::Program program = util::buildProgramFile(context, device, "../C_block_layout.cl",
+                                                     direct_options.str());
+        cl::Kernel direct(program, "mmul_mnk");
+
+        enqueueLayout(queue, direct, blksz, M, N, K, d_a, d_b, d_c, NULL).wait();   // warm up
+        zero_mat(M, N, h_C);
+        cl::Event event = enqueueLayout(queue, direct, blksz, M, N, K, d_a, d_b, d_c, NULL);
+        event.wait();
+        double direct_time = util::eventSeconds(event);
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        report("direct", M, N, K, direct_time, h_C, h_ref);
+
+        // Transpose: back to NN on the device, then the NN kernel
+        double transpose_time = 0.0;
+        for (int rep = 0; rep < 2; rep++)   // the first is a warm up
+        {
+            std::vector<cl::Event> transposes;
+            if (ta)
+                transposes.push_back(enqueueTranspose(queue, transpose, blksz, K, M, d_a, d_as));
+            if (tb)
+                transposes.push_back(enqueueTranspose(queue, transpose, blksz, N, K, d_b, d_bs));
+
+            event = enqueueVariant(queue, nn, variant, params, M, N, K,
+                                   ta ? d_as : d_a, tb ? d_bs : d_b, d_c, &transposes);
+            event.wait();
+
+            transpose_time = util::eventSeconds(event);
+            for (size_t t = 0; t < transposes.size(); t++)
+                transpose_time += util::eventSeconds(transposes[t]);
+        }
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        report("transpose", M, N, K, transpose_time, h_C, h_ref);
+
+        printf("   Selected: %s\n", direct_time <= transpose_time ? "direct" : "transpose");
+    }
+}
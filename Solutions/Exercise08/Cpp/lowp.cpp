@@ -0,0 +1,165 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Reduced precision matrix multiplication
+//
+//  PURPOSE: Multiply with A and B stored in fewer bits, keeping the
+//           sums in fp32 (or int32), to see what halving or quartering
+//           the bytes moved buys over the float blocked kernel:
+//
+//              fp16   A and B stored as halfs (C_block_half.cl)
+//              int8   A and B quantized to signed 8 bit integers with
+//                     one scale each (C_block_int8.cl), summed as ints
+//                     and scaled back as C is stored
+//
+//           The conversions are made on the host (matrix_lib.cpp) and
+//           are not timed.  The int8 kernel uses the packed 4 x 8 bit
+//           dot product of cl_khr_integer_dot_product when the device
+//           has it and OpenCL C 3.0, and char4 arithmetic otherwise.
+//
+//  USAGE:   ./mult --lowp [--size M N K]
+//
+//           The block size is the tuned one of the float blocked
+//           kernel.  The error is checked as for the float kernels;
+//           with the constant matrices of initmat both conversions
+//           are exact, so a large error is a bug, not rounding.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "program_cache.hpp"
+
+#include <sstream>
+
+//------------------------------------------------------------------------------
+//
+//  Function to time one launch of a blocked kernel over C(M,N)
+//
+//------------------------------------------------------------------------------
+static double runBlocked(cl::CommandQueue& queue, cl::Kernel& kernel, int blksz, int M, int N)
+{
+    const int cols = ((N + blksz - 1) / blksz) * blksz;
+    const int rows = ((M + blksz - 1) / blksz) * blksz;
+
+    // Warm up, then time
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(cols, rows),
+                               cl::NDRange(blksz, blksz));
+    queue.finish();
+
+    util::Timer timer;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(cols, rows),
+                               cl::NDRange(blksz, blksz));
+    queue.finish();
+    return static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the fp16 and int8 kernels and report each
+//
+//------------------------------------------------------------------------------
+void lowPrecision(const cl::Context& context, const cl::Device& device,
+                  cl::CommandQueue& queue, const util::TuningFile& tuning,
+                  int M, int N, int K)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    const int blksz = params["blksz"];
+
+    std::ostringstream options;
+    options << "-D blksz=" << blksz;
+
+    util::PinnedAllocator<float> pinned(context, queue);
+    HostMatrix h_A(M * K, 0.0f, pinned);
+    HostMatrix h_B(K * N, 0.0f, pinned);
+    HostMatrix h_C(M * N, 0.0f, pinned);
+    initmat(M, N, K, h_A, h_B, h_C);
+
+    cl::Buffer d_c(context, CL_MEM_WRITE_ONLY, sizeof(float) * M * N);
+    double run_time;
+
+    // fp16 storage, fp32 sums
+    {
+        std::vector<cl_half> h_Ah, h_Bh;
+        toHalf(M, K, h_A, h_Ah);
+        toHalf(K, N, h_B, h_Bh);
+
+        cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       sizeof(cl_half) * h_Ah.size(), &h_Ah[0]);
+        cl::Buffer d_b(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       sizeof(cl_half) * h_Bh.size(), &h_Bh[0]);
+
+        cl::Program program = util::buildProgramFile(context, device, "../C_block_half.cl",
+                                                     options.str());
+        cl::Kernel kernel(program, "mmul_mnk");
+        kernel.setArg(0, M);
+        kernel.setArg(1, N);
+        kernel.setArg(2, K);
+        kernel.setArg(3, d_a);
+        kernel.setArg(4, d_b);
+        kernel.setArg(5, d_c);
+        kernel.setArg(6, cl::Local(sizeof(float) * blksz * blksz));
+        kernel.setArg(7, cl::Local(sizeof(float) * blksz * blksz));
+
+        run_time = runBlocked(queue, kernel, blksz, M, N);
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        printf(" %-28s", "fp16 storage, fp32 sums");
+        results(M, N, K, h_C, run_time);
+        printf(" %-28s A and B %.1f MB, float %.1f MB\n", "",
+               sizeof(cl_half) * (double)(M * K + K * N) * 1.0e-6,
+               sizeof(float) * (double)(M * K + K * N) * 1.0e-6);
+    }
+
+    // int8 storage, int32 sums
+    {
+        const int Kp = (K + 3) / 4;
+        std::vector<cl_char> h_Aq, h_Bq;
+        float scale = quantizeInt8(M, K, h_A, false, h_Aq)
+                    * quantizeInt8(K, N, h_B, true, h_Bq);
+
+        // Feature macros such as the packed dot product are only defined
+        // when building for OpenCL C 3.0
+        std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+        std::string c_version = device.getInfo<CL_DEVICE_OPENCL_C_VERSION>();
+        bool dot = extensions.find("cl_khr_integer_dot_product") != std::string::npos &&
+                   c_version.find("OpenCL C 3.") != std::string::npos;
+        std::string int_options = options.str() + (dot ? " -cl-std=CL3.0" : "");
+
+        cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       h_Aq.size(), &h_Aq[0]);
+        cl::Buffer d_b(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       h_Bq.size(), &h_Bq[0]);
+
+        cl::Program program = util::buildProgramFile(context, device, "../C_block_int8.cl",
+                                                     int_options);
+        cl::Kernel kernel(program, "mmul_mnk");
+        kernel.setArg(0, M);
+        kernel.setArg(1, N);
+        kernel.setArg(2, Kp);
+        kernel.setArg(3, d_a);
+        kernel.setArg(4, d_b);
+        kernel.setArg(5, d_c);
+        kernel.setArg(6, scale);
+        kernel.setArg(7, cl::Local(sizeof(cl_int) * blksz * blksz));
+        kernel.setArg(8, cl::Local(sizeof(cl_int) * blksz * blksz));
+
+        zero_mat(M, N, h_C);
+        run_time = runBlocked(queue, kernel, blksz, M, N);
+
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        printf(" %-28s", dot ? "int8, packed dot product" : "int8, char4 arithmetic");
+        results(M, N, K, h_C, run_time);
+        printf(" %-28s A and B %.1f MB, scale %g\n", "",
+               (double)(h_Aq.size() + h_Bq.size()) * 1.0e-6, scale);
+    }
+}
@@ -10,8 +10,119 @@
 //           A and B are set to constant matrices so we
 //           can make a quick test of the multiplication.
 //
-//  USAGE:   The matrices are constant matrices, square and the order is
-//           set as a constant, ORDER (see mult.h).
+//  USAGE:   The matrices are constant matrices, square by default with
+//           the order set as a constant, ORDER (see matmul.hpp).  Use
+//           --size M N K to multiply an M x K matrix A by a K x N
+//           matrix B instead; the kernels handle sizes that are not a
+//           multiple of their work-group or tile sizes.
+//
+//           The kernel variants are listed in variants.cpp.  Run with
+//           --tune to search for the best work-group sizes, tile sizes
+//           and unroll factors on the chosen device; the results are
+//           saved in a tuning file which later runs load automatically.
+//
+//           The OpenCL run times are measured on the device with event
+//           profiling.  A breakdown of every kernel and transfer (time
+//           queued, time waiting to start, and run time) is printed at
+//           the end; --profile FILE also writes it as CSV, or as JSON if
+//           FILE ends in .json.  Then each variant's GFLOP/s and GB/s
+//           against the peaks of the device, and whether it is memory or
+//           compute bound (see roofline.hpp), and what each kernel uses
+//           of the device (work-group, local and private memory) with
+//           an estimate of its occupancy, also printed under each
+//           variant's times (see kernel_report.hpp).  With
+//           OCL_TRACE=FILE the builds, buffers, enqueues and every
+//           profiled command are also written to FILE as a Chrome
+//           trace (see trace.hpp).  With OCL_WORKLOAD=FILE the sizes of
+//           the run are appended to FILE, for replay (see workload.hpp).
+//
+//           --bench replaces the single timed run with many repetitions
+//           of each variant and reports percentiles (see bench.cpp);
+//           --no-verify skips checking the answers first.
+//           --save-baseline stores the times as the device's baseline,
+//           and --check-baseline exits non-zero if a variant has become
+//           slower than it by more than --threshold PCT.  Both need
+//           --reps of at least BASELINE_MIN_RUNS (5) for the rank test
+//           (perf_baseline.hpp) to be able to find a change.
+//
+//           --multi splits the product by rows across every device on
+//           the chosen device's platform (see multidevice.cpp).
+//           --numa splits it instead across the NUMA nodes of the chosen
+//           device (a CPU on several sockets), each a sub-device with
+//           buffers of its own.
+//
+//           --pipeline streams A and C through the device in panels of
+//           rows, overlapping transfers with computation (see
+//           pipeline.cpp).
+//
+//           --out-of-core multiplies matrices larger than the device's
+//           memory a tile of C at a time (--tile T), streaming panels of
+//           A and B through the device (see outofcore.cpp).
+//
+//           --batch COUNT multiplies COUNT small matrices (order
+//           BATCH_ORDER unless --size is given) with one launch (see
+//           batch.cpp).
+//
+//           --lowp multiplies with A and B stored as fp16, then as int8,
+//           summing in fp32 / int32 (see lowp.cpp).
+//
+//           --layout multiplies with A and/or B stored transposed (NN,
+//           NT, TN, TT), directly and through device transposes (see
+//           layout.cpp).
+//
+//           --strassen multiplies with the Strassen-Winograd recursion
+//           down to a tuned crossover order (see strassen.cpp).
+//
+//           --chain D0,D1,...,Dn multiplies n matrices, the i-th of
+//           Di-1 x Di, in the order with the fewest flops, intermediates
+//           kept on the device, against left to right (see chain.cpp).
+//
+//           --sparse DENSITY multiplies a random A with that fraction
+//           nonzero in CSR and ELLPACK form (see sparse.cpp).
+//
+//           --epilogue SPEC applies C = relu(alpha*A*B + beta*C + bias),
+//           or the parts of it in SPEC, inside the blocked kernel and
+//           as a separate pass (see epilogue.cpp).
+//
+//           --concurrent runs the variants at the same time, each on a
+//           queue of its own (see concurrent.cpp).
+//
+//           --specialize times each variant built for the sizes of the
+//           run, with M, N and K compiled in, against the one taking
+//           them as arguments (see specialize.cpp).
+//
+//           --hybrid shares the rows of C between the device and the
+//           host's tiled product on a thread of its own, both at once,
+//           and moves rows to whichever side was faster in the last pass
+//           (see hybrid.cpp).
+//
+//           --serve JOBS submits JOBS multiplications from several host
+//           threads to a pool of threads with a queue and kernel each,
+//           --workers W of them (see serve.cpp).
+//
+//           --svm multiplies with A, B and C in OpenCL 2.0 shared virtual
+//           memory, with no buffers or copies, against the buffers (see
+//           svm.cpp); devices without SVM run the buffers alone.
+//
+//           --input-a FILE and --input-b FILE multiply the matrices in
+//           those files instead of the constant ones: .npy files of
+//           float32 (from numpy.save), or raw floats by rows with the
+//           shape from --size.  The files are mapped into memory (see
+//           mapped_matrix.hpp) and the buffers made over the mapped pages
+//           with CL_MEM_USE_HOST_PTR, so there is no copy on the host.
+//           The results are then checked against the tiled host product.
+//           --multi, --numa, --out-of-core, --hybrid and --pipeline copy
+//           the files' matrices into host memory and use them too; the
+//           other modes make matrices of their own, so refuse
+//           --input-a/-b.
+//
+//           The host CPU result uses a tiled, vectorised OpenMP
+//           multiplication; --host naive runs the original dot product
+//           loop, which is kept as the reference.  The programs of the
+//           variants (with their tuned parameters) are built on a worker
+//           thread while the host sets up and runs its multiplication,
+//           so the OpenCL C compiler is off the critical path (see
+//           util::Runtime::prebuild).
 //
 //  HISTORY: Written by Tim Mattson, August 2010 
 //           Modified by Simon McIntosh-Smith, September 2011
@@ -23,31 +134,71 @@
 
 #include "matmul.hpp"
 #include "matrix_lib.hpp"
+#include "variants.hpp"
 #include "util.hpp"
 #include "err_code.h"
 #include "device_picker.hpp"
+#include "program_cache.hpp"
+#include "profiler.hpp"
+#include "roofline.hpp"
+#include "kernel_report.hpp"
+#include "trace.hpp"
+#include "mapped_matrix.hpp"
+#include "sub_devices.hpp"
+#include "workload.hpp"
+#include "perf_baseline.hpp"
+
+//------------------------------------------------------------------------------
+//
+//  Function to set up A, B and C for a run mode that takes host matrices:
+//  copies of the mapped files, with their tiled host product as the
+//  reference, or the constant matrices when there are no files
+//
+//------------------------------------------------------------------------------
+static void setMatrices(int M, int N, int K, const util::MappedMatrix *in_a,
+                        const util::MappedMatrix *in_b, HostMatrix& h_A, HostMatrix& h_B,
+                        HostMatrix& h_C, HostMatrix& h_ref)
+{
+    h_A.resize((size_t)M * K);
+    h_B.resize((size_t)K * N);
+    h_C.resize((size_t)M * N);
+
+    if (in_a == NULL || in_b == NULL)
+    {
+        initmat(M, N, K, h_A, h_B, h_C);
+        return;
+    }
+
+    std::copy(in_a->data(), in_a->data() + (size_t)M * K, h_A.begin());
+    std::copy(in_b->data(), in_b->data() + (size_t)K * N, h_B.begin());
+    zero_mat(M, N, h_C);
+
+    h_ref.resize((size_t)M * N);
+    seq_mat_mul_tiled(M, N, K, &h_A[0], &h_B[0], &h_ref[0]);
+    useReference(&h_ref);
+}
 
 int main(int argc, char *argv[])
 {
 
-    int N;   // A[N][N], B[N][N], C[N][N]
-    int size;      // Number of elements in each matrix
+    int M, N, K;   // A[M][K], B[K][N], C[M][N]
 
 
     double start_time;      // Starting time
     double run_time;        // Timing data
     util::Timer timer;      // timing
 
-    N = ORDER;
-
-    size = N * N;
+    M = N = K = ORDER;
 
-    std::vector<float> h_A(size); // Host memory for Matrix A
-    std::vector<float> h_B(size); // Host memory for Matrix B
-    std::vector<float> h_C(size); // Host memory for Matrix C
+    HostMatrix h_A; // Host memory for Matrix A
+    HostMatrix h_B; // Host memory for Matrix B
+    HostMatrix h_C; // Host memory for Matrix C
+    HostMatrix h_ref;   // The host product, when A and B are from files
 
     cl::Buffer d_a, d_b, d_c;   // Matrices in device memory
 
+    util::MappedMatrix *in_a = NULL, *in_b = NULL;  // A and B from files
+
 //--------------------------------------------------------------------------------
 // Create a context and queue
 //--------------------------------------------------------------------------------
@@ -56,7 +207,274 @@ int main(int argc, char *argv[])
     {   
  
         cl_uint deviceIndex = 0;
-        parseArguments(argc, argv, &deviceIndex);
+        parseArguments(argc, argv, &deviceIndex,
+            "      --size       M N K   Multiply A(M,K) by B(K,N) (default: square)\n"
+            "      --tune               Tune the kernels for the device and save the parameters\n"
+            "      --profile    FILE    Write the device timings to FILE (.csv or .json)\n"
+            "      --bench              Time each variant many times and report percentiles\n"
+            "      --sweep              Benchmark square orders 256 to 8192\n"
+            "      --reps       R       Timed runs per variant when benchmarking (default 20)\n"
+            "      --warmup     W       Untimed runs per variant when benchmarking (default 2)\n"
+            "      --bench-out  FILE    Write the benchmark results to FILE (.csv or .json)\n"
+            "      --no-verify          Do not check the answers when benchmarking\n"
+            "      --save-baseline      Store the benchmark times as this device's baseline\n"
+            "      --check-baseline     Fail if the benchmark is slower than the baseline\n"
+            "      --threshold  PCT     Slowdown that fails the check (default 5)\n"
+            "      --multi              Split the product across all devices on the platform\n"
+            "      --numa               Split the product across the device's NUMA nodes\n"
+            "      --pipeline           Overlap transfers and computation, a panel of rows at a time\n"
+            "      --panel      ROWS    Rows of C per panel when pipelining (default 256)\n"
+            "      --out-of-core        Multiply a tile of C at a time, for matrices the device cannot hold\n"
+            "      --tile       T       Order of the tiles of C out of core (default: from the memory)\n"
+            "      --batch      COUNT   Multiply COUNT small matrices in one launch\n"
+            "      --lowp               Multiply with A and B stored as fp16, then int8\n"
+            "      --layout             Multiply with transposed operands (NN, NT, TN, TT)\n"
+            "      --strassen           Multiply with the Strassen-Winograd recursion\n"
+            "      --crossover  ORDER   Order below which Strassen uses the blocked kernel\n"
+            "      --chain      D0,...  Multiply a chain of D0xD1, D1xD2, ... matrices\n"
+            "      --sparse     DENSITY Multiply a sparse A (DENSITY nonzero) in CSR and ELLPACK\n"
+            "      --epilogue   SPEC    Fuse alpha=V,beta=V,bias,relu into the blocked kernel\n"
+            "      --concurrent         Run the variants at once, a queue and C each\n"
+            "      --specialize         Time the variants built for these sizes\n"
+            "      --hybrid             Share the rows of C between the host and the device\n"
+            "      --serve      JOBS    Submit JOBS multiplications from several host threads\n"
+            "      --workers    W       Executor threads when serving (default 4)\n"
+            "      --svm                Multiply in shared virtual memory, against buffers\n"
+            "      --input-a    FILE    Read A from a .npy or raw float32 file\n"
+            "      --input-b    FILE    Read B from a .npy or raw float32 file\n"
+            "      --host       NAME    Host multiplication: tiled (default) or naive\n");
+
+        bool tune = false;
+        bool bench = false, sweep = false, multi = false, numa = false, pipe = false, lowp = false;
+        bool verify = true;
+        bool layout = false, strassen_mode = false, together = false, specialized = false;
+        bool hybrid_mode = false;
+        bool svm = false;
+        int crossover = 0;
+        float density = 0.0f;
+        std::vector<int> chain_dims;
+        Epilogue epi;
+        bool fuse = false;
+        int panel = PIPE_PANEL;
+        bool ooc = false;
+        int tile = 0;
+        int batch = 0;
+        int serve_jobs = 0, workers = SERVE_WORKERS;
+        bool sized = false;
+        bool naive = false;
+        int reps = BENCH_REPS, warmup = BENCH_WARMUP;
+        std::string bench_file;
+        BaselineMode baseline_mode = BASELINE_OFF;
+        double threshold = BENCH_THRESHOLD;
+        std::string profile_file;
+        std::string input_a, input_b;
+        for (int i = 1; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--tune"))
+                tune = true;
+            else if (!strcmp(argv[i], "--input-a") && i + 1 < argc)
+                input_a = argv[++i];
+            else if (!strcmp(argv[i], "--input-b") && i + 1 < argc)
+                input_b = argv[++i];
+            else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+                profile_file = argv[++i];
+            else if (!strcmp(argv[i], "--bench"))
+                bench = true;
+            else if (!strcmp(argv[i], "--sweep"))
+                sweep = true;
+            else if (!strcmp(argv[i], "--no-verify"))
+                verify = false;
+            else if (!strcmp(argv[i], "--multi"))
+                multi = true;
+            else if (!strcmp(argv[i], "--numa"))
+                numa = true;
+            else if (!strcmp(argv[i], "--pipeline"))
+                pipe = true;
+            else if (!strcmp(argv[i], "--out-of-core"))
+                ooc = true;
+            else if (!strcmp(argv[i], "--tile"))
+            {
+                if (++i >= argc || (tile = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid tile order\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--lowp"))
+                lowp = true;
+            else if (!strcmp(argv[i], "--layout"))
+                layout = true;
+            else if (!strcmp(argv[i], "--strassen"))
+                strassen_mode = true;
+            else if (!strcmp(argv[i], "--concurrent"))
+                together = true;
+            else if (!strcmp(argv[i], "--specialize"))
+                specialized = true;
+            else if (!strcmp(argv[i], "--hybrid"))
+                hybrid_mode = true;
+            else if (!strcmp(argv[i], "--sparse"))
+            {
+                if (++i >= argc || (density = atof(argv[i])) <= 0.0f || density > 1.0f)
+                {
+                    std::cout << "Invalid density (between 0 and 1)\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--epilogue"))
+            {
+                if (++i >= argc || !parseEpilogue(argv[i], epi))
+                {
+                    std::cout << "Invalid epilogue (alpha=V,beta=V,bias,relu)\n";
+                    return EXIT_FAILURE;
+                }
+                fuse = true;
+            }
+            else if (!strcmp(argv[i], "--chain"))
+            {
+                if (++i >= argc || !parseChain(argv[i], chain_dims))
+                {
+                    std::cout << "Invalid chain (D0,D1,...,Dn: two matrices or more)\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--crossover"))
+            {
+                if (++i >= argc || (crossover = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid crossover order\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--batch"))
+            {
+                if (++i >= argc || (batch = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid batch size\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--host"))
+            {
+                if (++i >= argc || (strcmp(argv[i], "tiled") && strcmp(argv[i], "naive")))
+                {
+                    std::cout << "Invalid host multiplication (tiled or naive)\n";
+                    return EXIT_FAILURE;
+                }
+                naive = !strcmp(argv[i], "naive");
+            }
+            else if (!strcmp(argv[i], "--svm"))
+            {
+                svm = true;
+            }
+            else if (!strcmp(argv[i], "--serve"))
+            {
+                if (++i >= argc || (serve_jobs = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid number of jobs\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--workers"))
+            {
+                if (++i >= argc || (workers = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid number of executor threads\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--panel"))
+            {
+                if (++i >= argc || (panel = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid panel size\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--bench-out") && i + 1 < argc)
+                bench_file = argv[++i];
+            else if (!strcmp(argv[i], "--save-baseline"))
+                baseline_mode = BASELINE_SAVE;
+            else if (!strcmp(argv[i], "--check-baseline"))
+                baseline_mode = BASELINE_CHECK;
+            else if (!strcmp(argv[i], "--threshold"))
+            {
+                if (++i >= argc || (threshold = atof(argv[i]) / 100.0) <= 0.0)
+                {
+                    std::cout << "Invalid threshold (a percentage above 0)\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--reps"))
+            {
+                if (++i >= argc || (reps = atoi(argv[i])) < 1)
+                {
+                    std::cout << "Invalid number of repetitions\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--warmup"))
+            {
+                if (++i >= argc || (warmup = atoi(argv[i])) < 0)
+                {
+                    std::cout << "Invalid number of warm-up runs\n";
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[i], "--size"))
+            {
+                if (i + 3 >= argc ||
+                    (M = atoi(argv[i+1])) <= 0 ||
+                    (N = atoi(argv[i+2])) <= 0 ||
+                    (K = atoi(argv[i+3])) <= 0)
+                {
+                    std::cout << "Invalid matrix sizes (--size M N K)\n";
+                    return EXIT_FAILURE;
+                }
+                i += 3;
+                sized = true;
+            }
+        }
+
+        if (bench && baseline_mode != BASELINE_OFF && reps < BASELINE_MIN_RUNS)
+        {
+            std::cout << "A baseline needs --reps of " << BASELINE_MIN_RUNS << " or more\n";
+            return EXIT_FAILURE;
+        }
+
+        // Matrices from files: the shapes come from .npy headers, or
+        // from --size for raw files
+        const bool inputs = !input_a.empty() || !input_b.empty();
+        if (inputs)
+        {
+            if (input_a.empty() || input_b.empty())
+            {
+                std::cout << "Give both --input-a and --input-b\n";
+                return EXIT_FAILURE;
+            }
+            if (bench || strassen_mode || !chain_dims.empty() || density > 0.0f || fuse ||
+                together || specialized || serve_jobs > 0 || svm || batch > 0 || lowp || layout)
+            {
+                std::cout << "This mode makes its own matrices: --input-a and --input-b "
+                             "work only with the default run, --tune, --multi, --numa, "
+                             "--out-of-core, --hybrid and --pipeline\n";
+                return EXIT_FAILURE;
+            }
+            in_a = new util::MappedMatrix(input_a, sized ? M : 0, sized ? K : 0);
+            in_b = new util::MappedMatrix(input_b, sized ? K : 0, sized ? N : 0);
+            if (in_a->cols() != in_b->rows())
+            {
+                std::cout << "The columns of A (" << in_a->cols()
+                          << ") do not match the rows of B (" << in_b->rows() << ")\n";
+                delete in_a;
+                delete in_b;
+                return EXIT_FAILURE;
+            }
+            M = in_a->rows();
+            K = in_a->cols();
+            N = in_b->cols();
+            printf("\n A (%d x %d) from %s, B (%d x %d) from %s\n",
+                M, K, input_a.c_str(), K, N, input_b.c_str());
+        }
 
         // Get list of devices
         std::vector<cl::Device> devices;
@@ -75,231 +493,496 @@ int main(int argc, char *argv[])
         getDeviceName(device, name);
         std::cout << "\nUsing OpenCL device: " << name << "\n";
 
-        std::vector<cl::Device> chosen_device;
-        chosen_device.push_back(device);
-        cl::Context context(chosen_device);
-        cl::CommandQueue queue(context, device);
+        // The run goes into the OCL_WORKLOAD log, for replay.cpp
+        const long workload[] = { M, N, K };
+        util::recordWorkload(device, "matmul", workload, 3);
 
 //--------------------------------------------------------------------------------
-// Run sequential matmul
+// Multi-device mode: share the rows of C over the platform's devices, then stop
 //--------------------------------------------------------------------------------
 
-        initmat(N, h_A, h_B, h_C);
+        if (multi)
+        {
+            cl::Platform platform(device.getInfo<CL_DEVICE_PLATFORM>());
+            std::vector<cl::Device> platform_devices;
+            platform.getDevices(CL_DEVICE_TYPE_ALL, &platform_devices);
+
+            printf("\n===== OpenCL, matrix mult split over %d devices, %s ======\n",
+                (int)platform_devices.size(), sizeName(M, N, K).c_str());
 
-        printf("\n===== Sequential, matrix mult (dot prod), order %d on host CPU ======\n",ORDER);
-        for(int i = 0; i < COUNT; i++)
+            setMatrices(M, N, K, in_a, in_b, h_A, h_B, h_C, h_ref);
+            multiDevice(platform_devices, M, N, K, h_A, h_B, h_C);
+            return EXIT_SUCCESS;
+        }
+
+//--------------------------------------------------------------------------------
+// NUMA mode: the same split over one sub-device per NUMA node, then stop
+//--------------------------------------------------------------------------------
+
+        if (numa)
         {
-            zero_mat(N, h_C);
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            std::vector<cl::Device> nodes = util::numaSubDevices(device);
+            if (nodes.size() == 1)
+                printf(" %s has one NUMA node (or cannot be partitioned by them)\n", name.c_str());
 
-            seq_mat_mul_sdot(N, h_A, h_B, h_C);
+            printf("\n===== OpenCL, matrix mult split over %d NUMA nodes, %s ======\n",
+                (int)nodes.size(), sizeName(M, N, K).c_str());
 
-            run_time  = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0 - start_time;
-            results(N, h_C, run_time);
+            setMatrices(M, N, K, in_a, in_b, h_A, h_B, h_C, h_ref);
+            multiDevice(nodes, M, N, K, h_A, h_B, h_C, true);
+            return EXIT_SUCCESS;
         }
 
 //--------------------------------------------------------------------------------
-// Setup the buffers, initialize matrices, and write them into global memory
+// Out-of-core mode: a tile of C at a time, then stop
 //--------------------------------------------------------------------------------
 
-        //  Reset A, B and C matrices (just to play it safe)
-        initmat(N, h_A, h_B, h_C);
+        if (ooc)
+        {
+            util::TuningFile tuning(device);
+            cl::Context context(device);
 
-        d_a = cl::Buffer(context, h_A.begin(), h_A.end(), true);
+            printf("\n===== OpenCL, matrix mult (blocked) out of core, %s ======\n",
+                sizeName(M, N, K).c_str());
+
+            // On the ordinary heap: they may be far larger than can be pinned
+            setMatrices(M, N, K, in_a, in_b, h_A, h_B, h_C, h_ref);
+            outOfCore(context, device, tuning, M, N, K, tile, h_A, h_B, h_C);
+            return EXIT_SUCCESS;
+        }
 
-        d_b = cl::Buffer(context, h_B.begin(), h_B.end(), true);
+        // The context, queue and programs are made once and shared by
+        // every variant and run mode
+        util::Runtime runtime(device, CL_QUEUE_PROFILING_ENABLE);
+        cl::Context& context = runtime.context();
+        cl::CommandQueue& queue = runtime.queue();
+
+        // Host matrices in pinned memory, for full speed transfers; A
+        // and B stay in the mapped files when they come from them, but
+        // for the modes that copy them in
+        util::PinnedAllocator<float> pinned(context, queue);
+        if (!inputs || hybrid_mode || pipe)
+        {
+            h_A = HostMatrix(M * K, 0.0f, pinned);
+            h_B = HostMatrix(K * N, 0.0f, pinned);
+        }
+        h_C = HostMatrix(M * N, 0.0f, pinned);
 
-        d_c = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * size);
+        util::Profiler profiler;
+        cl::Event event;
 
 //--------------------------------------------------------------------------------
-// OpenCL matrix multiplication ... Naive
+// Benchmark mode: many timed runs of each variant, then stop
 //--------------------------------------------------------------------------------
 
-        // Create the compute program from the source buffer
-        cl::Program program(context, util::loadProgram("../C_elem.cl"), true);
+        if (bench)
+        {
+            util::TuningFile tuning(device);
+
+            std::vector<MatrixSize> sizes;
+            if (sweep)
+            {
+                for (int order = BENCH_MIN_ORDER; order <= BENCH_MAX_ORDER; order *= 2)
+                {
+                    MatrixSize size = { order, order, order };
+                    sizes.push_back(size);
+                }
+            }
+            else
+            {
+                MatrixSize size = { M, N, K };
+                sizes.push_back(size);
+            }
+
+            int slower = benchmark(runtime, tuning, sizes, reps, warmup, bench_file, verify,
+                                   baseline_mode, threshold);
+            return slower ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
 
-        // Create the compute kernel from the program
-        cl::make_kernel<int, cl::Buffer, cl::Buffer, cl::Buffer> naive_mmul(program, "mmul");
+//--------------------------------------------------------------------------------
+// Strassen mode: recursive multiplication down to the crossover, then stop
+//--------------------------------------------------------------------------------
+
+        if (strassen_mode)
+        {
+            util::TuningFile tuning(device);
+
+            printf("\n===== OpenCL, Strassen-Winograd matrix mult, %s ======\n",
+                sizeName(M, N, K).c_str());
+
+            strassen(runtime, tuning, M, N, K, crossover, tune);
+            return EXIT_SUCCESS;
+        }
 
-        printf("\n===== OpenCL, matrix mult, C(i,j) per work item, order %d ======\n",N);
+//--------------------------------------------------------------------------------
+// Chain mode: a chain of products in the planned order, then stop
+//--------------------------------------------------------------------------------
 
-        // Do the multiplication COUNT times
-        for (int i = 0; i < COUNT; i++)
+        if (!chain_dims.empty())
         {
-            zero_mat(N, h_C);
+            util::TuningFile tuning(device);
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            printf("\n===== OpenCL, chain of %d matrix mults (blocked) ======\n",
+                (int)chain_dims.size() - 2);
+
+            chain(runtime, tuning, chain_dims);
+            return EXIT_SUCCESS;
+        }
 
-            // Execute the kernel over the entire range of C matrix elements ... computing
-            // a dot product for each element of the product matrix.  The local work
-            // group size is set to NULL ... so I'm telling the OpenCL runtime to
-            // figure out a local work group size for me.
-            cl::NDRange global(N, N);
-            naive_mmul(cl::EnqueueArgs(queue, global),
-                    N, d_a, d_b, d_c);
+//--------------------------------------------------------------------------------
+// Sparse mode: CSR and ELLPACK kernels on a random sparse A, then stop
+//--------------------------------------------------------------------------------
 
-            queue.finish();
+        if (density > 0.0f)
+        {
+            util::TuningFile tuning(device);
 
-            run_time  = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0 - start_time;
+            printf("\n===== OpenCL, sparse matrix mult, density %g, %s ======\n",
+                density, sizeName(M, N, K).c_str());
 
-            cl::copy(queue, d_c, h_C.begin(), h_C.end());
+            sparse(runtime, tuning, M, N, K, density);
+            return EXIT_SUCCESS;
+        }
 
-            results(N, h_C, run_time);
+//--------------------------------------------------------------------------------
+// Epilogue mode: the epilogue fused into the blocked kernel, then stop
+//--------------------------------------------------------------------------------
+
+        if (fuse)
+        {
+            util::TuningFile tuning(device);
 
-        } // end for loop
+            printf("\n===== OpenCL, matrix mult (blocked) with epilogue, %s ======\n",
+                sizeName(M, N, K).c_str());
+
+            fusedEpilogue(context, device, queue, tuning, M, N, K, epi);
+            return EXIT_SUCCESS;
+        }
 
 //--------------------------------------------------------------------------------
-// OpenCL matrix multiplication ... C row per work item
+// Concurrent mode: every variant at once on queues of their own, then stop
 //--------------------------------------------------------------------------------
 
-        // Create the compute program from the source buffer
-        program = cl::Program(context, util::loadProgram("../C_row.cl"), true);
+        if (together)
+        {
+            util::TuningFile tuning(device);
 
-        // Create the compute kernel from the program
-        cl::make_kernel<int, cl::Buffer, cl::Buffer, cl::Buffer> crow_mmul(program, "mmul");
+            printf("\n===== OpenCL, matrix mult variants run concurrently, %s ======\n",
+                sizeName(M, N, K).c_str());
 
-        printf("\n===== OpenCL, matrix mult, C row per work item, order %d ======\n",N);
+            concurrent(runtime, tuning, M, N, K);
+            return EXIT_SUCCESS;
+        }
 
-        // Do the multiplication COUNT times
-        for (int i = 0; i < COUNT; i++)
+//--------------------------------------------------------------------------------
+// Specialized mode: every variant with the sizes compiled in, then stop
+//--------------------------------------------------------------------------------
+
+        if (specialized)
         {
-            zero_mat(N, h_C);
+            util::TuningFile tuning(device);
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            printf("\n===== OpenCL, matrix mult variants specialized for %s ======\n",
+                sizeName(M, N, K).c_str());
 
-            cl::NDRange global(N);
-            crow_mmul(cl::EnqueueArgs(queue, global),
-                    N, d_a, d_b, d_c);
+            specialize(runtime, tuning, M, N, K);
+            return EXIT_SUCCESS;
+        }
 
-            queue.finish();
+//--------------------------------------------------------------------------------
+// Hybrid mode: rows of C on the host and the device at once, then stop
+//--------------------------------------------------------------------------------
 
-            run_time  = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0 - start_time;
+        if (hybrid_mode)
+        {
+            util::TuningFile tuning(device);
+
+            printf("\n===== OpenCL and host (%d threads), matrix mult split by rows, %s ======\n",
+                omp_get_max_threads(), sizeName(M, N, K).c_str());
+
+            setMatrices(M, N, K, in_a, in_b, h_A, h_B, h_C, h_ref);
+            hybrid(runtime, tuning, M, N, K, h_A, h_B, h_C);
+            return EXIT_SUCCESS;
+        }
 
-            cl::copy(queue, d_c, h_C.begin(), h_C.end());
+//--------------------------------------------------------------------------------
+// Serving mode: jobs from many host threads through an executor, then stop
+//--------------------------------------------------------------------------------
 
-            results(N, h_C, run_time);
+        if (serve_jobs > 0)
+        {
+            util::TuningFile tuning(device);
 
-        } // end for loop
+            printf("\n===== OpenCL, matrix mult (blocked) served to host threads, %s ======\n",
+                sizeName(M, N, K).c_str());
+
+            serve(runtime, tuning, M, N, K, serve_jobs, workers);
+            return EXIT_SUCCESS;
+        }
 
 //--------------------------------------------------------------------------------
-// OpenCL matrix multiplication ... C row per work item, A row in pivate memory
+// SVM mode: A, B and C in shared virtual memory, against buffers, then stop
 //--------------------------------------------------------------------------------
 
-        // Create the compute program from the source buffer
-        program = cl::Program(context, util::loadProgram("../C_row_priv.cl"), true);
+        if (svm)
+        {
+            util::TuningFile tuning(device);
+
+            printf("\n===== OpenCL, matrix mult (blocked) in shared virtual memory, %s ======\n",
+                sizeName(M, N, K).c_str());
 
-        // Create the compute kernel from the program
-        cl::make_kernel<int, cl::Buffer, cl::Buffer, cl::Buffer> arowpriv_mmul(program, "mmul");
+            svmMultiply(runtime, tuning, M, N, K);
+            return EXIT_SUCCESS;
+        }
 
-        printf("\n===== OpenCL, matrix mult, C row, A row in priv mem, order %d ======\n",N);
+//--------------------------------------------------------------------------------
+// Batched mode: many small matrices in one launch, then stop
+//--------------------------------------------------------------------------------
 
-        // Do the multiplication COUNT times
-        for (int i = 0; i < COUNT; i++)
+        if (batch > 0)
         {
-            zero_mat(N, h_C);
+            util::TuningFile tuning(device);
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            if (!sized)
+                M = N = K = BATCH_ORDER;
 
-            cl::NDRange global(N);
-            cl::NDRange local(ORDER / 16);
-            arowpriv_mmul(cl::EnqueueArgs(queue, global, local),
-                    N, d_a, d_b, d_c);
+            printf("\n===== OpenCL, batch of %d matrix mults, %s ======\n",
+                batch, sizeName(M, N, K).c_str());
 
-            queue.finish();
+            batched(context, device, queue, tuning, M, N, K, batch);
+            return EXIT_SUCCESS;
+        }
 
-            run_time  = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0 - start_time;
+//--------------------------------------------------------------------------------
+// Reduced precision mode: fp16 and int8 storage, then stop
+//--------------------------------------------------------------------------------
 
-            cl::copy(queue, d_c, h_C.begin(), h_C.end());
+        if (lowp)
+        {
+            util::TuningFile tuning(device);
 
-            results(N, h_C, run_time);
+            printf("\n===== OpenCL, reduced precision matrix mult (blocked), %s ======\n",
+                sizeName(M, N, K).c_str());
 
-        } // end for loop
+            lowPrecision(context, device, queue, tuning, M, N, K);
+            return EXIT_SUCCESS;
+        }
 
 //--------------------------------------------------------------------------------
-// OpenCL matrix multiplication ... C row per work item, A row pivate, B col local
+// Layout mode: transposed operands, directly and transposed on the device, then stop
 //--------------------------------------------------------------------------------
 
-        // Create the compute program from the source buffer
-        program = cl::Program(context, util::loadProgram("../C_row_priv_bloc.cl"), true);
+        if (layout)
+        {
+            util::TuningFile tuning(device);
 
-        // Create the compute kernel from the program
-        cl::make_kernel<int, cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg> browloc_mmul(program, "mmul");
+            printf("\n===== OpenCL, matrix mult with transposed operands (blocked), %s ======\n",
+                sizeName(M, N, K).c_str());
+
+            layouts(context, device, queue, tuning, M, N, K);
+            return EXIT_SUCCESS;
+        }
 
-        printf("\n===== OpenCL, mat mult, C row, priv A, B cols loc, order %d ======\n",N);
+//--------------------------------------------------------------------------------
+// Pipelined mode: overlap transfers and computation, then stop
+//--------------------------------------------------------------------------------
 
-        // Do the multiplication COUNT times
-        for (int i = 0; i < COUNT; i++)
+        if (pipe)
         {
-            zero_mat(N, h_C);
+            util::TuningFile tuning(device);
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            printf("\n===== OpenCL, matrix mult pipelined by panels, %s ======\n",
+                sizeName(M, N, K).c_str());
 
-            cl::NDRange global(N);
-            cl::NDRange local(ORDER / 16);
+            setMatrices(M, N, K, in_a, in_b, h_A, h_B, h_C, h_ref);
+            pipeline(context, device, tuning, M, N, K, panel, h_A, h_B, h_C);
+            return EXIT_SUCCESS;
+        }
 
-            cl::LocalSpaceArg localmem = cl::Local(sizeof(float) * N);
+//--------------------------------------------------------------------------------
+// Build the variants' programs in the background, while the host runs
+//--------------------------------------------------------------------------------
+
+        {
+            util::TuningFile tuning(device);
+            std::vector<util::Runtime::Build> builds;
+            for (int v = 0; v < NUM_VARIANTS; v++)
+            {
+                util::TuningParams params = tuning.get(variants[v].name, defaultParams(variants[v]));
+                if (checkParams(variants[v], params, K, device).empty())
+                    builds.push_back(util::Runtime::Build(variants[v].file,
+                                                          variantOptions(variants[v], params)));
+            }
+            runtime.prebuild(builds);
+        }
+
+//--------------------------------------------------------------------------------
+// Run sequential matmul
+//--------------------------------------------------------------------------------
 
-            browloc_mmul(cl::EnqueueArgs(queue, global, local),
-                    N, d_a, d_b, d_c, localmem);
+        if (inputs)
+        {
+            // The tiled product is the reference every result is checked
+            // against, the host runs below included
+            h_ref = HostMatrix(M * N, 0.0f, pinned);
+            seq_mat_mul_tiled(M, N, K, in_a->data(), in_b->data(), &h_ref[0]);
+            useReference(&h_ref);
+        }
+        else
+            initmat(M, N, K, h_A, h_B, h_C);
+
+        if (naive)
+            printf("\n===== Sequential, matrix mult (dot prod), %s on host CPU ======\n",
+                sizeName(M, N, K).c_str());
+        else
+            printf("\n===== Host matrix mult (tiled, %d threads), %s on host CPU ======\n",
+                omp_get_max_threads(), sizeName(M, N, K).c_str());
+        // The tiled product runs over rows padded to aligned strides
+        PaddedMatrix p_A, p_B, p_C;
+        if (!inputs && !naive)
+        {
+            p_A = PaddedMatrix(M, K, pinned);
+            p_B = PaddedMatrix(K, N, pinned);
+            p_C = PaddedMatrix(M, N, pinned);
+            p_A.fromDense(&h_A[0]);
+            p_B.fromDense(&h_B[0]);
+        }
+        for(int i = 0; i < COUNT; i++)
+        {
+            zero_mat(M, N, h_C);
+            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
 
-            queue.finish();
+            if (inputs && naive)
+                seq_mat_mul_sdot(M, N, K, in_a->data(), in_b->data(), &h_C[0]);
+            else if (inputs)
+                seq_mat_mul_tiled(M, N, K, in_a->data(), in_b->data(), &h_C[0]);
+            else if (naive)
+                seq_mat_mul_sdot(M, N, K, h_A, h_B, h_C);
+            else
+                seq_mat_mul_tiled(p_A, p_B, p_C);
 
             run_time  = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0 - start_time;
+            if (!inputs && !naive)
+                p_C.toDense(&h_C[0]);
+            results(M, N, K, h_C, run_time);
+        }
+
+//--------------------------------------------------------------------------------
+// Setup the buffers, initialize matrices, and write them into global memory
+//--------------------------------------------------------------------------------
 
-            cl::copy(queue, d_c, h_C.begin(), h_C.end());
+        if (inputs)
+        {
+            // Over the mapped pages: the runtime reads them as it needs
+            // them (or uses them in place on a CPU or integrated GPU)
+            d_a = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, in_a->bytes(), in_a->data());
+            d_b = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, in_b->bytes(), in_b->data());
+        }
+        else
+        {
+            //  Reset A, B and C matrices (just to play it safe)
+            initmat(M, N, K, h_A, h_B, h_C);
 
-            results(N, h_C, run_time);
+            d_a = runtime.pool().acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+            queue.enqueueWriteBuffer(d_a, CL_TRUE, 0, sizeof(float) * M * K, &h_A[0], NULL, &event);
+            profiler.record("write A", event);
+
+            d_b = runtime.pool().acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+            queue.enqueueWriteBuffer(d_b, CL_TRUE, 0, sizeof(float) * K * N, &h_B[0], NULL, &event);
+            profiler.record("write B", event);
+        }
 
-        } // end for loop
+        d_c = runtime.pool().acquire(sizeof(float) * M * N, CL_MEM_WRITE_ONLY);
 
 //--------------------------------------------------------------------------------
-// OpenCL matrix multiplication ... blocked
+// Tune the kernels for this device, if asked to
 //--------------------------------------------------------------------------------
 
-        // Create the compute program from the source buffer
-        program = cl::Program(context, util::loadProgram("../C_block_form.cl"), true);
+        // Parameters saved by an earlier --tune run on this device are
+        // picked up automatically
+        util::TuningFile tuning(device);
 
-        // Create the compute kernel from the program
-        cl::make_kernel<int, cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl::LocalSpaceArg> block_mmul(program, "mmul");
+        if (tune)
+            autotune(runtime, tuning, M, N, K, d_a, d_b, d_c, h_C);
 
-        printf("\n===== Parallel matrix mult (blocked), order %d on device ======\n",ORDER);
+//--------------------------------------------------------------------------------
+// OpenCL matrix multiplication ... each variant in turn
+//--------------------------------------------------------------------------------
+
+        // Achieved GFLOP/s and GB/s of each variant against the device peaks
+        util::Roofline roofline(context, device);
 
-        // Do the multiplication COUNT times
-        for (int i = 0; i < COUNT; i++)
+        // What each kernel uses of the device, to explain the times
+        util::KernelReport kernel_report(device);
+
+        for (int v = 0; v < NUM_VARIANTS; v++)
         {
-            zero_mat(N, h_C);
+            const Variant& variant = variants[v];
+            util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            printf("\n===== ");
+            printf(variant.title, sizeName(M, N, K).c_str());
+            printf(" ======\n");
 
-            // Work-group computes a block of C.  This size is also set
-            // in a #define inside the kernel function.  Note this blocksize
-            // must evenly divide the matrix order
-            int blocksize = 16;
+            if (tuning.has(variant.name))
+                printf(" Tuned: %s\n", util::formatParams(params).c_str());
 
-            cl::LocalSpaceArg A_block = cl::Local(sizeof(float) * blocksize*blocksize);
-            cl::LocalSpaceArg B_block = cl::Local(sizeof(float) * blocksize*blocksize);
+            std::string invalid = checkParams(variant, params, K, device);
+            if (!invalid.empty())
+            {
+                printf(" Skipped: %s\n", invalid.c_str());
+                continue;
+            }
 
-            block_mmul(
-                cl::EnqueueArgs(
-                    queue,
-                    cl::NDRange(N,N),
-                    cl::NDRange(blocksize,blocksize)),
-                N,
-                d_a,
-                d_b,
-                d_c,
-                A_block,
-                B_block);
+            // The compute kernel, built now or (after --tune) already built
+            cl::Kernel& kernel = variantKernel(runtime, variant, params);
 
-            queue.finish();
+            // Do the multiplication COUNT times
+            for (int i = 0; i < COUNT; i++)
+            {
+                zero_mat(M, N, h_C);
 
-            run_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0 - start_time;
+                {
+                    util::TraceSpan span("enqueue", variant.name);
+                    event = enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+                }
 
-            cl::copy(queue, d_c, h_C.begin(), h_C.end());
+                profiler.record(variant.name, event);
 
-            results(N, h_C, run_time);
+                run_time = util::eventSeconds(event);
+                roofline.record(variant.name, util::matmulCost(M, N, K), run_time);
 
-        } // end for loop
+                queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0], NULL, &event);
+                profiler.record("read C", event);
+
+                results(M, N, K, h_C, run_time);
+
+            } // end for loop
+
+            // After the launch, so the local memory arguments are counted
+            const util::KernelUsage& usage =
+                kernel_report.record(variant.name, kernel, variantGroupSize(variant, params));
+            printf(" %s\n", util::formatUsage(usage).c_str());
+            for (unsigned w = 0; w < usage.warnings.size(); w++)
+                printf("   %s\n", usage.warnings[w].c_str());
+        } // end for variants
+
+//--------------------------------------------------------------------------------
+// Device timings of every kernel and transfer
+//--------------------------------------------------------------------------------
+
+        profiler.print();
+        roofline.print();
+        kernel_report.print();
+        runtime.pool().print();
+
+        if (!profile_file.empty())
+        {
+            if (profiler.writeFile(profile_file))
+                printf("\nDevice timings written to %s\n", profile_file.c_str());
+            else
+                printf("\nCould not write device timings to %s\n", profile_file.c_str());
+        }
     } catch (cl::Error err)
     {
         std::cout << "Exception\n";
@@ -311,5 +994,9 @@ int main(int argc, char *argv[])
                   << std::endl;
     }
 
+    // The buffers over the mapped files go before the mappings
+    d_a = d_b = cl::Buffer();
+    delete in_a;
+    delete in_b;
     return EXIT_SUCCESS;
 }
@@ -16,13 +16,35 @@
 #include <cstdlib>
 #include <cmath>
 #include <iostream>
+#include <string>
 
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#else
+inline int omp_get_max_threads() { return 1; }
+#endif
+
 #define __CL_ENABLE_EXCEPTIONS
 #include "cl.hpp"
 
 #include "util.hpp"
+#include "pinned_allocator.hpp"
+#include "padded_matrix.hpp"
+
+//------------------------------------------------------------------------------
+//  Host matrices.  Once a context exists they are allocated in pinned
+//  memory so transfers avoid a staging copy; before that they use the
+//  ordinary heap.
+//------------------------------------------------------------------------------
+typedef std::vector<float, util::PinnedAllocator<float> > HostMatrix;
+
+//------------------------------------------------------------------------------
+//  Host matrices with each row aligned and padded to ld() floats, for host
+//  loops over rows; write() and read() move them to and from dense buffers
+//------------------------------------------------------------------------------
+typedef util::PaddedMatrix<float> PaddedMatrix;
 
 #include "matrix_lib.hpp"
 
@@ -40,6 +62,23 @@ extern double wtime();   // returns time since some fixed past point (wtime.c)
 #define TOL      (0.001) // tolerance used in floating point comparisons
 #define DIM      2       // Max dim for NDRange
 #define COUNT    1       // number of times to do each multiplication
+#define REG_TS   64      // tile of C per work-group in C_block_reg.cl
+#define REG_TSK  16      // depth of the k-panel in C_block_reg.cl
+#define REG_WPT  4       // tile of C per work-item in C_block_reg.cl
+#define BENCH_REPS      20    // timed runs per variant in benchmark mode
+#define BENCH_WARMUP    2     // untimed runs per variant in benchmark mode
+#define BENCH_MIN_ORDER 256   // smallest order in a benchmark sweep
+#define BENCH_MAX_ORDER 8192  // largest order in a benchmark sweep
+#define BENCH_THRESHOLD 0.05  // slowdown against the baseline that fails a check
+#define PIPE_PANEL      256   // rows of C per panel in pipelined mode
+#define BATCH_ORDER     64    // order of the matrices in batched mode
+#define HOST_TILE       64    // tile size of the tiled host multiplication
+#define STRASSEN_CROSSOVER  1024  // order below which Strassen uses the blocked kernel
+#define STRASSEN_CHECK_ROWS 16    // rows of C checked on the host in Strassen mode
+#define SPMV_VECTOR     32    // work-items per row in the work-group SpMV kernel
+#define SERVE_CLIENTS   4     // host threads submitting jobs in serving mode
+#define SERVE_WORKERS   4     // executor threads in serving mode
+#define SVM_REPS        3     // timed runs in SVM mode (best is kept)
 #define SUCCESS  1
 #define FAILURE  0
 
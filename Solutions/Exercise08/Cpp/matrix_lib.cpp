@@ -5,8 +5,9 @@
 //  PURPOSE: This is a simple set of functions to manipulate
 //           matrices used with the multiplcation driver.
 //
-//  USAGE:   The matrices are square and the order is
-//           set as a defined constant, ORDER.
+//  USAGE:   The matrices are stored by rows: A is M x K, B is K x N
+//           and C is M x N.  By default they are square and the
+//           order is set as a defined constant, ORDER.
 //
 //  HISTORY: Written by Tim Mattson, August 2010
 //           Modified by Simon McIntosh-Smith, September 2011
@@ -18,49 +19,117 @@
 
 #include "matmul.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 //------------------------------------------------------------------------------
 //
 //  Function to compute the matrix product (sequential algorithm, dot prod)
 //
 //------------------------------------------------------------------------------
 
-void seq_mat_mul_sdot(int N, std::vector<float>& A, std::vector<float>& B, std::vector<float>& C)
+void seq_mat_mul_sdot(int M, int N, int K, const float *A, const float *B, float *C)
 {
     int i, j, k;
     float tmp;
 
-    for (i = 0; i < N; i++) {
+    for (i = 0; i < M; i++) {
         for (j = 0; j < N; j++) {
             tmp = 0.0f;
-            for (k = 0; k < N; k++) {
+            for (k = 0; k < K; k++) {
                 /* C(i,j) = sum(over k) A(i,k) * B(k,j) */
-                tmp += A[i*N+k] * B[k*N+j];
+                tmp += A[i*K+k] * B[k*N+j];
             }
             C[i*N+j] = tmp;
         }
     }
 }
 
+void seq_mat_mul_sdot(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C)
+{
+    seq_mat_mul_sdot(M, N, K, &A[0], &B[0], &C[0]);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to compute the matrix product (tiled, vectorised, OpenMP)
+//
+//  Each thread takes a band of HOST_TILE rows of C.  Within a band the
+//  product is built from HOST_TILE x HOST_TILE tiles so the tiles of A, B
+//  and C in use stay in cache, and the innermost loop runs along a row of
+//  B and C so the compiler can vectorise it (AVX, NEON, ...).  The rows
+//  of each matrix may be padded (lda, ldb and ldc elements apart), as a
+//  PaddedMatrix is, so every row starts aligned.
+//
+//------------------------------------------------------------------------------
+
+void seq_mat_mul_tiled(int M, int N, int K, const float *a, int lda, const float *b, int ldb,
+                       float *c, int ldc)
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int ii = 0; ii < M; ii += HOST_TILE) {
+        const int iend = std::min(ii + HOST_TILE, M);
+
+        for (int i = ii; i < iend; i++)
+            for (int j = 0; j < N; j++)
+                c[(long)i*ldc+j] = 0.0f;
+
+        for (int jj = 0; jj < N; jj += HOST_TILE) {
+            const int jend = std::min(jj + HOST_TILE, N);
+            for (int kk = 0; kk < K; kk += HOST_TILE) {
+                const int kend = std::min(kk + HOST_TILE, K);
+                for (int i = ii; i < iend; i++) {
+                    float *crow = c + (long)i*ldc;
+                    for (int k = kk; k < kend; k++) {
+                        /* C(i,:) += A(i,k) * B(k,:) */
+                        const float  aik  = a[(long)i*lda+k];
+                        const float *brow = b + (long)k*ldb;
+                        #pragma omp simd
+                        for (int j = jj; j < jend; j++)
+                            crow[j] += aik * brow[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void seq_mat_mul_tiled(int M, int N, int K, const float *a, const float *b, float *c)
+{
+    seq_mat_mul_tiled(M, N, K, a, K, b, N, c, N);
+}
+
+void seq_mat_mul_tiled(const PaddedMatrix& A, const PaddedMatrix& B, PaddedMatrix& C)
+{
+    seq_mat_mul_tiled((int)A.rows(), (int)B.cols(), (int)A.cols(), A.data(), (int)A.ld(),
+                      B.data(), (int)B.ld(), C.data(), (int)C.ld());
+}
+
+void seq_mat_mul_tiled(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C)
+{
+    seq_mat_mul_tiled(M, N, K, &A[0], &B[0], &C[0]);
+}
+
 //------------------------------------------------------------------------------
 //
 //  Function to initialize the input matrices A and B
 //
 //------------------------------------------------------------------------------
-void initmat(int N, std::vector<float>& A, std::vector<float>& B, std::vector<float>& C)
+void initmat(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C)
 {
-    int i, j;
+    long i, j;
 
-    /* Initialize matrices */
+    /* Initialize matrices (long indices, for orders past 46340) */
 
-    for (i = 0; i < N; i++)
-        for (j = 0; j < N; j++)
-            A[i*N+j] = AVAL;
+    for (i = 0; i < M; i++)
+        for (j = 0; j < K; j++)
+            A[i*K+j] = AVAL;
 
-    for (i = 0; i < N; i++)
+    for (i = 0; i < K; i++)
         for (j = 0; j < N; j++)
             B[i*N+j] = BVAL;
 
-    for (i = 0; i < N; i++)
+    for (i = 0; i < M; i++)
         for (j = 0; j < N; j++)
             C[i*N+j] = 0.0f;
 }
@@ -70,48 +139,274 @@ void initmat(int N, std::vector<float>& A, std::vector<float>& B, std::vector<fl
 //  Function to set a matrix to zero
 //
 //------------------------------------------------------------------------------
-void zero_mat (int N, std::vector<float>& C)
+void zero_mat (int M, int N, HostMatrix& C)
 {
-    int i, j;
+    float *c = &C[0];
+    const long count = (long)M * N;
 
-    for (i = 0; i < N; i++)
-        for (j = 0; j < N; j++)
-            C[i*N+j] = 0.0f;
+    #pragma omp parallel for simd
+    for (long i = 0; i < count; i++)
+        c[i] = 0.0f;
 }
 
 //------------------------------------------------------------------------------
 //
-//  Function to fill Btrans(N,N) with transpose of B(N,N)
+//  Function to fill Btrans(cols,rows) with transpose of B(rows,cols)
 //
 //------------------------------------------------------------------------------
-void trans(int N, std::vector<float>& B, std::vector<float>& Btrans)
+void trans(int rows, int cols, HostMatrix& B, HostMatrix& Btrans)
 {
     int i, j;
 
-    for (i = 0; i < N; i++)
-        for (j = 0; j < N; j++)
-            Btrans[j*N+i] = B[i*N+j];
+    for (i = 0; i < rows; i++)
+        for (j = 0; j < cols; j++)
+            Btrans[j*rows+i] = B[i*cols+j];
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to convert a float to the nearest half (IEEE 754 binary16),
+//  ties to even, for the fp16 kernel (C_block_half.cl)
+//
+//------------------------------------------------------------------------------
+cl_half floatToHalf(float f)
+{
+    cl_uint u;
+    memcpy(&u, &f, sizeof(u));
+
+    const cl_uint sign = (u >> 16) & 0x8000;
+    const int     exp  = (int)((u >> 23) & 0xff) - 127 + 15;
+    cl_uint       mant = u & 0x7fffff;
+
+    if (((u >> 23) & 0xff) == 0xff)             // infinity or NaN
+        return (cl_half)(sign | 0x7c00 | (mant ? 0x200 : 0));
+    if (exp >= 31)                              // too large: infinity
+        return (cl_half)(sign | 0x7c00);
+
+    cl_uint shift, h;
+    if (exp <= 0)                               // a subnormal half, or zero
+    {
+        if (exp < -10)
+            return (cl_half)sign;
+        mant |= 0x800000;
+        shift = 14 - exp;
+        h = mant >> shift;
+    }
+    else
+    {
+        shift = 13;
+        h = ((cl_uint)exp << 10) | (mant >> shift);
+    }
+
+    // Round the bits shifted out; a carry may step up the exponent,
+    // which is still the right answer
+    const cl_uint rest = mant & ((1u << shift) - 1);
+    const cl_uint halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1)))
+        h++;
+    return (cl_half)(sign | h);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to fill H with X(rows,cols) in halfs
+//
+//------------------------------------------------------------------------------
+void toHalf(int rows, int cols, HostMatrix& X, std::vector<cl_half>& H)
+{
+    H.resize((size_t)rows * cols);
+    for (size_t i = 0; i < H.size(); i++)
+        H[i] = floatToHalf(X[i]);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to quantize X(rows,cols) to signed 8 bits for the int8 kernel
+//  (C_block_int8.cl), returning the scale (X is about scale * Q).
+//
+//  Q is laid out with the k dimension contiguous and padded with zeros to
+//  a multiple of 4, so it packs into ints.  For A(M,K) that is X itself,
+//  M rows of ceil(K/4)*4; for B(K,N) it is the transpose, N rows of
+//  ceil(K/4)*4.
+//
+//------------------------------------------------------------------------------
+float quantizeInt8(int rows, int cols, HostMatrix& X, bool transpose, std::vector<cl_char>& Q)
+{
+    const int out_rows = transpose ? cols : rows;
+    const int inner = transpose ? rows : cols;
+    const int padded = (inner + 3) / 4 * 4;
+
+    float amax = 0.0f;
+    for (int i = 0; i < rows * cols; i++)
+        amax = std::max(amax, std::fabs(X[i]));
+    const float scale = amax > 0.0f ? amax / 127.0f : 1.0f;
+
+    Q.assign((size_t)out_rows * padded, 0);
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            long q = lrintf(X[i*cols+j] / scale);
+            q = std::max(-127L, std::min(127L, q));
+            if (transpose)
+                Q[(size_t)j*padded+i] = (cl_char)q;
+            else
+                Q[(size_t)i*padded+j] = (cl_char)q;
+        }
+    }
+    return scale;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to make a random sparse matrix in CSR form.  Each element is
+//  nonzero with probability density, with a value in [-1, 1); the
+//  generator is seeded the same way every run.
+//
+//------------------------------------------------------------------------------
+void makeSparse(int rows, int cols, float density, CsrMatrix& S)
+{
+    unsigned int seed = 12345;
+    const unsigned int threshold = (unsigned int)(density * 4294967295.0);
+
+    S.rows = rows;
+    S.cols = cols;
+    S.row_ptr.assign(1, 0);
+    S.col.clear();
+    S.val.clear();
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            if (seed >= threshold)
+                continue;
+            seed = seed * 1664525u + 1013904223u;
+            S.col.push_back(j);
+            S.val.push_back((float)(seed >> 8) / 8388608.0f - 1.0f);
+        }
+        S.row_ptr.push_back((int)S.col.size());
+    }
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to convert a CSR matrix to ELLPACK, padded to its longest row
+//
+//------------------------------------------------------------------------------
+void csrToEll(const CsrMatrix& S, EllMatrix& E)
+{
+    E.rows = S.rows;
+    E.cols = S.cols;
+    E.width = 0;
+    for (int i = 0; i < S.rows; i++)
+        E.width = std::max(E.width, S.row_ptr[i+1] - S.row_ptr[i]);
+
+    E.col.assign((size_t)E.width * S.rows, 0);
+    E.val.assign((size_t)E.width * S.rows, 0.0f);
+    for (int i = 0; i < S.rows; i++)
+    {
+        for (int p = S.row_ptr[i]; p < S.row_ptr[i+1]; p++)
+        {
+            const size_t w = p - S.row_ptr[i];
+            E.col[w*S.rows+i] = S.col[p];
+            E.val[w*S.rows+i] = S.val[p];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to fill X(rows,cols) with a CSR matrix
+//
+//------------------------------------------------------------------------------
+void csrToDense(const CsrMatrix& S, HostMatrix& X)
+{
+    std::fill(X.begin(), X.begin() + (size_t)S.rows * S.cols, 0.0f);
+    for (int i = 0; i < S.rows; i++)
+        for (int p = S.row_ptr[i]; p < S.row_ptr[i+1]; p++)
+            X[(size_t)i*S.cols+S.col[p]] = S.val[p];
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to compute C(rows,N) = S * B(cols,N) on the host, the
+//  reference for the sparse kernels
+//
+//------------------------------------------------------------------------------
+void csr_mat_mul(const CsrMatrix& S, int N, HostMatrix& B, HostMatrix& C)
+{
+    #pragma omp parallel for
+    for (int i = 0; i < S.rows; i++)
+    {
+        float *c = &C[(size_t)i*N];
+        for (int j = 0; j < N; j++)
+            c[j] = 0.0f;
+        for (int p = S.row_ptr[i]; p < S.row_ptr[i+1]; p++)
+        {
+            const float a = S.val[p];
+            const float *b = &B[(size_t)S.col[p]*N];
+            for (int j = 0; j < N; j++)
+                c[j] += a * b[j];
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
 //
 //  Function to compute errors of the product matrix
 //
+//  Threaded and vectorised like the tiled multiplication, as at large
+//  orders a serial pass over C takes longer than the kernels it checks.
+//  The sums are in double, so the rounding of millions of float
+//  additions does not hide (or make up) an error.
+//
 //------------------------------------------------------------------------------
-float error(int N, std::vector<float>& C)
+static const HostMatrix *reference = NULL;
+
+void useReference(const HostMatrix *ref)
 {
-   int i,j;
-   float cval, errsq, err;
-   cval = (float) N * AVAL * BVAL;
-   errsq = 0.0f;
+    reference = ref;
+}
 
-    for (i = 0; i < N; i++) {
-        for (j = 0; j < N; j++) {
-            err = C[i*N+j] - cval;
+float error(int M, int N, int K, HostMatrix& C)
+{
+    return error(M, N, K, &C[0]);
+}
+
+float error(int M, int N, int K, const float *c)
+{
+    const long count = (long)M * N;
+    double errsq = 0.0;
+
+    if (reference) {
+        // Relative to the size of the reference, as the elements of real
+        // data can be of any magnitude
+        const float *r = &(*reference)[0];
+        double refsq = 0.0;
+        #pragma omp parallel for simd reduction(+:errsq,refsq)
+        for (long i = 0; i < count; i++) {
+            const double err = (double)c[i] - r[i];
             errsq += err * err;
+            refsq += (double)r[i] * r[i];
         }
+        return (float)(refsq > 0.0 ? errsq / refsq : errsq);
+    }
+
+    const double cval = (double)K * AVAL * BVAL;
+    #pragma omp parallel for simd reduction(+:errsq)
+    for (long i = 0; i < count; i++) {
+        const double err = c[i] - cval;
+        errsq += err * err;
     }
-    return errsq;
+    return (float)errsq;
+}
+
+float error(int K, const PaddedMatrix& C)
+{
+    std::vector<float> dense(C.rows() * C.cols());
+    C.toDense(dense.empty() ? NULL : &dense[0]);
+    return error((int)C.rows(), (int)C.cols(), K, dense.empty() ? NULL : &dense[0]);
 }
 
 //------------------------------------------------------------------------------
@@ -119,16 +414,31 @@ float error(int N, std::vector<float>& C)
 //  Function to analyze and output results
 //
 //------------------------------------------------------------------------------
-void results(int N, std::vector<float>& C, double run_time)
+void results(int M, int N, int K, HostMatrix& C, double run_time)
 {
 
     float mflops;
     float errsq;
     
-    mflops = 2.0 * N * N * N/(1000000.0f * run_time);
+    mflops = 2.0 * M * N * K/(1000000.0f * run_time);
     printf(" %.2f seconds at %.1f MFLOPS \n",  run_time,mflops);
-    errsq = error(N, C);
+    errsq = error(M, N, K, C);
     if (std::isnan(errsq) || errsq > TOL)
            printf("\n Errors in multiplication: %f\n",errsq);
 }
 
+//------------------------------------------------------------------------------
+//
+//  Function to describe the matrix sizes for banners
+//
+//------------------------------------------------------------------------------
+std::string sizeName(int M, int N, int K)
+{
+    char name[64];
+
+    if (M == N && N == K)
+        sprintf(name, "order %d", N);
+    else
+        sprintf(name, "M=%d, N=%d, K=%d", M, N, K);
+    return name;
+}
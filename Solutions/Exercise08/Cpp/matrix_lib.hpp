@@ -8,6 +8,8 @@
 //           Updated to C++ Wrapper v1.2.6 by Tom Deakin, August 2013
 //           Modified to assume square matrices by Simon McIntosh-Smith, Sep 2014
 //
+//  The matrices are stored by rows: A is M x K, B is K x N and C is M x N.
+//
 //------------------------------------------------------------------------------
 
 #ifndef __MATRIX_LIB_HDR
@@ -19,35 +21,112 @@
 //  Function to compute the matrix product (sequential algorithm, dot producdt)
 //
 //------------------------------------------------------------------------------
-void seq_mat_mul_sdot(int N, std::vector<float> &A, std::vector<float> &B, std::vector<float> &C);
+void seq_mat_mul_sdot(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C);
+
+void seq_mat_mul_sdot(int M, int N, int K, const float *A, const float *B, float *C);
+
+//------------------------------------------------------------------------------
+//
+//  Function to compute the matrix product (tiled, vectorised and threaded
+//  with OpenMP).  seq_mat_mul_sdot stays as the reference.
+//
+//------------------------------------------------------------------------------
+void seq_mat_mul_tiled(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C);
+
+void seq_mat_mul_tiled(int M, int N, int K, const float *A, const float *B, float *C);
+
+void seq_mat_mul_tiled(int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+                       float *C, int ldc);
+
+void seq_mat_mul_tiled(const PaddedMatrix& A, const PaddedMatrix& B, PaddedMatrix& C);
 
 //------------------------------------------------------------------------------
 //
 //  Function to initialize the input matrices A and B
 //
 //------------------------------------------------------------------------------
-void initmat(int N, std::vector<float>& A, std::vector<float>& B, std::vector<float>& C);
+void initmat(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C);
 
 //------------------------------------------------------------------------------
 //
 //  Function to set a matrix to zero 
 //
 //------------------------------------------------------------------------------
-void zero_mat (int N, std::vector<float> &C);
+void zero_mat (int M, int N, HostMatrix& C);
 
 //------------------------------------------------------------------------------
 //
-//  Function to fill Btrans(Mdim,Pdim)  with transpose of B(Pdim,Mdim)
+//  Function to fill Btrans(cols,rows) with transpose of B(rows,cols)
 //
 //------------------------------------------------------------------------------
-void trans(int N, std::vector<float>& B, std::vector<float>& Btrans);
+void trans(int rows, int cols, HostMatrix& B, HostMatrix& Btrans);
 
 //------------------------------------------------------------------------------
 //
-//  Function to compute errors of the product matrix
+//  Functions to convert matrices for the reduced precision kernels: to
+//  halfs, and to signed 8 bit integers with the k dimension contiguous
+//  and padded to a multiple of 4 (B is transposed).  quantizeInt8
+//  returns the scale to multiply the products by.
 //
 //------------------------------------------------------------------------------
-float error(int N, std::vector<float>& C);
+cl_half floatToHalf(float f);
+
+void toHalf(int rows, int cols, HostMatrix& X, std::vector<cl_half>& H);
+
+float quantizeInt8(int rows, int cols, HostMatrix& X, bool transpose, std::vector<cl_char>& Q);
+
+//------------------------------------------------------------------------------
+//
+//  Sparse matrices.  CSR (compressed sparse row) holds the nonzeros of
+//  row i in val[row_ptr[i]] to val[row_ptr[i+1]-1], with their columns
+//  in col.  ELLPACK pads every row to width nonzeros (column 0, value 0)
+//  and stores them by columns of that rows x width array, element w of
+//  row i at w*rows+i, so neighbouring rows are neighbouring in memory.
+//
+//------------------------------------------------------------------------------
+struct CsrMatrix
+{
+    int                 rows, cols;
+    std::vector<int>    row_ptr;    // rows + 1 offsets into col and val
+    std::vector<int>    col;
+    std::vector<float>  val;
+};
+
+struct EllMatrix
+{
+    int                 rows, cols, width;
+    std::vector<int>    col;        // width * rows, by columns
+    std::vector<float>  val;
+};
+
+//------------------------------------------------------------------------------
+//
+//  Functions to make a random sparse matrix with about density of its
+//  elements nonzero, to convert it to ELLPACK and to dense storage, and
+//  to multiply it by a dense matrix on the host: C(rows,N) = S * B(cols,N)
+//
+//------------------------------------------------------------------------------
+void makeSparse(int rows, int cols, float density, CsrMatrix& S);
+
+void csrToEll(const CsrMatrix& S, EllMatrix& E);
+
+void csrToDense(const CsrMatrix& S, HostMatrix& X);
+
+void csr_mat_mul(const CsrMatrix& S, int N, HostMatrix& B, HostMatrix& C);
+
+//------------------------------------------------------------------------------
+//
+//  Function to compute errors of the product matrix: the sum of the
+//  squared differences from K*AVAL*BVAL, or after useReference from
+//  the reference (relative to its sum of squares).  useReference(NULL)
+//  goes back to the constant.  C may be any M*N floats (as in SVM).
+//
+//------------------------------------------------------------------------------
+void useReference(const HostMatrix *ref);
+
+float error(int M, int N, int K, HostMatrix& C);
+float error(int M, int N, int K, const float *C);
+float error(int K, const PaddedMatrix& C);
 
 
 //------------------------------------------------------------------------------
@@ -55,6 +134,14 @@ float error(int N, std::vector<float>& C);
 //  Function to analyze and output results 
 //
 //------------------------------------------------------------------------------
-void results(int N, std::vector<float>& C, double run_time);
+void results(int M, int N, int K, HostMatrix& C, double run_time);
+
+//------------------------------------------------------------------------------
+//
+//  Function to describe the matrix sizes for banners ("order 1024" or
+//  "M=1000, N=500, K=700")
+//
+//------------------------------------------------------------------------------
+std::string sizeName(int M, int N, int K);
     
 #endif
@@ -0,0 +1,238 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Multi-device matrix multiplication
+//
+//  PURPOSE: Split C = A * B by blocks of rows across every device on a
+//           platform.  Each device gets its own queue and works on
+//           sub-buffers of A and C holding its rows; B is shared.
+//
+//           The first pass splits the rows evenly and times each device
+//           with event profiling.  The rows are then shared out again in
+//           proportion to the measured throughput (rows per second), and
+//           the second pass is the one reported.
+//
+//  USAGE:   ./mult --multi [--size M N K] [--device INDEX]
+//
+//           All the devices on the platform of the chosen device are
+//           used.  Each runs the blocked kernel with its own tuned
+//           parameters, if it has a tuning file.
+//
+//           ./mult --numa [--size M N K] [--device INDEX] splits the
+//           chosen device instead, into one sub-device per NUMA node
+//           (sub_devices.hpp), for a CPU runtime spread over several
+//           sockets.  Then each sub-device has buffers of its own: its
+//           rows of A, a copy of B and its rows of C, written through
+//           its own queue so the runtime can place them on its node,
+//           rather than sub-buffers of matrices on whichever node the
+//           one context put them.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the smallest number of rows whose sub-buffers of A
+//  (K columns) and C (N columns) start on a boundary every device
+//  accepts (CL_DEVICE_MEM_BASE_ADDR_ALIGN)
+//
+//------------------------------------------------------------------------------
+static int rowGranularity(const std::vector<cl::Device>& devices, int N, int K)
+{
+    cl_uint align = 0;
+    for (unsigned d = 0; d < devices.size(); d++)
+        align = std::max(align, devices[d].getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8);
+
+    int rows = 1;
+    while ((rows * K * sizeof(float)) % align != 0 || (rows * N * sizeof(float)) % align != 0)
+        rows++;
+    return rows;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to share M rows out in proportion to share[], in multiples
+//  of granularity (the last device takes whatever is left over)
+//
+//------------------------------------------------------------------------------
+static std::vector<int> splitRows(int M, const std::vector<double>& share, int granularity)
+{
+    std::vector<int> rows(share.size(), 0);
+    int left = M;
+
+    for (unsigned d = 0; d + 1 < share.size(); d++)
+    {
+        rows[d] = (int)(share[d] * M / granularity) * granularity;
+        rows[d] = std::min(rows[d], left);
+        left -= rows[d];
+    }
+    rows[share.size() - 1] = left;
+    return rows;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply the matrices across all the given devices
+//
+//------------------------------------------------------------------------------
+void multiDevice(const std::vector<cl::Device>& all_devices, int M, int N, int K,
+                 HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C, bool own_buffers)
+{
+    const Variant *variant = &findVariant(VARIANT_BLOCK);
+
+    // Drop devices that cannot run the kernel
+    std::vector<cl::Device> devices;
+    std::vector<util::TuningParams> params;
+    for (unsigned d = 0; d < all_devices.size(); d++)
+    {
+        util::TuningFile tuning(all_devices[d]);
+        util::TuningParams p = tuning.get(variant->name, defaultParams(*variant));
+        std::string invalid = checkParams(*variant, p, K, all_devices[d]);
+        if (!invalid.empty())
+        {
+            printf(" Not using %s: %s\n",
+                all_devices[d].getInfo<CL_DEVICE_NAME>().c_str(), invalid.c_str());
+            continue;
+        }
+        devices.push_back(all_devices[d]);
+        params.push_back(p);
+    }
+
+    if (devices.empty())
+    {
+        printf(" No device can run the %s kernel\n", variant->name);
+        return;
+    }
+
+    const unsigned ndev = devices.size();
+    cl::Context context(devices);
+
+    std::vector<cl::CommandQueue> queues;
+    std::vector<cl::Kernel> kernels;
+    for (unsigned d = 0; d < ndev; d++)
+    {
+        printf(" Device %u: %s\n", d, devices[d].getInfo<CL_DEVICE_NAME>().c_str());
+        queues.push_back(util::createProfilingQueue(context, devices[d]));
+        cl::Program program = buildVariant(context, devices[d], *variant, params[d]);
+        kernels.push_back(cl::Kernel(program, "mmul_mnk"));
+    }
+
+    // Whole matrices to take sub-buffers of, or B for each device
+    cl::Buffer d_a, d_c;
+    std::vector<cl::Buffer> d_b(ndev);
+    if (own_buffers)
+    {
+        for (unsigned d = 0; d < ndev; d++)
+        {
+            d_b[d] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * K * N);
+            queues[d].enqueueWriteBuffer(d_b[d], CL_FALSE, 0, sizeof(float) * K * N, &h_B[0]);
+        }
+    }
+    else
+    {
+        d_a = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                         sizeof(float) * M * K, &h_A[0]);
+        d_b.assign(ndev, cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                    sizeof(float) * K * N, &h_B[0]));
+        d_c = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * M * N);
+    }
+
+    // Buffers of their own can start on any row
+    const int granularity = own_buffers ? 1 : rowGranularity(devices, N, K);
+    std::vector<double> share(ndev, 1.0 / ndev);
+    std::vector<int> rows;
+    std::vector<cl::Buffer> d_a_rows(ndev), d_c_rows(ndev);
+    util::Timer timer;
+    double run_time = 0.0;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        rows = splitRows(M, share, granularity);
+
+        printf("\n %s pass:\n", pass == 0 ? "Calibration" : "Balanced");
+
+        // Buffers (or sub-buffers) of A and C for each device's rows
+        int first = 0;
+        for (unsigned d = 0; d < ndev; d++)
+        {
+            if (rows[d] == 0)
+                continue;
+
+            if (own_buffers)
+            {
+                d_a_rows[d] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * rows[d] * K);
+                d_c_rows[d] = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * rows[d] * N);
+                queues[d].enqueueWriteBuffer(d_a_rows[d], CL_FALSE, 0, sizeof(float) * rows[d] * K,
+                                             &h_A[first * K]);
+            }
+            else
+            {
+                cl_buffer_region a_region = { sizeof(float) * first * K, sizeof(float) * rows[d] * K };
+                cl_buffer_region c_region = { sizeof(float) * first * N, sizeof(float) * rows[d] * N };
+                d_a_rows[d] = d_a.createSubBuffer(CL_MEM_READ_ONLY,
+                                                  CL_BUFFER_CREATE_TYPE_REGION, &a_region);
+                d_c_rows[d] = d_c.createSubBuffer(CL_MEM_WRITE_ONLY,
+                                                  CL_BUFFER_CREATE_TYPE_REGION, &c_region);
+            }
+            first += rows[d];
+        }
+
+        // The copies are not part of the time
+        for (unsigned d = 0; d < ndev; d++)
+            queues[d].finish();
+
+        std::vector<cl::Event> events(ndev);
+        timer.reset();
+        for (unsigned d = 0; d < ndev; d++)
+        {
+            if (rows[d] == 0)
+                continue;
+
+            events[d] = enqueueVariant(queues[d], kernels[d], *variant, params[d],
+                                       rows[d], N, K, d_a_rows[d], d_b[d], d_c_rows[d]);
+            queues[d].flush();
+        }
+
+        for (unsigned d = 0; d < ndev; d++)
+            queues[d].finish();
+        run_time = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        // Throughput of each device decides the next split
+        double total = 0.0;
+        std::vector<double> rate(ndev, 0.0);
+        for (unsigned d = 0; d < ndev; d++)
+        {
+            if (rows[d] == 0)
+            {
+                printf("   device %u: no rows\n", d);
+                continue;
+            }
+            double seconds = util::eventSeconds(events[d]);
+            rate[d] = rows[d] / seconds;
+            total += rate[d];
+            printf("   device %u: %6d rows in %.4f seconds (%.1f MFLOPS)\n", d, rows[d],
+                seconds, 2.0 * rows[d] * N * K / (1000000.0f * seconds));
+        }
+        if (total > 0.0)
+            for (unsigned d = 0; d < ndev; d++)
+                share[d] = rate[d] / total;
+    }
+
+    // Gather the rows of C
+    int first = 0;
+    for (unsigned d = 0; d < ndev; d++)
+    {
+        if (rows[d] > 0)
+            queues[d].enqueueReadBuffer(d_c_rows[d], CL_TRUE, 0, sizeof(float) * rows[d] * N,
+                                        &h_C[first * N]);
+        first += rows[d];
+    }
+
+    printf("\n All devices:");
+    results(M, N, K, h_C, run_time);
+}
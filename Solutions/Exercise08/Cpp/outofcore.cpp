@@ -0,0 +1,256 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Out-of-core matrix multiplication
+//
+//  PURPOSE: Compute C = A * B for matrices larger than the device's
+//           memory, a tile of C at a time.  C is cut into T x T tiles
+//           and K into panels of P; the tile C(I,J) is the sum over
+//           the panels of A(I,panel) * B(panel,J), each product one
+//           launch of the blocked kernel.  The first panel stores its
+//           product, and the rest add theirs to the tile already on
+//           the device (the blocked kernel built with its EPI_BETA
+//           epilogue and beta = 1), so a tile is read back once.
+//
+//           The panels of A and B are cut out of the host matrices by
+//           rectangular copies and go through two pairs of ping-pong
+//           buffers, and the tiles of C through two more, so the
+//           device holds 2T^2 + 4TP floats whatever the sizes.  As in
+//           pipeline.cpp, one queue does the transfers and the other
+//           the kernels, with events between them: the panels of the
+//           next product upload, and the last tile downloads, while
+//           the kernel runs.  Each tile does 2T^2 K flops for 2TK
+//           floats of panels, so a large enough tile keeps the device
+//           busy whatever the speed of the link.
+//
+//  USAGE:   ./mult --out-of-core [--tile T] [--size M N K]
+//
+//           Without --tile, T is the largest multiple of the block
+//           size whose buffers (with P = T/2) take at most half of the
+//           device's global memory, and no one buffer is larger than
+//           the device allows.  If the whole product also fits on the
+//           device it is run in core as well, to compare.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to choose the tile: the largest multiple of blksz, no larger
+//  than the matrices need, whose buffers fit in half the global memory
+//
+//------------------------------------------------------------------------------
+static int chooseTile(const cl::Device& device, int M, int N, int blksz)
+{
+    const cl_ulong budget = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2;
+    const cl_ulong max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+    const int largest = ((std::max(M, N) + blksz - 1) / blksz) * blksz;
+
+    int tile = blksz;
+    for (int t = 2 * blksz; t <= largest; t += blksz)
+    {
+        // 2 C tiles (T^2) and 4 panels (T x T/2)
+        const cl_ulong bytes = sizeof(float) * 4 * (cl_ulong)t * t;
+        if (bytes > budget || sizeof(float) * (cl_ulong)t * t > max_alloc)
+            break;
+        tile = t;
+    }
+    return tile;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to describe a rectangle of a matrix stored by rows, for the
+//  rectangular copies: rows [row, row+rows) and cols [col, col+cols)
+//
+//------------------------------------------------------------------------------
+static void rect(int row, int col, int rows, int cols,
+                 cl::size_t<3>& origin, cl::size_t<3>& region)
+{
+    origin[0] = sizeof(float) * col;
+    origin[1] = row;
+    origin[2] = 0;
+    region[0] = sizeof(float) * cols;
+    region[1] = rows;
+    region[2] = 1;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply a tile of C at a time, returning the elapsed
+//  time in seconds
+//
+//------------------------------------------------------------------------------
+static double runTiles(const cl::Context& context, cl::CommandQueue& xfer,
+                       cl::CommandQueue& compute, cl::Kernel& store, cl::Kernel& accumulate,
+                       const Variant& variant, const util::TuningParams& params,
+                       int M, int N, int K, int tile, int panel,
+                       HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C)
+{
+    const int row_tiles = (M + tile - 1) / tile;
+    const int col_tiles = (N + tile - 1) / tile;
+    const int panels = (K + panel - 1) / panel;
+    const int steps = row_tiles * col_tiles * panels;
+
+    cl::Buffer d_a[2], d_b[2], d_c[2];
+    for (int b = 0; b < 2; b++)
+    {
+        d_a[b] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * tile * panel);
+        d_b[b] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * panel * tile);
+        d_c[b] = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * tile * tile);
+    }
+
+    // Add to C: alpha and bias are not compiled in, but must be set
+    accumulate.setArg(8, 1.0f);
+    accumulate.setArg(9, 1.0f);
+    accumulate.setArg(10, d_c[0]);
+
+    // Events of each step's uploads and kernel, and of each tile's download
+    std::vector<cl::Event> upload_a(steps), upload_b(steps), kernel_done(steps);
+    std::vector<cl::Event> download(row_tiles * col_tiles);
+    cl::size_t<3> zero, origin, region;
+    zero[0] = zero[1] = zero[2] = 0;
+
+    util::Timer timer;
+
+    for (int s = 0; s <= steps; s++)
+    {
+        // Upload the panels of step s, once the kernel two steps back
+        // is done with their buffers
+        if (s < steps)
+        {
+            const int t = s / panels, p = s % panels;
+            const int row = (t / col_tiles) * tile, col = (t % col_tiles) * tile;
+            const int rows = std::min(tile, M - row), cols = std::min(tile, N - col);
+            const int k = p * panel, depth = std::min(panel, K - k);
+
+            std::vector<cl::Event> wait;
+            if (s >= 2)
+                wait.push_back(kernel_done[s - 2]);
+
+            rect(row, k, rows, depth, origin, region);
+            xfer.enqueueWriteBufferRect(d_a[s % 2], CL_FALSE, zero, origin, region,
+                                        sizeof(float) * depth, 0, sizeof(float) * K, 0,
+                                        &h_A[0], wait.empty() ? NULL : &wait, &upload_a[s]);
+            rect(k, col, depth, cols, origin, region);
+            xfer.enqueueWriteBufferRect(d_b[s % 2], CL_FALSE, zero, origin, region,
+                                        sizeof(float) * cols, 0, sizeof(float) * N, 0,
+                                        &h_B[0], wait.empty() ? NULL : &wait, &upload_b[s]);
+            xfer.flush();
+        }
+
+        // Multiply step s-1 into its tile, and download the tile after
+        // its last panel
+        if (s >= 1)
+        {
+            const int q = s - 1;
+            const int t = q / panels, p = q % panels;
+            const int row = (t / col_tiles) * tile, col = (t % col_tiles) * tile;
+            const int rows = std::min(tile, M - row), cols = std::min(tile, N - col);
+            const int depth = std::min(panel, K - p * panel);
+
+            // The first panel of a tile waits for the download two tiles
+            // back to empty its C buffer
+            std::vector<cl::Event> wait;
+            wait.push_back(upload_a[q]);
+            wait.push_back(upload_b[q]);
+            if (p == 0 && t >= 2)
+                wait.push_back(download[t - 2]);
+
+            kernel_done[q] = enqueueVariant(compute, p == 0 ? store : accumulate, variant, params,
+                                            rows, cols, depth, d_a[q % 2], d_b[q % 2], d_c[t % 2],
+                                            &wait);
+            compute.flush();
+
+            if (p == panels - 1)
+            {
+                std::vector<cl::Event> after(1, kernel_done[q]);
+                rect(row, col, rows, cols, origin, region);
+                xfer.enqueueReadBufferRect(d_c[t % 2], CL_FALSE, zero, origin, region,
+                                           sizeof(float) * cols, 0, sizeof(float) * N, 0,
+                                           &h_C[0], &after, &download[t]);
+                xfer.flush();
+            }
+        }
+    }
+
+    xfer.finish();
+    compute.finish();
+
+    return static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the out-of-core product, and the in-core one if the
+//  matrices fit, and report both
+//
+//------------------------------------------------------------------------------
+void outOfCore(const cl::Context& context, const cl::Device& device,
+               const util::TuningFile& tuning, int M, int N, int K, int tile,
+               HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    // Whole blocks, so no work-group straddles two tiles' worth of work
+    const int blksz = params["blksz"];
+    if (tile <= 0)
+        tile = chooseTile(device, M, N, blksz);
+    tile = std::max(blksz, (tile / blksz) * blksz);
+    const int panel = std::max(blksz, (tile / 2 / blksz) * blksz);
+
+    const double device_mb = sizeof(float) * (2.0 * tile * tile + 4.0 * tile * panel) / 1.0e6;
+    const double total_mb = sizeof(float) * ((double)M * K + (double)K * N + (double)M * N) / 1.0e6;
+    printf(" Tiles of %d x %d, panels of %d: %.0f MB on the device for %.0f MB of matrices\n",
+           tile, tile, panel, device_mb, total_mb);
+
+    cl::CommandQueue xfer(context, device);
+    cl::CommandQueue compute(context, device);
+
+    cl::Program plain = buildVariant(context, device, variant, params);
+    cl::Program accum = util::buildProgramFile(context, device, variant.file,
+                                               variantOptions(variant, params) + " -D EPI_BETA");
+    cl::Kernel store(plain, "mmul_mnk");
+    cl::Kernel accumulate(accum, "mmul_mnk");
+
+    zero_mat(M, N, h_C);
+    double run_time = runTiles(context, xfer, compute, store, accumulate, variant, params,
+                               M, N, K, tile, panel, h_A, h_B, h_C);
+    printf(" %-24s", "Out of core (tiled)");
+    results(M, N, K, h_C, run_time);
+
+    // In core, with the copies, if the device can hold all three
+    const cl_ulong max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+    const cl_ulong largest = sizeof(float) * std::max((cl_ulong)M * K,
+                                                      std::max((cl_ulong)K * N, (cl_ulong)M * N));
+    if (total_mb * 1.0e6 > device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2 || largest > max_alloc)
+    {
+        printf(" %-24s does not fit on the device\n", "In core");
+        return;
+    }
+
+    zero_mat(M, N, h_C);
+    util::Timer timer;
+    cl::Buffer d_a(context, CL_MEM_READ_ONLY, sizeof(float) * M * K);
+    cl::Buffer d_b(context, CL_MEM_READ_ONLY, sizeof(float) * K * N);
+    cl::Buffer d_c(context, CL_MEM_WRITE_ONLY, sizeof(float) * M * N);
+    compute.enqueueWriteBuffer(d_a, CL_FALSE, 0, sizeof(float) * M * K, &h_A[0]);
+    compute.enqueueWriteBuffer(d_b, CL_FALSE, 0, sizeof(float) * K * N, &h_B[0]);
+    enqueueVariant(compute, store, variant, params, M, N, K, d_a, d_b, d_c);
+    compute.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    run_time = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+    printf(" %-24s", "In core");
+    results(M, N, K, h_C, run_time);
+}
@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Pipelined matrix multiplication
+//
+//  PURPOSE: Compute C = A * B a panel of rows at a time, overlapping the
+//           transfers with the computation.  B is copied to the device
+//           once; the panels of A and C go through two pairs of
+//           ping-pong buffers, so only two panels of each need to fit
+//           in device memory.
+//
+//           One queue does the transfers and the other the kernels.
+//           While panel i is being computed, panel i+1 of A is being
+//           uploaded and panel i-1 of C downloaded.  Events order the
+//           two queues: a buffer is not overwritten until the command
+//           reading it has finished.
+//
+//           For comparison the same panels are first run on a single
+//           queue, one step after the other.
+//
+//  USAGE:   ./mult --pipeline [--panel ROWS] [--size M N K]
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply the matrices in panels of rows, returning the
+//  elapsed time in seconds.  With overlap false everything runs in turn
+//  on the compute queue.
+//
+//------------------------------------------------------------------------------
+static double runPanels(const cl::Context& context, cl::CommandQueue& xfer,
+                        cl::CommandQueue& compute, cl::Kernel& kernel,
+                        const Variant& variant, const util::TuningParams& params,
+                        int M, int N, int K, int panel,
+                        HostMatrix& h_A, HostMatrix& h_B,
+                        HostMatrix& h_C, bool overlap)
+{
+    cl::CommandQueue& copyq = overlap ? xfer : compute;
+    const int npanels = (M + panel - 1) / panel;
+
+    cl::Buffer d_b(context, CL_MEM_READ_ONLY, sizeof(float) * K * N);
+    cl::Buffer d_a[2], d_c[2];
+    for (int b = 0; b < 2; b++)
+    {
+        d_a[b] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * panel * K);
+        d_c[b] = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * panel * N);
+    }
+
+    // Events of each panel's upload, kernel and download
+    std::vector<cl::Event> upload(npanels), kernel_done(npanels), download(npanels);
+
+    util::Timer timer;
+
+    copyq.enqueueWriteBuffer(d_b, CL_TRUE, 0, sizeof(float) * K * N, &h_B[0]);
+
+    for (int i = 0; i <= npanels; i++)
+    {
+        // Upload panel i of A, once the kernel two panels back is done with its buffer
+        if (i < npanels)
+        {
+            int rows = std::min(panel, M - i * panel);
+            std::vector<cl::Event> wait;
+            if (i >= 2)
+                wait.push_back(kernel_done[i - 2]);
+            copyq.enqueueWriteBuffer(d_a[i % 2], overlap ? CL_FALSE : CL_TRUE, 0,
+                                     sizeof(float) * rows * K, &h_A[i * panel * K],
+                                     wait.empty() ? NULL : &wait, &upload[i]);
+        }
+
+        // Compute panel i-1 and download it
+        if (i >= 1)
+        {
+            int p = i - 1;
+            int rows = std::min(panel, M - p * panel);
+
+            // The kernel waits for its A to arrive and for the download two
+            // panels back to empty its C buffer
+            std::vector<cl::Event> wait(1, upload[p]);
+            if (p >= 2)
+                wait.push_back(download[p - 2]);
+
+            kernel_done[p] = enqueueVariant(compute, kernel, variant, params,
+                                            rows, N, K, d_a[p % 2], d_b, d_c[p % 2], &wait);
+            if (overlap)
+                compute.flush();
+
+            std::vector<cl::Event> after(1, kernel_done[p]);
+            copyq.enqueueReadBuffer(d_c[p % 2], overlap ? CL_FALSE : CL_TRUE, 0,
+                                    sizeof(float) * rows * N, &h_C[p * panel * N],
+                                    &after, &download[p]);
+            if (overlap)
+                copyq.flush();
+        }
+    }
+
+    copyq.finish();
+    compute.finish();
+
+    return static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the serial and the pipelined versions and report both
+//
+//------------------------------------------------------------------------------
+void pipeline(const cl::Context& context, const cl::Device& device,
+              const util::TuningFile& tuning, int M, int N, int K, int panel,
+              HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    panel = std::max(1, std::min(panel, M));
+    printf(" %d panels of %d rows, %s kernel\n", (M + panel - 1) / panel, panel, variant.name);
+
+    cl::CommandQueue xfer(context, device);
+    cl::CommandQueue compute(context, device);
+
+    cl::Program program = buildVariant(context, device, variant, params);
+    cl::Kernel kernel(program, "mmul_mnk");
+
+    const char *names[] = { "Serial (one queue)", "Pipelined (two queues)" };
+    for (int overlap = 0; overlap < 2; overlap++)
+    {
+        zero_mat(M, N, h_C);
+        double run_time = runPanels(context, xfer, compute, kernel, variant, params,
+                                    M, N, K, panel, h_A, h_B, h_C, overlap != 0);
+        printf(" %-24s", names[overlap]);
+        results(M, N, K, h_C, run_time);
+    }
+}
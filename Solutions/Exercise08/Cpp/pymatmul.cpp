@@ -0,0 +1,558 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Python bindings for the matrix multiplication
+//
+//  PURPOSE: The matmul_ocl module: the C++ Runtime, its programs (so the
+//           binary cache of program_cache.hpp) and the tuned variants,
+//           from Python, where Exercise08/Python builds everything again
+//           with PyOpenCL.  Matrices are device buffers made with
+//           CL_MEM_ALLOC_HOST_PTR, which Python reads and writes through
+//           the buffer protocol: a memoryview of a Buffer maps it, with
+//           no copy where the device shares memory with the host, and
+//           letting go of the last view unmaps it again.
+//
+//  USAGE:   make python, then (Exercise08/Python/matmul_cpp.py):
+//
+//             import matmul_ocl
+//             rt = matmul_ocl.Runtime(0)        # device 0 of --list
+//             a = rt.buffer(N * N)              # floats
+//             with memoryview(a) as m:
+//                 m[:] = array.array('f', [3.0]) * (N * N)
+//             seconds = rt.matmul(a, b, c, N, N, N, "block")
+//             print(rt.tuned("block"))          # {'blksz': 16}
+//
+//             k = rt.kernel("vadd.cl", "vadd")  # any kernel, cached
+//             seconds = k.run(count, None, a, b, c, count)
+//
+//           matmul uses the parameters in the device's tuning file (or
+//           the defaults), as the driver does.  Kernel arguments are
+//           Buffers, ints (int) and floats (float); a buffer may not be
+//           used by the device while a view of it is open.  The kernels
+//           are the runtime's, so their arguments are shared.  The GIL is
+//           let go while waiting for the device.
+//
+//------------------------------------------------------------------------------
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "matmul.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+#include "device_picker.hpp"
+#include "err_code.h"
+
+#include <cstring>
+
+struct RuntimeObject
+{
+    PyObject_HEAD
+    util::Runtime    *runtime;
+    util::TuningFile *tuning;
+};
+
+struct BufferObject
+{
+    PyObject_HEAD
+    RuntimeObject *owner;       // kept alive for its queue
+    cl::Buffer    *buffer;
+    Py_ssize_t     count;       // floats
+    Py_ssize_t     stride;      // sizeof(float), for views that ask
+    float         *mapped;      // while exports > 0
+    int            exports;
+};
+
+struct KernelObject
+{
+    PyObject_HEAD
+    RuntimeObject *owner;
+    cl::Kernel    *kernel;
+};
+
+static PyTypeObject *RuntimeType, *BufferType, *KernelType;
+
+// Raise an OpenCL error as a RuntimeError, returning NULL
+static PyObject *raise(const cl::Error& err)
+{
+    PyErr_Format(PyExc_RuntimeError, "OpenCL error: %s returned %s", err.what(),
+                 err_code(err.err()));
+    return NULL;
+}
+
+static bool ready(RuntimeObject *self)
+{
+    if (self->runtime)
+        return true;
+    PyErr_SetString(PyExc_RuntimeError, "matmul_ocl.Runtime not initialised");
+    return false;
+}
+
+// The buffer of argument 'what', if it is not mapped
+static cl::Buffer *deviceBuffer(PyObject *obj, const char *what)
+{
+    BufferObject *buffer = (BufferObject *)obj;
+    if (buffer->exports > 0)
+    {
+        PyErr_Format(PyExc_BufferError,
+                     "%s is mapped: release its memoryview before the device uses it", what);
+        return NULL;
+    }
+    return buffer->buffer;
+}
+
+static const Variant *variantNamed(const char *name)
+{
+    for (int i = 0; i < NUM_VARIANTS; i++)
+        if (!strcmp(variants[i].name, name))
+            return &variants[i];
+    PyErr_Format(PyExc_ValueError, "no variant %s", name);
+    return NULL;
+}
+
+// A work size: an int, a tuple of one to three ints, or None
+static bool toRange(PyObject *obj, cl::NDRange& range)
+{
+    if (obj == Py_None)
+    {
+        range = cl::NullRange;
+        return true;
+    }
+
+    ::size_t d[3] = { 1, 1, 1 };
+    Py_ssize_t n = 1;
+    if (PyLong_Check(obj))
+        d[0] = PyLong_AsSize_t(obj);
+    else if (PyTuple_Check(obj) && PyTuple_Size(obj) >= 1 && PyTuple_Size(obj) <= 3)
+    {
+        n = PyTuple_Size(obj);
+        for (Py_ssize_t i = 0; i < n; i++)
+            d[i] = PyLong_AsSize_t(PyTuple_GetItem(obj, i));
+    }
+    else
+    {
+        PyErr_SetString(PyExc_TypeError, "a work size is an int, a tuple of 1 to 3 ints or None");
+        return false;
+    }
+    if (PyErr_Occurred())
+        return false;
+
+    range = n == 1 ? cl::NDRange(d[0]) : n == 2 ? cl::NDRange(d[0], d[1])
+                                                : cl::NDRange(d[0], d[1], d[2]);
+    return true;
+}
+
+// Wait for a kernel without the GIL, returning its device time
+static PyObject *waitSeconds(cl::Event& event)
+{
+    cl_int err = CL_SUCCESS;
+    Py_BEGIN_ALLOW_THREADS
+    err = event.wait();
+    Py_END_ALLOW_THREADS
+    if (err != CL_SUCCESS)
+        return raise(cl::Error(err, "clWaitForEvents"));
+    return PyFloat_FromDouble(util::eventSeconds(event));
+}
+
+//------------------------------------------------------------------------------
+//
+//  Buffer: n floats of device memory, viewed from Python by mapping
+//
+//------------------------------------------------------------------------------
+static void Buffer_dealloc(BufferObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete self->buffer;
+    Py_XDECREF(self->owner);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static int Buffer_getbuffer(BufferObject *self, Py_buffer *view, int flags)
+{
+    const ::size_t bytes = sizeof(float) * self->count;
+    if (self->exports == 0)
+    {
+        try
+        {
+            self->mapped = (float *)self->owner->runtime->queue().enqueueMapBuffer(
+                *self->buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes);
+        } catch (cl::Error err)
+        {
+            view->obj = NULL;
+            raise(err);
+            return -1;
+        }
+    }
+    self->exports++;
+
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->buf = self->mapped;
+    view->len = bytes;
+    view->readonly = 0;
+    view->itemsize = sizeof(float);
+    view->format = (flags & PyBUF_FORMAT) ? (char *)"f" : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->count : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->stride : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void Buffer_releasebuffer(BufferObject *self, Py_buffer *)
+{
+    if (--self->exports > 0)
+        return;
+    try
+    {
+        self->owner->runtime->queue().enqueueUnmapMemObject(*self->buffer, self->mapped);
+    } catch (cl::Error)
+    {
+        // Nowhere to report it; the next map or launch will fail instead
+    }
+    self->mapped = NULL;
+}
+
+static Py_ssize_t Buffer_length(BufferObject *self)
+{
+    return self->count;
+}
+
+static PyType_Slot buffer_slots[] =
+{
+    { Py_tp_dealloc,      (void *)Buffer_dealloc },
+    { Py_tp_doc,          (void *)"n floats of device memory; memoryview() maps it" },
+    { Py_bf_getbuffer,    (void *)Buffer_getbuffer },
+    { Py_bf_releasebuffer, (void *)Buffer_releasebuffer },
+    { Py_sq_length,       (void *)Buffer_length },
+    { 0, NULL }
+};
+
+//------------------------------------------------------------------------------
+//
+//  Kernel: a kernel built by the runtime, run with arguments from Python
+//
+//------------------------------------------------------------------------------
+static void Kernel_dealloc(KernelObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete self->kernel;
+    Py_XDECREF(self->owner);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+// run(global, local, *args): set the arguments, launch, wait, return seconds
+static PyObject *Kernel_run(KernelObject *self, PyObject *args)
+{
+    Py_ssize_t nargs = PyTuple_Size(args);
+    if (nargs < 2)
+    {
+        PyErr_SetString(PyExc_TypeError, "run(global, local, *args)");
+        return NULL;
+    }
+
+    cl::NDRange global, local;
+    if (!toRange(PyTuple_GetItem(args, 0), global) || !toRange(PyTuple_GetItem(args, 1), local))
+        return NULL;
+
+    try
+    {
+        for (Py_ssize_t i = 2; i < nargs; i++)
+        {
+            PyObject *arg = PyTuple_GetItem(args, i);
+            cl_uint index = (cl_uint)(i - 2);
+            if (PyObject_TypeCheck(arg, BufferType))
+            {
+                cl::Buffer *buffer = deviceBuffer(arg, "a kernel argument");
+                if (!buffer)
+                    return NULL;
+                self->kernel->setArg(index, *buffer);
+            }
+            else if (PyFloat_Check(arg))
+                self->kernel->setArg(index, (cl_float)PyFloat_AsDouble(arg));
+            else if (PyLong_Check(arg))
+            {
+                long value = PyLong_AsLong(arg);
+                if (PyErr_Occurred())
+                    return NULL;
+                self->kernel->setArg(index, (cl_int)value);
+            }
+            else
+            {
+                PyErr_Format(PyExc_TypeError, "kernel argument %d is not a Buffer, int or float",
+                             (int)index);
+                return NULL;
+            }
+        }
+
+        cl::Event event;
+        self->owner->runtime->queue().enqueueNDRangeKernel(*self->kernel, cl::NullRange,
+                                                           global, local, NULL, &event);
+        return waitSeconds(event);
+    } catch (cl::Error err)
+    {
+        return raise(err);
+    }
+}
+
+static PyMethodDef kernel_methods[] =
+{
+    { "run", (PyCFunction)Kernel_run, METH_VARARGS,
+      "run(global, local, *args): launch, wait and return the kernel's seconds" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot kernel_slots[] =
+{
+    { Py_tp_dealloc, (void *)Kernel_dealloc },
+    { Py_tp_doc,     (void *)"A kernel built by a Runtime" },
+    { Py_tp_methods, (void *)kernel_methods },
+    { 0, NULL }
+};
+
+//------------------------------------------------------------------------------
+//
+//  Runtime: util::Runtime on one device, with its tuning file
+//
+//------------------------------------------------------------------------------
+static int Runtime_init(RuntimeObject *self, PyObject *args, PyObject *kwds)
+{
+    unsigned int index = 0;
+    static const char *keywords[] = { "device", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", (char **)keywords, &index))
+        return -1;
+
+    try
+    {
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+        if (index >= numDevices)
+        {
+            PyErr_Format(PyExc_IndexError, "no device %u (there are %u)", index, numDevices);
+            return -1;
+        }
+        delete self->runtime;
+        delete self->tuning;
+        self->runtime = new util::Runtime(devices[index], CL_QUEUE_PROFILING_ENABLE);
+        self->tuning = new util::TuningFile(devices[index]);
+    } catch (cl::Error err)
+    {
+        raise(err);
+        return -1;
+    }
+    return 0;
+}
+
+static void Runtime_dealloc(RuntimeObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete self->tuning;
+    delete self->runtime;
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *Runtime_device_name(RuntimeObject *self, PyObject *)
+{
+    if (!ready(self))
+        return NULL;
+    std::string name;
+    getDeviceName(self->runtime->device(), name);
+    return PyUnicode_FromString(name.c_str());
+}
+
+static PyObject *Runtime_buffer(RuntimeObject *self, PyObject *args)
+{
+    Py_ssize_t count;
+    if (!ready(self) || !PyArg_ParseTuple(args, "n", &count))
+        return NULL;
+    if (count < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "a buffer holds at least one float");
+        return NULL;
+    }
+
+    BufferObject *buffer = PyObject_New(BufferObject, BufferType);
+    if (!buffer)
+        return NULL;
+    buffer->owner = self;
+    Py_INCREF(self);
+    buffer->buffer = NULL;
+    buffer->count = count;
+    buffer->stride = sizeof(float);
+    buffer->mapped = NULL;
+    buffer->exports = 0;
+    try
+    {
+        buffer->buffer = new cl::Buffer(self->runtime->context(),
+                                        CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                        sizeof(float) * count);
+    } catch (cl::Error err)
+    {
+        Py_DECREF(buffer);
+        return raise(err);
+    }
+    return (PyObject *)buffer;
+}
+
+static PyObject *Runtime_tuned(RuntimeObject *self, PyObject *args)
+{
+    const char *name;
+    if (!ready(self) || !PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    const Variant *variant = variantNamed(name);
+    if (!variant)
+        return NULL;
+
+    util::TuningParams params = self->tuning->get(variant->name, defaultParams(*variant));
+    PyObject *dict = PyDict_New();
+    for (util::TuningParams::const_iterator p = params.begin(); dict && p != params.end(); ++p)
+    {
+        PyObject *value = PyLong_FromLong(p->second);
+        if (!value || PyDict_SetItemString(dict, p->first.c_str(), value) < 0)
+            Py_CLEAR(dict);
+        Py_XDECREF(value);
+    }
+    return dict;
+}
+
+static PyObject *Runtime_matmul(RuntimeObject *self, PyObject *args)
+{
+    PyObject *a, *b, *c;
+    int M, N, K;
+    const char *name = "block";
+    if (!ready(self) ||
+        !PyArg_ParseTuple(args, "O!O!O!iii|s", BufferType, &a, BufferType, &b, BufferType, &c,
+                          &M, &N, &K, &name))
+        return NULL;
+    const Variant *variant = variantNamed(name);
+    if (!variant)
+        return NULL;
+    if (M < 1 || N < 1 || K < 1 || ((BufferObject *)a)->count < (Py_ssize_t)M * K ||
+        ((BufferObject *)b)->count < (Py_ssize_t)K * N ||
+        ((BufferObject *)c)->count < (Py_ssize_t)M * N)
+    {
+        PyErr_SetString(PyExc_ValueError, "the buffers are too small for M, N and K");
+        return NULL;
+    }
+
+    cl::Buffer *d_a = deviceBuffer(a, "A"), *d_b = d_a ? deviceBuffer(b, "B") : NULL;
+    cl::Buffer *d_c = d_b ? deviceBuffer(c, "C") : NULL;
+    if (!d_c)
+        return NULL;
+
+    try
+    {
+        util::Runtime& runtime = *self->runtime;
+        util::TuningParams params = self->tuning->get(variant->name, defaultParams(*variant));
+        std::string invalid = checkParams(*variant, params, K, runtime.device());
+        if (!invalid.empty())
+        {
+            PyErr_Format(PyExc_ValueError, "%s cannot be used: %s", variant->name, invalid.c_str());
+            return NULL;
+        }
+        cl::Kernel& kernel = variantKernel(runtime, *variant, params);
+        cl::Event event = enqueueVariant(runtime.queue(), kernel, *variant, params, M, N, K,
+                                         *d_a, *d_b, *d_c);
+        return waitSeconds(event);
+    } catch (cl::Error err)
+    {
+        return raise(err);
+    }
+}
+
+static PyObject *Runtime_kernel(RuntimeObject *self, PyObject *args)
+{
+    const char *file, *name, *options = "";
+    if (!ready(self) || !PyArg_ParseTuple(args, "ss|s", &file, &name, &options))
+        return NULL;
+
+    KernelObject *kernel = PyObject_New(KernelObject, KernelType);
+    if (!kernel)
+        return NULL;
+    kernel->owner = self;
+    Py_INCREF(self);
+    kernel->kernel = NULL;
+    try
+    {
+        kernel->kernel = new cl::Kernel(self->runtime->kernel(file, name, options));
+    } catch (cl::Error err)
+    {
+        Py_DECREF(kernel);
+        return raise(err);
+    }
+    return (PyObject *)kernel;
+}
+
+static PyMethodDef runtime_methods[] =
+{
+    { "device_name", (PyCFunction)Runtime_device_name, METH_NOARGS,
+      "device_name(): the name of the runtime's device" },
+    { "buffer", (PyCFunction)Runtime_buffer, METH_VARARGS,
+      "buffer(n): a Buffer of n floats" },
+    { "tuned", (PyCFunction)Runtime_tuned, METH_VARARGS,
+      "tuned(variant): the variant's parameters, from the tuning file or the defaults" },
+    { "matmul", (PyCFunction)Runtime_matmul, METH_VARARGS,
+      "matmul(a, b, c, M, N, K, variant='block'): C = A * B, returning the kernel's seconds" },
+    { "kernel", (PyCFunction)Runtime_kernel, METH_VARARGS,
+      "kernel(file_or_source, name, options=''): a Kernel, built once and cached" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot runtime_slots[] =
+{
+    { Py_tp_init,    (void *)Runtime_init },
+    { Py_tp_new,     (void *)PyType_GenericNew },
+    { Py_tp_dealloc, (void *)Runtime_dealloc },
+    { Py_tp_doc,     (void *)"Runtime(device=0): the C++ runtime on a device of --list" },
+    { Py_tp_methods, (void *)runtime_methods },
+    { 0, NULL }
+};
+
+#ifdef Py_TPFLAGS_DISALLOW_INSTANTIATION
+#define MADE_BY_RUNTIME Py_TPFLAGS_DISALLOW_INSTANTIATION
+#else
+#define MADE_BY_RUNTIME 0
+#endif
+
+static PyType_Spec runtime_spec =
+    { "matmul_ocl.Runtime", sizeof(RuntimeObject), 0, Py_TPFLAGS_DEFAULT, runtime_slots };
+static PyType_Spec buffer_spec =
+    { "matmul_ocl.Buffer", sizeof(BufferObject), 0, Py_TPFLAGS_DEFAULT | MADE_BY_RUNTIME,
+      buffer_slots };
+static PyType_Spec kernel_spec =
+    { "matmul_ocl.Kernel", sizeof(KernelObject), 0, Py_TPFLAGS_DEFAULT | MADE_BY_RUNTIME,
+      kernel_slots };
+
+static PyModuleDef matmul_module =
+{
+    PyModuleDef_HEAD_INIT, "matmul_ocl",
+    "The C++ OpenCL runtime, program cache and tuned matrix multiplication", -1,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_matmul_ocl(void)
+{
+    RuntimeType = (PyTypeObject *)PyType_FromSpec(&runtime_spec);
+    BufferType = (PyTypeObject *)PyType_FromSpec(&buffer_spec);
+    KernelType = (PyTypeObject *)PyType_FromSpec(&kernel_spec);
+    if (!RuntimeType || !BufferType || !KernelType)
+        return NULL;
+
+    PyObject *module = PyModule_Create(&matmul_module);
+    if (!module)
+        return NULL;
+    Py_INCREF(RuntimeType);
+    Py_INCREF(BufferType);
+    Py_INCREF(KernelType);
+    if (PyModule_AddObject(module, "Runtime", (PyObject *)RuntimeType) < 0 ||
+        PyModule_AddObject(module, "Buffer", (PyObject *)BufferType) < 0 ||
+        PyModule_AddObject(module, "Kernel", (PyObject *)KernelType) < 0)
+    {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
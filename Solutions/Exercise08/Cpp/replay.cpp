@@ -0,0 +1,444 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Replay of a logged workload
+//
+//  PURPOSE: Run again the kernels the drivers logged with OCL_WORKLOAD
+//           (workload.hpp): the matrix multiplications of mult (the
+//           blocked variant, at each M N K), the vector additions of
+//           vadd_chain (at each length) and the boards of gameoflife (nx
+//           by ny, for the generations logged), all through one shared
+//           util::Runtime, so its programs, kernels and buffer pool serve
+//           a realistic mix of requests the way they would in a service.
+//
+//           Each request writes its inputs from the host, runs and reads
+//           its result back, from buffers acquire()d from the runtime's
+//           pool and released after.  Its latency is from its arrival to
+//           its result being on the host.  At the recorded rate a
+//           request arrives when it did in the log (less the time of the
+//           first, divided by --speed), and if the device is still busy
+//           with earlier ones it waits, so the latency includes the time
+//           queued behind them.  At the maximum rate each arrives as the
+//           one before finishes, and the latency is its service time.
+//
+//           The report gives, for each kernel and for the whole replay,
+//           the requests a second, the median, 90th and 99th percentile
+//           and worst latency, the mean device time of the kernels and
+//           the work done a second; with the recorded rate, also how many
+//           requests had to wait.
+//
+//  USAGE:   ./replay work.log [--rate recorded|max] [--speed X] [--cold]
+//                             [--device INDEX]
+//
+//           Programs are built before the replay starts, unless --cold,
+//           when the first request of each kernel pays for the build (or
+//           the load from the binary cache).  The log may have been made
+//           on other devices: it is all replayed on the one chosen, and
+//           the number of requests logged elsewhere is reported.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "variants.hpp"
+#include "err_code.h"
+#include "device_picker.hpp"
+#include "profiler.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+
+#define LIFE_BLOCK 16       // work-items a side of the accelerate_life blocks
+#define VADD_GROUP 256      // global size of vadd is rounded up to this
+
+// One request as replayed
+struct Replayed
+{
+    double latency;         // seconds, arrival to result on the host
+    double device;          // seconds the kernels ran
+    double work;            // flops, bytes or cell updates
+    bool   waited;          // arrived while the device was busy
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the p'th percentile of sorted times (nearest rank)
+//
+//------------------------------------------------------------------------------
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    int rank = (int)ceil(p / 100.0 * sorted.size()) - 1;
+    rank = std::max(0, std::min(rank, (int)sorted.size() - 1));
+    return sorted[rank];
+}
+
+//------------------------------------------------------------------------------
+//
+//  The replay: the runtime, its tuning and a host copy of inputs and
+//  results large enough for the largest request so far
+//
+//------------------------------------------------------------------------------
+class Replayer
+{
+public:
+    Replayer(util::Runtime& runtime, const util::TuningFile& tuning)
+        : runtime_(runtime), queue_(runtime.queue()), pool_(runtime.pool()),
+          pinned_(runtime.context(), runtime.queue()),
+          variant_(findVariant(VARIANT_BLOCK)),
+          params_(tuning.get(variant_.name, defaultParams(variant_)))
+    {
+    }
+
+    //! The kernels a log of these entries needs, built before the replay
+    void prebuild(const std::vector<util::WorkloadEntry>& entries)
+    {
+        std::vector<util::Runtime::Build> builds;
+        builds.push_back(util::Runtime::Build(variant_.file, variantOptions(variant_, params_)));
+        builds.push_back(util::Runtime::Build("vadd_chain.cl", ""));
+        builds.push_back(util::Runtime::Build("gameoflife.cl", ""));
+        runtime_.prebuild(builds);
+
+        for (unsigned int e = 0; e < entries.size(); e++)
+            known(entries[e]);
+        if (kinds_.count("matmul"))
+            variantKernel(runtime_, variant_, params_);
+        if (kinds_.count("vadd"))
+            runtime_.kernel("vadd_chain.cl", "vadd");
+        if (kinds_.count("life"))
+            runtime_.kernel("gameoflife.cl", "accelerate_life");
+    }
+
+    //! Whether an entry is a kernel, with sizes, that can be replayed
+    bool known(const util::WorkloadEntry& entry)
+    {
+        const std::vector<long>& s = entry.sizes;
+        bool ok = false;
+        if (entry.kernel == "matmul")
+            ok = s.size() == 3 && s[0] > 0 && s[1] > 0 && s[2] > 0;
+        else if (entry.kernel == "vadd")
+            ok = s.size() == 1 && s[0] > 0;
+        else if (entry.kernel == "life")
+            ok = s.size() == 3 && s[0] > 0 && s[1] > 0 && s[2] > 0;
+        if (ok)
+            kinds_[entry.kernel] = true;
+        return ok;
+    }
+
+    //! Run one request, returning the device time of its kernels and
+    //! setting the work it did
+    double run(const util::WorkloadEntry& entry, double *work)
+    {
+        const std::vector<long>& s = entry.sizes;
+        if (entry.kernel == "matmul")
+            return matmul((int)s[0], (int)s[1], (int)s[2], work);
+        if (entry.kernel == "vadd")
+            return vadd((unsigned int)s[0], work);
+        return life((unsigned int)s[0], (unsigned int)s[1], (unsigned int)s[2], work);
+    }
+
+private:
+    util::Runtime&               runtime_;
+    cl::CommandQueue&            queue_;
+    util::BufferPool&            pool_;
+    util::PinnedAllocator<float> pinned_;
+    const Variant&               variant_;
+    util::TuningParams           params_;
+    HostMatrix                   in_, out_;
+    std::map<std::string, bool>  kinds_;
+
+    // Host memory of at least in and out floats
+    void reserve(::size_t in, ::size_t out)
+    {
+        if (in_.size() < in)
+            in_ = HostMatrix(in, 1.0f, pinned_);
+        if (out_.size() < out)
+            out_ = HostMatrix(out, 0.0f, pinned_);
+    }
+
+    double matmul(int M, int N, int K, double *work)
+    {
+        std::string invalid = checkParams(variant_, params_, K, runtime_.device());
+        if (!invalid.empty())
+            throw cl::Error(CL_INVALID_VALUE, "the blocked kernel cannot run at this K");
+
+        reserve(std::max((::size_t)M * K, (::size_t)K * N), (::size_t)M * N);
+        cl::Kernel& kernel = variantKernel(runtime_, variant_, params_);
+        cl::Buffer d_a = pool_.acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+        cl::Buffer d_b = pool_.acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+        cl::Buffer d_c = pool_.acquire(sizeof(float) * M * N, CL_MEM_WRITE_ONLY);
+
+        queue_.enqueueWriteBuffer(d_a, CL_FALSE, 0, sizeof(float) * M * K, &in_[0]);
+        queue_.enqueueWriteBuffer(d_b, CL_FALSE, 0, sizeof(float) * K * N, &in_[0]);
+        cl::Event event = enqueueVariant(queue_, kernel, variant_, params_, M, N, K, d_a, d_b, d_c);
+        queue_.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &out_[0]);
+
+        pool_.release(d_a);
+        pool_.release(d_b);
+        pool_.release(d_c);
+        *work = 2.0 * M * N * K;
+        return util::eventSeconds(event);
+    }
+
+    double vadd(unsigned int count, double *work)
+    {
+        reserve(count, count);
+        cl::Kernel& kernel = runtime_.kernel("vadd_chain.cl", "vadd");
+        const ::size_t bytes = sizeof(float) * count;
+        cl::Buffer d_a = pool_.acquire(bytes, CL_MEM_READ_ONLY);
+        cl::Buffer d_b = pool_.acquire(bytes, CL_MEM_READ_ONLY);
+        cl::Buffer d_c = pool_.acquire(bytes, CL_MEM_WRITE_ONLY);
+
+        queue_.enqueueWriteBuffer(d_a, CL_FALSE, 0, bytes, &in_[0]);
+        queue_.enqueueWriteBuffer(d_b, CL_FALSE, 0, bytes, &in_[0]);
+        kernel.setArg(0, d_a);
+        kernel.setArg(1, d_b);
+        kernel.setArg(2, d_c);
+        kernel.setArg(3, count);
+        cl::Event event;
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                    cl::NDRange((count + VADD_GROUP - 1) / VADD_GROUP * VADD_GROUP),
+                                    cl::NullRange, NULL, &event);
+        queue_.enqueueReadBuffer(d_c, CL_TRUE, 0, bytes, &out_[0]);
+
+        pool_.release(d_a);
+        pool_.release(d_b);
+        pool_.release(d_c);
+        *work = 3.0 * bytes;
+        return util::eventSeconds(event);
+    }
+
+    double life(unsigned int nx, unsigned int ny, unsigned int generations, double *work)
+    {
+        // A board of chars, in the floats of the host copy
+        const ::size_t bytes = sizeof(char) * nx * ny;
+        reserve(0, (bytes + sizeof(float) - 1) / sizeof(float));
+        cl::Kernel& kernel = runtime_.kernel("gameoflife.cl", "accelerate_life");
+        cl::Buffer tick = pool_.acquire(bytes, CL_MEM_READ_WRITE);
+        cl::Buffer tock = pool_.acquire(bytes, CL_MEM_READ_WRITE);
+
+        // Blocks as square as the kernel allows
+        ::size_t side = LIFE_BLOCK;
+        const ::size_t max_group =
+            kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(runtime_.device());
+        while (side > 1 && side * side > max_group)
+            side /= 2;
+        cl::NDRange global((nx + side - 1) / side * side, (ny + side - 1) / side * side);
+        cl::NDRange local(side, side);
+
+        std::fill(out_.begin(), out_.begin() + (bytes + sizeof(float) - 1) / sizeof(float), 0.0f);
+        queue_.enqueueWriteBuffer(tick, CL_FALSE, 0, bytes, &out_[0]);
+        kernel.setArg(2, nx);
+        kernel.setArg(3, ny);
+        kernel.setArg(4, cl::Local(sizeof(char) * (side + 2) * (side + 2)));
+
+        std::vector<cl::Event> events(generations);
+        for (unsigned int g = 0; g < generations; g++)
+        {
+            kernel.setArg(0, g % 2 ? tock : tick);
+            kernel.setArg(1, g % 2 ? tick : tock);
+            queue_.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, NULL, &events[g]);
+        }
+        queue_.enqueueReadBuffer(generations % 2 ? tock : tick, CL_TRUE, 0, bytes, &out_[0]);
+
+        pool_.release(tick);
+        pool_.release(tock);
+        *work = (double)nx * ny * generations;
+        double seconds = 0.0;
+        for (unsigned int g = 0; g < generations; g++)
+            seconds += util::eventSeconds(events[g]);
+        return seconds;
+    }
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to print one line of the report for a set of requests
+//
+//------------------------------------------------------------------------------
+static void report(const std::string& name, const std::vector<Replayed>& done, double span,
+                   const char *unit, bool recorded)
+{
+    std::vector<double> latency;
+    double device = 0.0, work = 0.0;
+    int waited = 0;
+    for (unsigned int r = 0; r < done.size(); r++)
+    {
+        latency.push_back(done[r].latency);
+        device += done[r].device;
+        work += done[r].work;
+        waited += done[r].waited;
+    }
+    std::sort(latency.begin(), latency.end());
+
+    printf(" %-8s %7u %9.2f %10.3f %10.3f %10.3f %10.3f %11.3f %9.2f %-8s",
+        name.c_str(), (unsigned int)done.size(), done.size() / span,
+        1.0e3 * percentile(latency, 50.0), 1.0e3 * percentile(latency, 90.0),
+        1.0e3 * percentile(latency, 99.0), 1.0e3 * latency.back(),
+        1.0e3 * device / done.size(), work / span * 1.0e-9, unit);
+    if (recorded)
+        printf(" %6d", waited);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        cl_uint deviceIndex = 0;
+        parseArguments(argc, argv, &deviceIndex,
+            "      --rate       R       recorded (the log's arrivals) or max (default)\n"
+            "      --speed      X       Arrivals X times as fast as logged (default 1)\n"
+            "      --cold               Build each program on its first request\n");
+
+        const char *log = NULL;
+        bool recorded = false, cold = false;
+        double speed = 1.0;
+        for (int i = 1; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--rate") && i + 1 < argc)
+                recorded = !strcmp(argv[++i], "recorded");
+            else if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+                speed = atof(argv[++i]);
+            else if (!strcmp(argv[i], "--cold"))
+                cold = true;
+            else if (!strcmp(argv[i], "--device") || !strcmp(argv[i], "--device-type"))
+                i++;
+            else if (argv[i][0] != '-')
+                log = argv[i];
+        }
+        if (log == NULL || speed <= 0.0)
+        {
+            std::cout << "Usage: ./replay work.log [--rate recorded|max] [--speed X] [--cold]\n";
+            return EXIT_FAILURE;
+        }
+
+        std::vector<util::WorkloadEntry> entries;
+        if (!util::readWorkload(log, entries) || entries.empty())
+        {
+            std::cout << "No requests in " << log << "\n";
+            return EXIT_FAILURE;
+        }
+
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+        if (deviceIndex >= numDevices)
+        {
+            std::cout << "Invalid device index (try '--list')\n";
+            return EXIT_FAILURE;
+        }
+        cl::Device device = devices[deviceIndex];
+
+        std::string name;
+        getDeviceName(device, name);
+        std::cout << "\nUsing OpenCL device: " << name << "\n";
+
+        util::Runtime runtime(device, CL_QUEUE_PROFILING_ENABLE);
+        util::TuningFile tuning(device);
+        Replayer replayer(runtime, tuning);
+
+        int skipped = 0, elsewhere = 0;
+        std::vector<util::WorkloadEntry> requests;
+        for (unsigned int e = 0; e < entries.size(); e++)
+        {
+            if (!replayer.known(entries[e]))
+            {
+                skipped++;
+                continue;
+            }
+            elsewhere += entries[e].device != device.getInfo<CL_DEVICE_NAME>();
+            requests.push_back(entries[e]);
+        }
+        if (!cold)
+            replayer.prebuild(requests);
+
+        printf("\n===== Replay of %u requests from %s, %s ======\n", (unsigned int)requests.size(),
+            log, recorded ? "at the recorded rate" : "at the maximum rate");
+        if (recorded && speed != 1.0)
+            printf(" Arrivals %.2f times as fast as logged\n", speed);
+        if (skipped)
+            printf(" %d lines of unknown kernels or sizes not replayed\n", skipped);
+        if (elsewhere)
+            printf(" %d requests were logged on other devices\n", elsewhere);
+
+        // Replay in order, one request at a time
+        typedef std::chrono::steady_clock clock;
+        const clock::time_point start = clock::now();
+        std::map<std::string, std::vector<Replayed> > done;
+        std::vector<Replayed> all;
+        int failed = 0;
+        for (unsigned int r = 0; r < requests.size(); r++)
+        {
+            const util::WorkloadEntry& request = requests[r];
+            clock::time_point arrival = clock::now();
+            bool waited = false;
+            if (recorded)
+            {
+                const double offset = (request.time - requests[0].time) / speed;
+                const clock::time_point due = start +
+                    std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(offset));
+                if (arrival < due)
+                {
+                    std::this_thread::sleep_until(due);
+                    arrival = clock::now();
+                }
+                else
+                {
+                    waited = true;
+                    arrival = due;
+                }
+            }
+
+            Replayed replayed;
+            try
+            {
+                replayed.device = replayer.run(request, &replayed.work);
+            }
+            catch (cl::Error err)
+            {
+                printf(" Request %u (%s) failed: %s (%d)\n", r, request.kernel.c_str(),
+                    err.what(), err.err());
+                failed++;
+                continue;
+            }
+            replayed.latency = std::chrono::duration<double>(clock::now() - arrival).count();
+            replayed.waited = waited;
+            done[request.kernel].push_back(replayed);
+            all.push_back(replayed);
+        }
+        const double span = std::chrono::duration<double>(clock::now() - start).count();
+
+        if (all.empty())
+        {
+            printf(" No request ran\n");
+            return EXIT_FAILURE;
+        }
+
+        printf("\n %-8s %7s %9s %10s %10s %10s %10s %11s %18s", "kernel", "count", "req/s",
+            "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)", "device(ms)", "work/s");
+        if (recorded)
+            printf(" %6s", "waited");
+        printf("\n");
+
+        const char *units[][2] = { { "matmul", "GFLOP/s" }, { "vadd", "GB/s" },
+                                   { "life", "Gcells/s" } };
+        for (unsigned int k = 0; k < 3; k++)
+            if (done.count(units[k][0]))
+                report(units[k][0], done[units[k][0]], span, units[k][1], recorded);
+        if (done.size() > 1)
+            report("all", all, span, "", recorded);
+
+        printf("\n %u requests in %.3f seconds", (unsigned int)all.size(), span);
+        if (failed)
+            printf(", %d failed", failed);
+        printf("\n");
+        runtime.pool().print();
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    catch (cl::Error err)
+    {
+        std::cout << "Exception\n";
+        std::cerr << "ERROR: " << err.what() << "(" << err_code(err.err()) << ")" << std::endl;
+    }
+    return EXIT_FAILURE;
+}
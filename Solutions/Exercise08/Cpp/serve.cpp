@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplications served to many host threads at once
+//
+//  PURPOSE: Stand in for a service with requests arriving on several
+//           threads: SERVE_CLIENTS client threads each submit their share
+//           of JOBS multiplications to a util::Executor (executor.hpp),
+//           whose threads each have a queue and a copy of the blocked
+//           kernel of their own.  A job makes its own buffers, copies A
+//           and B in, multiplies, reads C back and checks it, so jobs
+//           share nothing but the context and the program, and none of
+//           them waits on a lock while another is using the device.
+//
+//  USAGE:   ./mult --serve JOBS [--workers W] [--size M N K]
+//
+//           The jobs are run with one executor thread, then with W (by
+//           default SERVE_WORKERS), each time from the same client
+//           threads; more threads than one let a job's copies overlap
+//           another's kernel.  The rate is jobs a second from the first
+//           submission to the last answer.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "executor.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the jobs through an executor of threads threads
+//
+//------------------------------------------------------------------------------
+static void serveWith(util::Runtime& runtime, const Variant& variant,
+                      const util::TuningParams& params, cl::Program& program,
+                      const HostMatrix& h_A, const HostMatrix& h_B,
+                      int M, int N, int K, int jobs, unsigned int threads)
+{
+    cl::Context& context = runtime.context();
+    util::Executor executor(context, std::vector<cl::Device>(1, runtime.device()), threads);
+
+    // One multiplication, on whichever executor thread takes it
+    auto job = [&](util::ExecutorThread& thread) -> float {
+        cl::CommandQueue& queue = thread.queue();
+        cl::Kernel& kernel = thread.kernel(program, "mmul_mnk");
+
+        cl::Buffer d_a(context, CL_MEM_READ_ONLY, sizeof(float) * M * K);
+        cl::Buffer d_b(context, CL_MEM_READ_ONLY, sizeof(float) * K * N);
+        cl::Buffer d_c(context, CL_MEM_WRITE_ONLY, sizeof(float) * M * N);
+        queue.enqueueWriteBuffer(d_a, CL_FALSE, 0, sizeof(float) * M * K, &h_A[0]);
+        queue.enqueueWriteBuffer(d_b, CL_FALSE, 0, sizeof(float) * K * N, &h_B[0]);
+        enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+
+        HostMatrix h_C(M * N);
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        return error(M, N, K, h_C);
+    };
+
+    // The clients share out the jobs and wait for their own answers
+    std::vector<float> errors(jobs);
+    const double start = wtime();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < SERVE_CLIENTS; c++)
+        clients.push_back(std::thread([&, c]() {
+            std::vector<std::future<float> > answers;
+            for (int j = c; j < jobs; j += SERVE_CLIENTS)
+                answers.push_back(executor.submit(job));
+            for (int j = c, a = 0; j < jobs; j += SERVE_CLIENTS, a++)
+                errors[j] = answers[a].get();
+        }));
+    for (unsigned int c = 0; c < clients.size(); c++)
+        clients[c].join();
+    const double seconds = wtime() - start;
+
+    int wrong = 0;
+    for (int j = 0; j < jobs; j++)
+        if (std::isnan(errors[j]) || errors[j] > TOL)
+            wrong++;
+
+    printf(" %2u executor threads: %d jobs in %.3f seconds, %.1f jobs/s, %.1f GFLOP/s",
+           threads, jobs, seconds, jobs / seconds, 2.0 * M * N * K * jobs / (1.0e9 * seconds));
+    if (wrong)
+        printf("   %d wrong answers", wrong);
+    printf("\n    jobs taken by each thread:");
+    for (unsigned int t = 0; t < executor.threads(); t++)
+        printf(" %u", executor.jobs(t));
+    printf("\n");
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to serve the jobs with one executor thread, then workers
+//
+//------------------------------------------------------------------------------
+void serve(util::Runtime& runtime, const util::TuningFile& tuning,
+           int M, int N, int K, int jobs, int workers)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+    std::string invalid = checkParams(variant, params, K, runtime.device());
+    if (!invalid.empty())
+    {
+        printf(" %s cannot be used: %s\n", variant.name, invalid.c_str());
+        return;
+    }
+
+    // Built once, before any job; each executor thread makes its own kernel
+    cl::Program& program = buildVariant(runtime, variant, params);
+
+    HostMatrix h_A(M * K), h_B(K * N), h_C(M * N);
+    initmat(M, N, K, h_A, h_B, h_C);
+
+    printf(" %d client threads submitting %d jobs\n", SERVE_CLIENTS, jobs);
+    serveWith(runtime, variant, params, program, h_A, h_B, M, N, K, jobs, 1);
+    if (workers > 1)
+        serveWith(runtime, variant, params, program, h_A, h_B, M, N, K, jobs, workers);
+}
@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Sparse matrix multiplication
+//
+//  PURPOSE: Multiply a sparse A(M,K) by a dense x (SpMV) and by a dense
+//           B(K,N) (SpMM) with the CSR and ELLPACK kernels of
+//           C_sparse.cl, and compare the SpMM with the dense blocked
+//           kernel on the same A stored densely, which does all M*N*K
+//           multiplications whatever the zeros.
+//
+//  USAGE:   ./mult --sparse DENSITY [--size M N K]
+//
+//           DENSITY is the fraction of A that is nonzero (0.05 for 95%
+//           zeros).  The kernel times are from the device events; the
+//           MFLOPS count 2 FLOPs a nonzero (per column of B for SpMM),
+//           the work actually needed.  Each result is checked against
+//           csr_mat_mul on the host.  ELLPACK pads every row to the
+//           longest, so it suits rows of similar length.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the largest difference from the reference, relative
+//  to its largest element
+//
+//------------------------------------------------------------------------------
+static float relError(size_t n, const float *x, HostMatrix& ref)
+{
+    float err = 0.0f, largest = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        err = std::max(err, std::fabs(x[i] - ref[i]));
+        largest = std::max(largest, std::fabs(ref[i]));
+    }
+    return largest > 0.0f ? err / largest : err;
+}
+
+static void report(const char *how, double flops, double run_time, float err)
+{
+    printf(" %-28s %.6f seconds at %.1f MFLOPS", how, run_time, flops / (1.0e6 * run_time));
+    if (std::isnan(err) || err > TOL)
+        printf(", errors: %g", err);
+    printf("\n");
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run a kernel twice (the first a warm up) and return the
+//  device time of the second
+//
+//------------------------------------------------------------------------------
+static double timeKernel(cl::CommandQueue& queue, cl::Kernel& kernel,
+                         const cl::NDRange& global, const cl::NDRange& local)
+{
+    cl::Event event;
+    for (int rep = 0; rep < 2; rep++)
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, NULL, &event);
+    event.wait();
+    return util::eventSeconds(event);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the sparse kernels, and the dense kernel for comparison
+//
+//------------------------------------------------------------------------------
+void sparse(util::Runtime& runtime, const util::TuningFile& tuning,
+            int M, int N, int K, float density)
+{
+    cl::Context& context = runtime.context();
+    cl::CommandQueue& queue = runtime.queue();
+    const cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+    CsrMatrix csr;
+    EllMatrix ell;
+    makeSparse(M, K, density, csr);
+    csrToEll(csr, ell);
+    const double nnz = (double)csr.val.size();
+    if (nnz == 0)
+    {
+        printf(" No nonzeros at density %g\n", density);
+        return;
+    }
+    printf(" %.0f nonzeros (%.2f%%), ELLPACK width %d (%.0f stored)\n", nnz,
+           100.0 * nnz / ((double)M * K), ell.width, (double)ell.width * M);
+
+    util::PinnedAllocator<float> pinned(context, queue);
+    HostMatrix h_B(K * N, 0.0f, pinned);
+    HostMatrix h_C(M * N, 0.0f, pinned), h_ref(M * N, 0.0f, pinned);
+    for (int i = 0; i < K * N; i++)
+        h_B[i] = (float)(i % 5 - 2);
+
+    // x is the first column of B; y = A x is the first column of C
+    HostMatrix h_ref_y(M, 0.0f, pinned);
+    std::vector<float> h_x(K), h_y(M);
+    csr_mat_mul(csr, N, h_B, h_ref);
+    for (int k = 0; k < K; k++)
+        h_x[k] = h_B[k*N];
+    for (int i = 0; i < M; i++)
+        h_ref_y[i] = h_ref[i*N];
+
+    cl::Buffer d_row_ptr(context, csr.row_ptr.begin(), csr.row_ptr.end(), true);
+    cl::Buffer d_col(context, csr.col.begin(), csr.col.end(), true);
+    cl::Buffer d_val(context, csr.val.begin(), csr.val.end(), true);
+    cl::Buffer d_ell_col(context, ell.col.begin(), ell.col.end(), true);
+    cl::Buffer d_ell_val(context, ell.val.begin(), ell.val.end(), true);
+    cl::Buffer d_x(context, h_x.begin(), h_x.end(), true);
+    cl::Buffer d_y(context, CL_MEM_WRITE_ONLY, sizeof(float) * M);
+    cl::Buffer d_b(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * K * N, &h_B[0]);
+    cl::Buffer d_c(context, CL_MEM_READ_WRITE, sizeof(float) * M * N);
+
+    const char *file = "../C_sparse.cl";
+    const int vec = std::min((int)device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(), SPMV_VECTOR);
+    double run_time;
+
+    printf("\n SpMV, y = A x:\n");
+    {
+        cl::Kernel& kernel = runtime.kernel(file, "spmv_csr");
+        kernel.setArg(0, M);
+        kernel.setArg(1, d_row_ptr);
+        kernel.setArg(2, d_col);
+        kernel.setArg(3, d_val);
+        kernel.setArg(4, d_x);
+        kernel.setArg(5, d_y);
+        run_time = timeKernel(queue, kernel, cl::NDRange(M), cl::NullRange);
+        queue.enqueueReadBuffer(d_y, CL_TRUE, 0, sizeof(float) * M, &h_y[0]);
+        report("CSR, item per row", 2.0 * nnz, run_time, relError(M, &h_y[0], h_ref_y));
+    }
+    {
+        cl::Kernel& kernel = runtime.kernel(file, "spmv_csr_vector");
+        kernel.setArg(0, M);
+        kernel.setArg(1, d_row_ptr);
+        kernel.setArg(2, d_col);
+        kernel.setArg(3, d_val);
+        kernel.setArg(4, d_x);
+        kernel.setArg(5, d_y);
+        kernel.setArg(6, cl::Local(sizeof(float) * vec));
+        run_time = timeKernel(queue, kernel, cl::NDRange((::size_t)M * vec), cl::NDRange(vec));
+        queue.enqueueReadBuffer(d_y, CL_TRUE, 0, sizeof(float) * M, &h_y[0]);
+        report("CSR, work-group per row", 2.0 * nnz, run_time, relError(M, &h_y[0], h_ref_y));
+    }
+    {
+        cl::Kernel& kernel = runtime.kernel(file, "spmv_ell");
+        kernel.setArg(0, M);
+        kernel.setArg(1, ell.width);
+        kernel.setArg(2, d_ell_col);
+        kernel.setArg(3, d_ell_val);
+        kernel.setArg(4, d_x);
+        kernel.setArg(5, d_y);
+        run_time = timeKernel(queue, kernel, cl::NDRange(M), cl::NullRange);
+        queue.enqueueReadBuffer(d_y, CL_TRUE, 0, sizeof(float) * M, &h_y[0]);
+        report("ELLPACK, item per row", 2.0 * nnz, run_time, relError(M, &h_y[0], h_ref_y));
+    }
+
+    printf("\n SpMM, C = A B:\n");
+    const cl::NDRange global(N, M), local = cl::NullRange;
+    {
+        cl::Kernel& kernel = runtime.kernel(file, "spmm_csr");
+        kernel.setArg(0, M);
+        kernel.setArg(1, N);
+        kernel.setArg(2, d_row_ptr);
+        kernel.setArg(3, d_col);
+        kernel.setArg(4, d_val);
+        kernel.setArg(5, d_b);
+        kernel.setArg(6, d_c);
+        run_time = timeKernel(queue, kernel, global, local);
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        report("CSR", 2.0 * nnz * N, run_time, relError((size_t)M * N, &h_C[0], h_ref));
+    }
+    {
+        cl::Kernel& kernel = runtime.kernel(file, "spmm_ell");
+        kernel.setArg(0, M);
+        kernel.setArg(1, N);
+        kernel.setArg(2, ell.width);
+        kernel.setArg(3, d_ell_col);
+        kernel.setArg(4, d_ell_val);
+        kernel.setArg(5, d_b);
+        kernel.setArg(6, d_c);
+        run_time = timeKernel(queue, kernel, global, local);
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        report("ELLPACK", 2.0 * nnz * N, run_time, relError((size_t)M * N, &h_C[0], h_ref));
+    }
+
+    // The same A stored densely, with the blocked kernel
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+    std::string invalid = checkParams(variant, params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Dense skipped: %s\n", invalid.c_str());
+        return;
+    }
+
+    HostMatrix h_A(M * K, 0.0f, pinned);
+    csrToDense(csr, h_A);
+    cl::Buffer d_a(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * M * K, &h_A[0]);
+
+    cl::Kernel& kernel = variantKernel(runtime, variant, params);
+    cl::Event event;
+    for (int rep = 0; rep < 2; rep++)
+        event = enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+    event.wait();
+    run_time = util::eventSeconds(event);
+    queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    report("Dense, blocked", 2.0 * nnz * N, run_time, relError((size_t)M * N, &h_C[0], h_ref));
+}
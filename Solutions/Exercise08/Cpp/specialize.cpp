@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplication kernels specialized for one shape
+//
+//  PURPOSE: Compare each kernel variant taking M, N and K as arguments
+//           with the same kernel built for the sizes of this run.  With
+//           the sizes compiled in (-D SIZE_M, SIZE_N and SIZE_K, which
+//           each kernel uses in place of its arguments) every loop
+//           bound and row stride is a constant, so the compiler can
+//           unroll the loops over K completely or by more, fold the
+//           index arithmetic into the addresses and drop the tests at
+//           the edges of C that the shape never needs.  The row
+//           variants also get a private row of A just K long when K is
+//           below 1024, in one pass rather than in chunks.
+//
+//           A specialized program is one more program: the runtime
+//           builds it once for each shape and keeps it, and the binary
+//           cache (program_cache.hpp) keeps it across runs, so for a
+//           few fixed production shapes only the first run compiles.
+//
+//  USAGE:   ./mult --specialize [--size M N K]
+//
+//           Each time is the fastest of SPECIALIZE_REPS runs from the
+//           device's events, after one to warm up.  The build time of
+//           the specialized program is reported too: from the cache it
+//           is a load of the binary.  Each answer is checked as usual.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+#define SPECIALIZE_REPS 5
+
+//------------------------------------------------------------------------------
+//
+//  Function to time a kernel, returning the fastest run in seconds, or a
+//  negative time if its answer is wrong
+//
+//------------------------------------------------------------------------------
+static double timeKernel(cl::CommandQueue& queue, cl::Kernel& kernel,
+                         const Variant& variant, const util::TuningParams& params,
+                         int M, int N, int K, cl::Buffer& d_a, cl::Buffer& d_b,
+                         cl::Buffer& d_c, HostMatrix& h_C)
+{
+    double best = 0.0;
+    for (int rep = 0; rep <= SPECIALIZE_REPS; rep++)
+    {
+        cl::Event event = enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+        event.wait();
+        if (rep == 1 || (rep > 1 && util::eventSeconds(event) < best))
+            best = util::eventSeconds(event);
+    }
+
+    cl::copy(queue, d_c, h_C.begin(), h_C.end());
+    float errsq = error(M, N, K, h_C);
+    return (std::isnan(errsq) || errsq > TOL) ? -best : best;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run each variant generic and specialized
+//
+//------------------------------------------------------------------------------
+void specialize(util::Runtime& runtime, const util::TuningFile& tuning,
+                int M, int N, int K)
+{
+    cl::Context& context = runtime.context();
+    cl::Device& device = runtime.device();
+    util::BufferPool& pool = runtime.pool();
+    cl::CommandQueue queue = util::createProfilingQueue(context, device);
+
+    HostMatrix h_A(M * K), h_B(K * N), h_C(M * N);
+    initmat(M, N, K, h_A, h_B, h_C);
+    cl::Buffer d_a = pool.acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+    cl::Buffer d_b = pool.acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+    cl::Buffer d_c = pool.acquire(sizeof(float) * M * N, CL_MEM_READ_WRITE);
+    cl::copy(queue, h_A.begin(), h_A.end(), d_a);
+    cl::copy(queue, h_B.begin(), h_B.end(), d_b);
+
+    printf(" %-14s %12s %12s %8s %10s\n", "variant", "generic(s)", "fixed(s)", "speedup", "build(s)");
+
+    for (int v = 0; v < NUM_VARIANTS; v++)
+    {
+        const Variant& variant = variants[v];
+        util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+
+        std::string invalid = checkParams(variant, params, K, device);
+        if (!invalid.empty())
+        {
+            printf(" %-14s skipped: %s\n", variant.name, invalid.c_str());
+            continue;
+        }
+
+        cl::Kernel& generic = variantKernel(runtime, variant, params);
+        util::Timer timer;
+        cl::Kernel& fixed = specializedKernel(runtime, variant, params, M, N, K);
+        const double build = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+
+        const double t_generic = timeKernel(queue, generic, variant, params, M, N, K,
+                                            d_a, d_b, d_c, h_C);
+        const double t_fixed = timeKernel(queue, fixed, variant, params, M, N, K,
+                                          d_a, d_b, d_c, h_C);
+
+        printf(" %-14s %12.6f %12.6f %7.2fx %10.3f", variant.name, std::fabs(t_generic),
+               std::fabs(t_fixed), std::fabs(t_generic) / std::fabs(t_fixed), build);
+        if (t_generic < 0.0 || t_fixed < 0.0)
+            printf("   wrong answer (%s)", t_fixed < 0.0 ? "specialized" : "generic");
+        printf("\n");
+    }
+
+    pool.release(d_a);
+    pool.release(d_b);
+    pool.release(d_c);
+}
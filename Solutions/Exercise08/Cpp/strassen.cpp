@@ -0,0 +1,367 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Strassen-Winograd matrix multiplication
+//
+//  PURPOSE: Multiply large matrices with the Strassen-Winograd recursion:
+//           each level splits A, B and C into quadrants and forms C from
+//           7 products of half the size (instead of 8) and 15 sums of
+//           quadrants, so L levels do (7/8)^L of the multiplications.
+//           Below the crossover the products are done by the blocked
+//           kernel (C_block_form.cl) at its tuned block size.
+//
+//           The quadrants are copied out of and into their matrices with
+//           clEnqueueCopyBufferRect, and the sums are done by mat_add
+//           (C_strassen.cl).  Every temporary comes from the runtime's
+//           buffer pool and goes back as soon as it is used, so the next
+//           product of the same size reuses it; everything is on one
+//           in-order queue, so a buffer can be released while commands
+//           using it are still queued.
+//
+//  USAGE:   ./mult --strassen [--size M N K] [--crossover ORDER] [--tune]
+//
+//           A level is taken while M, N and K are even and all larger
+//           than the crossover, so the orders should be the crossover
+//           times a power of two.  Without --crossover it is read from
+//           the tuning file ("strassen crossover=..."), which --tune
+//           fills by timing each candidate.  The recursion is compared
+//           with the blocked kernel on the whole product, and rows of
+//           the result are checked against seq_mat_mul_sdot.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+
+#include <algorithm>
+#include <climits>
+
+// Crossovers tried by --tune
+static const int crossovers[] = { 256, 512, 1024, 2048, 4096, -1 };
+
+// The kernels and queue of one multiplication
+struct Recursion
+{
+    util::Runtime           *runtime;
+    const Variant           *variant;
+    util::TuningParams       params;
+    cl::Kernel               mmul;
+    cl::Kernel               add;
+    int                      crossover;
+    int                      products;      // blocked kernel launches
+    int                      depth;         // deepest level reached
+};
+
+//------------------------------------------------------------------------------
+//
+//  Functions to copy quadrant (qi,qj) of X(rows,cols) to or from Q
+//
+//------------------------------------------------------------------------------
+static void quadrantRect(int rows, int cols, int qi, int qj,
+                         cl::size_t<3>& origin, cl::size_t<3>& region)
+{
+    origin[0] = sizeof(float) * qj * (cols / 2);
+    origin[1] = qi * (rows / 2);
+    origin[2] = 0;
+    region[0] = sizeof(float) * (cols / 2);
+    region[1] = rows / 2;
+    region[2] = 1;
+}
+
+static void getQuadrant(cl::CommandQueue& queue, cl::Buffer& X, int rows, int cols,
+                        int qi, int qj, cl::Buffer& Q)
+{
+    cl::size_t<3> origin, zero, region;
+    quadrantRect(rows, cols, qi, qj, origin, region);
+    zero[0] = zero[1] = zero[2] = 0;
+    queue.enqueueCopyBufferRect(X, Q, origin, zero, region,
+                                sizeof(float) * cols, 0, region[0], 0);
+}
+
+static void putQuadrant(cl::CommandQueue& queue, cl::Buffer& Q, cl::Buffer& X,
+                        int rows, int cols, int qi, int qj)
+{
+    cl::size_t<3> origin, zero, region;
+    quadrantRect(rows, cols, qi, qj, origin, region);
+    zero[0] = zero[1] = zero[2] = 0;
+    queue.enqueueCopyBufferRect(Q, X, zero, origin, region,
+                                region[0], 0, sizeof(float) * cols, 0);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue Z = X + beta * Y over count floats
+//
+//------------------------------------------------------------------------------
+static void enqueueAdd(Recursion& r, int count, cl::Buffer& X, cl::Buffer& Y,
+                       cl::Buffer& Z, float beta)
+{
+    r.add.setArg(0, count);
+    r.add.setArg(1, X);
+    r.add.setArg(2, Y);
+    r.add.setArg(3, Z);
+    r.add.setArg(4, beta);
+    r.runtime->queue().enqueueNDRangeKernel(r.add, cl::NullRange, cl::NDRange(count));
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue C(M,N) = A(M,K) * B(K,N), recursing while the
+//  sizes halve evenly and stay above the crossover
+//
+//------------------------------------------------------------------------------
+static void multiply(Recursion& r, int M, int N, int K,
+                     cl::Buffer& A, cl::Buffer& B, cl::Buffer& C, int level)
+{
+    cl::CommandQueue& queue = r.runtime->queue();
+    util::BufferPool& pool = r.runtime->pool();
+
+    r.depth = std::max(r.depth, level);
+    if (M % 2 || N % 2 || K % 2 || std::min(M, std::min(N, K)) <= r.crossover)
+    {
+        enqueueVariant(queue, r.mmul, *r.variant, r.params, M, N, K, A, B, C);
+        r.products++;
+        return;
+    }
+
+    const int m = M / 2, n = N / 2, k = K / 2;
+    const ::size_t bytesA = sizeof(float) * m * k;
+    const ::size_t bytesB = sizeof(float) * k * n;
+    const ::size_t bytesC = sizeof(float) * m * n;
+
+    cl::Buffer A11 = pool.acquire(bytesA), A12 = pool.acquire(bytesA);
+    cl::Buffer A21 = pool.acquire(bytesA), A22 = pool.acquire(bytesA);
+    cl::Buffer B11 = pool.acquire(bytesB), B12 = pool.acquire(bytesB);
+    cl::Buffer B21 = pool.acquire(bytesB), B22 = pool.acquire(bytesB);
+    getQuadrant(queue, A, M, K, 0, 0, A11);
+    getQuadrant(queue, A, M, K, 0, 1, A12);
+    getQuadrant(queue, A, M, K, 1, 0, A21);
+    getQuadrant(queue, A, M, K, 1, 1, A22);
+    getQuadrant(queue, B, K, N, 0, 0, B11);
+    getQuadrant(queue, B, K, N, 0, 1, B12);
+    getQuadrant(queue, B, K, N, 1, 0, B21);
+    getQuadrant(queue, B, K, N, 1, 1, B22);
+
+    cl::Buffer S = pool.acquire(bytesA);
+    cl::Buffer T = pool.acquire(bytesB);
+
+    // C11 = P1 + P2, P1 = A11 B11, P2 = A12 B21
+    cl::Buffer P1 = pool.acquire(bytesC);
+    multiply(r, m, n, k, A11, B11, P1, level + 1);
+    {
+        cl::Buffer P2 = pool.acquire(bytesC);
+        multiply(r, m, n, k, A12, B21, P2, level + 1);
+        enqueueAdd(r, m * n, P1, P2, P2, 1.0f);
+        putQuadrant(queue, P2, C, M, N, 0, 0);
+        pool.release(P2);
+    }
+
+    // P5 = S1 T1, S1 = A21 + A22, T1 = B12 - B11
+    cl::Buffer P5 = pool.acquire(bytesC);
+    enqueueAdd(r, m * k, A21, A22, S, 1.0f);
+    enqueueAdd(r, k * n, B12, B11, T, -1.0f);
+    multiply(r, m, n, k, S, T, P5, level + 1);
+
+    // U2 = P1 + P6, P6 = S2 T2, S2 = S1 - A11, T2 = B22 - T1
+    enqueueAdd(r, m * k, S, A11, S, -1.0f);
+    enqueueAdd(r, k * n, B22, T, T, -1.0f);
+    {
+        cl::Buffer P6 = pool.acquire(bytesC);
+        multiply(r, m, n, k, S, T, P6, level + 1);
+        enqueueAdd(r, m * n, P1, P6, P1, 1.0f);
+        pool.release(P6);
+    }
+
+    // P3 = S4 B22, S4 = A12 - S2
+    cl::Buffer P3 = pool.acquire(bytesC);
+    enqueueAdd(r, m * k, A12, S, S, -1.0f);
+    multiply(r, m, n, k, S, B22, P3, level + 1);
+
+    // P4 = A22 T4, T4 = T2 - B21
+    cl::Buffer P4 = pool.acquire(bytesC);
+    enqueueAdd(r, k * n, T, B21, T, -1.0f);
+    multiply(r, m, n, k, A22, T, P4, level + 1);
+
+    // P7 = S3 T3, S3 = A11 - A21, T3 = B22 - B12
+    cl::Buffer P7 = pool.acquire(bytesC);
+    enqueueAdd(r, m * k, A11, A21, S, -1.0f);
+    enqueueAdd(r, k * n, B22, B12, T, -1.0f);
+    multiply(r, m, n, k, S, T, P7, level + 1);
+
+    pool.release(S);
+    pool.release(T);
+    pool.release(A11);
+    pool.release(A12);
+    pool.release(A21);
+    pool.release(A22);
+    pool.release(B11);
+    pool.release(B12);
+    pool.release(B21);
+    pool.release(B22);
+
+    // U3 = U2 + P7, U4 = U2 + P5
+    enqueueAdd(r, m * n, P1, P7, P7, 1.0f);
+    enqueueAdd(r, m * n, P1, P5, P1, 1.0f);
+
+    // C12 = U4 + P3, C21 = U3 - P4, C22 = U3 + P5
+    enqueueAdd(r, m * n, P1, P3, P3, 1.0f);
+    enqueueAdd(r, m * n, P7, P4, P4, -1.0f);
+    enqueueAdd(r, m * n, P7, P5, P5, 1.0f);
+    putQuadrant(queue, P3, C, M, N, 0, 1);
+    putQuadrant(queue, P4, C, M, N, 1, 0);
+    putQuadrant(queue, P5, C, M, N, 1, 1);
+
+    pool.release(P1);
+    pool.release(P3);
+    pool.release(P4);
+    pool.release(P5);
+    pool.release(P7);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to time a whole multiplication, after one untimed run that
+//  also fills the buffer pool
+//
+//------------------------------------------------------------------------------
+static double timeMultiply(Recursion& r, int M, int N, int K,
+                           cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c)
+{
+    multiply(r, M, N, K, d_a, d_b, d_c, 0);
+    r.runtime->queue().finish();
+
+    r.products = 0;
+    r.depth = 0;
+    util::Timer timer;
+    multiply(r, M, N, K, d_a, d_b, d_c, 0);
+    r.runtime->queue().finish();
+    return static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to find the largest error, relative to the largest element,
+//  of a few rows of C against seq_mat_mul_sdot
+//
+//------------------------------------------------------------------------------
+static float rowError(int M, int N, int K, HostMatrix& A, HostMatrix& B, HostMatrix& C)
+{
+    const int rows = std::min(M, STRASSEN_CHECK_ROWS);
+    HostMatrix a(K), c(N);
+    float err = 0.0f, largest = 0.0f;
+
+    for (int s = 0; s < rows; s++)
+    {
+        const int i = rows > 1 ? (int)((long)s * (M - 1) / (rows - 1)) : 0;
+        std::copy(A.begin() + (long)i * K, A.begin() + (long)(i + 1) * K, a.begin());
+        seq_mat_mul_sdot(1, N, K, a, B, c);
+        for (int j = 0; j < N; j++)
+        {
+            err = std::max(err, std::fabs(C[(long)i * N + j] - c[j]));
+            largest = std::max(largest, std::fabs(c[j]));
+        }
+    }
+    return largest > 0.0f ? err / largest : err;
+}
+
+static void report(const char *how, int M, int N, int K, double run_time, float err)
+{
+    printf(" %-28s %.4f seconds at %.1f MFLOPS (of 2MNK), error %g\n", how, run_time,
+           2.0 * M * N * K / (1000000.0 * run_time), err);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to run the recursion and the blocked kernel on one product
+//
+//------------------------------------------------------------------------------
+void strassen(util::Runtime& runtime, util::TuningFile& tuning, int M, int N, int K,
+              int crossover, bool tune)
+{
+    const cl::Device device = runtime.context().getInfo<CL_CONTEXT_DEVICES>()[0];
+    cl::CommandQueue& queue = runtime.queue();
+
+    Recursion r;
+    r.runtime = &runtime;
+    r.variant = &findVariant(VARIANT_BLOCK);
+    r.params = tuning.get(r.variant->name, defaultParams(*r.variant));
+    r.products = r.depth = 0;
+
+    std::string invalid = checkParams(*r.variant, r.params, K, device);
+    if (!invalid.empty())
+    {
+        printf(" Skipped: %s\n", invalid.c_str());
+        return;
+    }
+    r.mmul = variantKernel(runtime, *r.variant, r.params);
+    r.add = runtime.kernel("../C_strassen.cl", "mat_add");
+
+    // Small integers, so a wrong quadrant shows up and the sums stay exact
+    // enough to compare
+    util::PinnedAllocator<float> pinned(runtime.context(), queue);
+    HostMatrix h_A(M * K, 0.0f, pinned);
+    HostMatrix h_B(K * N, 0.0f, pinned);
+    HostMatrix h_C(M * N, 0.0f, pinned);
+    for (int i = 0; i < M * K; i++)
+        h_A[i] = (float)(i % 7 - 3);
+    for (int i = 0; i < K * N; i++)
+        h_B[i] = (float)(i % 5 - 2);
+
+    util::BufferPool& pool = runtime.pool();
+    cl::Buffer d_a = pool.acquire(sizeof(float) * M * K, CL_MEM_READ_ONLY);
+    cl::Buffer d_b = pool.acquire(sizeof(float) * K * N, CL_MEM_READ_ONLY);
+    cl::Buffer d_c = pool.acquire(sizeof(float) * M * N);
+    queue.enqueueWriteBuffer(d_a, CL_TRUE, 0, sizeof(float) * M * K, &h_A[0]);
+    queue.enqueueWriteBuffer(d_b, CL_TRUE, 0, sizeof(float) * K * N, &h_B[0]);
+
+    // The crossover: given, tuned now, or from an earlier --tune
+    if (tune)
+    {
+        double best = 0.0;
+        for (int c = 0; crossovers[c] > 0; c++)
+        {
+            if (crossovers[c] > std::min(M, std::min(N, K)))
+                break;
+            r.crossover = crossovers[c];
+            double run_time = timeMultiply(r, M, N, K, d_a, d_b, d_c);
+            printf(" crossover %-6d %.4f seconds, %d levels\n", r.crossover, run_time, r.depth);
+            if (best == 0.0 || run_time < best)
+            {
+                best = run_time;
+                crossover = r.crossover;
+            }
+        }
+        if (crossover > 0)
+        {
+            util::TuningParams params;
+            params["crossover"] = crossover;
+            char note[64];
+            sprintf(note, "%f s at %s", best, sizeName(M, N, K).c_str());
+            tuning.set("strassen", params, note);
+            if (tuning.save())
+                printf(" Saved crossover %d to %s\n", crossover, tuning.path().c_str());
+        }
+    }
+    if (crossover <= 0)
+    {
+        util::TuningParams defaults;
+        defaults["crossover"] = STRASSEN_CROSSOVER;
+        crossover = tuning.get("strassen", defaults)["crossover"];
+    }
+    r.crossover = crossover;
+
+    double run_time = timeMultiply(r, M, N, K, d_a, d_b, d_c);
+    queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    printf(" Crossover %d: %d levels, %d blocked products\n", r.crossover, r.depth, r.products);
+    report("Strassen-Winograd", M, N, K, run_time, rowError(M, N, K, h_A, h_B, h_C));
+
+    // The same product with no recursion
+    r.crossover = INT_MAX;
+    run_time = timeMultiply(r, M, N, K, d_a, d_b, d_c);
+    queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+    report("Blocked", M, N, K, run_time, rowError(M, N, K, h_A, h_B, h_C));
+
+    pool.release(d_a);
+    pool.release(d_b);
+    pool.release(d_c);
+}
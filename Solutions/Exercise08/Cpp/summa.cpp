@@ -0,0 +1,386 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Distributed matrix multiplication (SUMMA) over MPI
+//
+//  PURPOSE: Compute C = A * B across MPI ranks, each rank driving one
+//           OpenCL device with the blocked kernel of Exercise08.
+//
+//           The ranks form a Pr x Pc grid (MPI_Dims_create), and each
+//           matrix is cut into Pr x Pc blocks: rank (r,c) holds block
+//           (r,c) of A, B and C.  SUMMA (van de Geijn and Watts) walks
+//           K a panel at a time: the ranks of the process column
+//           holding columns [k, k+kb) of A broadcast their part of the
+//           panel along their process rows, the ranks of the process
+//           row holding rows [k, k+kb) of B broadcast theirs down their
+//           process columns, and every rank adds the product of the two
+//           panels it received to its block of C.  C stays on the
+//           device for the whole product: the first panel is stored and
+//           the rest added by the blocked kernel built with its
+//           EPI_BETA epilogue and beta = 1, as out of core.
+//
+//           The broadcasts are non-blocking (MPI_Ibcast) and double
+//           buffered: while the device multiplies one pair of panels
+//           the next pair is on its way, so the network and the device
+//           overlap.  A host panel is only broadcast into again once
+//           its upload to the device has finished.
+//
+//           At the end the blocks of C are gathered on rank 0 and
+//           checked with the results() of matrix_lib.
+//
+//  USAGE:   mpirun -np P ./summa [--size M N K] [--panel KB] [--device INDEX]
+//
+//           Each rank takes device (local rank mod devices) of --list,
+//           where the local rank counts the ranks on its node, so one
+//           rank per device of a node drives them all; --device picks
+//           the same one on every rank.  A and B are the constant
+//           matrices of the driver (see matmul.hpp).  "make summa"
+//           builds it with MPICXX (default mpicxx); it needs MPI 3 for
+//           the non-blocking collectives.
+//
+//------------------------------------------------------------------------------
+
+#include <mpi.h>
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "err_code.h"
+#include "device_picker.hpp"
+
+#include <algorithm>
+#include <climits>
+
+#define SUMMA_PANEL 256    // default columns of A (rows of B) a step
+
+//------------------------------------------------------------------------------
+//
+//  Function to give the first index of part p of n split into parts
+//  (the first n % parts one larger)
+//
+//------------------------------------------------------------------------------
+static int splitStart(int n, int parts, int p)
+{
+    return p * (n / parts) + std::min(p, n % parts);
+}
+
+// One step of SUMMA: columns [k, k+width) of A, rows of B, and the
+// process column and row that hold them
+struct Step
+{
+    int k, width;
+    int col_root, row_root;
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to cut K into steps of at most kb, none crossing the edge of
+//  a block of A's columns (split over pc) or of B's rows (split over pr)
+//
+//------------------------------------------------------------------------------
+static std::vector<Step> planSteps(int K, int kb, int pr, int pc)
+{
+    std::vector<Step> steps;
+    int col_root = 0, row_root = 0;
+    for (int k = 0; k < K; )
+    {
+        while (splitStart(K, pc, col_root + 1) <= k)
+            col_root++;
+        while (splitStart(K, pr, row_root + 1) <= k)
+            row_root++;
+
+        Step step;
+        step.k = k;
+        step.width = std::min(kb, std::min(splitStart(K, pc, col_root + 1),
+                                           splitStart(K, pr, row_root + 1)) - k);
+        step.col_root = col_root;
+        step.row_root = row_root;
+        steps.push_back(step);
+        k += step.width;
+    }
+    return steps;
+}
+
+// A rank's blocks of A and B, and the host panels it broadcasts from or
+// receives into
+struct Panels
+{
+    int                 myrow, mycol;
+    int                 rows, cols;       // of this rank's block of C
+    int                 ka0, kas;         // columns of A held: [ka0, ka0+kas)
+    int                 kb0;              // first row of B held
+    std::vector<float>  a_block;          // rows x kas
+    std::vector<float>  b_block;          // kbs x cols
+    std::vector<float>  h_a[2], h_b[2];   // rows x width, width x cols
+    MPI_Comm            row_comm, col_comm;
+    MPI_Request         requests[2][2];
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to pack the panels of step s if this rank holds them, and to
+//  start their broadcasts into buffer s % 2
+//
+//------------------------------------------------------------------------------
+static void startBroadcast(Panels& z, const Step& step, int s)
+{
+    const int b = s % 2, w = step.width;
+    if (z.mycol == step.col_root)
+        for (int i = 0; i < z.rows; i++)
+        {
+            const float *from = &z.a_block[(size_t)i * z.kas + step.k - z.ka0];
+            std::copy(from, from + w, &z.h_a[b][(size_t)i * w]);
+        }
+    if (z.myrow == step.row_root)
+    {
+        const float *from = &z.b_block[(size_t)(step.k - z.kb0) * z.cols];
+        std::copy(from, from + (size_t)w * z.cols, &z.h_b[b][0]);
+    }
+
+    MPI_Ibcast(&z.h_a[b][0], z.rows * w, MPI_FLOAT, step.col_root, z.row_comm, &z.requests[b][0]);
+    MPI_Ibcast(&z.h_b[b][0], w * z.cols, MPI_FLOAT, step.row_root, z.col_comm, &z.requests[b][1]);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to gather the blocks of C on rank 0 of the grid
+//
+//------------------------------------------------------------------------------
+static void gatherC(MPI_Comm grid, int pr, int pc, int M, int N,
+                    std::vector<float>& block, HostMatrix& h_C)
+{
+    int rank, size;
+    MPI_Comm_rank(grid, &rank);
+    MPI_Comm_size(grid, &size);
+
+    std::vector<int> counts(size), displs(size);
+    for (int r = 0; r < size; r++)
+    {
+        int coords[2];
+        MPI_Cart_coords(grid, r, 2, coords);
+        const int rows = splitStart(M, pr, coords[0] + 1) - splitStart(M, pr, coords[0]);
+        const int cols = splitStart(N, pc, coords[1] + 1) - splitStart(N, pc, coords[1]);
+        counts[r] = rows * cols;
+        displs[r] = r ? displs[r - 1] + counts[r - 1] : 0;
+    }
+
+    std::vector<float> all(rank == 0 ? (size_t)M * N : 0);
+    MPI_Gatherv(&block[0], (int)block.size(), MPI_FLOAT,
+                rank == 0 ? &all[0] : NULL, &counts[0], &displs[0], MPI_FLOAT, 0, grid);
+    if (rank != 0)
+        return;
+
+    // Each block, by rows, into its place in C
+    for (int r = 0; r < size; r++)
+    {
+        int coords[2];
+        MPI_Cart_coords(grid, r, 2, coords);
+        const int row = splitStart(M, pr, coords[0]), col = splitStart(N, pc, coords[1]);
+        const int rows = splitStart(M, pr, coords[0] + 1) - row;
+        const int cols = splitStart(N, pc, coords[1] + 1) - col;
+        const float *from = &all[displs[r]];
+        for (int i = 0; i < rows; i++, from += cols)
+            std::copy(from, from + cols, &h_C[(size_t)(row + i) * N + col]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+
+    int world_rank, world_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+    int M = ORDER, N = ORDER, K = ORDER;
+    int kb = SUMMA_PANEL;
+
+    try
+    {
+        cl_uint deviceIndex = UINT_MAX;
+        parseArguments(argc, argv, &deviceIndex,
+            "      --size       M N K   Multiply A(M,K) by B(K,N) (default: square)\n"
+            "      --panel      KB      Columns of A, rows of B, a step (default 256)\n");
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--size") && i + 3 < argc)
+            {
+                M = atoi(argv[++i]);
+                N = atoi(argv[++i]);
+                K = atoi(argv[++i]);
+            }
+            else if (!strcmp(argv[i], "--panel") && i + 1 < argc)
+                kb = atoi(argv[++i]);
+        }
+
+        // The process grid, and the rows and columns of it
+        int dims[2] = { 0, 0 }, periods[2] = { 0, 0 };
+        MPI_Dims_create(world_size, 2, dims);
+        const int pr = dims[0], pc = dims[1];
+        if (M < pr || N < pc || K < std::max(pr, pc) || kb < 1)
+        {
+            if (world_rank == 0)
+                std::cout << "Invalid sizes: need M >= " << pr << ", N >= " << pc
+                          << ", K >= " << std::max(pr, pc) << " and a panel of 1 or more\n";
+            MPI_Finalize();
+            return EXIT_FAILURE;
+        }
+
+        MPI_Comm grid, row_comm, col_comm;
+        MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+        int rank, coords[2];
+        MPI_Comm_rank(grid, &rank);
+        MPI_Cart_coords(grid, rank, 2, coords);
+        const int myrow = coords[0], mycol = coords[1];
+
+        // Ranks along this rank's process row (varying column), and down
+        // its process column; the rank in each is the other coordinate
+        int keep_cols[2] = { 0, 1 }, keep_rows[2] = { 1, 0 };
+        MPI_Cart_sub(grid, keep_cols, &row_comm);
+        MPI_Cart_sub(grid, keep_rows, &col_comm);
+
+        // One device a rank, shared out among the ranks of a node
+        MPI_Comm node;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank, MPI_INFO_NULL, &node);
+        int local_rank;
+        MPI_Comm_rank(node, &local_rank);
+
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+        if (numDevices == 0 || (deviceIndex != UINT_MAX && deviceIndex >= numDevices))
+        {
+            std::cout << "Rank " << rank << ": no device " << deviceIndex << " (try '--list')\n";
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        if (deviceIndex == UINT_MAX)
+            deviceIndex = local_rank % numDevices;
+        cl::Device device = devices[deviceIndex];
+
+        std::string name;
+        getDeviceName(device, name);
+        printf(" Rank %d (%d,%d of %dx%d): %s\n", rank, myrow, mycol, pr, pc, name.c_str());
+
+        // This rank's blocks: rows of A and C, columns of B and C, and
+        // the columns of A and rows of B it holds
+        const int row0 = splitStart(M, pr, myrow), rows = splitStart(M, pr, myrow + 1) - row0;
+        const int col0 = splitStart(N, pc, mycol), cols = splitStart(N, pc, mycol + 1) - col0;
+        const int ka0 = splitStart(K, pc, mycol), kas = splitStart(K, pc, mycol + 1) - ka0;
+        const int kb0 = splitStart(K, pr, myrow), kbs = splitStart(K, pr, myrow + 1) - kb0;
+
+        Panels z;
+        z.myrow = myrow;
+        z.mycol = mycol;
+        z.rows = rows;
+        z.cols = cols;
+        z.ka0 = ka0;
+        z.kas = kas;
+        z.kb0 = kb0;
+        z.a_block.assign((size_t)rows * kas, AVAL);
+        z.b_block.assign((size_t)kbs * cols, BVAL);
+        z.row_comm = row_comm;
+        z.col_comm = col_comm;
+        std::vector<float> c_block((size_t)rows * cols);
+
+        const std::vector<Step> steps = planSteps(K, kb, pr, pc);
+        int widest = 0;
+        for (unsigned s = 0; s < steps.size(); s++)
+            widest = std::max(widest, steps[s].width);
+
+        // The kernels: store the first product, add the rest
+        util::TuningFile tuning(device);
+        const Variant& variant = findVariant(VARIANT_BLOCK);
+        util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+        std::string invalid = checkParams(variant, params, widest, device);
+        if (!invalid.empty())
+        {
+            std::cout << "Rank " << rank << ": " << invalid << "\n";
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+
+        cl::Context context(device);
+        cl::CommandQueue queue(context, device);
+        cl::Program plain = buildVariant(context, device, variant, params);
+        cl::Program accum = util::buildProgramFile(context, device, variant.file,
+                                                   variantOptions(variant, params) + " -D EPI_BETA");
+        cl::Kernel store(plain, "mmul_mnk");
+        cl::Kernel accumulate(accum, "mmul_mnk");
+
+        // Two panels of each on the host (received or packed) and on the
+        // device, and the block of C
+        cl::Buffer d_a[2], d_b[2];
+        for (int b = 0; b < 2; b++)
+        {
+            z.h_a[b].resize((size_t)rows * widest);
+            z.h_b[b].resize((size_t)widest * cols);
+            d_a[b] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * rows * widest);
+            d_b[b] = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * widest * cols);
+        }
+        cl::Buffer d_c(context, CL_MEM_READ_WRITE, sizeof(float) * rows * cols);
+        accumulate.setArg(8, 1.0f);
+        accumulate.setArg(9, 1.0f);
+        accumulate.setArg(10, d_c);
+
+        const int nsteps = steps.size();
+        std::vector<cl::Event> upload(nsteps);
+
+        MPI_Barrier(grid);
+        double start_time = MPI_Wtime();
+
+        // One in-order queue: each upload follows the kernel before it,
+        // while the broadcast of the next panels runs
+        startBroadcast(z, steps[0], 0);
+        for (int s = 0; s < nsteps; s++)
+        {
+            const int b = s % 2, w = steps[s].width;
+            MPI_Waitall(2, z.requests[b], MPI_STATUSES_IGNORE);
+
+            queue.enqueueWriteBuffer(d_a[b], CL_FALSE, 0, sizeof(float) * rows * w, &z.h_a[b][0]);
+            queue.enqueueWriteBuffer(d_b[b], CL_FALSE, 0, sizeof(float) * w * cols, &z.h_b[b][0],
+                                     NULL, &upload[s]);
+            enqueueVariant(queue, s == 0 ? store : accumulate, variant, params,
+                           rows, cols, w, d_a[b], d_b[b], d_c);
+            queue.flush();
+
+            // The next panels go into the other host buffers, once the
+            // device has them from the step before this one
+            if (s + 1 < nsteps)
+            {
+                if (s >= 1)
+                    upload[s - 1].wait();
+                startBroadcast(z, steps[s + 1], s + 1);
+            }
+        }
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * rows * cols, &c_block[0]);
+
+        double local_time = MPI_Wtime() - start_time, run_time;
+        MPI_Reduce(&local_time, &run_time, 1, MPI_DOUBLE, MPI_MAX, 0, grid);
+
+        // Rank 0 checks the whole of C
+        HostMatrix h_C(rank == 0 ? (size_t)M * N : 0);
+        gatherC(grid, pr, pc, M, N, c_block, h_C);
+        if (rank == 0)
+        {
+            printf("\n===== SUMMA over %d ranks (%dx%d), panels of %d, %s ======\n",
+                   world_size, pr, pc, kb, sizeName(M, N, K).c_str());
+            results(M, N, K, h_C, run_time);
+        }
+
+        MPI_Comm_free(&node);
+        MPI_Comm_free(&row_comm);
+        MPI_Comm_free(&col_comm);
+        MPI_Comm_free(&grid);
+    } catch (cl::Error err)
+    {
+        std::cout << "Exception\n";
+        std::cerr << "ERROR: rank " << world_rank << ": "
+                  << err.what()
+                  << "("
+                  << err_code(err.err())
+                  << ")"
+                  << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
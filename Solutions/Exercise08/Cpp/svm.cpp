@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: Matrix multiplication in shared virtual memory
+//
+//  PURPOSE: On an OpenCL 2.0 device, keep A, B and C in shared virtual
+//           memory (svm.hpp): the host fills A and B where the kernel
+//           reads them and checks C where the kernel wrote it, with no
+//           buffers and no copies.  The blocked kernel is run that way
+//           and, to compare, with buffers written and read back as
+//           usual.  With fine-grained SVM (integrated GPUs, CPUs) the
+//           pages are shared outright; with coarse-grained SVM they are
+//           mapped for the host between launches.
+//
+//  USAGE:   ./mult --svm [--size M N K]
+//
+//           Each time is the best of SVM_REPS, from the host, and takes
+//           in everything from the first write of A to C being readable
+//           on the host.  Devices without SVM run the buffers alone.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "matrix_lib.hpp"
+#include "variants.hpp"
+#include "svm.hpp"
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply with buffers and copies, returning the best time
+//
+//------------------------------------------------------------------------------
+static double withBuffers(util::Runtime& runtime, cl::Kernel& kernel, const Variant& variant,
+                          const util::TuningParams& params, int M, int N, int K, float& err)
+{
+    cl::Context& context = runtime.context();
+    cl::CommandQueue& queue = runtime.queue();
+
+    HostMatrix h_A(M * K), h_B(K * N), h_C(M * N);
+    cl::Buffer d_a(context, CL_MEM_READ_ONLY, sizeof(float) * M * K);
+    cl::Buffer d_b(context, CL_MEM_READ_ONLY, sizeof(float) * K * N);
+    cl::Buffer d_c(context, CL_MEM_WRITE_ONLY, sizeof(float) * M * N);
+
+    double best = 0.0;
+    for (int r = 0; r < SVM_REPS; r++)
+    {
+        double start = wtime();
+        initmat(M, N, K, h_A, h_B, h_C);
+        queue.enqueueWriteBuffer(d_a, CL_FALSE, 0, sizeof(float) * M * K, &h_A[0]);
+        queue.enqueueWriteBuffer(d_b, CL_FALSE, 0, sizeof(float) * K * N, &h_B[0]);
+        enqueueVariant(queue, kernel, variant, params, M, N, K, d_a, d_b, d_c);
+        queue.enqueueReadBuffer(d_c, CL_TRUE, 0, sizeof(float) * M * N, &h_C[0]);
+        double seconds = wtime() - start;
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    err = error(M, N, K, h_C);
+    return best;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply in SVM, returning the best time
+//
+//------------------------------------------------------------------------------
+static double withSVM(util::Runtime& runtime, cl::Kernel& kernel, const Variant& variant,
+                      const util::TuningParams& params, util::SVMKind kind,
+                      int M, int N, int K, float& err)
+{
+    cl::Context& context = runtime.context();
+    cl::CommandQueue& queue = runtime.queue();
+
+    util::SVMVector<float> s_a(context, kind, M * K), s_b(context, kind, K * N);
+    util::SVMVector<float> s_c(context, kind, M * N);
+
+    double best = 0.0;
+    for (int r = 0; r < SVM_REPS; r++)
+    {
+        double start = wtime();
+        s_a.hostAccess(queue);
+        s_b.hostAccess(queue);
+        std::fill(s_a.data(), s_a.data() + M * K, (float)AVAL);
+        std::fill(s_b.data(), s_b.data() + K * N, (float)BVAL);
+        s_a.deviceAccess(queue);
+        s_b.deviceAccess(queue);
+        s_c.deviceAccess(queue);
+
+        s_a.setArg(kernel, 3);
+        s_b.setArg(kernel, 4);
+        s_c.setArg(kernel, 5);
+        launchVariant(queue, kernel, variant, params, M, N, K);
+        queue.finish();
+        s_c.hostAccess(queue);
+        double seconds = wtime() - start;
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    err = error(M, N, K, s_c.data());
+    return best;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to compare the blocked multiplication in SVM with buffers
+//
+//------------------------------------------------------------------------------
+void svmMultiply(util::Runtime& runtime, const util::TuningFile& tuning,
+                 int M, int N, int K)
+{
+    const Variant& variant = findVariant(VARIANT_BLOCK);
+    util::TuningParams params = tuning.get(variant.name, defaultParams(variant));
+    std::string invalid = checkParams(variant, params, K, runtime.device());
+    if (!invalid.empty())
+    {
+        printf(" %s cannot be used: %s\n", variant.name, invalid.c_str());
+        return;
+    }
+    cl::Kernel& kernel = variantKernel(runtime, variant, params);
+
+    util::SVMKind kind = util::svmKind(runtime.device());
+    printf(" Device has %s\n", util::svmName(kind));
+
+    float err;
+    double buffers = withBuffers(runtime, kernel, variant, params, M, N, K, err);
+    printf(" %-8s %9.6f seconds, error %g\n", "buffers", buffers, err);
+    if (kind == util::SVM_NONE)
+    {
+        printf(" (buffers only: the device has no shared virtual memory)\n");
+        return;
+    }
+
+    double svm = withSVM(runtime, kernel, variant, params, kind, M, N, K, err);
+    printf(" %-8s %9.6f seconds, error %g, %.2fx the buffers\n", "SVM", svm, err,
+           buffers / svm);
+}
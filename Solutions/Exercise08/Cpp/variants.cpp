@@ -0,0 +1,435 @@
+//------------------------------------------------------------------------------
+//
+//  PROGRAM: OpenCL matrix multiplication variants
+//
+//  PURPOSE: The table of kernel variants run by the matrix multiplication
+//           driver, with their tuning parameters, and the functions to
+//           build and launch them.
+//
+//  USAGE:   Parameters marked as defines are compiled into the kernel with
+//           -D NAME=value; the others only change how the kernel is
+//           launched.  A work-group size ("local") of 0 leaves the choice
+//           to the OpenCL runtime.
+//
+//------------------------------------------------------------------------------
+
+#include "matmul.hpp"
+#include "variants.hpp"
+#include "program_cache.hpp"
+
+#include <sstream>
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+//  The variants, in the order the driver runs them
+//------------------------------------------------------------------------------
+const Variant variants[] =
+{
+    { VARIANT_ELEM, "elem", "../C_elem.cl",
+      "OpenCL, matrix mult, C(i,j) per work item, %s", 2,
+      {
+        { "local",  false, 0,  { 0, 4, 8, 16, 32, -1 } },
+        { "UNROLL", true,  1,  { 1, 2, 4, 8, -1 } }
+      }
+    },
+    { VARIANT_ROW, "row", "../C_row.cl",
+      "OpenCL, matrix mult, C row per work item, %s", 2,
+      {
+        { "local",  false, 0,  { 0, 16, 32, 64, 128, 256, -1 } },
+        { "UNROLL", true,  1,  { 1, 2, 4, 8, -1 } }
+      }
+    },
+    { VARIANT_ROW_PRIV, "row_priv", "../C_row_priv.cl",
+      "OpenCL, matrix mult, C row, A row in priv mem, %s", 2,
+      {
+        { "local",  false, ORDER / 16, { 0, 16, 32, 64, 128, 256, -1 } },
+        { "UNROLL", true,  1,  { 1, 2, 4, 8, -1 } }
+      }
+    },
+    { VARIANT_ROW_PRIV_BLOC, "row_priv_bloc", "../C_row_priv_bloc.cl",
+      "OpenCL, mat mult, C row, priv A, B cols loc, %s", 2,
+      {
+        { "local",  false, ORDER / 16, { 16, 32, 64, 128, 256, -1 } },
+        { "UNROLL", true,  1,  { 1, 2, 4, 8, -1 } }
+      }
+    },
+    { VARIANT_ROW_PRIV_PANEL, "row_priv_panel", "../C_row_priv_panel.cl",
+      "OpenCL, mat mult, C row, priv A, B panel loc, %s", 3,
+      {
+        { "local",  false, ORDER / 16, { 16, 32, 64, 128, 256, -1 } },
+        { "UNROLL", true,  1,  { 1, 2, 4, 8, -1 } },
+        { "NCOL",   true,  4,  { 2, 4, 8, 16, -1 } }
+      }
+    },
+    { VARIANT_BLOCK, "block", "../C_block_form.cl",
+      "Parallel matrix mult (blocked), %s on device", 1,
+      {
+        { "blksz",  true,  16, { 4, 8, 16, 32, -1 } }
+      }
+    },
+    { VARIANT_BLOCK_REG, "block_reg", "../C_block_reg.cl",
+      "Parallel matrix mult (blocked, register tiled), %s on device", 3,
+      {
+        { "TS",     true,  REG_TS,  { 16, 32, 64, 128, -1 } },
+        { "TSK",    true,  REG_TSK, { 4, 8, 16, 32, -1 } },
+        { "WPT",    true,  REG_WPT, { 1, 2, 4, 8, -1 } }
+      }
+    },
+    { VARIANT_BLOCK_SG, "block_sg", "../C_block_subgroup.cl",
+      "Parallel matrix mult (blocked, sub-group shuffles), %s on device", 1,
+      {
+        { "blksz",  true,  16, { 8, 16, 32, -1 } }
+      }
+    },
+    { VARIANT_ELEM_IMAGE, "elem_image", "../C_elem_image.cl",
+      "OpenCL, matrix mult, C(i,j) per work item, A and B as images, %s", 2,
+      {
+        { "local",  false, 0,  { 0, 4, 8, 16, 32, -1 } },
+        { "UNROLL", true,  1,  { 1, 2, 4, 8, -1 } }
+      }
+    }
+};
+
+const int NUM_VARIANTS = sizeof(variants) / sizeof(variants[0]);
+
+//------------------------------------------------------------------------------
+//
+//  The entry in the table for a kind of variant
+//
+//------------------------------------------------------------------------------
+const Variant& findVariant(VariantKind kind)
+{
+    for (int v = 0; v < NUM_VARIANTS; v++)
+        if (variants[v].kind == kind)
+            return variants[v];
+    return variants[0];
+}
+
+//------------------------------------------------------------------------------
+//
+//  Default tuning parameters for a variant
+//
+//------------------------------------------------------------------------------
+util::TuningParams defaultParams(const Variant& variant)
+{
+    util::TuningParams params;
+    for (int p = 0; p < variant.nparams; p++)
+        params[variant.params[p].name] = variant.params[p].def;
+    return params;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to check the parameters can be used on a device.  The
+//  kernels handle any M, N and K, so only the device limits matter.
+//
+//------------------------------------------------------------------------------
+std::string checkParams(const Variant& variant, const util::TuningParams& params,
+                        int K, const cl::Device& device)
+{
+    const ::size_t max_wg  = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    const cl_ulong max_loc = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    std::ostringstream why;
+
+    util::TuningParams p = defaultParams(variant);
+    for (util::TuningParams::const_iterator i = params.begin(); i != params.end(); ++i)
+        p[i->first] = i->second;
+
+    switch (variant.kind)
+    {
+    case VARIANT_ELEM:
+        if ((::size_t)(p["local"] * p["local"]) > max_wg)
+            why << "work-group " << p["local"] << "x" << p["local"] << " is too large";
+        break;
+
+    case VARIANT_ELEM_IMAGE:
+        // A is K wide and B K high; M and N are checked when the images
+        // are made
+        if (!device.getInfo<CL_DEVICE_IMAGE_SUPPORT>())
+            why << "the device has no images";
+        else if ((::size_t)K > device.getInfo<CL_DEVICE_IMAGE2D_MAX_WIDTH>() ||
+                 (::size_t)K > device.getInfo<CL_DEVICE_IMAGE2D_MAX_HEIGHT>())
+            why << "K of " << K << " is larger than an image can be";
+        else if ((::size_t)(p["local"] * p["local"]) > max_wg)
+            why << "work-group " << p["local"] << "x" << p["local"] << " is too large";
+        break;
+
+    case VARIANT_ROW_PRIV_BLOC:
+        // The column of B in local memory is at most AWRK (1024) long
+        if (sizeof(float) * std::min(K, 1024) > max_loc)
+            why << "a column of B does not fit in local memory";
+        // fall through
+
+    case VARIANT_ROW:
+    case VARIANT_ROW_PRIV:
+        if ((::size_t)p["local"] > max_wg)
+            why << "work-group " << p["local"] << " is too large";
+        break;
+
+    case VARIANT_ROW_PRIV_PANEL:
+        if (sizeof(float) * p["NCOL"] * std::min(K, 1024) > max_loc)
+            why << "a panel of " << p["NCOL"] << " columns of B does not fit in local memory";
+        else if ((::size_t)p["local"] > max_wg)
+            why << "work-group " << p["local"] << " is too large";
+        break;
+
+    case VARIANT_BLOCK:
+        if ((::size_t)(p["blksz"] * p["blksz"]) > max_wg)
+            why << "block size " << p["blksz"] << " is too large a work-group";
+        else if (2 * sizeof(float) * p["blksz"] * p["blksz"] > max_loc)
+            why << "block size " << p["blksz"] << " does not fit in local memory";
+        break;
+
+    case VARIANT_BLOCK_SG:
+        // Two blocks of B and, for the path without shuffles, one of A
+        if ((::size_t)(p["blksz"] * p["blksz"]) > max_wg)
+            why << "block size " << p["blksz"] << " is too large a work-group";
+        else if (3 * sizeof(float) * p["blksz"] * p["blksz"] > max_loc)
+            why << "block size " << p["blksz"] << " does not fit in local memory";
+        break;
+
+    case VARIANT_BLOCK_REG:
+        if (p["TS"] % p["WPT"] != 0 || p["TS"] % 4 != 0 || p["TSK"] % 4 != 0)
+            why << "tile " << p["TS"] << "x" << p["TSK"] << " is not a multiple of "
+                << p["WPT"] << " and 4";
+        else if ((::size_t)((p["TS"] / p["WPT"]) * (p["TS"] / p["WPT"])) > max_wg)
+            why << "tile " << p["TS"] << " / " << p["WPT"] << " is too large a work-group";
+        else if (2 * sizeof(float) * p["TS"] * p["TSK"] > max_loc)
+            why << "tile " << p["TS"] << "x" << p["TSK"] << " does not fit in local memory";
+        break;
+    }
+
+    return why.str();
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to build the program for a variant with the given parameters
+//
+//------------------------------------------------------------------------------
+std::string variantOptions(const Variant& variant, const util::TuningParams& params)
+{
+    std::ostringstream options;
+    for (int i = 0; i < variant.nparams; i++)
+    {
+        const TuneParam& param = variant.params[i];
+        if (!param.define)
+            continue;
+        util::TuningParams::const_iterator p = params.find(param.name);
+        options << " -D " << param.name << "=" << (p != params.end() ? p->second : param.def);
+    }
+    return options.str();
+}
+
+std::string specializedOptions(const Variant& variant, const util::TuningParams& params,
+                               int M, int N, int K)
+{
+    std::ostringstream options;
+    options << variantOptions(variant, params)
+            << " -D SIZE_M=" << M << " -D SIZE_N=" << N << " -D SIZE_K=" << K;
+
+    // A row of A that fits takes one pass, in a private array no longer
+    // than it needs (the column or panel of B in local memory is
+    // min(K, 1024) long either way)
+    const bool priv = variant.kind == VARIANT_ROW_PRIV || variant.kind == VARIANT_ROW_PRIV_BLOC ||
+                      variant.kind == VARIANT_ROW_PRIV_PANEL;
+    if (priv && K < 1024)
+        options << " -D AWRK=" << K;
+    return options.str();
+}
+
+cl::Program buildVariant(const cl::Context& context, const cl::Device& device,
+                         const Variant& variant, const util::TuningParams& params)
+{
+    return util::buildProgramFile(context, device, variant.file,
+                                  variantOptions(variant, params));
+}
+
+cl::Program& buildVariant(util::Runtime& runtime,
+                          const Variant& variant, const util::TuningParams& params)
+{
+    return runtime.program(variant.file, variantOptions(variant, params));
+}
+
+cl::Kernel& variantKernel(util::Runtime& runtime, const Variant& variant,
+                          const util::TuningParams& params, const char *name)
+{
+    return runtime.kernel(variant.file, name, variantOptions(variant, params));
+}
+
+cl::Kernel& specializedKernel(util::Runtime& runtime, const Variant& variant,
+                              const util::TuningParams& params, int M, int N, int K)
+{
+    return runtime.kernel(variant.file, "mmul_mnk", specializedOptions(variant, params, M, N, K));
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to round a global size up to a multiple of the work-group size
+//
+//------------------------------------------------------------------------------
+static int roundUp(int n, int multiple)
+{
+    return multiple > 0 ? ((n + multiple - 1) / multiple) * multiple : n;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to copy a width x height matrix of floats from a buffer into
+//  a new image, once the events in wait (if any) are complete
+//
+//------------------------------------------------------------------------------
+static cl::Image2D imageOf(cl::CommandQueue& queue, cl::Buffer& buffer, int width, int height,
+                           const std::vector<cl::Event>* wait)
+{
+    cl::Image2D image(queue.getInfo<CL_QUEUE_CONTEXT>(), CL_MEM_READ_ONLY,
+                      cl::ImageFormat(CL_R, CL_FLOAT), width, height);
+    cl::size_t<3> origin, region;
+    region[0] = width;
+    region[1] = height;
+    region[2] = 1;
+    queue.enqueueCopyBufferToImage(buffer, image, 0, origin, region, wait);
+    return image;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue one multiplication C(M,N) = A(M,K) * B(K,N)
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueVariant(cl::CommandQueue& queue, cl::Kernel& kernel,
+                    const Variant& variant, const util::TuningParams& params,
+                    int M, int N, int K,
+                    cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+                    const std::vector<cl::Event>* wait)
+{
+    if (variant.kind == VARIANT_ELEM_IMAGE)
+    {
+        // The copies come before the kernel on the queue.  Setting an
+        // argument does not retain it, so the images must outlive the
+        // kernel: this waits for it before they go
+        cl::Image2D image_a = imageOf(queue, d_a, K, M, wait);
+        cl::Image2D image_b = imageOf(queue, d_b, N, K, wait);
+        kernel.setArg(3, image_a);
+        kernel.setArg(4, image_b);
+        kernel.setArg(5, d_c);
+        cl::Event event = launchVariant(queue, kernel, variant, params, M, N, K);
+        event.wait();
+        return event;
+    }
+
+    kernel.setArg(3, d_a);
+    kernel.setArg(4, d_b);
+    kernel.setArg(5, d_c);
+    return launchVariant(queue, kernel, variant, params, M, N, K, wait);
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to give the work-items in a work-group of a variant's launch
+//
+//------------------------------------------------------------------------------
+::size_t variantGroupSize(const Variant& variant, const util::TuningParams& params)
+{
+    util::TuningParams p = defaultParams(variant);
+    for (util::TuningParams::const_iterator i = params.begin(); i != params.end(); ++i)
+        p[i->first] = i->second;
+
+    switch (variant.kind)
+    {
+    case VARIANT_ELEM:
+    case VARIANT_ELEM_IMAGE:
+        return p["local"] * p["local"];
+
+    case VARIANT_ROW:
+    case VARIANT_ROW_PRIV:
+    case VARIANT_ROW_PRIV_BLOC:
+    case VARIANT_ROW_PRIV_PANEL:
+        return p["local"];
+
+    case VARIANT_BLOCK:
+    case VARIANT_BLOCK_SG:
+        return p["blksz"] * p["blksz"];
+
+    case VARIANT_BLOCK_REG:
+        return (p["TS"] / p["WPT"]) * (p["TS"] / p["WPT"]);
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue the multiplication with A, B and C already set
+//
+//------------------------------------------------------------------------------
+cl::Event launchVariant(cl::CommandQueue& queue, cl::Kernel& kernel,
+                    const Variant& variant, const util::TuningParams& params,
+                    int M, int N, int K, const std::vector<cl::Event>* wait)
+{
+    util::TuningParams p = defaultParams(variant);
+    for (util::TuningParams::const_iterator i = params.begin(); i != params.end(); ++i)
+        p[i->first] = i->second;
+
+    kernel.setArg(0, M);
+    kernel.setArg(1, N);
+    kernel.setArg(2, K);
+
+    cl::NDRange global, local;
+
+    // The kernels skip work-items outside C, so the global sizes are
+    // rounded up to whole work-groups
+    switch (variant.kind)
+    {
+    case VARIANT_ELEM:
+    case VARIANT_ELEM_IMAGE:
+        // The local work group size of 0 tells the OpenCL runtime
+        // to figure out a local work group size for me
+        global = cl::NDRange(roundUp(M, p["local"]), roundUp(N, p["local"]));
+        local  = p["local"] ? cl::NDRange(p["local"], p["local"]) : cl::NullRange;
+        break;
+
+    case VARIANT_ROW_PRIV_BLOC:
+        kernel.setArg(6, cl::Local(sizeof(float) * std::min(K, 1024)));
+        // fall through
+
+    case VARIANT_ROW:
+    case VARIANT_ROW_PRIV:
+        global = cl::NDRange(roundUp(M, p["local"]));
+        local  = p["local"] ? cl::NDRange(p["local"]) : cl::NullRange;
+        break;
+
+    case VARIANT_ROW_PRIV_PANEL:
+        kernel.setArg(6, cl::Local(sizeof(float) * p["NCOL"] * std::min(K, 1024)));
+        global = cl::NDRange(roundUp(M, p["local"]));
+        local  = p["local"] ? cl::NDRange(p["local"]) : cl::NullRange;
+        break;
+
+    case VARIANT_BLOCK:
+        // Work-group computes a block of C.  This size is also set
+        // in a #define inside the kernel function.  Dimension 0 runs
+        // along the columns of C
+        kernel.setArg(6, cl::Local(sizeof(float) * p["blksz"] * p["blksz"]));
+        kernel.setArg(7, cl::Local(sizeof(float) * p["blksz"] * p["blksz"]));
+        global = cl::NDRange(roundUp(N, p["blksz"]), roundUp(M, p["blksz"]));
+        local  = cl::NDRange(p["blksz"], p["blksz"]);
+        break;
+
+    case VARIANT_BLOCK_SG:
+        // As the blocked kernel, with B double buffered
+        kernel.setArg(6, cl::Local(2 * sizeof(float) * p["blksz"] * p["blksz"]));
+        kernel.setArg(7, cl::Local(sizeof(float) * p["blksz"] * p["blksz"]));
+        global = cl::NDRange(roundUp(N, p["blksz"]), roundUp(M, p["blksz"]));
+        local  = cl::NDRange(p["blksz"], p["blksz"]);
+        break;
+
+    case VARIANT_BLOCK_REG:
+        // Each work-item computes a WPT x WPT tile of C
+        global = cl::NDRange(roundUp(N, p["TS"]) / p["WPT"], roundUp(M, p["TS"]) / p["WPT"]);
+        local  = cl::NDRange(p["TS"] / p["WPT"], p["TS"] / p["WPT"]);
+        break;
+    }
+
+    cl::Event event;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, wait, &event);
+    return event;
+}
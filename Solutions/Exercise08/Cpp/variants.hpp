@@ -0,0 +1,405 @@
+//------------------------------------------------------------------------------
+//
+//  Include file for the OpenCL matrix multiplication variants
+//
+//  Each variant of the product C = A * B is described by the kernel
+//  source it is built from, the parameters that can be tuned for a
+//  device (work-group sizes, tile sizes, unroll factors) and how it
+//  is launched.  The driver, the auto-tuner and the other run modes
+//  all go through this table.
+//
+//------------------------------------------------------------------------------
+
+#ifndef __VARIANTS_HDR
+#define __VARIANTS_HDR
+
+#include <string>
+#include <vector>
+
+#include "tuning.hpp"
+#include "runtime.hpp"
+
+#define MAX_TUNE_VALUES  8   // Max candidate values for one tuning parameter
+#define MAX_TUNE_PARAMS  3   // Max tuning parameters for one variant
+
+// How a variant is launched
+enum VariantKind
+{
+    VARIANT_ELEM,            // C(i,j) per work-item
+    VARIANT_ROW,             // C row per work-item
+    VARIANT_ROW_PRIV,        // C row per work-item, A row in private memory
+    VARIANT_ROW_PRIV_BLOC,   // ... and B column in local memory
+    VARIANT_ROW_PRIV_PANEL,  // ... and a panel of B columns in local memory
+    VARIANT_BLOCK,           // blocked
+    VARIANT_BLOCK_REG,       // blocked, register tiled
+    VARIANT_BLOCK_SG,        // blocked, A shared by sub-group shuffles
+    VARIANT_ELEM_IMAGE       // C(i,j) per work-item, A and B read as images
+};
+
+// A tuning parameter and the values the auto-tuner tries
+struct TuneParam
+{
+    const char *name;
+    bool        define;                  // passed to the build as -D name=value
+    int         def;                     // default value
+    int         values[MAX_TUNE_VALUES]; // candidates, terminated by -1
+};
+
+struct Variant
+{
+    VariantKind kind;
+    const char *name;        // short name used in tuning files
+    const char *file;        // kernel source file
+    const char *title;       // banner printed before results (takes the sizes, see sizeName)
+    int         nparams;
+    TuneParam   params[MAX_TUNE_PARAMS];
+};
+
+extern const Variant variants[];
+extern const int     NUM_VARIANTS;
+
+//------------------------------------------------------------------------------
+//
+//  The entry in the table for a kind of variant
+//
+//------------------------------------------------------------------------------
+const Variant& findVariant(VariantKind kind);
+
+//------------------------------------------------------------------------------
+//
+//  Default tuning parameters for a variant
+//
+//------------------------------------------------------------------------------
+util::TuningParams defaultParams(const Variant& variant);
+
+//------------------------------------------------------------------------------
+//
+//  Function to check the parameters can be used with inner dimension K
+//  on a device.  Returns an empty string if so, or the reason why not.
+//
+//------------------------------------------------------------------------------
+std::string checkParams(const Variant& variant, const util::TuningParams& params,
+                        int K, const cl::Device& device);
+
+//------------------------------------------------------------------------------
+//
+//  Functions to build the program for a variant with the given parameters.
+//  The build options are the parameters marked as defines.  With a
+//  runtime, the program is built once and kept for the next time the
+//  same variant and parameters are asked for.
+//
+//------------------------------------------------------------------------------
+std::string variantOptions(const Variant& variant, const util::TuningParams& params);
+
+cl::Program buildVariant(const cl::Context& context, const cl::Device& device,
+                         const Variant& variant, const util::TuningParams& params);
+
+cl::Program& buildVariant(util::Runtime& runtime,
+                          const Variant& variant, const util::TuningParams& params);
+
+cl::Kernel& variantKernel(util::Runtime& runtime, const Variant& variant,
+                          const util::TuningParams& params, const char *name = "mmul_mnk");
+
+//------------------------------------------------------------------------------
+//
+//  Functions to build a variant's "mmul_mnk" for one shape, with M, N
+//  and K compiled in (-D SIZE_M and so on) in place of the arguments.
+//  The kernel must only be launched at that shape.  Each shape is one
+//  more program, built once and kept like any other, so a run that
+//  keeps to a few fixed shapes pays for each build once (and with the
+//  binary cache, once across runs).
+//
+//------------------------------------------------------------------------------
+std::string specializedOptions(const Variant& variant, const util::TuningParams& params,
+                               int M, int N, int K);
+
+cl::Kernel& specializedKernel(util::Runtime& runtime, const Variant& variant,
+                              const util::TuningParams& params, int M, int N, int K);
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue one multiplication C(M,N) = A(M,K) * B(K,N) with
+//  the variant's "mmul_mnk" kernel, once the events in wait (if any) are
+//  complete.  Returns the kernel's event.  For a variant that reads images
+//  A and B are first copied into images, on the same queue, and the call
+//  waits for the kernel to finish, as the images are released on return.
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueVariant(cl::CommandQueue& queue, cl::Kernel& kernel,
+                    const Variant& variant, const util::TuningParams& params,
+                    int M, int N, int K,
+                    cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+                    const std::vector<cl::Event>* wait = NULL);
+
+//------------------------------------------------------------------------------
+//
+//  Function to enqueue the same multiplication once A, B and C have been
+//  set as arguments 3, 4 and 5 of kernel some other way (as SVM pointers
+//  in svm.cpp)
+//
+//------------------------------------------------------------------------------
+cl::Event launchVariant(cl::CommandQueue& queue, cl::Kernel& kernel,
+                    const Variant& variant, const util::TuningParams& params,
+                    int M, int N, int K, const std::vector<cl::Event>* wait = NULL);
+
+//------------------------------------------------------------------------------
+//
+//  Function to give the work-items in each work-group enqueueVariant
+//  launches, or 0 when the OpenCL runtime chooses
+//
+//------------------------------------------------------------------------------
+::size_t variantGroupSize(const Variant& variant, const util::TuningParams& params);
+
+//------------------------------------------------------------------------------
+//
+//  Function to tune every variant on a device and save the fastest
+//  parameters in its tuning file (autotune.cpp)
+//
+//------------------------------------------------------------------------------
+void autotune(util::Runtime& runtime, util::TuningFile& tuning,
+              int M, int N, int K, cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+              HostMatrix& h_C);
+
+// The sizes of one product C(M,N) = A(M,K) * B(K,N)
+struct MatrixSize
+{
+    int M, N, K;
+};
+
+// What a benchmark does with the device's stored baseline
+enum BaselineMode
+{
+    BASELINE_OFF,
+    BASELINE_SAVE,           // store this run's times as the baseline
+    BASELINE_CHECK           // compare this run's times with the baseline
+};
+
+//------------------------------------------------------------------------------
+//
+//  Function to time every variant repeatedly at each size and report
+//  percentiles, optionally writing them to a CSV or JSON file.  Unless
+//  verify is false each answer is checked first.  Returns the number of
+//  variants and sizes slower than the baseline by more than threshold
+//  (a fraction) when checking (bench.cpp).
+//
+//------------------------------------------------------------------------------
+int benchmark(util::Runtime& runtime, const util::TuningFile& tuning,
+              const std::vector<MatrixSize>& sizes, int reps, int warmup,
+              const std::string& out_file, bool verify = true,
+              BaselineMode baseline_mode = BASELINE_OFF, double threshold = BENCH_THRESHOLD);
+
+//------------------------------------------------------------------------------
+//
+//  Function to split one multiplication by rows of C across several
+//  devices, in proportion to their measured throughput (multidevice.cpp);
+//  with own_buffers each device has its own copies of its rows and of B
+//
+//------------------------------------------------------------------------------
+void multiDevice(const std::vector<cl::Device>& devices, int M, int N, int K,
+                 HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C,
+                 bool own_buffers = false);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply matrices too large for the device a tile of C at
+//  a time, streaming panels of A and B through it (outofcore.cpp).  A
+//  tile of 0 chooses one from the device's memory.
+//
+//------------------------------------------------------------------------------
+void outOfCore(const cl::Context& context, const cl::Device& device,
+               const util::TuningFile& tuning, int M, int N, int K, int tile,
+               HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply in panels of rows of C, overlapping the transfers
+//  of one panel with the computation of the next (pipeline.cpp)
+//
+//------------------------------------------------------------------------------
+void pipeline(const cl::Context& context, const cl::Device& device,
+              const util::TuningFile& tuning, int M, int N, int K, int panel,
+              HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C);
+
+//------------------------------------------------------------------------------
+//
+//  Functions to multiply a batch of same-sized matrices with one launch of
+//  the blocked kernel (batch.cpp).  The matrices of each operand are in one
+//  buffer, either stride floats apart or at the float offsets held in an
+//  int buffer.
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueBatched(cl::CommandQueue& queue, cl::Kernel& kernel,
+                         const util::TuningParams& params, int M, int N, int K, int batch,
+                         cl::Buffer& d_a, int strideA, cl::Buffer& d_b, int strideB,
+                         cl::Buffer& d_c, int strideC);
+
+cl::Event enqueueBatchedOffsets(cl::CommandQueue& queue, cl::Kernel& kernel,
+                                const util::TuningParams& params, int M, int N, int K,
+                                int batch, cl::Buffer& d_a, cl::Buffer& d_offA,
+                                cl::Buffer& d_b, cl::Buffer& d_offB,
+                                cl::Buffer& d_c, cl::Buffer& d_offC);
+
+//------------------------------------------------------------------------------
+//
+//  Function to compare a launch per matrix with the batched launches
+//
+//------------------------------------------------------------------------------
+void batched(const cl::Context& context, const cl::Device& device,
+             cl::CommandQueue& queue, const util::TuningFile& tuning,
+             int M, int N, int K, int batch);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply with A and B stored as halfs, then as 8 bit
+//  integers, and report each (lowp.cpp)
+//
+//------------------------------------------------------------------------------
+void lowPrecision(const cl::Context& context, const cl::Device& device,
+                  cl::CommandQueue& queue, const util::TuningFile& tuning,
+                  int M, int N, int K);
+
+//------------------------------------------------------------------------------
+//
+//  Functions for operands stored transposed (layout.cpp): to transpose
+//  X(rows,cols) on the device, to multiply C = op(A) * op(B) with the
+//  kernel built for the layout (-D TRANS_A, TRANS_B), and to compare that
+//  with transposing on the device first, for each of NN, NT, TN and TT
+//
+//------------------------------------------------------------------------------
+cl::Event enqueueTranspose(cl::CommandQueue& queue, cl::Kernel& kernel, int blksz,
+                           int rows, int cols, cl::Buffer& d_x, cl::Buffer& d_y);
+
+cl::Event enqueueLayout(cl::CommandQueue& queue, cl::Kernel& kernel, int blksz,
+                        int M, int N, int K,
+                        cl::Buffer& d_a, cl::Buffer& d_b, cl::Buffer& d_c,
+                        const std::vector<cl::Event>* wait = NULL);
+
+void layouts(const cl::Context& context, const cl::Device& device,
+             cl::CommandQueue& queue, const util::TuningFile& tuning,
+             int M, int N, int K);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply with the Strassen-Winograd recursion down to the
+//  crossover order, then the blocked kernel (strassen.cpp).  A crossover
+//  of 0 takes the tuned one; tune times the candidates and saves the best.
+//
+//------------------------------------------------------------------------------
+void strassen(util::Runtime& runtime, util::TuningFile& tuning, int M, int N, int K,
+              int crossover, bool tune);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply a random sparse A(M,K), with density of it
+//  nonzero, by a vector and by B(K,N) with the CSR and ELLPACK kernels,
+//  and by B with the dense blocked kernel (sparse.cpp)
+//
+//------------------------------------------------------------------------------
+void sparse(util::Runtime& runtime, const util::TuningFile& tuning,
+            int M, int N, int K, float density);
+
+// The parts of a GEMM epilogue, C = relu(alpha*A*B + beta*C + bias)
+struct Epilogue
+{
+    bool  alpha, beta, bias, relu;
+    float alpha_value, beta_value;
+};
+
+//------------------------------------------------------------------------------
+//
+//  Functions for the epilogue of the blocked kernel (epilogue.cpp): to
+//  read one from a SPEC such as "alpha=2,beta=0.5,bias,relu", to give
+//  the -D EPI_ options that compile it in, and to compare it fused into
+//  the kernel with a separate pass over C
+//
+//------------------------------------------------------------------------------
+bool parseEpilogue(const char *spec, Epilogue& epi);
+
+std::string epilogueOptions(const Epilogue& epi);
+
+void fusedEpilogue(const cl::Context& context, const cl::Device& device,
+                   cl::CommandQueue& queue, const util::TuningFile& tuning,
+                   int M, int N, int K, const Epilogue& epi);
+
+//------------------------------------------------------------------------------
+//
+//  Function to run every variant on a queue and C of its own, one at a
+//  time and then all at once, to see how far the device overlaps them
+//  (concurrent.cpp)
+//
+//------------------------------------------------------------------------------
+void concurrent(util::Runtime& runtime, const util::TuningFile& tuning,
+                int M, int N, int K);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply jobs times from SERVE_CLIENTS host threads through
+//  an executor with one thread, then workers, each thread with its own
+//  queue and kernel (serve.cpp)
+//
+//------------------------------------------------------------------------------
+void serve(util::Runtime& runtime, const util::TuningFile& tuning,
+           int M, int N, int K, int jobs, int workers);
+
+//------------------------------------------------------------------------------
+//
+//  Function to multiply with A, B and C in shared virtual memory, and with
+//  buffers and copies to compare, or with buffers alone on devices
+//  without SVM (svm.cpp)
+//
+//------------------------------------------------------------------------------
+void svmMultiply(util::Runtime& runtime, const util::TuningFile& tuning,
+                 int M, int N, int K);
+
+// The order to multiply a chain in: Ai is dims[i] x dims[i+1], and the
+// last product of Ai..Aj is (Ai..Ak)(Ak+1..Aj) with k = split[i][j]
+struct ChainPlan
+{
+    std::vector<int>               dims;
+    std::vector<std::vector<int> > split;
+    double                         flops;   // 2MNK over the products
+    std::string                    order;   // such as ((A1 A2) A3)
+};
+
+//------------------------------------------------------------------------------
+//
+//  Functions for chains of products (chain.cpp): to read the dimensions
+//  from "D0,D1,...,Dn", to plan the order with the fewest flops (or left
+//  to right), to enqueue a chain into result with the blocked kernel and
+//  the intermediates from the runtime's pool, returning the event of the
+//  last product, and to compare the planned order with left to right
+//
+//------------------------------------------------------------------------------
+bool parseChain(const char *spec, std::vector<int>& dims);
+
+ChainPlan planChain(const std::vector<int>& dims);
+
+ChainPlan leftToRight(const std::vector<int>& dims);
+
+cl::Event multiplyChain(util::Runtime& runtime, const util::TuningFile& tuning,
+                        const ChainPlan& plan, std::vector<cl::Buffer>& mats,
+                        cl::Buffer& result);
+
+void chain(util::Runtime& runtime, const util::TuningFile& tuning,
+           const std::vector<int>& dims);
+
+//------------------------------------------------------------------------------
+//
+//  Function to time every variant with the sizes as arguments and with
+//  them compiled in, and report the speedup (specialize.cpp)
+//
+//------------------------------------------------------------------------------
+void specialize(util::Runtime& runtime, const util::TuningFile& tuning,
+                int M, int N, int K);
+
+//------------------------------------------------------------------------------
+//
+//  Function to split the rows of C between the device and the host, run
+//  at once, rebalanced each pass from their measured throughput
+//  (hybrid.cpp)
+//
+//------------------------------------------------------------------------------
+void hybrid(util::Runtime& runtime, const util::TuningFile& tuning, int M, int N, int K,
+            HostMatrix& h_A, HostMatrix& h_B, HostMatrix& h_C);
+
+#endif
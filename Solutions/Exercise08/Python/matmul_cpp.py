@@ -0,0 +1,60 @@
+#
+# Matrix Multiplication through the C++ runtime
+#
+# The same product as matmul.py, C = A * B, but with the tuned variants of
+# Exercise08/Cpp, built (or taken from the program cache) by the C++ side
+# through the matmul_ocl module ("make python" in ../Cpp).  The matrices
+# are device buffers, filled and checked through memoryviews of their
+# mapped memory, so nothing is copied to or from numpy arrays.
+#
+# Usage:     python3 matmul_cpp.py [device] [variant ...]
+#
+#            device is an index of --list (default 0); the variants are
+#            names of the tuning file (default: block and block_reg).
+#
+
+import os
+import sys
+from array import array
+from time import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Cpp"))
+import matmul_ocl
+
+from definitions import *
+
+N = ORDER
+size = N * N
+
+device = int(sys.argv[1]) if len(sys.argv) > 1 else 0
+names = sys.argv[2:] or ["block", "block_reg"]
+
+runtime = matmul_ocl.Runtime(device)
+print("\nUsing OpenCL device: " + runtime.device_name())
+
+d_a = runtime.buffer(size)
+d_b = runtime.buffer(size)
+d_c = runtime.buffer(size)
+
+# Let go of the views before the device uses the buffers
+with memoryview(d_a) as a:
+    a[:] = array('f', [AVAL]) * size
+with memoryview(d_b) as b:
+    b[:] = array('f', [BVAL]) * size
+
+cval = float(N) * AVAL * BVAL
+for name in names:
+    print("\n===== Tuned variant " + name + " " + str(runtime.tuned(name)) +
+          ", order " + str(N) + " ======\n")
+    for i in range(COUNT):
+        start_time = time()
+        kernel_time = runtime.matmul(d_a, d_b, d_c, N, N, N, name)
+        run_time = time() - start_time
+
+        with memoryview(d_c) as c:
+            errsq = sum((x - cval) * (x - cval) for x in c)
+
+        mflops = 2.0 * N * N * N / (1000000.0 * kernel_time)
+        print("%f seconds (%f in the kernel) at %.1f MFLOPS" % (run_time, kernel_time, mflops))
+        if errsq > TOL:
+            print("Errors in multiplication: %g" % errsq)
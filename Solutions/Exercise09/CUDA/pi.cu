@@ -0,0 +1,215 @@
+//------------------------------------------------------------------------------
+//
+// Name:       pi.cu
+//
+// Purpose:    CUDA version of the numeric integration to estimate pi
+//             (pi_ocl.cl), for comparing the two on NVIDIA devices
+//
+// Usage:      ./pi [--precision float|double] [--steps N] [--device INDEX]
+//                  [--list]
+//
+//             As pi_ocl: each thread sums a run of steps, the block sums
+//             are reduced pairwise in shared memory, and the partial sums
+//             of the blocks are added up on the device by a second kernel
+//             (pi_final) run as one block, so only the result is read
+//             back.  The blocks fill the device, and steps is rounded up
+//             to a whole number of iterations for each thread.
+//
+//             The output is that of pi_ocl, so Tools/bench_suite.py reads
+//             either.  --device picks a CUDA device by its index in
+//             --list; this numbering is CUDA's, not the OpenCL one.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cuda.h>
+
+#define INSTEPS     (512*512*512)
+#define BLOCK_SIZE  256          // threads per block, a power of two
+#define BLOCKS_PER_SM 8          // blocks per multiprocessor to fill the device
+
+// Stop with CUDA's message if a call fails
+#define CHECK(call)                                                         \
+    do {                                                                    \
+        cudaError_t err = (call);                                           \
+        if (err != cudaSuccess) {                                           \
+            fprintf(stderr, "ERROR: %s (%s, line %d)\n",                    \
+                    cudaGetErrorString(err), __FILE__, __LINE__);           \
+            exit(EXIT_FAILURE);                                             \
+        }                                                                   \
+    } while (0)
+
+/*************************************************************************************
+ * CUDA kernels
+ ************************************************************************************/
+
+// Sum sums[0 .. BLOCK_SIZE-1] pairwise; all threads of the block must call this
+template <typename real>
+__device__ real reduce_block(real* sums)
+{
+    for (int half = BLOCK_SIZE / 2; half > 0; half /= 2) {
+        __syncthreads();
+        if (threadIdx.x < half)
+            sums[threadIdx.x] += sums[threadIdx.x + half];
+    }
+    __syncthreads();
+    return sums[0];
+}
+
+template <typename real>
+__global__ void pi(const int niters, const real step_size, real* partial_sums)
+{
+    __shared__ real sums[BLOCK_SIZE];
+
+    long long istart = ((long long)blockIdx.x * BLOCK_SIZE + threadIdx.x) * niters;
+    long long iend   = istart + niters;
+
+    real x, accum = 0;
+    for (long long i = istart; i < iend; i++) {
+        x = (i + (real)0.5) * step_size;
+        accum += (real)4 / ((real)1 + x*x);
+    }
+
+    sums[threadIdx.x] = accum;
+    real sum = reduce_block(sums);
+    if (threadIdx.x == 0)
+        partial_sums[blockIdx.x] = sum;
+}
+
+// Second stage, launched as one block: add up the partial sums on the device
+template <typename real>
+__global__ void pi_final(const int nsums, const real step_size,
+                         const real* partial_sums, real* result)
+{
+    __shared__ real sums[BLOCK_SIZE];
+
+    real accum = 0;
+    for (int i = threadIdx.x; i < nsums; i += BLOCK_SIZE)
+        accum += partial_sums[i];
+
+    sums[threadIdx.x] = accum;
+    accum = reduce_block(sums);
+    if (threadIdx.x == 0)
+        result[0] = accum * step_size;
+}
+
+/*************************************************************************************
+ * Host functions
+ ************************************************************************************/
+
+template <typename real>
+double integrate(const cudaDeviceProp& prop, long long in_nsteps)
+{
+    // Fill the device, then set the iterations per thread, the actual
+    // number of steps and the step size
+    long long nblocks = (long long)prop.multiProcessorCount * BLOCKS_PER_SM;
+    long long threads = nblocks * BLOCK_SIZE;
+    int niters = (int)((in_nsteps + threads - 1) / threads);
+    long long nsteps = (long long)niters * threads;
+    real step_size = (real)(1.0 / (double)nsteps);
+
+    printf(
+        " %d work groups of size %d, %d iterations each.  %lld Integration steps\n",
+        (int)nblocks,
+        BLOCK_SIZE,
+        niters,
+        nsteps);
+
+    real *d_partial_sums, *d_result, pi_res;
+    CHECK(cudaMalloc(&d_partial_sums, sizeof(real) * nblocks));
+    CHECK(cudaMalloc(&d_result, sizeof(real)));
+
+    cudaEvent_t start, stop;
+    CHECK(cudaEventCreate(&start));
+    CHECK(cudaEventCreate(&stop));
+
+    CHECK(cudaEventRecord(start));
+    pi<real><<<(int)nblocks, BLOCK_SIZE>>>(niters, step_size, d_partial_sums);
+    pi_final<real><<<1, BLOCK_SIZE>>>((int)nblocks, step_size, d_partial_sums, d_result);
+    CHECK(cudaMemcpy(&pi_res, d_result, sizeof(real), cudaMemcpyDeviceToHost));
+    CHECK(cudaEventRecord(stop));
+    CHECK(cudaEventSynchronize(stop));
+    CHECK(cudaGetLastError());
+
+    float ms = 0.0f;
+    CHECK(cudaEventElapsedTime(&ms, start, stop));
+    printf("\nThe calculation ran in %lf seconds\n", ms / 1000.0);
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(d_partial_sums);
+    cudaFree(d_result);
+    return pi_res;
+}
+
+static void listDevices(void)
+{
+    int count = 0;
+    CHECK(cudaGetDeviceCount(&count));
+    printf("\nDevices:\n");
+    for (int d = 0; d < count; d++) {
+        cudaDeviceProp prop;
+        CHECK(cudaGetDeviceProperties(&prop, d));
+        printf("%d: %s\n     %d multiprocessors at %d MHz\n",
+               d, prop.name, prop.multiProcessorCount, prop.clockRate / 1000);
+    }
+    printf("\n");
+}
+
+/*************************************************************************************
+ * Main function
+ ************************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    long long in_nsteps = INSTEPS;
+    const char *precision = "float";
+    int device = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--list")) {
+            listDevices();
+            return EXIT_SUCCESS;
+        }
+        else if (!strcmp(argv[i], "--device") && i + 1 < argc)
+            device = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--steps") && i + 1 < argc)
+            in_nsteps = strtoll(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--precision") && i + 1 < argc)
+            precision = argv[++i];
+        else {
+            printf("Usage: %s [--precision float|double] [--steps N] [--device INDEX] [--list]\n",
+                   argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (strcmp(precision, "float") && strcmp(precision, "double")) {
+        printf("Unknown precision %s (try float or double)\n", precision);
+        return EXIT_FAILURE;
+    }
+    if (in_nsteps < 1) {
+        printf("Invalid number of steps\n");
+        return EXIT_FAILURE;
+    }
+
+    int count = 0;
+    CHECK(cudaGetDeviceCount(&count));
+    if (device < 0 || device >= count) {
+        printf("Invalid device index (try '--list')\n");
+        return EXIT_FAILURE;
+    }
+    CHECK(cudaSetDevice(device));
+    cudaDeviceProp prop;
+    CHECK(cudaGetDeviceProperties(&prop, device));
+    printf("\nUsing CUDA device: %s\n", prop.name);
+
+    double pi_res = strcmp(precision, "double") ? integrate<float>(prop, in_nsteps)
+                                                : integrate<double>(prop, in_nsteps);
+
+    printf(" pi = %.12f (%s), error %.3e\n", pi_res, precision,
+        fabs(pi_res - 3.14159265358979323846));
+    return EXIT_SUCCESS;
+}
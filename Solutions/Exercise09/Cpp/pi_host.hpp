@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+//
+// Name:       pi_host.hpp
+//
+// Purpose:    The pi integration on the host's cores, as a fair baseline
+//             for the device and for machines with no OpenCL device
+//
+// Usage:      const char *isa;
+//             double pi = piHost(nsteps, threads, &isa);   // 0: all cores
+//
+//             The steps are split into a run per std::thread, and each
+//             run is vectorised with AVX-512 (8 doubles) or AVX2 and FMA
+//             (4 doubles, two vectors to a pass) when the CPU has them,
+//             as found at run time, so the program needs no -mavx flags.
+//             A vector of steps is x = (i + ramp) * step for the ramp
+//             0.5, 1.5, ..., and adds four / (one + x*x); the sums are
+//             double, as in the serial Exercise09/Cpp/pi.cpp, to the
+//             same answer.  On other CPUs the runs are plain loops.
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PI_HOST_X86
+#endif
+
+namespace {
+
+// Steps lo to hi - 1, one at a time
+inline double piRunScalar(long long lo, long long hi, double step)
+{
+    double sum = 0.0;
+    for (long long i = lo; i < hi; i++)
+    {
+        double x = (i + 0.5) * step;
+        sum += 4.0 / (1.0 + x * x);
+    }
+    return sum;
+}
+
+#ifdef PI_HOST_X86
+__attribute__((target("avx2,fma")))
+double piRunAVX2(long long lo, long long hi, double step)
+{
+    const __m256d ramp0 = _mm256_set_pd(3.5, 2.5, 1.5, 0.5);
+    const __m256d ramp1 = _mm256_set_pd(7.5, 6.5, 5.5, 4.5);
+    const __m256d four  = _mm256_set1_pd(4.0);
+    const __m256d one   = _mm256_set1_pd(1.0);
+    const __m256d vstep = _mm256_set1_pd(step);
+
+    // Two sums, so one division does not wait on the add of the other
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    long long i = lo;
+    for (; i + 8 <= hi; i += 8)
+    {
+        const __m256d base = _mm256_set1_pd((double)i);
+        const __m256d x0 = _mm256_mul_pd(_mm256_add_pd(base, ramp0), vstep);
+        const __m256d x1 = _mm256_mul_pd(_mm256_add_pd(base, ramp1), vstep);
+        sum0 = _mm256_add_pd(sum0, _mm256_div_pd(four, _mm256_fmadd_pd(x0, x0, one)));
+        sum1 = _mm256_add_pd(sum1, _mm256_div_pd(four, _mm256_fmadd_pd(x1, x1, one)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + piRunScalar(i, hi, step);
+}
+
+__attribute__((target("avx512f")))
+double piRunAVX512(long long lo, long long hi, double step)
+{
+    const __m512d ramp  = _mm512_set_pd(7.5, 6.5, 5.5, 4.5, 3.5, 2.5, 1.5, 0.5);
+    const __m512d four  = _mm512_set1_pd(4.0);
+    const __m512d one   = _mm512_set1_pd(1.0);
+    const __m512d vstep = _mm512_set1_pd(step);
+
+    __m512d sum = _mm512_setzero_pd();
+    long long i = lo;
+    for (; i + 8 <= hi; i += 8)
+    {
+        const __m512d x = _mm512_mul_pd(_mm512_add_pd(_mm512_set1_pd((double)i), ramp), vstep);
+        sum = _mm512_add_pd(sum, _mm512_div_pd(four, _mm512_fmadd_pd(x, x, one)));
+    }
+    return _mm512_reduce_add_pd(sum) + piRunScalar(i, hi, step);
+}
+#endif
+
+typedef double (*PiRun)(long long, long long, double);
+
+// The widest run the CPU can do, and its name
+inline PiRun piHostRun(const char **isa)
+{
+#ifdef PI_HOST_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        *isa = "AVX-512";
+        return piRunAVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        *isa = "AVX2";
+        return piRunAVX2;
+    }
+#endif
+    *isa = "scalar";
+    return piRunScalar;
+}
+
+} // namespace
+
+// pi with nsteps steps on threads threads (0 for one per hardware thread)
+inline double piHost(long long nsteps, unsigned int threads, const char **isa)
+{
+    const PiRun run = piHostRun(isa);
+    const double step = 1.0 / (double)nsteps;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned int)std::min((long long)threads, nsteps);
+
+    // Runs of whole vectors, the last taking what is left
+    const long long per = (nsteps / threads + 7) / 8 * 8;
+    std::vector<double> sums(threads, 0.0);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; t++)
+        workers.push_back(std::thread([&, t]() {
+            sums[t] = run(std::min(t * per, nsteps), std::min((t + 1) * per, nsteps), step);
+        }));
+    sums[0] = run(0, std::min(per, nsteps), step);
+    for (unsigned int t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    // The last run ends at nsteps, whatever the rounding
+    if (threads * per < nsteps)
+        sums[threads - 1] += run(threads * per, nsteps, step);
+
+    double sum = 0.0;
+    for (unsigned int t = 0; t < threads; t++)
+        sum += sums[t];
+    return sum * step;
+}
@@ -4,6 +4,58 @@
 //
 // Purpose:    Numeric integration to estimate pi
 //
+// Usage:      The run time is measured both with a host timer and with
+//             event profiling on the device; the device timings are
+//             printed at the end, and written to FILE (CSV, or JSON if
+//             FILE ends in .json) with --profile FILE, and the GFLOP/s
+//             of the integration against the device peak (roofline.hpp).
+//             OCL_TRACE=FILE writes a Chrome trace of the run (trace.hpp).
+//
+//             The partial sums of the work-groups are added up on the
+//             device by a second kernel (pi_final), so only the result
+//             is read back.  On OpenCL 2.0 devices the work-group sums
+//             use the work_group_reduce_add built-in.
+//
+//             --precision float|kahan|double picks the float kernel, the
+//             float kernel with compensated (Kahan) sums in each
+//             work-item, or the double kernel (cl_khr_fp64).  --steps N
+//             sets the number of integration steps; it may be past 2^31.
+//
+//             --share runs the integration on every device at once (of
+//             --list, CPUs and GPUs alike), in --chunks C pieces that each
+//             device takes from a shared counter as it has room, so fast
+//             devices do more of them; first the same chunks are dealt out
+//             evenly, to compare.  float and double only.  With --numa
+//             each device that can be is first split into one sub-device
+//             per NUMA node (sub_devices.hpp), each with its own context,
+//             queue and buffers, so a CPU on several sockets shares the
+//             chunks out a node at a time.
+//
+//             --host integrates on the host's cores instead, vectorised
+//             with AVX-512 or AVX2 where the CPU has them, on --threads N
+//             of them (default: all; see pi_host.hpp), in double.  It is
+//             also what runs when there is no OpenCL platform at all.
+//
+//             --monte-carlo estimates pi from --steps N random points of
+//             the unit square instead, made on the device by the Philox
+//             generator (random.hpp) from --seed S, and counted with the
+//             same work-group planning and tree reduction as the
+//             integration: a kernel of integer multiplies and no memory
+//             traffic, to set against the divides of the integration.
+//             It reports the points a second, from the kernel's event and
+//             from the host timer.  The error falls as 1/sqrt(N), so it
+//             needs far more points than the integration does steps.
+//
+//             --integrand EXPR integrates any function instead of pi's,
+//             with the generated kernels of quadrature.hpp: EXPR is OpenCL
+//             C in x0, x1, ... over --dims D dimensions (default 1), from
+//             --from A to --to B along each (default 0 and 1), in --steps N
+//             cells along each dimension (default 1024 past one dimension)
+//             with --rule midpoint (default), simpson or gauss1 .. gauss5,
+//             in --precision float or double.  --define OPTS passes build
+//             options, such as -D K=2, that EXPR may use.  It reports the
+//             integrand's evaluations a second.
+//
 // HISTORY:    Written by Tim Mattson, May 2010
 //             Ported to the C++ Wrapper API by Benedict R. Gaster, September 2011
 //             Updated by Tom Deakin and Simon McIntosh-Smith, October 2012
@@ -20,38 +72,620 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <algorithm>
+#include <cmath>
 
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <thread>
 
 
 #include "err_code.h"
 #include "device_picker.hpp"
+#include "program_cache.hpp"
+#include "profiler.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
+#include "launch_plan.hpp"
+#include "pi_host.hpp"
+#include "random.hpp"
+#include "quadrature.hpp"
+#include "sub_devices.hpp"
 
 #define INSTEPS (512*512*512)
-#define ITERS (262144)
+#define SHARE_CHUNKS 256     // pieces of the integration in --share mode
+#define MC_SEED 2011         // default seed of --monte-carlo
+#define QUAD_CELLS 1024      // default cells a dimension of --integrand, past one
 
-int main(int argc, char *argv[])
+//------------------------------------------------------------------------------
+//
+//  Function to run the integration with the kernels named pi_name and
+//  final_name, which sum in real (float or double), returning pi
+//
+//------------------------------------------------------------------------------
+template <typename real>
+double integrate(const cl::Context& context, const cl::Device& device,
+                 cl::CommandQueue& queue, cl::Program& program,
+                 const char *pi_name, const char *final_name,
+                 cl_long in_nsteps, util::Profiler& profiler, util::Roofline& roofline)
 {
-    float *h_psum;					// vector to hold partial sum
-    int in_nsteps = INSTEPS;		// default number of steps (updated later to device prefereable)
-    int niters = ITERS;				// number of iterations
-    int nsteps;
-    float step_size;
-    ::size_t nwork_groups;
-    ::size_t max_size, work_group_size = 8;
-    float pi_res;
+    real step_size;
+    real pi_res;
+
+    cl::make_kernel<int, real, cl::LocalSpaceArg, cl::Buffer> pi(program, pi_name);
+    cl::make_kernel<int, real, cl::Buffer, cl::LocalSpaceArg, cl::Buffer>
+        pi_final(program, final_name);
+
+    // The second stage runs as one work-group
+    cl::Kernel ko_final(program, final_name);
+    ::size_t final_size = ko_final.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+
+    // Size the work-groups and their number to fill the device, then set
+    // the iterations per work-item, the actual number of steps and the
+    // step size
+    util::LaunchPlan plan = util::planLaunch(cl::Kernel(program, pi_name), device, in_nsteps);
+    ::size_t nwork_groups = plan.work_groups;
+    ::size_t work_group_size = plan.work_group_size;
+    int niters = (int)plan.iters;
+    cl_long nsteps = plan.steps;
+    step_size = 1.0/static_cast<double>(nsteps);
+
+    printf(
+        " %d work groups of size %d, %d iterations each.  %lld Integration steps\n",
+        (int)nwork_groups,
+        (int)work_group_size,
+        niters,
+        (long long)nsteps);
+
+    cl::Buffer d_partial_sums(context, CL_MEM_READ_WRITE, sizeof(real) * nwork_groups);
+    cl::Buffer d_result(context, CL_MEM_WRITE_ONLY, sizeof(real));
+
+    util::Timer timer;
+
+    // Execute the kernel over the entire range of our 1d input data set
+    // using the maximum number of work group items for this device
+    util::TraceSpan span("integrate", pi_name);
+    cl::Event pi_event = pi(
+        cl::EnqueueArgs(
+                queue,
+                cl::NDRange(nwork_groups * work_group_size),
+                cl::NDRange(work_group_size)),
+                niters,
+                step_size,
+                cl::Local(sizeof(real) * work_group_size),
+                d_partial_sums);
+    profiler.record(pi_name, pi_event);
+
+    // Add up the partial sums on the device
+    final_size = std::min(final_size, nwork_groups);
+    cl::Event event = pi_final(
+        cl::EnqueueArgs(
+                queue,
+                cl::NDRange(final_size),
+                cl::NDRange(final_size)),
+                (int)nwork_groups,
+                step_size,
+                d_partial_sums,
+                cl::Local(sizeof(real) * final_size),
+                d_result);
+    profiler.record(final_name, event);
+
+    queue.enqueueReadBuffer(d_result, CL_TRUE, 0, sizeof(real), &pi_res, NULL, &event);
+    profiler.record("read result", event);
+
+    roofline.record(pi_name, util::piCost(nsteps, sizeof(real) * nwork_groups),
+                    util::eventSeconds(pi_event));
+
+    //rtime = wtime() - rtime;
+    double rtime = static_cast<double>(timer.getTimeMilliseconds()) / 1000.;
+    printf("\nThe calculation ran in %lf seconds\n", rtime);
+    return pi_res;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to estimate pi from in_nsamples random points, counting
+//  those inside the quarter circle, returning pi
+//
+//------------------------------------------------------------------------------
+double monteCarlo(const cl::Context& context, const cl::Device& device,
+                  cl::CommandQueue& queue, cl_long in_nsamples, cl_ulong seed,
+                  util::Profiler& profiler)
+{
+    // The generator's source first, for philox_at
+    cl::Program program = util::buildProgram(context, device,
+        std::string(util::philoxSource()) + util::loadProgram("../pi_mc.cl"));
+
+    cl::make_kernel<int, cl_uint, cl_uint, cl_long, cl::LocalSpaceArg, cl::Buffer>
+        pi_mc(program, "pi_mc");
+    cl::make_kernel<int, cl::Buffer, cl::LocalSpaceArg, cl::Buffer>
+        pi_mc_final(program, "pi_mc_final");
+
+    cl::Kernel ko_final(program, "pi_mc_final");
+    ::size_t final_size = ko_final.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+
+    // A step is a counter of the generator, which makes two points
+    util::LaunchPlan plan = util::planLaunch(cl::Kernel(program, "pi_mc"), device,
+                                             (in_nsamples + 1) / 2);
+    ::size_t nwork_groups = plan.work_groups;
+    ::size_t work_group_size = plan.work_group_size;
+    int niters = (int)plan.iters;
+    cl_long nsamples = plan.steps * 2;
+
+    printf(
+        " %d work groups of size %d, %d counters each.  %lld Random points\n",
+        (int)nwork_groups,
+        (int)work_group_size,
+        niters,
+        (long long)nsamples);
+
+    cl::Buffer d_partial_hits(context, CL_MEM_READ_WRITE, sizeof(cl_ulong) * nwork_groups);
+    cl::Buffer d_result(context, CL_MEM_WRITE_ONLY, sizeof(cl_ulong));
+
+    util::Timer timer;
+
+    util::TraceSpan span("monte-carlo", "pi_mc");
+    cl::Event mc_event = pi_mc(
+        cl::EnqueueArgs(
+                queue,
+                cl::NDRange(nwork_groups * work_group_size),
+                cl::NDRange(work_group_size)),
+                niters,
+                (cl_uint)seed,
+                (cl_uint)(seed >> 32),
+                (cl_long)0,
+                cl::Local(sizeof(cl_ulong) * work_group_size),
+                d_partial_hits);
+    profiler.record("pi_mc", mc_event);
+
+    final_size = std::min(final_size, nwork_groups);
+    cl::Event event = pi_mc_final(
+        cl::EnqueueArgs(
+                queue,
+                cl::NDRange(final_size),
+                cl::NDRange(final_size)),
+                (int)nwork_groups,
+                d_partial_hits,
+                cl::Local(sizeof(cl_ulong) * final_size),
+                d_result);
+    profiler.record("pi_mc_final", event);
+
+    cl_ulong hits = 0;
+    queue.enqueueReadBuffer(d_result, CL_TRUE, 0, sizeof(cl_ulong), &hits, NULL, &event);
+    profiler.record("read result", event);
+
+    double rtime = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+    printf("\nThe calculation ran in %lf seconds\n", rtime);
+    printf(" %.3e points/s in the kernel, %.3e from the host\n",
+           nsamples / util::eventSeconds(mc_event), nsamples / rtime);
+    return 4.0 * (double)hits / (double)nsamples;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Function to integrate spec over [from, to]^dims in cells a dimension,
+//  returning the integral
+//
+//------------------------------------------------------------------------------
+double quadrature(const cl::Context& context, const cl::Device& device,
+                  cl::CommandQueue& queue, const util::QuadratureSpec& spec,
+                  double from, double to, cl_long cells, util::Profiler& profiler)
+{
+    util::Quadrature quad(context, device);
+    std::vector<double> lo(spec.dims, from), hi(spec.dims, to);
+
+    util::Timer timer;
+    util::TraceSpan span("quadrature", spec.expr);
+    util::QuadratureResult result = quad.integrate(queue, spec, &lo[0], &hi[0], cells);
+    double rtime = static_cast<double>(timer.getTimeMicroseconds()) / 1.0e6;
+    profiler.record("quadrature", result.event);
+
+    printf(" %lld cells, %lld evaluations of %s\n", (long long)result.cells,
+           (long long)result.evaluations, spec.expr.c_str());
+    printf("\nThe calculation ran in %lf seconds (with the build)\n", rtime);
+    printf(" %.3e evaluations/s in the kernel\n",
+           result.evaluations / util::eventSeconds(result.event));
+    return result.value;
+}
+
+//------------------------------------------------------------------------------
+//
+//  Every device at once: the steps are cut into chunks, and each device
+//  has a host thread taking the next chunk from a shared counter when it
+//  has room for one, so a fast device takes more of them than a slow
+//  one.  A device keeps two chunks in flight, so it has the next to start
+//  while the host waits on the last.  With stealing false the chunks are
+//  dealt round the devices in turn instead, as a fixed, even split.
+//
+//------------------------------------------------------------------------------
 
-    cl::Buffer d_partial_sums;
+// The build options for a device: its work-group reduction if it has one
+static std::string piOptions(const cl::Device& device)
+{
+    std::string version = device.getInfo<CL_DEVICE_OPENCL_C_VERSION>();
+    if (version.size() > 9 && version[9] >= '2')
+        return "-cl-std=CL2.0 -D USE_WG_REDUCE";
+    return "";
+}
+
+// One device's part in the shared integration
+struct Share
+{
+    std::string         name;
+    cl::Device          device;
+    cl::Context         context;
+    cl::CommandQueue    queue;
+    cl::Program         program;
+    cl_long             chunks;       // taken in the last run
+    double              seconds;      // from its first chunk to its last answer
+    double              sum;
+    std::string         error;
+};
+
+template <typename real>
+static void shareWork(Share& share, const char *chunk_name, const char *final_name,
+                      std::atomic<cl_long>& next, cl_long nchunks, cl_long chunk,
+                      real step_size, bool stealing, unsigned int index, unsigned int ndevices)
+{
+    try
+    {
+        cl::Kernel ko_chunk(share.program, chunk_name);
+        cl::Kernel ko_final(share.program, final_name);
+        util::LaunchPlan plan = util::planLaunch(ko_chunk, share.device, chunk);
+        ::size_t final_size = std::min(
+            ko_final.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(share.device), plan.work_groups);
+
+        cl::Buffer d_partial_sums[2], d_result[2];
+        for (int b = 0; b < 2; b++)
+        {
+            d_partial_sums[b] = cl::Buffer(share.context, CL_MEM_READ_WRITE, sizeof(real) * plan.work_groups);
+            d_result[b] = cl::Buffer(share.context, CL_MEM_WRITE_ONLY, sizeof(real));
+        }
+
+        real result[2];
+        cl::Event read[2];
+        bool busy[2] = { false, false };
+        int slot = 0;
+        cl_long taken = 0, mine = index;
+        share.sum = 0.0;
+
+        util::Timer timer;
+        for (;;)
+        {
+            const cl_long c = stealing ? next.fetch_add(1) : mine;
+            mine += ndevices;
+            if (c >= nchunks)
+                break;
+            taken++;
+
+            ko_chunk.setArg(0, (int)plan.iters);
+            ko_chunk.setArg(1, step_size);
+            ko_chunk.setArg(2, c * chunk);
+            ko_chunk.setArg(3, (c + 1) * chunk);
+            ko_chunk.setArg(4, cl::Local(sizeof(real) * plan.work_group_size));
+            ko_chunk.setArg(5, d_partial_sums[slot]);
+            share.queue.enqueueNDRangeKernel(ko_chunk, cl::NullRange,
+                cl::NDRange(plan.work_groups * plan.work_group_size), cl::NDRange(plan.work_group_size));
+
+            ko_final.setArg(0, (int)plan.work_groups);
+            ko_final.setArg(1, step_size);
+            ko_final.setArg(2, d_partial_sums[slot]);
+            ko_final.setArg(3, cl::Local(sizeof(real) * final_size));
+            ko_final.setArg(4, d_result[slot]);
+            share.queue.enqueueNDRangeKernel(ko_final, cl::NullRange,
+                cl::NDRange(final_size), cl::NDRange(final_size));
+
+            share.queue.enqueueReadBuffer(d_result[slot], CL_FALSE, 0, sizeof(real),
+                                          &result[slot], NULL, &read[slot]);
+            share.queue.flush();
+            busy[slot] = true;
+
+            // Add up the chunk before, while this one runs
+            slot ^= 1;
+            if (busy[slot])
+            {
+                read[slot].wait();
+                share.sum += result[slot];
+                busy[slot] = false;
+            }
+        }
+        for (int b = 0; b < 2; b++)
+            if (busy[b])
+            {
+                read[b].wait();
+                share.sum += result[b];
+            }
+
+        share.chunks = taken;
+        share.seconds = timer.getTimeMicroseconds() / 1.0e6;
+    } catch (cl::Error err)
+    {
+        share.error = std::string(err.what()) + " (" + err_code(err.err()) + ")";
+    }
+}
+
+template <typename real>
+static void shareRun(std::vector<Share>& shares, const char *chunk_name, const char *final_name,
+                     cl_long nchunks, cl_long chunk, bool stealing)
+{
+    const cl_long nsteps = nchunks * chunk;
+    const real step_size = (real)(1.0 / static_cast<double>(nsteps));
+    std::atomic<cl_long> next(0);
+
+    util::Timer timer;
+    std::vector<std::thread> threads;
+    for (unsigned int d = 0; d < shares.size(); d++)
+        threads.push_back(std::thread(shareWork<real>, std::ref(shares[d]), chunk_name, final_name,
+                                      std::ref(next), nchunks, chunk, step_size, stealing,
+                                      d, (unsigned int)shares.size()));
+    for (unsigned int d = 0; d < threads.size(); d++)
+        threads[d].join();
+    const double rtime = timer.getTimeMicroseconds() / 1.0e6;
+
+    double pi_res = 0.0;
+    printf("\n %s: %lld chunks of %lld steps\n",
+           stealing ? "Taken from a shared queue" : "Dealt out evenly",
+           (long long)nchunks, (long long)chunk);
+    for (unsigned int d = 0; d < shares.size(); d++)
+    {
+        Share& share = shares[d];
+        if (!share.error.empty())
+        {
+            printf("   %-40s failed: %s\n", share.name.c_str(), share.error.c_str());
+            continue;
+        }
+        pi_res += share.sum;
+        printf("   %-40s %6lld chunks (%5.1f%%) in %.3f s, %.2f Gsteps/s\n", share.name.c_str(),
+               (long long)share.chunks, 100.0 * share.chunks / nchunks, share.seconds,
+               share.seconds > 0.0 ? share.chunks * chunk / (1.0e9 * share.seconds) : 0.0);
+    }
+    printf(" %.3f seconds, %.2f Gsteps/s: pi = %.12f, error %.3e\n", rtime,
+           nsteps / (1.0e9 * rtime), pi_res, fabs(pi_res - 3.14159265358979323846));
+}
+
+// Set up every device, run the even split and then the shared queue
+static void shareAll(cl_long in_nsteps, cl_long nchunks, bool dp, bool numa)
+{
+    std::vector<cl::Device> devices;
+    getDeviceList(devices);
+
+    // A device of several NUMA nodes stands for one sub-device a node
+    std::vector<cl::Device> parts;
+    std::vector<int> nodes;
+    for (unsigned int d = 0; d < devices.size(); d++)
+    {
+        std::vector<cl::Device> sub(1, devices[d]);
+        if (numa)
+            sub = util::numaSubDevices(devices[d]);
+        for (unsigned int n = 0; n < sub.size(); n++)
+        {
+            parts.push_back(sub[n]);
+            nodes.push_back(sub.size() > 1 ? (int)n : -1);
+        }
+    }
+    devices.swap(parts);
+
+    std::vector<Share> shares;
+    for (unsigned int d = 0; d < devices.size(); d++)
+    {
+        Share share;
+        share.device = devices[d];
+        getDeviceName(share.device, share.name);
+        if (nodes[d] >= 0)
+            share.name += " (node " + std::to_string(nodes[d]) + ")";
+        if (dp && share.device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") == std::string::npos)
+        {
+            std::cout << " " << share.name << ": no double precision, left out\n";
+            continue;
+        }
+        share.context = cl::Context(std::vector<cl::Device>(1, share.device));
+        share.queue = cl::CommandQueue(share.context, share.device);
+        share.program = util::buildProgramFile(share.context, share.device, "../pi_ocl.cl",
+                                               piOptions(share.device));
+        share.chunks = 0;
+        share.seconds = 0.0;
+        shares.push_back(share);
+        std::cout << " " << d << ": " << share.name << "\n";
+    }
+    if (shares.empty())
+    {
+        std::cout << "No devices to share the integration over\n";
+        return;
+    }
+
+    // Whole chunks, at least one step each
+    cl_long chunk = std::max((cl_long)1, (in_nsteps + nchunks - 1) / nchunks);
+    nchunks = (in_nsteps + chunk - 1) / chunk;
+
+    for (int run = 0; run < 2; run++)
+    {
+        if (dp)
+            shareRun<double>(shares, "pi_chunk_dp", "pi_final_dp", nchunks, chunk, run == 1);
+        else
+            shareRun<float>(shares, "pi_chunk", "pi_final", nchunks, chunk, run == 1);
+    }
+}
+
+//------------------------------------------------------------------------------
+//
+//  The integration on the host, timed as the device runs are
+//
+//------------------------------------------------------------------------------
+static void runHost(cl_long nsteps, unsigned int threads)
+{
+    const char *isa;
+    util::Timer timer;
+    double pi_res = piHost(nsteps, threads, &isa);
+    double rtime = timer.getTimeMicroseconds() / 1.0e6;
+
+    printf(" Host (%s, %u threads), %lld Integration steps\n", isa,
+           threads ? threads : std::max(1u, std::thread::hardware_concurrency()),
+           (long long)nsteps);
+    printf("\nThe calculation ran in %lf seconds\n", rtime);
+    printf(" pi = %.12f (double), error %.3e\n", pi_res, fabs(pi_res - 3.14159265358979323846));
+}
+
+int main(int argc, char *argv[])
+{
+    cl_long in_nsteps = INSTEPS;	// default number of steps (updated later to device prefereable)
+    double pi_res;
 
     try
     {
         cl_uint deviceIndex = 0;
-        parseArguments(argc, argv, &deviceIndex);
+        parseArguments(argc, argv, &deviceIndex,
+            "      --precision  P       float (default), kahan or double\n"
+            "      --steps      N       Number of integration steps\n"
+            "      --profile    FILE    Write the device timings to FILE (.csv or .json)\n"
+            "      --share              Share the integration over every device, a chunk at a time\n"
+            "      --chunks     C       Chunks to share out (default 256)\n"
+            "      --numa               Share over each NUMA node of a device separately\n"
+            "      --host               Integrate on the host's cores (AVX-512/AVX2)\n"
+            "      --threads    N       Host threads (default: all)\n"
+            "      --monte-carlo        Estimate pi from N random points on the device\n"
+            "      --seed       S       Seed of the random points (default 2011)\n"
+            "      --integrand  EXPR    Integrate EXPR, in x0, x1, ..., instead of pi's\n"
+            "      --dims       D       Dimensions of the integrand (default 1)\n"
+            "      --from       A       Lower bound of each dimension (default 0)\n"
+            "      --to         B       Upper bound of each dimension (default 1)\n"
+            "      --rule       R       midpoint (default), simpson or gauss1 .. gauss5\n"
+            "      --define     OPTS    Build options for the integrand, such as -D K=2\n");
+
+        std::string profile_file;
+        std::string precision = "float";
+        cl_long nchunks = SHARE_CHUNKS;
+        bool share = false, host = false, monte_carlo = false, numa = false;
+        unsigned int threads = 0;
+        cl_ulong seed = MC_SEED;
+        std::string integrand, rule = "midpoint", defines;
+        unsigned int dims = 1;
+        double from = 0.0, to = 1.0;
+        bool steps_given = false;
+        for (int i = 1; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--share"))
+                share = true;
+            else if (!strcmp(argv[i], "--host"))
+                host = true;
+            else if (!strcmp(argv[i], "--monte-carlo"))
+                monte_carlo = true;
+            else if (!strcmp(argv[i], "--numa"))
+                numa = true;
+        }
+        for (int i = 1; i < argc - 1; i++)
+        {
+            if (!strcmp(argv[i], "--chunks"))
+                nchunks = strtoll(argv[i + 1], NULL, 10);
+            else if (!strcmp(argv[i], "--threads"))
+                threads = std::max(0, atoi(argv[i + 1]));
+            else if (!strcmp(argv[i], "--profile"))
+                profile_file = argv[i + 1];
+            else if (!strcmp(argv[i], "--precision"))
+                precision = argv[i + 1];
+            else if (!strcmp(argv[i], "--steps"))
+            {
+                in_nsteps = strtoll(argv[i + 1], NULL, 10);
+                steps_given = true;
+            }
+            else if (!strcmp(argv[i], "--seed"))
+                seed = strtoull(argv[i + 1], NULL, 10);
+            else if (!strcmp(argv[i], "--integrand"))
+                integrand = argv[i + 1];
+            else if (!strcmp(argv[i], "--dims"))
+                dims = std::max(0, atoi(argv[i + 1]));
+            else if (!strcmp(argv[i], "--from"))
+                from = atof(argv[i + 1]);
+            else if (!strcmp(argv[i], "--to"))
+                to = atof(argv[i + 1]);
+            else if (!strcmp(argv[i], "--rule"))
+                rule = argv[i + 1];
+            else if (!strcmp(argv[i], "--define"))
+                defines = argv[i + 1];
+        }
+
+        if (precision != "float" && precision != "kahan" && precision != "double")
+        {
+            std::cout << "Unknown precision " << precision << " (try float, kahan or double)\n";
+            return EXIT_FAILURE;
+        }
+        if (in_nsteps < 1)
+        {
+            std::cout << "Invalid number of steps\n";
+            return EXIT_FAILURE;
+        }
+
+        if (numa && !share)
+        {
+            std::cout << "--numa splits the devices of --share\n";
+            return EXIT_FAILURE;
+        }
+
+        if ((monte_carlo || !integrand.empty()) && (host || share))
+        {
+            std::cout << "--monte-carlo and --integrand run on one device, not with --host or --share\n";
+            return EXIT_FAILURE;
+        }
+
+        util::QuadratureSpec spec(integrand, dims);
+        if (!integrand.empty())
+        {
+            if (rule == "simpson")
+                spec.simpson();
+            else if (rule.compare(0, 5, "gauss") == 0 && rule.size() == 6 &&
+                     rule[5] >= '1' && rule[5] <= '5')
+                spec.gauss(rule[5] - '0');
+            else if (rule != "midpoint")
+            {
+                std::cout << "Unknown rule " << rule << " (try midpoint, simpson or gauss1 .. gauss5)\n";
+                return EXIT_FAILURE;
+            }
+            if (precision == "kahan" || dims < 1)
+            {
+                std::cout << "--integrand takes --precision float or double and --dims of 1 or more\n";
+                return EXIT_FAILURE;
+            }
+            spec.precision(precision).options(defines);
+            if (!steps_given && dims > 1)
+                in_nsteps = QUAD_CELLS;
+        }
+
+        if (host)
+        {
+            runHost(in_nsteps, threads);
+            return EXIT_SUCCESS;
+        }
+
+        if (share)
+        {
+            if (precision == "kahan" || nchunks < 1)
+            {
+                std::cout << "--share takes --precision float or double and --chunks of 1 or more\n";
+                return EXIT_FAILURE;
+            }
+            shareAll(in_nsteps, nchunks, precision == "double", numa);
+            return EXIT_SUCCESS;
+        }
 
         // Get list of devices
+        // With no platform at all, the host does the work
         std::vector<cl::Device> devices;
-        unsigned numDevices = getDeviceList(devices);
+        unsigned numDevices;
+        try
+        {
+            numDevices = getDeviceList(devices);
+        } catch (cl::Error err)
+        {
+            if (monte_carlo || !integrand.empty())
+            {
+                std::cout << "No OpenCL platform (" << err_code(err.err()) << ") for "
+                          << (monte_carlo ? "--monte-carlo\n" : "--integrand\n");
+                return EXIT_FAILURE;
+            }
+            std::cout << "No OpenCL platform (" << err_code(err.err()) << "), running on the host\n";
+            runHost(in_nsteps, threads);
+            return EXIT_SUCCESS;
+        }
 
         // Check device index in range
         if (deviceIndex >= numDevices)
@@ -66,71 +700,61 @@ int main(int argc, char *argv[])
         getDeviceName(device, name);
         std::cout << "\nUsing OpenCL device: " << name << "\n";
 
+        if (precision == "double" &&
+            device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") == std::string::npos)
+        {
+            std::cout << "This device does not support double precision (cl_khr_fp64)\n";
+            return EXIT_FAILURE;
+        }
+
         std::vector<cl::Device> chosen_device;
         chosen_device.push_back(device);
         cl::Context context(chosen_device);
-        cl::CommandQueue queue(context, device);
-
-        // Create the program object
-        cl::Program program(context, util::loadProgram("../pi_ocl.cl"), true);
-
-        // Create the kernel object for quering information
-        cl::Kernel ko_pi(program, "pi");
-
-        // Get the work group size
-        work_group_size = ko_pi.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
-        //printf("wgroup_size = %lu\n", work_group_size);
+        cl::CommandQueue queue = util::createProfilingQueue(context, device);
+        util::Profiler profiler;
+        util::Roofline roofline(context, device);
 
-        cl::make_kernel<int, float, cl::LocalSpaceArg, cl::Buffer> pi(program, "pi");
-
-        // Now that we know the size of the work_groups, we can set the number of work
-        // groups, the actual number of steps, and the step size
-        nwork_groups = in_nsteps/(work_group_size*niters);
-
-        if ( nwork_groups < 1) {
-            nwork_groups = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
-            work_group_size=in_nsteps / (nwork_groups*niters);
+        if (monte_carlo)
+        {
+            pi_res = monteCarlo(context, device, queue, in_nsteps, seed, profiler);
+            printf(" pi = %.12f (Monte-Carlo, seed %llu), error %.3e\n", pi_res,
+                   (unsigned long long)seed, fabs(pi_res - 3.14159265358979323846));
+            profiler.print();
+            if (!profile_file.empty() && !profiler.writeFile(profile_file))
+                printf("\nCould not write device timings to %s\n", profile_file.c_str());
+            return EXIT_SUCCESS;
         }
 
-        nsteps = work_group_size * niters * nwork_groups;
-        step_size = 1.0f/static_cast<float>(nsteps);
-        std::vector<float> h_psum(nwork_groups);
-
-        printf(
-            " %d work groups of size %d.  %d Integration steps\n",
-            (int)nwork_groups,
-            (int)work_group_size,
-            nsteps);
-
-        d_partial_sums = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * nwork_groups);
-
-        util::Timer timer;
+        if (!integrand.empty())
+        {
+            double value = quadrature(context, device, queue, spec, from, to, in_nsteps, profiler);
+            printf(" integral = %.12g (%s, %s)\n", value, rule.c_str(), precision.c_str());
+            profiler.print();
+            if (!profile_file.empty() && !profiler.writeFile(profile_file))
+                printf("\nCould not write device timings to %s\n", profile_file.c_str());
+            return EXIT_SUCCESS;
+        }
 
-        // Execute the kernel over the entire range of our 1d input data set
-        // using the maximum number of work group items for this device
-        pi(
-            cl::EnqueueArgs(
-                    queue,
-                    cl::NDRange(nsteps / niters),
-                    cl::NDRange(work_group_size)),
-                    niters,
-                    step_size,
-                    cl::Local(sizeof(float) * work_group_size),
-                    d_partial_sums);
+        // Create the program object, with the built-in work-group
+        // reduction if the device has OpenCL C 2.0 ("OpenCL C 2.0 ...")
+        cl::Program program = util::buildProgramFile(context, device, "../pi_ocl.cl",
+                                                     piOptions(device));
 
-        cl::copy(queue, d_partial_sums, h_psum.begin(), h_psum.end());
+        if (precision == "double")
+            pi_res = integrate<double>(context, device, queue, program, "pi_dp", "pi_final_dp",
+                                       in_nsteps, profiler, roofline);
+        else
+            pi_res = integrate<float>(context, device, queue, program,
+                                      precision == "kahan" ? "pi_kahan" : "pi", "pi_final",
+                                      in_nsteps, profiler, roofline);
 
-        // complete the sum and compute final integral value
-        pi_res = 0.0f;
-        for (unsigned int i = 0; i< nwork_groups; i++) {
-                pi_res += h_psum[i];
-        }
-        pi_res = pi_res * step_size;
+        printf(" pi = %.12f (%s), error %.3e\n", pi_res, precision.c_str(),
+            fabs(pi_res - 3.14159265358979323846));
 
-        //rtime = wtime() - rtime;
-        double rtime = static_cast<double>(timer.getTimeMilliseconds()) / 1000.;
-        printf("\nThe calculation ran in %lf seconds\n", rtime);
-        printf(" pi = %f for %d steps\n", pi_res, nsteps);
+        profiler.print();
+        roofline.print();
+        if (!profile_file.empty() && !profiler.writeFile(profile_file))
+            printf("\nCould not write device timings to %s\n", profile_file.c_str());
 
         }
         catch (cl::Error err) {
@@ -144,4 +768,3 @@ int main(int argc, char *argv[])
             << std::endl;
         }
 }
-
@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+//
+// kernel:  pi_mc
+//
+// Purpose: Monte-Carlo estimate of pi: count the random points of the
+//          unit square that fall inside the quarter circle, x^2 + y^2 < 1
+//
+// input: int   niters per work item, counters of the generator
+//        uint  key0, key1   the seed, as Philox's key
+//        long  base         the first counter of the run
+//        local ulong* an array to hold counts from each work item
+//
+// output: partial_hits   ulong vector of hits, one per work-group
+//
+// Built after util::philoxSource() (Cpp_common/random.hpp), which has
+// philox_at.  Each counter gives four 24 bit uniforms, so two points,
+// made where they are used: nothing is read from or written to global
+// memory but the one count a work-group, so the kernel is all integer
+// multiplies, where pi is all floating point divides.  The counts are
+// 64 bit, so a run may go past 2^32 points.
+//
+
+ulong reduce_hits(__local ulong*);
+
+__kernel void pi_mc(
+   const int          niters,
+   const uint         key0,
+   const uint         key1,
+   const long         base,
+   __local  ulong*    local_hits,
+   __global ulong*    partial_hits)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+   int group_id       = get_group_id(0);
+
+   const uint2 key = (uint2)(key0, key1);
+   uint hits = 0;
+   long i,istart,iend;
+
+   istart = ((long)group_id * num_wrk_items + local_id) * niters;
+   iend   = istart+niters;
+
+   for(i= istart; i<iend; i++){
+       const uint4 r = philox_at(base, i, key);
+       const float4 u = convert_float4(r >> 8u) * (1.0f / 16777216.0f);
+       hits += (u.x*u.x + u.y*u.y < 1.0f) + (u.z*u.z + u.w*u.w < 1.0f);
+   }
+
+   local_hits[local_id] = hits;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   ulong sum = reduce_hits(local_hits);
+
+   if (local_id == 0)
+      partial_hits[group_id] = sum;
+}
+
+//------------------------------------------------------------------------------
+//
+// kernel:  pi_mc_final
+//
+// Purpose: second stage of the reduction: add up the hits of the
+//          work-groups on the device, so only the total is copied back
+//
+// input: int    ncounts  number of partial counts
+//        global ulong* partial_hits from the pi_mc kernel
+//        local ulong* an array to hold counts from each work item
+//
+// output: result   hits in result[0]
+//
+// Launch with a single work-group.  The result is the count, not pi,
+// as not every device has the doubles to divide it exactly.
+//
+
+__kernel void pi_mc_final(
+   const int          ncounts,
+   __global ulong*    partial_hits,
+   __local  ulong*    local_hits,
+   __global ulong*    result)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+
+   ulong accum = 0;
+   int i;
+
+   for (i = local_id; i < ncounts; i += num_wrk_items)
+      accum += partial_hits[i];
+
+   local_hits[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   accum = reduce_hits(local_hits);
+
+   if (local_id == 0)
+      result[0] = accum;
+}
+
+// Sum local_hits[0 .. local size-1] pairwise in a tree, as reduce_local
+// does in pi_ocl.cl; the result is returned to every work-item.  All
+// work-items of the group must call this.
+ulong reduce_hits(__local ulong* local_hits)
+{
+   int local_id = get_local_id(0);
+   int count    = get_local_size(0);
+
+   while (count > 1) {
+      int half = (count + 1) / 2;
+      if (local_id < count - half)
+         local_hits[local_id] += local_hits[local_id + half];
+      barrier(CLK_LOCAL_MEM_FENCE);
+      count = half;
+   }
+   return local_hits[0];
+}
@@ -10,11 +10,15 @@
 //
 // output: partial_sums   float vector of partial sums
 //
+// The step index is 64 bit, so nsteps may go past 2^31.
+//
 
 
 void reduce(                                          
    __local  float*,                          
    __global float*);
+
+float reduce_local(__local float*);
                         
 
 __kernel void pi(                                          
@@ -28,9 +32,9 @@ __kernel void pi(
    int group_id       = get_group_id(0);                   
    
    float x, accum = 0.0f;                              
-   int i,istart,iend;                                      
+   long i,istart,iend;                                      
    
-   istart = (group_id * num_wrk_items + local_id) * niters;
+   istart = ((long)group_id * num_wrk_items + local_id) * niters;
    iend   = istart+niters;      
 
    for(i= istart; i<iend; i++){ 
@@ -44,6 +48,85 @@ __kernel void pi(
    reduce(local_sums, partial_sums);                  
 }
 
+//------------------------------------------------------------------------------
+//
+// kernel:  pi_kahan
+//
+// Purpose: as pi, with compensated (Kahan) summation in each work-item,
+//          so the error of the float accumulator does not grow with
+//          niters.  Do not build with -cl-fast-relaxed-math, which
+//          lets the compiler cancel the compensation away.
+//
+
+__kernel void pi_kahan(
+   const int          niters,
+   const float        step_size,
+   __local  float*    local_sums,
+   __global float*    partial_sums)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+   int group_id       = get_group_id(0);
+
+   float x, y, t, accum = 0.0f, comp = 0.0f;
+   long i,istart,iend;
+
+   istart = ((long)group_id * num_wrk_items + local_id) * niters;
+   iend   = istart+niters;
+
+   for(i= istart; i<iend; i++){
+       x = (i+0.5f)*step_size;
+       y = 4.0f/(1.0f+x*x) - comp;
+       t = accum + y;
+       comp = (t - accum) - y;
+       accum = t;
+   }
+
+   local_sums[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   reduce(local_sums, partial_sums);
+}
+
+//------------------------------------------------------------------------------
+//
+// kernel:  pi_chunk
+//
+// Purpose: as pi, over the steps first to last - 1 only, for a scheduler
+//          sharing the integration out a chunk at a time.  The launch
+//          may cover more steps than the chunk (each device sizes its
+//          own launch); the work-items past last add nothing.
+//
+
+__kernel void pi_chunk(
+   const int          niters,
+   const float        step_size,
+   const long         first,
+   const long         last,
+   __local  float*    local_sums,
+   __global float*    partial_sums)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+   int group_id       = get_group_id(0);
+
+   float x, accum = 0.0f;
+   long i,istart,iend;
+
+   istart = first + ((long)group_id * num_wrk_items + local_id) * niters;
+   iend   = min(istart+niters, last);
+
+   for(i= istart; i<iend; i++){
+       x = (i+0.5f)*step_size;
+       accum += 4.0f/(1.0f+x*x);
+   }
+
+   local_sums[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   reduce(local_sums, partial_sums);
+}
+
 //------------------------------------------------------------------------------
 //
 // OpenCL function:  reduction    
@@ -54,26 +137,207 @@ __kernel void pi(
 //
 // output: global float* partial_sums   float vector of partial sums
 //
+// The sums are added pairwise in a tree, halving the number of
+// active work-items each step, so the work-group finishes in
+// log2(local size) steps rather than work-item 0 adding them all.
+// Any work-group size works: an odd element out is carried to the
+// next step.  Built with -D USE_WG_REDUCE on OpenCL 2.0 devices the
+// work_group_reduce_add built-in does the whole job.
+//
 
 void reduce(                                          
    __local  float*    local_sums,                          
    __global float*    partial_sums)                        
 {                                                          
-   int num_wrk_items  = get_local_size(0);                 
    int local_id       = get_local_id(0);                   
    int group_id       = get_group_id(0);                   
    
-   float sum;                              
-   int i;                                      
+   float sum = reduce_local(local_sums);
    
    if (local_id == 0) {                      
-      sum = 0.0f;                            
-   
-      for (i=0; i<num_wrk_items; i++) {        
-          sum += local_sums[i];             
-      }                                     
-   
       partial_sums[group_id] = sum;         
    }
 }
-                                          
+
+// Sum local_sums[0 .. local size-1]; the result is returned to every
+// work-item.  All work-items of the group must call this.
+float reduce_local(__local float* local_sums)
+{
+   int local_id = get_local_id(0);
+   int count    = get_local_size(0);
+
+#ifdef USE_WG_REDUCE
+   return work_group_reduce_add(local_sums[local_id]);
+#else
+   while (count > 1) {
+      int half = (count + 1) / 2;
+      if (local_id < count - half)
+         local_sums[local_id] += local_sums[local_id + half];
+      barrier(CLK_LOCAL_MEM_FENCE);
+      count = half;
+   }
+   return local_sums[0];
+#endif
+}
+
+//------------------------------------------------------------------------------
+//
+// kernel:  pi_final
+//
+// Purpose: second stage of the reduction: add up the partial sums
+//          on the device, so only the final value is copied back
+//
+// input: int   nsums  number of partial sums
+//        float step_size
+//        global float* partial_sums from the pi kernel
+//        local float* an array to hold sums from each work item
+//
+// output: result   pi, in result[0]
+//
+// Launch with a single work-group.
+//
+
+__kernel void pi_final(
+   const int          nsums,
+   const float        step_size,
+   __global float*    partial_sums,
+   __local  float*    local_sums,
+   __global float*    result)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+
+   float y, t, accum = 0.0f, comp = 0.0f;
+   int i;
+
+   // Compensated, as there can be a great many partial sums
+   for (i = local_id; i < nsums; i += num_wrk_items) {
+      y = partial_sums[i] - comp;
+      t = accum + y;
+      comp = (t - accum) - y;
+      accum = t;
+   }
+
+   local_sums[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   accum = reduce_local(local_sums);
+
+   if (local_id == 0)
+      result[0] = accum * step_size;
+}
+
+//------------------------------------------------------------------------------
+//
+// Double precision versions of pi, reduce_local and pi_final, for
+// devices with cl_khr_fp64
+//
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+double reduce_local_dp(__local double* local_sums)
+{
+   int local_id = get_local_id(0);
+   int count    = get_local_size(0);
+
+#ifdef USE_WG_REDUCE
+   return work_group_reduce_add(local_sums[local_id]);
+#else
+   while (count > 1) {
+      int half = (count + 1) / 2;
+      if (local_id < count - half)
+         local_sums[local_id] += local_sums[local_id + half];
+      barrier(CLK_LOCAL_MEM_FENCE);
+      count = half;
+   }
+   return local_sums[0];
+#endif
+}
+
+__kernel void pi_dp(
+   const int          niters,
+   const double       step_size,
+   __local  double*   local_sums,
+   __global double*   partial_sums)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+   int group_id       = get_group_id(0);
+
+   double x, accum = 0.0;
+   long i,istart,iend;
+
+   istart = ((long)group_id * num_wrk_items + local_id) * niters;
+   iend   = istart+niters;
+
+   for(i= istart; i<iend; i++){
+       x = (i+0.5)*step_size;
+       accum += 4.0/(1.0+x*x);
+   }
+
+   local_sums[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   accum = reduce_local_dp(local_sums);
+   if (local_id == 0)
+      partial_sums[group_id] = accum;
+}
+
+__kernel void pi_chunk_dp(
+   const int          niters,
+   const double       step_size,
+   const long         first,
+   const long         last,
+   __local  double*   local_sums,
+   __global double*   partial_sums)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+   int group_id       = get_group_id(0);
+
+   double x, accum = 0.0;
+   long i,istart,iend;
+
+   istart = first + ((long)group_id * num_wrk_items + local_id) * niters;
+   iend   = min(istart+niters, last);
+
+   for(i= istart; i<iend; i++){
+       x = (i+0.5)*step_size;
+       accum += 4.0/(1.0+x*x);
+   }
+
+   local_sums[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   accum = reduce_local_dp(local_sums);
+   if (local_id == 0)
+      partial_sums[group_id] = accum;
+}
+
+__kernel void pi_final_dp(
+   const int          nsums,
+   const double       step_size,
+   __global double*   partial_sums,
+   __local  double*   local_sums,
+   __global double*   result)
+{
+   int num_wrk_items  = get_local_size(0);
+   int local_id       = get_local_id(0);
+
+   double accum = 0.0;
+   int i;
+
+   for (i = local_id; i < nsums; i += num_wrk_items)
+      accum += partial_sums[i];
+
+   local_sums[local_id] = accum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   accum = reduce_local_dp(local_sums);
+
+   if (local_id == 0)
+      result[0] = accum * step_size;
+}
+
+#endif
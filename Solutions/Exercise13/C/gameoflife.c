@@ -54,7 +54,7 @@ int main(int argc, char **argv)
         printf("Usage:\n./gameoflife input.dat input.params bx by\n");
         printf("\tinput.dat\tpattern file\n");
         printf("\tinput.params\tparameter file defining board size\n");
-        printf("\tbx by\tsizes of thread blocks - must divide the board size equally\n");
+        printf("\tbx by\tsizes of thread blocks\n");
         return EXIT_FAILURE;
     }
 
@@ -140,8 +140,9 @@ int main(int argc, char **argv)
     printf("Starting state\n");
     print_board(h_board, nx, ny);
 
-    // Set he global and local problem sizes
-    const size_t global[2] = {nx, ny};
+    // Set he global and local problem sizes, the global rounded up to
+    // whole blocks; the kernel leaves off the cells past the edge
+    const size_t global[2] = {(nx + bx - 1) / bx * bx, (ny + by - 1) / by * by};
     const size_t local[2] = {bx, by};
 
     // Set kernel arguments
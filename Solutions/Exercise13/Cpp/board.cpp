@@ -0,0 +1,427 @@
+//------------------------------------------------------------------------------
+//
+// Name:       board.cpp
+//
+// Purpose:    Utility functions for the game of life: reading the
+//             parameters and the starting board, printing and saving
+//             boards
+//
+// HISTORY:    Written by Tom Deakin and Simon McIntosh-Smith, August 2013
+//
+//------------------------------------------------------------------------------
+
+#include "gameoflife.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*************************************************************************************
+ * Cell access, so the board functions work on both board types
+ ************************************************************************************/
+
+static inline bool is_alive(const Board& board, const unsigned int nx,
+                            const unsigned int x, const unsigned int y)
+{
+    return board[y * nx + x] == ALIVE;
+}
+
+static inline void set_alive(Board& board, const unsigned int nx,
+                             const unsigned int x, const unsigned int y)
+{
+    board[y * nx + x] = ALIVE;
+}
+
+static inline bool is_alive(const PackedBoard& board, const unsigned int nx,
+                            const unsigned int x, const unsigned int y)
+{
+    return (board[y * packed_words(nx) + x / CELLS_PER_WORD] >> (x % CELLS_PER_WORD)) & 1;
+}
+
+static inline void set_alive(PackedBoard& board, const unsigned int nx,
+                             const unsigned int x, const unsigned int y)
+{
+    board[y * packed_words(nx) + x / CELLS_PER_WORD] |= 1u << (x % CELLS_PER_WORD);
+}
+
+/*************************************************************************************
+ * Utility functions
+ ************************************************************************************/
+
+// Function to load the params file and set up the X and Y dimensions
+void load_params(const char* file, unsigned int *nx, unsigned int *ny, unsigned int *iterations)
+{
+    std::ifstream fp(file);
+    if (!fp.is_open())
+        die("Could not open params file.", __LINE__, __FILE__);
+
+    fp >> *nx;
+    fp >> *ny;
+    fp >> *iterations;
+    fp.close();
+}
+
+/*************************************************************************************
+ * Board files
+ *
+ * load_board maps the pattern file into memory and parses it in place,
+ * straight into the board.  It takes three formats:
+ *
+ *   - the live cells, one to a line as x y 1
+ *   - run-length encoded (RLE) Life patterns, as from the pattern collections:
+ *     # comment lines, a header line "x = m, y = n, ...", then runs of
+ *     dead (b) and live (o) cells, $ to end a row and ! to end the pattern.
+ *     The pattern goes at the top left of the board.
+ *   - snapshot files written by --snapshot (see snapshot.hpp), from which
+ *     the last frame is loaded, so a run can carry on from where another
+ *     stopped
+ ************************************************************************************/
+
+class MappedFile
+{
+public:
+    MappedFile(const char* file) : data_(NULL), size_(0)
+    {
+        int fd = open(file, O_RDONLY);
+        if (fd < 0)
+            die("Could not open input file.", __LINE__, __FILE__);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            die("Could not read input file.", __LINE__, __FILE__);
+        size_ = st.st_size;
+
+        if (size_ > 0)
+        {
+            void *p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+                die("Could not map input file.", __LINE__, __FILE__);
+            data_ = static_cast<const char *>(p);
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data_)
+            munmap(const_cast<char *>(data_), size_);
+    }
+
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+    ::size_t size() const { return size_; }
+
+private:
+    const char *data_;
+    ::size_t size_;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+template <typename B>
+static void set_cell(B& board, const unsigned int nx, const unsigned int ny,
+                     const unsigned long x, const unsigned long y)
+{
+    if (x > nx - 1)
+        die("Input x-coord out of range.", __LINE__, __FILE__);
+    if (y > ny - 1)
+        die("Input y-coord out of range.", __LINE__, __FILE__);
+    set_alive(board, nx, x, y);
+}
+
+// Unsigned decimal number at p, moving p past it
+static unsigned long read_number(const char*& p, const char* end)
+{
+    unsigned long value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    return value;
+}
+
+static bool is_space(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Each line of the file is expected to be: x y 1
+template <typename B>
+static void load_triplets(B& board, const char* p, const char* end,
+                          const unsigned int nx, const unsigned int ny)
+{
+    for (;;)
+    {
+        unsigned long v[3];
+        for (int i = 0; i < 3; i++)
+        {
+            while (p < end && is_space(*p))
+                p++;
+            if (p == end)
+            {
+                if (i != 0)
+                    die("Input line incomplete.", __LINE__, __FILE__);
+                return;
+            }
+            if (*p < '0' || *p > '9')
+                die("Input should be lines of x y 1.", __LINE__, __FILE__);
+            v[i] = read_number(p, end);
+        }
+        if (v[2] != ALIVE)
+            die("Alive value should be 1.", __LINE__, __FILE__);
+        set_cell(board, nx, ny, v[0], v[1]);
+    }
+}
+
+template <typename B>
+static void load_rle(B& board, const char* p, const char* end,
+                     const unsigned int nx, const unsigned int ny)
+{
+    // Comments and the header line
+    while (p < end && (*p == '#' || *p == 'x'))
+    {
+        while (p < end && *p != '\n')
+            p++;
+        while (p < end && is_space(*p))
+            p++;
+    }
+
+    unsigned long x = 0, y = 0;
+    while (p < end && *p != '!')
+    {
+        if (is_space(*p))
+        {
+            p++;
+            continue;
+        }
+
+        unsigned long run = 1;
+        if (*p >= '0' && *p <= '9')
+            run = read_number(p, end);
+        if (p == end)
+            break;
+
+        const char tag = *p++;
+        if (tag == '$')
+        {
+            y += run;
+            x = 0;
+        }
+        else if (tag == 'b')
+            x += run;
+        else
+        {
+            // o, or any other state of a multi-state pattern, is alive
+            for (unsigned long i = 0; i < run; i++)
+                set_cell(board, nx, ny, x + i, y);
+            x += run;
+        }
+    }
+}
+
+static cl_uint get_u32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((cl_uint)p[3] << 24);
+}
+
+template <typename B>
+static void load_snapshot(B& board, const char* begin, const char* end,
+                          const unsigned int nx, const unsigned int ny)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(begin);
+    const unsigned char *stop = reinterpret_cast<const unsigned char *>(end);
+
+    if (stop - p < 12 || get_u32(p + 4) != nx || get_u32(p + 8) != ny)
+        die("Snapshot is not of a board of this size.", __LINE__, __FILE__);
+    p += 12;
+
+    // Skip to the last whole frame
+    const unsigned char *last = NULL;
+    while (stop - p >= 8 && (::size_t)(stop - p - 8) >= get_u32(p + 4))
+    {
+        last = p;
+        p += 8 + get_u32(p + 4);
+    }
+    if (!last)
+        die("Snapshot has no frames.", __LINE__, __FILE__);
+
+    // Alternate runs of dead and live cells
+    p = last + 8;
+    stop = p + get_u32(last + 4);
+    unsigned long cell = 0;
+    bool alive = false;
+    while (p < stop)
+    {
+        unsigned long run = 0;
+        int shift = 0;
+        while (p < stop && (*p & 0x80))
+        {
+            run |= (unsigned long)(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        if (p < stop)
+            run |= (unsigned long)*p++ << shift;
+
+        if (cell + run > (unsigned long)nx * ny)
+            die("Snapshot frame is longer than the board.", __LINE__, __FILE__);
+        if (alive)
+            for (unsigned long i = cell; i < cell + run; i++)
+                set_alive(board, nx, i % nx, i / nx);
+        cell += run;
+        alive = !alive;
+    }
+}
+
+template <typename B>
+static void load_cells(B& board, const char* file, const unsigned int nx, const unsigned int ny)
+{
+    MappedFile map(file);
+    const char *p = map.begin();
+    const char *end = map.end();
+
+    if (map.size() >= 4 && !strncmp(p, "GOLS", 4))
+        load_snapshot(board, p, end, nx, ny);
+    else
+    {
+        const char *q = p;
+        while (q < end && is_space(*q))
+            q++;
+        if (q < end && (*q == '#' || *q == 'x'))
+            load_rle(board, q, end, nx, ny);
+        else
+            load_triplets(board, q, end, nx, ny);
+    }
+}
+
+// Function to print out the board to stdout
+// Alive cells are displayed as O
+// Dead cells are displayed as .
+template <typename B>
+static void print_cells(const B& board, const unsigned int nx, const unsigned int ny)
+{
+    for (unsigned int i = 0; i < ny; i++)
+    {
+        for (unsigned int j = 0; j < nx; j++)
+        {
+            if (!is_alive(board, nx, j, i))
+                std::cout << ".";
+            else
+                std::cout << "O";
+        }
+        std::cout << "\n";
+    }
+}
+
+template <typename B>
+static void save_cells(const B& board, const unsigned int nx, const unsigned int ny, const char* file)
+{
+    FILE *fp = fopen(file, "w");
+    if (!fp)
+        die("Could not open final state file.", __LINE__, __FILE__);
+
+    for (unsigned int i = 0; i < ny; i++)
+    {
+        for (unsigned int j = 0; j < nx; j++)
+        {
+            if (is_alive(board, nx, j, i))
+                fprintf(fp, "%d %d %d\n", j, i, ALIVE);
+        }
+    }
+    fclose(fp);
+}
+
+void load_board(Board& board, const char* file, const unsigned int nx, const unsigned int ny)
+{
+    load_cells(board, file, nx, ny);
+}
+
+void print_board(const Board& board, const unsigned int nx, const unsigned int ny)
+{
+    print_cells(board, nx, ny);
+}
+
+void save_board(const Board& board, const unsigned int nx, const unsigned int ny, const char* file)
+{
+    save_cells(board, nx, ny, file);
+}
+
+void load_board(PackedBoard& board, const char* file, const unsigned int nx, const unsigned int ny)
+{
+    load_cells(board, file, nx, ny);
+}
+
+void print_board(const PackedBoard& board, const unsigned int nx, const unsigned int ny)
+{
+    print_cells(board, nx, ny);
+}
+
+void save_board(const PackedBoard& board, const unsigned int nx, const unsigned int ny, const char* file)
+{
+    save_cells(board, nx, ny, file);
+}
+
+// The birth and survive masks of a B/S rulestring, such as B3/S23
+// (Conway's Life) or B36/S23 (HighLife): bit n is set if n neighbours
+// are a birth, or let a live cell survive.  The parts may come in
+// either order.
+void rule_masks(const char* rule, unsigned int *birth, unsigned int *survive)
+{
+    unsigned int masks[2] = {0, 0};     // birth, survive
+    int part = -1;
+    for (const char *p = rule; *p; p++)
+    {
+        if (*p == 'B' || *p == 'b')
+            part = 0;
+        else if (*p == 'S' || *p == 's')
+            part = 1;
+        else if (*p >= '0' && *p <= '8' && part >= 0)
+            masks[part] |= 1u << (*p - '0');
+        else if (*p != '/')
+            die("Rules should be of the form B3/S23.", __LINE__, __FILE__);
+    }
+    *birth = masks[0];
+    *survive = masks[1];
+}
+
+// Build options that compile a rulestring into the kernels: the -D BIRTH
+// and SURVIVE masks of gameoflife.cl
+std::string rule_options(const char* rule)
+{
+    unsigned int birth, survive;
+    rule_masks(rule, &birth, &survive);
+
+    char options[64];
+    sprintf(options, "-D BIRTH=0x%03x -D SURVIVE=0x%03x", birth, survive);
+    return options;
+}
+
+// Work-group shape for accelerate_life, when not given on the command line
+void choose_block(const cl::Kernel& kernel, const cl::Device& device,
+                  unsigned int nx, unsigned int ny, unsigned int *bx, unsigned int *by)
+{
+    ::size_t max_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+    ::size_t multiple =
+        kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+    std::vector< ::size_t> max_items = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+
+    max_size = std::min(max_size, (::size_t)256);
+    if (multiple < 1 || multiple > max_size)
+        multiple = 1;
+
+    // A row of the block is the preferred multiple, so the work-items of
+    // a warp or wavefront read one run of cells, then add rows up to the
+    // work-group size; neither bigger than the board
+    *bx = (unsigned int)std::min(std::min(multiple, max_items[0]), (::size_t)nx);
+    *by = (unsigned int)std::min(std::min(max_size / *bx, max_items[1]), (::size_t)ny);
+    *by = std::max(*by, 1u);
+}
+
+// Function to display error and exit nicely
+void die(const std::string message, const int line, const std::string file)
+{
+  std::cerr << "Error at line " << line << " of file " << file << ":\n";
+  std::cerr << message << "\n";
+  exit(EXIT_FAILURE);
+}
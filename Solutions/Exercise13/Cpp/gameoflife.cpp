@@ -1,233 +1,1659 @@
 //------------------------------------------------------------------------------
 //
 // Name:       gameoflife.cpp
-// 
+//
 // Purpose:    Run a naive Conway's game of life
 //
+// Usage:      ./gameoflife input.dat input.params [bx by] [--packed] [--generations K]
+//                          [--sparse] [--devices N] [--snapshot N [FILE]] [--rule B3/S23]
+//                          [--launch-rate] [--compare-tiles] [--host] [--threads N]
+//                          [--cycles K] [--persistent] [--record] [--svm] [--image]
+//                          [--bench R [--save-baseline | --check-baseline] [--threshold PCT]]
+//                          [--timed]
+//             ./gameoflife --batch list.txt [--rule B3/S23]
+//
+//             --batch runs every board in list.txt (a line each of pattern
+//             file and parameter file) together, with one build of the
+//             program and one launch a generation for all of them, and
+//             saves board i to final_state_i.dat.
+//
+//             --rule compiles the kernels for another Life-like rule, given
+//             as a B/S rulestring (B36/S23 is HighLife); the rule is built
+//             into each kernel as a table of constants, so costs nothing.
+//
+//             input.dat lists the live cells as x y 1 lines, or is an RLE
+//             pattern (.rle, placed at the top left) or a --snapshot file,
+//             whose last frame is the starting state.
+//
+//             The board may be any size.  Without bx and by, the block is
+//             as wide as the preferred work-group size multiple of the
+//             kernel and as tall as makes up a work-group of 256.
+//
+//             --packed stores the board as bits, 32 cells to a word, and
+//             runs accelerate_life_packed, which counts the neighbours of
+//             a whole word of cells at once with bitwise adders.  That
+//             is an eighth of the memory and bandwidth of the board of
+//             chars.  bx and by are not used by the packed engine.
+//
+//             --generations K runs accelerate_life_multi, which advances
+//             each bx by by tile K generations in local memory from a
+//             halo K cells deep, so the board is read and written once
+//             every K generations and there are a K'th of the launches.
+//             The halo costs (bx+2K)(by+2K) - bx*by extra cells of work
+//             per launch, so K should stay small next to bx and by.
+//
+//             --sparse runs accelerate_life_sparse, which only updates the
+//             bx by by tiles that changed, or had a neighbouring tile
+//             change, in the last generation.  Patterns that leave most
+//             of the board dead or still (Acorn, QueenBee) skip most of
+//             the work.
+//
+//             --devices N splits the board by rows over the first N
+//             devices of --list (0 for all of them), each with ghost rows
+//             copied from the strips next to it.  With --generations K the
+//             ghost rows are K deep and are swapped every K generations.
+//             The rows going out are sent while the strip's interior is
+//             updated.
+//
+//             --snapshot N writes the board every N generations (or at
+//             the first launch after, with --generations) to FILE, by
+//             default snapshots.gol, in the binary run-length format of
+//             snapshot.hpp.  A writer thread does the writing, so the
+//             simulation does not wait for it.
+//
+//             Each engine binds its kernel arguments once (with
+//             util::PingPongLaunch), so a generation is one enqueue.
+//             --launch-rate times the board's iterations as launches
+//             through cl::make_kernel, which sets every argument each
+//             time, and through the bound kernels; on small boards the
+//             launches, not the cells, are the cost.
+//
+//             --cycles K hashes each new board on the device (with
+//             accelerate_life_hash) and reads the hashes back every K
+//             generations without waiting for them.  Once a board repeats
+//             an earlier one (a still life is period 1, the Pulsar period
+//             3), the rest of the iterations are whole periods and what is
+//             left over, so only that is run.
+//
+//             --record records REPLAY_PAIRS pairs of launches of
+//             accelerate_life once and replays them, through
+//             cl_khr_command_buffer where the device has it, so the driver
+//             checks and builds the launches once (see command_buffer.hpp).
+//             Without the extension, the replays are batches of bare
+//             enqueues.
+//
+//             --persistent runs every generation in one launch of
+//             accelerate_life_persistent: a single work-group keeps the
+//             board in local memory and syncs with a barrier between
+//             generations, so small boards are not held up by one launch
+//             per generation.  That only works if the board fits twice in
+//             local memory; if it doesn't, the board engine does the run.
+//
+//             --svm keeps the two boards in OpenCL 2.0 shared virtual
+//             memory (svm.hpp) and runs accelerate_life on them there:
+//             the host puts the starting state straight into the first
+//             board and reads the last from where the kernel left it,
+//             with no buffers and no copies between host and device.  On
+//             devices without SVM the board engine does the run.
+//
+//             --image keeps the two boards in images and runs
+//             accelerate_life_image on them, which reads the neighbours
+//             through the texture cache and lets the sampler wrap the
+//             torus.  Devices without images, or boards wider or taller
+//             than their images can be, run the board engine.
+//
+//             --compare-tiles times the board's iterations with three
+//             kernels: accelerate_life_edges, which loads the halo of its
+//             block with the work-items at its edges (the left and right
+//             ones down columns) and the corners with every work-item;
+//             accelerate_life, which loads the whole block a row at a time
+//             with all of them; and accelerate_life_vec, which also
+//             updates 16 cells a work-item as a char16.  Each should give
+//             the same final board.
+//
+//             --bench R times R runs of the board's iterations, each from
+//             the starting state, with the board engine (accelerate_life)
+//             and the packed engine.  --save-baseline keeps the times for
+//             this device and board size (perf_baseline.hpp), and
+//             --check-baseline compares a run with them and exits with a
+//             failure if either engine is more than --threshold PCT
+//             (default 5) slower by a rank test of the two samples, so a
+//             driver or kernel change that makes them slower is caught.
+//             Either needs R of at least BASELINE_MIN_RUNS (5): with
+//             fewer the test cannot reach significance.
+//
+//             --timed runs the board's iterations with each engine in
+//             turn, the board of chars (accelerate_life), the packed
+//             board, the tiles of --generations K (default
+//             TIMED_GENERATIONS) and the host, and prints no boards, only
+//             their generations a second and cell updates a second.  The
+//             device engines also give the time their kernels ran a
+//             generation, from the events of a profiling queue, and what
+//             fraction of the wall time that was; the rest is launches.
+//             With --host, or with no device, the table has the host alone.
+//
+//             --host runs the board on the host's cores instead (see
+//             host_life.cpp), with --threads N of them (default: all).  It
+//             is also what runs, whatever the options, when no OpenCL
+//             device can be found, so the program still works on build and
+//             login nodes; only --batch and --devices need a device.
+//
+//             Without --snapshot, the board engine ends with the GB/s its
+//             generations moved against the device's (roofline.hpp).
+//             OCL_TRACE=FILE writes a Chrome trace of the host side of the
+//             run: the build, the launches and the waits (trace.hpp).
+//             OCL_WORKLOAD=FILE appends the board and generations of the
+//             run to FILE, for replay (workload.hpp).
+//
 // HISTORY:    Written by Tom Deakin and Simon McIntosh-Smith, August 2013
 //
 //------------------------------------------------------------------------------
 
-#include <iostream>
-#include <fstream>
-#include <vector>
+#include "gameoflife.hpp"
+#include "snapshot.hpp"
+#include "ping_pong.hpp"
+#include "command_buffer.hpp"
+#include "svm.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
+#include "perf_baseline.hpp"
+#include "profiler.hpp"
+#include "workload.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <map>
+
+#include "err_code.h"
+#include "device_picker.hpp"
+
+#define REPLAY_PAIRS 32     // pairs of launches in a --record replay (64 generations)
+#define BENCH_THRESHOLD 0.05    // slowdown a --check-baseline fails on, by default
+#define TIMED_GENERATIONS 4     // generations a launch of the --timed multi engine, by default
 
-#define __CL_ENABLE_EXCEPTIONS
-#include "cl.hpp"
+enum { BASELINE_OFF, BASELINE_SAVE, BASELINE_CHECK };
 
-#include "util.hpp"
+/*************************************************************************************
+ * Finding a board that was seen before, from the hashes accelerate_life_hash makes
+ ************************************************************************************/
 
-//pick up device type from compiler command line or from 
-//the default type
-#ifndef DEVICE
-#define DEVICE CL_DEVICE_TYPE_DEFAULT
-#endif
+// The hashes are written into one half of a buffer of 2K slots while the
+// other half, the K generations before, is read back without waiting, and
+// looked at when the next half is full; so the host is never waiting on
+// the device, and the device is at most 2K generations past a repeat when
+// it is found.  A hash is taken to be its board: two 32 bit sums of mixed
+// positions make a false match unlikely, but not impossible.
+class CycleFinder
+{
+public:
+    CycleFinder(cl::Context& context, unsigned int every)
+        : every_(every), found_(0), period_(0), stop_(0)
+    {
+        if (every_ == 0)
+            return;
+        buffer_ = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 4 * every_);
+        for (int h = 0; h < 2; h++)
+        {
+            hashes_[h].resize(2 * every_);
+            first_[h] = count_[h] = 0;
+        }
+    }
+
+    cl::Buffer& buffer() { return buffer_; }
 
+    //! The slot for generation i + 1 (launch i), clearing a half as it is
+    //! started; the queue is in order, so after the read of that half
+    unsigned int slot(cl::CommandQueue& queue, unsigned int i)
+    {
+        const unsigned int half = (i / every_) % 2;
+        if (i % every_ == 0)
+            queue.enqueueFillBuffer(buffer_, (cl_uint)0, sizeof(cl_uint) * 2 * every_ * half,
+                                    sizeof(cl_uint) * 2 * every_);
+        return half * every_ + i % every_;
+    }
 
-#define FINALSTATEFILE "final_state.dat"
+    //! After launch i of iterations: read a full half back, and look
+    //! through the one before.  True when a repeat is first found, and
+    //! sets stop() to the generations to run to.
+    bool check(cl::CommandQueue& queue, unsigned int i, unsigned int iterations)
+    {
+        if (period_ > 0 || (i % every_ != every_ - 1 && i != iterations - 1))
+            return false;
 
-// Define the state of the cell
-#define DEAD  0
-#define ALIVE 1
+        const unsigned int half = (i / every_) % 2;
+        first_[half] = i / every_ * every_ + 1;
+        count_[half] = i % every_ + 1;
+        queue.enqueueReadBuffer(buffer_, CL_FALSE, sizeof(cl_uint) * 2 * every_ * half,
+                                sizeof(cl_uint) * 2 * count_[half], &hashes_[half][0],
+                                NULL, &read_[half]);
+
+        const unsigned int other = 1 - half;
+        if (i < every_ || count_[other] == 0)
+            return false;
+        read_[other].wait();
+        for (unsigned int k = 0; k < count_[other]; k++)
+        {
+            const unsigned int generation = first_[other] + k;
+            Key key(hashes_[other][2 * k], hashes_[other][2 * k + 1]);
+            std::map<Key, unsigned int>::iterator seen = seen_.find(key);
+            if (seen == seen_.end())
+            {
+                seen_[key] = generation;
+                continue;
+            }
+            found_ = generation;
+            period_ = generation - seen->second;
+            stop_ = (i + 1) + (iterations - (i + 1)) % period_;
+            return true;
+        }
+        count_[other] = 0;
+        return false;
+    }
+
+    unsigned int found() const { return found_; }
+    unsigned int period() const { return period_; }
+    unsigned int stop() const { return stop_; }
+
+private:
+    typedef std::pair<cl_uint, cl_uint> Key;
+
+    unsigned int                    every_;
+    cl::Buffer                      buffer_;
+    std::vector<cl_uint>            hashes_[2];
+    unsigned int                    first_[2], count_[2];   // generations in each half
+    cl::Event                       read_[2];
+    std::map<Key, unsigned int>     seen_;                  // hash -> generation
+    unsigned int                    found_, period_, stop_;
+};
 
 /*************************************************************************************
- * Forward declarations of utility functions
+ * Simulation with one char per cell
  ************************************************************************************/
-void die(const std::string message, const int line, const std::string file);
-void load_board(std::vector<char>& board, const char* file, const unsigned int nx, const unsigned int ny);
-void print_board(const std::vector<char>& board, const unsigned int nx, const unsigned int ny);
-void save_board(const std::vector<char>& board, const unsigned int nx, const unsigned int ny);
-void load_params(const char* file, unsigned int *nx, unsigned int *ny, unsigned int *iterations);
+void run_board(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+               const char *input, unsigned int nx, unsigned int ny,
+               unsigned int bx, unsigned int by, unsigned int iterations,
+               unsigned int generations, unsigned int snapshot_every, const char *snapshot_file,
+               unsigned int cycle_every, bool recorded)
+{
+    // Looking for cycles takes a generation a launch
+    if (generations > 1 && cycle_every > 0)
+    {
+        std::cout << "--cycles is not used with --generations\n";
+        cycle_every = 0;
+    }
 
-#include "err_code.h"
+    // A replay is the same launches every time, with nothing in between
+    if (recorded && (generations > 1 || cycle_every > 0 || snapshot_every > 0))
+    {
+        std::cout << "--record is not used with --generations, --cycles or --snapshot\n";
+        recorded = false;
+    }
+    const char *kernel = generations > 1 ? "accelerate_life_multi"
+                       : cycle_every > 0 ? "accelerate_life_hash" : "accelerate_life";
+
+    // Allocate memory for boards
+    util::PinnedAllocator<char> pinned(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+
+    // Load in the starting state to host board and copy to device
+    load_board(h_board, input, nx, ny);
+    queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    // Frames of the board written as it goes, starting with generation 0
+    SnapshotWriter *snapshots = NULL;
+    if (snapshot_every > 0)
+    {
+        snapshots = new SnapshotWriter(context, queue, snapshot_file, nx, ny);
+        snapshots->capture(d_board_tick, 0);
+    }
+
+    // Set the global and local problem sizes, the global rounded up to
+    // whole blocks; the kernels leave off the cells past the edge
+    cl::NDRange global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+    cl::NDRange local(bx, by);
+
+    // Allocate local memory
+    cl::LocalSpaceArg localmem = cl::Local(sizeof(char) * (bx + 2) * (by + 2));
+
+    // Tiles with a halo deep enough for several generations a launch
+    ::size_t tile_bytes = sizeof(char) * (bx + 2 * generations) * (by + 2 * generations);
+
+    // The arguments are set once; each launch swaps the boards over
+    util::PingPongLaunch life(program, kernel);
+    life.swap(0, 1, d_board_tick, d_board_tock);
+    life.setArg(2, nx);
+    life.setArg(3, ny);
+    if (generations > 1)
+    {
+        life.setArg(4, generations);
+        life.setArg(5, cl::Local(tile_bytes));
+        life.setArg(6, cl::Local(tile_bytes));
+    }
+    else
+        life.setArg(4, localmem);
+
+    // The hashes of the boards, K (cycle_every) generations in each half,
+    // read back one half at a time while the next K are worked out
+    CycleFinder cycles(context, cycle_every);
+    if (cycle_every > 0)
+        life.setArg(5, cycles.buffer());
+
+    // The generations are timed on the host, so they are reported
+    // without the snapshots
+    util::Roofline roofline(context, queue.getInfo<CL_QUEUE_DEVICE>());
+    util::Timer timer;
+
+    // Loop
+    util::TraceSpan span("enqueue generations");
+    unsigned int first = 0;
+    if (recorded)
+    {
+        // REPLAY_PAIRS pairs of launches a replay, then the rest one at a time
+        util::CommandRecording recording(queue);
+        life.record(recording, global, local, REPLAY_PAIRS);
+        recording.finalize();
+        printf("Replaying %u launches at a time %s\n", recording.size(),
+               recording.native() ? "through cl_khr_command_buffer" : "as a batch of enqueues");
+
+        for (; first + recording.size() <= iterations; first += recording.size())
+            life.replay(queue, recording);
+    }
+    for (unsigned int i = first; i < iterations; i += generations)
+    {
+        // The last launch does whatever generations are left
+        if (generations > 1 && iterations - i < generations)
+            life.setArg(4, iterations - i);
+
+        // Apply the rules of Life
+        if (cycle_every > 0)
+            life.setArg(6, cycles.slot(queue, i));
+        life.enqueue(queue, global, local);
+
+        // Once a board repeats, the board after iterations generations is
+        // the one after as many more as are left over from whole periods
+        if (cycle_every > 0 && cycles.check(queue, i, iterations))
+        {
+            printf("Generation %u repeats generation %u (period %u): stopping after %u of %u generations\n",
+                cycles.found(), cycles.found() - cycles.period(), cycles.period(),
+                cycles.stop(), iterations);
+            iterations = cycles.stop();
+        }
+
+        // A frame whenever this launch passed a multiple of snapshot_every
+        unsigned int done = std::min(i + generations, iterations);
+        if (snapshots && done / snapshot_every != i / snapshot_every)
+            snapshots->capture(life.input(), done);
+    }
+    span.end();
+
+    util::TraceSpan wait("finish");
+    queue.finish();
+    wait.end();
+    double rtime = timer.getTimeMicroseconds() / 1.0e6;
+
+    // Copy back the memory to the host
+    queue.enqueueReadBuffer(life.input(), CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+
+    if (snapshots)
+    {
+        snapshots->finish();
+        delete snapshots;
+    }
+
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    // Save the final state of the board
+    save_board(h_board, nx, ny);
+
+    if (snapshot_every == 0)
+    {
+        roofline.record(kernel,
+                        util::lifeCost((double)nx * ny, sizeof(char), life.launches()), rtime,
+                        life.launches());
+        roofline.print();
+    }
+}
 
 /*************************************************************************************
- * Main function
+ * Simulation updating only the tiles that can change
  ************************************************************************************/
+void run_sparse(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+                const char *input, unsigned int nx, unsigned int ny,
+                unsigned int bx, unsigned int by, unsigned int iterations)
+{
+    const unsigned int ntx = (nx + bx - 1) / bx;
+    const unsigned int nty = (ny + by - 1) / by;
+    const ::size_t ntiles = (::size_t)ntx * nty;
 
-int main(int argc, char **argv)
+    // Allocate memory for boards
+    util::PinnedAllocator<char> pinned(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+
+    // Changed flags for the last generation and the next; every tile
+    // counts as changed before the first
+    std::vector<cl_uchar> h_changed(ntiles, 1);
+    cl::Buffer d_changed_in(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, ntiles, &h_changed[0]);
+    cl::Buffer d_changed_out(context, CL_MEM_READ_WRITE, ntiles);
+
+    cl_uint updates = 0;
+    cl::Buffer d_updates(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &updates);
+
+    // Load in the starting state to both host boards and copy to device,
+    // as skipped tiles are left as they are in tock
+    load_board(h_board, input, nx, ny);
+    queue.enqueueWriteBuffer(d_board_tick, CL_FALSE, 0, sizeof(char) * nx * ny, &h_board[0]);
+    queue.enqueueWriteBuffer(d_board_tock, CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    // A work-group per tile, the global rounded up to whole tiles
+    cl::NDRange global(ntx * bx, nty * by);
+    cl::NDRange local(bx, by);
+
+    // The boards and the flags swap over after each launch
+    util::PingPongLaunch life(program, "accelerate_life_sparse");
+    life.swap(0, 1, d_board_tick, d_board_tock);
+    life.swap(4, 5, d_changed_in, d_changed_out);
+    life.setArg(2, nx);
+    life.setArg(3, ny);
+    life.setArg(6, d_updates);
+    life.setArg(7, cl::Local(sizeof(char) * (bx + 2) * (by + 2)));
+
+    for (unsigned int i = 0; i < iterations; i++)
+        life.enqueue(queue, global, local);
+
+    // Copy back the memory to the host
+    queue.enqueueReadBuffer(life.input(), CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+    queue.enqueueReadBuffer(d_updates, CL_TRUE, 0, sizeof(cl_uint), &updates);
+
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    printf("Updated %u of %.0f tiles (%.1f%%)\n", updates, (double)ntiles * iterations,
+        iterations ? 100.0 * updates / ((double)ntiles * iterations) : 0.0);
+
+    // Save the final state of the board
+    save_board(h_board, nx, ny);
+}
+
+/*************************************************************************************
+ * Simulation on the bit-packed board
+ ************************************************************************************/
+void run_packed(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+                const char *input, unsigned int nx, unsigned int ny, unsigned int iterations)
 {
+    const unsigned int nwords = packed_words(nx);
+    const ::size_t bytes = sizeof(cl_uint) * nwords * ny;
 
-    // Check we have a starting state file
-    if (argc != 5)
+    // Allocate memory for boards
+    util::PinnedAllocator<cl_uint> pinned(context, queue);
+    PackedBoard h_board(nwords * ny, 0, pinned);
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, bytes);
+
+    // Load in the starting state, packing it, and copy to device
+    load_board(h_board, input, nx, ny);
+    queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, bytes, &h_board[0]);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    // One work-item per word
+    cl::NDRange global(nwords, ny);
+
+    util::PingPongLaunch life(program, "accelerate_life_packed");
+    life.swap(0, 1, d_board_tick, d_board_tock);
+    life.setArg(2, nx);
+    life.setArg(3, ny);
+    life.setArg(4, nwords);
+
+    for (unsigned int i = 0; i < iterations; i++)
+        life.enqueue(queue, global);
+
+    // Copy back the memory to the host
+    queue.enqueueReadBuffer(life.input(), CL_TRUE, 0, bytes, &h_board[0]);
+
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    // Save the final state of the board, unpacking it
+    save_board(h_board, nx, ny);
+}
+
+/*************************************************************************************
+ * The whole simulation as one launch, the board held in one work-group's local memory
+ ************************************************************************************/
+bool run_persistent(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+                    const char *input, unsigned int nx, unsigned int ny, unsigned int iterations)
+{
+    const ::size_t bytes = sizeof(char) * nx * ny;
+    cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+    cl::Kernel kernel(program, "accelerate_life_persistent");
+
+    // Two copies of the board, and whatever local memory the kernel uses itself
+    const cl_ulong local_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    const cl_ulong kernel_local = kernel.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device);
+    if (2 * bytes + kernel_local > local_size)
     {
-        printf("Usage:\n./gameoflife input.dat input.params bx by\n");
-        printf("\tinput.dat\tpattern file\n");
-        printf("\tinput.params\tparameter file defining board size\n");
-        printf("\tbx by\tsizes of thread blocks - must divide the board size equally\n");
-        return EXIT_FAILURE;
+        printf("A %u x %u board needs %lu bytes of local memory, and the device has %lu:"
+               " running a launch a generation instead\n", nx, ny,
+               (unsigned long)(2 * bytes + kernel_local), (unsigned long)local_size);
+        return false;
     }
 
-    // Board dimensions and iteration total
-    unsigned int nx, ny;
-    unsigned int bx = atoi(argv[3]);
-    unsigned int by = atoi(argv[4]);
-    unsigned int iterations;
+    // As many work-items as the kernel can have in a group, up to a cell each
+    const ::size_t items = std::min(
+        kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device), (::size_t)nx * ny);
+    printf("One work-group of %lu work-items for all %u generations\n",
+           (unsigned long)items, iterations);
 
-    load_params(argv[2], &nx, &ny, &iterations);
+    // Allocate memory for boards
+    util::PinnedAllocator<char> pinned(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    cl::Buffer d_board_tick(context, CL_MEM_READ_ONLY, bytes);
+    cl::Buffer d_board_tock(context, CL_MEM_WRITE_ONLY, bytes);
 
-    // Create OpenCL context, queue and program
-    try
+    // Load in the starting state to host board and copy to device
+    load_board(h_board, input, nx, ny);
+    queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, bytes, &h_board[0]);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    kernel.setArg(0, d_board_tick);
+    kernel.setArg(1, d_board_tock);
+    kernel.setArg(2, nx);
+    kernel.setArg(3, ny);
+    kernel.setArg(4, iterations);
+    kernel.setArg(5, cl::Local(bytes));
+    kernel.setArg(6, cl::Local(bytes));
+
+    util::Timer timer;
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(items), cl::NDRange(items));
+    queue.finish();
+    double rtime = timer.getTimeMicroseconds() / 1.0e6;
+    printf("%u generations in %.6f seconds, %.1f million cells a second\n", iterations, rtime,
+           rtime > 0.0 ? (double)nx * ny * iterations / (1.0e6 * rtime) : 0.0);
+
+    // Copy back the memory to the host
+    queue.enqueueReadBuffer(d_board_tock, CL_TRUE, 0, bytes, &h_board[0]);
+
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    // Save the final state of the board
+    save_board(h_board, nx, ny);
+    return true;
+}
+
+/*************************************************************************************
+ * Launches a second through cl::make_kernel and through util::PingPongLaunch
+ ************************************************************************************/
+void launch_rate(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+                 unsigned int nx, unsigned int ny, unsigned int bx, unsigned int by,
+                 unsigned int iterations)
+{
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    queue.enqueueFillBuffer(d_board_tick, (char)DEAD, 0, sizeof(char) * nx * ny);
+
+    cl::NDRange global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+    cl::NDRange local(bx, by);
+    cl::LocalSpaceArg localmem = cl::Local(sizeof(char) * (bx + 2) * (by + 2));
+
+    cl::make_kernel
+        <cl::Buffer, cl::Buffer, unsigned int, unsigned int, cl::LocalSpaceArg>
+        accelerate_life(program, "accelerate_life");
+
+    util::PingPongLaunch life(program, "accelerate_life");
+    life.swap(0, 1, d_board_tick, d_board_tock);
+    life.setArg(2, nx);
+    life.setArg(3, ny);
+    life.setArg(4, localmem);
+
+    // A warm-up launch of each, then the timed runs
+    accelerate_life(cl::EnqueueArgs(queue, global, local), d_board_tick, d_board_tock, nx, ny, localmem);
+    life.enqueue(queue, global, local);
+    queue.finish();
+
+    util::Timer timer;
+    for (unsigned int i = 0; i < iterations; i++)
     {
-        cl::Context context(DEVICE);
-        cl::CommandQueue queue(context);
-        cl::Program program(context, util::loadProgram("../gameoflife.cl"));
-        try
+        accelerate_life(cl::EnqueueArgs(queue, global, local), d_board_tick, d_board_tock, nx, ny, localmem);
+
+        cl::Buffer tmp = d_board_tick;
+        d_board_tick = d_board_tock;
+        d_board_tock = tmp;
+    }
+    queue.finish();
+    double functor = timer.getTimeMicroseconds() / 1.0e6;
+
+    timer.reset();
+    for (unsigned int i = 0; i < iterations; i++)
+        life.enqueue(queue, global, local);
+    queue.finish();
+    double bound = timer.getTimeMicroseconds() / 1.0e6;
+
+    printf("%u launches on a %u x %u board:\n", iterations, nx, ny);
+    printf("\tcl::make_kernel\t\t%.3f seconds, %.0f launches/s\n", functor, iterations / functor);
+    printf("\tutil::PingPongLaunch\t%.3f seconds, %.0f launches/s (%.2fx)\n", bound,
+        iterations / bound, functor / bound);
+}
+
+/*************************************************************************************
+ * The board and packed engines timed against a stored baseline
+ ************************************************************************************/
+int bench_engines(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+                  const char *input, unsigned int nx, unsigned int ny,
+                  unsigned int bx, unsigned int by, unsigned int iterations,
+                  unsigned int reps, int baseline_mode, double threshold)
+{
+    cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+    util::PerfBaseline baseline(device);
+    if (baseline_mode == BASELINE_CHECK)
+    {
+        if (!baseline.load())
         {
-            program.build();
+            printf("No baseline to check against (%s): run with --save-baseline first\n",
+                   baseline.path().c_str());
+            return 1;
         }
-        catch (cl::Error error)
+        printf("Checking against %s (driver %s), failing slowdowns over %.0f%%\n",
+               baseline.path().c_str(), baseline.savedDriver().c_str(), 100.0 * threshold);
+    }
+
+    const unsigned int nwords = packed_words(nx);
+    util::PinnedAllocator<char> pinned(context, queue);
+    util::PinnedAllocator<cl_uint> pinned_words(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    PackedBoard h_packed(nwords * ny, 0, pinned_words);
+    load_board(h_board, input, nx, ny);
+    load_board(h_packed, input, nx, ny);
+
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_packed_tick(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * nwords * ny);
+    cl::Buffer d_packed_tock(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * nwords * ny);
+
+    util::PingPongLaunch board(program, "accelerate_life");
+    board.setArg(2, nx);
+    board.setArg(3, ny);
+    board.setArg(4, cl::Local(sizeof(char) * (bx + 2) * (by + 2)));
+    cl::NDRange board_global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+
+    util::PingPongLaunch packed(program, "accelerate_life_packed");
+    packed.setArg(2, nx);
+    packed.setArg(3, ny);
+    packed.setArg(4, nwords);
+    cl::NDRange packed_global(nwords, ny);
+
+    std::ostringstream size;
+    size << nx << "x" << ny;
+    const char *names[2] = { "board", "packed" };
+
+    printf("%u runs of %u generations on a %u x %u board:\n", reps, iterations, nx, ny);
+    int slower = 0, missing = 0, too_few = 0;
+    for (int e = 0; e < 2; e++)
+    {
+        // Every run from the starting state, after one to warm up
+        std::vector<double> times;
+        for (unsigned int r = 0; r <= reps; r++)
         {
-            // If it was a build error then show the error
-            if (error.err() == CL_BUILD_PROGRAM_FAILURE)
+            if (e == 0)
             {
-                std::vector<cl::Device> devices;
-                devices = context.getInfo<CL_CONTEXT_DEVICES>();
-                std::string built = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
-                std::cerr << built << "\n";
+                queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+                board.swap(0, 1, d_board_tick, d_board_tock);
             }
-            throw error;
+            else
+            {
+                queue.enqueueWriteBuffer(d_packed_tick, CL_TRUE, 0, sizeof(cl_uint) * nwords * ny, &h_packed[0]);
+                packed.swap(0, 1, d_packed_tick, d_packed_tock);
+            }
+
+            util::Timer timer;
+            for (unsigned int i = 0; i < iterations; i++)
+            {
+                if (e == 0)
+                    board.enqueue(queue, board_global, cl::NDRange(bx, by));
+                else
+                    packed.enqueue(queue, packed_global);
+            }
+            queue.finish();
+            if (r > 0)
+                times.push_back(timer.getTimeMicroseconds() / 1.0e6);
         }
 
-        cl::make_kernel
-            <cl::Buffer, cl::Buffer, unsigned int, unsigned int, cl::LocalSpaceArg>
-            accelerate_life(program, "accelerate_life");
+        const std::string key = std::string("life/") + names[e] + "/" + size.str();
+        printf("\t%-8s median %.6f seconds, %.0f generations/s", names[e],
+               util::sampleMedian(times), iterations / util::sampleMedian(times));
+        if (baseline_mode == BASELINE_CHECK)
+        {
+            util::BaselineCheck check = baseline.compare(key, times, threshold);
+            printf(", %s", util::formatCheck(check).c_str());
+            slower += check.verdict == util::BASELINE_SLOWER;
+            missing += check.verdict == util::BASELINE_MISSING;
+            too_few += check.verdict == util::BASELINE_TOO_FEW;
+        }
+        else if (baseline_mode == BASELINE_SAVE)
+            baseline.set(key, times);
+        printf("\n");
+    }
+
+    if (baseline_mode == BASELINE_SAVE)
+    {
+        if (baseline.save())
+            printf("Baseline written to %s\n", baseline.path().c_str());
+        else
+            printf("Could not write the baseline to %s\n", baseline.path().c_str());
+    }
+    else if (baseline_mode == BASELINE_CHECK)
+    {
+        printf("Baseline check: %d slower", slower);
+        if (missing)
+            printf(", %d not in the baseline", missing);
+        if (too_few)
+            printf(", %d with too few runs to test", too_few);
+        printf("\n");
+    }
+    return slower;
+}
+
+/*************************************************************************************
+ * Each engine timed on the board, with nothing printed but the rates
+ ************************************************************************************/
+
+// What a timed engine did: the launches and the wall and kernel times
+struct EngineTime
+{
+    const char   *name;
+    unsigned int launches;
+    double       wall;      // seconds, enqueue of the first launch to finish
+    double       kernel;    // seconds, summed over the launches' events (< 0: none)
+};
+
+// Launch life until iterations generations are done, generations at a time,
+// and add up the time each launch ran on the device
+EngineTime time_launches(cl::CommandQueue& queue, util::PingPongLaunch& life,
+                         const char *name, const cl::NDRange& global,
+                         const cl::NDRange& local, unsigned int iterations,
+                         unsigned int generations)
+{
+    std::vector<cl::Event> events;
+    events.reserve((iterations + generations - 1) / generations);
+
+    util::Timer timer;
+    for (unsigned int i = 0; i < iterations; i += generations)
+    {
+        if (generations > 1 && iterations - i < generations)
+            life.setArg(4, iterations - i);
+        events.push_back(cl::Event());
+        life.enqueue(queue, global, local, &events.back());
+    }
+    queue.finish();
+
+    EngineTime t;
+    t.name = name;
+    t.launches = events.size();
+    t.wall = timer.getTimeMicroseconds() / 1.0e6;
+    t.kernel = 0.0;
+    for (unsigned int e = 0; e < events.size(); e++)
+        t.kernel += util::eventSeconds(events[e]);
+    return t;
+}
+
+// The host engine, with no launches or kernel time
+EngineTime time_host_engine(const char *input, unsigned int nx, unsigned int ny,
+                            unsigned int iterations, unsigned int birth, unsigned int survive,
+                            unsigned int threads)
+{
+    EngineTime t;
+    t.name = "host";
+    t.launches = 0;
+    t.wall = time_host(input, nx, ny, iterations, birth, survive, threads);
+    t.kernel = -1.0;
+    return t;
+}
+
+// The rate table, a row an engine
+void print_times(const std::vector<EngineTime>& times, unsigned int nx, unsigned int ny,
+                 unsigned int iterations)
+{
+    const double cells = (double)nx * ny * iterations;
+    printf("%-8s %9s %10s %12s %14s %16s %8s\n", "engine", "launches", "wall(s)",
+           "generations/s", "cell updates/s", "kernel/gen(us)", "kernel%");
+    for (unsigned int e = 0; e < times.size(); e++)
+    {
+        const EngineTime& t = times[e];
+        printf("%-8s %9u %10.6f %12.0f %14.3e", t.name, t.launches, t.wall,
+               t.wall > 0.0 ? iterations / t.wall : 0.0, t.wall > 0.0 ? cells / t.wall : 0.0);
+        if (t.kernel >= 0.0)
+            printf(" %16.3f %7.1f%%", 1.0e6 * t.kernel / iterations,
+                   t.wall > 0.0 ? 100.0 * t.kernel / t.wall : 0.0);
+        printf("\n");
+    }
+}
+
+void time_engines(cl::Context& context, cl::Device& device, cl::Program& program,
+                  const char *input, unsigned int nx, unsigned int ny,
+                  unsigned int bx, unsigned int by, unsigned int iterations,
+                  unsigned int generations, unsigned int birth, unsigned int survive,
+                  unsigned int threads)
+{
+    cl::CommandQueue queue = util::createProfilingQueue(context, device);
+    if (generations < 2)
+        generations = TIMED_GENERATIONS;
+
+    const unsigned int nwords = packed_words(nx);
+    util::PinnedAllocator<char> pinned(context, queue);
+    util::PinnedAllocator<cl_uint> pinned_words(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    PackedBoard h_packed(nwords * ny, 0, pinned_words);
+    load_board(h_board, input, nx, ny);
+    load_board(h_packed, input, nx, ny);
+
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+    cl::Buffer d_packed_tick(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * nwords * ny);
+    cl::Buffer d_packed_tock(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * nwords * ny);
+
+    cl::NDRange global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+    cl::NDRange local(bx, by);
+    std::vector<EngineTime> times;
+
+    try
+    {
+        queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+        util::PingPongLaunch life(program, "accelerate_life");
+        life.swap(0, 1, d_board_tick, d_board_tock);
+        life.setArg(2, nx);
+        life.setArg(3, ny);
+        life.setArg(4, cl::Local(sizeof(char) * (bx + 2) * (by + 2)));
+        times.push_back(time_launches(queue, life, "byte", global, local, iterations, 1));
+    } catch (cl::Error err)
+    {
+        printf("byte engine failed: %s (%d)\n", err.what(), err.err());
+    }
+
+    try
+    {
+        queue.enqueueWriteBuffer(d_packed_tick, CL_TRUE, 0, sizeof(cl_uint) * nwords * ny, &h_packed[0]);
+        util::PingPongLaunch life(program, "accelerate_life_packed");
+        life.swap(0, 1, d_packed_tick, d_packed_tock);
+        life.setArg(2, nx);
+        life.setArg(3, ny);
+        life.setArg(4, nwords);
+        times.push_back(time_launches(queue, life, "packed", cl::NDRange(nwords, ny),
+                                      cl::NullRange, iterations, 1));
+    } catch (cl::Error err)
+    {
+        printf("packed engine failed: %s (%d)\n", err.what(), err.err());
+    }
+
+    try
+    {
+        queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+        ::size_t tile_bytes = sizeof(char) * (bx + 2 * generations) * (by + 2 * generations);
+        util::PingPongLaunch life(program, "accelerate_life_multi");
+        life.swap(0, 1, d_board_tick, d_board_tock);
+        life.setArg(2, nx);
+        life.setArg(3, ny);
+        life.setArg(4, generations);
+        life.setArg(5, cl::Local(tile_bytes));
+        life.setArg(6, cl::Local(tile_bytes));
+        times.push_back(time_launches(queue, life, "multi", global, local, iterations, generations));
+    } catch (cl::Error err)
+    {
+        printf("multi engine failed: %s (%d)\n", err.what(), err.err());
+    }
+
+    times.push_back(time_host_engine(input, nx, ny, iterations, birth, survive, threads));
+
+    printf("%u generations on a %u x %u board, blocks of %u x %u, multi %u generations a launch:\n",
+           iterations, nx, ny, bx, by, generations);
+    print_times(times, nx, ny, iterations);
+}
 
-        // Allocate memory for boards
-        std::vector<char> h_board(nx * ny);
-        cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
-        cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+// The host engine alone, for a run with no device or with --host
+void time_host_only(const char *input, unsigned int nx, unsigned int ny,
+                    unsigned int iterations, unsigned int birth, unsigned int survive,
+                    unsigned int threads)
+{
+    std::vector<EngineTime> times(1, time_host_engine(input, nx, ny, iterations,
+                                                      birth, survive, threads));
+
+    printf("%u generations on a %u x %u board, on the host only:\n", iterations, nx, ny);
+    print_times(times, nx, ny, iterations);
+}
+
+/*************************************************************************************
+ * The char board kernels with each way of loading the block, timed on one board
+ ************************************************************************************/
+void compare_tiles(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+                   const char *input, unsigned int nx, unsigned int ny,
+                   unsigned int bx, unsigned int by, unsigned int iterations)
+{
+    const ::size_t bytes = sizeof(char) * nx * ny;
+    const unsigned int vec = 16;        // LIFE_VEC in gameoflife.cl
+    const cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
 
-        // Load in the starting state to host board and copy to device
-        load_board(h_board, argv[1], nx, ny);
-        cl::copy(queue, h_board.begin(), h_board.end(), d_board_tick);
+    Board start(nx * ny, DEAD), first(nx * ny, DEAD), board(nx * ny, DEAD);
+    load_board(start, input, nx, ny);
+    cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, bytes);
 
-        // Display the starting state
-        std::cout << "Starting state\n";
-        print_board(h_board, nx, ny);
+    const char *names[] = { "accelerate_life_edges", "accelerate_life", "accelerate_life_vec" };
+    const char *what[]  = { "halo by the edge work-items", "whole block together", "16 cells a work-item" };
 
-        // Set the global and local problem sizes
-        cl::NDRange global(nx, ny);
+    printf("%u generations on a %u x %u board, blocks of %u x %u work-items:\n",
+        iterations, nx, ny, bx, by);
+    for (int k = 0; k < 3; k++)
+    {
+        // accelerate_life_vec covers 16 times the columns with each group
+        const unsigned int cells = (k == 2) ? bx * vec : bx;
+        const ::size_t local_bytes = sizeof(char) * (cells + 2) * (by + 2);
+        if (local_bytes > device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>())
+        {
+            printf("\t%-22s skipped: needs %u bytes of local memory\n", names[k], (unsigned int)local_bytes);
+            continue;
+        }
+        const unsigned int items = (k == 2) ? (nx + vec - 1) / vec : nx;
+        cl::NDRange global((items + bx - 1) / bx * bx, (ny + by - 1) / by * by);
         cl::NDRange local(bx, by);
 
-        // Allocate local memory
-        cl::LocalSpaceArg localmem = cl::Local(sizeof(char) * (bx + 2) * (by + 2));
+        util::PingPongLaunch life(program, names[k]);
+        queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, bytes, &start[0]);
+        life.swap(0, 1, d_board_tick, d_board_tock);
+        life.setArg(2, nx);
+        life.setArg(3, ny);
+        life.setArg(4, cl::Local(local_bytes));
 
-        // Loop
+        util::Timer timer;
         for (unsigned int i = 0; i < iterations; i++)
+            life.enqueue(queue, global, local);
+        queue.finish();
+        double rtime = timer.getTimeMicroseconds() / 1.0e6;
+
+        // Every kernel should end with the same board
+        Board& result = k ? board : first;
+        queue.enqueueReadBuffer(life.input(), CL_TRUE, 0, bytes, &result[0]);
+        bool same = !k || result == first;
+
+        printf("\t%-22s %.6f seconds, %.1f million cells a second (%s)%s\n", names[k], rtime,
+            rtime > 0.0 ? (double)nx * ny * iterations / (1.0e6 * rtime) : 0.0, what[k],
+            same ? "" : ", DIFFERENT final board");
+    }
+
+    save_board(first, nx, ny);
+}
+
+/*************************************************************************************
+ * Simulation split by rows over several devices
+ ************************************************************************************/
+
+// A device's share of the board: rows y0 to y0 + h - 1, held with depth
+// ghost rows above and below.  Each device has its own context, as the
+// devices may come from different platforms, so rows go between them
+// through (pinned) host memory.
+struct Strip
+{
+    unsigned int y0, h;
+    cl::Context context;
+    cl::CommandQueue queue;         // kernels, and the ghost rows coming in
+    cl::CommandQueue io;            // the edge rows going out
+    cl::Kernel kernel;
+    cl::Buffer tick, tock;
+    Board edges;                    // edge rows going out: [round % 2][top, bottom]
+    cl::Event read;                 // this round's edge rows are on the host
+    std::vector<cl::Event> sent[2]; // last round's edge rows have gone out
+
+    Strip(const cl::Device& device, const std::string& source, const std::string& options,
+          unsigned int nx, unsigned int y0, unsigned int h, unsigned int depth)
+        : y0(y0), h(h),
+          context(std::vector<cl::Device>(1, device)),
+          queue(context, device), io(context, device),
+          edges(4 * depth * nx, DEAD, util::PinnedAllocator<char>(context, queue))
+    {
+        cl::Program program = util::buildProgram(context, device, source, options);
+        kernel = cl::Kernel(program, "accelerate_life_strip");
+        tick = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(char) * nx * (h + 2 * depth));
+        tock = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(char) * nx * (h + 2 * depth));
+    }
+
+    // Update rows row0 to row0 + nrows - 1 of tock from tick
+    void update(unsigned int nx, unsigned int row0, unsigned int nrows, cl::Event *event = NULL)
+    {
+        kernel.setArg(0, tick);
+        kernel.setArg(1, tock);
+        kernel.setArg(2, nx);
+        kernel.setArg(3, row0);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nx, nrows), cl::NullRange, NULL, event);
+    }
+
+    void swap()
+    {
+        cl::Buffer tmp = tick;
+        tick = tock;
+        tock = tmp;
+    }
+};
+
+// With depth ghost rows, the strips only swap rows every depth generations.
+// In the last generation of a round, a strip updates its top and bottom
+// depth rows first and sends them to the host on its second queue, while
+// it updates the rest; the host passes them on to the strips either side
+// as their new ghost rows.
+void run_devices(const std::vector<cl::Device>& devices, const std::string& source,
+                 const std::string& options, const char *input, unsigned int nx, unsigned int ny,
+                 unsigned int iterations, unsigned int depth)
+{
+    const unsigned int n = devices.size();
+    const ::size_t band = sizeof(char) * depth * nx;
+
+    Board h_board(nx * ny, DEAD);
+    load_board(h_board, input, nx, ny);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    std::vector<Strip*> strips;
+    for (unsigned int d = 0; d < n; d++)
+    {
+        unsigned int y0 = (unsigned int)((cl_ulong)d * ny / n);
+        unsigned int y1 = (unsigned int)((cl_ulong)(d + 1) * ny / n);
+        if (y1 - y0 < depth)
+            die("Too many devices, or too many generations, for the rows of the board.", __LINE__, __FILE__);
+
+        cl::Device device = devices[d];
+        std::string name;
+        getDeviceName(device, name);
+        std::cout << "Rows " << y0 << " to " << y1 - 1 << " on " << name << "\n";
+
+        Strip *strip = new Strip(device, source, options, nx, y0, y1 - y0, depth);
+        strips.push_back(strip);
+
+        // The strip and its ghost rows, round the torus
+        std::vector<char> rows(nx * (strip->h + 2 * depth));
+        for (unsigned int r = 0; r < strip->h + 2 * depth; r++)
         {
-            // Apply the rules of Life
-            // Enqueue the kernel
-            accelerate_life(cl::EnqueueArgs(queue, global, local), d_board_tick, d_board_tock, nx, ny, localmem);
+            unsigned int y = (y0 + ny - depth + r) % ny;
+            memcpy(&rows[r * nx], &h_board[y * nx], nx);
+        }
+        strip->queue.enqueueWriteBuffer(strip->tick, CL_TRUE, 0, rows.size(), &rows[0]);
+    }
+
+    util::Timer timer;
+
+    unsigned int round = 0;
+    for (unsigned int done = 0; done < iterations; round++)
+    {
+        const unsigned int gens = std::min(depth, iterations - done);
+        const unsigned int p = round % 2;
+
+        for (unsigned int d = 0; d < n; d++)
+        {
+            Strip& s = *strips[d];
+            const unsigned int rows = s.h + 2 * depth;
+
+            // Generation g is right in all but the g rows at each end
+            for (unsigned int g = 1; g < gens; g++)
+            {
+                s.update(nx, g, rows - 2 * g);
+                s.swap();
+            }
+
+            // Last generation: the rows going out first
+            cl::Event edges_done;
+            s.update(nx, depth, depth);
+            s.update(nx, s.h, depth, &edges_done);
+            if (s.h > 2 * depth)
+                s.update(nx, 2 * depth, s.h - 2 * depth);
+
+            // The edge buffers of two rounds ago must have gone out
+            for (unsigned int e = 0; e < s.sent[p].size(); e++)
+                s.sent[p][e].wait();
+            s.sent[p].clear();
 
-            // Swap the boards over
-            cl::Buffer tmp = d_board_tick;
-            d_board_tick = d_board_tock;
-            d_board_tock = tmp;
+            std::vector<cl::Event> after(1, edges_done);
+            cl::Event top;
+            s.io.enqueueReadBuffer(s.tock, CL_FALSE, depth * nx, band, &s.edges[(2 * p) * band], &after, &top);
+            s.io.enqueueReadBuffer(s.tock, CL_FALSE, s.h * nx, band, &s.edges[(2 * p + 1) * band], &after, &s.read);
+            s.io.flush();
+            s.queue.flush();
+            s.swap();
         }
 
-        // Copy back the memory to the host
-        cl::copy(queue, d_board_tick, h_board.begin(), h_board.end());
+        // Each strip's top rows are the bottom ghost rows of the strip
+        // above, and its bottom rows the top ghost rows of the one below
+        for (unsigned int d = 0; d < n; d++)
+        {
+            Strip& s = *strips[d];
+            Strip& above = *strips[(d + n - 1) % n];
+            Strip& below = *strips[(d + 1) % n];
 
-        // Display the final state
-        std::cout << "Finishing state\n";
-        print_board(h_board, nx, ny);
+            s.read.wait();
+            cl::Event up, down;
+            above.queue.enqueueWriteBuffer(above.tick, CL_FALSE, (above.h + depth) * nx, band,
+                                           &s.edges[(2 * p) * band], NULL, &up);
+            below.queue.enqueueWriteBuffer(below.tick, CL_FALSE, 0, band,
+                                           &s.edges[(2 * p + 1) * band], NULL, &down);
+            s.sent[p].push_back(up);
+            s.sent[p].push_back(down);
+        }
+        for (unsigned int d = 0; d < n; d++)
+            strips[d]->queue.flush();
 
-        // Save the final state of the board
-        save_board(h_board, nx, ny);
+        done += gens;
+    }
 
-    } catch (cl::Error err)
+    // Copy back each strip, without its ghost rows
+    for (unsigned int d = 0; d < n; d++)
     {
-        std::cerr << "ERROR: " << err.what() << ":\n";
-        err_code(err.err());
-        return EXIT_FAILURE;
+        Strip& s = *strips[d];
+        s.queue.enqueueReadBuffer(s.tick, CL_TRUE, depth * nx, sizeof(char) * nx * s.h, &h_board[s.y0 * nx]);
     }
 
-    return EXIT_SUCCESS;
-}
+    double rtime = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+    printf("%u generations on %u devices in %.3f seconds\n", iterations, n, rtime);
+
+    for (unsigned int d = 0; d < n; d++)
+        delete strips[d];
 
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    // Save the final state of the board
+    save_board(h_board, nx, ny);
+}
 
 /*************************************************************************************
- * Utility functions
+ * Many boards at once
  ************************************************************************************/
 
-// Function to load the params file and set up the X and Y dimensions
-void load_params(const char* file, unsigned int *nx, unsigned int *ny, unsigned int *iterations)
+// The list has a board to a line, as the pattern file and then the
+// parameter file; lines starting with # are skipped.  Board i is saved to
+// final_state_i.dat.
+void run_batch(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+               const char *list)
 {
-    std::ifstream fp(file);
+    cl::make_kernel
+        <cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, unsigned int>
+        accelerate_life_batch(program, "accelerate_life_batch");
+
+    std::ifstream fp(list);
     if (!fp.is_open())
-        die("Could not open params file.", __LINE__, __FILE__);
+        die("Could not open batch list.", __LINE__, __FILE__);
+
+    std::vector<std::string> inputs;
+    std::vector<cl_uint> offsets, widths, heights, iterations;
+    cl_uint total = 0, max_nx = 1, max_ny = 1, max_iterations = 0;
+
+    std::string line;
+    while (std::getline(fp, line))
+    {
+        std::istringstream fields(line);
+        std::string input, params;
+        if (!(fields >> input) || input[0] == '#')
+            continue;
+        if (!(fields >> params))
+            die("Batch lines should be: input.dat input.params", __LINE__, __FILE__);
+
+        unsigned int nx, ny, its;
+        load_params(params.c_str(), &nx, &ny, &its);
+        inputs.push_back(input);
+        offsets.push_back(total);
+        widths.push_back(nx);
+        heights.push_back(ny);
+        iterations.push_back(its);
+
+        total += nx * ny;
+        max_nx = std::max(max_nx, (cl_uint)nx);
+        max_ny = std::max(max_ny, (cl_uint)ny);
+        max_iterations = std::max(max_iterations, (cl_uint)its);
+    }
+    const unsigned int nboards = inputs.size();
+    if (nboards == 0)
+        die("Batch list has no boards.", __LINE__, __FILE__);
+
+    // All the boards end to end
+    util::PinnedAllocator<char> pinned(context, queue);
+    Board h_boards(total, DEAD, pinned);
+    for (unsigned int b = 0; b < nboards; b++)
+    {
+        Board board(widths[b] * heights[b], DEAD);
+        load_board(board, inputs[b].c_str(), widths[b], heights[b]);
+        std::copy(board.begin(), board.end(), h_boards.begin() + offsets[b]);
+    }
+
+    cl::Buffer d_tick(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, total, &h_boards[0]);
+    cl::Buffer d_tock(context, CL_MEM_READ_WRITE, total);
+    cl::Buffer d_offsets(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * nboards, &offsets[0]);
+    cl::Buffer d_widths(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * nboards, &widths[0]);
+    cl::Buffer d_heights(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * nboards, &heights[0]);
+    cl::Buffer d_iterations(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * nboards, &iterations[0]);
+
+    printf("%u boards, %u cells, up to %u x %u and %u generations\n",
+        nboards, total, max_nx, max_ny, max_iterations);
+
+    util::Timer timer;
 
-    int retval;
-    fp >> *nx;
-    fp >> *ny;
-    fp >> *iterations;
-    fp.close();
+    // One launch a generation for every board
+    cl::NDRange global(max_nx, max_ny, nboards);
+    for (unsigned int i = 0; i < max_iterations; i++)
+    {
+        accelerate_life_batch(cl::EnqueueArgs(queue, global),
+            d_tick, d_tock, d_offsets, d_widths, d_heights, d_iterations, i);
+
+        cl::Buffer tmp = d_tick;
+        d_tick = d_tock;
+        d_tock = tmp;
+    }
+    queue.enqueueReadBuffer(d_tick, CL_TRUE, 0, total, &h_boards[0]);
+
+    double rtime = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+    printf("%.3f seconds\n", rtime);
+
+    for (unsigned int b = 0; b < nboards; b++)
+    {
+        Board board(h_boards.begin() + offsets[b], h_boards.begin() + offsets[b] + widths[b] * heights[b]);
+        unsigned int live = std::count(board.begin(), board.end(), (char)ALIVE);
+        printf("%s: %u x %u, %u generations, %u live cells\n",
+            inputs[b].c_str(), widths[b], heights[b], iterations[b], live);
+
+        char file[64];
+        sprintf(file, "final_state_%u.dat", b);
+        save_board(board, widths[b], heights[b], file);
+    }
 }
 
-// Function to load in a file which lists the alive cells
-// Each line of the file is expected to be: x y 1
-void load_board(std::vector<char>& board, const char* file, const unsigned int nx, const unsigned int ny)
+/*************************************************************************************
+ * Simulation on boards in shared virtual memory, with no copies to or from the device
+ ************************************************************************************/
+bool run_svm(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+             const char *input, unsigned int nx, unsigned int ny,
+             unsigned int bx, unsigned int by, unsigned int iterations)
 {
-    std::ifstream fp(file);
-    if (!fp.is_open())
-        die("Could not open input file.", __LINE__, __FILE__);
+    cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+    util::SVMKind kind = util::svmKind(device);
+    if (kind == util::SVM_NONE)
+    {
+        std::cout << "The device has no shared virtual memory: running on buffers instead\n";
+        return false;
+    }
+    std::cout << "Boards in " << util::svmName(kind) << "\n";
+
+    // The pattern is parsed into a host board, which the first SVM board
+    // is filled from; after that no board is copied
+    util::PinnedAllocator<char> pinned(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    load_board(h_board, input, nx, ny);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    util::SVMVector<char> tick(context, kind, nx * ny), tock(context, kind, nx * ny);
+    tick.hostAccess(queue);
+    std::copy(h_board.begin(), h_board.end(), tick.data());
+    tick.deviceAccess(queue);
+
+    // One kernel each way round, bound once, as in util::PingPongLaunch
+    cl::Kernel life[2] = { cl::Kernel(program, "accelerate_life"),
+                           cl::Kernel(program, "accelerate_life") };
+    for (int k = 0; k < 2; k++)
+    {
+        (k ? tock : tick).setArg(life[k], 0);
+        (k ? tick : tock).setArg(life[k], 1);
+        life[k].setArg(2, nx);
+        life[k].setArg(3, ny);
+        life[k].setArg(4, cl::Local(sizeof(char) * (bx + 2) * (by + 2)));
+    }
+
+    cl::NDRange global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+    cl::NDRange local(bx, by);
+
+    util::Timer timer;
+    for (unsigned int i = 0; i < iterations; i++)
+        queue.enqueueNDRangeKernel(life[i % 2], cl::NullRange, global, local);
+    queue.finish();
+    double rtime = timer.getTimeMicroseconds() / 1.0e6;
+    printf("%u generations in %.6f seconds, %.1f million cells a second\n", iterations, rtime,
+           rtime > 0.0 ? (double)nx * ny * iterations / (1.0e6 * rtime) : 0.0);
+
+    // The last board is where the last launch wrote it
+    util::SVMVector<char>& last = iterations % 2 ? tock : tick;
+    last.hostAccess(queue);
+    std::copy(last.data(), last.data() + nx * ny, h_board.begin());
+
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    // Save the final state of the board
+    save_board(h_board, nx, ny);
+    return true;
+}
 
-    int retval;
-    unsigned int x, y, s;
-    while (fp >> x >> y >> s)
+/*************************************************************************************
+ * Simulation on boards in images, read through the texture cache
+ ************************************************************************************/
+bool run_image(cl::Context& context, cl::CommandQueue& queue, cl::Program& program,
+               const char *input, unsigned int nx, unsigned int ny,
+               unsigned int bx, unsigned int by, unsigned int iterations)
+{
+    cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+    if (!device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() ||
+        nx > device.getInfo<CL_DEVICE_IMAGE2D_MAX_WIDTH>() ||
+        ny > device.getInfo<CL_DEVICE_IMAGE2D_MAX_HEIGHT>())
     {
-        if (x > nx - 1)
-            die("Input x-coord out of range.", __LINE__, __FILE__);
-        if (y > ny - 1)
-            die("Input y-coord out of range.", __LINE__, __FILE__);
-        if (s != ALIVE)
-            die("Alive value should be 1.", __LINE__, __FILE__);
+        std::cout << "The device cannot hold the board in an image: running on buffers instead\n";
+        return false;
+    }
+
+    util::PinnedAllocator<char> pinned(context, queue);
+    Board h_board(nx * ny, DEAD, pinned);
+    load_board(h_board, input, nx, ny);
+
+    // Display the starting state
+    std::cout << "Starting state\n";
+    print_board(h_board, nx, ny);
+
+    cl::ImageFormat format(CL_R, CL_UNSIGNED_INT8);
+    cl::Image2D tick(context, CL_MEM_READ_WRITE, format, nx, ny);
+    cl::Image2D tock(context, CL_MEM_READ_WRITE, format, nx, ny);
+    cl::size_t<3> origin, region;
+    region[0] = nx;
+    region[1] = ny;
+    region[2] = 1;
+    queue.enqueueWriteImage(tick, CL_TRUE, origin, region, 0, 0, &h_board[0]);
 
-        board[x + y * nx] = ALIVE;
+    // One kernel each way round, bound once, as in run_svm
+    cl::Kernel life[2] = { cl::Kernel(program, "accelerate_life_image"),
+                           cl::Kernel(program, "accelerate_life_image") };
+    for (int k = 0; k < 2; k++)
+    {
+        life[k].setArg(0, k ? tock : tick);
+        life[k].setArg(1, k ? tick : tock);
+        life[k].setArg(2, nx);
+        life[k].setArg(3, ny);
     }
 
-    fp.close();
+    cl::NDRange global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+    cl::NDRange local(bx, by);
+
+    util::Timer timer;
+    for (unsigned int i = 0; i < iterations; i++)
+        queue.enqueueNDRangeKernel(life[i % 2], cl::NullRange, global, local);
+    queue.finish();
+    double rtime = timer.getTimeMicroseconds() / 1.0e6;
+    printf("%u generations in %.6f seconds, %.1f million cells a second\n", iterations, rtime,
+           rtime > 0.0 ? (double)nx * ny * iterations / (1.0e6 * rtime) : 0.0);
+
+    // The last board is the image the last launch wrote
+    queue.enqueueReadImage(iterations % 2 ? tock : tick, CL_TRUE, origin, region, 0, 0,
+                           &h_board[0]);
+
+    // Display the final state
+    std::cout << "Finishing state\n";
+    print_board(h_board, nx, ny);
+
+    // Save the final state of the board
+    save_board(h_board, nx, ny);
+    return true;
 }
 
-// Function to print out the board to stdout
-// Alive cells are displayed as O
-// Dead cells are displayed as .
-void print_board(const std::vector<char>& board, const unsigned int nx, const unsigned int ny)
+/*************************************************************************************
+ * Main function
+ ************************************************************************************/
+int main(int argc, char **argv)
 {
-    for (unsigned int i = 0; i < ny; i++)
+
+    // A batch of boards in place of a starting state file
+    const char *batch = NULL;
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (!strcmp(argv[i], "--batch"))
+            batch = argv[i + 1];
+    }
+
+    // Check we have a starting state file
+    if (argc < 3 && !batch)
     {
-        for (unsigned int j = 0; j < nx; j++)
+        printf("Usage:\n./gameoflife input.dat input.params [bx by] [--packed] [--generations K]\n");
+        printf("\tinput.dat\tpattern file: x y 1 lines, RLE, or a snapshot file\n");
+        printf("\tinput.params\tparameter file defining board size\n");
+        printf("\tbx by\tsizes of thread blocks (default: chosen for the device)\n");
+        printf("\t--packed\tstore the board as bits, 32 cells to a word\n");
+        printf("\t--generations K\tadvance each block K generations per launch\n");
+        printf("\t--sparse\tonly update the blocks that can change\n");
+        printf("\t--devices N\tsplit the board by rows over N devices (0 for all)\n");
+        printf("\t--snapshot N [FILE]\twrite the board to FILE every N generations\n");
+        printf("\t--rule B3/S23\tthe rule, as a B/S rulestring\n");
+        printf("\t--batch list.txt\trun the boards listed together\n");
+        printf("\t--launch-rate\ttime the launches of cl::make_kernel and bound kernels\n");
+        printf("\t--cycles K\tstop early once the board repeats, checking every K generations\n");
+        printf("\t--record\treplay recorded launches, with cl_khr_command_buffer if there is one\n");
+        printf("\t--persistent\tall the generations in one launch, for boards that fit in local memory\n");
+        printf("\t--svm\tkeep the boards in shared virtual memory, with no copies\n");
+        printf("\t--image\tkeep the boards in images, read through the texture cache\n");
+        printf("\t--compare-tiles\ttime the ways of loading a block of the board\n");
+        printf("\t--bench R\ttime R runs of the board and packed engines\n");
+        printf("\t--save-baseline\tkeep the --bench times as this device's baseline\n");
+        printf("\t--check-baseline\tfail if --bench is slower than the baseline\n");
+        printf("\t--threshold PCT\tslowdown --check-baseline fails on (default 5)\n");
+        printf("\t--timed\trate every engine, printing no boards\n");
+        printf("\t--host\trun on the host's cores, as when there is no OpenCL device\n");
+        printf("\t--threads N\thost threads (default: one per hardware thread)\n");
+        return EXIT_FAILURE;
+    }
+
+    // Board dimensions and iteration total
+    unsigned int nx, ny;
+    unsigned int bx = 0, by = 0;
+    unsigned int iterations;
+
+    bool packed = false;
+    bool sparse = false;
+    bool rate = false;
+    bool host = false;
+    bool tiles = false;
+    bool persistent = false;
+    bool recorded = false;
+    bool svm = false;
+    bool image = false;
+    bool timed = false;
+    unsigned int cycle_every = 0;
+    unsigned int bench_reps = 0;
+    int baseline_mode = BASELINE_OFF;
+    double threshold = BENCH_THRESHOLD;
+    unsigned int threads = 0;
+    unsigned int birth = HOST_BIRTH, survive = HOST_SURVIVE;
+    unsigned int generations = 1;
+    int ndevices = -1;
+    unsigned int snapshot_every = 0;
+    const char *snapshot_file = "snapshots.gol";
+    std::string options;
+    int i = batch ? 1 : 3;
+    if (!batch && argc > 4 && argv[3][0] != '-')
+    {
+        bx = atoi(argv[3]);
+        by = atoi(argv[4]);
+        i = 5;
+    }
+    for (; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--packed"))
+            packed = true;
+        else if (!strcmp(argv[i], "--sparse"))
+            sparse = true;
+        else if (!strcmp(argv[i], "--launch-rate"))
+            rate = true;
+        else if (!strcmp(argv[i], "--host"))
+            host = true;
+        else if (!strcmp(argv[i], "--compare-tiles"))
+            tiles = true;
+        else if (!strcmp(argv[i], "--persistent"))
+            persistent = true;
+        else if (!strcmp(argv[i], "--record"))
+            recorded = true;
+        else if (!strcmp(argv[i], "--svm"))
+            svm = true;
+        else if (!strcmp(argv[i], "--image"))
+            image = true;
+        else if (!strcmp(argv[i], "--timed"))
+            timed = true;
+        else if (!strcmp(argv[i], "--save-baseline"))
+            baseline_mode = BASELINE_SAVE;
+        else if (!strcmp(argv[i], "--check-baseline"))
+            baseline_mode = BASELINE_CHECK;
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = std::max(0.0, atof(argv[++i]) / 100.0);
+        else if (!strcmp(argv[i], "--bench") && i + 1 < argc)
+            bench_reps = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--cycles") && i + 1 < argc)
+            cycle_every = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--generations") && i + 1 < argc)
+            generations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--devices") && i + 1 < argc)
+            ndevices = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--rule") && i + 1 < argc)
         {
-            if (board[i * nx + j] == DEAD)
-                std::cout << ".";
-            else
-                std::cout << "O";
+            options = rule_options(argv[++i]);
+            rule_masks(argv[i], &birth, &survive);
+        }
+        else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc)
+        {
+            snapshot_every = std::max(0, atoi(argv[++i]));
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                snapshot_file = argv[++i];
         }
-        std::cout << "\n";
     }
-}
 
-void save_board(const std::vector<char>& board, const unsigned int nx, const unsigned int ny)
-{
-    FILE *fp = fopen(FINALSTATEFILE, "w");
-    if (!fp)
-        die("Could not open final state file.", __LINE__, __FILE__);
+    if (baseline_mode != BASELINE_OFF && bench_reps < BASELINE_MIN_RUNS)
+    {
+        printf("--save-baseline and --check-baseline need --bench R of %d or more runs\n",
+               BASELINE_MIN_RUNS);
+        return EXIT_FAILURE;
+    }
+
+    if (!batch)
+        load_params(argv[2], &nx, &ny, &iterations);
+
+    if (host && !batch)
+    {
+        if (timed)
+            time_host_only(argv[1], nx, ny, iterations, birth, survive, threads);
+        else
+            run_host(argv[1], nx, ny, iterations, birth, survive, threads);
+        return EXIT_SUCCESS;
+    }
 
-    for (unsigned int i = 0; i < ny; i++)
+    // Create OpenCL context, queue and program
+    try
     {
-        for (unsigned int j = 0; j < nx; j++)
+        if (ndevices >= 0 && !batch)
         {
-            if (board[i * nx + j] == ALIVE)
-                fprintf(fp, "%d %d %d\n", j, i, ALIVE);
+            std::vector<cl::Device> devices;
+            unsigned int available = getDeviceList(devices);
+            if (ndevices > 0 && (unsigned int)ndevices < available)
+                devices.resize(ndevices);
+            run_devices(devices, util::loadProgram("../gameoflife.cl"), options, argv[1], nx, ny, iterations, generations);
+            return EXIT_SUCCESS;
         }
+
+        // With no device (or no platform) at all, the host does the work
+        cl::Context context;
+        try
+        {
+            context = cl::Context(DEVICE);
+        } catch (cl::Error err)
+        {
+            if (batch)
+                throw;
+            std::cout << "No OpenCL device (" << err_code(err.err()) << "), running on the host\n";
+            if (timed)
+                time_host_only(argv[1], nx, ny, iterations, birth, survive, threads);
+            else
+                run_host(argv[1], nx, ny, iterations, birth, survive, threads);
+            return EXIT_SUCCESS;
+        }
+        cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+        cl::CommandQueue queue(context, device);
+
+        // The run goes into the OCL_WORKLOAD log, for replay
+        if (!batch)
+        {
+            const long workload[] = { nx, ny, iterations };
+            util::recordWorkload(device, "life", workload, 3);
+        }
+
+        // Build the program, printing the build log on failure
+        cl::Program program = util::buildProgramFile(context, device, "../gameoflife.cl", options);
+
+        if (batch)
+        {
+            run_batch(context, queue, program, batch);
+            return EXIT_SUCCESS;
+        }
+
+        if ((!packed || rate || tiles || bench_reps || timed) && (bx == 0 || by == 0))
+        {
+            choose_block(cl::Kernel(program, "accelerate_life"), device, nx, ny, &bx, &by);
+            std::cout << "Using blocks of " << bx << " x " << by << "\n";
+        }
+
+        if (timed)
+            time_engines(context, device, program, argv[1], nx, ny, bx, by, iterations,
+                         generations, birth, survive, threads);
+        else if (bench_reps)
+        {
+            int slower = bench_engines(context, queue, program, argv[1], nx, ny, bx, by,
+                                       iterations, bench_reps, baseline_mode, threshold);
+            return slower ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        else if (rate)
+            launch_rate(context, queue, program, nx, ny, bx, by, iterations);
+        else if (tiles)
+            compare_tiles(context, queue, program, argv[1], nx, ny, bx, by, iterations);
+        else if (packed)
+            run_packed(context, queue, program, argv[1], nx, ny, iterations);
+        else if (sparse)
+            run_sparse(context, queue, program, argv[1], nx, ny, bx, by, iterations);
+        else if (svm && run_svm(context, queue, program, argv[1], nx, ny, bx, by, iterations))
+            std::cout << "Boards shared with the host, nothing copied\n";
+        else if (image && run_image(context, queue, program, argv[1], nx, ny, bx, by, iterations))
+            std::cout << "Boards read through the texture cache\n";
+        else if (!persistent || !run_persistent(context, queue, program, argv[1], nx, ny, iterations))
+            run_board(context, queue, program, argv[1], nx, ny, bx, by, iterations, generations,
+                      snapshot_every, snapshot_file, cycle_every, recorded);
+
+    } catch (cl::Error err)
+    {
+        std::cerr << "ERROR: " << err.what() << ":\n";
+        err_code(err.err());
+        return EXIT_FAILURE;
     }
-}
 
-// Function to display error and exit nicely
-void die(const std::string message, const int line, const std::string file)
-{
-  std::cerr << "Error at line " << line << " of file " << file << ":\n";
-  std::cerr << message << "\n";
-  exit(EXIT_FAILURE);
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+//
+// Name:       gameoflife.hpp
+//
+// Purpose:    Include file for the game of life: board types and the
+//             board utility functions (board.cpp)
+//
+// HISTORY:    Written by Tom Deakin and Simon McIntosh-Smith, August 2013
+//
+//------------------------------------------------------------------------------
+
+#ifndef __GAMEOFLIFE_HDR
+#define __GAMEOFLIFE_HDR
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define __CL_ENABLE_EXCEPTIONS
+#include "cl.hpp"
+
+#include "util.hpp"
+#include "program_cache.hpp"
+#include "pinned_allocator.hpp"
+
+//pick up device type from compiler command line or from
+//the default type
+#ifndef DEVICE
+#define DEVICE CL_DEVICE_TYPE_DEFAULT
+#endif
+
+
+#define FINALSTATEFILE "final_state.dat"
+
+// Define the state of the cell
+#define DEAD  0
+#define ALIVE 1
+
+// Host copy of the board, in pinned memory for fast transfers
+typedef std::vector<char, util::PinnedAllocator<char> > Board;
+
+// Bit-packed board: each row is packed_words(nx) words, with cell x of
+// the row in bit x % CELLS_PER_WORD of word x / CELLS_PER_WORD.  The
+// bits past the end of a row are always zero.
+typedef std::vector<cl_uint, util::PinnedAllocator<cl_uint> > PackedBoard;
+
+#define CELLS_PER_WORD 32
+
+inline unsigned int packed_words(const unsigned int nx)
+{
+    return (nx + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+}
+
+/*************************************************************************************
+ * Utility functions (board.cpp)
+ ************************************************************************************/
+void die(const std::string message, const int line, const std::string file);
+void load_params(const char* file, unsigned int *nx, unsigned int *ny, unsigned int *iterations);
+void rule_masks(const char* rule, unsigned int *birth, unsigned int *survive);
+std::string rule_options(const char* rule);
+void choose_block(const cl::Kernel& kernel, const cl::Device& device,
+                  unsigned int nx, unsigned int ny, unsigned int *bx, unsigned int *by);
+
+// Reading, printing and saving a board, one char per cell or bit-packed
+void load_board(Board& board, const char* file, const unsigned int nx, const unsigned int ny);
+void print_board(const Board& board, const unsigned int nx, const unsigned int ny);
+void save_board(const Board& board, const unsigned int nx, const unsigned int ny,
+                const char* file = FINALSTATEFILE);
+
+void load_board(PackedBoard& board, const char* file, const unsigned int nx, const unsigned int ny);
+void print_board(const PackedBoard& board, const unsigned int nx, const unsigned int ny);
+void save_board(const PackedBoard& board, const unsigned int nx, const unsigned int ny,
+                const char* file = FINALSTATEFILE);
+
+/*************************************************************************************
+ * The engine for hosts without an OpenCL device (host_life.cpp): the packed board,
+ * threaded over bands of rows.  threads 0 means one per hardware thread.
+ ************************************************************************************/
+#define HOST_BIRTH   0x008      // the masks of B3/S23, as BIRTH and SURVIVE
+#define HOST_SURVIVE 0x00C      // in gameoflife.cl
+
+void run_host(const char *input, unsigned int nx, unsigned int ny, unsigned int iterations,
+              unsigned int birth, unsigned int survive, unsigned int threads);
+
+// The same generations without printing or saving the board: the seconds they took
+double time_host(const char *input, unsigned int nx, unsigned int ny, unsigned int iterations,
+                 unsigned int birth, unsigned int survive, unsigned int threads);
+
+#endif
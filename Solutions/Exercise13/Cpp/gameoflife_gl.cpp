@@ -0,0 +1,272 @@
+//------------------------------------------------------------------------------
+//
+// Name:       gameoflife_gl.cpp
+//
+// Purpose:    Run Conway's game of life and show it live with OpenGL
+//
+// Usage:      ./gameoflife_gl input.dat input.params [winX winY] [--steps N] [--rule B3/S23]
+//
+//             The board never leaves the device.  The OpenCL context
+//             shares the OpenGL context (cl_khr_gl_sharing), and after
+//             every N generations (1 by default) draw_board writes the
+//             board into the GL texture the window shows, between
+//             acquiring and releasing it, up to 60 times a second.
+//
+//             Keys: space pauses, + and - change the generations drawn
+//             per frame, q quits.  The iterations in input.params are not
+//             used; the simulation runs until the window is closed.
+//
+//             Needs GLUT: make gameoflife_gl
+//
+//------------------------------------------------------------------------------
+
+#include "gameoflife.hpp"
+#include "ping_pong.hpp"
+
+#ifdef __APPLE__
+    #include <OpenGL/gl.h>
+    #include <OpenGL/OpenGL.h>
+    #include <GLUT/glut.h>
+#else
+    #include <GL/gl.h>
+    #include <GL/glx.h>
+    #include <GL/glut.h>
+#endif
+
+#include <cstring>
+
+#include "err_code.h"
+
+#define FRAME_MS (1000 / 60)
+
+// State shared by the GLUT callbacks
+static unsigned int nx, ny, bx, by;
+static unsigned int steps = 1;
+static unsigned long generation = 0;
+static bool paused = false;
+
+static GLuint texture;
+static cl::CommandQueue queue;
+static util::PingPongLaunch *life;    // accelerate_life, bound to the two boards
+static cl::Kernel draw;
+static cl::ImageGL image;
+
+static void fail(cl::Error& err)
+{
+    std::cerr << "ERROR: " << err.what() << ":\n";
+    err_code(err.err());
+    exit(EXIT_FAILURE);
+}
+
+// A context on the device which drives the current GL context
+static cl::Context gl_context(cl::Device& device)
+{
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+
+    for (unsigned int p = 0; p < platforms.size(); p++)
+    {
+#ifdef __APPLE__
+        cl_context_properties props[] = {
+            CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE,
+            (cl_context_properties)CGLGetShareGroup(CGLGetCurrentContext()),
+            0};
+        const char *sharing = "cl_APPLE_gl_sharing";
+#else
+        cl_context_properties props[] = {
+            CL_GL_CONTEXT_KHR,   (cl_context_properties)glXGetCurrentContext(),
+            CL_GLX_DISPLAY_KHR,  (cl_context_properties)glXGetCurrentDisplay(),
+            CL_CONTEXT_PLATFORM, (cl_context_properties)platforms[p](),
+            0};
+        const char *sharing = "cl_khr_gl_sharing";
+#endif
+
+        std::vector<cl::Device> devices;
+        try
+        {
+            platforms[p].getDevices(CL_DEVICE_TYPE_GPU, &devices);
+        } catch (cl::Error)
+        {
+            continue;
+        }
+
+        // Only the device behind the GL context will take the properties
+        for (unsigned int d = 0; d < devices.size(); d++)
+        {
+            if (devices[d].getInfo<CL_DEVICE_EXTENSIONS>().find(sharing) == std::string::npos)
+                continue;
+            try
+            {
+                cl::Context context(std::vector<cl::Device>(1, devices[d]), props);
+                device = devices[d];
+                return context;
+            } catch (cl::Error)
+            {
+            }
+        }
+    }
+    throw cl::Error(CL_INVALID_CONTEXT, "gl_context (no OpenCL device can share the OpenGL context)");
+}
+
+static void display(void)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // Row 0 of the board at the top, as in the Displayer
+    glBegin(GL_QUADS);
+        glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, -1.0);
+        glTexCoord2f(0.0, 0.0); glVertex2f(-1.0,  1.0);
+        glTexCoord2f(1.0, 0.0); glVertex2f( 1.0,  1.0);
+        glTexCoord2f(1.0, 1.0); glVertex2f( 1.0, -1.0);
+    glEnd();
+    glFlush();
+    glDisable(GL_TEXTURE_2D);
+}
+
+// Run the next generations and draw the board into the texture
+static void frame(int)
+{
+    try
+    {
+        cl::NDRange local(bx, by);
+        cl::NDRange global((nx + bx - 1) / bx * bx, (ny + by - 1) / by * by);
+
+        for (unsigned int s = 0; !paused && s < steps; s++)
+        {
+            life->enqueue(queue, global, local);
+            generation++;
+        }
+
+        // GL must be done with the texture before OpenCL takes it
+        glFinish();
+        std::vector<cl::Memory> shared(1, image);
+        queue.enqueueAcquireGLObjects(&shared);
+        draw.setArg(0, life->input());
+        draw.setArg(1, nx);
+        draw.setArg(2, image);
+        queue.enqueueNDRangeKernel(draw, cl::NullRange, cl::NDRange(nx, ny));
+        queue.enqueueReleaseGLObjects(&shared);
+        queue.finish();
+    } catch (cl::Error err)
+    {
+        fail(err);
+    }
+
+    char title[64];
+    sprintf(title, "Game of Life: generation %lu%s", generation, paused ? " (paused)" : "");
+    glutSetWindowTitle(title);
+
+    glutPostRedisplay();
+    glutTimerFunc(FRAME_MS, frame, 0);
+}
+
+static void press(unsigned char key, int, int)
+{
+    switch (key)
+    {
+        case ' ':
+            paused = !paused;
+            break;
+        case '+':
+            steps *= 2;
+            break;
+        case '-':
+            steps = std::max(steps / 2, 1u);
+            break;
+        case 'q':
+            exit(EXIT_SUCCESS);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage:\n./gameoflife_gl input.dat input.params [winX winY] [--steps N] [--rule B3/S23]\n");
+        printf("\tinput.dat\tpattern file: x y 1 lines, RLE, or a snapshot file\n");
+        printf("\tinput.params\tparameter file defining board size\n");
+        printf("\twinX winY\tsize of the window (default 800 800)\n");
+        printf("\t--steps N\tgenerations run per frame\n");
+        printf("\t--rule B3/S23\tthe rule, as a B/S rulestring\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned int iterations;
+    load_params(argv[2], &nx, &ny, &iterations);
+
+    unsigned int winX = 800, winY = 800;
+    std::string options;
+    int i = 3;
+    if (argc > 4 && argv[3][0] != '-')
+    {
+        winX = atoi(argv[3]);
+        winY = atoi(argv[4]);
+        i = 5;
+    }
+    for (; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--steps") && i + 1 < argc)
+            steps = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--rule") && i + 1 < argc)
+            options = rule_options(argv[++i]);
+    }
+
+    // The GL context must exist before an OpenCL context can share it
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
+    glutInitWindowSize(winX, winY);
+    glutCreateWindow("Game of Life");
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+
+    // The texture the board is drawn into; RGBA8 is a format every
+    // device can share
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, nx, ny, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glFinish();
+
+    try
+    {
+        cl::Device device;
+        cl::Context context = gl_context(device);
+        queue = cl::CommandQueue(context, device);
+
+        std::string name = device.getInfo<CL_DEVICE_NAME>();
+        std::cout << "Using OpenCL device: " << name << "\n";
+
+        cl::Program program = util::buildProgramFile(context, device, "../gameoflife.cl", options);
+        life = new util::PingPongLaunch(program, "accelerate_life");
+        draw = cl::Kernel(program, "draw_board");
+        choose_block(life->kernel(), device, nx, ny, &bx, &by);
+
+        // Load in the starting state and copy to device
+        Board h_board(nx * ny, DEAD);
+        load_board(h_board, argv[1], nx, ny);
+        cl::Buffer d_board_tick(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+        cl::Buffer d_board_tock(context, CL_MEM_READ_WRITE, sizeof(char) * nx * ny);
+        queue.enqueueWriteBuffer(d_board_tick, CL_TRUE, 0, sizeof(char) * nx * ny, &h_board[0]);
+
+        life->swap(0, 1, d_board_tick, d_board_tock);
+        life->setArg(2, nx);
+        life->setArg(3, ny);
+        life->setArg(4, cl::Local(sizeof(char) * (bx + 2) * (by + 2)));
+
+        image = cl::ImageGL(context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, texture);
+    } catch (cl::Error err)
+    {
+        fail(err);
+    }
+
+    glutDisplayFunc(display);
+    glutKeyboardFunc(press);
+    glutTimerFunc(0, frame, 0);
+    glutMainLoop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+//------------------------------------------------------------------------------
+//
+// Name:       host_life.cpp
+//
+// Purpose:    The game of life on the host, for machines with no OpenCL
+//             device (or with --host)
+//
+//             The board is bit-packed as for accelerate_life_packed, and
+//             a generation is worked out the same way: the 8 neighbours
+//             of the 32 cells of a word by shifting the words of the rows
+//             above, at and below, counted with a bit-sliced adder.  Away
+//             from the ends of a row there are no branches, so the
+//             compiler vectorises the loop over words, and each
+//             instruction then updates 32 cells a lane.
+//
+//             The rows are shared out in bands, one to a thread, and the
+//             threads meet at a barrier after each generation.  A band is
+//             worked through in strips of HOST_STRIP words, so the three
+//             rows of the strip being read stay in the L1 cache as the
+//             strip moves down the band.
+//
+//------------------------------------------------------------------------------
+
+#include "gameoflife.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define HOST_STRIP 256     // words of a row updated at a time (1 KB)
+
+namespace {
+
+// The threads wait here until all of them have finished a generation
+class Barrier
+{
+public:
+    explicit Barrier(unsigned int count) : count_(count), waiting_(0), phase_(0) {}
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const unsigned long phase = phase_;
+        if (++waiting_ == count_)
+        {
+            waiting_ = 0;
+            phase_++;
+            done_.notify_all();
+        }
+        else
+            done_.wait(lock, [&] { return phase_ != phase; });
+    }
+
+private:
+    std::mutex              mutex_;
+    std::condition_variable done_;
+    unsigned int            count_, waiting_;
+    unsigned long           phase_;
+};
+
+// The rule as a mask for each number of neighbours: all ones where n
+// neighbours give a birth, or let a cell survive
+struct Rule
+{
+    bool    conway;
+    cl_uint born[9], keep[9];
+};
+
+// Add the bits of x into the count kept in the bit planes s0 to s3
+inline void add_neighbours(const cl_uint x, cl_uint& s0, cl_uint& s1, cl_uint& s2, cl_uint& s3)
+{
+    cl_uint c0 = s0 & x;
+    s0 ^= x;
+    cl_uint c1 = s1 & c0;
+    s1 ^= c0;
+    cl_uint c2 = s2 & c1;
+    s2 ^= c1;
+    s3 |= c2;
+}
+
+// The next state of a word from its 8 neighbour words, shifted into line
+inline cl_uint next_word(const Rule& rule, const cl_uint alive,
+                         const cl_uint nw, const cl_uint n, const cl_uint ne,
+                         const cl_uint w, const cl_uint e,
+                         const cl_uint sw, const cl_uint s, const cl_uint se)
+{
+    cl_uint s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    add_neighbours(nw, s0, s1, s2, s3);
+    add_neighbours(n,  s0, s1, s2, s3);
+    add_neighbours(ne, s0, s1, s2, s3);
+    add_neighbours(w,  s0, s1, s2, s3);
+    add_neighbours(e,  s0, s1, s2, s3);
+    add_neighbours(sw, s0, s1, s2, s3);
+    add_neighbours(s,  s0, s1, s2, s3);
+    add_neighbours(se, s0, s1, s2, s3);
+
+    // B3/S23: 3 neighbours, or 2 and alive now
+    if (rule.conway)
+        return s1 & ~s2 & ~s3 & (s0 | alive);
+
+    cl_uint next = 0;
+    for (int count = 0; count <= 8; count++)
+    {
+        cl_uint is = ((count & 1) ? s0 : ~s0) & ((count & 2) ? s1 : ~s1) &
+                     ((count & 4) ? s2 : ~s2) & ((count & 8) ? s3 : ~s3);
+        next |= is & ((rule.born[count] & ~alive) | (rule.keep[count] & alive));
+    }
+    return next;
+}
+
+// Word w of row shifted so each bit holds its west (x - 1) or east
+// (x + 1) neighbour, wrapping round the torus
+inline cl_uint west(const cl_uint* row, unsigned int w, unsigned int nwords, unsigned int last_bits)
+{
+    cl_uint carry = (w == 0) ? row[nwords - 1] >> (last_bits - 1) : row[w - 1] >> 31;
+    return (row[w] << 1) | (carry & 1);
+}
+
+inline cl_uint east(const cl_uint* row, unsigned int w, unsigned int nwords, unsigned int last_bits)
+{
+    if (w == nwords - 1)
+        return (row[w] >> 1) | ((row[0] & 1) << (last_bits - 1));
+    return (row[w] >> 1) | (row[w + 1] << 31);
+}
+
+// Update the words w0 to w1 - 1 of row y
+void update_row(const Rule& rule, const cl_uint* tick, cl_uint* tock,
+                unsigned int ny, unsigned int nwords, unsigned int last_bits,
+                unsigned int y, unsigned int w0, unsigned int w1)
+{
+    const cl_uint* up = tick + ((y == 0) ? ny - 1 : y - 1) * nwords;
+    const cl_uint* at = tick + y * nwords;
+    const cl_uint* dn = tick + ((y + 1) % ny) * nwords;
+    cl_uint* out = tock + y * nwords;
+
+    // The words at the ends of the row, which wrap
+    for (unsigned int w = w0; w < w1; w++)
+    {
+        if (w != 0 && w != nwords - 1)
+            continue;
+        out[w] = next_word(rule, at[w],
+                           west(up, w, nwords, last_bits), up[w], east(up, w, nwords, last_bits),
+                           west(at, w, nwords, last_bits),        east(at, w, nwords, last_bits),
+                           west(dn, w, nwords, last_bits), dn[w], east(dn, w, nwords, last_bits));
+    }
+
+    // The rest, without a branch
+    const unsigned int lo = std::max(w0, 1u), hi = std::min(w1, nwords - 1);
+    for (unsigned int w = lo; w < hi; w++)
+        out[w] = next_word(rule, at[w],
+                           (up[w] << 1) | (up[w - 1] >> 31), up[w], (up[w] >> 1) | (up[w + 1] << 31),
+                           (at[w] << 1) | (at[w - 1] >> 31),        (at[w] >> 1) | (at[w + 1] << 31),
+                           (dn[w] << 1) | (dn[w - 1] >> 31), dn[w], (dn[w] >> 1) | (dn[w + 1] << 31));
+
+    // Keep the bits past the end of the row clear
+    if (w1 == nwords && last_bits < 32)
+        out[nwords - 1] &= (1u << last_bits) - 1;
+}
+
+// One thread's share: rows y0 to y1 - 1 of every generation
+void run_band(const Rule& rule, cl_uint* tick, cl_uint* tock,
+              unsigned int ny, unsigned int nwords, unsigned int last_bits,
+              unsigned int y0, unsigned int y1, unsigned int iterations, Barrier& barrier)
+{
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        for (unsigned int w0 = 0; w0 < nwords; w0 += HOST_STRIP)
+        {
+            const unsigned int w1 = std::min(w0 + HOST_STRIP, nwords);
+            for (unsigned int y = y0; y < y1; y++)
+                update_row(rule, tick, tock, ny, nwords, last_bits, y, w0, w1);
+        }
+
+        barrier.wait();
+        std::swap(tick, tock);
+    }
+}
+
+Rule make_rule(unsigned int birth, unsigned int survive)
+{
+    Rule rule;
+    rule.conway = birth == HOST_BIRTH && survive == HOST_SURVIVE;
+    for (int count = 0; count <= 8; count++)
+    {
+        rule.born[count] = ((birth >> count) & 1) ? ~0u : 0u;
+        rule.keep[count] = ((survive >> count) & 1) ? ~0u : 0u;
+    }
+    return rule;
+}
+
+// Run iterations generations from tick over threads bands, returning the
+// seconds taken.  The last generation is in tock if there were an odd number.
+double run_threads(const Rule& rule, PackedBoard& tick, PackedBoard& tock,
+                   unsigned int nx, unsigned int ny, unsigned int iterations,
+                   unsigned int threads)
+{
+    const unsigned int nwords = packed_words(nx);
+    const unsigned int last_bits = nx - (nwords - 1) * CELLS_PER_WORD;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, ny);
+    const unsigned int band = (ny + threads - 1) / threads;
+    threads = (ny + band - 1) / band;
+    printf("Host engine: %u threads, bands of %u rows\n", threads, band);
+
+    util::Timer timer;
+
+    // This thread takes the first band
+    Barrier barrier(threads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; t++)
+        workers.push_back(std::thread(run_band, std::cref(rule), &tick[0], &tock[0], ny, nwords,
+                                      last_bits, t * band, std::min((t + 1) * band, ny),
+                                      iterations, std::ref(barrier)));
+    run_band(rule, &tick[0], &tock[0], ny, nwords, last_bits, 0, std::min(band, ny),
+             iterations, barrier);
+    for (unsigned int t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    return timer.getTimeMicroseconds() / 1.0e6;
+}
+
+} // namespace
+
+/*************************************************************************************
+ * Simulation on the host
+ ************************************************************************************/
+void run_host(const char *input, unsigned int nx, unsigned int ny, unsigned int iterations,
+              unsigned int birth, unsigned int survive, unsigned int threads)
+{
+    const unsigned int nwords = packed_words(nx);
+
+    // Ordinary memory: with no context the allocator uses the heap
+    PackedBoard tick(nwords * ny, 0), tock(nwords * ny, 0);
+    load_board(tick, input, nx, ny);
+
+    std::cout << "Starting state\n";
+    print_board(tick, nx, ny);
+
+    double rtime = run_threads(make_rule(birth, survive), tick, tock, nx, ny, iterations, threads);
+    printf("%u generations in %.6f seconds, %.1f million cells a second\n", iterations, rtime,
+           rtime > 0.0 ? (double)nx * ny * iterations / (1.0e6 * rtime) : 0.0);
+
+    // The last generation was written to tock if there were an odd number
+    PackedBoard& board = (iterations % 2) ? tock : tick;
+
+    std::cout << "Finishing state\n";
+    print_board(board, nx, ny);
+
+    save_board(board, nx, ny);
+}
+
+/*************************************************************************************
+ * The host engine timed, with nothing printed or saved
+ ************************************************************************************/
+double time_host(const char *input, unsigned int nx, unsigned int ny, unsigned int iterations,
+                 unsigned int birth, unsigned int survive, unsigned int threads)
+{
+    PackedBoard tick(packed_words(nx) * ny, 0), tock(packed_words(nx) * ny, 0);
+    load_board(tick, input, nx, ny);
+    return run_threads(make_rule(birth, survive), tick, tock, nx, ny, iterations, threads);
+}
+
+
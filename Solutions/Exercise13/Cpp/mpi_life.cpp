@@ -0,0 +1,406 @@
+//------------------------------------------------------------------------------
+//
+// Name:       mpi_life.cpp
+//
+// Purpose:    Run the game of life over MPI ranks, each rank driving one
+//             OpenCL device
+//
+// Usage:      mpirun -np P ./mpi_life input.dat input.params [--rule B3/S23] [--device INDEX]
+//
+//             The ranks form a Pr x Pc grid (MPI_Dims_create) that wraps
+//             round both ways, as the board does, and the board is cut
+//             into Pr x Pc tiles: rank (r,c) holds tile (r,c).  Each
+//             tile is kept on its device with a ring of ghost cells, the
+//             edge cells of the eight tiles round it.  A generation:
+//
+//               1. reads the tile's edge cells (its first and last rows
+//                  and columns) back to the host;
+//               2. launches accelerate_life_region over the inside of
+//                  the tile, which needs no ghost cells;
+//               3. meanwhile swaps the edges with the neighbours by
+//                  non-blocking MPI, the columns across the process row
+//                  and then the rows, with the corners from the columns
+//                  on their ends, down the process column, so the
+//                  diagonal neighbours need no messages of their own;
+//               4. writes the ghost cells into the tile and updates its
+//                  four edges.
+//
+//             The queue is in order, so the edge updates run after the
+//             inside and the ghost cells only change once the inside
+//             has been read.
+//
+//             Each rank loads the whole starting state and keeps its
+//             tile, so the board must fit in each rank's memory once.
+//             The final state is written to final_state.dat as by
+//             gameoflife, the live cells as x y 1 lines in row order,
+//             with MPI-IO: each rank formats the lines of its tile, a
+//             prefix sum of the lengths gives each row of each tile its
+//             place in the file, and one collective write puts them
+//             there.
+//
+//             --device picks the same device on every rank; without it
+//             each rank takes device (local rank mod devices), where the
+//             local rank counts the ranks on its node.  "make mpi_life"
+//             builds it with MPICXX (default mpicxx).
+//
+//------------------------------------------------------------------------------
+
+#include <mpi.h>
+
+#include "gameoflife.hpp"
+
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include "err_code.h"
+#include "device_picker.hpp"
+
+// The sides of a tile
+enum { LEFT, RIGHT, TOP, BOTTOM };
+
+// The message tags, by the way the cells are going
+enum { TAG_LEFTWARD, TAG_RIGHTWARD, TAG_UPWARD, TAG_DOWNWARD };
+
+// The first index of part p of n split into parts (the first n % parts
+// one larger)
+static unsigned int split_start(unsigned int n, unsigned int parts, unsigned int p)
+{
+    return p * (n / parts) + std::min(p, n % parts);
+}
+
+// One rank's tile of the board: lx by ly cells from (x0, y0), stored
+// with a ring of ghost cells, pitch = lx + 2 cells a row
+struct Tile
+{
+    unsigned int x0, y0, lx, ly, pitch;
+    int left, right, up, down;      // the neighbouring ranks, round the torus
+    cl::Context context;
+    cl::CommandQueue queue;
+    cl::Kernel kernel;
+    cl::Buffer tick, tock;
+    std::vector<char> out[4];       // edge cells going out, by side
+    std::vector<char> in[4];        // ghost cells coming in, by side
+
+    Tile(const cl::Device& device, const std::string& options,
+         unsigned int x0, unsigned int y0, unsigned int lx, unsigned int ly)
+        : x0(x0), y0(y0), lx(lx), ly(ly), pitch(lx + 2),
+          context(std::vector<cl::Device>(1, device)),
+          queue(context, device)
+    {
+        cl::Program program = util::buildProgramFile(context, device, "../gameoflife.cl", options);
+        kernel = cl::Kernel(program, "accelerate_life_region");
+        tick = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(char) * pitch * (ly + 2));
+        tock = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(char) * pitch * (ly + 2));
+
+        // The columns are ly cells, the rows pitch: they carry the corners
+        for (int s = LEFT; s <= RIGHT; s++)
+        {
+            out[s].assign(ly, DEAD);
+            in[s].assign(ly, DEAD);
+        }
+        for (int s = TOP; s <= BOTTOM; s++)
+        {
+            out[s].assign(pitch, DEAD);
+            in[s].assign(pitch, DEAD);
+        }
+    }
+
+    // Update w by h cells of tock from (x, y) in the tile, if there are any
+    void update(unsigned int x, unsigned int y, int w, int h)
+    {
+        if (w <= 0 || h <= 0)
+            return;
+        kernel.setArg(0, tick);
+        kernel.setArg(1, tock);
+        kernel.setArg(2, pitch);
+        kernel.setArg(3, x);
+        kernel.setArg(4, y);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(w, h), cl::NullRange);
+    }
+
+    // Copy column x of the tile, rows 1 to ly, to or from the host
+    void column(unsigned int x, std::vector<char>& cells, bool read, cl::Event *event = NULL)
+    {
+        cl::size_t<3> origin, host, region;
+        origin[0] = x;
+        origin[1] = 1;
+        origin[2] = host[0] = host[1] = host[2] = 0;
+        region[0] = 1;
+        region[1] = ly;
+        region[2] = 1;
+        if (read)
+            queue.enqueueReadBufferRect(tick, CL_FALSE, origin, host, region, pitch, 0, 1, 0,
+                                        &cells[0], NULL, event);
+        else
+            queue.enqueueWriteBufferRect(tick, CL_FALSE, origin, host, region, pitch, 0, 1, 0,
+                                         &cells[0], NULL, event);
+    }
+
+    void swap()
+    {
+        cl::Buffer tmp = tick;
+        tick = tock;
+        tock = tmp;
+    }
+};
+
+// Swap the edge cells with the neighbours: the columns first, and then
+// the rows, whose ends carry the ghost cells of the columns on to the
+// diagonal neighbours.  A neighbour may be this rank, or be on both
+// sides, so the messages are told apart by their tags.
+static void exchange(Tile& t, MPI_Comm grid)
+{
+    MPI_Request requests[4];
+    MPI_Irecv(&t.in[LEFT][0], t.ly, MPI_CHAR, t.left, TAG_RIGHTWARD, grid, &requests[0]);
+    MPI_Irecv(&t.in[RIGHT][0], t.ly, MPI_CHAR, t.right, TAG_LEFTWARD, grid, &requests[1]);
+    MPI_Isend(&t.out[LEFT][0], t.ly, MPI_CHAR, t.left, TAG_LEFTWARD, grid, &requests[2]);
+    MPI_Isend(&t.out[RIGHT][0], t.ly, MPI_CHAR, t.right, TAG_RIGHTWARD, grid, &requests[3]);
+    MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+
+    t.out[TOP][0] = t.in[LEFT][0];
+    t.out[TOP][t.lx + 1] = t.in[RIGHT][0];
+    t.out[BOTTOM][0] = t.in[LEFT][t.ly - 1];
+    t.out[BOTTOM][t.lx + 1] = t.in[RIGHT][t.ly - 1];
+
+    MPI_Irecv(&t.in[TOP][0], t.pitch, MPI_CHAR, t.up, TAG_DOWNWARD, grid, &requests[0]);
+    MPI_Irecv(&t.in[BOTTOM][0], t.pitch, MPI_CHAR, t.down, TAG_UPWARD, grid, &requests[1]);
+    MPI_Isend(&t.out[TOP][0], t.pitch, MPI_CHAR, t.up, TAG_UPWARD, grid, &requests[2]);
+    MPI_Isend(&t.out[BOTTOM][0], t.pitch, MPI_CHAR, t.down, TAG_DOWNWARD, grid, &requests[3]);
+    MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+}
+
+// One generation of the tile
+static void generation(Tile& t, MPI_Comm grid)
+{
+    const int lx = t.lx, ly = t.ly;
+
+    // The edge cells, before the inside is updated
+    cl::Event edges_read;
+    t.column(1, t.out[LEFT], true);
+    t.column(lx, t.out[RIGHT], true);
+    t.queue.enqueueReadBuffer(t.tick, CL_FALSE, t.pitch + 1, lx, &t.out[TOP][1]);
+    t.queue.enqueueReadBuffer(t.tick, CL_FALSE, ly * t.pitch + 1, lx, &t.out[BOTTOM][1],
+                              NULL, &edges_read);
+    t.update(2, 2, lx - 2, ly - 2);
+    t.queue.flush();
+
+    // The inside runs while the edges go round
+    edges_read.wait();
+    exchange(t, grid);
+
+    t.column(0, t.in[LEFT], false);
+    t.column(lx + 1, t.in[RIGHT], false);
+    t.queue.enqueueWriteBuffer(t.tick, CL_FALSE, 0, t.pitch, &t.in[TOP][0]);
+    t.queue.enqueueWriteBuffer(t.tick, CL_FALSE, (ly + 1) * t.pitch, t.pitch, &t.in[BOTTOM][0]);
+
+    // The top and bottom rows, and the columns between them
+    t.update(1, 1, lx, 1);
+    if (ly > 1)
+        t.update(1, ly, lx, 1);
+    t.update(1, 2, 1, ly - 2);
+    if (lx > 1)
+        t.update(lx, 2, 1, ly - 2);
+    t.queue.flush();
+    t.swap();
+}
+
+// Write the live cells of every tile to file, as save_board does for a
+// whole board: row by row, and along each row tile by tile
+static void save_tiles(const Tile& t, const std::vector<char>& cells,
+                       MPI_Comm grid, MPI_Comm row_comm, MPI_Comm col_comm, const char *file)
+{
+    // This tile's lines, and their length in each row
+    std::string text;
+    std::vector<long long> bytes(t.ly), before(t.ly, 0), totals(t.ly);
+    char line[64];
+    for (unsigned int y = 0; y < t.ly; y++)
+    {
+        const size_t start = text.size();
+        for (unsigned int x = 0; x < t.lx; x++)
+        {
+            if (cells[(y + 1) * t.pitch + x + 1] == ALIVE)
+            {
+                sprintf(line, "%d %d %d\n", t.x0 + x, t.y0 + y, ALIVE);
+                text += line;
+            }
+        }
+        bytes[y] = text.size() - start;
+    }
+
+    // In each row of the file, this tile's lines come after those of the
+    // tiles to its left; the rows of a band of tiles come after those of
+    // the bands above it
+    int row_rank, col_rank;
+    MPI_Comm_rank(row_comm, &row_rank);
+    MPI_Comm_rank(col_comm, &col_rank);
+    MPI_Exscan(&bytes[0], &before[0], t.ly, MPI_LONG_LONG, MPI_SUM, row_comm);
+    if (row_rank == 0)
+        std::fill(before.begin(), before.end(), 0);
+    MPI_Allreduce(&bytes[0], &totals[0], t.ly, MPI_LONG_LONG, MPI_SUM, row_comm);
+
+    long long band = 0, band_start = 0;
+    for (unsigned int y = 0; y < t.ly; y++)
+        band += totals[y];
+    MPI_Exscan(&band, &band_start, 1, MPI_LONG_LONG, MPI_SUM, col_comm);
+    if (col_rank == 0)
+        band_start = 0;
+
+    std::vector<int> lengths(t.ly);
+    std::vector<MPI_Aint> places(t.ly);
+    long long row_start = band_start;
+    for (unsigned int y = 0; y < t.ly; y++)
+    {
+        lengths[y] = (int)bytes[y];
+        places[y] = (MPI_Aint)(row_start + before[y]);
+        row_start += totals[y];
+    }
+
+    MPI_Datatype view;
+    MPI_Type_create_hindexed(t.ly, &lengths[0], &places[0], MPI_CHAR, &view);
+    MPI_Type_commit(&view);
+
+    MPI_File fh;
+    if (MPI_File_open(grid, const_cast<char*>(file), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        die("Could not open final state file.", __LINE__, __FILE__);
+    MPI_File_set_size(fh, 0);
+    MPI_File_set_view(fh, 0, MPI_CHAR, view, const_cast<char*>("native"), MPI_INFO_NULL);
+    MPI_File_write_all(fh, text.empty() ? NULL : &text[0], (int)text.size(), MPI_CHAR,
+                       MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    MPI_Type_free(&view);
+}
+
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+
+    int world_rank, world_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+    if (argc < 3)
+    {
+        if (world_rank == 0)
+        {
+            printf("Usage:\nmpirun -np P ./mpi_life input.dat input.params [--rule B3/S23] [--device INDEX]\n");
+            printf("\tinput.dat\tpattern file: x y 1 lines, RLE, or a snapshot file\n");
+            printf("\tinput.params\tparameter file defining board size\n");
+            printf("\t--rule B3/S23\tthe rule, as a B/S rulestring\n");
+            printf("\t--device INDEX\tthe device of every rank (default: one a rank on each node)\n");
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        cl_uint deviceIndex = UINT_MAX;
+        parseArguments(argc, argv, &deviceIndex);
+
+        std::string options;
+        for (int i = 3; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--rule") && i + 1 < argc)
+                options = rule_options(argv[++i]);
+        }
+
+        unsigned int nx, ny, iterations;
+        load_params(argv[2], &nx, &ny, &iterations);
+
+        // The process grid, round the torus both ways
+        int dims[2] = { 0, 0 }, periods[2] = { 1, 1 };
+        MPI_Dims_create(world_size, 2, dims);
+        const int pr = dims[0], pc = dims[1];
+        if (nx < (unsigned int)pc || ny < (unsigned int)pr)
+        {
+            if (world_rank == 0)
+                std::cout << "The board is too small for a " << pr << " x " << pc << " grid of ranks\n";
+            MPI_Finalize();
+            return EXIT_FAILURE;
+        }
+
+        MPI_Comm grid, row_comm, col_comm;
+        MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+        int rank, coords[2];
+        MPI_Comm_rank(grid, &rank);
+        MPI_Cart_coords(grid, rank, 2, coords);
+        const int myrow = coords[0], mycol = coords[1];
+
+        // Ranks along this rank's process row, and down its column
+        int keep_cols[2] = { 0, 1 }, keep_rows[2] = { 1, 0 };
+        MPI_Cart_sub(grid, keep_cols, &row_comm);
+        MPI_Cart_sub(grid, keep_rows, &col_comm);
+
+        // One device a rank, shared out among the ranks of a node
+        MPI_Comm node;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank, MPI_INFO_NULL, &node);
+        int local_rank;
+        MPI_Comm_rank(node, &local_rank);
+
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+        if (numDevices == 0 || (deviceIndex != UINT_MAX && deviceIndex >= numDevices))
+        {
+            std::cout << "Rank " << rank << ": no device " << deviceIndex << " (try '--list')\n";
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        if (deviceIndex == UINT_MAX)
+            deviceIndex = local_rank % numDevices;
+        cl::Device device = devices[deviceIndex];
+
+        // This rank's tile
+        const unsigned int y0 = split_start(ny, pr, myrow), y1 = split_start(ny, pr, myrow + 1);
+        const unsigned int x0 = split_start(nx, pc, mycol), x1 = split_start(nx, pc, mycol + 1);
+
+        std::string name;
+        getDeviceName(device, name);
+        printf(" Rank %d (%d,%d of %dx%d): cells %u to %u by %u to %u on %s\n",
+               rank, myrow, mycol, pr, pc, x0, x1 - 1, y0, y1 - 1, name.c_str());
+
+        Tile tile(device, options, x0, y0, x1 - x0, y1 - y0);
+        MPI_Cart_shift(grid, 1, 1, &tile.left, &tile.right);
+        MPI_Cart_shift(grid, 0, 1, &tile.up, &tile.down);
+
+        // The whole starting state, of which this rank keeps its tile
+        std::vector<char> cells(tile.pitch * (tile.ly + 2), DEAD);
+        {
+            Board h_board(nx * ny, DEAD);
+            load_board(h_board, argv[1], nx, ny);
+            for (unsigned int y = 0; y < tile.ly; y++)
+                memcpy(&cells[(y + 1) * tile.pitch + 1], &h_board[(y0 + y) * nx + x0], tile.lx);
+        }
+        tile.queue.enqueueWriteBuffer(tile.tick, CL_TRUE, 0, cells.size(), &cells[0]);
+
+        MPI_Barrier(grid);
+        double start_time = MPI_Wtime();
+
+        for (unsigned int i = 0; i < iterations; i++)
+            generation(tile, grid);
+
+        tile.queue.enqueueReadBuffer(tile.tick, CL_TRUE, 0, cells.size(), &cells[0]);
+
+        double local_time = MPI_Wtime() - start_time, run_time;
+        MPI_Reduce(&local_time, &run_time, 1, MPI_DOUBLE, MPI_MAX, 0, grid);
+        if (rank == 0)
+            printf("%u generations over %d ranks (%dx%d) in %.3f seconds\n",
+                   iterations, world_size, pr, pc, run_time);
+
+        // Save the final state of the board
+        save_tiles(tile, cells, grid, row_comm, col_comm, FINALSTATEFILE);
+
+        MPI_Comm_free(&node);
+        MPI_Comm_free(&row_comm);
+        MPI_Comm_free(&col_comm);
+        MPI_Comm_free(&grid);
+    } catch (cl::Error err)
+    {
+        std::cerr << "ERROR: rank " << world_rank << ": " << err.what() << ":\n";
+        err_code(err.err());
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
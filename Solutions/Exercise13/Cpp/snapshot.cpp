@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+//
+// Name:       snapshot.cpp
+//
+// Purpose:    Writer thread for the board snapshots (see snapshot.hpp)
+//
+//------------------------------------------------------------------------------
+
+#include "snapshot.hpp"
+
+static void put_u32(std::vector<unsigned char>& out, cl_uint value)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+static void put_varint(std::vector<unsigned char>& out, cl_uint value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+SnapshotWriter::SnapshotWriter(cl::Context& context, cl::CommandQueue& queue, const char *file,
+                               unsigned int nx, unsigned int ny, unsigned int slots)
+    : queue_(queue), nx_(nx), ny_(ny), done_(false)
+{
+    fp_ = fopen(file, "wb");
+    if (!fp_)
+        die("Could not open snapshot file.", __LINE__, __FILE__);
+
+    std::vector<unsigned char> header;
+    header.push_back('G');
+    header.push_back('O');
+    header.push_back('L');
+    header.push_back('S');
+    put_u32(header, nx);
+    put_u32(header, ny);
+    fwrite(&header[0], 1, header.size(), fp_);
+
+    util::PinnedAllocator<char> pinned(context, queue);
+    for (unsigned int s = 0; s < std::max(slots, 1u); s++)
+    {
+        staging_.push_back(Board(nx * ny, DEAD, pinned));
+        free_.push_back(s);
+    }
+
+    writer_ = std::thread(&SnapshotWriter::write_frames, this);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    finish();
+}
+
+void SnapshotWriter::capture(const cl::Buffer& board, unsigned int generation)
+{
+    Frame frame;
+    frame.generation = generation;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (free_.empty())
+            freed_.wait(lock);
+        frame.slot = free_.back();
+        free_.pop_back();
+    }
+
+    queue_.enqueueReadBuffer(board, CL_FALSE, 0, sizeof(char) * nx_ * ny_,
+                             &staging_[frame.slot][0], NULL, &frame.read);
+    queue_.flush();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.push_back(frame);
+    ready_.notify_one();
+}
+
+void SnapshotWriter::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        ready_.notify_one();
+    }
+    if (writer_.joinable())
+        writer_.join();
+    if (fp_)
+    {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+}
+
+void SnapshotWriter::write_frames()
+{
+    std::vector<unsigned char> out;
+    for (;;)
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (frames_.empty() && !done_)
+                ready_.wait(lock);
+            if (frames_.empty())
+                return;
+            frame = frames_.front();
+            frames_.pop_front();
+        }
+
+        frame.read.wait();
+
+        out.clear();
+        put_u32(out, frame.generation);
+        put_u32(out, 0);
+        encode(staging_[frame.slot], out);
+        cl_uint cells = (cl_uint)(out.size() - 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)(cells >> (8 * i));
+        fwrite(&out[0], 1, out.size(), fp_);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(frame.slot);
+        freed_.notify_one();
+    }
+}
+
+// Runs of dead and live cells, starting with dead
+void SnapshotWriter::encode(const Board& board, std::vector<unsigned char>& out) const
+{
+    const ::size_t ncells = (::size_t)nx_ * ny_;
+    char state = DEAD;
+    ::size_t start = 0;
+    for (::size_t i = 0; i <= ncells; i++)
+    {
+        if (i == ncells || board[i] != state)
+        {
+            put_varint(out, (cl_uint)(i - start));
+            start = i;
+            state = (state == DEAD) ? ALIVE : DEAD;
+        }
+    }
+}
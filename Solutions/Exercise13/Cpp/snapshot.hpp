@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+//
+// Name:       snapshot.hpp
+//
+// Purpose:    Write the board every few generations without holding up
+//             the simulation
+//
+// Usage:      SnapshotWriter snapshots(context, queue, "frames.gol", nx, ny);
+//             ...
+//             snapshots.capture(d_board_tick, generation);
+//             ...
+//             snapshots.finish();
+//
+//             capture() enqueues a non-blocking read of the board into one
+//             of a few pinned staging boards and returns at once; a writer
+//             thread waits for the read, encodes the board and writes it.
+//             The host only waits when every staging board is still
+//             queued for writing.
+//
+//             The file is a header of the four bytes "GOLS" then nx and ny,
+//             and then a frame per capture: the generation, the length in
+//             bytes of the cells, and the cells.  The cells are the runs of
+//             dead and live cells, in row order and starting with a run of
+//             dead cells (which may be empty), each length a little-endian
+//             base 128 varint.  Numbers in the header and frames are 32 bit
+//             little-endian.
+//
+//------------------------------------------------------------------------------
+
+#ifndef __SNAPSHOT_HDR
+#define __SNAPSHOT_HDR
+
+#include "gameoflife.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <deque>
+
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(cl::Context& context, cl::CommandQueue& queue, const char *file,
+                   unsigned int nx, unsigned int ny, unsigned int slots = 3);
+    ~SnapshotWriter();
+
+    //! Queue a copy of board, as it is after generation, for writing
+    void capture(const cl::Buffer& board, unsigned int generation);
+
+    //! Write every frame captured so far, and close the file
+    void finish();
+
+private:
+    struct Frame
+    {
+        unsigned int slot;
+        unsigned int generation;
+        cl::Event read;
+    };
+
+    cl::CommandQueue queue_;
+    unsigned int nx_, ny_;
+    FILE *fp_;
+
+    std::vector<Board> staging_;
+    std::vector<unsigned int> free_;    // staging boards not waiting to be written
+    std::deque<Frame> frames_;          // captured, not yet written
+    bool done_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;     // a frame was captured, or done_ set
+    std::condition_variable freed_;     // a staging board was written
+    std::thread writer_;
+
+    void write_frames();
+    void encode(const Board& board, std::vector<unsigned char>& out) const;
+
+    SnapshotWriter(const SnapshotWriter&);
+    SnapshotWriter& operator=(const SnapshotWriter&);
+};
+
+#endif
@@ -30,7 +30,7 @@ def main():
         python gameoflife.py input.dat input.params bx by
         \tinput.dat\tpattern file
         \tinput.params\tparater file defining board size
-        \tbx by\t\tsizes of the thread blocks - must divide the board size equally
+        \tbx by\t\tsizes of the thread blocks
         '''
         sys.exit(-1)
 
@@ -62,8 +62,9 @@ def main():
     print 'Starting state'
     print_board(h_board, nx, ny)
 
-    # Set the global and local problem sizes
-    global_size = (nx, ny)
+    # Set the global and local problem sizes, the global rounded up to
+    # whole blocks; the kernel leaves off the cells past the edge
+    global_size = ((nx + bx - 1) // bx * bx, (ny + by - 1) // by * by)
     local_size = (bx, by)
 
     # Allocate local memory
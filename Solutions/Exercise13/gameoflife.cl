@@ -11,60 +11,206 @@
 #define ALIVE 1
 #define DEAD  0
 
+// The rule, as masks of neighbour counts: a dead cell with n live
+// neighbours is born if bit n of BIRTH is set, and a live one survives
+// if bit n of SURVIVE is.  The host sets them with -D from a B/S
+// rulestring; the default is Conway's B3/S23.
+#ifndef BIRTH
+#define BIRTH   0x008
+#endif
+#ifndef SURVIVE
+#define SURVIVE 0x00C
+#endif
+
+// A table of the next state by (state, count), looked up without branches
+#define RULE (BIRTH | (SURVIVE << 9))
+#define NEXT_STATE(alive, n) ((char)((RULE >> ((n) + 9 * (alive))) & 1))
+
+// Position i on a torus of n cells, for i down to -n
+inline unsigned int wrap(const int i, const unsigned int n)
+{
+    return (unsigned int)((i + (int)n) % (int)n);
+}
+
+// Load the work-group's block of the board, with a halo of one cell, into
+// local memory, and return the next state of the work-item's cell.  The
+// board need not be a whole number of work-groups: the NDRange is rounded
+// up, and work-items past the edge of the board load the cells they cover
+// on the torus, so the block is still a correct view of it.  Every
+// work-item of the group must call this, as it has a barrier.
+//
+// The whole (bx+2) x (by+2) block, halo and all, is loaded together: the
+// work-items take its cells in turn, a group's worth at a time, so each
+// pass reads runs of neighbouring cells along the rows and no cell is
+// loaded twice.
+inline void load_block(__global const char* tick, const unsigned int nx, const unsigned int ny,
+                       const unsigned int tw, const unsigned int th, const int x0, const int y0,
+                       __local char* block)
+{
+    const unsigned int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    const unsigned int nitems = get_local_size(0) * get_local_size(1);
+
+    for (unsigned int j = lid; j < tw * th; j += nitems)
+    {
+        const unsigned int gx = wrap(x0 + (int)(j % tw), nx);
+        const unsigned int gy = wrap(y0 + (int)(j / tw), ny);
+        block[j] = tick[gy * nx + gx];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+inline char life_block(__global const char* tick, const unsigned int nx, const unsigned int ny, __local char* block)
+{
+    const unsigned int bx = get_local_size(0);
+    const unsigned int by = get_local_size(1);
+    const unsigned int tw = bx + 2;
+
+    load_block(tick, nx, ny, tw, by + 2,
+               (int)(get_group_id(0) * bx) - 1, (int)(get_group_id(1) * by) - 1, block);
+
+    // The work-item's cell, and the rows above and below it
+    const unsigned int id_b = (get_local_id(1) + 1) * tw + get_local_id(0) + 1;
+    __local const char* up = block + id_b - tw;
+    __local const char* at = block + id_b;
+    __local const char* dn = block + id_b + tw;
+
+    // Count alive neighbours (out of eight); cells are 0 or 1
+    int neighbours = up[-1] + up[0] + up[1] + at[-1] + at[1] + dn[-1] + dn[0] + dn[1];
+
+    // Apply the rules of life
+    return NEXT_STATE(at[0], neighbours);
+}
+
 __kernel void accelerate_life(__global const char* tick, __global char* tock, const unsigned int nx, const unsigned int ny, __local char* block)
+{
+    const unsigned int idx = get_global_id(0);
+    const unsigned int idy = get_global_id(1);
+
+    const char cell = life_block(tick, nx, ny, block);
+
+    // Work-items past the edge of the board only helped fill the block
+    if (idx < nx && idy < ny)
+        tock[idy * nx + idx] = cell;
+}
+
+//------------------------------------------------------------------------------
+//
+// As accelerate_life, also adding the new board into a hash, for the host
+// to spot a board it has seen before (a still life, or a cycle of any
+// period) and skip the rest of the iterations.  Each live cell adds two
+// mixed forms of its position into hashes[2*slot] and hashes[2*slot+1],
+// sums that do not depend on the order the cells are added in; the host
+// clears the slot first.  A work-group adds up its cells in local memory
+// and makes one update of each.
+//
+//------------------------------------------------------------------------------
+
+// A 32 bit integer mixing function (a murmur-style finaliser)
+inline uint mix_hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+__kernel void accelerate_life_hash(__global const char* tick, __global char* tock,
+                                   const unsigned int nx, const unsigned int ny,
+                                   __local char* block,
+                                   __global uint* hashes, const unsigned int slot)
+{
+    const unsigned int idx = get_global_id(0);
+    const unsigned int idy = get_global_id(1);
+    const bool first = get_local_id(0) == 0 && get_local_id(1) == 0;
+    __local uint sums[2];
+
+    // Cleared before the barrier in life_block, added to after it
+    if (first)
+        sums[0] = sums[1] = 0;
+
+    const char cell = life_block(tick, nx, ny, block);
+
+    if (idx < nx && idy < ny)
+    {
+        const unsigned int id = idy * nx + idx;
+        tock[id] = cell;
+        if (cell)
+        {
+            atomic_add(&sums[0], mix_hash(id));
+            atomic_add(&sums[1], mix_hash(id ^ 0x9e3779b9u));
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (first)
+    {
+        atomic_add(&hashes[2 * slot], sums[0]);
+        atomic_add(&hashes[2 * slot + 1], sums[1]);
+    }
+}
+
+// The first loader of the block, kept to compare with (accelerate_life_edges):
+// each work-item loads its own cell, those on the edges of the group the
+// halo beside them (the left and right halos are loads down a column), and
+// every work-item the four corners.
+inline char life_block_edges(__global const char* tick, const unsigned int nx, const unsigned int ny, __local char* block)
 {
 
     // The cell we work on in the loop
     const unsigned int idx = get_global_id(0);
     const unsigned int idy = get_global_id(1);
 
-    // Index with respect to global array
-    const unsigned int id = idy * nx + idx;
+    // The same cell taken round the torus
+    const unsigned int wx = idx % nx;
+    const unsigned int wy = idy % ny;
 
     // Index with respect to local block (work-group size plus a halo border)
     const unsigned int id_b = (get_local_id(1) + 1) * (get_local_size(0) + 2) + get_local_id(0) + 1;
 
     // Copy block to local memory
-    block[id_b] = tick[id];
+    block[id_b] = tick[wy * nx + wx];
 
 
-    // Copy the halo cells (those around the block) to local memory
-    const unsigned int block_r = (get_group_id(0) + 1) % get_num_groups(0);
-    const unsigned int block_l = (get_group_id(0) == 0) ? get_num_groups(0) - 1 : get_group_id(0) - 1;
-    const unsigned int block_u = (get_group_id(1) + 1) % get_num_groups(1);
-    const unsigned int block_d = (get_group_id(1) == 0) ? get_num_groups(1) - 1 : get_group_id(1) - 1;
+    // Rows and columns of the halo cells (those around the block)
+    const unsigned int col_l = wrap((int)(get_group_id(0) * get_local_size(0)) - 1, nx);
+    const unsigned int col_r = ((get_group_id(0) + 1) * get_local_size(0)) % nx;
+    const unsigned int row_d = wrap((int)(get_group_id(1) * get_local_size(1)) - 1, ny);
+    const unsigned int row_u = ((get_group_id(1) + 1) * get_local_size(1)) % ny;
 
     // Select the first row of work-items
     if (get_local_id(1) == 0)
     {
         // Down row
-        block[get_local_id(0) + 1] = tick[(get_local_size(1) * block_d + get_local_size(1) - 1) * nx + idx];
+        block[get_local_id(0) + 1] = tick[row_d * nx + wx];
     }
     // Select the last row of work-items
     if (get_local_id(1) == get_local_size(1) - 1)
     {
         // Up row
-        block[id_b + get_local_size(0) + 2] = tick[(get_local_size(1) * block_u) * nx + idx];
+        block[id_b + get_local_size(0) + 2] = tick[row_u * nx + wx];
     }
 
     // Select the right column of work-items
     if (get_local_id(0) == get_local_size(0) - 1)
     {
         // Copy in right
-        block[id_b + 1] = tick[nx * idy + (get_local_size(0) * block_r)];
+        block[id_b + 1] = tick[nx * wy + col_r];
     }
     // Select the left column of work-items
     if (get_local_id(0) == 0)
     {
         // Copy in left
-        block[id_b - 1] = tick[nx * idy + (get_local_size(0) * block_l + get_local_size(0) - 1)];
+        block[id_b - 1] = tick[nx * wy + col_l];
     }
 
     // Copy in the 4 corner halo cells
-    block[0] = tick[nx * (get_local_size(1) * block_d + get_local_size(1) - 1) + (get_local_size(0) * block_l) + get_local_size(0) - 1];
-    block[get_local_size(0) + 1] = tick[nx * (get_local_size(1) * block_d + get_local_size(1) - 1) + (get_local_size(0) * block_r)];
-    block[(get_local_size(0) + 2) * (get_local_size(1) + 1)] = tick[nx * (get_local_size(1) * block_u) + (get_local_size(0) * block_l) + get_local_size(0) - 1];
-    block[(get_local_size(0) + 2) * (get_local_size(1) + 2) - 1] = tick[nx * (get_local_size(1) * block_u) + (get_local_size(0) * block_r)];
+    block[0] = tick[nx * row_d + col_l];
+    block[get_local_size(0) + 1] = tick[nx * row_d + col_r];
+    block[(get_local_size(0) + 2) * (get_local_size(1) + 1)] = tick[nx * row_u + col_l];
+    block[(get_local_size(0) + 2) * (get_local_size(1) + 2) - 1] = tick[nx * row_u + col_r];
 
     barrier(CLK_LOCAL_MEM_FENCE);
 
@@ -77,36 +223,527 @@ __kernel void accelerate_life(__global const char* tick, __global char* tock, co
     y_u = get_local_id(1) + 2;
     y_d = get_local_id(1);
 
-    // Count alive neighbours (out of eight)
+    // Count alive neighbours (out of eight); cells are 0 or 1
     int neighbours = 0;
-    if (block[(get_local_id(1) + 1) * (get_local_size(0) + 2) + x_l] == ALIVE) neighbours++;
-    if (block[y_u * (get_local_size(0) + 2) + x_l] == ALIVE) neighbours++;
-    if (block[y_d * (get_local_size(0) + 2) + x_l] == ALIVE) neighbours++;
-    
-    if (block[(get_local_id(1) + 1) * (get_local_size(0) + 2) + x_r] == ALIVE) neighbours++;
-    if (block[y_u * (get_local_size(0) + 2) + x_r] == ALIVE) neighbours++;
-    if (block[y_d * (get_local_size(0) + 2) + x_r] == ALIVE) neighbours++;
-    
-    if (block[y_u * (get_local_size(0) + 2) + get_local_id(0) + 1] == ALIVE) neighbours++;
-    if (block[y_d * (get_local_size(0) + 2) + get_local_id(0) + 1] == ALIVE) neighbours++;
-
-    // Apply game of life rules
-    if (block[id_b] == ALIVE)
+    neighbours += block[(get_local_id(1) + 1) * (get_local_size(0) + 2) + x_l];
+    neighbours += block[y_u * (get_local_size(0) + 2) + x_l];
+    neighbours += block[y_d * (get_local_size(0) + 2) + x_l];
+
+    neighbours += block[(get_local_id(1) + 1) * (get_local_size(0) + 2) + x_r];
+    neighbours += block[y_u * (get_local_size(0) + 2) + x_r];
+    neighbours += block[y_d * (get_local_size(0) + 2) + x_r];
+
+    neighbours += block[y_u * (get_local_size(0) + 2) + get_local_id(0) + 1];
+    neighbours += block[y_d * (get_local_size(0) + 2) + get_local_id(0) + 1];
+
+    // Apply the rules of life
+    return NEXT_STATE(block[id_b], neighbours);
+}
+
+__kernel void accelerate_life_edges(__global const char* tick, __global char* tock, const unsigned int nx, const unsigned int ny, __local char* block)
+{
+    const unsigned int idx = get_global_id(0);
+    const unsigned int idy = get_global_id(1);
+
+    const char cell = life_block_edges(tick, nx, ny, block);
+
+    if (idx < nx && idy < ny)
+        tock[idy * nx + idx] = cell;
+}
+
+//------------------------------------------------------------------------------
+//
+// As accelerate_life, with each work-item updating a run of LIFE_VEC (16)
+// cells of a row as a char16.  The block is bx*16+2 cells wide; the
+// neighbour counts of the run are the sums of char16 loads from the rows
+// above, at and below, each one cell to the left, in line and one to the
+// right, and the rule is looked up for all 16 at once.
+//
+//------------------------------------------------------------------------------
+
+#define LIFE_VEC 16
+
+__kernel void accelerate_life_vec(__global const char* tick, __global char* tock, const unsigned int nx, const unsigned int ny, __local char* block)
+{
+    const unsigned int bx = get_local_size(0) * LIFE_VEC;
+    const unsigned int by = get_local_size(1);
+    const unsigned int tw = bx + 2;
+
+    load_block(tick, nx, ny, tw, by + 2,
+               (int)(get_group_id(0) * bx) - 1, (int)(get_group_id(1) * by) - 1, block);
+
+    const unsigned int c = get_local_id(0) * LIFE_VEC + 1;
+    __local const char* up = block + get_local_id(1) * tw + c;
+    __local const char* at = up + tw;
+    __local const char* dn = at + tw;
+
+    const char16 alive = vload16(0, at);
+    const char16 neighbours = vload16(0, up - 1) + vload16(0, up) + vload16(0, up + 1)
+                            + vload16(0, at - 1)                  + vload16(0, at + 1)
+                            + vload16(0, dn - 1) + vload16(0, dn) + vload16(0, dn + 1);
+
+    const uint16 index = convert_uint16(neighbours) + 9u * convert_uint16(alive);
+    const char16 next = convert_char16(((uint16)(RULE) >> index) & 1);
+
+    // The whole run, or the cells of it that are on the board
+    const unsigned int x = get_global_id(0) * LIFE_VEC;
+    const unsigned int y = get_global_id(1);
+    if (y >= ny || x >= nx)
+        return;
+    if (x + LIFE_VEC <= nx)
+        vstore16(next, 0, tock + y * nx + x);
+    else
     {
-        if (neighbours == 2 || neighbours == 3)
-            // Cell lives on
-            tock[id] = ALIVE;
-        else
-            // Cell dies by over/under population
-            tock[id] = DEAD;
+        char cells[LIFE_VEC];
+        vstore16(next, 0, cells);
+        for (unsigned int i = 0; i < nx - x; i++)
+            tock[y * nx + x + i] = cells[i];
     }
-    else
+}
+
+//------------------------------------------------------------------------------
+//
+// Sparse update: each work-group is a tile of the board, and the tiles
+// are only updated when they, or one of the 8 tiles round them, changed
+// in the last generation.  No other tile can change.  A tile that is
+// skipped is left as it is in tock, which the host keeps right: it starts
+// as a copy of tick, and a tile is only skipped when it was the same in
+// the last two generations, so the older board already holds it.
+//
+// changed_in and changed_out hold a flag per tile for the generations
+// before and after; every tile writes its flag, so changed_out need not
+// be cleared.  updates counts the tiles that were worked on.
+//
+//------------------------------------------------------------------------------
+
+__kernel void accelerate_life_sparse(__global const char* tick, __global char* tock,
+                                     const unsigned int nx, const unsigned int ny,
+                                     __global const uchar* changed_in, __global uchar* changed_out,
+                                     __global unsigned int* updates, __local char* block)
+{
+    const unsigned int idx = get_global_id(0);
+    const unsigned int idy = get_global_id(1);
+    const unsigned int ntx = get_num_groups(0);
+    const unsigned int nty = get_num_groups(1);
+    const unsigned int tile = get_group_id(1) * ntx + get_group_id(0);
+    const bool first = get_local_id(0) == 0 && get_local_id(1) == 0;
+    __local int changed;
+
+    // The whole group takes the same branch, so the barriers are safe
+    uchar active = 0;
+    for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+            active |= changed_in[wrap((int)get_group_id(1) + dy, nty) * ntx
+                               + wrap((int)get_group_id(0) + dx, ntx)];
+    if (!active)
+    {
+        if (first)
+            changed_out[tile] = 0;
+        return;
+    }
+
+    // Cleared before the barrier in life_block, set after it
+    if (first)
+        changed = 0;
+
+    const char cell = life_block(tick, nx, ny, block);
+
+    if (idx < nx && idy < ny)
+    {
+        const unsigned int id = idy * nx + idx;
+        tock[id] = cell;
+        if (cell != tick[id])
+            changed = 1;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (first)
     {
-        if (neighbours == 3)
-            // Cell becomes alive through reproduction
-            tock[id] = ALIVE;
-        else
-            // Remains dead
-            tock[id] = DEAD;
+        changed_out[tile] = changed;
+        atomic_inc(updates);
     }
 }
+
+//------------------------------------------------------------------------------
+//
+// Bit-packed board: each row is nwords words, cell x in bit x % 32 of
+// word x / 32, and the bits past the end of the row zero.  A work-item
+// updates a word (32 cells) at a time: the 8 neighbours of every bit
+// are formed by shifting the words of the rows above, at and below,
+// and counted with a bit-sliced adder.
+//
+//------------------------------------------------------------------------------
+
+// The word w of row, shifted so each bit holds its west (x - 1) neighbour,
+// wrapping round the torus.  last_bits is the number of cells in the
+// last word of the row.
+uint west(__global const uint* row, const unsigned int w, const unsigned int nwords,
+          const unsigned int last_bits)
+{
+    uint carry = (w == 0) ? row[nwords - 1] >> (last_bits - 1) : row[w - 1] >> 31;
+    return (row[w] << 1) | (carry & 1);
+}
+
+// As west, for the east (x + 1) neighbours
+uint east(__global const uint* row, const unsigned int w, const unsigned int nwords,
+          const unsigned int last_bits)
+{
+    if (w == nwords - 1)
+        return (row[w] >> 1) | ((row[0] & 1) << (last_bits - 1));
+    return (row[w] >> 1) | (row[w + 1] << 31);
+}
+
+// Add the bits of x into the count kept in the bit planes s0 to s3
+void add_neighbours(const uint x, uint* s0, uint* s1, uint* s2, uint* s3)
+{
+    uint c0 = *s0 & x;
+    *s0 ^= x;
+    uint c1 = *s1 & c0;
+    *s1 ^= c0;
+    uint c2 = *s2 & c1;
+    *s2 ^= c1;
+    *s3 |= c2;
+}
+
+// The bits whose count is n, and the bits of cells alive next under the
+// rule for count n; the masks are constants, so all but the terms of the
+// rule fold away
+#define COUNT_IS(n) ((((n) & 1) ? s0 : ~s0) & (((n) & 2) ? s1 : ~s1) & \
+                     (((n) & 4) ? s2 : ~s2) & (((n) & 8) ? s3 : ~s3))
+#define RULE_TERM(n) ((((BIRTH >> (n)) & 1) ? COUNT_IS(n) & ~alive : 0) | \
+                      (((SURVIVE >> (n)) & 1) ? COUNT_IS(n) & alive : 0))
+
+__kernel void accelerate_life_packed(__global const uint* tick, __global uint* tock,
+                                     const unsigned int nx, const unsigned int ny,
+                                     const unsigned int nwords)
+{
+    const unsigned int w = get_global_id(0);
+    const unsigned int y = get_global_id(1);
+    if (w >= nwords || y >= ny)
+        return;
+
+    const unsigned int last_bits = nx - (nwords - 1) * 32;
+
+    __global const uint* row_d = tick + ((y == 0) ? ny - 1 : y - 1) * nwords;
+    __global const uint* row   = tick + y * nwords;
+    __global const uint* row_u = tick + ((y + 1) % ny) * nwords;
+
+    uint s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    add_neighbours(west(row_d, w, nwords, last_bits), &s0, &s1, &s2, &s3);
+    add_neighbours(row_d[w],                          &s0, &s1, &s2, &s3);
+    add_neighbours(east(row_d, w, nwords, last_bits), &s0, &s1, &s2, &s3);
+    add_neighbours(west(row, w, nwords, last_bits),   &s0, &s1, &s2, &s3);
+    add_neighbours(east(row, w, nwords, last_bits),   &s0, &s1, &s2, &s3);
+    add_neighbours(west(row_u, w, nwords, last_bits), &s0, &s1, &s2, &s3);
+    add_neighbours(row_u[w],                          &s0, &s1, &s2, &s3);
+    add_neighbours(east(row_u, w, nwords, last_bits), &s0, &s1, &s2, &s3);
+
+    const uint alive = row[w];
+#if BIRTH == 0x008 && SURVIVE == 0x00C
+    // Alive next if 3 neighbours, or 2 and alive now: the count has bit
+    // 1 set and bits 2 and 3 clear, and bit 0 set unless the cell is alive
+    uint next = s1 & ~s2 & ~s3 & (s0 | alive);
+#else
+    uint next = RULE_TERM(0) | RULE_TERM(1) | RULE_TERM(2) | RULE_TERM(3) | RULE_TERM(4)
+              | RULE_TERM(5) | RULE_TERM(6) | RULE_TERM(7) | RULE_TERM(8);
+#endif
+
+    // Keep the bits past the end of the row clear
+    if (w == nwords - 1 && last_bits < 32)
+        next &= (1u << last_bits) - 1;
+
+    tock[y * nwords + w] = next;
+}
+
+//------------------------------------------------------------------------------
+//
+// Temporal blocking: a work-group loads its bx x by tile of the board
+// with a halo k cells deep, then advances it k generations in local
+// memory, so a launch does k generations with one read and one write of
+// the board.  After generation s only the tile less s cells all round
+// is still correct, which after k generations is the bx x by centre.
+//
+// The cells of the tile are spread over the work-items of the group, and
+// positions are taken round the torus, so groups at the edges of a board
+// whose size is not a multiple of the block size work too (they only
+// write the cells that are on the board).
+//
+//------------------------------------------------------------------------------
+
+__kernel void accelerate_life_multi(__global const char* tick, __global char* tock,
+                                    const unsigned int nx, const unsigned int ny,
+                                    const unsigned int k,
+                                    __local char* block_a, __local char* block_b)
+{
+    const unsigned int bx = get_local_size(0);
+    const unsigned int by = get_local_size(1);
+    const unsigned int tw = bx + 2 * k;             // tile width and height
+    const unsigned int th = by + 2 * k;
+    const unsigned int lid = get_local_id(1) * bx + get_local_id(0);
+    const unsigned int nitems = bx * by;
+
+    // Top left of the tile, including halo, on the board
+    const int x0 = (int)(get_group_id(0) * bx) - (int)k;
+    const int y0 = (int)(get_group_id(1) * by) - (int)k;
+
+    unsigned int j;
+    for (j = lid; j < tw * th; j += nitems)
+    {
+        int gx = ((x0 + (int)(j % tw)) % (int)nx + (int)nx) % (int)nx;
+        int gy = ((y0 + (int)(j / tw)) % (int)ny + (int)ny) % (int)ny;
+        block_a[j] = tick[gy * nx + gx];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    __local char* src = block_a;
+    __local char* dst = block_b;
+    unsigned int s;
+    for (s = 1; s <= k; s++)
+    {
+        // Cells still exact after generation s: s to tw - s - 1 across
+        const unsigned int w = tw - 2 * s;
+        const unsigned int h = th - 2 * s;
+        for (j = lid; j < w * h; j += nitems)
+        {
+            unsigned int tx = j % w + s;
+            unsigned int ty = j / w + s;
+            unsigned int c = ty * tw + tx;
+            int neighbours = src[c - tw - 1] + src[c - tw] + src[c - tw + 1]
+                           + src[c - 1]                    + src[c + 1]
+                           + src[c + tw - 1] + src[c + tw] + src[c + tw + 1];
+            dst[c] = NEXT_STATE(src[c], neighbours);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        __local char* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    // Write back the centre of the tile that is on the board
+    const unsigned int gx = get_group_id(0) * bx + get_local_id(0);
+    const unsigned int gy = get_group_id(1) * by + get_local_id(1);
+    if (gx < nx && gy < ny)
+        tock[gy * nx + gx] = src[(get_local_id(1) + k) * tw + get_local_id(0) + k];
+}
+
+//------------------------------------------------------------------------------
+//
+// The whole run in one launch, for boards small enough that launching a
+// kernel a generation is most of the time.  One work-group holds the
+// whole board, twice over, in local memory, and steps it through all the
+// iterations with a barrier between generations; the board is read once
+// and written once.  OpenCL has no barrier across work-groups, so this
+// is one group, and the board must fit twice in the device's local
+// memory (2 * nx * ny bytes); the host checks.  The cells are shared out
+// in turn over the work-items, which may be any number.
+//
+//------------------------------------------------------------------------------
+
+__kernel void accelerate_life_persistent(__global const char* tick, __global char* tock,
+                                         const unsigned int nx, const unsigned int ny,
+                                         const unsigned int iterations,
+                                         __local char* board_a, __local char* board_b)
+{
+    const unsigned int lid = get_local_id(0);
+    const unsigned int nitems = get_local_size(0);
+    const unsigned int ncells = nx * ny;
+
+    unsigned int j;
+    for (j = lid; j < ncells; j += nitems)
+        board_a[j] = tick[j];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    __local char* src = board_a;
+    __local char* dst = board_b;
+    unsigned int i;
+    for (i = 0; i < iterations; i++)
+    {
+        for (j = lid; j < ncells; j += nitems)
+        {
+            const unsigned int x = j % nx;
+            const unsigned int y = j / nx;
+            const unsigned int x_l = (x == 0) ? nx - 1 : x - 1;
+            const unsigned int x_r = (x == nx - 1) ? 0 : x + 1;
+
+            __local const char* up = src + ((y == 0) ? ny - 1 : y - 1) * nx;
+            __local const char* at = src + y * nx;
+            __local const char* dn = src + ((y == ny - 1) ? 0 : y + 1) * nx;
+
+            const int neighbours = up[x_l] + up[x] + up[x_r]
+                                 + at[x_l]         + at[x_r]
+                                 + dn[x_l] + dn[x] + dn[x_r];
+
+            dst[j] = NEXT_STATE(at[x], neighbours);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        __local char* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    for (j = lid; j < ncells; j += nitems)
+        tock[j] = src[j];
+}
+
+//------------------------------------------------------------------------------
+//
+// One strip of a board split over several devices by rows.  The strip
+// buffer is rows rows of nx cells, wrapping round in x only: the rows at
+// its top and bottom are ghost rows, copies of the rows of the strips
+// next to it.  The kernel updates rows row0 to row0 + nrows - 1, which
+// must leave at least one row either side; the host shrinks the range a
+// row each generation, so ghost rows k deep last k generations.
+//
+//------------------------------------------------------------------------------
+
+__kernel void accelerate_life_strip(__global const char* tick, __global char* tock,
+                                    const unsigned int nx, const unsigned int row0)
+{
+    const unsigned int x = get_global_id(0);
+    const unsigned int row = row0 + get_global_id(1);
+
+    const unsigned int x_l = (x == 0) ? nx - 1 : x - 1;
+    const unsigned int x_r = (x == nx - 1) ? 0 : x + 1;
+
+    __global const char* up = tick + (row - 1) * nx;
+    __global const char* at = tick + row * nx;
+    __global const char* dn = tick + (row + 1) * nx;
+
+    const int neighbours = up[x_l] + up[x] + up[x_r]
+                         + at[x_l]         + at[x_r]
+                         + dn[x_l] + dn[x] + dn[x_r];
+
+    tock[row * nx + x] = NEXT_STATE(at[x], neighbours);
+}
+
+//------------------------------------------------------------------------------
+//
+// A rectangle of one rank's tile of a board split over MPI ranks (see
+// Cpp/mpi_life.cpp).  The tile buffer holds the rank's cells with a ring
+// of ghost cells round them, pitch cells a row, so nothing wraps: the
+// kernel updates the cells x0 to x0 + w - 1 and y0 to y0 + h - 1 (the
+// NDRange is w by h), which must not touch the ring.  The host launches
+// the inside of the tile while the ghost cells are on their way, and the
+// four edges of the tile once they are in.
+//
+//------------------------------------------------------------------------------
+
+__kernel void accelerate_life_region(__global const char* tick, __global char* tock,
+                                     const unsigned int pitch,
+                                     const unsigned int x0, const unsigned int y0)
+{
+    const unsigned int x = x0 + get_global_id(0);
+    const unsigned int y = y0 + get_global_id(1);
+
+    __global const char* up = tick + (y - 1) * pitch;
+    __global const char* at = tick + y * pitch;
+    __global const char* dn = tick + (y + 1) * pitch;
+
+    const int neighbours = up[x - 1] + up[x] + up[x + 1]
+                         + at[x - 1]         + at[x + 1]
+                         + dn[x - 1] + dn[x] + dn[x + 1];
+
+    tock[y * pitch + x] = NEXT_STATE(at[x], neighbours);
+}
+
+//------------------------------------------------------------------------------
+//
+// Draw the board into an image, such as a GL texture shared with OpenCL:
+// live cells white, dead cells black
+//
+//------------------------------------------------------------------------------
+
+__kernel void draw_board(__global const char* board, const unsigned int nx,
+                         __write_only image2d_t image)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    const float v = (board[y * nx + x] == ALIVE) ? 1.0f : 0.0f;
+    write_imagef(image, (int2)(x, y), (float4)(v, v, v, 1.0f));
+}
+
+//------------------------------------------------------------------------------
+//
+// Many boards at once: board b is widths[b] x heights[b] cells, starting
+// at offsets[b] in the buffers, and the third dimension of the NDRange is
+// the board.  The first two dimensions cover the largest board, and
+// work-items past the edge of a smaller one do nothing.  A board that has
+// had its iterations[b] generations is copied through unchanged, so it
+// stays put while the others carry on.
+//
+//------------------------------------------------------------------------------
+
+__kernel void accelerate_life_batch(__global const char* tick, __global char* tock,
+                                    __global const unsigned int* offsets,
+                                    __global const unsigned int* widths,
+                                    __global const unsigned int* heights,
+                                    __global const unsigned int* iterations,
+                                    const unsigned int generation)
+{
+    const unsigned int b = get_global_id(2);
+    const unsigned int nx = widths[b];
+    const unsigned int ny = heights[b];
+    const unsigned int x = get_global_id(0);
+    const unsigned int y = get_global_id(1);
+    if (x >= nx || y >= ny)
+        return;
+
+    __global const char* board = tick + offsets[b];
+    const unsigned int id = offsets[b] + y * nx + x;
+    if (generation >= iterations[b])
+    {
+        tock[id] = tick[id];
+        return;
+    }
+
+    const unsigned int x_l = (x == 0) ? nx - 1 : x - 1;
+    const unsigned int x_r = (x == nx - 1) ? 0 : x + 1;
+
+    __global const char* up = board + ((y == 0) ? ny - 1 : y - 1) * nx;
+    __global const char* at = board + y * nx;
+    __global const char* dn = board + ((y == ny - 1) ? 0 : y + 1) * nx;
+
+    const int neighbours = up[x_l] + up[x] + up[x_r]
+                         + at[x_l]         + at[x_r]
+                         + dn[x_l] + dn[x] + dn[x_r];
+
+    tock[id] = NEXT_STATE(at[x], neighbours);
+}
+
+//------------------------------------------------------------------------------
+//
+// As accelerate_life, with the boards as images (CL_R, CL_UNSIGNED_INT8):
+// the neighbours are read through the texture cache, and the sampler's
+// CLK_ADDRESS_REPEAT wraps the board round the torus, so there is no wrap()
+// and no block in local memory.  REPEAT needs normalised coordinates, the
+// centre of cell (x, y) being ((x + 0.5) / nx, (y + 0.5) / ny).  Only built
+// for devices with images.
+//
+//------------------------------------------------------------------------------
+
+#ifdef __IMAGE_SUPPORT__
+__constant sampler_t torus = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_REPEAT | CLK_FILTER_NEAREST;
+
+__kernel void accelerate_life_image(__read_only image2d_t tick, __write_only image2d_t tock,
+                                    const unsigned int nx, const unsigned int ny)
+{
+    const unsigned int idx = get_global_id(0);
+    const unsigned int idy = get_global_id(1);
+    if (idx >= nx || idy >= ny)
+        return;
+
+    const float2 cell = (float2)(1.0f / nx, 1.0f / ny);
+    const float2 at = ((float2)(idx, idy) + 0.5f) * cell;
+
+    int neighbours = 0;
+    for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+            if (dx || dy)
+                neighbours += read_imageui(tick, torus, at + (float2)(dx, dy) * cell).x;
+
+    const uint alive = read_imageui(tick, torus, at).x;
+    write_imageui(tock, (int2)(idx, idy), (uint4)(NEXT_STATE(alive, neighbours), 0, 0, 0));
+}
+#endif
@@ -111,8 +111,10 @@ int main(int argc, char** argv)
     char *kernel_source = getKernelSource("../pi_vocl.cl");
     program = clCreateProgramWithSource(context, 1, (const char**)&kernel_source, NULL, &err);
     checkError(err, "Creating program");
-    // Build the program
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    // Build the program, for this vector width
+    char options[32];
+    sprintf(options, "-D VW=%d", vector_size);
+    err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
     if (err != CL_SUCCESS)
     {
         size_t len;
@@ -121,21 +123,8 @@ int main(int argc, char** argv)
         printf("%s\n", buffer);
         checkError(err, "Building program");
     }
-    if (vector_size == 1)
-    {
-        kernel = clCreateKernel(program, "pi", &err);
-        checkError(err, "Creating kernel pi");
-    }
-    else if (vector_size == 4)
-    {
-        kernel = clCreateKernel(program, "pi_vec4", &err);
-        checkError(err, "Creating kernel pi_vec4");
-    }
-    else if (vector_size == 8)
-    {
-        kernel = clCreateKernel(program, "pi_vec8", &err);
-        checkError(err, "Creating kernel pi_vec8");
-    }
+    kernel = clCreateKernel(program, "pi_vec", &err);
+    checkError(err, "Creating kernel pi_vec");
 
     // Now that we know the size of the work_groups, we can set the number of work
     // groups, the actual number of steps, and the step size
@@ -149,7 +138,7 @@ int main(int argc, char** argv)
     if (max_size > work_group_size)
     {
         work_group_size = max_size;
-        nwork_groups = in_nsteps/(nwork_groups*niters);
+        nwork_groups = in_nsteps/(work_group_size*niters);
     }
 
     if (nwork_groups < 1)
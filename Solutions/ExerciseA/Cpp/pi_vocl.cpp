@@ -3,7 +3,8 @@
 //
 // Numeric integration to estimate pi
 // Asks the user to select a device at runtime
-// Vector size must be present as a CLI argument
+// The vector width is CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT of the
+// device, unless it is given as a CLI argument (1, 2, 4, 8 or 16)
 //
 // History: C version written by Tim Mattson, May 2010
 //          Ported to the C++ Wrapper API by Benedict R. Gaster, September 2011
@@ -19,6 +20,7 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 //pick up device type from compiler command line or from 
 //the default type
@@ -27,100 +29,76 @@
 #endif
 
 #include "err_code.h"
+#include "launch_plan.hpp"
 
 #define INSTEPS (512*512*512)
 
+//------------------------------------------------------------------------------
+//
+//  Function to pick the vector width the device prefers for floats,
+//  rounded down to one the kernel is built for
+//
+//------------------------------------------------------------------------------
+unsigned int preferredWidth(const cl::Device& device)
+{
+	unsigned int preferred = device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>();
+	unsigned int width = 1;
+	while (width < 16 && 2 * width <= preferred)
+		width *= 2;
+	return width;
+}
+
 int main(int argc, char** argv)
 {
-	if (argc != 2)
+	if (argc > 2)
 	{
-		std::cout << "Usage: ./pi_vocl num\n"
-		          << "\twhere num = 1, 4 or 8\n";
+		std::cout << "Usage: ./pi_vocl [num]\n"
+		          << "\twhere num = 1, 2, 4, 8 or 16 (default: the device's preferred width)\n";
 		return EXIT_FAILURE;
 	}
 
-	int vector_size = atoi(argv[1]);
-
-	// Define some vector size specific constants
-	unsigned int ITERS, WGS;
-	if (vector_size == 1)
-	{
-		ITERS = 262144;
-		WGS = 8;
-	}
-	else if (vector_size == 4)
-	{
-		ITERS = 262144 / 4;
-		WGS = 32;
-	}
-	else if (vector_size == 8)
-	{
-		ITERS = 262144 / 8;
-		WGS = 64;
-	}
-	else
+	int vector_size = argc == 2 ? atoi(argv[1]) : 0;
+	if (vector_size != 0 && vector_size != 1 && vector_size != 2 && vector_size != 4 &&
+	    vector_size != 8 && vector_size != 16)
 	{
 		std::cerr << "Invalid vector size\n";
 		return EXIT_FAILURE;
 	}
 
-	// Set some default values:
-	// Default number of steps (updated later to device preferable)
-	unsigned int in_nsteps = INSTEPS;
-	// Default number of iterations
-	unsigned int niters = ITERS;
-	unsigned int work_group_size = WGS;
-
 	try
 	{
 		// Create context, queue and build program
 		cl::Context context(DEVICE);
 		cl::CommandQueue queue(context);
-		cl::Program program(context, util::loadProgram("../pi_vocl.cl"), true);
-		cl::Kernel kernel;
-
-		// Now that we know the size of the work_groups, we can set the number of work
-		// groups, the actual number of steps, and the step size
-		unsigned int nwork_groups = in_nsteps/(work_group_size*niters);
-
-		// Get the max work group size for the kernel pi on our device
-		unsigned int max_size;
-        std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
-		if (vector_size == 1)
-		{
-			kernel = cl::Kernel(program, "pi");
-			max_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(devices[0]);
-		}
-		else if (vector_size == 4)
-		{
-			kernel = cl::Kernel(program, "pi_vec4");
-			max_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(devices[0]);
-		}
-		else if (vector_size == 8)
-		{
-			kernel = cl::Kernel(program, "pi_vec8");
-			max_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(devices[0]);
-		}
-
-		if (max_size > work_group_size)
-		{
-			work_group_size = max_size;
-			nwork_groups = in_nsteps/(nwork_groups*niters);
-		}
-
-		if (nwork_groups < 1)
-		{
-			nwork_groups = devices[0].getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
-			work_group_size = in_nsteps/(nwork_groups*niters);
-		}
-
-		unsigned int nsteps = work_group_size * niters * nwork_groups;
+		std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
+
+		if (vector_size == 0)
+			vector_size = preferredWidth(devices[0]);
+
+		// One kernel source for every width, chosen with -D VW
+		std::ostringstream options;
+		options << "-D VW=" << vector_size;
+		cl::Program program(context, util::loadProgram("../pi_vocl.cl"));
+		program.build(devices, options.str().c_str());
+		cl::Kernel kernel(program, "pi_vec");
+
+		std::cout << "Vector width " << vector_size << "\n";
+
+		// Size the work-groups and their number to fill the device, then set
+		// the iterations per work-item (whole vectors), the actual number of
+		// steps and the step size
+		util::LaunchPlan plan = util::planLaunch(kernel, devices[0], INSTEPS, vector_size);
+		unsigned int nwork_groups = plan.work_groups;
+		unsigned int work_group_size = plan.work_group_size;
+		int niters = (int)plan.iters;
+		unsigned int nsteps = (unsigned int)plan.steps;
 		float step_size = 1.0f / (float) nsteps;
 
 		// Vector to hold partial sum
 		std::vector<float> h_psum(nwork_groups);
 
-		std::cout << nwork_groups << " work groups of size " << work_group_size << ".\n"
+		std::cout << nwork_groups << " work groups of size " << work_group_size
+		          << ", " << niters << " iterations each.\n"
 		          << nsteps << " Integration steps\n";
 
         cl::Buffer d_partial_sums(context, CL_MEM_WRITE_ONLY, sizeof(float) * nwork_groups);
@@ -53,13 +53,8 @@ work_group_size = WGS
 context = cl.create_some_context()
 queue = cl.CommandQueue(context)
 kernelsource = open("../pi_vocl.cl").read()
-program = cl.Program(context, kernelsource).build()
-if vector_size == 1:
-	pi = program.pi
-elif vector_size == 4:
-	pi = program.pi_vec4
-elif vector_size == 8:
-	pi = program.pi_vec8
+program = cl.Program(context, kernelsource).build(options="-D VW=%d" % vector_size)
+pi = program.pi_vec
 
 pi.set_scalar_arg_dtypes([numpy.int32, numpy.float32, None, None])
 
@@ -69,12 +64,7 @@ nwork_groups = in_nsteps/(work_group_size*niters)
 
 # Get the max work group size for the kernel pi on our device
 device = context.devices[0]
-if vector_size == 1:
-	max_size = program.pi.get_work_group_info(cl.kernel_work_group_info.WORK_GROUP_SIZE, device)
-elif vector_size == 4:
-	max_size = program.pi_vec4.get_work_group_info(cl.kernel_work_group_info.WORK_GROUP_SIZE, device)
-elif vector_size == 8:
-	max_size = program.pi_vec8.get_work_group_info(cl.kernel_work_group_info.WORK_GROUP_SIZE, device)
+max_size = pi.get_work_group_info(cl.kernel_work_group_info.WORK_GROUP_SIZE, device)
 
 if max_size > work_group_size:
 	work_group_size = max_size
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+//
+// Name:       program_cache_test.cpp
+//
+// Purpose:    Check the binary cache of program_cache.hpp end to end: a cold
+//             build must write the device binary to the cache, and a warm
+//             start must load that binary and run it
+//
+// Usage:      make check (in Solutions), or ./program_cache_test
+//
+//             The cache goes in a directory of its own under /tmp (or
+//             $TMPDIR), so the build is always cold and no other cache is
+//             touched.  The loaded program runs a kernel whose result is
+//             checked, so a binary that loads but is truncated fails too.
+//             With no OpenCL device the test is skipped and passes.
+//
+//------------------------------------------------------------------------------
+
+#define __CL_ENABLE_EXCEPTIONS
+
+#include "cl.hpp"
+#include "util.hpp"
+#include "err_code.h"
+#include "program_cache.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define LENGTH 1024
+
+static const char *source =
+    "kernel void triple(global int *out)\n"
+    "{\n"
+    "    out[get_global_id(0)] = 3 * (int)get_global_id(0);\n"
+    "}\n";
+
+// Length of a file in bytes, or -1 if it cannot be opened
+static long fileBytes(const std::string& path)
+{
+    std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    return stream.is_open() ? (long)stream.tellg() : -1;
+}
+
+// Run the triple kernel of program and check its result
+static bool runs(const cl::Context& context, const cl::Device& device, const cl::Program& program)
+{
+    cl::CommandQueue queue(context, device);
+    cl::Buffer d_out(context, CL_MEM_WRITE_ONLY, sizeof(int) * LENGTH);
+    cl::Kernel kernel(program, "triple");
+    kernel.setArg(0, d_out);
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(LENGTH), cl::NullRange);
+
+    std::vector<int> h_out(LENGTH);
+    queue.enqueueReadBuffer(d_out, CL_TRUE, 0, sizeof(int) * LENGTH, &h_out[0]);
+    for (int i = 0; i < LENGTH; i++)
+        if (h_out[i] != 3 * i)
+            return false;
+    return true;
+}
+
+int main(void)
+{
+    cl::Context context;
+    try
+    {
+        context = cl::Context(CL_DEVICE_TYPE_DEFAULT);
+    }
+    catch (cl::Error err)
+    {
+        printf("program_cache_test: no OpenCL device (%s), SKIPPED\n", err_code(err.err()));
+        return EXIT_SUCCESS;
+    }
+    cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+    const char *tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp != NULL && *tmp != '\0' ? tmp : "/tmp") + "/clcache_test";
+    char pid[32];
+    sprintf(pid, ".%d", (int)getpid());
+    dir += pid;
+    setenv("OCL_PROGRAM_CACHE", dir.c_str(), 1);
+
+    const std::string options = "-cl-mad-enable";
+    const std::string path = util::programCachePath(device, source, options);
+    int failures = 0;
+
+    try
+    {
+        // Cold: nothing cached, so the source is compiled and stored
+        cl::Program cold = util::buildProgram(context, device, source, options);
+        const std::vector< ::size_t> sizes = cold.getInfo<CL_PROGRAM_BINARY_SIZES>();
+        const long stored = fileBytes(path);
+        if (stored <= 0 || sizes.empty() || (::size_t)stored != sizes[0])
+        {
+            printf("FAIL: cold build stored %ld bytes at %s, the binary is %lu\n", stored,
+                   path.c_str(), sizes.empty() ? 0UL : (unsigned long)sizes[0]);
+            failures++;
+        }
+        if (!runs(context, device, cold))
+        {
+            printf("FAIL: the cold build gives wrong results\n");
+            failures++;
+        }
+
+        // Warm: the stored binary is loaded, built and run
+        cl::Program warm;
+        if (!util::loadCachedProgram(context, device, path, options, warm))
+        {
+            printf("FAIL: the stored binary could not be loaded\n");
+            failures++;
+        }
+        else if (!runs(context, device, warm))
+        {
+            printf("FAIL: the binary loaded from the cache gives wrong results\n");
+            failures++;
+        }
+
+        // And through buildProgram, which takes the same path
+        if (!runs(context, device, util::buildProgram(context, device, source, options)))
+        {
+            printf("FAIL: the warm build gives wrong results\n");
+            failures++;
+        }
+    }
+    catch (cl::Error err)
+    {
+        printf("FAIL: %s (%s)\n", err.what(), err_code(err.err()));
+        failures++;
+    }
+
+    remove(path.c_str());
+    rmdir(dir.c_str());
+
+    printf("program_cache_test: %s\n", failures ? "FAILED" : "passed");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+
+# Usage: ./bench_suite.py [--solutions DIR] [--trials N] [--devices LIST]
+#                         [--python PYTHON] [--out FILE] [--only NAME,...]
+#                         [--timeout SECONDS]
+#
+# Runs the C, C++ and Python solutions under one protocol: every program
+# over the problem sizes it can be given, on each device, --trials times.
+# The results of every run go into one report, FILE (CSV, or JSON if FILE
+# ends in .json), with the median of each set of trials printed at the end.
+#
+# Each row has the wall time of the whole program and the shortest time
+# it reported itself (its "N seconds" lines: the kernel, or the best
+# variant for matmul), which leaves out start up and building.
+#
+# --devices is a comma separated list of indices from --list of the C++
+# programs (all of them by default).  Programs that take --device (the C
+# and C++ ones with the device picker) run on each; the Python ones run
+# on the same device through PYOPENCL_CTX; the rest use the DEVICE they
+# were built for and run once, as device "default".  So do the CUDA
+# ports (built with "make cuda"), on CUDA device 0, as their --device
+# numbers CUDA's devices rather than OpenCL's; a CUDA program that was not
+# built shows as "missing".
+#
+# Run from Solutions/ as part of "make bench", after the programs are built.
+
+import csv
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# How each program is run: (benchmark, language, directory, command, sizes,
+# takes_device).  sizes is a list of (label, extra arguments); the
+# programs with their sizes compiled in have the one size "default".
+DEFAULT = [("default", [])]
+MATMUL_ORDERS = [256, 512, 1024]
+PI_STEPS = [1 << 24, 1 << 27, 1 << 30]
+VADD_LENGTHS = [1 << 22, 1 << 24, 1 << 26]
+PI_VECTORS = [0, 4, 8]
+LIFE_BOARDS = [256, 1024, 2048]
+LIFE_ITERATIONS = 100
+
+
+def life_sizes(workdir):
+    """Acorn at the top left of square boards of each size"""
+    sizes = []
+    pattern = os.path.join(workdir, "acorn.dat")
+    with open(pattern, "w") as f:
+        for (x, y) in [(1, 0), (3, 1), (0, 2), (1, 2), (4, 2), (5, 2), (6, 2)]:
+            f.write("%d %d 1\n" % (x + 8, y + 8))
+    for n in LIFE_BOARDS:
+        params = os.path.join(workdir, "board%d.params" % n)
+        with open(params, "w") as f:
+            f.write("%d\n%d\n%d\n" % (n, n, LIFE_ITERATIONS))
+        sizes.append(("%dx%d" % (n, n), [pattern, params, "16", "16"]))
+    return sizes
+
+
+def suite(python, workdir):
+    life = life_sizes(workdir)
+    return [
+        ("vadd_chain", "C",      "Exercise04/C",      ["./vadd_chain"], DEFAULT, False),
+        ("vadd_chain", "C++",    "Exercise04/Cpp",    ["./vadd_chain"], DEFAULT, False),
+        ("vadd_chain", "Python", "Exercise04/Python", [python, "vadd_chain.py"], DEFAULT, True),
+        ("vadd_stream", "C++",   "Exercise04/Cpp",    ["./vadd_stream"],
+            [(str(n), ["--length", str(n)]) for n in VADD_LENGTHS], True),
+        ("vadd_abc",   "C",      "Exercise05/C",      ["./vadd_abc"], DEFAULT, False),
+        ("vadd_abc",   "C++",    "Exercise05/Cpp",    ["./vadd_abc"], DEFAULT, False),
+        ("vadd_abc",   "Python", "Exercise05/Python", [python, "vadd_abc.py"], DEFAULT, True),
+        ("matmul_06",  "C",      "Exercise06/C",      ["./mult"], DEFAULT, True),
+        ("matmul_06",  "C++",    "Exercise06/Cpp",    ["./mult"], DEFAULT, True),
+        ("matmul_06",  "Python", "Exercise06/Python", [python, "matmul.py"], DEFAULT, True),
+        ("matmul_07",  "C",      "Exercise07/C",      ["./mult"], DEFAULT, True),
+        ("matmul_07",  "C++",    "Exercise07/Cpp",    ["./mult"], DEFAULT, True),
+        ("matmul_07",  "Python", "Exercise07/Python", [python, "matmul.py"], DEFAULT, True),
+        ("matmul_08",  "C",      "Exercise08/C",      ["./mult"], DEFAULT, True),
+        ("matmul_08",  "C++",    "Exercise08/Cpp",    ["./mult"],
+            DEFAULT + [(str(n), ["--size", str(n), str(n), str(n)]) for n in MATMUL_ORDERS], True),
+        ("matmul_08",  "Python", "Exercise08/Python", [python, "matmul.py"], DEFAULT, True),
+        ("matmul_08",  "CUDA",   "Exercise08/CUDA",   ["./mult"],
+            DEFAULT + [(str(n), ["--size", str(n), str(n), str(n)]) for n in MATMUL_ORDERS], False),
+        ("pi",         "C",      "Exercise09/C",      ["./pi_ocl"], DEFAULT, True),
+        ("pi",         "C++",    "Exercise09/Cpp",    ["./pi_ocl"],
+            DEFAULT + [(str(n), ["--steps", str(n)]) for n in PI_STEPS], True),
+        ("pi",         "Python", "Exercise09/Python", [python, "pi_ocl.py"], DEFAULT, True),
+        ("pi",         "CUDA",   "Exercise09/CUDA",   ["./pi"],
+            DEFAULT + [(str(n), ["--steps", str(n)]) for n in PI_STEPS], False),
+        ("gameoflife", "C",      "Exercise13/C",      ["./gameoflife"], life, False),
+        ("gameoflife", "C++",    "Exercise13/Cpp",    ["./gameoflife"], life, False),
+        ("gameoflife", "Python", "Exercise13/Python", [python, "gameoflife.py"], life, True),
+        ("pi_vocl",    "C",      "ExerciseA/C",       ["./pi_vocl"],
+            [(str(v), [str(v)]) for v in PI_VECTORS if v], False),
+        ("pi_vocl",    "C++",    "ExerciseA/Cpp",     ["./pi_vocl"],
+            [(str(v), [str(v)]) for v in PI_VECTORS], False),
+        ("pi_vocl",    "Python", "ExerciseA/Python",  [python, "pi_vocl.py"],
+            [(str(v), [str(v)]) for v in PI_VECTORS if v], True),
+    ]
+
+
+SECONDS = re.compile(r"([0-9]+\.?[0-9]*(?:[eE][-+]?[0-9]+)?)\s+seconds")
+
+
+def cpp_devices(solutions):
+    """(index, name) of the devices, as the C++ programs number them"""
+    try:
+        out = subprocess.run(["./pi_ocl", "--list"], cwd=os.path.join(solutions, "Exercise09/Cpp"),
+                             stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                             universal_newlines=True).stdout
+    except OSError:
+        return []
+    return [(int(m.group(1)), m.group(2).strip())
+            for m in re.finditer(r"^(\d+): (.*)$", out, re.MULTILINE)]
+
+
+def python_contexts(python):
+    """PYOPENCL_CTX for each device, in the order of the C++ programs
+    (platforms in turn, then their devices)"""
+    probe = ("import pyopencl as cl\n"
+             "for p, platform in enumerate(cl.get_platforms()):\n"
+             "    for d in range(len(platform.get_devices())):\n"
+             "        print('%d:%d' % (p, d))\n")
+    try:
+        out = subprocess.run([python, "-c", probe], stdout=subprocess.PIPE,
+                             stderr=subprocess.DEVNULL, universal_newlines=True)
+    except OSError:
+        return []
+    return out.stdout.split() if out.returncode == 0 else []
+
+
+def run(command, cwd, env, timeout):
+    start = time.time()
+    try:
+        proc = subprocess.run(command, cwd=cwd, env=env, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT, universal_newlines=True,
+                              timeout=timeout)
+        status, out = proc.returncode, proc.stdout
+    except subprocess.TimeoutExpired:
+        status, out = "timeout", ""
+    except OSError as e:
+        status, out = "missing", str(e)
+    wall = time.time() - start
+
+    reported = [float(s) for s in SECONDS.findall(out)]
+    return status, wall, min(reported) if reported else None
+
+
+def write_report(rows, path):
+    fields = ["benchmark", "language", "program", "device", "size", "trial",
+              "status", "wall_s", "reported_s"]
+    if path.endswith(".json"):
+        with open(path, "w") as f:
+            json.dump({"runs": rows}, f, indent=2)
+    else:
+        with open(path, "w") as f:
+            writer = csv.DictWriter(f, fieldnames=fields)
+            writer.writeheader()
+            writer.writerows(rows)
+
+
+def summary(rows):
+    groups = {}
+    for row in rows:
+        if row["status"] != 0:
+            continue
+        key = (row["benchmark"], row["size"], row["device"], row["language"])
+        groups.setdefault(key, []).append(row)
+
+    print("\n%-12s %-10s %-28s %-7s %6s %12s %12s" %
+          ("benchmark", "size", "device", "lang", "trials", "wall_s", "reported_s"))
+    for key in sorted(groups):
+        runs = groups[key]
+        wall = statistics.median([r["wall_s"] for r in runs])
+        reported = [r["reported_s"] for r in runs if r["reported_s"] is not None]
+        print("%-12s %-10s %-28s %-7s %6d %12.4f %12s" %
+              (key[0], key[1], key[2][:28], key[3], len(runs), wall,
+               "%.4f" % statistics.median(reported) if reported else "-"))
+
+
+def main(argv):
+    solutions = "."
+    trials = 3
+    devices = None
+    python = "python"
+    out_path = "bench.csv"
+    only = None
+    timeout = 600
+
+    i = 1
+    while i < len(argv):
+        arg = argv[i]
+        value = argv[i + 1] if i + 1 < len(argv) else None
+        if arg == "--solutions" and value:
+            solutions = value
+        elif arg == "--trials" and value:
+            trials = max(1, int(value))
+        elif arg == "--devices" and value is not None:
+            devices = [int(d) for d in value.split(",") if d.strip()] or None
+        elif arg == "--python" and value:
+            python = value
+        elif arg == "--out" and value:
+            out_path = value
+        elif arg == "--only" and value:
+            only = value.split(",")
+        elif arg == "--timeout" and value:
+            timeout = int(value)
+        else:
+            print("Usage: bench_suite.py [--solutions DIR] [--trials N] [--devices LIST]\n"
+                  "                      [--python PYTHON] [--out FILE] [--only NAME,...]\n"
+                  "                      [--timeout SECONDS]", file=sys.stderr)
+            return 1
+        i += 2
+
+    solutions = os.path.abspath(solutions)
+    listed = cpp_devices(solutions)
+    if devices is not None:
+        listed = [(d, name) for (d, name) in listed if d in devices]
+    if not listed:
+        print("No OpenCL devices found (is Exercise09/Cpp/pi_ocl built?)", file=sys.stderr)
+        return 1
+    contexts = python_contexts(python)
+
+    workdir = tempfile.mkdtemp(prefix="bench_suite")
+    rows = []
+    for (benchmark, language, directory, command, sizes, takes_device) in suite(python, workdir):
+        if only and benchmark not in only:
+            continue
+        program = os.path.join(directory, os.path.basename(command[-1]))
+        cwd = os.path.join(solutions, directory)
+
+        targets = listed if takes_device else [(None, "default")]
+        for (index, device_name) in targets:
+            env = dict(os.environ)
+            device_args = []
+            if index is not None and language == "Python":
+                if index >= len(contexts):
+                    continue
+                env["PYOPENCL_CTX"] = contexts[index]
+            elif index is not None:
+                device_args = ["--device", str(index)]
+
+            for (label, size_args) in sizes:
+                for trial in range(trials):
+                    status, wall, reported = run(command + size_args + device_args, cwd, env, timeout)
+                    rows.append({"benchmark": benchmark, "language": language,
+                                 "program": program, "device": device_name, "size": label,
+                                 "trial": trial, "status": status, "wall_s": round(wall, 6),
+                                 "reported_s": reported})
+                    print("%-12s %-7s %-28s %-10s trial %d: %s, %.3f s" %
+                          (benchmark, language, device_name[:28], label, trial,
+                           "ok" if status == 0 else "failed (%s)" % status, wall))
+
+    write_report(rows, out_path)
+    summary(rows)
+    print("\nResults of %d runs written to %s" % (len(rows), out_path))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))